@@ -79,6 +79,8 @@ define VALID_VARS
   LIBROACH_SRC_DIR
   LINKFLAGS
   LOCAL_BIN
+  LZ4_DIR
+  LZ4_SRC_DIR
   MACOS
   MACOSX_DEPLOYMENT_TARGET
   MAKECMDGOALS
@@ -144,6 +146,8 @@ define VALID_VARS
   XHOST_BIN_DIR
   XHOST_TRIPLE
   YARN_INSTALLED_TARGET
+  ZSTD_DIR
+  ZSTD_SRC_DIR
   bindir
   cyan
   go-version-check
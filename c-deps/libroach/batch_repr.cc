@@ -0,0 +1,115 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "batch_repr.h"
+
+namespace {
+
+// GetVarint32 decodes a varint32 from the front of *buf, returning
+// false if the buffer is truncated or the varint is malformed.
+bool GetVarint32(rocksdb::Slice* buf, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0, i = 0; shift <= 28 && i < buf->size(); shift += 7, ++i) {
+    const uint32_t byte = uint8_t((*buf)[i]);
+    result |= (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      buf->remove_prefix(i + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetLengthPrefixedSlice(rocksdb::Slice* buf, rocksdb::Slice* result) {
+  uint32_t len;
+  if (!GetVarint32(buf, &len) || buf->size() < len) {
+    return false;
+  }
+  *result = rocksdb::Slice(buf->data(), len);
+  buf->remove_prefix(len);
+  return true;
+}
+
+}  // namespace
+
+BatchReprReader::BatchReprReader(const rocksdb::Slice& repr)
+    : repr_(repr), count_(0), seen_(0), type_(kBatchTypeNoop) {}
+
+bool BatchReprReader::Init() {
+  if (repr_.size() < kHeaderSize) {
+    return setError("batch repr too small");
+  }
+  const uint8_t* b = reinterpret_cast<const uint8_t*>(repr_.data() + 8);
+  count_ = uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+  repr_.remove_prefix(kHeaderSize);
+  return true;
+}
+
+bool BatchReprReader::setError(const std::string& err) {
+  if (error_.empty()) {
+    error_ = err;
+  }
+  repr_.clear();
+  return false;
+}
+
+bool BatchReprReader::Next() {
+  for (;;) {
+    if (!error_.empty()) {
+      return false;
+    }
+    if (repr_.empty()) {
+      if (seen_ != count_) {
+        return setError("batch repr count mismatch");
+      }
+      return false;
+    }
+
+    const char tag = repr_[0];
+    repr_.remove_prefix(1);
+    switch (tag) {
+    case kBatchTypeDeletion:
+    case kBatchTypeSingleDeletion:
+      if (!GetLengthPrefixedSlice(&repr_, &key_)) {
+        return setError("bad deletion entry");
+      }
+      value_.clear();
+      break;
+    case kBatchTypeValue:
+    case kBatchTypeMerge:
+    case kBatchTypeRangeDeletion:
+      if (!GetLengthPrefixedSlice(&repr_, &key_) || !GetLengthPrefixedSlice(&repr_, &value_)) {
+        return setError("bad value entry");
+      }
+      break;
+    case kBatchTypeLogData: {
+      // LogData entries are not counted and carry no key.
+      rocksdb::Slice blob;
+      if (!GetLengthPrefixedSlice(&repr_, &blob)) {
+        return setError("bad log data entry");
+      }
+      continue;
+    }
+    case kBatchTypeNoop:
+      continue;
+    default:
+      return setError("unsupported batch entry type: " + std::to_string(int(uint8_t(tag))));
+    }
+
+    type_ = BatchReprType(tag);
+    ++seen_;
+    return true;
+  }
+}
@@ -0,0 +1,89 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <rocksdb/slice.h>
+#include <stdint.h>
+#include <string>
+
+// BatchReprType is the type of an entry in an encoded RocksDB
+// batch. The values mirror the RocksDB ValueType constants (see
+// rocksdb/db/dbformat.h) and storage/engine/batch.go:BatchType.
+enum BatchReprType {
+  kBatchTypeDeletion = 0x0,
+  kBatchTypeValue = 0x1,
+  kBatchTypeMerge = 0x2,
+  kBatchTypeLogData = 0x3,
+  kBatchTypeSingleDeletion = 0x7,
+  kBatchTypeNoop = 0xD,
+  kBatchTypeRangeDeletion = 0xF,
+};
+
+// BatchReprReader walks the entries of an encoded RocksDB batch in
+// place, without first copying the repr into a rocksdb::WriteBatch
+// (which requires its own std::string). The returned keys and values
+// point into the memory backing the repr. Only entries for the
+// default column family are supported. LogData and Noop entries are
+// skipped.
+//
+// Usage:
+//
+//   BatchReprReader reader(repr);
+//   if (!reader.Init()) { ... reader.Error() ... }
+//   while (reader.Next()) {
+//     switch (reader.Type()) { ... reader.Key() ... reader.Value() ... }
+//   }
+//   if (!reader.Error().empty()) { ... }
+class BatchReprReader {
+ public:
+  // kHeaderSize is the size of the batch header: an 8-byte sequence
+  // number followed by a 4-byte count.
+  static const int kHeaderSize = 12;
+
+  explicit BatchReprReader(const rocksdb::Slice& repr);
+
+  // Init decodes the batch header, returning false on error.
+  bool Init();
+
+  // Count returns the number of entries the batch header claims the
+  // batch contains. Only valid after a successful call to Init.
+  uint32_t Count() const { return count_; }
+
+  // Next advances to the next entry, returning false when there are
+  // no more entries or an error occurs (see Error).
+  bool Next();
+
+  // Error returns a description of the first decoding error, or an
+  // empty string if no error has occurred.
+  const std::string& Error() const { return error_; }
+
+  // Type, Key and Value return the current entry. For range
+  // deletions Key and Value are the start and end keys.
+  BatchReprType Type() const { return type_; }
+  rocksdb::Slice Key() const { return key_; }
+  rocksdb::Slice Value() const { return value_; }
+
+ private:
+  bool setError(const std::string& err);
+
+ private:
+  rocksdb::Slice repr_;
+  uint32_t count_;
+  uint32_t seen_;
+  BatchReprType type_;
+  rocksdb::Slice key_;
+  rocksdb::Slice value_;
+  std::string error_;
+};
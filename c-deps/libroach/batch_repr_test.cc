@@ -0,0 +1,120 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include "batch_repr.h"
+
+namespace {
+
+// AppendEntry appends an entry in the RocksDB batch repr format. The
+// keys and values used by the test are short enough to be encoded
+// with single byte varints.
+void AppendEntry(std::string* repr, char tag, const std::string& key, const std::string* value) {
+  repr->push_back(tag);
+  repr->push_back(char(key.size()));
+  repr->append(key);
+  if (value != nullptr) {
+    repr->push_back(char(value->size()));
+    repr->append(*value);
+  }
+}
+
+std::string MakeHeader(uint32_t count) {
+  std::string header(BatchReprReader::kHeaderSize, '\0');
+  header[8] = char(count);
+  return header;
+}
+
+}  // namespace
+
+TEST(Libroach, BatchReprReader) {
+  const std::string v1 = "value";
+  const std::string end = "e";
+  std::string repr = MakeHeader(4);
+  AppendEntry(&repr, kBatchTypeValue, "a", &v1);
+  AppendEntry(&repr, kBatchTypeDeletion, "b", nullptr);
+  AppendEntry(&repr, kBatchTypeLogData, "ignored", nullptr);
+  AppendEntry(&repr, kBatchTypeMerge, "c", &v1);
+  AppendEntry(&repr, kBatchTypeRangeDeletion, "d", &end);
+
+  BatchReprReader reader(repr);
+  ASSERT_TRUE(reader.Init());
+  EXPECT_EQ(4, reader.Count());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(kBatchTypeValue, reader.Type());
+  EXPECT_EQ("a", reader.Key().ToString());
+  EXPECT_EQ(v1, reader.Value().ToString());
+  // The key and value point into the repr.
+  EXPECT_EQ(repr.data() + BatchReprReader::kHeaderSize + 2, reader.Key().data());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(kBatchTypeDeletion, reader.Type());
+  EXPECT_EQ("b", reader.Key().ToString());
+  EXPECT_TRUE(reader.Value().empty());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(kBatchTypeMerge, reader.Type());
+  EXPECT_EQ("c", reader.Key().ToString());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(kBatchTypeRangeDeletion, reader.Type());
+  EXPECT_EQ("d", reader.Key().ToString());
+  EXPECT_EQ(end, reader.Value().ToString());
+
+  EXPECT_FALSE(reader.Next());
+  EXPECT_EQ("", reader.Error());
+}
+
+TEST(Libroach, BatchReprReaderErrors) {
+  const std::string v1 = "value";
+
+  {
+    BatchReprReader reader(rocksdb::Slice("short"));
+    EXPECT_FALSE(reader.Init());
+    EXPECT_NE("", reader.Error());
+  }
+
+  {
+    // Count mismatch.
+    std::string repr = MakeHeader(2);
+    AppendEntry(&repr, kBatchTypeValue, "a", &v1);
+    BatchReprReader reader(repr);
+    ASSERT_TRUE(reader.Init());
+    EXPECT_TRUE(reader.Next());
+    EXPECT_FALSE(reader.Next());
+    EXPECT_EQ("batch repr count mismatch", reader.Error());
+  }
+
+  {
+    // Truncated value.
+    std::string repr = MakeHeader(1);
+    AppendEntry(&repr, kBatchTypeValue, "a", &v1);
+    repr.resize(repr.size() - 1);
+    BatchReprReader reader(repr);
+    ASSERT_TRUE(reader.Init());
+    EXPECT_FALSE(reader.Next());
+    EXPECT_EQ("bad value entry", reader.Error());
+  }
+
+  {
+    // Unsupported (column family) entry type.
+    std::string repr = MakeHeader(1);
+    AppendEntry(&repr, 0x5, "a", &v1);
+    BatchReprReader reader(repr);
+    ASSERT_TRUE(reader.Init());
+    EXPECT_FALSE(reader.Next());
+    EXPECT_EQ("unsupported batch entry type: 5", reader.Error());
+  }
+}
@@ -0,0 +1,921 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "blob_store.h"
+#include <algorithm>
+#include <inttypes.h>
+#include <limits>
+#include <rocksdb/experimental.h>
+#include <string.h>
+#include <vector>
+#include "batch_repr.h"
+#include "db.h"
+#include "encoding.h"
+#include "fmt.h"
+
+namespace {
+
+// kBlobReferenceTag is the roachpb.Value tag of a blob reference. It
+// is not a valid roachpb.ValueType so that a reference can never be
+// mistaken for a value.
+const char kBlobReferenceTag = char(0xfe);
+const int kBlobReferenceTagPos = 4;
+
+// kBlobFilesPropName is the sstable property holding the (encoded)
+// numbers of the blob files referenced by the sstable, and
+// kBlobRefBytesPropName the property holding each of those numbers
+// followed by the total size of the values referenced in the file.
+// The former is still written so that the sstables remain readable by
+// versions which only know about it.
+const char kBlobFilesPropName[] = "crdb.blob.files";
+const char kBlobRefBytesPropName[] = "crdb.blob.ref_bytes";
+
+const char kBlobFileSuffix[] = ".blob";
+
+// The size of the chunks blob files are copied in.
+const size_t kCopyChunkSize = 1 << 20;
+
+// The total size of the values whose references are rewritten at a
+// time by a relocation. Other writes wait while a chunk is rewritten.
+const size_t kRelocateChunkSize = 1 << 20;
+
+std::string encodeBlobReference(uint64_t file, uint64_t offset, uint32_t size) {
+  std::string ref(kBlobReferenceTagPos, '\0');
+  ref.push_back(kBlobReferenceTag);
+  EncodeUint64(&ref, file);
+  EncodeUint64(&ref, offset);
+  EncodeUint32(&ref, size);
+  return ref;
+}
+
+bool decodeBlobReference(rocksdb::Slice ref, uint64_t* file, uint64_t* offset, uint32_t* size) {
+  if (!IsBlobReference(ref)) {
+    return false;
+  }
+  ref.remove_prefix(kBlobReferenceTagPos + 1);
+  return DecodeUint64(&ref, file) && DecodeUint64(&ref, offset) && DecodeUint32(&ref, size);
+}
+
+// parseBlobFileName returns true if name is the name of a blob file,
+// setting *number to its number.
+bool parseBlobFileName(const std::string& name, uint64_t* number) {
+  const size_t suffix_len = sizeof(kBlobFileSuffix) - 1;
+  if (name.size() <= suffix_len ||
+      name.compare(name.size() - suffix_len, suffix_len, kBlobFileSuffix) != 0) {
+    return false;
+  }
+  uint64_t n = 0;
+  for (size_t i = 0; i < name.size() - suffix_len; i++) {
+    if (name[i] < '0' || name[i] > '9') {
+      return false;
+    }
+    n = n * 10 + (name[i] - '0');
+  }
+  *number = n;
+  return true;
+}
+
+// BlobRefTblPropCollector records the numbers of the blob files
+// referenced by the values in an sstable and the total size of the
+// values referenced in each.
+class BlobRefTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  const char* Name() const override { return "BlobRefTblPropCollector"; }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    std::string files;
+    std::string ref_bytes;
+    for (const auto& f : files_) {
+      EncodeUint64(&files, f.first);
+      EncodeUint64(&ref_bytes, f.first);
+      EncodeUint64(&ref_bytes, f.second);
+    }
+    *properties = rocksdb::UserCollectedProperties{
+        {kBlobFilesPropName, files},
+        {kBlobRefBytesPropName, ref_bytes},
+    };
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
+                             rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                             uint64_t file_size) override {
+    uint64_t file, offset;
+    uint32_t size;
+    if (type == rocksdb::kEntryPut && decodeBlobReference(value, &file, &offset, &size)) {
+      files_[file] += size;
+    }
+    return rocksdb::Status::OK();
+  }
+
+  virtual rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return rocksdb::UserCollectedProperties{};
+  }
+
+ private:
+  std::map<uint64_t, uint64_t> files_;
+};
+
+class BlobRefTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new BlobRefTblPropCollector();
+  }
+  const char* Name() const override { return "BlobRefTblPropCollectorFactory"; }
+};
+
+// addRefBytes adds b to *a, saturating at the unknown size.
+void addRefBytes(uint64_t* a, uint64_t b) {
+  *a = (*a > std::numeric_limits<uint64_t>::max() - b) ? std::numeric_limits<uint64_t>::max()
+                                                         : *a + b;
+}
+
+}  // namespace
+
+const double BlobStore::kMinLiveRatio = 0.5;
+const uint64_t BlobStore::kUnknownRefBytes;
+
+bool IsBlobReference(const rocksdb::Slice& value) {
+  return value.size() == kBlobReferenceSize && value[kBlobReferenceTagPos] == kBlobReferenceTag &&
+         memcmp(value.data(), "\0\0\0\0", kBlobReferenceTagPos) == 0;
+}
+
+uint64_t BlobValueSize(const rocksdb::Slice& value) {
+  uint64_t file, offset;
+  uint32_t size;
+  if (!decodeBlobReference(value, &file, &offset, &size)) {
+    return value.size();
+  }
+  return size;
+}
+
+BlobStore::BlobStore(rocksdb::Env* env, const std::string& dir, uint64_t threshold,
+                     std::shared_ptr<rocksdb::Logger> logger)
+    : env_(env),
+      dir_(dir),
+      // Separating a value no larger than its reference would not save
+      // anything.
+      threshold_(threshold > 0 ? std::max<uint64_t>(threshold, kBlobReferenceSize) : 0),
+      logger_(logger),
+      flushed_seq_(0),
+      next_file_(1),
+      cur_file_(0),
+      epoch_(0),
+      db_(nullptr),
+      stopping_(false),
+      relocated_bytes_(0),
+      writers_(0),
+      relocating_(false) {}
+
+BlobStore::~BlobStore() {
+  Stop();
+  if (writer_ != nullptr) {
+    writer_->Close();
+  }
+}
+
+std::string BlobStore::fileName(uint64_t number) const {
+  return fmt::StringPrintf("%s/%06" PRIu64 "%s", dir_.c_str(), number, kBlobFileSuffix);
+}
+
+rocksdb::Status BlobStore::Open() {
+  rocksdb::Status status = env_->CreateDirIfMissing(dir_);
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<std::string> children;
+  status = env_->GetChildren(dir_, &children);
+  if (!status.ok()) {
+    return status;
+  }
+
+  std::lock_guard<std::mutex> l(mu_);
+  for (const auto& name : children) {
+    uint64_t number;
+    if (!parseBlobFileName(name, &number)) {
+      continue;
+    }
+    // The files written before the restart are sealed. The writes in
+    // the WAL which referenced them are replayed when the DB is
+    // opened, so they precede the sequence number the files are sealed
+    // at by the first garbage collection.
+    blobFile& f = files_[number];
+    f.sealed = true;
+    status = env_->GetFileSize(fileName(number), &f.size);
+    if (!status.ok()) {
+      return status;
+    }
+    next_file_ = std::max(next_file_, number + 1);
+  }
+  rocksdb::Info(logger_, "opened blob store with %d files (separation threshold %" PRIu64 ")",
+                int(files_.size()), threshold_);
+  if (threshold_ == 0) {
+    return rocksdb::Status::OK();
+  }
+  return newFileLocked();
+}
+
+rocksdb::Status BlobStore::newFileLocked() {
+  if (writer_ != nullptr) {
+    rocksdb::Status status = writer_->Sync();
+    if (status.ok()) {
+      status = writer_->Close();
+    }
+    if (!status.ok()) {
+      return status;
+    }
+    writer_.reset();
+    files_[cur_file_].sealed = true;
+  }
+  const uint64_t number = next_file_++;
+  rocksdb::Status status =
+      env_->NewWritableFile(fileName(number), &writer_, rocksdb::EnvOptions());
+  if (!status.ok()) {
+    return status;
+  }
+  files_[number] = blobFile();
+  cur_file_ = number;
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status BlobStore::Separate(const rocksdb::WriteBatch& batch, bool sync,
+                                    rocksdb::WriteBatch* out, bool* separated, uint64_t* file) {
+  *separated = false;
+  if (threshold_ == 0) {
+    return rocksdb::Status::OK();
+  }
+
+  // Only values at versioned keys (whose encoded timestamp length
+  // suffix is non-zero) are separated.
+  auto separate = [this](const BatchReprReader& reader) {
+    return reader.Type() == kBatchTypeValue && reader.Value().size() > threshold_ &&
+           reader.Value().size() <= std::numeric_limits<uint32_t>::max() &&
+           !reader.Key().empty() && reader.Key()[reader.Key().size() - 1] != 0;
+  };
+
+  // Most batches contain no large values, so check for them without
+  // copying the batch first.
+  {
+    BatchReprReader reader(batch.Data());
+    if (!reader.Init()) {
+      return rocksdb::Status::Corruption(reader.Error());
+    }
+    bool found = false;
+    while (!found && reader.Next()) {
+      found = separate(reader);
+    }
+    if (!reader.Error().empty()) {
+      return rocksdb::Status::Corruption(reader.Error());
+    }
+    if (!found) {
+      return rocksdb::Status::OK();
+    }
+  }
+
+  std::lock_guard<std::mutex> l(mu_);
+  if (files_[cur_file_].size >= kMaxBlobFileSize) {
+    rocksdb::Status status = newFileLocked();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  blobFile& f = files_[cur_file_];
+
+  out->Clear();
+  BatchReprReader reader(batch.Data());
+  reader.Init();
+  while (reader.Next()) {
+    switch (reader.Type()) {
+    case kBatchTypeValue:
+      if (separate(reader)) {
+        rocksdb::Status status = writer_->Append(reader.Value());
+        if (!status.ok()) {
+          return status;
+        }
+        out->Put(reader.Key(),
+                 encodeBlobReference(cur_file_, f.size, uint32_t(reader.Value().size())));
+        f.size += reader.Value().size();
+      } else {
+        out->Put(reader.Key(), reader.Value());
+      }
+      break;
+    case kBatchTypeDeletion:
+      out->Delete(reader.Key());
+      break;
+    case kBatchTypeSingleDeletion:
+      out->SingleDelete(reader.Key());
+      break;
+    case kBatchTypeMerge:
+      out->Merge(reader.Key(), reader.Value());
+      break;
+    case kBatchTypeRangeDeletion:
+      out->DeleteRange(reader.Key(), reader.Value());
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Flush the values to the OS so that the file can be read before it
+  // is synced.
+  rocksdb::Status status = writer_->Flush();
+  if (status.ok() && sync) {
+    status = writer_->Sync();
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  ++f.writes;
+  *file = cur_file_;
+  *separated = true;
+  return rocksdb::Status::OK();
+}
+
+void BlobStore::EndWrite(uint64_t file) {
+  std::lock_guard<std::mutex> l(mu_);
+  --files_[file].writes;
+}
+
+rocksdb::Status BlobStore::Get(const rocksdb::Slice& ref, std::string* value) {
+  uint64_t file, offset;
+  uint32_t size;
+  if (!decodeBlobReference(ref, &file, &offset, &size)) {
+    return rocksdb::Status::Corruption("invalid blob reference");
+  }
+
+  std::shared_ptr<rocksdb::RandomAccessFile> reader;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    auto it = files_.find(file);
+    if (it == files_.end()) {
+      return rocksdb::Status::Corruption(
+          fmt::StringPrintf("blob file %06" PRIu64 " not found", file));
+    }
+    if (it->second.reader == nullptr) {
+      std::unique_ptr<rocksdb::RandomAccessFile> f;
+      rocksdb::Status status = env_->NewRandomAccessFile(fileName(file), &f, rocksdb::EnvOptions());
+      if (!status.ok()) {
+        return status;
+      }
+      it->second.reader.reset(f.release());
+    }
+    reader = it->second.reader;
+  }
+
+  value->resize(size);
+  rocksdb::Slice result;
+  rocksdb::Status status = reader->Read(offset, size, &result, &(*value)[0]);
+  if (!status.ok()) {
+    return status;
+  }
+  if (result.size() != size) {
+    return rocksdb::Status::Corruption(fmt::StringPrintf(
+        "short read of blob file %06" PRIu64 " at offset %" PRIu64, file, offset));
+  }
+  if (result.data() != value->data()) {
+    memcpy(&(*value)[0], result.data(), size);
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status BlobStore::Sync() {
+  std::lock_guard<std::mutex> l(mu_);
+  if (writer_ == nullptr) {
+    return rocksdb::Status::OK();
+  }
+  return writer_->Sync();
+}
+
+uint64_t BlobStore::Pin() {
+  std::lock_guard<std::mutex> l(mu_);
+  pins_.insert(epoch_);
+  return epoch_;
+}
+
+void BlobStore::Unpin(uint64_t epoch) {
+  std::lock_guard<std::mutex> l(mu_);
+  pins_.erase(pins_.find(epoch));
+}
+
+void BlobStore::Start(rocksdb::DB* db) {
+  std::lock_guard<std::mutex> l(mu_);
+  if (!thread_.joinable()) {
+    db_ = db;
+    stopping_ = false;
+    thread_ = std::thread(&BlobStore::run, this);
+  }
+}
+
+void BlobStore::Stop() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BlobStore::AcquireWriter() {
+  for (;;) {
+    // Both the count and the flag are sequentially consistent, so
+    // either the writer sees the pending relocation or the relocation
+    // sees the writer.
+    writers_.fetch_add(1);
+    if (!relocating_.load()) {
+      return;
+    }
+    ReleaseWriter();
+    std::unique_lock<std::mutex> l(gate_mu_);
+    gate_cv_.wait(l, [this] { return !relocating_.load(); });
+  }
+}
+
+void BlobStore::ReleaseWriter() {
+  if (writers_.fetch_sub(1) == 1 && relocating_.load()) {
+    std::lock_guard<std::mutex> l(gate_mu_);
+    gate_cv_.notify_all();
+  }
+}
+
+void BlobStore::addTableLocked(const std::string& path, const rocksdb::TableProperties& props) {
+  const rocksdb::UserCollectedProperties& user = props.user_collected_properties;
+  tableRefs& refs = tables_[path];
+  refs.clear();
+  auto it = user.find(kBlobRefBytesPropName);
+  if (it != user.end()) {
+    rocksdb::Slice buf(it->second);
+    uint64_t f, bytes;
+    while (DecodeUint64(&buf, &f) && DecodeUint64(&buf, &bytes)) {
+      addRefBytes(&refs[f], bytes);
+    }
+    return;
+  }
+  it = user.find(kBlobFilesPropName);
+  if (it != user.end()) {
+    rocksdb::Slice buf(it->second);
+    uint64_t f;
+    while (DecodeUint64(&buf, &f)) {
+      refs[f] = kUnknownRefBytes;
+    }
+  }
+}
+
+rocksdb::Status BlobStore::CollectGarbage(rocksdb::DB* db) {
+  // The flushed sequence number must be loaded before the sstables are
+  // listed so that the sstables written by the flushes it reflects are
+  // included.
+  const uint64_t flushed_seq = flushed_seq_.load();
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  db->GetLiveFilesMetaData(&metadata);
+  std::vector<std::string> paths;
+  paths.reserve(metadata.size());
+  for (const auto& m : metadata) {
+    paths.push_back(m.db_path + m.name);
+  }
+
+  // The references of the sstables are recorded as they are written.
+  // Those of the sstables which predate the store, or whose event has
+  // not been delivered yet, are read from their properties.
+  bool missing = false;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    for (const auto& path : paths) {
+      if (tables_.find(path) == tables_.end()) {
+        missing = true;
+        break;
+      }
+    }
+  }
+  if (missing) {
+    rocksdb::TablePropertiesCollection props;
+    rocksdb::Status status = db->GetPropertiesOfAllTables(&props);
+    if (!status.ok()) {
+      return status;
+    }
+    std::lock_guard<std::mutex> l(mu_);
+    for (const auto& path : paths) {
+      auto it = props.find(path);
+      if (it != props.end() && tables_.find(path) == tables_.end()) {
+        addTableLocked(path, *it->second);
+      }
+    }
+  }
+
+  std::vector<uint64_t> deletable;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    std::map<uint64_t, uint64_t> live;
+    for (const auto& path : paths) {
+      auto t = tables_.find(path);
+      if (t == tables_.end()) {
+        // The sstable was deleted since it was listed.
+        continue;
+      }
+      for (const auto& ref : t->second) {
+        addRefBytes(&live[ref.first], ref.second);
+      }
+    }
+
+    bool marked = false;
+    for (auto it = files_.begin(); it != files_.end();) {
+      blobFile& f = it->second;
+      if (f.sealed && !f.has_sealed_seq && f.writes == 0) {
+        // All of the writes to the file have been applied, so they
+        // precede the current sequence number.
+        f.sealed_seq = db->GetLatestSequenceNumber();
+        f.has_sealed_seq = true;
+      }
+      // Once the writes to the file have been flushed, all of its
+      // references are in the sstables.
+      const bool flushed = f.has_sealed_seq && f.sealed_seq <= flushed_seq;
+      auto refs = live.find(it->first);
+      if (!f.obsolete && flushed && refs == live.end()) {
+        f.obsolete = true;
+        f.obsolete_epoch = epoch_;
+        marked = true;
+      }
+      if (f.obsolete && (pins_.empty() || *pins_.begin() > f.obsolete_epoch)) {
+        deletable.push_back(it->first);
+        it = files_.erase(it);
+        continue;
+      }
+      if (!f.obsolete && !f.relocated && flushed && db_ != nullptr && refs != live.end() &&
+          double(refs->second) < kMinLiveRatio * double(f.size)) {
+        f.relocated = true;
+        relocate_queue_.insert(it->first);
+        queued = true;
+      }
+      ++it;
+    }
+    if (marked) {
+      // Readers which pin the store from now on see a DB which no
+      // longer references the newly obsolete files.
+      ++epoch_;
+    }
+  }
+  if (queued) {
+    cv_.notify_one();
+  }
+
+  for (auto f : deletable) {
+    rocksdb::Status status = env_->DeleteFile(fileName(f));
+    if (!status.ok()) {
+      return status;
+    }
+    rocksdb::Info(logger_, "deleted blob file %06" PRIu64, f);
+  }
+  return rocksdb::Status::OK();
+}
+
+void BlobStore::run() {
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    cv_.wait(l, [this] { return stopping_ || !relocate_queue_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    std::set<uint64_t> files;
+    files.swap(relocate_queue_);
+    l.unlock();
+    rocksdb::Status status = relocate(files);
+    if (!status.ok()) {
+      rocksdb::Warn(logger_, "blob relocation failed: %s", status.ToString().c_str());
+    }
+    l.lock();
+  }
+}
+
+rocksdb::Status BlobStore::relocate(const std::set<uint64_t>& files) {
+  // Only the spans of the sstables which reference the files need to
+  // be scanned. Merge the spans which overlap.
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  db_->GetLiveFilesMetaData(&metadata);
+  std::vector<std::pair<std::string, std::string>> spans;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    for (const auto& m : metadata) {
+      auto t = tables_.find(m.db_path + m.name);
+      if (t == tables_.end()) {
+        continue;
+      }
+      for (auto f : files) {
+        if (t->second.count(f) > 0) {
+          spans.emplace_back(m.smallestkey, m.largestkey);
+          break;
+        }
+      }
+    }
+  }
+  std::sort(spans.begin(), spans.end(),
+            [cmp](const std::pair<std::string, std::string>& a,
+                  const std::pair<std::string, std::string>& b) {
+              return cmp->Compare(a.first, b.first) < 0;
+            });
+  std::vector<std::pair<std::string, std::string>> merged;
+  for (auto& span : spans) {
+    if (!merged.empty() && cmp->Compare(span.first, merged.back().second) <= 0) {
+      if (cmp->Compare(span.second, merged.back().second) > 0) {
+        merged.back().second = std::move(span.second);
+      }
+      continue;
+    }
+    merged.push_back(std::move(span));
+  }
+
+  // The values are read through an iterator pinned (together with the
+  // blob files it may see) for the duration of the scan, which must be
+  // released before the relocated values are accounted for so that
+  // the files they were relocated from can be deleted.
+  uint64_t written = 0;
+  {
+    BlobReadPin pin(this);
+    rocksdb::ReadOptions opts;
+    opts.total_order_seek = true;
+    opts.fill_cache = false;
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(opts));
+    std::vector<relocation> chunk;
+    size_t chunk_size = 0;
+    for (const auto& span : merged) {
+      for (iter->Seek(span.first); iter->Valid() && cmp->Compare(iter->key(), span.second) <= 0;
+           iter->Next()) {
+        if (stopping_.load()) {
+          return rocksdb::Status::OK();
+        }
+        uint64_t file, offset;
+        uint32_t size;
+        if (!decodeBlobReference(iter->value(), &file, &offset, &size) ||
+            files.count(file) == 0) {
+          continue;
+        }
+        relocation r;
+        r.key = iter->key().ToString();
+        r.ref = iter->value().ToString();
+        rocksdb::Status status = Get(iter->value(), &r.value);
+        if (!status.ok()) {
+          return status;
+        }
+        chunk_size += r.value.size();
+        chunk.push_back(std::move(r));
+        if (chunk_size >= kRelocateChunkSize) {
+          status = relocateChunk(&chunk, &written);
+          if (!status.ok()) {
+            return status;
+          }
+          chunk_size = 0;
+        }
+      }
+      if (!iter->status().ok()) {
+        return iter->status();
+      }
+    }
+    rocksdb::Status status = relocateChunk(&chunk, &written);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  // The old references remain in the sstables until compactions drop
+  // them, so ask for the spans to be compacted.
+  for (const auto& span : merged) {
+    const rocksdb::Slice begin(span.first);
+    const rocksdb::Slice end(span.second);
+    rocksdb::Status status = rocksdb::experimental::SuggestCompactRange(db_, &begin, &end);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  relocated_bytes_ += int64_t(written);
+  rocksdb::Info(logger_, "relocated %" PRIu64 " bytes from %d blob files", written,
+                int(files.size()));
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status BlobStore::relocateChunk(std::vector<relocation>* chunk, uint64_t* written) {
+  if (chunk->empty()) {
+    return rocksdb::Status::OK();
+  }
+
+  // Exclude the other writes while the references are checked and
+  // rewritten, so that a key written (or deleted) since it was read is
+  // left alone.
+  {
+    std::unique_lock<std::mutex> l(gate_mu_);
+    relocating_.store(true);
+    gate_cv_.wait(l, [this] { return writers_.load() == 0; });
+  }
+  rocksdb::WriteBatch batch;
+  uint64_t bytes = 0;
+  rocksdb::Status status;
+  for (const auto& r : *chunk) {
+    std::string cur;
+    status = db_->Get(rocksdb::ReadOptions(), r.key, &cur);
+    if (status.IsNotFound() || (status.ok() && cur != r.ref)) {
+      status = rocksdb::Status::OK();
+      continue;
+    }
+    if (!status.ok()) {
+      break;
+    }
+    batch.Put(r.key, r.value);
+    bytes += r.value.size();
+  }
+  if (status.ok() && batch.Count() > 0) {
+    // The values are synced to the blob file before the references to
+    // them are written.
+    rocksdb::WriteBatch separated_batch;
+    bool separated;
+    uint64_t file;
+    status = Separate(batch, true, &separated_batch, &separated, &file);
+    if (status.ok()) {
+      status = db_->Write(rocksdb::WriteOptions(), separated ? &separated_batch : &batch);
+      if (separated) {
+        EndWrite(file);
+      }
+    }
+  }
+  {
+    std::lock_guard<std::mutex> l(gate_mu_);
+    relocating_.store(false);
+  }
+  gate_cv_.notify_all();
+
+  if (status.ok()) {
+    *written += bytes;
+  }
+  chunk->clear();
+  return status;
+}
+
+rocksdb::Status BlobStore::CopyFiles(const std::string& dir) {
+  rocksdb::Status status = Sync();
+  if (!status.ok()) {
+    return status;
+  }
+  status = env_->CreateDirIfMissing(dir);
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> files;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    for (const auto& f : files_) {
+      files.push_back(std::make_pair(f.first, f.second.size));
+    }
+  }
+
+  std::string scratch(kCopyChunkSize, '\0');
+  for (const auto& f : files) {
+    std::unique_ptr<rocksdb::SequentialFile> src;
+    status = env_->NewSequentialFile(fileName(f.first), &src, rocksdb::EnvOptions());
+    if (!status.ok()) {
+      return status;
+    }
+    std::unique_ptr<rocksdb::WritableFile> dst;
+    status = env_->NewWritableFile(
+        fmt::StringPrintf("%s/%06" PRIu64 "%s", dir.c_str(), f.first, kBlobFileSuffix), &dst,
+        rocksdb::EnvOptions());
+    if (!status.ok()) {
+      return status;
+    }
+    // Only the size known when the files were listed is copied; any
+    // values appended since are not referenced by the copy.
+    for (uint64_t remaining = f.second; remaining > 0;) {
+      rocksdb::Slice chunk;
+      status = src->Read(std::min<uint64_t>(remaining, scratch.size()), &chunk, &scratch[0]);
+      if (!status.ok()) {
+        return status;
+      }
+      if (chunk.empty()) {
+        return rocksdb::Status::Corruption(
+            fmt::StringPrintf("blob file %06" PRIu64 " is truncated", f.first));
+      }
+      status = dst->Append(chunk);
+      if (!status.ok()) {
+        return status;
+      }
+      remaining -= chunk.size();
+    }
+    status = dst->Sync();
+    if (status.ok()) {
+      status = dst->Close();
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return rocksdb::Status::OK();
+}
+
+void BlobStore::GetStats(int64_t* files, int64_t* bytes) {
+  std::lock_guard<std::mutex> l(mu_);
+  *files = files_.size();
+  *bytes = 0;
+  for (const auto& f : files_) {
+    *bytes += f.second.size;
+  }
+}
+
+void BlobStore::OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    addTableLocked(info.file_path, info.table_properties);
+  }
+  uint64_t seq = flushed_seq_.load();
+  while (info.largest_seqno > seq && !flushed_seq_.compare_exchange_weak(seq, info.largest_seqno)) {
+  }
+  rocksdb::Status status = CollectGarbage(db);
+  if (!status.ok()) {
+    rocksdb::Warn(logger_, "blob garbage collection failed: %s", status.ToString().c_str());
+  }
+}
+
+void BlobStore::OnCompactionCompleted(rocksdb::DB* db, const rocksdb::CompactionJobInfo& ci) {
+  {
+    // The compaction's table properties cover both its inputs and its
+    // outputs. A trivial move lists the same file as input and output.
+    std::lock_guard<std::mutex> l(mu_);
+    for (const auto& path : ci.input_files) {
+      if (std::find(ci.output_files.begin(), ci.output_files.end(), path) ==
+          ci.output_files.end()) {
+        tables_.erase(path);
+      }
+    }
+    for (const auto& path : ci.output_files) {
+      auto it = ci.table_properties.find(path);
+      if (it != ci.table_properties.end()) {
+        addTableLocked(path, *it->second);
+      }
+    }
+  }
+  rocksdb::Status status = CollectGarbage(db);
+  if (!status.ok()) {
+    rocksdb::Warn(logger_, "blob garbage collection failed: %s", status.ToString().c_str());
+  }
+}
+
+void BlobStore::OnExternalFileIngested(rocksdb::DB* db,
+                                       const rocksdb::ExternalFileIngestionInfo& info) {
+  std::lock_guard<std::mutex> l(mu_);
+  addTableLocked(info.internal_file_path, info.table_properties);
+}
+
+void BlobStore::OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) {
+  std::lock_guard<std::mutex> l(mu_);
+  tables_.erase(info.file_path);
+}
+
+BlobReadPin& BlobReadPin::operator=(BlobReadPin&& other) {
+  if (this != &other) {
+    reset();
+    store_ = other.store_;
+    epoch_ = other.epoch_;
+    other.store_ = nullptr;
+  }
+  return *this;
+}
+
+void BlobReadPin::Repin() {
+  if (store_ != nullptr) {
+    const uint64_t epoch = store_->Pin();
+    store_->Unpin(epoch_);
+    epoch_ = epoch;
+  }
+}
+
+void BlobReadPin::reset() {
+  if (store_ != nullptr) {
+    store_->Unpin(epoch_);
+    store_ = nullptr;
+  }
+}
+
+rocksdb::Status ResolveBlobValue(BlobStore* store, rocksdb::Slice* value, std::string* buf) {
+  if (store == nullptr || !IsBlobReference(*value)) {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status status = store->Get(*value, buf);
+  if (status.ok()) {
+    *value = *buf;
+  }
+  return status;
+}
+
+rocksdb::TablePropertiesCollectorFactory* NewBlobRefTblPropCollectorFactory() {
+  return new BlobRefTblPropCollectorFactory();
+}
@@ -0,0 +1,307 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <rocksdb/env.h>
+#include <rocksdb/listener.h>
+#include <rocksdb/table_properties.h>
+#include <rocksdb/write_batch.h>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// kBlobReferenceSize is the size of an encoded blob reference. A
+// reference has the layout of a roachpb.Value with a zero checksum
+// and a tag (kBlobReferenceTag) which is not a valid ValueType,
+// followed by the fixed 8-byte blob file number, the fixed 8-byte
+// offset of the value in the file and its fixed 4-byte size.
+const int kBlobReferenceSize = 25;
+
+// IsBlobReference returns true if the value is a reference to a value
+// stored in a blob file.
+bool IsBlobReference(const rocksdb::Slice& value);
+
+// BlobValueSize returns the size of the value a reference refers to,
+// or the size of the value itself if it is not a reference. The MVCC
+// stats are computed using the size of the referenced values so that
+// they match the stats maintained by the Go side.
+uint64_t BlobValueSize(const rocksdb::Slice& value);
+
+// BlobStore implements key-value separation. Large MVCC values are
+// written to append-only blob files and the LSM stores a small
+// reference to the value in their place, so that compactions do not
+// repeatedly rewrite them.
+//
+// Only versioned values (i.e. those whose key has a non-zero
+// timestamp) larger than the threshold are separated. Unversioned
+// keys, which hold the MVCCMetadata of intents, inline values and
+// time series data, and all merge operands are always stored in the
+// LSM, so the merge operator and the compaction filter never see a
+// reference. References are resolved when values are returned to the
+// caller: by the MVCC scanner, DBGet and iterators.
+//
+// Blob files are garbage collected in the wake of flushes and
+// compactions. Each sstable records the blob files it references, and
+// how many bytes of values in each, in its properties (see
+// NewBlobRefTblPropCollectorFactory). The store keeps these
+// references for every live sstable up to date from the sstables
+// written and removed by flushes, compactions and ingestions. A blob
+// file is deleted once it is no longer written to, all of the writes
+// which referenced it have been flushed from the memtable, no live
+// sstable references it and no reader (see BlobReadPin) which might
+// still see an older sstable which did remains.
+//
+// A blob file in which less than kMinLiveRatio of the bytes are still
+// referenced is relocated by a background thread: the live values are
+// copied to the current blob file and their references rewritten,
+// after which the compaction of the sstables holding the old
+// references is requested so that the file can be deleted. To ensure
+// a rewrite never overwrites a concurrent write to the same key, the
+// rewrites are applied while no other write is in progress (see
+// BlobWriteGuard) and only if the key still holds the old reference.
+class BlobStore : public rocksdb::EventListener {
+ public:
+  // kMaxBlobFileSize is the size at which a new blob file is started.
+  static const uint64_t kMaxBlobFileSize = 64 << 20;
+  // kMinLiveRatio is the fraction of a blob file's bytes which must be
+  // referenced for it not to be relocated.
+  static const double kMinLiveRatio;
+
+  // The blob store uses the given env for its files in dir, which is
+  // created if it does not exist. Values larger than threshold bytes
+  // are separated. A threshold of zero disables separation, though
+  // existing blob files are still read and garbage collected.
+  BlobStore(rocksdb::Env* env, const std::string& dir, uint64_t threshold,
+            std::shared_ptr<rocksdb::Logger> logger);
+  virtual ~BlobStore();
+
+  // Open lists the existing blob files and starts a new file for
+  // writes. It must be called before the DB is opened.
+  rocksdb::Status Open();
+
+  // Separate moves the large values of the batch to the current blob
+  // file, syncing it if sync is true. If any values were moved,
+  // separated is set to true, *out holds the batch with references in
+  // their place and *file is the blob file they were written to, which
+  // must be passed to EndWrite once *out has been applied (or failed
+  // to apply). Otherwise the batch should be written as is.
+  rocksdb::Status Separate(const rocksdb::WriteBatch& batch, bool sync, rocksdb::WriteBatch* out,
+                           bool* separated, uint64_t* file);
+  void EndWrite(uint64_t file);
+
+  // Get reads the value the reference refers to.
+  rocksdb::Status Get(const rocksdb::Slice& ref, std::string* value);
+
+  // Sync syncs the current blob file.
+  rocksdb::Status Sync();
+
+  // Pin returns a token which prevents the deletion of the blob files
+  // visible to the caller until it is passed to Unpin. Readers pin the
+  // store before acquiring their view of the DB. See BlobReadPin.
+  uint64_t Pin();
+  void Unpin(uint64_t epoch);
+
+  // Start starts relocating the sparsely referenced blob files of db.
+  // Stop stops the relocation thread, waiting for it to exit, and must
+  // be called before db is closed.
+  void Start(rocksdb::DB* db);
+  void Stop();
+
+  // AcquireWriter and ReleaseWriter bracket every write to the DB, so
+  // that relocations can exclude them (see BlobWriteGuard).
+  void AcquireWriter();
+  void ReleaseWriter();
+
+  // CollectGarbage deletes the blob files which are no longer
+  // referenced and queues those which are sparsely referenced for
+  // relocation. It is called after every flush and compaction.
+  rocksdb::Status CollectGarbage(rocksdb::DB* db);
+
+  // CopyFiles copies the blob files to dir (see DBCreateCheckpoint).
+  rocksdb::Status CopyFiles(const std::string& dir);
+
+  // GetStats returns the number and total size of the blob files.
+  void GetStats(int64_t* files, int64_t* bytes);
+  // RelocatedBytes returns the total size of the values relocated.
+  int64_t RelocatedBytes() const { return relocated_bytes_.load(); }
+
+  // Dir returns the directory containing the blob files.
+  const std::string& Dir() const { return dir_; }
+
+  // EventListener methods.
+  virtual void OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) override;
+  virtual void OnCompactionCompleted(rocksdb::DB* db,
+                                     const rocksdb::CompactionJobInfo& ci) override;
+  virtual void OnExternalFileIngested(rocksdb::DB* db,
+                                      const rocksdb::ExternalFileIngestionInfo& info) override;
+  virtual void OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) override;
+
+ private:
+  struct blobFile {
+    blobFile()
+        : size(0),
+          writes(0),
+          sealed(false),
+          sealed_seq(0),
+          has_sealed_seq(false),
+          obsolete(false),
+          obsolete_epoch(0),
+          relocated(false) {}
+    uint64_t size;
+    // The number of writes which appended to the file and have not yet
+    // been applied to the DB.
+    int writes;
+    // A sealed file is no longer written to. Once the writes to it have
+    // been applied, sealed_seq is the DB sequence number all of them
+    // precede.
+    bool sealed;
+    uint64_t sealed_seq;
+    bool has_sealed_seq;
+    // An obsolete file is not referenced by any sstable. It is deleted
+    // once no reader which pinned the store at or before obsolete_epoch
+    // remains.
+    bool obsolete;
+    uint64_t obsolete_epoch;
+    // A relocated file has been queued for relocation. Its remaining
+    // references are dropped by compactions.
+    bool relocated;
+    std::shared_ptr<rocksdb::RandomAccessFile> reader;
+  };
+
+  // tableRefs maps the blob files referenced by an sstable to the
+  // total size of the values it references in each, which is unknown
+  // (kUnknownRefBytes) for sstables written before the sizes were
+  // recorded.
+  typedef std::map<uint64_t, uint64_t> tableRefs;
+  static const uint64_t kUnknownRefBytes = ~uint64_t(0);
+
+  // relocation is a value to be relocated, along with its key and the
+  // reference it is to replace.
+  struct relocation {
+    std::string key;
+    std::string ref;
+    std::string value;
+  };
+
+  std::string fileName(uint64_t number) const;
+  rocksdb::Status newFileLocked();
+  void addTableLocked(const std::string& path, const rocksdb::TableProperties& props);
+  void run();
+  // relocate relocates the live values of the given blob files, and
+  // relocateChunk rewrites the references of a chunk of them, adding
+  // the size of the values rewritten to *written.
+  rocksdb::Status relocate(const std::set<uint64_t>& files);
+  rocksdb::Status relocateChunk(std::vector<relocation>* chunk, uint64_t* written);
+
+  rocksdb::Env* const env_;
+  const std::string dir_;
+  const uint64_t threshold_;
+  std::shared_ptr<rocksdb::Logger> logger_;
+  // The largest sequence number flushed from the memtable.
+  std::atomic<uint64_t> flushed_seq_;
+  std::mutex mu_;
+  std::map<uint64_t, blobFile> files_;
+  uint64_t next_file_;
+  uint64_t cur_file_;
+  std::unique_ptr<rocksdb::WritableFile> writer_;
+  uint64_t epoch_;
+  std::multiset<uint64_t> pins_;
+  // Protected by mu_. The blob references of the live sstables, keyed
+  // by path.
+  std::unordered_map<std::string, tableRefs> tables_;
+  // Protected by mu_. The files queued for relocation.
+  std::set<uint64_t> relocate_queue_;
+  rocksdb::DB* db_;
+  std::atomic<bool> stopping_;
+  std::condition_variable cv_;
+  std::thread thread_;
+  std::atomic<int64_t> relocated_bytes_;
+  // The number of writes in progress and whether a relocation excludes
+  // new ones. Writers only take gate_mu_ if a relocation is pending.
+  std::atomic<int> writers_;
+  std::atomic<bool> relocating_;
+  std::mutex gate_mu_;
+  std::condition_variable gate_cv_;
+};
+
+// BlobWriteGuard brackets a write to the DB (see
+// BlobStore::AcquireWriter). A guard on a NULL store is a no-op.
+class BlobWriteGuard {
+ public:
+  explicit BlobWriteGuard(BlobStore* store) : store_(store) {
+    if (store_ != nullptr) {
+      store_->AcquireWriter();
+    }
+  }
+  ~BlobWriteGuard() {
+    if (store_ != nullptr) {
+      store_->ReleaseWriter();
+    }
+  }
+
+ private:
+  BlobStore* const store_;
+
+  BlobWriteGuard(const BlobWriteGuard&) = delete;
+  BlobWriteGuard& operator=(const BlobWriteGuard&) = delete;
+};
+
+// BlobReadPin pins a blob store (see BlobStore::Pin) for its lifetime.
+// A pin on a NULL store is a no-op.
+class BlobReadPin {
+ public:
+  BlobReadPin() : store_(nullptr), epoch_(0) {}
+  explicit BlobReadPin(BlobStore* store)
+      : store_(store), epoch_(store != nullptr ? store->Pin() : 0) {}
+  BlobReadPin(BlobReadPin&& other) : store_(other.store_), epoch_(other.epoch_) {
+    other.store_ = nullptr;
+  }
+  BlobReadPin& operator=(BlobReadPin&& other);
+  ~BlobReadPin() { reset(); }
+
+  // Repin replaces the pin with a pin at the store's current epoch. It
+  // is called before a reader refreshes its view of the DB.
+  void Repin();
+
+  BlobStore* store() const { return store_; }
+
+ private:
+  void reset();
+
+  BlobStore* store_;
+  uint64_t epoch_;
+
+  BlobReadPin(const BlobReadPin&) = delete;
+  BlobReadPin& operator=(const BlobReadPin&) = delete;
+};
+
+// ResolveBlobValue replaces *value with the value it refers to if it
+// is a blob reference, reading the value into *buf. The store may be
+// NULL, in which case values are never references.
+rocksdb::Status ResolveBlobValue(BlobStore* store, rocksdb::Slice* value, std::string* buf);
+
+// NewBlobRefTblPropCollectorFactory returns a table properties
+// collector factory which records the blob files referenced by each
+// sstable (see BlobStore).
+rocksdb::TablePropertiesCollectorFactory* NewBlobRefTblPropCollectorFactory();
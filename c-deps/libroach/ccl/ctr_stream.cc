@@ -0,0 +1,237 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed as a CockroachDB Enterprise file under the Cockroach Community
+// License (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+//     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
+
+
+#include "ctr_stream.h"
+#include <algorithm>
+#include <string.h>
+#include "../env_switching.h"
+#include "../fmt.h"
+#include "crypto_utils.h"
+
+CTRCipherStream::CTRCipherStream(const std::string& key, const std::string& iv) {
+  aes_.SetKey(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+  memcpy(iv_, iv.data(), kBlockSize);
+}
+
+void CTRCipherStream::counter(uint64_t block_index, uint8_t* out) const {
+  // out = iv_ + block_index as 128 bit big-endian integers.
+  uint64_t carry = block_index;
+  for (int i = kBlockSize - 1; i >= 0; --i) {
+    const uint64_t sum = uint64_t(iv_[i]) + (carry & 0xff);
+    out[i] = uint8_t(sum);
+    carry = (carry >> 8) + (sum >> 8);
+  }
+}
+
+void CTRCipherStream::xorKeystreamBlock(uint64_t block_index, size_t skip, size_t n,
+                                        char* data) const {
+  uint8_t block[kBlockSize];
+  counter(block_index, block);
+  aes_.ProcessBlock(block);
+  for (size_t i = 0; i < n; ++i) {
+    data[i] ^= char(block[skip + i]);
+  }
+}
+
+rocksdb::Status CTRCipherStream::Encrypt(uint64_t file_offset, char* data, size_t data_size) {
+  uint64_t block_index = file_offset / kBlockSize;
+
+  // A leading partial block.
+  const size_t skip = file_offset % kBlockSize;
+  if (skip > 0) {
+    const size_t n = std::min(kBlockSize - skip, data_size);
+    xorKeystreamBlock(block_index, skip, n, data);
+    data += n;
+    data_size -= n;
+    ++block_index;
+  }
+
+  // Full blocks, in batches. AdvancedProcessBlocks encrypts successive
+  // counter values (incrementing the low byte of the counter) and XORs
+  // the keystream into the data.
+  uint8_t ctr[kBlockSize];
+  size_t blocks = data_size / kBlockSize;
+  while (blocks > 0) {
+    counter(block_index, ctr);
+    const size_t n = std::min<size_t>(blocks, kBatchBlocks - ctr[kBlockSize - 1]);
+    uint8_t* p = reinterpret_cast<uint8_t*>(data);
+    aes_.AdvancedProcessBlocks(ctr, p, p, n * kBlockSize,
+                               CryptoPP::BlockTransformation::BT_InBlockIsCounter |
+                                   CryptoPP::BlockTransformation::BT_AllowParallel);
+    data += n * kBlockSize;
+    data_size -= n * kBlockSize;
+    block_index += n;
+    blocks -= n;
+  }
+
+  // A trailing partial block.
+  if (data_size > 0) {
+    xorKeystreamBlock(block_index, 0, data_size, data);
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status CTRCipherStream::Decrypt(uint64_t file_offset, char* data, size_t data_size) {
+  return Encrypt(file_offset, data, data_size);
+}
+
+void CTRCipherStream::AllocateScratch(std::string& scratch) { scratch.reserve(kBlockSize); }
+
+rocksdb::Status CTRCipherStream::EncryptBlock(uint64_t block_index, char* data, char* scratch) {
+  xorKeystreamBlock(block_index, 0, kBlockSize, data);
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status CTRCipherStream::DecryptBlock(uint64_t block_index, char* data, char* scratch) {
+  return EncryptBlock(block_index, data, scratch);
+}
+
+namespace {
+
+// plaintextCipherStream is the cipher stream of files written while
+// the active data key is the plaintext key.
+class plaintextCipherStream : public rocksdb::BlockAccessCipherStream {
+ public:
+  virtual size_t BlockSize() override { return CTRCipherStream::kBlockSize; }
+  virtual rocksdb::Status Encrypt(uint64_t file_offset, char* data, size_t data_size) override {
+    return rocksdb::Status::OK();
+  }
+  virtual rocksdb::Status Decrypt(uint64_t file_offset, char* data, size_t data_size) override {
+    return rocksdb::Status::OK();
+  }
+
+ protected:
+  virtual void AllocateScratch(std::string& scratch) override {}
+  virtual rocksdb::Status EncryptBlock(uint64_t block_index, char* data, char* scratch) override {
+    return rocksdb::Status::OK();
+  }
+  virtual rocksdb::Status DecryptBlock(uint64_t block_index, char* data, char* scratch) override {
+    return rocksdb::Status::OK();
+  }
+};
+
+// keyLength returns the AES key length of the encryption type, or 0 for
+// plaintext and unknown types.
+size_t keyLength(enginepbccl::EncryptionType type) {
+  switch (type) {
+  case enginepbccl::AES128_CTR:
+    return 16;
+  case enginepbccl::AES192_CTR:
+    return 24;
+  case enginepbccl::AES256_CTR:
+    return 32;
+  default:
+    return 0;
+  }
+}
+
+// The encryption prefix is laid out as follows (and zero padded to
+// kEncryptionPrefixLength):
+//
+//   <magic><version:1><encryption type:1><key id length:1><key id><iv:16>
+const size_t kPrefixHeaderLength = kEncryptedFileMagicLength + 3;
+
+}  // namespace
+
+size_t CTREncryptionProvider::GetPrefixLength() { return kEncryptionPrefixLength; }
+
+rocksdb::Status CTREncryptionProvider::CreateNewPrefix(const std::string& fname, char* prefix,
+                                                       size_t prefix_length) {
+  std::unique_ptr<enginepbccl::SecretKey> key = key_manager_->CurrentKey();
+  if (key == nullptr) {
+    return rocksdb::Status::InvalidArgument("no active data key");
+  }
+  const std::string& key_id = key->info().key_id();
+  const std::string iv = RandomBytes(CTRCipherStream::kBlockSize);
+  if (key_id.size() > 255 ||
+      kPrefixHeaderLength + key_id.size() + iv.size() > prefix_length) {
+    return rocksdb::Status::InvalidArgument(
+        fmt::StringPrintf("key ID too long: %d bytes", int(key_id.size())));
+  }
+
+  memset(prefix, 0, prefix_length);
+  char* p = prefix;
+  memcpy(p, kEncryptedFileMagic, kEncryptedFileMagicLength);
+  p += kEncryptedFileMagicLength;
+  *p++ = char(kEncryptionPrefixVersion);
+  *p++ = char(key->info().encryption_type());
+  *p++ = char(key_id.size());
+  memcpy(p, key_id.data(), key_id.size());
+  p += key_id.size();
+  memcpy(p, iv.data(), iv.size());
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status CTREncryptionProvider::CreateCipherStream(
+    const std::string& fname, const rocksdb::EnvOptions& options, rocksdb::Slice& prefix,
+    std::unique_ptr<rocksdb::BlockAccessCipherStream>* result) {
+  if (prefix.size() < kPrefixHeaderLength ||
+      memcmp(prefix.data(), kEncryptedFileMagic, kEncryptedFileMagicLength) != 0) {
+    return rocksdb::Status::Corruption(fname, "missing encryption prefix");
+  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(prefix.data()) + kEncryptedFileMagicLength;
+  const uint8_t version = p[0];
+  const auto type = enginepbccl::EncryptionType(p[1]);
+  const size_t key_id_length = p[2];
+  if (version != kEncryptionPrefixVersion) {
+    return rocksdb::Status::Corruption(
+        fname, fmt::StringPrintf("unknown encryption prefix version %d", int(version)));
+  }
+  if (kPrefixHeaderLength + key_id_length + CTRCipherStream::kBlockSize > prefix.size()) {
+    return rocksdb::Status::Corruption(fname, "truncated encryption prefix");
+  }
+  const std::string key_id(prefix.data() + kPrefixHeaderLength, key_id_length);
+
+  if (type == enginepbccl::Plaintext) {
+    result->reset(new plaintextCipherStream);
+    return rocksdb::Status::OK();
+  }
+
+  std::unique_ptr<enginepbccl::SecretKey> key = key_manager_->GetKey(key_id);
+  if (key == nullptr) {
+    return rocksdb::Status::InvalidArgument(
+        fmt::StringPrintf("key %s of file %s not found", key_id.c_str(), fname.c_str()));
+  }
+  if (key->info().encryption_type() != type || keyLength(type) == 0 ||
+      key->key().size() != keyLength(type)) {
+    return rocksdb::Status::InvalidArgument(
+        fmt::StringPrintf("key %s does not match the encryption type %d of file %s",
+                          key_id.c_str(), int(type), fname.c_str()));
+  }
+  const std::string iv(prefix.data() + kPrefixHeaderLength + key_id_length,
+                       CTRCipherStream::kBlockSize);
+  result->reset(new CTRCipherStream(key->key(), iv));
+  return rocksdb::Status::OK();
+}
+
+namespace {
+
+// ctrEncryptedEnv owns the encryption provider used by the RocksDB
+// encrypted Env it wraps. The provider is held in a base class so that
+// it is constructed before (and destroyed after) the EnvWrapper.
+struct ctrProviderHolder {
+  explicit ctrProviderHolder(rocksdb::Env* base_env, std::shared_ptr<KeyManager> key_manager)
+      : provider(new CTREncryptionProvider(key_manager)),
+        env(rocksdb::NewEncryptedEnv(base_env, provider.get())) {}
+
+  std::unique_ptr<CTREncryptionProvider> provider;
+  std::unique_ptr<rocksdb::Env> env;
+};
+
+class ctrEncryptedEnv : private ctrProviderHolder, public rocksdb::EnvWrapper {
+ public:
+  ctrEncryptedEnv(rocksdb::Env* base_env, std::shared_ptr<KeyManager> key_manager)
+      : ctrProviderHolder(base_env, key_manager), rocksdb::EnvWrapper(env.get()) {}
+};
+
+}  // namespace
+
+rocksdb::Env* NewCTREncryptedEnv(rocksdb::Env* base_env, std::shared_ptr<KeyManager> key_manager) {
+  return new ctrEncryptedEnv(base_env, key_manager);
+}
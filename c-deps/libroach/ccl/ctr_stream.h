@@ -0,0 +1,100 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed as a CockroachDB Enterprise file under the Cockroach Community
+// License (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+//     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
+
+
+#pragma once
+
+#include <cryptopp/aes.h>
+#include <memory>
+#include <rocksdb/env.h>
+#include <rocksdb/env_encryption.h>
+#include <rocksdb/status.h>
+#include <string>
+#include "key_manager.h"
+
+// CTRCipherStream implements AES-CTR encryption of a file's contents
+// for RocksDB's encrypted Env. The AES key schedule is expanded once
+// when the stream is created (i.e. when the file is opened) and the
+// stream is safe for concurrent use, as required for random access
+// reads.
+//
+// The keystream is generated in batches of up to kBatchBlocks blocks
+// per call into CryptoPP, which pipelines multiple blocks through the
+// AES-NI instructions when the CPU supports them. The counter for the
+// block at byte offset o is iv + o/16, treated as a 128 bit big-endian
+// integer.
+class CTRCipherStream : public rocksdb::BlockAccessCipherStream {
+ public:
+  static const size_t kBlockSize = CryptoPP::AES::BLOCKSIZE;
+  // kBatchBlocks is the maximum number of keystream blocks generated
+  // at once. CryptoPP only increments the low byte of the counter
+  // within a batch, so a batch never crosses a multiple of 256 blocks.
+  static const size_t kBatchBlocks = 256;
+
+  // key must be a valid AES key (16, 24 or 32 bytes) and iv must be
+  // kBlockSize bytes.
+  CTRCipherStream(const std::string& key, const std::string& iv);
+  virtual ~CTRCipherStream() {}
+
+  virtual size_t BlockSize() override { return kBlockSize; }
+
+  // Encrypt and Decrypt are identical for CTR mode. They operate on
+  // data in place and accept any offset and size.
+  virtual rocksdb::Status Encrypt(uint64_t file_offset, char* data, size_t data_size) override;
+  virtual rocksdb::Status Decrypt(uint64_t file_offset, char* data, size_t data_size) override;
+
+ protected:
+  virtual void AllocateScratch(std::string& scratch) override;
+  virtual rocksdb::Status EncryptBlock(uint64_t block_index, char* data, char* scratch) override;
+  virtual rocksdb::Status DecryptBlock(uint64_t block_index, char* data, char* scratch) override;
+
+ private:
+  // counter sets out to the counter block for the given block index.
+  void counter(uint64_t block_index, uint8_t* out) const;
+  // xorKeystreamBlock XORs n bytes of data with the
+  // keystream of the block, starting skip bytes into the block
+  // (skip + n <= kBlockSize).
+  void xorKeystreamBlock(uint64_t block_index, size_t skip, size_t n, char* data) const;
+
+  CryptoPP::AES::Encryption aes_;
+  uint8_t iv_[kBlockSize];
+};
+
+// kEncryptionPrefixVersion is the current version of the encryption
+// prefix written at the start of each encrypted file.
+static const uint8_t kEncryptionPrefixVersion = 1;
+
+// CTREncryptionProvider is a RocksDB EncryptionProvider which encrypts
+// new files with the active data key of a key manager using
+// AES-CTR. The prefix of each file records the ID of the key and the
+// random initialization vector so that the file can be decrypted
+// after the active key is rotated. The prefix starts with
+// kEncryptedFileMagic, which SwitchingEnv uses to tell encrypted files
+// from plaintext ones.
+class CTREncryptionProvider : public rocksdb::EncryptionProvider {
+ public:
+  explicit CTREncryptionProvider(std::shared_ptr<KeyManager> key_manager)
+      : key_manager_(key_manager) {}
+  virtual ~CTREncryptionProvider() {}
+
+  virtual size_t GetPrefixLength() override;
+  virtual rocksdb::Status CreateNewPrefix(const std::string& fname, char* prefix,
+                                          size_t prefix_length) override;
+  virtual rocksdb::Status
+  CreateCipherStream(const std::string& fname, const rocksdb::EnvOptions& options,
+                     rocksdb::Slice& prefix,
+                     std::unique_ptr<rocksdb::BlockAccessCipherStream>* result) override;
+
+ private:
+  std::shared_ptr<KeyManager> key_manager_;
+};
+
+// NewCTREncryptedEnv returns an Env which encrypts the files it
+// creates (and decrypts the files it opens) using the keys of
+// key_manager. base_env is owned by the caller.
+rocksdb::Env* NewCTREncryptedEnv(rocksdb::Env* base_env, std::shared_ptr<KeyManager> key_manager);
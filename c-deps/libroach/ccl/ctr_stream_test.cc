@@ -0,0 +1,280 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed as a CockroachDB Enterprise file under the Cockroach Community
+// License (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+//     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
+
+
+#include <chrono>
+#include <rocksdb/env.h>
+#include <stdio.h>
+#include <vector>
+#include "../env_switching.h"
+#include "../testutils.h"
+#include "crypto_utils.h"
+#include "ctr_stream.h"
+
+namespace {
+
+std::string unhex(const std::string& s) {
+  std::string res;
+  for (size_t i = 0; i + 1 < s.size(); i += 2) {
+    res.push_back(char(std::stoi(s.substr(i, 2), nullptr, 16)));
+  }
+  return res;
+}
+
+// testKeyManager is a KeyManager with a fixed set of keys, the first
+// of which is active.
+class testKeyManager : public KeyManager {
+ public:
+  explicit testKeyManager(std::vector<enginepbccl::SecretKey> keys) : keys_(keys) {}
+  virtual ~testKeyManager() {}
+
+  static enginepbccl::SecretKey MakeKey(const std::string& id, enginepbccl::EncryptionType type,
+                                        const std::string& key) {
+    enginepbccl::SecretKey k;
+    k.mutable_info()->set_key_id(id);
+    k.mutable_info()->set_encryption_type(type);
+    k.set_key(key);
+    return k;
+  }
+
+  virtual std::unique_ptr<enginepbccl::SecretKey> CurrentKey() override {
+    if (keys_.empty()) {
+      return nullptr;
+    }
+    return std::unique_ptr<enginepbccl::SecretKey>(new enginepbccl::SecretKey(keys_[0]));
+  }
+
+  virtual std::unique_ptr<enginepbccl::SecretKey> GetKey(const std::string& id) override {
+    for (auto& k : keys_) {
+      if (k.info().key_id() == id) {
+        return std::unique_ptr<enginepbccl::SecretKey>(new enginepbccl::SecretKey(k));
+      }
+    }
+    return nullptr;
+  }
+
+  void SetKeys(std::vector<enginepbccl::SecretKey> keys) { keys_ = keys; }
+
+ private:
+  std::vector<enginepbccl::SecretKey> keys_;
+};
+
+}  // namespace
+
+TEST(CTRCipherStream, NISTVector) {
+  // NIST SP800-38A, F.5.1 CTR-AES128.Encrypt.
+  const std::string key = unhex("2b7e151628aed2a6abf7158809cf4f3c");
+  const std::string iv = unhex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+  const std::string plaintext = unhex("6bc1bee22e409f96e93d7e117393172a"
+                                      "ae2d8a571e03ac9c9eb76fac45af8e51"
+                                      "30c81c46a35ce411e5fbc1191a0a52ef"
+                                      "f69f2445df4f9b17ad2b417be66c3710");
+  const std::string ciphertext = unhex("874d6191b620e3261bef6864990db6ce"
+                                       "9806f66b7970fdff8617187bb9fffdff"
+                                       "5ae4df3edbd5d35e5b4f09020db03eab"
+                                       "1e031dda2fbe03d1792170a0f3009cee");
+
+  CTRCipherStream stream(key, iv);
+  std::string data = plaintext;
+  ASSERT_OK(stream.Encrypt(0, &data[0], data.size()));
+  EXPECT_EQ(HexString(ciphertext), HexString(data));
+  ASSERT_OK(stream.Decrypt(0, &data[0], data.size()));
+  EXPECT_EQ(HexString(plaintext), HexString(data));
+
+  // Encrypting the same data at arbitrary offsets and sizes must
+  // produce the same ciphertext.
+  for (size_t piece : {1, 3, 15, 16, 17, 33}) {
+    data = plaintext;
+    for (size_t offset = 0; offset < data.size(); offset += piece) {
+      const size_t n = std::min(piece, data.size() - offset);
+      ASSERT_OK(stream.Encrypt(offset, &data[offset], n));
+    }
+    EXPECT_EQ(HexString(ciphertext), HexString(data)) << "piece size " << piece;
+  }
+}
+
+TEST(CTRCipherStream, CounterCarry) {
+  // An IV whose low bytes are about to wrap exercises both the carry
+  // across counter bytes and the batch boundary at a multiple of 256
+  // blocks.
+  const std::string key = unhex("000102030405060708090a0b0c0d0e0f");
+  const std::string iv = unhex("00000000000000000000000000fffff0");
+  CTRCipherStream stream(key, iv);
+
+  const size_t kSize = 1000 * CTRCipherStream::kBlockSize + 7;
+  std::string whole(kSize, 'x');
+  ASSERT_OK(stream.Encrypt(0, &whole[0], whole.size()));
+
+  // Encrypting one block at a time never batches the keystream.
+  std::string blocks(kSize, 'x');
+  for (size_t offset = 0; offset < kSize; offset += CTRCipherStream::kBlockSize) {
+    const size_t n = std::min(size_t(CTRCipherStream::kBlockSize), kSize - offset);
+    ASSERT_OK(stream.Encrypt(offset, &blocks[offset], n));
+  }
+  EXPECT_EQ(HexString(whole), HexString(blocks));
+
+  ASSERT_OK(stream.Decrypt(0, &whole[0], whole.size()));
+  EXPECT_EQ(std::string(kSize, 'x'), whole);
+}
+
+TEST(CTREncryptedEnv, ReadWrite) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  std::shared_ptr<testKeyManager> key_manager(new testKeyManager(
+      {testKeyManager::MakeKey("key1", enginepbccl::AES128_CTR, std::string(16, 'a'))}));
+  std::unique_ptr<rocksdb::Env> env(NewSwitchingEnv(
+      mem_env.get(), std::unique_ptr<rocksdb::Env>(NewCTREncryptedEnv(mem_env.get(), key_manager)),
+      nullptr));
+
+  // A plaintext file written before encryption was enabled.
+  const std::string contents = "some file contents";
+  ASSERT_OK(rocksdb::WriteStringToFile(mem_env.get(), contents, "plain"));
+  ASSERT_OK(rocksdb::WriteStringToFile(env.get(), contents, "encrypted"));
+
+  std::string data;
+  ASSERT_OK(rocksdb::ReadFileToString(env.get(), "plain", &data));
+  EXPECT_EQ(contents, data);
+  ASSERT_OK(rocksdb::ReadFileToString(env.get(), "encrypted", &data));
+  EXPECT_EQ(contents, data);
+
+  // The raw file holds the prefix and the ciphertext.
+  ASSERT_OK(rocksdb::ReadFileToString(mem_env.get(), "encrypted", &data));
+  EXPECT_EQ(kEncryptionPrefixLength + contents.size(), data.size());
+  EXPECT_EQ(std::string(kEncryptedFileMagic, kEncryptedFileMagicLength),
+            data.substr(0, kEncryptedFileMagicLength));
+  EXPECT_EQ(std::string::npos, data.find(contents));
+
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize("plain", &size));
+  EXPECT_EQ(contents.size(), size);
+  ASSERT_OK(env->GetFileSize("encrypted", &size));
+  EXPECT_EQ(contents.size(), size);
+
+  // Rotating the active key keeps existing files readable, as long as
+  // the old key is still known.
+  key_manager->SetKeys(
+      {testKeyManager::MakeKey("key2", enginepbccl::AES256_CTR, std::string(32, 'b')),
+       testKeyManager::MakeKey("key1", enginepbccl::AES128_CTR, std::string(16, 'a'))});
+  ASSERT_OK(rocksdb::ReadFileToString(env.get(), "encrypted", &data));
+  EXPECT_EQ(contents, data);
+
+  key_manager->SetKeys(
+      {testKeyManager::MakeKey("key2", enginepbccl::AES256_CTR, std::string(32, 'b'))});
+  EXPECT_ERR(rocksdb::ReadFileToString(env.get(), "encrypted", &data),
+             "key key1 of file encrypted not found");
+}
+
+TEST(CTREncryptedEnv, Switching) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  std::shared_ptr<testKeyManager> key_manager(new testKeyManager(
+      {testKeyManager::MakeKey("key1", enginepbccl::AES128_CTR, std::string(16, 'a'))}));
+  std::unique_ptr<rocksdb::Env> env(NewSwitchingEnv(
+      mem_env.get(), std::unique_ptr<rocksdb::Env>(NewCTREncryptedEnv(mem_env.get(), key_manager)),
+      nullptr));
+
+  const std::string contents = "some file contents";
+  ASSERT_OK(rocksdb::WriteStringToFile(env.get(), contents, "encrypted"));
+
+  // Renamed files keep their format.
+  ASSERT_OK(env->RenameFile("encrypted", "renamed"));
+  std::string data;
+  ASSERT_OK(rocksdb::ReadFileToString(env.get(), "renamed", &data));
+  EXPECT_EQ(contents, data);
+  uint64_t size;
+  ASSERT_OK(env->GetFileSize("renamed", &size));
+  EXPECT_EQ(contents.size(), size);
+
+  // A file recreated in plaintext after deleting an encrypted one.
+  ASSERT_OK(rocksdb::WriteStringToFile(env.get(), contents, "recreated"));
+  ASSERT_OK(env->DeleteFile("recreated"));
+  ASSERT_OK(rocksdb::WriteStringToFile(mem_env.get(), contents, "recreated"));
+  ASSERT_OK(rocksdb::ReadFileToString(env.get(), "recreated", &data));
+  EXPECT_EQ(contents, data);
+
+  // Without encryption, plaintext files are readable but encrypted
+  // files are an error instead of being read as garbage.
+  std::unique_ptr<rocksdb::Env> plain_env(
+      NewSwitchingEnv(mem_env.get(), std::unique_ptr<rocksdb::Env>(), nullptr));
+  ASSERT_OK(rocksdb::ReadFileToString(plain_env.get(), "recreated", &data));
+  EXPECT_EQ(contents, data);
+  EXPECT_ERR(rocksdb::ReadFileToString(plain_env.get(), "renamed", &data),
+             "file is encrypted but encryption is not enabled: renamed");
+}
+
+// Throughput of the encrypted Env compared to the plaintext one, both
+// on top of a MemEnv so that the numbers reflect the cost of the
+// encryption alone. Run with --gtest_also_run_disabled_tests.
+TEST(CTREncryptedEnv, DISABLED_Throughput) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  std::shared_ptr<testKeyManager> key_manager(new testKeyManager(
+      {testKeyManager::MakeKey("key", enginepbccl::AES256_CTR, RandomBytes(32))}));
+  std::unique_ptr<rocksdb::Env> encrypted_env(NewCTREncryptedEnv(mem_env.get(), key_manager));
+
+  const size_t kFileSize = 64 << 20;
+  const size_t kWriteSize = 1 << 20;  // compaction output buffer
+  const size_t kBlockReadSize = 4 << 10;  // a table block
+  const int kNumBlockReads = 100000;
+  const std::string payload = RandomBytes(kWriteSize);
+  const rocksdb::EnvOptions env_options;
+
+  auto report = [](const char* env_name, const char* op, size_t bytes,
+                   std::chrono::steady_clock::duration elapsed) {
+    const double secs = std::chrono::duration<double>(elapsed).count();
+    printf("%-10s %-16s %8.1f MB/s\n", env_name, op, bytes / secs / (1 << 20));
+  };
+
+  struct namedEnv {
+    const char* name;
+    rocksdb::Env* env;
+  };
+  for (auto e :
+       {namedEnv{"plaintext", mem_env.get()}, namedEnv{"encrypted", encrypted_env.get()}}) {
+    const std::string fname = std::string("bench-") + e.name;
+
+    // Sequential writes, as done by flushes and compactions.
+    auto start = std::chrono::steady_clock::now();
+    {
+      std::unique_ptr<rocksdb::WritableFile> file;
+      ASSERT_OK(e.env->NewWritableFile(fname, &file, env_options));
+      for (size_t written = 0; written < kFileSize; written += kWriteSize) {
+        ASSERT_OK(file->Append(payload));
+      }
+      ASSERT_OK(file->Close());
+    }
+    report(e.name, "sequential write", kFileSize, std::chrono::steady_clock::now() - start);
+
+    // Sequential reads, as done by compactions.
+    std::string scratch(kWriteSize, '\0');
+    start = std::chrono::steady_clock::now();
+    {
+      std::unique_ptr<rocksdb::SequentialFile> file;
+      ASSERT_OK(e.env->NewSequentialFile(fname, &file, env_options));
+      rocksdb::Slice result;
+      do {
+        ASSERT_OK(file->Read(kWriteSize, &result, &scratch[0]));
+      } while (result.size() > 0);
+    }
+    report(e.name, "sequential read", kFileSize, std::chrono::steady_clock::now() - start);
+
+    // Random block reads, as done by point lookups and scans.
+    start = std::chrono::steady_clock::now();
+    {
+      std::unique_ptr<rocksdb::RandomAccessFile> file;
+      ASSERT_OK(e.env->NewRandomAccessFile(fname, &file, env_options));
+      rocksdb::Slice result;
+      uint64_t offset = 0;
+      for (int i = 0; i < kNumBlockReads; i++) {
+        // A cheap LCG spreads the reads over the file.
+        offset = (offset * 6364136223846793005ULL + 1442695040888963407ULL);
+        const uint64_t block_offset = (offset >> 16) % (kFileSize - kBlockReadSize);
+        ASSERT_OK(file->Read(block_offset, kBlockReadSize, &result, &scratch[0]));
+      }
+    }
+    report(e.name, "random 4KB read", kNumBlockReads * kBlockReadSize,
+           std::chrono::steady_clock::now() - start);
+  }
+}
@@ -7,21 +7,25 @@
 //     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
 
 #include "../db.h"
+#include <algorithm>
 #include <iostream>
 #include <libroachccl.h>
 #include <memory>
 #include <rocksdb/comparator.h>
 #include <rocksdb/iterator.h>
-#include <rocksdb/utilities/write_batch_with_index.h>
 #include <rocksdb/write_batch.h>
+#include <vector>
+#include "../batch_repr.h"
 #include "ccl/baseccl/encryption_options.pb.h"
+#include "ctr_stream.h"
 #include "key_manager.h"
 
 const DBStatus kSuccess = {NULL, 0};
 
 // DBOpenHook parses the extra_options field of DBOptions and initializes encryption objects if
 // needed.
-rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions db_opts) {
+rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions db_opts,
+                           rocksdb::Env* base_env, std::unique_ptr<rocksdb::Env>* encrypted_env) {
   DBSlice options = db_opts.extra_options;
   if (options.len == 0) {
     return rocksdb::Status::OK();
@@ -65,38 +69,131 @@ rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions db_opts) {
     return status;
   }
 
-  return rocksdb::Status::InvalidArgument("encryption is not supported");
+  // Files created from now on are encrypted with the active data key.
+  encrypted_env->reset(NewCTREncryptedEnv(base_env, data_key_manager));
+  return rocksdb::Status::OK();
 }
 
+namespace {
+
+// batchReprEntry is an entry of a batch repr. The key and value point
+// into the repr.
+struct batchReprEntry {
+  rocksdb::Slice key;
+  rocksdb::Slice value;
+  bool deleted;
+};
+
+// batchReprIterator is a rocksdb::Iterator over the sorted entries of a
+// batch repr. It allows DBBatchReprVerify to compute stats with
+// MVCCComputeStatsInternal without building a WriteBatchWithIndex.
+class batchReprIterator : public rocksdb::Iterator {
+ public:
+  batchReprIterator(const rocksdb::Comparator* cmp, const std::vector<batchReprEntry>* entries)
+      : cmp_(cmp), entries_(entries), pos_(entries->size()) {}
+
+  virtual bool Valid() const override { return pos_ < entries_->size(); }
+  virtual void SeekToFirst() override { pos_ = 0; }
+  virtual void SeekToLast() override {
+    pos_ = entries_->empty() ? entries_->size() : entries_->size() - 1;
+  }
+  virtual void Seek(const rocksdb::Slice& target) override {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            [this](const batchReprEntry& e, const rocksdb::Slice& k) {
+                              return cmp_->Compare(e.key, k) < 0;
+                            }) -
+           entries_->begin();
+  }
+  virtual void SeekForPrev(const rocksdb::Slice& target) override {
+    pos_ = std::upper_bound(entries_->begin(), entries_->end(), target,
+                            [this](const rocksdb::Slice& k, const batchReprEntry& e) {
+                              return cmp_->Compare(k, e.key) < 0;
+                            }) -
+           entries_->begin();
+    Prev();
+  }
+  virtual void Next() override { ++pos_; }
+  virtual void Prev() override { pos_ = pos_ == 0 ? entries_->size() : pos_ - 1; }
+  virtual rocksdb::Slice key() const override { return (*entries_)[pos_].key; }
+  virtual rocksdb::Slice value() const override { return (*entries_)[pos_].value; }
+  virtual rocksdb::Status status() const override { return rocksdb::Status::OK(); }
+
+ private:
+  const rocksdb::Comparator* const cmp_;
+  const std::vector<batchReprEntry>* const entries_;
+  size_t pos_;
+};
+
+}  // namespace
+
 DBStatus DBBatchReprVerify(DBSlice repr, DBKey start, DBKey end, int64_t now_nanos,
                            MVCCStatsResult* stats) {
   const rocksdb::Comparator* kComparator = CockroachComparator();
 
-  // TODO(dan): Inserting into a batch just to iterate over it is unfortunate.
-  // Consider replacing this with WriteBatch's Iterate/Handler mechanism and
-  // computing MVCC stats on the post-ApplyBatchRepr engine. splitTrigger does
-  // the latter and it's a headache for propEvalKV, so wait to see how that
-  // settles out before doing it that way.
-  rocksdb::WriteBatchWithIndex batch(kComparator, 0, true);
-  rocksdb::WriteBatch b(ToString(repr));
-  std::unique_ptr<rocksdb::WriteBatch::Handler> inserter(GetDBBatchInserter(&batch));
-  rocksdb::Status status = b.Iterate(inserter.get());
-  if (!status.ok()) {
-    return ToDBStatus(status);
+  // Collect the entries of the batch in place. AddSSTable and import
+  // batches are written in key order, in which case no sorting is
+  // needed. Otherwise only the entry array is sorted, leaving the repr
+  // untouched.
+  BatchReprReader reader(rocksdb::Slice(repr.data, repr.len));
+  if (!reader.Init()) {
+    return FmtStatus("%s", reader.Error().c_str());
+  }
+  std::vector<batchReprEntry> entries;
+  entries.reserve(reader.Count());
+  bool sorted = true;
+  while (reader.Next()) {
+    batchReprEntry e;
+    switch (reader.Type()) {
+    case kBatchTypeValue:
+    case kBatchTypeMerge:
+      e.deleted = false;
+      break;
+    case kBatchTypeDeletion:
+    case kBatchTypeSingleDeletion:
+      e.deleted = true;
+      break;
+    default:
+      // Range deletions are not visible when iterating over the batch.
+      continue;
+    }
+    e.key = reader.Key();
+    e.value = reader.Value();
+    if (sorted && !entries.empty() && kComparator->Compare(entries.back().key, e.key) >= 0) {
+      sorted = false;
+    }
+    entries.push_back(e);
+  }
+  if (!reader.Error().empty()) {
+    return FmtStatus("%s", reader.Error().c_str());
   }
-  std::unique_ptr<rocksdb::Iterator> iter;
-  iter.reset(batch.NewIteratorWithBase(rocksdb::NewEmptyIterator()));
 
-  iter->SeekToFirst();
-  if (iter->Valid() && kComparator->Compare(iter->key(), EncodeKey(start)) < 0) {
-    return FmtStatus("key not in request range");
+  if (!sorted) {
+    // Later entries for a key replace earlier ones, so sort stably and
+    // keep the last entry of each key.
+    std::stable_sort(entries.begin(), entries.end(),
+                     [kComparator](const batchReprEntry& a, const batchReprEntry& b) {
+                       return kComparator->Compare(a.key, b.key) < 0;
+                     });
+    size_t n = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (i + 1 < entries.size() && kComparator->Compare(entries[i].key, entries[i + 1].key) == 0) {
+        continue;
+      }
+      entries[n++] = entries[i];
+    }
+    entries.resize(n);
   }
-  iter->SeekToLast();
-  if (iter->Valid() && kComparator->Compare(iter->key(), EncodeKey(end)) >= 0) {
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [](const batchReprEntry& e) { return e.deleted; }),
+                entries.end());
+
+  if (!entries.empty() && (kComparator->Compare(entries.front().key, EncodeKey(start)) < 0 ||
+                           kComparator->Compare(entries.back().key, EncodeKey(end)) >= 0)) {
     return FmtStatus("key not in request range");
   }
 
-  *stats = MVCCComputeStatsInternal(iter.get(), start, end, now_nanos);
+  batchReprIterator iter(kComparator, &entries);
+  *stats = MVCCComputeStatsInternal(&iter, start, end, now_nanos);
 
   return kSuccess;
 }
@@ -6,17 +6,87 @@
 //
 //     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
 
+#include <libroachccl.h>
+#include <rocksdb/write_batch.h>
 #include "../db.h"
 #include "../testutils.h"
 
 TEST(LibroachCCL, DBOpenHook) {
   DBOptions db_opts;
+  std::unique_ptr<rocksdb::Env> encrypted_env;
 
   // Try an empty extra_options.
   db_opts.extra_options = ToDBSlice("");
-  EXPECT_OK(DBOpenHook("", db_opts));
+  EXPECT_OK(DBOpenHook("", db_opts, rocksdb::Env::Default(), &encrypted_env));
 
   // Try extra_options with bad data.
   db_opts.extra_options = ToDBSlice("blah");
-  EXPECT_ERR(DBOpenHook("", db_opts), "failed to parse extra options");
+  EXPECT_ERR(DBOpenHook("", db_opts, rocksdb::Env::Default(), &encrypted_env),
+             "failed to parse extra options");
+}
+
+namespace {
+
+DBKey mvccKey(const char* key, int64_t wall_time) { return {ToDBSlice(key), wall_time, 0}; }
+
+// verifyAgainstEngine checks the stats computed by DBBatchReprVerify
+// against those computed over an engine the batch has been applied to.
+void verifyAgainstEngine(const std::string& repr, DBKey start, DBKey end) {
+  const int64_t now_nanos = 100e9;
+  MVCCStatsResult stats;
+  ASSERT_EQ(nullptr, DBBatchReprVerify(ToDBSlice(repr), start, end, now_nanos, &stats).data);
+
+  DBOptions db_opts = {};
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+  ASSERT_EQ(nullptr, DBApplyBatchRepr(db, ToDBSlice(repr), false).data);
+  DBIterator* iter = DBNewIter(db, false);
+  MVCCStatsResult expected = MVCCComputeStats(iter, start, end, now_nanos);
+  DBIterDestroy(iter);
+  DBClose(db);
+
+  EXPECT_EQ(nullptr, stats.status.data);
+  EXPECT_EQ(expected.key_count, stats.key_count);
+  EXPECT_EQ(expected.key_bytes, stats.key_bytes);
+  EXPECT_EQ(expected.val_count, stats.val_count);
+  EXPECT_EQ(expected.val_bytes, stats.val_bytes);
+  EXPECT_EQ(expected.live_count, stats.live_count);
+  EXPECT_EQ(expected.live_bytes, stats.live_bytes);
+  EXPECT_EQ(expected.gc_bytes_age, stats.gc_bytes_age);
+}
+
+}  // namespace
+
+TEST(LibroachCCL, DBBatchReprVerify) {
+  const DBKey start = mvccKey("a", 0);
+  const DBKey end = mvccKey("z", 0);
+
+  // A sorted batch, as written by AddSSTable and import.
+  rocksdb::WriteBatch sorted;
+  sorted.Put(EncodeKey(mvccKey("b", 2e9)), "b2");
+  sorted.Put(EncodeKey(mvccKey("b", 1e9)), "b1");
+  sorted.Put(EncodeKey(mvccKey("c", 1e9)), "");
+  sorted.Put(EncodeKey(mvccKey("d", 3e9)), "d3");
+  verifyAgainstEngine(sorted.Data(), start, end);
+
+  // An unsorted batch with overwritten and deleted keys.
+  rocksdb::WriteBatch unsorted;
+  unsorted.Put(EncodeKey(mvccKey("d", 3e9)), "d3");
+  unsorted.Put(EncodeKey(mvccKey("b", 1e9)), "b1");
+  unsorted.Put(EncodeKey(mvccKey("e", 1e9)), "e1");
+  unsorted.Put(EncodeKey(mvccKey("b", 2e9)), "b2");
+  unsorted.Put(EncodeKey(mvccKey("d", 3e9)), "d3-overwritten");
+  unsorted.Delete(EncodeKey(mvccKey("e", 1e9)));
+  verifyAgainstEngine(unsorted.Data(), start, end);
+
+  // Keys outside of the span are rejected, whether or not the batch is
+  // sorted.
+  MVCCStatsResult stats;
+  EXPECT_EQ("key not in request range",
+            ToString(DBBatchReprVerify(ToDBSlice(sorted.Data()), mvccKey("c", 0), end, 0, &stats)));
+  EXPECT_EQ("key not in request range",
+            ToString(DBBatchReprVerify(ToDBSlice(unsorted.Data()), start, mvccKey("c", 0), 0,
+                                       &stats)));
 }
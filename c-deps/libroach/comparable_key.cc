@@ -0,0 +1,157 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "comparable_key.h"
+#include "db.h"
+#include "encoding.h"
+
+namespace {
+
+const char kEscape = '\x00';
+const char kEscapedTerm = '\x01';
+const char kEscaped00 = '\xff';
+
+// splitComparableKey splits a comparable key into its escaped user key
+// (including the terminator) and its timestamp suffix.
+bool splitComparableKey(const rocksdb::Slice& buf, rocksdb::Slice* prefix,
+                        rocksdb::Slice* timestamp) {
+  for (size_t i = 0; i + 1 < buf.size(); i++) {
+    if (buf[i] != kEscape) {
+      continue;
+    }
+    if (buf[i + 1] == kEscapedTerm) {
+      *prefix = rocksdb::Slice(buf.data(), i + 2);
+      *timestamp = rocksdb::Slice(buf.data() + i + 2, buf.size() - i - 2);
+      return timestamp->empty() || timestamp->size() == kComparableKeyTimestampSize;
+    }
+    if (buf[i + 1] != kEscaped00) {
+      return false;
+    }
+    i++;
+  }
+  return false;
+}
+
+class ComparableKeyPrefixExtractor : public rocksdb::SliceTransform {
+ public:
+  virtual const char* Name() const override { return "cockroach_comparable_prefix_extractor"; }
+
+  virtual rocksdb::Slice Transform(const rocksdb::Slice& src) const override {
+    return ComparableKeyPrefix(src);
+  }
+
+  virtual bool InDomain(const rocksdb::Slice& src) const override { return true; }
+
+  virtual bool InRange(const rocksdb::Slice& dst) const override {
+    return Transform(dst) == dst;
+  }
+};
+
+}  // namespace
+
+void EncodeComparableKey(std::string* buf, const rocksdb::Slice& key, int64_t wall_time,
+                         int32_t logical) {
+  const bool ts = wall_time != 0 || logical != 0;
+  buf->reserve(buf->size() + key.size() + 2 + (ts ? kComparableKeyTimestampSize : 0));
+  for (size_t i = 0; i < key.size(); i++) {
+    buf->push_back(key[i]);
+    if (key[i] == kEscape) {
+      buf->push_back(kEscaped00);
+    }
+  }
+  buf->push_back(kEscape);
+  buf->push_back(kEscapedTerm);
+  if (ts) {
+    EncodeUint64(buf, ~uint64_t(wall_time));
+    EncodeUint32(buf, ~uint32_t(logical));
+  }
+}
+
+bool DecodeComparableKey(const rocksdb::Slice& buf, std::string* key, int64_t* wall_time,
+                         int32_t* logical) {
+  rocksdb::Slice prefix, timestamp;
+  if (!splitComparableKey(buf, &prefix, &timestamp)) {
+    return false;
+  }
+  key->clear();
+  key->reserve(prefix.size() - 2);
+  for (size_t i = 0; i + 2 < prefix.size(); i++) {
+    key->push_back(prefix[i]);
+    if (prefix[i] == kEscape) {
+      i++;
+    }
+  }
+  *wall_time = 0;
+  *logical = 0;
+  if (!timestamp.empty()) {
+    uint64_t w;
+    uint32_t l;
+    if (!DecodeUint64(&timestamp, &w) || !DecodeUint32(&timestamp, &l)) {
+      return false;
+    }
+    *wall_time = int64_t(~w);
+    *logical = int32_t(~l);
+  }
+  return true;
+}
+
+rocksdb::Slice ComparableKeyPrefix(const rocksdb::Slice& buf) {
+  rocksdb::Slice prefix, timestamp;
+  if (!splitComparableKey(buf, &prefix, &timestamp)) {
+    return buf;
+  }
+  return prefix;
+}
+
+bool ToComparableKey(const rocksdb::Slice& mvcc_key, std::string* comparable_key) {
+  if (mvcc_key.empty()) {
+    return false;
+  }
+  // See EncodeKey: the last byte is the size of the timestamp, which is
+  // a NUL followed by the 8-byte wall time and the optional 4-byte
+  // logical time.
+  const size_t ts_size = uint8_t(mvcc_key[mvcc_key.size() - 1]);
+  if (ts_size >= mvcc_key.size()) {
+    return false;
+  }
+  const rocksdb::Slice key(mvcc_key.data(), mvcc_key.size() - ts_size - 1);
+  rocksdb::Slice timestamp(key.data() + key.size(), ts_size);
+  uint64_t wall_time = 0;
+  uint32_t logical = 0;
+  if (ts_size > 0) {
+    timestamp.remove_prefix(1);
+    if (!DecodeUint64(&timestamp, &wall_time) ||
+        (!timestamp.empty() && !DecodeUint32(&timestamp, &logical)) || !timestamp.empty()) {
+      return false;
+    }
+  }
+  comparable_key->clear();
+  EncodeComparableKey(comparable_key, key, int64_t(wall_time), int32_t(logical));
+  return true;
+}
+
+bool FromComparableKey(const rocksdb::Slice& comparable_key, std::string* mvcc_key) {
+  std::string key;
+  int64_t wall_time;
+  int32_t logical;
+  if (!DecodeComparableKey(comparable_key, &key, &wall_time, &logical)) {
+    return false;
+  }
+  *mvcc_key = EncodeKey(DBKey{ToDBSlice(key), wall_time, logical});
+  return true;
+}
+
+const rocksdb::SliceTransform* NewComparableKeyPrefixExtractor() {
+  return new ComparableKeyPrefixExtractor;
+}
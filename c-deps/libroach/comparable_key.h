@@ -0,0 +1,67 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <rocksdb/slice.h>
+#include <rocksdb/slice_transform.h>
+#include <stdint.h>
+#include <string>
+
+// The comparable MVCC key encoding orders keys bytewise in the same
+// order as DBComparator orders the standard encoding (see EncodeKey),
+// so that a store using it can use RocksDB's bytewise comparator
+// (with its memcmp fast paths, prefix compression and separator
+// shortening) rather than splitting every key it compares.
+// A key is encoded as:
+//
+//   <escaped-key>\x00\x01[<^wall_time><^logical>]
+//
+// where 0x00 bytes in the key are escaped as 0x00 0xff, so that the
+// 0x00 0x01 terminator sorts before any longer key sharing the
+// prefix. Keys without a timestamp (such as intents' MVCCMetadata)
+// sort first because they are a prefix of every version of their key.
+// Versions carry the bitwise complements of their big-endian 8-byte
+// wall time and 4-byte logical time, so that they sort from newest to
+// oldest.
+
+// kComparableKeyTimestampSize is the size of the timestamp suffix of a
+// version.
+const int kComparableKeyTimestampSize = 12;
+
+// EncodeComparableKey appends the comparable encoding of the MVCC key
+// to buf.
+void EncodeComparableKey(std::string* buf, const rocksdb::Slice& key, int64_t wall_time,
+                         int32_t logical);
+
+// DecodeComparableKey decodes a key encoded by EncodeComparableKey,
+// returning false if buf is not a valid encoding.
+bool DecodeComparableKey(const rocksdb::Slice& buf, std::string* key, int64_t* wall_time,
+                         int32_t* logical);
+
+// ComparableKeyPrefix returns the prefix of a comparable key holding
+// its encoded user key (including the terminator), which is shared
+// by all of the versions of the key.
+rocksdb::Slice ComparableKeyPrefix(const rocksdb::Slice& buf);
+
+// ToComparableKey translates a key in the standard MVCC encoding into
+// the comparable encoding, and FromComparableKey translates it back.
+// Both return false if the key is not a valid encoding.
+bool ToComparableKey(const rocksdb::Slice& mvcc_key, std::string* comparable_key);
+bool FromComparableKey(const rocksdb::Slice& comparable_key, std::string* mvcc_key);
+
+// NewComparableKeyPrefixExtractor returns a prefix extractor for
+// comparable keys which, like DBPrefixExtractor for the standard
+// encoding, extracts the user key.
+const rocksdb::SliceTransform* NewComparableKeyPrefixExtractor();
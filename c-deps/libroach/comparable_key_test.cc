@@ -0,0 +1,120 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <rocksdb/comparator.h>
+#include <vector>
+#include "comparable_key.h"
+#include "db.h"
+
+namespace {
+
+struct mvccKey {
+  std::string key;
+  int64_t wall_time;
+  int32_t logical;
+};
+
+// randomKeys returns keys drawn from a small alphabet including the
+// escape bytes, with timestamps drawn from a small set including zero,
+// so that many pairs share their user keys or timestamps.
+std::vector<mvccKey> randomKeys(int n) {
+  std::mt19937 rng;
+  const char alphabet[] = {'\x00', '\x01', 'a', '\xff'};
+  std::uniform_int_distribution<int> len(0, 4);
+  std::uniform_int_distribution<int> byte(0, sizeof(alphabet) - 1);
+  std::uniform_int_distribution<int> ts(0, 3);
+  std::vector<mvccKey> keys;
+  for (int i = 0; i < n; i++) {
+    mvccKey k;
+    for (int j = len(rng); j > 0; j--) {
+      k.key.push_back(alphabet[byte(rng)]);
+    }
+    k.wall_time = ts(rng);
+    k.logical = ts(rng) == 0 ? 1 : 0;
+    if (ts(rng) == 0) {
+      k.wall_time = -1;
+    }
+    keys.push_back(k);
+  }
+  return keys;
+}
+
+int sign(int c) { return c < 0 ? -1 : (c > 0 ? 1 : 0); }
+
+}  // namespace
+
+TEST(Libroach, ComparableKeyOrder) {
+  const std::vector<mvccKey> keys = randomKeys(200);
+  std::vector<std::string> standard, comparable;
+  for (const auto& k : keys) {
+    standard.push_back(EncodeKey(DBKey{ToDBSlice(k.key), k.wall_time, k.logical}));
+    std::string c;
+    EncodeComparableKey(&c, k.key, k.wall_time, k.logical);
+    comparable.push_back(c);
+  }
+
+  // The bytewise order of the comparable keys is the MVCC order.
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  for (size_t i = 0; i < keys.size(); i++) {
+    for (size_t j = 0; j < keys.size(); j++) {
+      ASSERT_EQ(sign(cmp->Compare(standard[i], standard[j])),
+                sign(rocksdb::Slice(comparable[i]).compare(comparable[j])))
+          << i << " " << j;
+    }
+  }
+}
+
+TEST(Libroach, ComparableKeyRoundTrip) {
+  std::unique_ptr<const rocksdb::SliceTransform> prefix(NewComparableKeyPrefixExtractor());
+  for (const auto& k : randomKeys(200)) {
+    std::string c;
+    EncodeComparableKey(&c, k.key, k.wall_time, k.logical);
+    std::string key;
+    int64_t wall_time;
+    int32_t logical;
+    ASSERT_TRUE(DecodeComparableKey(c, &key, &wall_time, &logical));
+    EXPECT_EQ(k.key, key);
+    EXPECT_EQ(k.wall_time, wall_time);
+    EXPECT_EQ(k.logical, logical);
+
+    // All of the versions of a key share its prefix.
+    std::string metadata;
+    EncodeComparableKey(&metadata, k.key, 0, 0);
+    EXPECT_EQ(metadata, prefix->Transform(c).ToString());
+    EXPECT_EQ(metadata, ComparableKeyPrefix(metadata).ToString());
+
+    // Translation to and from the standard encoding.
+    const std::string standard = EncodeKey(DBKey{ToDBSlice(k.key), k.wall_time, k.logical});
+    std::string translated;
+    ASSERT_TRUE(ToComparableKey(standard, &translated));
+    EXPECT_EQ(c, translated);
+    ASSERT_TRUE(FromComparableKey(c, &translated));
+    EXPECT_EQ(standard, translated);
+  }
+
+  std::string key;
+  int64_t wall_time;
+  int32_t logical;
+  // Missing terminator, bad escape and truncated timestamp.
+  EXPECT_FALSE(DecodeComparableKey(rocksdb::Slice("a", 1), &key, &wall_time, &logical));
+  EXPECT_FALSE(DecodeComparableKey(rocksdb::Slice("a\x00\x02", 3), &key, &wall_time, &logical));
+  EXPECT_FALSE(
+      DecodeComparableKey(rocksdb::Slice("a\x00\x01\xff", 4), &key, &wall_time, &logical));
+  std::string translated;
+  EXPECT_FALSE(ToComparableKey(rocksdb::Slice(), &translated));
+  EXPECT_FALSE(ToComparableKey(rocksdb::Slice("a\x05", 2), &translated));
+}
@@ -14,8 +14,12 @@
 
 #include "db.h"
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <google/protobuf/stubs/stringprintf.h>
+#include <limits>
+#include <map>
 #include <mutex>
 #include <rocksdb/cache.h>
 #include <rocksdb/db.h>
@@ -25,16 +29,37 @@
 #include <rocksdb/merge_operator.h>
 #include <rocksdb/options.h>
 #include <rocksdb/perf_context.h>
+#include <rocksdb/persistent_cache.h>
 #include <rocksdb/slice_transform.h>
 #include <rocksdb/sst_file_writer.h>
 #include <rocksdb/statistics.h>
 #include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
 #include <rocksdb/utilities/write_batch_with_index.h>
+#include <set>
+#include <stdlib.h>
+#include <unordered_map>
+#include "batch_repr.h"
+#include "blob_store.h"
 #include "encoding.h"
+#include "env_readahead.h"
 #include "env_switching.h"
 #include "eventlistener.h"
 #include "fmt.h"
+#include "group_commit.h"
+#include "histogram.h"
+#include "key_sampler.h"
 #include "keys.h"
+#include "memory_stats.h"
+#include "rate_limiter.h"
+#include "read_pool.h"
+#include "scan_results.h"
+#include "scheduler.h"
+#include "sha512.h"
+#include "tombstone_compactor.h"
+#include "trace.h"
+#include "ts_columnar.h"
+#include "worker_pool.h"
 #include "protos/roachpb/data.pb.h"
 #include "protos/roachpb/internal.pb.h"
 #include "protos/storage/engine/enginepb/mvcc.pb.h"
@@ -65,7 +90,9 @@ char* __attribute__((weak)) prettyPrintKey(DBKey) { die_missing_symbol(__func__)
 #endif
 
 // DBOpenHook in OSS mode only verifies that no extra options are specified.
-__attribute__((weak)) rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions opts) {
+__attribute__((weak)) rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions opts,
+                                                 rocksdb::Env* base_env,
+                                                 std::unique_ptr<rocksdb::Env>* encrypted_env) {
   if (opts.extra_options.len != 0) {
     return rocksdb::Status::InvalidArgument(
         "DBOptions has extra_options, but OSS code cannot handle them");
@@ -73,9 +100,113 @@ __attribute__((weak)) rocksdb::Status DBOpenHook(const std::string& db_dir, cons
   return rocksdb::Status::OK();
 }
 
+// TrackedPersistentCache wraps a persistent cache to track its usage,
+// which the persistent cache does not report. The size of each
+// inserted block is recorded by the hash of its key, and released
+// once a lookup of the key misses because the persistent cache evicted
+// the file holding the block. Blocks which are evicted but not looked
+// up again are still counted, so the usage is capped at the capacity.
+class TrackedPersistentCache : public rocksdb::PersistentCache {
+ public:
+  TrackedPersistentCache(std::shared_ptr<rocksdb::PersistentCache> rep, uint64_t capacity)
+      : rep_(rep), capacity_(capacity), usage_(0) {}
+
+  virtual rocksdb::Status Insert(const rocksdb::Slice& key, const char* data, const size_t size) {
+    rocksdb::Status status = rep_->Insert(key, data, size);
+    if (status.ok()) {
+      std::lock_guard<std::mutex> guard(mu_);
+      uint64_t& tracked = sizes_[hash(key)];
+      usage_ += size - tracked;
+      tracked = size;
+    }
+    return status;
+  }
+  virtual rocksdb::Status Lookup(const rocksdb::Slice& key, std::unique_ptr<char[]>* data,
+                                 size_t* size) {
+    rocksdb::Status status = rep_->Lookup(key, data, size);
+    if (!status.ok()) {
+      std::lock_guard<std::mutex> guard(mu_);
+      auto it = sizes_.find(hash(key));
+      if (it != sizes_.end()) {
+        usage_ -= it->second;
+        sizes_.erase(it);
+      }
+    }
+    return status;
+  }
+  virtual bool IsCompressed() { return rep_->IsCompressed(); }
+  virtual StatsType Stats() { return rep_->Stats(); }
+  virtual std::string GetPrintableOptions() const { return rep_->GetPrintableOptions(); }
+
+  uint64_t Usage() {
+    std::lock_guard<std::mutex> guard(mu_);
+    return std::min(usage_, capacity_);
+  }
+
+ private:
+  static size_t hash(const rocksdb::Slice& key) {
+    return std::hash<std::string>()(key.ToString());
+  }
+
+  const std::shared_ptr<rocksdb::PersistentCache> rep_;
+  const uint64_t capacity_;
+  std::mutex mu_;
+  std::unordered_map<size_t, uint64_t> sizes_;
+  uint64_t usage_;
+};
+
 struct DBCache {
   std::mutex mu;
   std::shared_ptr<rocksdb::Cache> rep;
+  // The optional persistent (e.g. NVMe) tier holding blocks evicted
+  // from rep.
+  std::shared_ptr<TrackedPersistentCache> persistent;
+  // Whether index and filter blocks are stored in rep (with high
+  // priority) rather than held by the table readers.
+  bool cache_index_and_filter_blocks;
+};
+
+struct DBScheduler {
+  std::shared_ptr<BackgroundScheduler> rep;
+};
+
+class BatchPool;
+class IterPool;
+class TimeBoundTableCache;
+
+// LatencyStats holds an engine's per-operation latency histograms (in
+// nanoseconds). See DBGetLatencyStats.
+struct LatencyStats {
+  ShardedHistogram mvcc_scan;
+  ShardedHistogram mvcc_get;
+  ShardedHistogram iter_seek;
+  ShardedHistogram commit_batch;
+  ShardedHistogram apply_batch_repr;
+  ShardedHistogram sync_wal;
+};
+
+// LatencyTimer records the time elapsed between its construction and
+// destruction in one of the histograms of a LatencyStats. A NULL
+// LatencyStats disables the timer.
+class LatencyTimer {
+ public:
+  LatencyTimer(LatencyStats* stats, ShardedHistogram LatencyStats::*hist)
+      : hist_(stats != nullptr ? &(stats->*hist) : nullptr) {
+    if (hist_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~LatencyTimer() {
+    if (hist_ != nullptr) {
+      hist_->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count());
+    }
+  }
+
+ private:
+  ShardedHistogram* const hist_;
+  std::chrono::steady_clock::time_point start_;
 };
 
 struct DBEngine {
@@ -87,6 +218,10 @@ struct DBEngine {
   virtual DBStatus Put(DBKey key, DBSlice value) = 0;
   virtual DBStatus Merge(DBKey key, DBSlice value) = 0;
   virtual DBStatus Delete(DBKey key) = 0;
+  // DeleteEncoded is like Delete but takes an already encoded MVCC
+  // key, avoiding a decode/encode round trip for callers (such as
+  // DBDeleteIterRange) which have the encoded key in hand.
+  virtual DBStatus DeleteEncoded(const rocksdb::Slice& key) = 0;
   virtual DBStatus DeleteRange(DBKey start, DBKey end) = 0;
   virtual DBStatus CommitBatch(bool sync) = 0;
   virtual DBStatus ApplyBatchRepr(DBSlice repr, bool sync) = 0;
@@ -96,17 +231,218 @@ struct DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats) = 0;
   virtual DBString GetCompactionStats() = 0;
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents) = 0;
+  virtual DBStatus EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                               std::unique_ptr<rocksdb::WritableFile>* file) = 0;
+  virtual DBStatus ResetBatch() = 0;
 
   DBSSTable* GetSSTables(int* n);
   DBString GetUserProperties();
+
+  // GetEventListener returns the engine's event listener, or NULL if
+  // it has none (e.g. batches and snapshots).
+  virtual DBEventListener* GetEventListener() { return nullptr; }
+
+  // GetWriteListener returns the event listener which is notified of
+  // the range deletions written through the engine (see
+  // DBEventListener::RangeDeletionWritten), or NULL if there is none.
+  // Batches and snapshots share the listener of the engine they were
+  // created on.
+  virtual DBEventListener* GetWriteListener() { return nullptr; }
+
+  // GetGroupCommitter returns the engine's group committer, or NULL if
+  // it has none (e.g. batches and snapshots).
+  virtual GroupCommitter* GetGroupCommitter() { return nullptr; }
+
+  // GetWriteBatch returns the pending mutations of a batch engine, or
+  // NULL for engines which are not batches.
+  virtual rocksdb::WriteBatch* GetWriteBatch() { return nullptr; }
+
+  // GetBatchPool returns the pool from which batches created on the
+  // engine are allocated, or NULL if it has none.
+  virtual std::shared_ptr<BatchPool> GetBatchPool() { return nullptr; }
+
+  // GetIterPool returns the engine's iterator pool, or NULL if it has
+  // none.
+  virtual IterPool* GetIterPool() { return nullptr; }
+
+  // GetLatencyStats returns the latency histograms operations on the
+  // engine are recorded in. Batches and snapshots share the histograms
+  // of the engine they were created on.
+  virtual LatencyStats* GetLatencyStats() { return nullptr; }
+
+  // GetTracer returns the tracer operations on the engine are recorded
+  // by. Batches and snapshots share the tracer of the engine they were
+  // created on.
+  virtual Tracer* GetTracer() { return nullptr; }
+
+  // GetKeySampler returns the sampler of the keys accessed on the
+  // engine, or NULL if sampling is disabled. Batches and snapshots
+  // share the sampler of the engine they were created on.
+  virtual KeySampler* GetKeySampler() { return nullptr; }
+
+  // GetTombstoneCompactor returns the engine's tombstone compactor, or
+  // NULL if it has none.
+  virtual TombstoneCompactor* GetTombstoneCompactor() { return nullptr; }
+
+  // GetBlobStore returns the store large values are separated into, or
+  // NULL if value separation has never been enabled. Batches and
+  // snapshots share the blob store of the engine they were created on.
+  virtual BlobStore* GetBlobStore() { return nullptr; }
+
+  // GetTimeBoundTableCache returns the cache of the timestamp bounds of
+  // the engine's sstables, or NULL if it has none. Batches and
+  // snapshots share the cache of the engine they were created on.
+  virtual TimeBoundTableCache* GetTimeBoundTableCache() { return nullptr; }
+
+  // GetOpenStats returns the startup timing of an engine created by
+  // DBOpen, or NULL for other engines.
+  virtual const DBOpenStats* GetOpenStats() { return nullptr; }
+
+  // GetBlockCache returns the engine's block cache, or NULL for
+  // engines not created by DBOpen.
+  virtual rocksdb::Cache* GetBlockCache() { return nullptr; }
+
+  // GetReadPool returns the threads executing the reads submitted with
+  // DBSubmitReads, or NULL if the engine has none.
+  virtual ReadPool* GetReadPool() { return nullptr; }
+
+  // ReturnToPool resets the engine and hands it back to the pool it
+  // was allocated from, returning false if the engine is not pooled
+  // (or the pool is full) and should be deleted instead.
+  virtual bool ReturnToPool() { return false; }
+};
+
+// BatchPool caches closed batches so that DBNewBatch can reuse them
+// (and the memory backing their WriteBatch) rather than allocating a
+// new batch for every write. Batches which have grown larger than
+// kMaxPooledBatchBytes are not pooled so that a single large batch
+// does not pin its memory indefinitely. The pool is shared by the
+// engine and its batches: a batch closed after the engine is deleted
+// rather than returned to the (closed) pool.
+class BatchPool {
+ public:
+  static const size_t kMaxPooledBatches = 64;
+  static const size_t kMaxPooledBatchBytes = 1 << 20;
+
+  BatchPool() : closed_(false) {}
+  ~BatchPool() { Close(); }
+
+  // Close deletes the pooled batches, which reference the pool, and
+  // causes subsequent calls to Put to fail. It is called when the
+  // engine is closed.
+  void Close() {
+    std::vector<DBEngine*> batches;
+    {
+      std::lock_guard<std::mutex> l(mu_);
+      closed_ = true;
+      for (auto& v : free_) {
+        batches.insert(batches.end(), v.begin(), v.end());
+        v.clear();
+      }
+    }
+    for (auto b : batches) {
+      delete b;
+    }
+  }
+
+  // Get returns a pooled (and reset) batch, or NULL if there are none.
+  DBEngine* Get(bool write_only) {
+    std::lock_guard<std::mutex> l(mu_);
+    std::vector<DBEngine*>& v = free_[write_only];
+    if (v.empty()) {
+      return nullptr;
+    }
+    DBEngine* b = v.back();
+    v.pop_back();
+    return b;
+  }
+
+  // Put adds a reset batch to the pool, returning false if the pool is
+  // full or closed.
+  bool Put(DBEngine* batch, bool write_only) {
+    std::lock_guard<std::mutex> l(mu_);
+    std::vector<DBEngine*>& v = free_[write_only];
+    if (closed_ || v.size() >= kMaxPooledBatches) {
+      return false;
+    }
+    v.push_back(batch);
+    return true;
+  }
+
+ private:
+  std::mutex mu_;
+  bool closed_;
+  // The free indexed and write-only batches.
+  std::vector<DBEngine*> free_[2];
+};
+
+// IterPool caches destroyed iterators for reuse by DBNewPooledIter.
+// Constructing a RocksDB iterator allocates its merging iterator state
+// and pins the current SuperVersion; a pooled iterator is instead
+// refreshed to the latest SuperVersion when it is reused, which reuses
+// its state. Note that an idle pooled iterator still pins the
+// SuperVersion it last read, and so the memtables and sstables it
+// references, until it is reused or the engine is closed. The pool is
+// bounded by kMaxPooledIters to limit the number of such iterators.
+class IterPool {
+ public:
+  static const size_t kMaxPooledIters = 16;
+
+  ~IterPool();
+
+  // Get returns a pooled iterator in the given mode refreshed to the
+  // latest SuperVersion, or NULL if there are none.
+  DBIterator* Get(bool prefix);
+
+  // Put adds an iterator to the pool, returning false if the iterator
+  // could not be pooled and must be deleted.
+  bool Put(DBIterator* iter);
+
+ private:
+  std::mutex mu_;
+  // The free total order and prefix iterators.
+  std::vector<DBIterator*> free_[2];
 };
 
 struct DBImpl : public DBEngine {
   std::unique_ptr<rocksdb::Env> switching_env;
   std::unique_ptr<rocksdb::Env> memenv;
+  // The env performing readahead on sstable reads, if enabled.
+  std::unique_ptr<ReadaheadEnv> readahead_env;
+  // The env timing the phases of DBOpen.
+  std::unique_ptr<rocksdb::Env> open_timer_env;
+  // The env running background jobs on a shared scheduler, if any.
+  std::unique_ptr<SchedulingEnv> scheduling_env;
+  // NB: declared before rep_deleter so that the blob store outlives the
+  // DB, which calls it after flushes and compactions.
+  std::shared_ptr<BlobStore> blob_store;
   std::unique_ptr<rocksdb::DB> rep_deleter;
   std::shared_ptr<rocksdb::Cache> block_cache;
+  std::shared_ptr<TrackedPersistentCache> persistent_cache;
   std::shared_ptr<DBEventListener> event_listener;
+  // NB: declared after rep_deleter so that the commit thread is
+  // stopped before the DB is deleted.
+  std::unique_ptr<GroupCommitter> group_committer;
+  std::shared_ptr<BatchPool> batch_pool;
+  IterPool iter_pool;
+  LatencyStats latency_stats;
+  Tracer tracer;
+  // The sampler of accessed keys, if enabled.
+  std::unique_ptr<KeySampler> key_sampler;
+  // The rate limiter of flush and compaction writes, if enabled. Its
+  // tuning thread samples latency_stats and is stopped before the
+  // DBImpl is torn down.
+  std::shared_ptr<AdaptiveRateLimiter> rate_limiter;
+  // The compactor of sstables dense with tombstones, if enabled. Its
+  // thread compacts rep and is stopped before the DBImpl is torn down.
+  std::shared_ptr<TombstoneCompactor> tombstone_compactor;
+  DBOpenStats open_stats;
+  // The timestamp bounds of rep's sstables (see DBNewTimeBoundIter).
+  std::shared_ptr<TimeBoundTableCache> time_bound_cache;
+  // The threads executing submitted reads, if enabled. NB: declared
+  // last so that the threads (and their iterators) are stopped before
+  // the rest of the DBImpl is torn down.
+  std::unique_ptr<ReadPool> read_pool;
 
   // Construct a new DBImpl from the specified DB.
   // The DB and passed Envs will be deleted when the DBImpl is deleted.
@@ -118,8 +454,22 @@ struct DBImpl : public DBEngine {
         memenv(m),
         rep_deleter(r),
         block_cache(bc),
-        event_listener(event_listener) {}
+        event_listener(event_listener),
+        group_committer(new GroupCommitter(r)),
+        batch_pool(std::make_shared<BatchPool>()) {
+    memset(&open_stats, 0, sizeof(open_stats));
+  }
   virtual ~DBImpl() {
+    batch_pool->Close();
+    if (tombstone_compactor != nullptr) {
+      tombstone_compactor->Stop();
+    }
+    if (blob_store != nullptr) {
+      blob_store->Stop();
+    }
+    if (rate_limiter != nullptr) {
+      rate_limiter->Stop();
+    }
     const rocksdb::Options& opts = rep->GetOptions();
     const std::shared_ptr<rocksdb::Statistics>& s = opts.statistics;
     rocksdb::Info(opts.info_log, "bloom filter utility:    %0.1f%%",
@@ -130,6 +480,7 @@ struct DBImpl : public DBEngine {
   virtual DBStatus Put(DBKey key, DBSlice value);
   virtual DBStatus Merge(DBKey key, DBSlice value);
   virtual DBStatus Delete(DBKey key);
+  virtual DBStatus DeleteEncoded(const rocksdb::Slice& key);
   virtual DBStatus DeleteRange(DBKey start, DBKey end);
   virtual DBStatus CommitBatch(bool sync);
   virtual DBStatus ApplyBatchRepr(DBSlice repr, bool sync);
@@ -139,19 +490,50 @@ struct DBImpl : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
+  virtual DBStatus EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                               std::unique_ptr<rocksdb::WritableFile>* file);
+  virtual DBStatus ResetBatch();
+  virtual DBEventListener* GetEventListener() { return event_listener.get(); }
+  virtual DBEventListener* GetWriteListener() { return event_listener.get(); }
+  virtual GroupCommitter* GetGroupCommitter() { return group_committer.get(); }
+  virtual std::shared_ptr<BatchPool> GetBatchPool() { return batch_pool; }
+  virtual IterPool* GetIterPool() { return &iter_pool; }
+  virtual LatencyStats* GetLatencyStats() { return &latency_stats; }
+  virtual Tracer* GetTracer() { return &tracer; }
+  virtual KeySampler* GetKeySampler() { return key_sampler.get(); }
+  virtual TombstoneCompactor* GetTombstoneCompactor() { return tombstone_compactor.get(); }
+  virtual BlobStore* GetBlobStore() { return blob_store.get(); }
+  virtual TimeBoundTableCache* GetTimeBoundTableCache() { return time_bound_cache.get(); }
+  virtual const DBOpenStats* GetOpenStats() { return &open_stats; }
+  virtual rocksdb::Cache* GetBlockCache() { return block_cache.get(); }
+  virtual ReadPool* GetReadPool() { return read_pool.get(); }
 };
 
 struct DBBatch : public DBEngine {
   int updates;
   bool has_delete_range;
   rocksdb::WriteBatchWithIndex batch;
+  // The memory backing the batch repr, which is retained across
+  // resets so that pooled batches hold on to it.
+  MemoryReservation reservation;
+  const std::shared_ptr<BatchPool> pool;
+  LatencyStats* const latency_stats;
+  Tracer* const tracer;
+  KeySampler* const key_sampler;
+  BlobStore* const blob_store;
+  TimeBoundTableCache* const time_bound_cache;
+  DBEventListener* const write_listener;
 
   DBBatch(DBEngine* db);
   virtual ~DBBatch() {}
 
+  // AccountMemory updates the reservation after the batch has grown.
+  void AccountMemory() { reservation.Set(GetWriteBatch()->Data().capacity()); }
+
   virtual DBStatus Put(DBKey key, DBSlice value);
   virtual DBStatus Merge(DBKey key, DBSlice value);
   virtual DBStatus Delete(DBKey key);
+  virtual DBStatus DeleteEncoded(const rocksdb::Slice& key);
   virtual DBStatus DeleteRange(DBKey start, DBKey end);
   virtual DBStatus CommitBatch(bool sync);
   virtual DBStatus ApplyBatchRepr(DBSlice repr, bool sync);
@@ -161,18 +543,43 @@ struct DBBatch : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
+  virtual DBStatus EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                               std::unique_ptr<rocksdb::WritableFile>* file);
+  virtual DBStatus ResetBatch();
+  virtual rocksdb::WriteBatch* GetWriteBatch() { return batch.GetWriteBatch(); }
+  virtual bool ReturnToPool();
+  virtual LatencyStats* GetLatencyStats() { return latency_stats; }
+  virtual Tracer* GetTracer() { return tracer; }
+  virtual KeySampler* GetKeySampler() { return key_sampler; }
+  virtual BlobStore* GetBlobStore() { return blob_store; }
+  virtual TimeBoundTableCache* GetTimeBoundTableCache() { return time_bound_cache; }
+  virtual DBEventListener* GetWriteListener() { return write_listener; }
 };
 
 struct DBWriteOnlyBatch : public DBEngine {
   int updates;
   rocksdb::WriteBatch batch;
+  // The memory backing the batch repr, which is retained across
+  // resets so that pooled batches hold on to it.
+  MemoryReservation reservation;
+  const std::shared_ptr<BatchPool> pool;
+  LatencyStats* const latency_stats;
+  Tracer* const tracer;
+  KeySampler* const key_sampler;
+  BlobStore* const blob_store;
+  TimeBoundTableCache* const time_bound_cache;
+  DBEventListener* const write_listener;
 
   DBWriteOnlyBatch(DBEngine* db);
   virtual ~DBWriteOnlyBatch() {}
 
+  // AccountMemory updates the reservation after the batch has grown.
+  void AccountMemory() { reservation.Set(GetWriteBatch()->Data().capacity()); }
+
   virtual DBStatus Put(DBKey key, DBSlice value);
   virtual DBStatus Merge(DBKey key, DBSlice value);
   virtual DBStatus Delete(DBKey key);
+  virtual DBStatus DeleteEncoded(const rocksdb::Slice& key);
   virtual DBStatus DeleteRange(DBKey start, DBKey end);
   virtual DBStatus CommitBatch(bool sync);
   virtual DBStatus ApplyBatchRepr(DBSlice repr, bool sync);
@@ -182,17 +589,45 @@ struct DBWriteOnlyBatch : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
+  virtual DBStatus EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                               std::unique_ptr<rocksdb::WritableFile>* file);
+  virtual DBStatus ResetBatch();
+  virtual rocksdb::WriteBatch* GetWriteBatch() { return &batch; }
+  virtual bool ReturnToPool();
+  virtual LatencyStats* GetLatencyStats() { return latency_stats; }
+  virtual Tracer* GetTracer() { return tracer; }
+  virtual KeySampler* GetKeySampler() { return key_sampler; }
+  virtual BlobStore* GetBlobStore() { return blob_store; }
+  virtual TimeBoundTableCache* GetTimeBoundTableCache() { return time_bound_cache; }
+  virtual DBEventListener* GetWriteListener() { return write_listener; }
 };
 
 struct DBSnapshot : public DBEngine {
+  // NB: declared before snapshot so that the blob store is pinned
+  // before the snapshot is acquired.
+  BlobReadPin blob_pin;
   const rocksdb::Snapshot* snapshot;
-
-  DBSnapshot(DBEngine* db) : DBEngine(db->rep), snapshot(db->rep->GetSnapshot()) {}
+  LatencyStats* const latency_stats;
+  Tracer* const tracer;
+  KeySampler* const key_sampler;
+  TimeBoundTableCache* const time_bound_cache;
+  DBEventListener* const write_listener;
+
+  DBSnapshot(DBEngine* db)
+      : DBEngine(db->rep),
+        blob_pin(db->GetBlobStore()),
+        snapshot(db->rep->GetSnapshot()),
+        latency_stats(db->GetLatencyStats()),
+        tracer(db->GetTracer()),
+        key_sampler(db->GetKeySampler()),
+        time_bound_cache(db->GetTimeBoundTableCache()),
+        write_listener(db->GetWriteListener()) {}
   virtual ~DBSnapshot() { rep->ReleaseSnapshot(snapshot); }
 
   virtual DBStatus Put(DBKey key, DBSlice value);
   virtual DBStatus Merge(DBKey key, DBSlice value);
   virtual DBStatus Delete(DBKey key);
+  virtual DBStatus DeleteEncoded(const rocksdb::Slice& key);
   virtual DBStatus DeleteRange(DBKey start, DBKey end);
   virtual DBStatus CommitBatch(bool sync);
   virtual DBStatus ApplyBatchRepr(DBSlice repr, bool sync);
@@ -202,14 +637,70 @@ struct DBSnapshot : public DBEngine {
   virtual DBStatus GetStats(DBStatsResult* stats);
   virtual DBString GetCompactionStats();
   virtual DBStatus EnvWriteFile(DBSlice path, DBSlice contents);
+  virtual DBStatus EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                               std::unique_ptr<rocksdb::WritableFile>* file);
+  virtual DBStatus ResetBatch();
+  virtual LatencyStats* GetLatencyStats() { return latency_stats; }
+  virtual Tracer* GetTracer() { return tracer; }
+  virtual KeySampler* GetKeySampler() { return key_sampler; }
+  virtual BlobStore* GetBlobStore() { return blob_pin.store(); }
+  virtual TimeBoundTableCache* GetTimeBoundTableCache() { return time_bound_cache; }
+  virtual DBEventListener* GetWriteListener() { return write_listener; }
 };
 
 struct DBIterator {
+  DBIterator()
+      : prefix(false),
+        pool(nullptr),
+        latency_stats(nullptr),
+        tracer(nullptr),
+        trace_id(0),
+        key_sampler(nullptr) {}
+
+  // The pin on the blob store which the values the iterator sees may
+  // reference. NB: declared before rep so that the pin is released
+  // after the iterator is destroyed.
+  BlobReadPin blob_pin;
   std::unique_ptr<rocksdb::Iterator> rep;
-  std::unique_ptr<rocksdb::WriteBatch> kvs;
-  std::unique_ptr<rocksdb::WriteBatch> intents;
+  // Is this a prefix iterator (see DBNewIter)?
+  bool prefix;
+  // The pool the iterator is returned to when destroyed, if any (see
+  // DBNewPooledIter).
+  IterPool* pool;
+  // The latency histograms of the engine the iterator was created on.
+  LatencyStats* latency_stats;
+  // The tracer of the engine the iterator was created on.
+  Tracer* tracer;
+  // The ID of the iterator in the trace being recorded, or 0 if it has
+  // not been used while tracing (see Tracer::IterID).
+  uint64_t trace_id;
+  // The key sampler of the engine the iterator was created on.
+  KeySampler* key_sampler;
+  // The results of the most recent MVCCScan or MVCCGet. The buffers
+  // are reused across scans in order to avoid allocating on every
+  // call.
+  ScanResultBuffer kvs;
+  ScanResultBuffer intents;
+  // The per-span result boundaries of the most recent MVCCScanSpans.
+  std::vector<int64_t> span_ends;
+  // The encoded key a scan which stopped at its target bytes should
+  // resume from.
+  std::string resume_key;
+  // The most recent value read from the blob store.
+  std::string blob_value;
 };
 
+namespace {
+
+// traceIterID returns the ID of iter in the trace being recorded by
+// its tracer, recording the creation of the iterator if this is its
+// first use in the trace.
+uint64_t traceIterID(DBIterator* iter) {
+  return iter->tracer->IterID(&iter->trace_id, iter->prefix);
+}
+
+}  // namespace
+
 std::string ToString(DBSlice s) { return std::string(s.data, s.len); }
 
 std::string ToString(DBString s) { return std::string(s.data, s.len); }
@@ -435,7 +926,15 @@ DBIterState DBIterGetState(DBIterator* iter) {
     state.valid = DecodeKey(iter->rep->key(), &key, &state.key.wall_time, &state.key.logical);
     if (state.valid) {
       state.key.key = ToDBSlice(key);
-      state.value = ToDBSlice(iter->rep->value());
+      rocksdb::Slice value = iter->rep->value();
+      const rocksdb::Status status =
+          ResolveBlobValue(iter->blob_pin.store(), &value, &iter->blob_value);
+      if (!status.ok()) {
+        state.valid = false;
+        state.status = ToDBStatus(status);
+      } else {
+        state.value = ToDBSlice(value);
+      }
     }
   }
   return state;
@@ -538,11 +1037,67 @@ class DBComparator : public rocksdb::Comparator {
     return a == b;
   }
 
-  // The RocksDB docs say it is safe to leave these two methods unimplemented.
+  // FindShortestSeparator and FindShortSuccessor are used by RocksDB
+  // to shorten the keys stored in index blocks. Shortening operates on
+  // the user key portion of the MVCC key: the shortened user key is
+  // encoded without a timestamp which sorts it before every version of
+  // that key. Without this, every index entry holds a full MVCC key
+  // including its timestamp suffix.
   virtual void FindShortestSeparator(std::string* start,
-                                     const rocksdb::Slice& limit) const override {}
+                                     const rocksdb::Slice& limit) const override {
+    rocksdb::Slice key_start, key_limit;
+    rocksdb::Slice ts_start, ts_limit;
+    if (!SplitKey(*start, &key_start, &ts_start) || !SplitKey(limit, &key_limit, &ts_limit)) {
+      return;
+    }
+
+    // Find length of common prefix.
+    const size_t min_length = std::min(key_start.size(), key_limit.size());
+    size_t diff_index = 0;
+    while (diff_index < min_length && key_start[diff_index] == key_limit[diff_index]) {
+      diff_index++;
+    }
+    if (diff_index >= min_length) {
+      // One user key is a prefix of the other (or they are equal).
+      return;
+    }
+
+    const uint8_t diff_byte = static_cast<uint8_t>(key_start[diff_index]);
+    if (diff_byte >= 0xff || diff_byte + 1 >= static_cast<uint8_t>(key_limit[diff_index])) {
+      return;
+    }
+    // The separator is a strict successor of the start user key and a
+    // strict predecessor of the limit user key. The encoded separator
+    // therefore sorts after every version of the start key and before
+    // every version of the limit key.
+    std::string sep(key_start.data(), diff_index + 1);
+    sep[diff_index]++;
+    if (sep.size() + 1 < start->size()) {
+      sep.push_back(0);  // The timestamp length.
+      start->swap(sep);
+    }
+  }
 
-  virtual void FindShortSuccessor(std::string* key) const override {}
+  virtual void FindShortSuccessor(std::string* key) const override {
+    rocksdb::Slice user_key, ts;
+    if (!SplitKey(*key, &user_key, &ts)) {
+      return;
+    }
+    // Find first character that can be incremented.
+    for (size_t i = 0; i < user_key.size(); i++) {
+      const uint8_t byte = static_cast<uint8_t>(user_key[i]);
+      if (byte != 0xff) {
+        std::string succ(user_key.data(), i + 1);
+        succ[i] = byte + 1;
+        if (succ.size() + 1 < key->size()) {
+          succ.push_back(0);  // The timestamp length.
+          key->swap(succ);
+        }
+        return;
+      }
+    }
+    // *key is a run of 0xffs. Leave it alone.
+  }
 };
 
 const DBComparator kComparator;
@@ -589,6 +1144,48 @@ class DBBatchInserter : public rocksdb::WriteBatch::Handler {
   rocksdb::WriteBatchBase* const batch_;
 };
 
+// ApplyBatchReprInPlace applies the entries of the batch repr to
+// batch, decoding the repr in place rather than first copying it into
+// a rocksdb::WriteBatch. The number of entries applied is added to
+// *updates and *has_delete_range is set to true if the repr contains
+// a range deletion.
+DBStatus ApplyBatchReprInPlace(rocksdb::WriteBatchBase* batch, DBSlice repr, int* updates,
+                               bool* has_delete_range) {
+  BatchReprReader reader(ToSlice(repr));
+  if (!reader.Init()) {
+    return FmtStatus("%s", reader.Error().c_str());
+  }
+  int count = 0;
+  while (reader.Next()) {
+    switch (reader.Type()) {
+    case kBatchTypeValue:
+      batch->Put(reader.Key(), reader.Value());
+      break;
+    case kBatchTypeDeletion:
+      batch->Delete(reader.Key());
+      break;
+    case kBatchTypeSingleDeletion:
+      batch->SingleDelete(reader.Key());
+      break;
+    case kBatchTypeMerge:
+      batch->Merge(reader.Key(), reader.Value());
+      break;
+    case kBatchTypeRangeDeletion:
+      batch->DeleteRange(reader.Key(), reader.Value());
+      *has_delete_range = true;
+      break;
+    default:
+      return FmtStatus("unexpected batch entry type: %d", int(reader.Type()));
+    }
+    ++count;
+  }
+  if (!reader.Error().empty()) {
+    return FmtStatus("%s", reader.Error().c_str());
+  }
+  *updates += count;
+  return kSuccess;
+}
+
 // Method used to sort InternalTimeSeriesSamples.
 bool TimeSeriesSampleOrdering(const cockroach::roachpb::InternalTimeSeriesSample* a,
                               const cockroach::roachpb::InternalTimeSeriesSample* b) {
@@ -607,6 +1204,82 @@ void SerializeTimeSeriesToValue(std::string* val,
   SetTag(val, cockroach::roachpb::TIMESERIES);
 }
 
+// IsColumnarTimeSeriesData returns true if the given Value contains
+// time series data in the columnar encoding (see ts_columnar.h).
+bool IsColumnarTimeSeriesData(const std::string& val) {
+  return GetTag(val) == cockroach::roachpb::TIMESERIES_COLUMNAR;
+}
+
+// ConvertTimeSeriesToColumnar converts a Value containing an
+// InternalTimeSeriesData message into a Value containing the same
+// samples in the columnar encoding. Duplicate offsets are resolved the
+// same way as ConsolidateTimeSeriesValue (the last sample wins).
+// Returns false if the value cannot be parsed or uses the deprecated
+// sample fields which the columnar encoding cannot represent.
+WARN_UNUSED_RESULT bool ConvertTimeSeriesToColumnar(const std::string& val, std::string* result,
+                                                    rocksdb::Logger* logger) {
+  cockroach::roachpb::InternalTimeSeriesData ts;
+  if (!ParseProtoFromValue(val, &ts)) {
+    rocksdb::Warn(logger, "InternalTimeSeriesData could not be parsed from bytes.");
+    return false;
+  }
+  std::stable_sort(ts.mutable_samples()->pointer_begin(), ts.mutable_samples()->pointer_end(),
+                   TimeSeriesSampleOrdering);
+
+  ColumnarTimeSeriesWriter writer;
+  writer.Reset(ts.start_timestamp_nanos(), ts.sample_duration_nanos());
+  for (int i = 0; i < ts.samples_size(); i++) {
+    const cockroach::roachpb::InternalTimeSeriesSample& sample = ts.samples(i);
+    if (sample.has_max() || sample.has_min() || sample.count() > 1) {
+      rocksdb::Warn(logger, "cannot convert time series sample with deprecated fields.");
+      return false;
+    }
+    if (i + 1 < ts.samples_size() && ts.samples(i + 1).offset() == sample.offset()) {
+      continue;
+    }
+    writer.Add(sample.offset(), sample.sum());
+  }
+
+  result->assign(kHeaderSize, '\0');
+  SetTag(result, cockroach::roachpb::TIMESERIES_COLUMNAR);
+  writer.Finish(result);
+  return true;
+}
+
+// MergeColumnarTimeSeriesValues merges the time series values (at
+// least one of which uses the columnar encoding) into a single
+// columnar value stored in *left. Values using the protobuf encoding
+// are converted first. Returns true if the merge is successful.
+WARN_UNUSED_RESULT bool MergeColumnarTimeSeriesValues(std::string* left,
+                                                      const std::vector<const std::string*>& rights,
+                                                      rocksdb::Logger* logger) {
+  std::vector<std::string> converted(rights.size() + 1);
+  std::vector<rocksdb::Slice> values;
+  values.reserve(rights.size() + 1);
+  for (int i = 0; i <= rights.size(); i++) {
+    const std::string* val = (i == 0) ? left : rights[i - 1];
+    if (IsTimeSeriesData(*val)) {
+      if (!ConvertTimeSeriesToColumnar(*val, &converted[i], logger)) {
+        return false;
+      }
+      val = &converted[i];
+    } else if (!IsColumnarTimeSeriesData(*val)) {
+      rocksdb::Warn(logger, "inconsistent value types for merging time series data");
+      return false;
+    }
+    values.push_back(ValueDataBytes(*val));
+  }
+
+  std::string result(kHeaderSize, '\0');
+  SetTag(&result, cockroach::roachpb::TIMESERIES_COLUMNAR);
+  if (!MergeColumnarTimeSeries(values, &result)) {
+    rocksdb::Warn(logger, "columnar time series merge failed");
+    return false;
+  }
+  left->swap(result);
+  return true;
+}
+
 // MergeTimeSeriesValues attempts to merge two Values which contain
 // InternalTimeSeriesData messages. The messages cannot be merged if they have
 // different start timestamps or sample durations. Returns true if the merge is
@@ -745,6 +1418,188 @@ WARN_UNUSED_RESULT bool ConsolidateTimeSeriesValue(std::string* val, rocksdb::Lo
   return true;
 }
 
+// kTimeSeriesPrefix is the prefix of time series data keys. The keys
+// have the form (see Go ts.MakeDataKey):
+//
+//   <prefix><name:bytes><resolution:varint><timeslot:varint><source>
+const rocksdb::Slice kTimeSeriesPrefix("\x04tsd", 4);
+
+// The maximum number of intervals a time series query may return,
+// summed over all of its series.
+const int64_t kMaxTimeSeriesQueryIntervals = 1 << 20;
+
+// timeSeriesQuery aggregates the samples of the time series values in
+// a key span into fixed size intervals, separately for each series
+// (i.e. each name, resolution and source).
+class timeSeriesQuery {
+ public:
+  timeSeriesQuery(const DBTimeSeriesQuery& query, int64_t num_intervals)
+      : query_(query), num_intervals_(num_intervals) {}
+
+  // Add aggregates the samples of the value stored under the data key,
+  // which is either an InternalTimeSeriesData message or columnar time
+  // series data.
+  DBStatus Add(const rocksdb::Slice& key, const std::string& value) {
+    series* s = nullptr;
+    DBStatus status = lookup(key, &s);
+    if (status.data != NULL) {
+      return status;
+    }
+
+    if (IsColumnarTimeSeriesData(value)) {
+      ColumnarTimeSeriesReader reader;
+      if (!reader.Init(ValueDataBytes(value))) {
+        return FmtStatus("unable to decode columnar time series data");
+      }
+      while (reader.Next()) {
+        const double sum = reader.sum();
+        add(s, reader.start_nanos() + reader.offset() * reader.duration_nanos(), 1, sum, sum,
+            sum);
+      }
+      if (reader.Error()) {
+        return FmtStatus("unable to decode columnar time series data");
+      }
+      return kSuccess;
+    }
+
+    if (!IsTimeSeriesData(value) || !ParseProtoFromValue(value, &ts_)) {
+      return FmtStatus("unable to decode time series data");
+    }
+    const int64_t start = ts_.start_timestamp_nanos();
+    const int64_t duration = ts_.sample_duration_nanos();
+    for (const auto& sample : ts_.samples()) {
+      const uint32_t count = std::max<uint32_t>(sample.count(), 1);
+      const double avg = sample.sum() / count;
+      add(s, start + sample.offset() * duration, count, sample.sum(),
+          sample.has_max() ? sample.max() : avg, sample.has_min() ? sample.min() : avg);
+    }
+    return kSuccess;
+  }
+
+  // Finish fills in the results, transferring ownership of the
+  // allocated memory to the caller.
+  void Finish(DBTimeSeriesQueryResults* results) {
+    results->num_series = series_.size();
+    results->num_intervals = num_intervals_;
+    results->series = static_cast<DBTimeSeries*>(malloc(series_.size() * sizeof(DBTimeSeries)));
+    int i = 0;
+    for (const auto& it : series_) {
+      const series& s = it.second;
+      DBTimeSeries* out = &results->series[i++];
+      out->name = ToDBString(s.name);
+      out->source = ToDBString(s.source);
+      out->resolution = s.resolution;
+      out->values = static_cast<double*>(malloc(num_intervals_ * sizeof(double)));
+      for (int64_t j = 0; j < num_intervals_; j++) {
+        out->values[j] = value(s.intervals[j]);
+      }
+    }
+  }
+
+ private:
+  struct interval {
+    interval()
+        : count(0),
+          sum(0),
+          max(-std::numeric_limits<double>::infinity()),
+          min(std::numeric_limits<double>::infinity()),
+          last(0),
+          last_nanos(0) {}
+    uint64_t count;
+    double sum;
+    double max;
+    double min;
+    double last;
+    int64_t last_nanos;
+  };
+
+  struct series {
+    std::string name;
+    std::string source;
+    int64_t resolution;
+    std::vector<interval> intervals;
+  };
+
+  // lookup finds the series the data key belongs to, creating it if
+  // necessary.
+  DBStatus lookup(const rocksdb::Slice& key, series** s) {
+    rocksdb::Slice buf(key);
+    std::string name;
+    int64_t resolution;
+    int64_t timeslot;
+    if (!buf.starts_with(kTimeSeriesPrefix)) {
+      return FmtStatus("%s is not a time series key", key.ToString(true).c_str());
+    }
+    buf.remove_prefix(kTimeSeriesPrefix.size());
+    if (!DecodeBytesAscending(&buf, &name) || !DecodeVarintAscending(&buf, &resolution)) {
+      return FmtStatus("malformed time series key %s", key.ToString(true).c_str());
+    }
+    // The series is identified by the key without the timeslot.
+    series_key_.assign(key.data(), buf.data() - key.data());
+    if (!DecodeVarintAscending(&buf, &timeslot)) {
+      return FmtStatus("malformed time series key %s", key.ToString(true).c_str());
+    }
+    series_key_.append(buf.data(), buf.size());
+
+    auto it = series_.find(series_key_);
+    if (it == series_.end()) {
+      const int64_t total = int64_t(series_.size() + 1) * num_intervals_;
+      if (total > kMaxTimeSeriesQueryIntervals) {
+        return FmtStatus("time series query has too many intervals: %lld", (long long)total);
+      }
+      it = series_.emplace(series_key_, series()).first;
+      it->second.name.swap(name);
+      it->second.source = buf.ToString();
+      it->second.resolution = resolution;
+      it->second.intervals.resize(num_intervals_);
+    }
+    *s = &it->second;
+    return kSuccess;
+  }
+
+  void add(series* s, int64_t nanos, uint64_t count, double sum, double max, double min) {
+    if (nanos < query_.start_nanos || nanos >= query_.end_nanos) {
+      return;
+    }
+    interval& i = s->intervals[(nanos - query_.start_nanos) / query_.interval_nanos];
+    i.count += count;
+    i.sum += sum;
+    i.max = std::max(i.max, max);
+    i.min = std::min(i.min, min);
+    if (nanos >= i.last_nanos) {
+      i.last = sum / count;
+      i.last_nanos = nanos;
+    }
+  }
+
+  double value(const interval& i) const {
+    if (i.count == 0) {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    switch (query_.aggregator) {
+      case TimeSeriesAggregatorSum:
+        return i.sum;
+      case TimeSeriesAggregatorAvg:
+        return i.sum / i.count;
+      case TimeSeriesAggregatorMax:
+        return i.max;
+      case TimeSeriesAggregatorMin:
+        return i.min;
+      case TimeSeriesAggregatorLast:
+        return i.last;
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  const DBTimeSeriesQuery query_;
+  const int64_t num_intervals_;
+  // The series in key order, keyed by their data keys without the
+  // timeslot.
+  std::map<std::string, series> series_;
+  std::string series_key_;
+  cockroach::roachpb::InternalTimeSeriesData ts_;
+};
+
 WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMetadata* left,
                                     const cockroach::storage::engine::enginepb::MVCCMetadata& right,
                                     bool full_merge, rocksdb::Logger* logger) {
@@ -761,6 +1616,13 @@ WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMe
     // If a future need arises to merge another type of data, replay protection
     // will likely need to be a consideration.
 
+    if (IsColumnarTimeSeriesData(left->raw_bytes()) ||
+        IsColumnarTimeSeriesData(right.raw_bytes())) {
+      // Both partial and full merges of columnar values are performed
+      // eagerly as the merge is a cheap streaming operation.
+      return MergeColumnarTimeSeriesValues(left->mutable_raw_bytes(), {&right.raw_bytes()},
+                                           logger);
+    }
     if (IsTimeSeriesData(left->raw_bytes()) || IsTimeSeriesData(right.raw_bytes())) {
       // The right operand must also be a time series.
       if (!IsTimeSeriesData(left->raw_bytes()) || !IsTimeSeriesData(right.raw_bytes())) {
@@ -789,6 +1651,130 @@ WARN_UNUSED_RESULT bool MergeValues(cockroach::storage::engine::enginepb::MVCCMe
   }
 }
 
+// FullMergeColumnarTimeSeries is the columnar equivalent of
+// FullMergeTimeSeries: all of the values are merged with a single
+// streaming k-way merge. Returns false if the fast path does not
+// apply, leaving *meta untouched.
+bool FullMergeColumnarTimeSeries(cockroach::storage::engine::enginepb::MVCCMetadata* meta,
+                                 const std::deque<std::string>& operand_list,
+                                 rocksdb::Logger* logger) {
+  std::vector<cockroach::storage::engine::enginepb::MVCCMetadata> operands(operand_list.size());
+  std::vector<const std::string*> rights;
+  rights.reserve(operand_list.size());
+  for (int i = 0; i < operand_list.size(); i++) {
+    if (!operands[i].ParseFromArray(operand_list[i].data(), operand_list[i].size()) ||
+        !operands[i].has_raw_bytes()) {
+      return false;
+    }
+    rights.push_back(&operands[i].raw_bytes());
+  }
+
+  std::string left;
+  if (meta->has_raw_bytes()) {
+    left = meta->raw_bytes();
+  } else {
+    // Merging into an empty value: the first operand becomes the base.
+    left = *rights.front();
+    rights.erase(rights.begin());
+  }
+  if (!MergeColumnarTimeSeriesValues(&left, rights, logger)) {
+    return false;
+  }
+  if (!meta->has_raw_bytes() && operands[0].has_merge_timestamp()) {
+    meta->mutable_merge_timestamp()->CopyFrom(operands[0].merge_timestamp());
+  }
+  meta->mutable_raw_bytes()->swap(left);
+  return true;
+}
+
+// FullMergeTimeSeries merges all of the time series operands (and the
+// existing value, if any) in one step. Every value is parsed exactly
+// once, the samples from all of the values are sorted together by
+// offset and the result is serialized once. This avoids the quadratic
+// cost of merging the operands one at a time via MergeValues, which
+// parses, sorts and re-serializes the accumulated value for every
+// operand. The semantics are identical: for each offset, the sample
+// merged last wins. Returns false if the fast path does not apply
+// (e.g. the values are not all time series), in which case *meta is
+// left untouched and the caller should fall back to merging the
+// operands one at a time.
+bool FullMergeTimeSeries(cockroach::storage::engine::enginepb::MVCCMetadata* meta,
+                         const std::deque<std::string>& operand_list, rocksdb::Logger* logger) {
+  if (operand_list.empty()) {
+    return false;
+  }
+  if (meta->has_raw_bytes() && IsColumnarTimeSeriesData(meta->raw_bytes())) {
+    return FullMergeColumnarTimeSeries(meta, operand_list, logger);
+  }
+  if (meta->has_raw_bytes() && !IsTimeSeriesData(meta->raw_bytes())) {
+    return false;
+  }
+
+  const int num_values = operand_list.size() + (meta->has_raw_bytes() ? 1 : 0);
+  std::vector<cockroach::roachpb::InternalTimeSeriesData> values(num_values);
+  cockroach::storage::engine::enginepb::MVCCMetadata first_operand;
+  int n = 0;
+  if (meta->has_raw_bytes() && !ParseProtoFromValue(meta->raw_bytes(), &values[n++])) {
+    return false;
+  }
+  int num_samples = 0;
+  // The operand message is reused across operands so that its fields
+  // (and their allocations) are recycled by each ParseFromArray.
+  cockroach::storage::engine::enginepb::MVCCMetadata operand_meta;
+  for (int i = 0; i < operand_list.size(); i++) {
+    cockroach::storage::engine::enginepb::MVCCMetadata* m =
+        (i == 0) ? &first_operand : &operand_meta;
+    if (!m->ParseFromArray(operand_list[i].data(), operand_list[i].size()) ||
+        !m->has_raw_bytes()) {
+      return false;
+    }
+    if (i == 0 && !meta->has_raw_bytes() && IsColumnarTimeSeriesData(m->raw_bytes())) {
+      return FullMergeColumnarTimeSeries(meta, operand_list, logger);
+    }
+    if (!IsTimeSeriesData(m->raw_bytes()) ||
+        !ParseProtoFromValue(m->raw_bytes(), &values[n])) {
+      return false;
+    }
+    if (values[n].start_timestamp_nanos() != values[0].start_timestamp_nanos() ||
+        values[n].sample_duration_nanos() != values[0].sample_duration_nanos()) {
+      return false;
+    }
+    num_samples += values[n].samples_size();
+    ++n;
+  }
+
+  // Gather the samples from all of the values in merge order and sort
+  // them by offset. The sort is stable so the last sample for each
+  // offset is the most recently merged one.
+  std::vector<const cockroach::roachpb::InternalTimeSeriesSample*> samples;
+  samples.reserve(num_samples + (meta->has_raw_bytes() ? values[0].samples_size() : 0));
+  for (int i = 0; i < values.size(); i++) {
+    for (int j = 0; j < values[i].samples_size(); j++) {
+      samples.push_back(&values[i].samples(j));
+    }
+  }
+  std::stable_sort(samples.begin(), samples.end(), TimeSeriesSampleOrdering);
+
+  cockroach::roachpb::InternalTimeSeriesData new_ts;
+  new_ts.set_start_timestamp_nanos(values[0].start_timestamp_nanos());
+  new_ts.set_sample_duration_nanos(values[0].sample_duration_nanos());
+  new_ts.mutable_samples()->Reserve(samples.size());
+  for (int i = 0; i < samples.size(); i++) {
+    if (i + 1 < samples.size() && samples[i + 1]->offset() == samples[i]->offset()) {
+      continue;
+    }
+    new_ts.add_samples()->CopyFrom(*samples[i]);
+  }
+
+  if (!meta->has_raw_bytes() && first_operand.has_merge_timestamp()) {
+    // Mirror MergeValues which takes the merge timestamp from the
+    // first operand merged into an empty value.
+    meta->mutable_merge_timestamp()->CopyFrom(first_operand.merge_timestamp());
+  }
+  SerializeTimeSeriesToValue(meta->mutable_raw_bytes(), new_ts);
+  return true;
+}
+
 // MergeResult serializes the result MVCCMetadata value into a byte slice.
 DBStatus MergeResult(cockroach::storage::engine::enginepb::MVCCMetadata* meta, DBString* result) {
   // TODO(pmattis): Should recompute checksum here. Need a crc32
@@ -833,9 +1819,12 @@ class DBMergeOperator : public rocksdb::MergeOperator {
       }
     }
 
-    for (int i = 0; i < operand_list.size(); i++) {
-      if (!MergeOne(&meta, operand_list[i], true, logger)) {
-        return false;
+    if (!FullMergeTimeSeries(&meta, operand_list, logger)) {
+      cockroach::storage::engine::enginepb::MVCCMetadata operand_meta;
+      for (int i = 0; i < operand_list.size(); i++) {
+        if (!MergeOne(&meta, &operand_meta, operand_list[i], true, logger)) {
+          return false;
+        }
       }
     }
 
@@ -851,9 +1840,10 @@ class DBMergeOperator : public rocksdb::MergeOperator {
                                  std::string* new_value,
                                  rocksdb::Logger* logger) const WARN_UNUSED_RESULT {
     cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    cockroach::storage::engine::enginepb::MVCCMetadata operand_meta;
 
     for (int i = 0; i < operand_list.size(); i++) {
-      if (!MergeOne(&meta, operand_list[i], false, logger)) {
+      if (!MergeOne(&meta, &operand_meta, operand_list[i], false, logger)) {
         return false;
       }
     }
@@ -866,15 +1856,21 @@ class DBMergeOperator : public rocksdb::MergeOperator {
   }
 
  private:
+  // MergeOne parses operand into *operand_meta and merges it into
+  // *meta. The caller supplies operand_meta so that a single message
+  // can be reused for all of the operands of a merge: ParseFromArray
+  // clears the message but retains the memory backing its string and
+  // sub-message fields, avoiding a round of heap allocations for
+  // every operand.
   bool MergeOne(cockroach::storage::engine::enginepb::MVCCMetadata* meta,
+                cockroach::storage::engine::enginepb::MVCCMetadata* operand_meta,
                 const rocksdb::Slice& operand, bool full_merge,
                 rocksdb::Logger* logger) const WARN_UNUSED_RESULT {
-    cockroach::storage::engine::enginepb::MVCCMetadata operand_meta;
-    if (!operand_meta.ParseFromArray(operand.data(), operand.size())) {
+    if (!operand_meta->ParseFromArray(operand.data(), operand.size())) {
       rocksdb::Warn(logger, "corrupted operand value");
       return false;
     }
-    return MergeValues(meta, operand_meta, full_merge, logger);
+    return MergeValues(meta, *operand_meta, full_merge, logger);
   }
 };
 
@@ -1092,6 +2088,12 @@ class BaseDeltaIterator : public rocksdb::Iterator {
 
   virtual ~BaseDeltaIterator() { ClearMerged(); }
 
+  rocksdb::Status Refresh() override {
+    // The delta iterator always reflects the current contents of the
+    // batch so only the base iterator needs refreshing.
+    return base_iterator_->Refresh();
+  }
+
   bool Valid() const override {
     return status_.ok() && (current_at_base_ ? BaseValid() : DeltaValid());
   }
@@ -1362,8 +2364,17 @@ class BaseDeltaIterator : public rocksdb::Iterator {
 }  // namespace
 
 DBSSTable* DBEngine::GetSSTables(int* n) {
-  std::vector<rocksdb::LiveFileMetaData> metadata;
-  rep->GetLiveFilesMetaData(&metadata);
+  // The metadata is cached by the event listener, if any.
+  std::shared_ptr<const std::vector<rocksdb::LiveFileMetaData>> cached;
+  std::vector<rocksdb::LiveFileMetaData> uncached;
+  DBEventListener* listener = GetEventListener();
+  if (listener != nullptr) {
+    cached = listener->GetLiveTables(rep);
+  } else {
+    rep->GetLiveFilesMetaData(&uncached);
+  }
+  const std::vector<rocksdb::LiveFileMetaData>& metadata =
+      cached != nullptr ? *cached : uncached;
   *n = metadata.size();
   // We malloc the result so it can be deallocated by the caller using free().
   const int size = metadata.size() * sizeof(DBSSTable);
@@ -1391,8 +2402,29 @@ DBSSTable* DBEngine::GetSSTables(int* n) {
 }
 
 DBString DBEngine::GetUserProperties() {
-  rocksdb::TablePropertiesCollection props;
-  rocksdb::Status status = rep->GetPropertiesOfAllTables(&props);
+  // The user properties are cached by the event listener, if any.
+  std::vector<std::pair<std::string, DBEventListener::TableUserProps>> props;
+  rocksdb::Status status;
+  DBEventListener* listener = GetEventListener();
+  if (listener != nullptr) {
+    status = listener->GetLiveTableUserProps(rep, &props);
+  } else {
+    rocksdb::TablePropertiesCollection tables;
+    status = rep->GetPropertiesOfAllTables(&tables);
+    for (const auto& t : tables) {
+      const rocksdb::UserCollectedProperties& userprops = t.second->user_collected_properties;
+      DBEventListener::TableUserProps p;
+      auto it = userprops.find("crdb.ts.min");
+      if (it != userprops.end()) {
+        p.ts_min = it->second;
+      }
+      it = userprops.find("crdb.ts.max");
+      if (it != userprops.end()) {
+        p.ts_max = it->second;
+      }
+      props.emplace_back(t.first, p);
+    }
+  }
 
   cockroach::storage::engine::enginepb::SSTUserPropertiesCollection all;
   if (!status.ok()) {
@@ -1400,27 +2432,26 @@ DBString DBEngine::GetUserProperties() {
     return ToDBString(all.SerializeAsString());
   }
 
-  for (auto i = props.begin(); i != props.end(); i++) {
+  for (const auto& p : props) {
     cockroach::storage::engine::enginepb::SSTUserProperties* sst = all.add_sst();
-    sst->set_path(i->first);
-    auto userprops = i->second->user_collected_properties;
-
-    auto ts_min = userprops.find("crdb.ts.min");
-    if (ts_min != userprops.end() && !ts_min->second.empty()) {
-      if (!DecodeHLCTimestamp(rocksdb::Slice(ts_min->second), sst->mutable_ts_min())) {
-        fmt::SStringPrintf(
-            all.mutable_error(), "unable to decode crdb.ts.min value '%s' in table %s",
-            rocksdb::Slice(ts_min->second).ToString(true).c_str(), sst->path().c_str());
+    sst->set_path(p.first);
+
+    const std::string& ts_min = p.second.ts_min;
+    if (!ts_min.empty()) {
+      if (!DecodeHLCTimestamp(rocksdb::Slice(ts_min), sst->mutable_ts_min())) {
+        fmt::SStringPrintf(all.mutable_error(),
+                           "unable to decode crdb.ts.min value '%s' in table %s",
+                           rocksdb::Slice(ts_min).ToString(true).c_str(), sst->path().c_str());
         break;
       }
     }
 
-    auto ts_max = userprops.find("crdb.ts.max");
-    if (ts_max != userprops.end() && !ts_max->second.empty()) {
-      if (!DecodeHLCTimestamp(rocksdb::Slice(ts_max->second), sst->mutable_ts_max())) {
-        fmt::SStringPrintf(
-            all.mutable_error(), "unable to decode crdb.ts.max value '%s' in table %s",
-            rocksdb::Slice(ts_max->second).ToString(true).c_str(), sst->path().c_str());
+    const std::string& ts_max = p.second.ts_max;
+    if (!ts_max.empty()) {
+      if (!DecodeHLCTimestamp(rocksdb::Slice(ts_max), sst->mutable_ts_max())) {
+        fmt::SStringPrintf(all.mutable_error(),
+                           "unable to decode crdb.ts.max value '%s' in table %s",
+                           rocksdb::Slice(ts_max).ToString(true).c_str(), sst->path().c_str());
         break;
       }
     }
@@ -1429,33 +2460,536 @@ DBString DBEngine::GetUserProperties() {
 }
 
 DBBatch::DBBatch(DBEngine* db)
-    : DBEngine(db->rep), updates(0), has_delete_range(false), batch(&kComparator) {}
-
-DBWriteOnlyBatch::DBWriteOnlyBatch(DBEngine* db) : DBEngine(db->rep), updates(0) {}
+    : DBEngine(db->rep),
+      updates(0),
+      has_delete_range(false),
+      batch(&kComparator),
+      reservation(kMemoryBatches),
+      pool(db->GetBatchPool()),
+      latency_stats(db->GetLatencyStats()),
+      tracer(db->GetTracer()),
+      key_sampler(db->GetKeySampler()),
+      blob_store(db->GetBlobStore()),
+      time_bound_cache(db->GetTimeBoundTableCache()),
+      write_listener(db->GetWriteListener()) {}
+
+DBWriteOnlyBatch::DBWriteOnlyBatch(DBEngine* db)
+    : DBEngine(db->rep),
+      updates(0),
+      reservation(kMemoryBatches),
+      pool(db->GetBatchPool()),
+      latency_stats(db->GetLatencyStats()),
+      tracer(db->GetTracer()),
+      key_sampler(db->GetKeySampler()),
+      blob_store(db->GetBlobStore()),
+      time_bound_cache(db->GetTimeBoundTableCache()),
+      write_listener(db->GetWriteListener()) {}
+
+// kMaxCacheShardBits is the largest number of shard bits accepted by
+// the RocksDB LRU cache.
+const int kMaxCacheShardBits = 19;
 
 DBCache* DBNewCache(uint64_t size) {
-  const int num_cache_shard_bits = 4;
-  DBCache* cache = new DBCache;
-  cache->rep = rocksdb::NewLRUCache(size, num_cache_shard_bits);
+  DBCache* cache = nullptr;
+  DBNewCacheWithOptions(&cache, size, DBCacheOptions());
   return cache;
 }
 
+DBStatus DBNewCacheWithOptions(DBCache** cache, uint64_t size, DBCacheOptions opts) {
+  *cache = nullptr;
+  const int num_shard_bits = opts.num_shard_bits > 0 ? opts.num_shard_bits : 4;
+  if (num_shard_bits > kMaxCacheShardBits) {
+    return FmtStatus("num_shard_bits must be at most %d: %d", kMaxCacheShardBits,
+                     opts.num_shard_bits);
+  }
+  if (opts.high_pri_pool_ratio < 0 || opts.high_pri_pool_ratio >= 1) {
+    return FmtStatus("high_pri_pool_ratio must be in [0, 1): %f", opts.high_pri_pool_ratio);
+  }
+
+  *cache = new DBCache;
+  (*cache)->rep = rocksdb::NewLRUCache(size, num_shard_bits, false /* strict_capacity_limit */,
+                                       opts.high_pri_pool_ratio);
+  (*cache)->cache_index_and_filter_blocks = opts.high_pri_pool_ratio > 0;
+  return kSuccess;
+}
+
+DBStatus DBNewTieredCache(DBCache** cache, uint64_t size, DBSlice persistent_path,
+                          uint64_t persistent_size) {
+  const std::string path = ToString(persistent_path);
+  rocksdb::Env* env = rocksdb::Env::Default();
+  rocksdb::Status status = env->CreateDirIfMissing(path);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  std::shared_ptr<rocksdb::PersistentCache> persistent;
+  status = rocksdb::NewPersistentCache(env, path, persistent_size, nullptr /* log */,
+                                       true /* optimized_for_nvm */, &persistent);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  *cache = DBNewCache(size);
+  (*cache)->persistent = std::make_shared<TrackedPersistentCache>(persistent, persistent_size);
+  return kSuccess;
+}
+
 DBCache* DBRefCache(DBCache* cache) {
   DBCache* res = new DBCache;
   res->rep = cache->rep;
+  res->persistent = cache->persistent;
+  res->cache_index_and_filter_blocks = cache->cache_index_and_filter_blocks;
   return res;
 }
 
 void DBReleaseCache(DBCache* cache) { delete cache; }
 
-class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
- public:
-  const char* Name() const override { return "TimeBoundTblPropCollector"; }
+DBStatus DBNewScheduler(DBScheduler** scheduler, DBSchedulerOptions options) {
+  *scheduler = nullptr;
+  if (options.num_threads <= 0) {
+    return FmtStatus("num_threads must be positive: %d", options.num_threads);
+  }
+  *scheduler = new DBScheduler;
+  (*scheduler)->rep.reset(new BackgroundScheduler(options.num_threads, options.bytes_per_sec));
+  return kSuccess;
+}
+
+void DBReleaseScheduler(DBScheduler* scheduler) { delete scheduler; }
+
+DBStatus DBGetSchedulerStats(DBScheduler* scheduler, DBSchedulerStats* stats) {
+  BackgroundScheduler* rep = scheduler->rep.get();
+  stats->flushes = rep->Ran(true);
+  stats->compactions = rep->Ran(false);
+  stats->running_flushes = rep->Running(true);
+  stats->running_compactions = rep->Running(false);
+  stats->queued_flushes = rep->Queued(true);
+  stats->queued_compactions = rep->Queued(false);
+  return kSuccess;
+}
+
+const int64_t kNanosecondPerSecond = 1e9;
+
+inline int64_t age_factor(int64_t fromNS, int64_t toNS) {
+  // Careful about implicit conversions here.
+  // toNS/1e9 - fromNS/1e9 is not the same since
+  // "1e9" is a double.
+  return toNS / kNanosecondPerSecond - fromNS / kNanosecondPerSecond;
+}
+
+// MVCCStatsAccumulator computes MVCC stats over a sorted stream of
+// MVCC keys and values. It is used by MVCCComputeStatsInternal to
+// compute stats over an iterator and by MVCCStatsTblPropCollector to
+// compute per-sstable stats.
+//
+// In addition to the stats, the accumulator tracks gc_bytes: the
+// number of bytes which accrue GC age. Because age_factor is linear
+// in the current time, the gc_bytes_age (and intent_age) computed
+// at now_nanos=0 can be aged to any time T by adding
+// T/1e9*gc_bytes (and T/1e9*intent_count). See AgeStats.
+class MVCCStatsAccumulator {
+ public:
+  explicit MVCCStatsAccumulator(int64_t now_nanos)
+      : gc_bytes(0), now_nanos_(now_nanos), meta_info_(), first_(false), accrue_gc_age_nanos_(0) {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  // Add adds the key/value pair to the stats. The keys must be added
+  // in sorted order. Returns false (and sets stats.status) on error.
+  bool Add(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+    rocksdb::Slice decoded_key;
+    int64_t wall_time = 0;
+    int32_t logical = 0;
+    if (!DecodeKey(key, &decoded_key, &wall_time, &logical)) {
+      stats.status = FmtStatus("unable to decode key");
+      return false;
+    }
+
+    const bool isSys = (rocksdb::Slice(decoded_key).compare(kLocalMax) < 0);
+    const bool isValue = (wall_time != 0 || logical != 0);
+    const bool implicitMeta = isValue && decoded_key != prev_key_;
+    prev_key_.assign(decoded_key.data(), decoded_key.size());
+    // Separated values are accounted for using the size of the value
+    // rather than that of the reference (see BlobStore).
+    const int64_t value_size = isValue ? BlobValueSize(value) : value.size();
+
+    if (implicitMeta) {
+      // No MVCCMetadata entry for this series of keys. The metadata is
+      // synthesized without a protobuf as this is the common case.
+      meta_info_ = metaInfo{value_size == 0, false, false, wall_time, kMVCCVersionTimestampSize,
+                            value_size};
+    }
+
+    if (!isValue || implicitMeta) {
+      const int64_t meta_key_size = decoded_key.size() + 1;
+      const int64_t meta_val_size = implicitMeta ? 0 : value.size();
+      const int64_t total_bytes = meta_key_size + meta_val_size;
+      first_ = true;
+
+      if (!implicitMeta) {
+        if (!meta_.ParseFromArray(value.data(), value.size())) {
+          stats.status = FmtStatus("unable to decode MVCCMetadata");
+          return false;
+        }
+        meta_info_.deleted = meta_.deleted();
+        meta_info_.has_raw_bytes = meta_.has_raw_bytes();
+        meta_info_.has_txn = meta_.has_txn();
+        meta_info_.wall_time = meta_.timestamp().wall_time();
+        meta_info_.key_bytes = meta_.key_bytes();
+        meta_info_.val_bytes = meta_.val_bytes();
+      }
+
+      if (isSys) {
+        stats.sys_bytes += total_bytes;
+        stats.sys_count++;
+      } else {
+        if (!meta_info_.deleted) {
+          stats.live_bytes += total_bytes;
+          stats.live_count++;
+        } else {
+          stats.gc_bytes_age += total_bytes * age_factor(meta_info_.wall_time, now_nanos_);
+          gc_bytes += total_bytes;
+        }
+        stats.key_bytes += meta_key_size;
+        stats.val_bytes += meta_val_size;
+        stats.key_count++;
+        if (meta_info_.has_raw_bytes) {
+          stats.val_count++;
+        }
+      }
+      if (!implicitMeta) {
+        return true;
+      }
+    }
+
+    const int64_t total_bytes = value_size + kMVCCVersionTimestampSize;
+    if (isSys) {
+      stats.sys_bytes += total_bytes;
+    } else {
+      if (first_) {
+        first_ = false;
+        if (!meta_info_.deleted) {
+          stats.live_bytes += total_bytes;
+        } else {
+          stats.gc_bytes_age += total_bytes * age_factor(meta_info_.wall_time, now_nanos_);
+          gc_bytes += total_bytes;
+        }
+        if (meta_info_.has_txn) {
+          stats.intent_bytes += total_bytes;
+          stats.intent_count++;
+          stats.intent_age += age_factor(meta_info_.wall_time, now_nanos_);
+        }
+        if (meta_info_.key_bytes != kMVCCVersionTimestampSize) {
+          stats.status = FmtStatus("expected mvcc metadata key bytes to equal %d; got %d",
+                                   kMVCCVersionTimestampSize, int(meta_info_.key_bytes));
+          return false;
+        }
+        if (meta_info_.val_bytes != value_size) {
+          stats.status = FmtStatus("expected mvcc metadata val bytes to equal %d; got %d",
+                                   int(value_size), int(meta_info_.val_bytes));
+          return false;
+        }
+        accrue_gc_age_nanos_ = meta_info_.wall_time;
+      } else {
+        bool is_tombstone = value_size == 0;
+        if (is_tombstone) {
+          stats.gc_bytes_age += total_bytes * age_factor(wall_time, now_nanos_);
+        } else {
+          assert(accrue_gc_age_nanos_ > 0);
+          stats.gc_bytes_age += total_bytes * age_factor(accrue_gc_age_nanos_, now_nanos_);
+        }
+        gc_bytes += total_bytes;
+        accrue_gc_age_nanos_ = wall_time;
+      }
+      stats.key_bytes += kMVCCVersionTimestampSize;
+      stats.val_bytes += value_size;
+      stats.val_count++;
+    }
+    return true;
+  }
+
+ public:
+  MVCCStatsResult stats;
+  int64_t gc_bytes;
+
+ private:
+  // metaInfo holds the fields of the metadata of the current key
+  // which the stats depend on.
+  struct metaInfo {
+    bool deleted;
+    bool has_raw_bytes;
+    bool has_txn;
+    int64_t wall_time;
+    int64_t key_bytes;
+    int64_t val_bytes;
+  };
+
+  const int64_t now_nanos_;
+  // Only used to parse explicit metadata keys.
+  cockroach::storage::engine::enginepb::MVCCMetadata meta_;
+  metaInfo meta_info_;
+  std::string prev_key_;
+  bool first_;
+  // The wall time from which the GC age of the next (non-tombstone)
+  // version accrues.
+  int64_t accrue_gc_age_nanos_;
+};
+
+// The names of the table properties written by
+// MVCCStatsTblPropCollector.
+const char kMVCCStatsPropName[] = "crdb.mvcc.stats";
+const char kMVCCStatsFirstKeyPropName[] = "crdb.mvcc.first_key";
+const char kMVCCStatsLastKeyPropName[] = "crdb.mvcc.last_key";
+const char kMVCCStatsRangeTombstonesPropName[] = "crdb.mvcc.range_tombstones";
+
+// EncodeMVCCStatsProp encodes the stats (computed at now_nanos=0) and
+// gc_bytes of an MVCCStatsAccumulator as a sequence of fixed-width
+// integers. See DecodeMVCCStatsProp.
+std::string EncodeMVCCStatsProp(const MVCCStatsAccumulator& acc) {
+  const MVCCStatsResult& s = acc.stats;
+  const int64_t values[] = {
+      s.live_bytes,   s.key_bytes,  s.val_bytes,    s.intent_bytes, s.live_count,
+      s.key_count,    s.val_count,  s.intent_count, s.intent_age,   s.gc_bytes_age,
+      s.sys_bytes,    s.sys_count,  acc.gc_bytes,
+  };
+  std::string buf;
+  for (int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    EncodeUint64(&buf, uint64_t(values[i]));
+  }
+  return buf;
+}
+
+// DecodeMVCCStatsProp decodes the stats encoded by
+// EncodeMVCCStatsProp and ages them to now_nanos, adding them to
+// *stats. Returns false if the property is malformed.
+bool DecodeMVCCStatsProp(rocksdb::Slice buf, int64_t now_nanos, MVCCStatsResult* stats) {
+  int64_t* fields[] = {
+      &stats->live_bytes,   &stats->key_bytes,  &stats->val_bytes,    &stats->intent_bytes,
+      &stats->live_count,   &stats->key_count,  &stats->val_count,    &stats->intent_count,
+      &stats->intent_age,   &stats->gc_bytes_age, &stats->sys_bytes,  &stats->sys_count,
+  };
+  const int num_fields = sizeof(fields) / sizeof(fields[0]);
+  int64_t values[num_fields + 1];
+  for (int i = 0; i <= num_fields; ++i) {
+    uint64_t v;
+    if (!DecodeUint64(&buf, &v)) {
+      return false;
+    }
+    values[i] = int64_t(v);
+  }
+  if (!buf.empty()) {
+    return false;
+  }
+  const int64_t intent_count = values[7];
+  const int64_t gc_bytes = values[num_fields];
+  const int64_t now_secs = age_factor(0, now_nanos);
+  values[8] += now_secs * intent_count;
+  values[9] += now_secs * gc_bytes;
+  for (int i = 0; i < num_fields; ++i) {
+    *fields[i] += values[i];
+  }
+  return true;
+}
+
+// MVCCStatsTblPropCollector records the MVCC stats of the keys in
+// each sstable, along with the first and last user keys, so that
+// MVCCComputeStatsWithTableProps can avoid scanning sstables which
+// lie entirely within the span being computed. The properties are
+// only written if the sstable contains nothing but puts of distinct
+// keys (no deletions, merges or multiple versions of the same
+// internal key) as otherwise the stats can't be computed from the
+// sstable in isolation. The number of range tombstones is always
+// written: a range tombstone may delete keys in other sstables, whose
+// stats then can't be used either.
+class MVCCStatsTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  MVCCStatsTblPropCollector() : acc_(0), valid_(true), range_tombstones_(0) {}
+
+  const char* Name() const override { return "MVCCStatsTblPropCollector"; }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    std::string range_tombstones;
+    EncodeUint64(&range_tombstones, range_tombstones_);
+    *properties = rocksdb::UserCollectedProperties{
+        {kMVCCStatsRangeTombstonesPropName, range_tombstones},
+    };
+    if (!valid_ || last_key_.empty()) {
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Slice first_key;
+    rocksdb::Slice last_key;
+    rocksdb::Slice unused;
+    if (!SplitKey(first_mvcc_key_, &first_key, &unused) ||
+        !SplitKey(last_key_, &last_key, &unused)) {
+      return rocksdb::Status::OK();
+    }
+    properties->emplace(kMVCCStatsPropName, EncodeMVCCStatsProp(acc_));
+    properties->emplace(kMVCCStatsFirstKeyPropName, first_key.ToString());
+    properties->emplace(kMVCCStatsLastKeyPropName, last_key.ToString());
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
+                             rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                             uint64_t file_size) override {
+    if (type == rocksdb::kEntryOther) {
+      // Range deletions are the only entries of the engine which are
+      // neither puts, merges nor deletions.
+      range_tombstones_++;
+    }
+    if (!valid_) {
+      return rocksdb::Status::OK();
+    }
+    if (type != rocksdb::kEntryPut || user_key == last_key_ || !acc_.Add(user_key, value)) {
+      valid_ = false;
+      free(acc_.stats.status.data);
+      return rocksdb::Status::OK();
+    }
+    if (first_mvcc_key_.empty()) {
+      first_mvcc_key_.assign(user_key.data(), user_key.size());
+    }
+    last_key_.assign(user_key.data(), user_key.size());
+    return rocksdb::Status::OK();
+  }
+
+  virtual rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return rocksdb::UserCollectedProperties{};
+  }
+
+ private:
+  MVCCStatsAccumulator acc_;
+  bool valid_;
+  uint64_t range_tombstones_;
+  std::string first_mvcc_key_;
+  std::string last_key_;
+};
+
+class MVCCStatsTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  explicit MVCCStatsTblPropCollectorFactory() {}
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new MVCCStatsTblPropCollector();
+  }
+  const char* Name() const override { return "MVCCStatsTblPropCollectorFactory"; }
+};
+
+// kTimeBoundBlocksPropName is the name of the table property holding
+// the per-block timestamp bounds written by TimeBoundTblPropCollector.
+const char kTimeBoundBlocksPropName[] = "crdb.ts.blocks";
+
+// kMaxTimeBoundBlockSpans bounds the number of block spans recorded
+// per sstable. Table properties are held in memory by the table cache,
+// so adjacent blocks are coalesced to keep the property small.
+const int kMaxTimeBoundBlockSpans = 128;
+
+// TimeBoundBlockSpan is a contiguous run of data blocks in an sstable
+// along with the min and max MVCC timestamps of the keys in them. The
+// bounds are empty if the blocks only contain keys without a
+// timestamp.
+struct TimeBoundBlockSpan {
+  std::string first_key;
+  std::string last_key;
+  std::string ts_min;
+  std::string ts_max;
+
+  void AddKey(const rocksdb::Slice& key, const rocksdb::Slice& ts) {
+    if (first_key.empty()) {
+      first_key.assign(key.data(), key.size());
+    }
+    last_key.assign(key.data(), key.size());
+    if (!ts.empty()) {
+      if (ts_max.empty() || ts.compare(ts_max) > 0) {
+        ts_max.assign(ts.data(), ts.size());
+      }
+      if (ts_min.empty() || ts.compare(ts_min) < 0) {
+        ts_min.assign(ts.data(), ts.size());
+      }
+    }
+  }
+
+  // Absorb extends the span with the (subsequent) span other.
+  void Absorb(const TimeBoundBlockSpan& other) {
+    last_key = other.last_key;
+    if (!other.ts_max.empty() && (ts_max.empty() || other.ts_max > ts_max)) {
+      ts_max = other.ts_max;
+    }
+    if (!other.ts_min.empty() && (ts_min.empty() || other.ts_min < ts_min)) {
+      ts_min = other.ts_min;
+    }
+  }
+
+  // Overlaps returns true if the span might contain keys with
+  // timestamps in [min, max].
+  bool Overlaps(const std::string& min, const std::string& max) const {
+    return ts_min.empty() || (max.compare(ts_min) >= 0 && min.compare(ts_max) <= 0);
+  }
+};
+
+// CoalesceTimeBoundBlockSpans halves the number of spans by merging
+// adjacent pairs.
+void CoalesceTimeBoundBlockSpans(std::vector<TimeBoundBlockSpan>* spans) {
+  size_t n = 0;
+  for (size_t i = 0; i < spans->size(); i += 2, ++n) {
+    if (n != i) {
+      (*spans)[n] = std::move((*spans)[i]);
+    }
+    if (i + 1 < spans->size()) {
+      (*spans)[n].Absorb((*spans)[i + 1]);
+    }
+  }
+  spans->resize(n);
+}
+
+// EncodeTimeBoundBlockSpans encodes the spans as a sequence of
+// length-prefixed (first_key, last_key, ts_min, ts_max) tuples.
+std::string EncodeTimeBoundBlockSpans(const std::vector<TimeBoundBlockSpan>& spans) {
+  std::string buf;
+  for (const auto& span : spans) {
+    for (const std::string* field : {&span.first_key, &span.last_key, &span.ts_min, &span.ts_max}) {
+      EncodeUint32(&buf, uint32_t(field->size()));
+      buf.append(*field);
+    }
+  }
+  return buf;
+}
+
+// DecodeTimeBoundBlockSpans decodes the spans encoded by
+// EncodeTimeBoundBlockSpans. Returns false if the property is
+// malformed.
+bool DecodeTimeBoundBlockSpans(rocksdb::Slice buf, std::vector<TimeBoundBlockSpan>* spans) {
+  while (!buf.empty()) {
+    TimeBoundBlockSpan span;
+    for (std::string* field : {&span.first_key, &span.last_key, &span.ts_min, &span.ts_max}) {
+      uint32_t size;
+      if (!DecodeUint32(&buf, &size) || buf.size() < size) {
+        return false;
+      }
+      field->assign(buf.data(), size);
+      buf.remove_prefix(size);
+    }
+    spans->push_back(std::move(span));
+  }
+  return true;
+}
+
+// TimeBoundTblPropCollector records the min and max MVCC timestamps
+// of the keys in an sstable (crdb.ts.min and crdb.ts.max), which
+// DBNewTimeBoundIter uses to skip whole tables, as well as the bounds
+// of runs of data blocks within the table (kTimeBoundBlocksPropName),
+// which it uses to skip parts of tables.
+class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  TimeBoundTblPropCollector() : block_file_size_(0) {}
+
+  const char* Name() const override { return "TimeBoundTblPropCollector"; }
 
   rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    finishBlock();
+    while (spans_.size() > kMaxTimeBoundBlockSpans) {
+      CoalesceTimeBoundBlockSpans(&spans_);
+    }
     *properties = rocksdb::UserCollectedProperties{
         {"crdb.ts.min", ts_min_},
         {"crdb.ts.max", ts_max_},
+        {kTimeBoundBlocksPropName, EncodeTimeBoundBlockSpans(spans_)},
     };
     return rocksdb::Status::OK();
   }
@@ -1463,6 +2997,14 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
   rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
                              rocksdb::EntryType type, rocksdb::SequenceNumber seq,
                              uint64_t file_size) override {
+    // The table builder flushes the current data block before adding
+    // a key which does not fit in it, so a change in the file size
+    // indicates that this key is the first in a new block.
+    if (file_size != block_file_size_) {
+      finishBlock();
+      block_file_size_ = file_size;
+    }
+
     rocksdb::Slice unused;
     rocksdb::Slice ts;
     if (SplitKey(user_key, &unused, &ts) && !ts.empty()) {
@@ -1474,6 +3016,7 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
         ts_min_.assign(ts.data(), ts.size());
       }
     }
+    block_.AddKey(user_key, ts);
     return rocksdb::Status::OK();
   }
 
@@ -1481,9 +3024,25 @@ class TimeBoundTblPropCollector : public rocksdb::TablePropertiesCollector {
     return rocksdb::UserCollectedProperties{};
   }
 
+ private:
+  void finishBlock() {
+    if (block_.first_key.empty()) {
+      return;
+    }
+    spans_.push_back(std::move(block_));
+    block_ = TimeBoundBlockSpan();
+    // Bound the memory used while building very large tables.
+    if (spans_.size() >= 2 * kMaxTimeBoundBlockSpans) {
+      CoalesceTimeBoundBlockSpans(&spans_);
+    }
+  }
+
  private:
   std::string ts_min_;
   std::string ts_max_;
+  uint64_t block_file_size_;
+  TimeBoundBlockSpan block_;
+  std::vector<TimeBoundBlockSpan> spans_;
 };
 
 class TimeBoundTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
@@ -1496,6 +3055,156 @@ class TimeBoundTblPropCollectorFactory : public rocksdb::TablePropertiesCollecto
   const char* Name() const override { return "TimeBoundTblPropCollectorFactory"; }
 };
 
+// The names of the table properties holding the number of intents in
+// an sstable, the number of entries which may shadow an intent in an
+// older sstable and the first and last keys with either, written by
+// IntentTblPropCollector.
+const char kIntentCountPropName[] = "crdb.intent.count";
+const char kIntentShadowCountPropName[] = "crdb.intent.shadows";
+const char kIntentFirstKeyPropName[] = "crdb.intent.first";
+const char kIntentLastKeyPropName[] = "crdb.intent.last";
+
+// IntentTblPropCollector records the number of intents in each
+// sstable along with the first and last keys with intents, which
+// DBNewIntentIter uses to skip tables. Intents are the unversioned
+// keys whose MVCCMetadata has a txn. Resolving an intent deletes or
+// overwrites its metadata, and that entry can land in a newer sstable
+// which must not be skipped or the intent would reappear. So the
+// deletions and non-intent puts of unversioned keys, and range
+// deletions, are counted as shadows and included in the bounds.
+class IntentTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  IntentTblPropCollector() : count_(0), shadows_(0) {}
+
+  const char* Name() const override { return "IntentTblPropCollector"; }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    std::string count;
+    EncodeUint64(&count, count_);
+    std::string shadows;
+    EncodeUint64(&shadows, shadows_);
+    *properties = rocksdb::UserCollectedProperties{
+        {kIntentCountPropName, count},
+        {kIntentShadowCountPropName, shadows},
+        {kIntentFirstKeyPropName, first_key_},
+        {kIntentLastKeyPropName, last_key_},
+    };
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
+                             rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                             uint64_t file_size) override {
+    rocksdb::Slice key;
+    rocksdb::Slice ts;
+    if (type == rocksdb::kEntryOther) {
+      // Range deletions are the only entries of the engine which are
+      // neither puts, merges nor deletions. Their value is the end key.
+      // They may delete intents anywhere in [start, end).
+      rocksdb::Slice end_key;
+      if (!SplitKey(user_key, &key, &ts)) {
+        key = user_key;
+      }
+      if (!SplitKey(value, &end_key, &ts)) {
+        end_key = value;
+      }
+      shadows_++;
+      extend(key, end_key);
+      return rocksdb::Status::OK();
+    }
+    if (!SplitKey(user_key, &key, &ts) || !ts.empty()) {
+      return rocksdb::Status::OK();
+    }
+    switch (type) {
+    case rocksdb::kEntryPut:
+      // Rather than parsing every MVCCMetadata, rely on fields being
+      // serialized in field number order: the metadata has a txn iff it
+      // starts with the tag of the txn field (field 1, length delimited).
+      if (!value.empty() && value[0] == kMVCCMetadataTxnTag) {
+        count_++;
+      } else {
+        shadows_++;
+      }
+      break;
+    case rocksdb::kEntryDelete:
+    case rocksdb::kEntrySingleDelete:
+      shadows_++;
+      break;
+    default:
+      // Merges only apply to inline values, which are never intents.
+      return rocksdb::Status::OK();
+    }
+    extend(key, key);
+    return rocksdb::Status::OK();
+  }
+
+  virtual rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return rocksdb::UserCollectedProperties{};
+  }
+
+ private:
+  // extend extends the bounds to cover [start, end]. Range deletions
+  // are not added in key order.
+  void extend(const rocksdb::Slice& start, const rocksdb::Slice& end) {
+    const bool first = count_ + shadows_ == 1;
+    if (first || start.compare(first_key_) < 0) {
+      first_key_.assign(start.data(), start.size());
+    }
+    if (first || end.compare(last_key_) > 0) {
+      last_key_.assign(end.data(), end.size());
+    }
+  }
+
+ private:
+  static const char kMVCCMetadataTxnTag = (1 << 3) | 2;
+
+  uint64_t count_;
+  uint64_t shadows_;
+  std::string first_key_;
+  std::string last_key_;
+};
+
+class IntentTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  explicit IntentTblPropCollectorFactory() {}
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new IntentTblPropCollector();
+  }
+  const char* Name() const override { return "IntentTblPropCollectorFactory"; }
+};
+
+namespace {
+
+// The size of the compression dictionary for the bottommost level if
+// DBOptions.compression_dict_bytes is not set.
+const int kDefaultCompressionDictBytes = 16 << 10;
+
+rocksdb::CompressionType toCompressionType(DBCompression c, rocksdb::CompressionType def) {
+  switch (c) {
+  case DBCompressionNone:
+    return rocksdb::kNoCompression;
+  case DBCompressionSnappy:
+    return rocksdb::kSnappyCompression;
+  case DBCompressionLZ4:
+    return rocksdb::kLZ4Compression;
+  case DBCompressionZSTD:
+    return rocksdb::kZSTD;
+  default:
+    return def;
+  }
+}
+
+// The foreground p99 latency the rate limiter targets if
+// DBOptions.rate_limit_target_latency_nanos is not set.
+const int64_t kDefaultRateLimitTargetLatencyNanos = 10 * 1000 * 1000;  // 10 ms
+
+// blobDir returns the directory the blob files of the DB in db_dir are
+// stored in (see BlobStore).
+std::string blobDir(const std::string& db_dir) { return db_dir + "/blobs"; }
+
+}  // namespace
+
 rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   // Use the rocksdb options builder to configure the base options
   // using our memtable budget.
@@ -1503,10 +3212,23 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   // Increase parallelism for compactions and flushes based on the
   // number of cpus. Always use at least 2 threads, otherwise
   // compactions and flushes may fight with each other.
-  options.IncreaseParallelism(std::max(db_opts.num_cpu, 2));
-  // Enable subcompactions which will use multiple threads to speed up
-  // a single compaction. The value of num_cpu/2 has not been tuned.
-  options.max_subcompactions = std::max(db_opts.num_cpu / 2, 1);
+  if (db_opts.scheduler != nullptr) {
+    // The threads are owned by the shared scheduler. Let the engine
+    // schedule as many compactions as the scheduler has threads so
+    // that it can use all of them when the other engines are idle.
+    // Subcompactions run on threads of their own, outside of the
+    // scheduler's budget, so they are disabled.
+    const int num_threads = db_opts.scheduler->rep->NumThreads();
+    options.max_background_compactions = std::max(num_threads - 1, 1);
+    options.max_background_flushes = 1;
+    options.max_subcompactions = 1;
+  } else {
+    options.IncreaseParallelism(std::max(db_opts.num_cpu, 2));
+    // Enable subcompactions which will use multiple threads to speed
+    // up a single compaction. The value of num_cpu/2 has not been
+    // tuned.
+    options.max_subcompactions = std::max(db_opts.num_cpu / 2, 1);
+  }
   options.WAL_ttl_seconds = db_opts.wal_ttl_seconds;
   options.comparator = &kComparator;
   options.create_if_missing = !db_opts.must_exist;
@@ -1514,7 +3236,20 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   options.merge_operator.reset(new DBMergeOperator);
   options.prefix_extractor.reset(new DBPrefixExtractor);
   options.statistics = rocksdb::CreateDBStatistics();
+  if (db_opts.detailed_timers) {
+    // Enable the detailed timers (e.g. of block decompression), but
+    // not the timing of mutex waits which is even more expensive.
+    options.statistics->stats_level_ = rocksdb::kExceptTimeForMutex;
+  } else {
+    options.statistics->stats_level_ = rocksdb::kExceptDetailedTimers;
+  }
   options.max_open_files = db_opts.max_open_files;
+  if (db_opts.fast_open) {
+    // Opening a table reader is dominated by the latency of reading
+    // its footer, index and filter, so use more threads than cpus.
+    options.max_file_opening_threads = std::max(16, 4 * db_opts.num_cpu);
+    options.skip_stats_update_on_db_open = true;
+  }
   options.compaction_pri = rocksdb::kMinOverlappingRatio;
   // Periodically sync both the WAL and SST writes to smooth out disk
   // usage. Not performing such syncs can be faster but can cause
@@ -1550,6 +3285,16 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> time_bound_prop_collector(
       new TimeBoundTblPropCollectorFactory());
   options.table_properties_collector_factories.push_back(time_bound_prop_collector);
+  // Also store the MVCC stats of the keys in each sstable. See
+  // MVCCComputeStatsWithTableProps.
+  std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> mvcc_stats_prop_collector(
+      new MVCCStatsTblPropCollectorFactory());
+  options.table_properties_collector_factories.push_back(mvcc_stats_prop_collector);
+  // And the number and key bounds of the intents in each sstable. See
+  // DBNewIntentIter.
+  std::shared_ptr<rocksdb::TablePropertiesCollectorFactory> intent_prop_collector(
+      new IntentTblPropCollectorFactory());
+  options.table_properties_collector_factories.push_back(intent_prop_collector);
 
   // The write buffer size is the size of the in memory structure that
   // will be flushed to create L0 files.
@@ -1610,9 +3355,49 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   options.target_file_size_base = 4 << 20;  // 4 MB
   options.target_file_size_multiplier = 2;
 
+  // Every level uses snappy unless configured otherwise. L0 is
+  // written by flushes and compacted soon after, so it can be worth
+  // not compressing it to speed up flushes. Because most of the data
+  // lives in the bottommost level it can be worth compressing it more
+  // heavily (e.g. with zstd and a dictionary, which exploits the
+  // redundancy across the keys and values of a table).
+  const int num_levels = sizeof(db_opts.level_compression) / sizeof(db_opts.level_compression[0]);
+  bool level_compression_set = false;
+  for (int i = 0; i < num_levels; i++) {
+    level_compression_set |= db_opts.level_compression[i] != DBCompressionDefault;
+  }
+  if (level_compression_set) {
+    options.compression_per_level.resize(options.num_levels);
+    for (int i = 0; i < options.num_levels; i++) {
+      options.compression_per_level[i] = toCompressionType(
+          i < num_levels ? db_opts.level_compression[i] : DBCompressionDefault,
+          rocksdb::kSnappyCompression);
+    }
+  }
+  if (db_opts.bottommost_compression != DBCompressionDefault) {
+    options.bottommost_compression =
+        toCompressionType(db_opts.bottommost_compression, rocksdb::kSnappyCompression);
+    if (options.bottommost_compression == rocksdb::kZSTD) {
+      // The dictionary is only used for bottommost level compactions.
+      options.compression_opts.max_dict_bytes = db_opts.compression_dict_bytes > 0
+                                                    ? db_opts.compression_dict_bytes
+                                                    : kDefaultCompressionDictBytes;
+    }
+  }
+
   rocksdb::BlockBasedTableOptions table_options;
   if (db_opts.cache != nullptr) {
     table_options.block_cache = db_opts.cache->rep;
+    table_options.persistent_cache = db_opts.cache->persistent;
+    if (db_opts.cache->cache_index_and_filter_blocks) {
+      // Index and filter blocks are charged to the cache and kept in
+      // its high priority pool so that they are only evicted after
+      // the data blocks. Those of L0 files, which are consulted by
+      // every read, are pinned.
+      table_options.cache_index_and_filter_blocks = true;
+      table_options.cache_index_and_filter_blocks_with_high_priority = true;
+      table_options.pin_l0_filter_and_index_blocks_in_cache = true;
+    }
 
     // Reserve 1 memtable worth of memory from the cache. Under high
     // load situations we'll be using somewhat more than 1 memtable,
@@ -1643,20 +3428,102 @@ rocksdb::Options DBMakeOptions(DBOptions db_opts) {
   return options;
 }
 
-DBStatus DBOpen(DBEngine** db, DBSlice dir, DBOptions db_opts) {
-  rocksdb::Options options = DBMakeOptions(db_opts);
+namespace {
 
-  std::string db_dir = ToString(dir);
+bool hasSuffix(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-  // Call hooks to handle db_opts.extra_options.
-  auto hook_status = DBOpenHook(db_dir, db_opts);
-  if (!hook_status.ok()) {
-    return ToDBStatus(hook_status);
+// OpenTimerEnv delimits the phases of DB::Open (see DBOpenStats) by
+// recording when the first table and WAL file are opened. It only
+// records while DB::Open is running and otherwise passes through to
+// the wrapped Env.
+class OpenTimerEnv : public rocksdb::EnvWrapper {
+ public:
+  explicit OpenTimerEnv(rocksdb::Env* base_env)
+      : rocksdb::EnvWrapper(base_env),
+        recording_(false),
+        start_(0),
+        first_table_(0),
+        first_wal_(0),
+        tables_(0),
+        wal_files_(0) {}
+
+  void Start() {
+    std::lock_guard<std::mutex> l(mu_);
+    recording_ = true;
+    start_ = now();
+  }
+
+  void Stop(DBOpenStats* stats) {
+    std::lock_guard<std::mutex> l(mu_);
+    recording_ = false;
+    const int64_t end = now();
+    const int64_t wal = first_wal_ != 0 ? first_wal_ : end;
+    const int64_t table = first_table_ != 0 ? first_table_ : wal;
+    stats->total_nanos = end - start_;
+    stats->manifest_nanos = table - start_;
+    stats->table_open_nanos = wal - table;
+    stats->wal_replay_nanos = end - wal;
+    stats->tables_opened = tables_;
+    stats->wal_files = wal_files_;
+  }
+
+  virtual rocksdb::Status NewRandomAccessFile(const std::string& fname,
+                                              std::unique_ptr<rocksdb::RandomAccessFile>* result,
+                                              const rocksdb::EnvOptions& options) override {
+    if (hasSuffix(fname, ".sst")) {
+      std::lock_guard<std::mutex> l(mu_);
+      // Tables opened once the WAL replay has started were written by
+      // the recovery flushes.
+      if (recording_ && first_wal_ == 0) {
+        if (first_table_ == 0) {
+          first_table_ = now();
+        }
+        ++tables_;
+      }
+    }
+    return target()->NewRandomAccessFile(fname, result, options);
   }
 
-  // Register listener for tracking RocksDB stats.
-  std::shared_ptr<DBEventListener> event_listener(new DBEventListener);
-  options.listeners.emplace_back(event_listener);
+  virtual rocksdb::Status NewSequentialFile(const std::string& fname,
+                                            std::unique_ptr<rocksdb::SequentialFile>* result,
+                                            const rocksdb::EnvOptions& options) override {
+    if (hasSuffix(fname, ".log")) {
+      std::lock_guard<std::mutex> l(mu_);
+      if (recording_) {
+        if (first_wal_ == 0) {
+          first_wal_ = now();
+        }
+        ++wal_files_;
+      }
+    }
+    return target()->NewSequentialFile(fname, result, options);
+  }
+
+ private:
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  std::mutex mu_;
+  bool recording_;
+  int64_t start_;
+  int64_t first_table_;
+  int64_t first_wal_;
+  int64_t tables_;
+  int64_t wal_files_;
+};
+
+}  // namespace
+
+DBStatus DBOpen(DBEngine** db, DBSlice dir, DBOptions db_opts) {
+  rocksdb::Options options = DBMakeOptions(db_opts);
+
+  std::string db_dir = ToString(dir);
 
   // TODO(mberhault): we shouldn't need two separate env objects,
   // options.env should be sufficient with SwitchingEnv owning any
@@ -1667,37 +3534,194 @@ DBStatus DBOpen(DBEngine** db, DBSlice dir, DBOptions db_opts) {
     options.env = memenv.get();
   }
 
+  // Call hooks to handle db_opts.extra_options.
+  std::unique_ptr<rocksdb::Env> encrypted_env;
+  auto hook_status = DBOpenHook(db_dir, db_opts, options.env, &encrypted_env);
+  if (!hook_status.ok()) {
+    return ToDBStatus(hook_status);
+  }
+
+  // Register listener for tracking RocksDB stats.
+  std::shared_ptr<DBEventListener> event_listener(new DBEventListener);
+  options.listeners.emplace_back(event_listener);
+
   std::unique_ptr<rocksdb::Env> switching_env;
-  if (db_opts.use_switching_env) {
-    switching_env.reset(NewSwitchingEnv(options.env, options.info_log));
+  if (db_opts.use_switching_env || encrypted_env != nullptr) {
+    switching_env.reset(NewSwitchingEnv(options.env, std::move(encrypted_env), options.info_log));
     options.env = switching_env.get();
   }
 
+  // Read ahead on long sequential scans of sstables. The readahead is
+  // applied on top of any encryption so that the buffers hold
+  // plaintext.
+  std::unique_ptr<ReadaheadEnv> readahead_env;
+  if (db_opts.max_readahead_bytes > 0) {
+    readahead_env.reset(new ReadaheadEnv(options.env, db_opts.max_readahead_bytes));
+    options.env = readahead_env.get();
+  }
+
+  std::unique_ptr<OpenTimerEnv> open_timer_env(new OpenTimerEnv(options.env));
+  options.env = open_timer_env.get();
+
+  // Run the flushes and compactions on the shared scheduler.
+  std::unique_ptr<SchedulingEnv> scheduling_env;
+  if (db_opts.scheduler != nullptr) {
+    scheduling_env.reset(new SchedulingEnv(options.env, db_opts.scheduler->rep));
+    options.env = scheduling_env.get();
+    options.listeners.emplace_back(scheduling_env->NewListener());
+    if (db_opts.rate_limit_bytes_per_sec <= 0) {
+      options.rate_limiter = db_opts.scheduler->rep->RateLimiter();
+    }
+  }
+
+  // Open the blob store if value separation is enabled or was enabled
+  // previously, in which case the LSM may still reference blob files.
+  std::shared_ptr<BlobStore> blob_store;
+  const std::string blob_dir = blobDir(db_dir);
+  if (db_opts.value_separation_threshold > 0 || options.env->FileExists(blob_dir).ok()) {
+    blob_store.reset(new BlobStore(options.env, blob_dir,
+                                   std::max<int64_t>(db_opts.value_separation_threshold, 0),
+                                   options.info_log));
+    rocksdb::Status status = blob_store->Open();
+    if (!status.ok()) {
+      return ToDBStatus(status);
+    }
+    options.listeners.emplace_back(blob_store);
+    options.table_properties_collector_factories.emplace_back(
+        NewBlobRefTblPropCollectorFactory());
+  }
+
+  // Compact the spans of sstables which are dense with tombstones.
+  std::shared_ptr<TombstoneCompactor> tombstone_compactor;
+  if (db_opts.tombstone_compaction_density > 0) {
+    tombstone_compactor.reset(new TombstoneCompactor(db_opts.tombstone_compaction_density));
+    options.listeners.emplace_back(tombstone_compactor);
+    options.table_properties_collector_factories.emplace_back(
+        tombstone_compactor->NewTblPropCollectorFactory());
+  }
+
+  // Limit the rate of flush and compaction writes, backing off when
+  // foreground operations slow down. Compactions are sped up instead
+  // once the pending compaction bytes approach the point at which
+  // writes would be slowed down.
+  std::shared_ptr<AdaptiveRateLimiter> rate_limiter;
+  if (db_opts.rate_limit_bytes_per_sec > 0) {
+    rate_limiter.reset(new AdaptiveRateLimiter(
+        db_opts.rate_limit_bytes_per_sec,
+        db_opts.rate_limit_target_latency_nanos > 0 ? db_opts.rate_limit_target_latency_nanos
+                                                    : kDefaultRateLimitTargetLatencyNanos,
+        options.soft_pending_compaction_bytes_limit / 2));
+    options.rate_limiter = rate_limiter;
+  }
+
   rocksdb::DB* db_ptr;
+  open_timer_env->Start();
   rocksdb::Status status = rocksdb::DB::Open(options, db_dir, &db_ptr);
+  DBOpenStats open_stats;
+  open_timer_env->Stop(&open_stats);
   if (!status.ok()) {
     return ToDBStatus(status);
   }
-  *db =
+  rocksdb::Info(options.info_log,
+                "opened in %.1fms: manifest %.1fms, %d tables %.1fms, %d WAL files %.1fms",
+                open_stats.total_nanos / 1e6, open_stats.manifest_nanos / 1e6,
+                int(open_stats.tables_opened), open_stats.table_open_nanos / 1e6,
+                int(open_stats.wal_files), open_stats.wal_replay_nanos / 1e6);
+  DBImpl* impl =
       new DBImpl(db_ptr, memenv.release(), db_opts.cache != nullptr ? db_opts.cache->rep : nullptr,
                  event_listener, switching_env.release());
+  if (db_opts.cache != nullptr) {
+    impl->persistent_cache = db_opts.cache->persistent;
+  }
+  impl->readahead_env = std::move(readahead_env);
+  impl->open_timer_env = std::move(open_timer_env);
+  if (scheduling_env != nullptr) {
+    scheduling_env->UpdateL0Files(impl->rep);
+    impl->scheduling_env = std::move(scheduling_env);
+  }
+  impl->open_stats = open_stats;
+  impl->time_bound_cache = std::make_shared<TimeBoundTableCache>();
+  if (blob_store != nullptr) {
+    impl->blob_store = blob_store;
+    blob_store->Start(impl->rep);
+  }
+  // The WAL replayed into the memtables may have held range deletions.
+  uint64_t mem_entries = 0;
+  uint64_t imm_entries = 0;
+  if (!impl->rep->GetIntProperty("rocksdb.num-entries-active-mem-table", &mem_entries) ||
+      !impl->rep->GetIntProperty("rocksdb.num-entries-imm-mem-tables", &imm_entries) ||
+      mem_entries + imm_entries > 0) {
+    event_listener->RangeDeletionWritten(impl->rep->GetLatestSequenceNumber());
+  }
+  if (db_opts.key_sample_rate > 0) {
+    impl->key_sampler.reset(new KeySampler(db_opts.key_sample_rate));
+  }
+  if (tombstone_compactor != nullptr) {
+    impl->tombstone_compactor = tombstone_compactor;
+    tombstone_compactor->Start(impl->rep);
+  }
+  if (rate_limiter != nullptr) {
+    impl->rate_limiter = rate_limiter;
+    rate_limiter->Start([impl](Histogram* latency, uint64_t* pending_compaction_bytes) {
+      // The latency of a scan grows with the number of keys it reads,
+      // so a burst of large scans would read as contention with the
+      // background I/O.
+      impl->latency_stats.mvcc_get.MergeInto(latency);
+      impl->latency_stats.commit_batch.MergeInto(latency);
+      impl->rep->GetIntProperty("rocksdb.estimate-pending-compaction-bytes",
+                                pending_compaction_bytes);
+    });
+  }
+  if (db_opts.read_threads > 0) {
+    impl->read_pool.reset(new ReadPool(impl, db_opts.read_threads));
+  }
+  *db = impl;
   return kSuccess;
 }
 
 DBStatus DBDestroy(DBSlice dir) {
   rocksdb::Options options;
+  // DestroyDB only removes the files RocksDB knows about.
+  const std::string blob_dir = blobDir(ToString(dir));
+  std::vector<std::string> children;
+  if (options.env->GetChildren(blob_dir, &children).ok()) {
+    for (const auto& name : children) {
+      options.env->DeleteFile(blob_dir + "/" + name);
+    }
+    options.env->DeleteDir(blob_dir);
+  }
   return ToDBStatus(rocksdb::DestroyDB(ToString(dir), options));
 }
 
-void DBClose(DBEngine* db) { delete db; }
+void DBClose(DBEngine* db) {
+  if (!db->ReturnToPool()) {
+    delete db;
+  }
+}
 
 DBStatus DBFlush(DBEngine* db) {
   rocksdb::FlushOptions options;
   options.wait = true;
-  return ToDBStatus(db->rep->Flush(options));
+  rocksdb::Status status = db->rep->Flush(options);
+  // The flush may have returned before the event listener was notified
+  // of the new sstable.
+  DBEventListener* listener = db->GetEventListener();
+  if (listener != nullptr) {
+    listener->InvalidateLiveTables();
+  }
+  return ToDBStatus(status);
 }
 
 DBStatus DBSyncWAL(DBEngine* db) {
+  LatencyTimer timer(db->GetLatencyStats(), &LatencyStats::sync_wal);
+  // The values referenced by the synced writes must be durable too.
+  BlobStore* blob_store = db->GetBlobStore();
+  if (blob_store != nullptr) {
+    rocksdb::Status status = blob_store->Sync();
+    if (!status.ok()) {
+      return ToDBStatus(status);
+    }
+  }
 #ifdef _WIN32
   // On Windows, DB::SyncWAL() is not implemented due to fact that
   // `WinWritableFile` is not thread safe. To get around that, the only other
@@ -1721,15 +3745,55 @@ DBStatus DBSyncWAL(DBEngine* db) {
 
 DBStatus DBCompact(DBEngine* db) { return DBCompactRange(db, DBSlice(), DBSlice()); }
 
-DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
-  rocksdb::CompactRangeOptions options;
-  // By default, RocksDB doesn't recompact the bottom level (unless
-  // there is a compaction filter, which we don't use). However,
-  // recompacting the bottom layer is necessary to pick up changes to
-  // settings like bloom filter configurations, and to fully reclaim
-  // space after dropping, truncating, or migrating tables.
-  options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+struct DBCompactRangeProgress {
+  DBCompactRangeProgress() : bytes_done(0), bytes_total(0), canceled(false) {}
+
+  std::atomic<uint64_t> bytes_done;
+  std::atomic<uint64_t> bytes_total;
+  std::atomic<bool> canceled;
+};
+
+DBCompactRangeProgress* DBNewCompactRangeProgress() { return new DBCompactRangeProgress; }
+
+void DBCompactRangeProgressGet(DBCompactRangeProgress* progress, uint64_t* bytes_done,
+                               uint64_t* bytes_total) {
+  *bytes_done = progress->bytes_done;
+  *bytes_total = progress->bytes_total;
+}
+
+void DBCompactRangeProgressCancel(DBCompactRangeProgress* progress) { progress->canceled = true; }
+
+void DBCompactRangeProgressDestroy(DBCompactRangeProgress* progress) { delete progress; }
+
+namespace {
+
+// kMaxCompactRangeConcurrency bounds the number of chunks compacted at
+// a time by DBCompactRangeParallel.
+const int kMaxCompactRangeConcurrency = 4;
+
+// compactRangePool returns the pool on which DBCompactRangeParallel
+// runs its workers. They block in CompactRange for as long as a chunk
+// takes to compact, so they are kept off WorkerPool::Default, which
+// foreground operations rely on. The calling thread is one of the
+// workers.
+WorkerPool* compactRangePool() {
+  static WorkerPool pool(kMaxCompactRangeConcurrency - 1);
+  return &pool;
+}
+
+// compactRangeChunk is a span of keys compacted by a single
+// CompactRange call. An empty start (end) indicates the start (end) of
+// the database.
+struct compactRangeChunk {
+  std::string start;
+  std::string end;
+  uint64_t size;
+};
 
+// compactRangeChunks splits [start, end) into the chunks compacted by
+// DBCompactRange.
+std::vector<compactRangeChunk> compactRangeChunks(rocksdb::DB* db, const std::string& start_key,
+                                                  const std::string& end_key) {
   // Compacting the entire database in a single-shot can use a
   // significant amount of additional (temporary) disk space. Instead,
   // we loop over the sstables in the lowest level and initiate
@@ -1738,12 +3802,10 @@ DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
   // for the compaction is dramatically reduced.
   std::vector<rocksdb::LiveFileMetaData> all_metadata;
   std::vector<rocksdb::LiveFileMetaData> metadata;
-  db->rep->GetLiveFilesMetaData(&all_metadata);
-
-  const std::string start_key(ToString(start));
-  const std::string end_key(ToString(end));
+  db->GetLiveFilesMetaData(&all_metadata);
 
   int max_level = 0;
+  uint64_t total_size = 0;
   for (int i = 0; i < all_metadata.size(); i++) {
     // Skip any SSTables which fall outside the specified range, if a
     // range was specified.
@@ -1754,20 +3816,18 @@ DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
     if (max_level < all_metadata[i].level) {
       max_level = all_metadata[i].level;
     }
+    total_size += all_metadata[i].size;
     // Gather the set of SSTables to compact.
     metadata.push_back(all_metadata[i]);
   }
   all_metadata.clear();
 
-  if (max_level != db->rep->NumberLevels() - 1) {
+  if (max_level != db->NumberLevels() - 1) {
     // There are no sstables at the lowest level, so just compact the
     // specified key span, wholesale. Due to the
     // level_compaction_dynamic_level_bytes setting, this will only
     // happen on spans containing very little data.
-    const rocksdb::Slice start_slice(start_key);
-    const rocksdb::Slice end_slice(end_key);
-    return ToDBStatus(db->rep->CompactRange(options, !start_key.empty() ? &start_slice : nullptr,
-                                            !end_key.empty() ? &end_slice : nullptr));
+    return {compactRangeChunk{start_key, end_key, total_size}};
   }
 
   // A naive approach to selecting ranges to compact would be to
@@ -1810,10 +3870,11 @@ DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
               return a.smallestkey < b.smallestkey;
             });
 
-  // Walk over the bottom-most sstables in order and perform
-  // compactions every 128MB.
-  rocksdb::Slice last;
-  rocksdb::Slice* last_ptr = nullptr;
+  // Walk over the bottom-most sstables in order and form chunks every
+  // 128MB. The size of a chunk (used for progress reporting) only
+  // counts its bottom-most sstables.
+  std::vector<compactRangeChunk> chunks;
+  std::string last;
   uint64_t size = 0;
   const uint64_t target_size = 128 << 20;
   for (int i = 0; i < sst.size(); ++i) {
@@ -1821,18 +3882,100 @@ DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
     if (size < target_size) {
       continue;
     }
-    rocksdb::Slice cur(sst[i].largestkey);
-    rocksdb::Status status = db->rep->CompactRange(options, last_ptr, &cur);
-    if (!status.ok()) {
-      return ToDBStatus(status);
-    }
-    last = cur;
-    last_ptr = &last;
+    chunks.push_back(compactRangeChunk{last, sst[i].largestkey, size});
+    last = sst[i].largestkey;
     size = 0;
   }
-
   if (size > 0) {
-    return ToDBStatus(db->rep->CompactRange(options, last_ptr, nullptr));
+    chunks.push_back(compactRangeChunk{last, std::string(), size});
+  }
+  return chunks;
+}
+
+// compactChunk compacts the keys in a chunk.
+rocksdb::Status compactChunk(rocksdb::DB* db, const rocksdb::CompactRangeOptions& options,
+                             const compactRangeChunk& chunk) {
+  const rocksdb::Slice start(chunk.start);
+  const rocksdb::Slice end(chunk.end);
+  return db->CompactRange(options, !chunk.start.empty() ? &start : nullptr,
+                          !chunk.end.empty() ? &end : nullptr);
+}
+
+}  // namespace
+
+DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end) {
+  return DBCompactRangeParallel(db, start, end, 1, nullptr);
+}
+
+DBStatus DBCompactRangeParallel(DBEngine* db, DBSlice start, DBSlice end, int concurrency,
+                                DBCompactRangeProgress* progress) {
+  rocksdb::CompactRangeOptions options;
+  // By default, RocksDB doesn't recompact the bottom level (unless
+  // there is a compaction filter, which we don't use). However,
+  // recompacting the bottom layer is necessary to pick up changes to
+  // settings like bloom filter configurations, and to fully reclaim
+  // space after dropping, truncating, or migrating tables.
+  options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+
+  const std::vector<compactRangeChunk> chunks =
+      compactRangeChunks(db->rep, ToString(start), ToString(end));
+  uint64_t total_size = 0;
+  for (const auto& chunk : chunks) {
+    total_size += chunk.size;
+  }
+  if (progress != nullptr) {
+    progress->bytes_done = 0;
+    progress->bytes_total = total_size;
+  }
+
+  concurrency = std::max(1, std::min<int>({concurrency, kMaxCompactRangeConcurrency,
+                                            int(chunks.size())}));
+  if (concurrency > 1) {
+    // Exclusive manual compactions are run one at a time. The chunks
+    // are disjoint in the bottom-most level and RocksDB serializes
+    // compactions whose inputs conflict at the higher levels.
+    options.exclusive_manual_compaction = false;
+  }
+
+  // Chunks are handed out in order to the workers, which run on
+  // compactRangePool with the calling thread participating. A
+  // canceled compaction stops handing out chunks but any chunks
+  // already being compacted run to completion.
+  std::atomic<size_t> next(0);
+  std::mutex mu;
+  rocksdb::Status result;
+  auto worker = [&]() {
+    for (;;) {
+      if (progress != nullptr && progress->canceled) {
+        return;
+      }
+      const size_t i = next++;
+      if (i >= chunks.size()) {
+        return;
+      }
+      rocksdb::Status status = compactChunk(db->rep, options, chunks[i]);
+      if (!status.ok()) {
+        std::lock_guard<std::mutex> guard(mu);
+        if (result.ok()) {
+          result = status;
+        }
+        // Stop handing out chunks.
+        next = chunks.size();
+        return;
+      }
+      if (progress != nullptr) {
+        progress->bytes_done += chunks[i].size;
+      }
+    }
+  };
+
+  compactRangePool()->ParallelFor(concurrency, concurrency, [&](int) { worker(); });
+
+  if (!result.ok()) {
+    return ToDBStatus(result);
+  }
+  if (progress != nullptr && progress->canceled && next < chunks.size()) {
+    return FmtStatus("compaction canceled");
   }
   return kSuccess;
 }
@@ -1847,20 +3990,66 @@ DBStatus DBApproximateDiskBytes(DBEngine* db, DBKey start, DBKey end, uint64_t*
   return kSuccess;
 }
 
+namespace {
+
+// writeSeparated applies the batch using write, first moving its large
+// values to the blob store if the engine has one.
+rocksdb::Status writeSeparated(BlobStore* blob_store, rocksdb::WriteBatch* batch, bool sync,
+                               const std::function<rocksdb::Status(rocksdb::WriteBatch*)>& write) {
+  if (blob_store == nullptr) {
+    return write(batch);
+  }
+  BlobWriteGuard guard(blob_store);
+  rocksdb::WriteBatch separated_batch;
+  bool separated;
+  uint64_t file;
+  rocksdb::Status status =
+      blob_store->Separate(*batch, sync, &separated_batch, &separated, &file);
+  if (!status.ok()) {
+    return status;
+  }
+  if (!separated) {
+    return write(batch);
+  }
+  status = write(&separated_batch);
+  blob_store->EndWrite(file);
+  return status;
+}
+
+// noteRangeDeletions tells the engine's write listener, if any, that
+// the memtables may hold range deletions if the batch which has just
+// been written to db contains any.
+void noteRangeDeletions(DBEventListener* listener, rocksdb::DB* db, rocksdb::WriteBatch* batch) {
+  if (listener != nullptr && batch->HasDeleteRange()) {
+    listener->RangeDeletionWritten(db->GetLatestSequenceNumber());
+  }
+}
+
+}  // namespace
+
 DBStatus DBImpl::Put(DBKey key, DBSlice value) {
   rocksdb::WriteOptions options;
+  if (blob_store != nullptr) {
+    rocksdb::WriteBatch batch;
+    batch.Put(EncodeKey(key), ToSlice(value));
+    return ToDBStatus(
+        writeSeparated(blob_store.get(), &batch, false,
+                       [&](rocksdb::WriteBatch* wb) { return rep->Write(options, wb); }));
+  }
   return ToDBStatus(rep->Put(options, EncodeKey(key), ToSlice(value)));
 }
 
 DBStatus DBBatch::Put(DBKey key, DBSlice value) {
   ++updates;
   batch.Put(EncodeKey(key), ToSlice(value));
+  AccountMemory();
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::Put(DBKey key, DBSlice value) {
   ++updates;
   batch.Put(EncodeKey(key), ToSlice(value));
+  AccountMemory();
   return kSuccess;
 }
 
@@ -1870,18 +4059,21 @@ DBStatus DBPut(DBEngine* db, DBKey key, DBSlice value) { return db->Put(key, val
 
 DBStatus DBImpl::Merge(DBKey key, DBSlice value) {
   rocksdb::WriteOptions options;
+  BlobWriteGuard guard(blob_store.get());
   return ToDBStatus(rep->Merge(options, EncodeKey(key), ToSlice(value)));
 }
 
 DBStatus DBBatch::Merge(DBKey key, DBSlice value) {
   ++updates;
   batch.Merge(EncodeKey(key), ToSlice(value));
+  AccountMemory();
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::Merge(DBKey key, DBSlice value) {
   ++updates;
   batch.Merge(EncodeKey(key), ToSlice(value));
+  AccountMemory();
   return kSuccess;
 }
 
@@ -1920,43 +4112,94 @@ DBStatus DBSnapshot::Get(DBKey key, DBString* value) {
   return base.Get(value);
 }
 
-DBStatus DBGet(DBEngine* db, DBKey key, DBString* value) { return db->Get(key, value); }
+DBStatus DBGet(DBEngine* db, DBKey key, DBString* value) {
+  BlobStore* blob_store = db->GetBlobStore();
+  if (blob_store == nullptr) {
+    return db->Get(key, value);
+  }
+  BlobReadPin pin(blob_store);
+  DBStatus status = db->Get(key, value);
+  if (status.data != NULL || !IsBlobReference(ToSlice(*value))) {
+    return status;
+  }
+  std::string buf;
+  rocksdb::Status s = blob_store->Get(ToSlice(*value), &buf);
+  free(value->data);
+  *value = DBString();
+  if (!s.ok()) {
+    return ToDBStatus(s);
+  }
+  *value = ToDBString(buf);
+  return kSuccess;
+}
 
 DBStatus DBImpl::Delete(DBKey key) {
   rocksdb::WriteOptions options;
+  BlobWriteGuard guard(blob_store.get());
   return ToDBStatus(rep->Delete(options, EncodeKey(key)));
 }
 
 DBStatus DBBatch::Delete(DBKey key) {
   ++updates;
   batch.Delete(EncodeKey(key));
+  AccountMemory();
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::Delete(DBKey key) {
   ++updates;
   batch.Delete(EncodeKey(key));
+  AccountMemory();
   return kSuccess;
 }
 
 DBStatus DBSnapshot::Delete(DBKey key) { return FmtStatus("unsupported"); }
 
+DBStatus DBImpl::DeleteEncoded(const rocksdb::Slice& key) {
+  rocksdb::WriteOptions options;
+  BlobWriteGuard guard(blob_store.get());
+  return ToDBStatus(rep->Delete(options, key));
+}
+
+DBStatus DBBatch::DeleteEncoded(const rocksdb::Slice& key) {
+  ++updates;
+  batch.Delete(key);
+  AccountMemory();
+  return kSuccess;
+}
+
+DBStatus DBWriteOnlyBatch::DeleteEncoded(const rocksdb::Slice& key) {
+  ++updates;
+  batch.Delete(key);
+  AccountMemory();
+  return kSuccess;
+}
+
+DBStatus DBSnapshot::DeleteEncoded(const rocksdb::Slice& key) { return FmtStatus("unsupported"); }
+
 DBStatus DBImpl::DeleteRange(DBKey start, DBKey end) {
   rocksdb::WriteOptions options;
-  return ToDBStatus(
-      rep->DeleteRange(options, rep->DefaultColumnFamily(), EncodeKey(start), EncodeKey(end)));
+  BlobWriteGuard guard(blob_store.get());
+  rocksdb::Status status =
+      rep->DeleteRange(options, rep->DefaultColumnFamily(), EncodeKey(start), EncodeKey(end));
+  if (status.ok()) {
+    event_listener->RangeDeletionWritten(rep->GetLatestSequenceNumber());
+  }
+  return ToDBStatus(status);
 }
 
 DBStatus DBBatch::DeleteRange(DBKey start, DBKey end) {
   ++updates;
   has_delete_range = true;
   batch.DeleteRange(EncodeKey(start), EncodeKey(end));
+  AccountMemory();
   return kSuccess;
 }
 
 DBStatus DBWriteOnlyBatch::DeleteRange(DBKey start, DBKey end) {
   ++updates;
   batch.DeleteRange(EncodeKey(start), EncodeKey(end));
+  AccountMemory();
   return kSuccess;
 }
 
@@ -1971,7 +4214,50 @@ DBStatus DBDeleteIterRange(DBEngine* db, DBIterator* iter, DBKey start, DBKey en
   iter_rep->Seek(EncodeKey(start));
   const std::string end_key = EncodeKey(end);
   for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
-    DBStatus status = db->Delete(ToDBKey(iter_rep->key()));
+    DBStatus status = db->DeleteEncoded(iter_rep->key());
+    if (status.data != NULL) {
+      return status;
+    }
+  }
+  return kSuccess;
+}
+
+// kDeleteIterRangeSampleKeys is the number of keys point deleted by
+// DBDeleteIterRangeAdaptive before it estimates the number of keys
+// remaining in the span.
+const int kDeleteIterRangeSampleKeys = 64;
+// kDeleteIterRangeMaxPointDeletes is the estimated number of
+// remaining keys above which DBDeleteIterRangeAdaptive switches to a
+// range tombstone.
+const int64_t kDeleteIterRangeMaxPointDeletes = 4096;
+
+DBStatus DBDeleteIterRangeAdaptive(DBEngine* db, DBIterator* iter, DBKey start, DBKey end) {
+  rocksdb::Iterator* const iter_rep = iter->rep.get();
+  iter_rep->Seek(EncodeKey(start));
+  const std::string end_key = EncodeKey(end);
+  int64_t n = 0;
+  int64_t sampled_bytes = 0;
+  for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
+    const rocksdb::Slice key = iter_rep->key();
+    if (n == kDeleteIterRangeSampleKeys) {
+      // Estimate the number of keys remaining in the span from its
+      // approximate size and the average size of the keys seen so
+      // far. If there are many, a single range tombstone is much
+      // cheaper than writing a tombstone per key.
+      const std::string cur_key = key.ToString();
+      const rocksdb::Range r(cur_key, end_key);
+      const uint8_t flags = rocksdb::DB::SizeApproximationFlags::INCLUDE_FILES |
+                            rocksdb::DB::SizeApproximationFlags::INCLUDE_MEMTABLES;
+      uint64_t size = 0;
+      db->rep->GetApproximateSizes(&r, 1, &size, flags);
+      const int64_t avg_bytes = std::max<int64_t>(1, sampled_bytes / n);
+      if (int64_t(size) / avg_bytes > kDeleteIterRangeMaxPointDeletes) {
+        return db->DeleteRange(ToDBKey(cur_key), end);
+      }
+    }
+    ++n;
+    sampled_bytes += key.size() + iter_rep->value().size();
+    DBStatus status = db->DeleteEncoded(key);
     if (status.data != NULL) {
       return status;
     }
@@ -1987,7 +4273,13 @@ DBStatus DBBatch::CommitBatch(bool sync) {
   }
   rocksdb::WriteOptions options;
   options.sync = sync;
-  return ToDBStatus(rep->Write(options, batch.GetWriteBatch()));
+  rocksdb::Status status =
+      writeSeparated(blob_store, batch.GetWriteBatch(), sync,
+                     [&](rocksdb::WriteBatch* wb) { return rep->Write(options, wb); });
+  if (status.ok() && has_delete_range) {
+    noteRangeDeletions(write_listener, rep, batch.GetWriteBatch());
+  }
+  return ToDBStatus(status);
 }
 
 DBStatus DBWriteOnlyBatch::CommitBatch(bool sync) {
@@ -1996,12 +4288,49 @@ DBStatus DBWriteOnlyBatch::CommitBatch(bool sync) {
   }
   rocksdb::WriteOptions options;
   options.sync = sync;
-  return ToDBStatus(rep->Write(options, &batch));
+  rocksdb::Status status =
+      writeSeparated(blob_store, &batch, sync,
+                     [&](rocksdb::WriteBatch* wb) { return rep->Write(options, wb); });
+  if (status.ok()) {
+    noteRangeDeletions(write_listener, rep, &batch);
+  }
+  return ToDBStatus(status);
 }
 
 DBStatus DBSnapshot::CommitBatch(bool sync) { return FmtStatus("unsupported"); }
 
+namespace {
+
+// sampleBatch records the keys of the sampled mutations of an encoded
+// batch with the key sampler, if any.
+void sampleBatch(KeySampler* sampler, const rocksdb::Slice& repr) {
+  if (sampler == nullptr) {
+    return;
+  }
+  BatchReprReader reader(repr);
+  if (!reader.Init() || !sampler->Skip(reader.Count())) {
+    return;
+  }
+  while (reader.Next()) {
+    rocksdb::Slice key;
+    rocksdb::Slice ts;
+    if (sampler->Sample() && SplitKey(reader.Key(), &key, &ts)) {
+      sampler->Add(key);
+    }
+  }
+}
+
+}  // namespace
+
 DBStatus DBCommitAndCloseBatch(DBEngine* db, bool sync) {
+  LatencyTimer timer(db->GetLatencyStats(), &LatencyStats::commit_batch);
+  Tracer* tracer = db->GetTracer();
+  if (tracer != nullptr && tracer->Enabled() && db->GetWriteBatch() != nullptr) {
+    tracer->CommitBatch(db->GetWriteBatch()->Data(), sync);
+  }
+  if (db->GetWriteBatch() != nullptr) {
+    sampleBatch(db->GetKeySampler(), db->GetWriteBatch()->Data());
+  }
   DBStatus status = db->CommitBatch(sync);
   if (status.data == NULL) {
     DBClose(db);
@@ -2009,68 +4338,280 @@ DBStatus DBCommitAndCloseBatch(DBEngine* db, bool sync) {
   return status;
 }
 
-DBStatus DBImpl::ApplyBatchRepr(DBSlice repr, bool sync) {
-  rocksdb::WriteBatch batch(ToString(repr));
-  rocksdb::WriteOptions options;
-  options.sync = sync;
-  return ToDBStatus(rep->Write(options, &batch));
-}
-
-DBStatus DBBatch::ApplyBatchRepr(DBSlice repr, bool sync) {
-  if (sync) {
+DBStatus DBCommitAndCloseBatchGrouped(DBEngine* db, DBEngine* batch) {
+  GroupCommitter* committer = db->GetGroupCommitter();
+  rocksdb::WriteBatch* wb = batch->GetWriteBatch();
+  if (committer == nullptr || wb == nullptr) {
     return FmtStatus("unsupported");
   }
-  // TODO(peter): It would be slightly more efficient to iterate over
-  // repr directly instead of first converting it to a string.
-  DBBatchInserter inserter(&batch);
-  rocksdb::WriteBatch batch(ToString(repr));
-  rocksdb::Status status = batch.Iterate(&inserter);
-  if (!status.ok()) {
-    return ToDBStatus(status);
+  LatencyTimer timer(db->GetLatencyStats(), &LatencyStats::commit_batch);
+  if (wb->Count() > 0) {
+    Tracer* tracer = batch->GetTracer();
+    if (tracer != nullptr && tracer->Enabled()) {
+      tracer->CommitBatch(wb->Data(), true);
+    }
+    sampleBatch(batch->GetKeySampler(), wb->Data());
+    DBStatus status = ToDBStatus(
+        writeSeparated(batch->GetBlobStore(), wb, true,
+                       [committer](rocksdb::WriteBatch* b) { return committer->Commit(b); }));
+    if (status.data != NULL) {
+      return status;
+    }
+    noteRangeDeletions(batch->GetWriteListener(), db->rep, wb);
   }
-  updates += batch.Count();
+  DBClose(batch);
   return kSuccess;
 }
 
-DBStatus DBWriteOnlyBatch::ApplyBatchRepr(DBSlice repr, bool sync) {
-  if (sync) {
+DBStatus DBGetLatencyStats(DBEngine* db, DBLatencyStats* stats) {
+  LatencyStats* latency = db->GetLatencyStats();
+  if (latency == nullptr) {
     return FmtStatus("unsupported");
   }
-  // TODO(peter): It would be slightly more efficient to iterate over
-  // repr directly instead of first converting it to a string.
-  DBBatchInserter inserter(&batch);
-  rocksdb::WriteBatch batch(ToString(repr));
-  rocksdb::Status status = batch.Iterate(&inserter);
-  if (!status.ok()) {
-    return ToDBStatus(status);
-  }
-  updates += batch.Count();
+  stats->mvcc_scan = latency->mvcc_scan.Export();
+  stats->mvcc_get = latency->mvcc_get.Export();
+  stats->iter_seek = latency->iter_seek.Export();
+  stats->commit_batch = latency->commit_batch.Export();
+  stats->apply_batch_repr = latency->apply_batch_repr.Export();
+  stats->sync_wal = latency->sync_wal.Export();
   return kSuccess;
 }
 
-DBStatus DBSnapshot::ApplyBatchRepr(DBSlice repr, bool sync) { return FmtStatus("unsupported"); }
+DBStatus DBGetHotKeys(DBEngine* db, DBSlice start, DBSlice end, DBHotKeys* result) {
+  memset(result, 0, sizeof(*result));
+  KeySampler* sampler = db->GetKeySampler();
+  if (sampler == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  uint64_t samples;
+  sampler->HotKeys(ToSlice(start), ToSlice(end), &keys, &samples);
+  result->samples = samples;
+  if (keys.empty()) {
+    return kSuccess;
+  }
 
-DBStatus DBApplyBatchRepr(DBEngine* db, DBSlice repr, bool sync) {
-  return db->ApplyBatchRepr(repr, sync);
+  // The split key is the key which most evenly divides the accesses of
+  // the hot keys between the keys before it and the keys from it on.
+  uint64_t total = 0;
+  for (const auto& k : keys) {
+    total += k.second;
+  }
+  size_t split = 0;
+  uint64_t best = total;
+  uint64_t before = keys[0].second;
+  for (size_t i = 1; i < keys.size(); ++i) {
+    const uint64_t after = total - before;
+    const uint64_t imbalance = before > after ? before - after : after - before;
+    if (imbalance < best) {
+      best = imbalance;
+      split = i;
+    }
+    before += keys[i].second;
+  }
+  if (split > 0) {
+    result->split_key = ToDBString(keys[split].first);
+  }
+
+  result->num_keys = int(keys.size());
+  result->keys = static_cast<DBHotKey*>(malloc(keys.size() * sizeof(DBHotKey)));
+  for (size_t i = 0; i < keys.size(); ++i) {
+    result->keys[i].key = ToDBString(keys[i].first);
+    result->keys[i].accesses = int64_t(keys[i].second);
+  }
+  return kSuccess;
 }
 
-DBSlice DBImpl::BatchRepr() { return ToDBSlice("unsupported"); }
+DBStatus DBGetTombstoneCompactionStats(DBEngine* db, DBTombstoneCompactionStats* stats) {
+  TombstoneCompactor* compactor = db->GetTombstoneCompactor();
+  if (compactor == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  stats->compactions = compactor->Compactions();
+  stats->reclaimed_bytes = compactor->ReclaimedBytes();
+  stats->pending = compactor->Pending();
+  return kSuccess;
+}
 
-DBSlice DBBatch::BatchRepr() { return ToDBSlice(batch.GetWriteBatch()->Data()); }
+DBStatus DBGetMemoryStats(DBEngine* db, DBMemoryStats* stats) {
+  rocksdb::Cache* block_cache = db->GetBlockCache();
+  if (block_cache == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  memset(stats, 0, sizeof(*stats));
+  AllocatorStats allocator;
+  if (GetAllocatorStats(&allocator)) {
+    stats->allocator_stats = true;
+    stats->allocated = int64_t(allocator.allocated);
+    stats->active = int64_t(allocator.active);
+    stats->metadata = int64_t(allocator.metadata);
+    stats->resident = int64_t(allocator.resident);
+    stats->mapped = int64_t(allocator.mapped);
+    stats->retained = int64_t(allocator.retained);
+  }
+
+  stats->block_cache_usage = int64_t(block_cache->GetUsage());
+  stats->block_cache_pinned_usage = int64_t(block_cache->GetPinnedUsage());
+  uint64_t cur_memtables = 0;
+  db->rep->GetIntProperty("rocksdb.cur-size-all-mem-tables", &cur_memtables);
+  uint64_t all_memtables = 0;
+  db->rep->GetIntProperty("rocksdb.size-all-mem-tables", &all_memtables);
+  stats->memtables = int64_t(cur_memtables);
+  stats->pinned_memtables =
+      all_memtables > cur_memtables ? int64_t(all_memtables - cur_memtables) : 0;
+  uint64_t table_readers = 0;
+  db->rep->GetIntProperty("rocksdb.estimate-table-readers-mem", &table_readers);
+  stats->table_readers = int64_t(table_readers);
+
+  stats->scan_buffers = MemoryAccountBytes(kMemoryScanBuffers);
+  stats->batches = MemoryAccountBytes(kMemoryBatches);
+  return kSuccess;
+}
 
-DBSlice DBWriteOnlyBatch::BatchRepr() { return ToDBSlice(batch.GetWriteBatch()->Data()); }
+DBStatus DBGetOpenStats(DBEngine* db, DBOpenStats* stats) {
+  const DBOpenStats* open_stats = db->GetOpenStats();
+  if (open_stats == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  *stats = *open_stats;
+  return kSuccess;
+}
 
-DBSlice DBSnapshot::BatchRepr() { return ToDBSlice("unsupported"); }
+rocksdb::Env* DBGetEnv(DBEngine* db) { return db->rep->GetEnv(); }
 
-DBSlice DBBatchRepr(DBEngine* db) { return db->BatchRepr(); }
+rocksdb::DB* DBGetRocksDB(DBEngine* db) { return db->rep; }
 
-DBEngine* DBNewSnapshot(DBEngine* db) { return new DBSnapshot(db); }
+DBStatus DBStartTrace(DBEngine* db, DBSlice path, DBSlice checkpoint_dir) {
+  Tracer* tracer = db->GetTracer();
+  if (tracer == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  std::function<rocksdb::Status()> checkpoint;
+  if (checkpoint_dir.len > 0) {
+    checkpoint = [db, checkpoint_dir]() {
+      DBStatus status = DBCreateCheckpoint(db, checkpoint_dir);
+      if (status.data == NULL) {
+        return rocksdb::Status::OK();
+      }
+      const std::string msg = ToString(status);
+      free(status.data);
+      return rocksdb::Status::IOError("unable to create checkpoint", msg);
+    };
+  }
+  return ToDBStatus(tracer->Start(DBGetEnv(db), ToString(path), checkpoint));
+}
 
-DBEngine* DBNewBatch(DBEngine* db, bool writeOnly) {
-  if (writeOnly) {
-    return new DBWriteOnlyBatch(db);
+DBStatus DBStopTrace(DBEngine* db) {
+  Tracer* tracer = db->GetTracer();
+  if (tracer == nullptr) {
+    return FmtStatus("unsupported");
   }
-  return new DBBatch(db);
+  return ToDBStatus(tracer->Stop());
+}
+
+DBStatus DBCreateCheckpoint(DBEngine* db, DBSlice dir) {
+  // Pin the blob store so that the blob files the checkpoint references
+  // are not deleted before they have been copied.
+  BlobStore* blob_store = db->GetBlobStore();
+  BlobReadPin pin(blob_store);
+  rocksdb::Checkpoint* checkpoint;
+  rocksdb::Status status = rocksdb::Checkpoint::Create(db->rep, &checkpoint);
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  std::unique_ptr<rocksdb::Checkpoint> checkpoint_deleter(checkpoint);
+  status = checkpoint->CreateCheckpoint(ToString(dir));
+  if (!status.ok() || blob_store == nullptr) {
+    return ToDBStatus(status);
+  }
+  return ToDBStatus(blob_store->CopyFiles(blobDir(ToString(dir))));
+}
+
+DBStatus DBGetGroupCommitStats(DBEngine* db, DBGroupCommitStats* stats) {
+  GroupCommitter* committer = db->GetGroupCommitter();
+  if (committer == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  stats->group_size = committer->GroupSizes().Export();
+  stats->sync_latency_nanos = committer->SyncLatencies().Export();
+  return kSuccess;
+}
+
+DBStatus DBImpl::ApplyBatchRepr(DBSlice repr, bool sync) {
+  // A rocksdb::WriteBatch must own its repr so a single copy is
+  // unavoidable here. The temporary string is moved into the batch
+  // (via the WriteBatch(std::string&&) constructor) so we don't pay
+  // for a second copy.
+  rocksdb::WriteBatch batch(ToString(repr));
+  rocksdb::WriteOptions options;
+  options.sync = sync;
+  rocksdb::Status status =
+      writeSeparated(blob_store.get(), &batch, sync,
+                     [&](rocksdb::WriteBatch* wb) { return rep->Write(options, wb); });
+  if (status.ok()) {
+    noteRangeDeletions(event_listener.get(), rep, &batch);
+  }
+  return ToDBStatus(status);
+}
+
+DBStatus DBBatch::ApplyBatchRepr(DBSlice repr, bool sync) {
+  if (sync) {
+    return FmtStatus("unsupported");
+  }
+  const DBStatus status = ApplyBatchReprInPlace(&batch, repr, &updates, &has_delete_range);
+  AccountMemory();
+  return status;
+}
+
+DBStatus DBWriteOnlyBatch::ApplyBatchRepr(DBSlice repr, bool sync) {
+  if (sync) {
+    return FmtStatus("unsupported");
+  }
+  bool has_delete_range = false;
+  const DBStatus status = ApplyBatchReprInPlace(&batch, repr, &updates, &has_delete_range);
+  AccountMemory();
+  return status;
+}
+
+DBStatus DBSnapshot::ApplyBatchRepr(DBSlice repr, bool sync) { return FmtStatus("unsupported"); }
+
+DBStatus DBApplyBatchRepr(DBEngine* db, DBSlice repr, bool sync) {
+  LatencyTimer timer(db->GetLatencyStats(), &LatencyStats::apply_batch_repr);
+  // Mutations applied to batches are traced when the batch commits.
+  Tracer* tracer = db->GetTracer();
+  if (tracer != nullptr && tracer->Enabled() && db->GetWriteBatch() == nullptr) {
+    tracer->ApplyBatchRepr(ToSlice(repr), sync);
+  }
+  if (db->GetWriteBatch() == nullptr) {
+    sampleBatch(db->GetKeySampler(), ToSlice(repr));
+  }
+  return db->ApplyBatchRepr(repr, sync);
+}
+
+DBSlice DBImpl::BatchRepr() { return ToDBSlice("unsupported"); }
+
+DBSlice DBBatch::BatchRepr() { return ToDBSlice(batch.GetWriteBatch()->Data()); }
+
+DBSlice DBWriteOnlyBatch::BatchRepr() { return ToDBSlice(batch.GetWriteBatch()->Data()); }
+
+DBSlice DBSnapshot::BatchRepr() { return ToDBSlice("unsupported"); }
+
+DBSlice DBBatchRepr(DBEngine* db) { return db->BatchRepr(); }
+
+DBEngine* DBNewSnapshot(DBEngine* db) { return new DBSnapshot(db); }
+
+DBEngine* DBNewBatch(DBEngine* db, bool writeOnly) {
+  std::shared_ptr<BatchPool> pool = db->GetBatchPool();
+  if (pool != nullptr) {
+    DBEngine* batch = pool->Get(writeOnly);
+    if (batch != nullptr) {
+      return batch;
+    }
+  }
+  if (writeOnly) {
+    return new DBWriteOnlyBatch(db);
+  }
+  return new DBBatch(db);
 }
 
 DBIterator* DBImpl::NewIter(rocksdb::ReadOptions* read_opts) {
@@ -2130,6 +4671,46 @@ DBStatus DBImpl::GetStats(DBStatsResult* stats) {
   stats->compactions = (int64_t)event_listener->GetCompactions();
   stats->table_readers_mem_estimate = table_readers_mem_estimate;
   stats->pending_compaction_bytes_estimate = pending_compaction_bytes_estimate;
+  stats->persistent_cache_hits = (int64_t)s->getTickerCount(rocksdb::PERSISTENT_CACHE_HIT);
+  stats->persistent_cache_misses = (int64_t)s->getTickerCount(rocksdb::PERSISTENT_CACHE_MISS);
+  // The persistent cache may be shared with other engines, in which
+  // case the usage is that of the shared cache.
+  stats->persistent_cache_usage =
+      persistent_cache != nullptr ? (int64_t)persistent_cache->Usage() : 0;
+  stats->write_stalls = (int64_t)event_listener->GetWriteStalls();
+  stats->write_stops = (int64_t)event_listener->GetWriteStops();
+  stats->write_stall_nanos = event_listener->GetWriteStallNanos();
+  stats->flush_bytes = (int64_t)event_listener->GetFlushBytes();
+  std::string l0_files;
+  rep->GetProperty("rocksdb.num-files-at-level0", &l0_files);
+  stats->l0_file_count = atoll(l0_files.c_str());
+  static_assert(sizeof(stats->compaction_levels) / sizeof(stats->compaction_levels[0]) ==
+                    DBEventListener::kNumLevels,
+                "mismatched number of compaction levels");
+  event_listener->GetCompactionLevelStats(stats->compaction_levels);
+  stats->block_decompressions = (int64_t)s->getTickerCount(rocksdb::NUMBER_BLOCK_DECOMPRESSED);
+  rocksdb::HistogramData decompression_times;
+  s->histogramData(rocksdb::DECOMPRESSION_TIMES_NANOS, &decompression_times);
+  stats->decompression_nanos = (int64_t)decompression_times.sum;
+  stats->blob_file_count = 0;
+  stats->blob_file_bytes = 0;
+  stats->blob_relocated_bytes = 0;
+  if (blob_store != nullptr) {
+    blob_store->GetStats(&stats->blob_file_count, &stats->blob_file_bytes);
+    stats->blob_relocated_bytes = blob_store->RelocatedBytes();
+  }
+  stats->readahead_bytes = 0;
+  stats->readahead_hit_bytes = 0;
+  if (readahead_env != nullptr) {
+    stats->readahead_bytes = readahead_env->ReadaheadBytes();
+    stats->readahead_hit_bytes = readahead_env->HitBytes();
+  }
+  stats->rate_limit_bytes_per_sec = 0;
+  stats->rate_limit_throttled_nanos = 0;
+  if (rate_limiter != nullptr) {
+    stats->rate_limit_bytes_per_sec = rate_limiter->GetBytesPerSecond();
+    stats->rate_limit_throttled_nanos = rate_limiter->GetThrottledNanos();
+  }
   return kSuccess;
 }
 
@@ -2180,17 +4761,425 @@ DBStatus DBSnapshot::EnvWriteFile(DBSlice path, DBSlice contents) {
   return FmtStatus("unsupported");
 }
 
+// EnvOpenFile creates a new "file" in the given engine which is written
+// incrementally. See DBEnvOpenFile.
+DBStatus DBImpl::EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                             std::unique_ptr<rocksdb::WritableFile>* file) {
+  return ToDBStatus(this->rep->GetEnv()->NewWritableFile(ToString(path), file, options));
+}
+
+DBStatus DBBatch::EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                              std::unique_ptr<rocksdb::WritableFile>* file) {
+  return FmtStatus("unsupported");
+}
+
+DBStatus DBWriteOnlyBatch::EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                                       std::unique_ptr<rocksdb::WritableFile>* file) {
+  return FmtStatus("unsupported");
+}
+
+DBStatus DBSnapshot::EnvOpenFile(DBSlice path, const rocksdb::EnvOptions& options,
+                                 std::unique_ptr<rocksdb::WritableFile>* file) {
+  return FmtStatus("unsupported");
+}
+
+DBStatus DBImpl::ResetBatch() { return FmtStatus("unsupported"); }
+
+DBStatus DBBatch::ResetBatch() {
+  // NB: WriteBatchWithIndex::Clear retains the memory backing the
+  // batch repr but releases the index.
+  batch.Clear();
+  updates = 0;
+  has_delete_range = false;
+  return kSuccess;
+}
+
+DBStatus DBWriteOnlyBatch::ResetBatch() {
+  batch.Clear();
+  updates = 0;
+  return kSuccess;
+}
+
+DBStatus DBSnapshot::ResetBatch() { return FmtStatus("unsupported"); }
+
+// The pooled batches retain the memory backing their reprs, which
+// may have grown well beyond their current size if they were reset
+// (see DBBatchReset), so it is the capacity that is bounded.
+bool DBBatch::ReturnToPool() {
+  if (pool == nullptr ||
+      batch.GetWriteBatch()->Data().capacity() > BatchPool::kMaxPooledBatchBytes) {
+    return false;
+  }
+  ResetBatch();
+  return pool->Put(this, false);
+}
+
+bool DBWriteOnlyBatch::ReturnToPool() {
+  if (pool == nullptr || batch.Data().capacity() > BatchPool::kMaxPooledBatchBytes) {
+    return false;
+  }
+  ResetBatch();
+  return pool->Put(this, true);
+}
+
+DBStatus DBBatchReset(DBEngine* db) { return db->ResetBatch(); }
+
 DBStatus DBEnvWriteFile(DBEngine* db, DBSlice path, DBSlice contents) {
   return db->EnvWriteFile(path, contents);
 }
 
+// DBWritableFile is a file being written through DBEnvAppendFile. The
+// bytes appended since the last range sync are tracked so that
+// writeback can be started every bytes_per_sync bytes.
+struct DBWritableFile {
+  std::unique_ptr<rocksdb::WritableFile> rep;
+  uint64_t bytes_per_sync;
+  uint64_t size;
+  uint64_t synced;
+};
+
+DBStatus DBEnvOpenFile(DBEngine* db, DBSlice path, uint64_t bytes_per_sync,
+                       DBWritableFile** file) {
+  rocksdb::EnvOptions soptions;
+  soptions.bytes_per_sync = bytes_per_sync;
+  std::unique_ptr<rocksdb::WritableFile> rep;
+  DBStatus status = db->EnvOpenFile(path, soptions, &rep);
+  if (status.data != NULL) {
+    return status;
+  }
+  *file = new DBWritableFile{std::move(rep), bytes_per_sync, 0, 0};
+  return kSuccess;
+}
+
+DBStatus DBEnvAppendFile(DBWritableFile* file, DBSlice contents) {
+  rocksdb::Status s = file->rep->Append(ToSlice(contents));
+  if (!s.ok()) {
+    return ToDBStatus(s);
+  }
+  file->size += contents.len;
+  if (file->bytes_per_sync > 0 && file->size - file->synced >= file->bytes_per_sync) {
+    // Start writeback of the bytes written since the last range sync,
+    // rounded down to a page, rather than leaving all of them for the
+    // final sync. Files which do not support range syncs (e.g. in-memory
+    // files) treat this as a no-op.
+    const uint64_t offset = file->size & ~uint64_t(4095);
+    if (offset > file->synced) {
+      s = file->rep->RangeSync(file->synced, offset - file->synced);
+      if (!s.ok()) {
+        return ToDBStatus(s);
+      }
+      file->synced = offset;
+    }
+  }
+  return kSuccess;
+}
+
+DBStatus DBEnvSyncFile(DBWritableFile* file) { return ToDBStatus(file->rep->Sync()); }
+
+DBStatus DBEnvCloseFile(DBWritableFile* file) {
+  rocksdb::Status s = file->rep->Close();
+  delete file;
+  return ToDBStatus(s);
+}
+
 DBIterator* DBNewIter(DBEngine* db, bool prefix) {
   rocksdb::ReadOptions opts;
   opts.prefix_same_as_start = prefix;
   opts.total_order_seek = !prefix;
-  return db->NewIter(&opts);
+  BlobReadPin pin(db->GetBlobStore());
+  DBIterator* iter = db->NewIter(&opts);
+  if (iter != NULL) {
+    iter->blob_pin = std::move(pin);
+    iter->prefix = prefix;
+    iter->latency_stats = db->GetLatencyStats();
+    iter->tracer = db->GetTracer();
+    iter->key_sampler = db->GetKeySampler();
+  }
+  return iter;
+}
+
+// TimeBoundTableCache caches the timestamp bounds of the sstables of
+// an engine, decoded from their table properties, so that creating a
+// time bound iterator does not read and decode the properties of every
+// sstable. sstables are immutable, so an entry only needs to be
+// dropped once its sstable is no longer live.
+class TimeBoundTableCache {
+ public:
+  struct Table {
+    // The bounds of the whole table (crdb.ts.min and crdb.ts.max),
+    // which are empty if the table does not record them.
+    std::string ts_min;
+    std::string ts_max;
+    // The bounds of the table's blocks, if has_blocks.
+    bool has_blocks;
+    std::vector<TimeBoundBlockSpan> spans;
+  };
+
+  // Get sets *tables to the bounds of the live sstables of db, reading
+  // the properties of only those which are not cached. Returns false
+  // if the properties cannot be read.
+  bool Get(rocksdb::DB* db, std::vector<std::shared_ptr<const Table>>* tables) {
+    std::vector<rocksdb::LiveFileMetaData> files;
+    db->GetLiveFilesMetaData(&files);
+
+    std::lock_guard<std::mutex> l(mu_);
+    std::unordered_map<std::string, std::shared_ptr<const Table>> live;
+    std::vector<rocksdb::Range> missing;
+    for (const auto& f : files) {
+      const std::string path = f.db_path + f.name;
+      auto it = tables_.find(path);
+      if (it != tables_.end()) {
+        live.emplace(path, it->second);
+      } else {
+        missing.emplace_back(f.smallestkey, f.largestkey);
+      }
+    }
+    if (!missing.empty()) {
+      rocksdb::TablePropertiesCollection props;
+      if (!db->GetPropertiesOfTablesInRange(db->DefaultColumnFamily(), missing.data(),
+                                            missing.size(), &props)
+               .ok()) {
+        return false;
+      }
+      for (const auto& f : files) {
+        const std::string path = f.db_path + f.name;
+        if (live.count(path) > 0) {
+          continue;
+        }
+        auto it = props.find(path);
+        if (it == props.end()) {
+          return false;
+        }
+        live.emplace(path, decode(*it->second));
+      }
+    }
+    tables_ = std::move(live);
+
+    tables->clear();
+    for (const auto& t : tables_) {
+      tables->push_back(t.second);
+    }
+    return true;
+  }
+
+ private:
+  static std::shared_ptr<const Table> decode(const rocksdb::TableProperties& props) {
+    const rocksdb::UserCollectedProperties& userprops = props.user_collected_properties;
+    std::shared_ptr<Table> t = std::make_shared<Table>();
+    auto tbl_min = userprops.find("crdb.ts.min");
+    auto tbl_max = userprops.find("crdb.ts.max");
+    if (tbl_min != userprops.end() && tbl_max != userprops.end()) {
+      t->ts_min = tbl_min->second;
+      t->ts_max = tbl_max->second;
+    }
+    auto blocks = userprops.find(kTimeBoundBlocksPropName);
+    t->has_blocks =
+        blocks != userprops.end() && DecodeTimeBoundBlockSpans(blocks->second, &t->spans);
+    return t;
+  }
+
+  std::mutex mu_;
+  // The live sstables, keyed by path.
+  std::unordered_map<std::string, std::shared_ptr<const Table>> tables_;
+};
+
+namespace {
+
+// Counters for the table and block skipping performed by time bound
+// iterators. See DBGetTimeBoundIterStats.
+std::atomic<int64_t> time_bound_tables_read;
+std::atomic<int64_t> time_bound_tables_skipped;
+std::atomic<int64_t> time_bound_blocks_read;
+std::atomic<int64_t> time_bound_blocks_skipped;
+
+// Counters for the table skipping performed by intent iterators. See
+// DBGetIntentIterStats.
+std::atomic<int64_t> intent_tables_read;
+std::atomic<int64_t> intent_tables_skipped;
+
+// TimeBoundBlockIterator wraps the iterator returned by
+// DBNewTimeBoundIter and skips forward past the parts of the key space
+// in which no sstable contains keys in the iterator's timestamp
+// range. The parts which must be read are described by a sorted list
+// of disjoint key ranges derived from the per-block timestamp bounds
+// of every sstable (see TimeBoundTblPropCollector). Keys in the
+// memtables (and, for a batch, in the batch) are not described by any
+// sstable, so before skipping a gap the iterator checks the unindexed
+// iterator (a memtable-only iterator at the same snapshot) for keys in
+// the gap. Only forward iteration skips; Prev and SeekToLast behave as
+// for the wrapped iterator.
+class TimeBoundBlockIterator : public rocksdb::Iterator {
+ public:
+  TimeBoundBlockIterator(rocksdb::DB* db, const rocksdb::Snapshot* snapshot,
+                         rocksdb::Iterator* base, rocksdb::Iterator* unindexed,
+                         std::vector<std::pair<std::string, std::string>> ranges)
+      : db_(db),
+        snapshot_(snapshot),
+        base_(base),
+        unindexed_(unindexed),
+        ranges_(std::move(ranges)),
+        exhausted_(false) {}
+
+  virtual ~TimeBoundBlockIterator() {
+    // The iterators must be destroyed before the snapshot is released.
+    base_.reset();
+    unindexed_.reset();
+    db_->ReleaseSnapshot(snapshot_);
+  }
+
+  bool Valid() const override { return !exhausted_ && base_->Valid(); }
+
+  void SeekToFirst() override {
+    exhausted_ = false;
+    base_->SeekToFirst();
+    skipForward();
+  }
+
+  void SeekToLast() override {
+    exhausted_ = false;
+    base_->SeekToLast();
+  }
+
+  void Seek(const rocksdb::Slice& target) override {
+    exhausted_ = false;
+    base_->Seek(target);
+    skipForward();
+  }
+
+  void SeekForPrev(const rocksdb::Slice& target) override {
+    exhausted_ = false;
+    base_->SeekForPrev(target);
+  }
+
+  void Next() override {
+    base_->Next();
+    skipForward();
+  }
+
+  void Prev() override { base_->Prev(); }
+
+  rocksdb::Slice key() const override { return base_->key(); }
+
+  rocksdb::Slice value() const override { return base_->value(); }
+
+  rocksdb::Status status() const override {
+    if (!base_->status().ok()) {
+      return base_->status();
+    }
+    return unindexed_->status();
+  }
+
+ private:
+  void skipForward() {
+    while (!exhausted_ && base_->Valid()) {
+      const rocksdb::Slice key = base_->key();
+      // Find the first range which ends at or after the key.
+      auto it = std::lower_bound(
+          ranges_.begin(), ranges_.end(), key,
+          [](const std::pair<std::string, std::string>& r, const rocksdb::Slice& k) {
+            return kComparator.Compare(r.second, k) < 0;
+          });
+      if (it != ranges_.end() && kComparator.Compare(it->first, key) <= 0) {
+        return;
+      }
+      // The key is in a gap between ranges which extends to the start
+      // of the next range (or the end of the key space). Stop at the
+      // first unindexed key in the gap, if any.
+      unindexed_->Seek(key);
+      if (!unindexed_->status().ok()) {
+        return;
+      }
+      if (unindexed_->Valid() &&
+          (it == ranges_.end() || kComparator.Compare(unindexed_->key(), it->first) < 0)) {
+        if (kComparator.Compare(unindexed_->key(), key) == 0) {
+          return;
+        }
+        base_->Seek(unindexed_->key());
+      } else if (it != ranges_.end()) {
+        base_->Seek(it->first);
+      } else {
+        exhausted_ = true;
+      }
+    }
+  }
+
+ private:
+  rocksdb::DB* const db_;
+  const rocksdb::Snapshot* const snapshot_;
+  std::unique_ptr<rocksdb::Iterator> base_;
+  std::unique_ptr<rocksdb::Iterator> unindexed_;
+  const std::vector<std::pair<std::string, std::string>> ranges_;
+  bool exhausted_;
+};
+
+// timeBoundRanges computes the key ranges which a time bound iterator
+// over [min, max] must read from the per-block timestamp bounds of the
+// sstables, returning false if some sstable which overlaps [min, max]
+// does not have block bounds (e.g. because it was written by an older
+// version or ingested), in which case no blocks can be skipped.
+bool timeBoundRanges(const std::vector<std::shared_ptr<const TimeBoundTableCache::Table>>& tables,
+                     const std::string& min, const std::string& max,
+                     std::vector<std::pair<std::string, std::string>>* ranges) {
+  int64_t blocks_read = 0;
+  int64_t blocks_skipped = 0;
+  for (const auto& t : tables) {
+    if (!t->ts_min.empty() && !t->ts_max.empty() &&
+        (max.compare(t->ts_min) < 0 || min.compare(t->ts_max) > 0)) {
+      // The whole table is skipped by the table filter.
+      continue;
+    }
+    if (!t->has_blocks) {
+      return false;
+    }
+    for (const auto& span : t->spans) {
+      if (span.Overlaps(min, max)) {
+        ranges->emplace_back(span.first_key, span.last_key);
+        ++blocks_read;
+      } else {
+        ++blocks_skipped;
+      }
+    }
+  }
+
+  // Sort and merge overlapping ranges.
+  std::sort(ranges->begin(), ranges->end(),
+            [](const std::pair<std::string, std::string>& a,
+               const std::pair<std::string, std::string>& b) {
+              return kComparator.Compare(a.first, b.first) < 0;
+            });
+  size_t n = 0;
+  for (size_t i = 0; i < ranges->size(); ++i) {
+    if (n > 0 && kComparator.Compare((*ranges)[i].first, (*ranges)[n - 1].second) <= 0) {
+      if (kComparator.Compare((*ranges)[i].second, (*ranges)[n - 1].second) > 0) {
+        (*ranges)[n - 1].second = std::move((*ranges)[i].second);
+      }
+      continue;
+    }
+    if (n != i) {
+      (*ranges)[n] = std::move((*ranges)[i]);
+    }
+    ++n;
+  }
+  ranges->resize(n);
+
+  time_bound_blocks_read += blocks_read;
+  time_bound_blocks_skipped += blocks_skipped;
+  return true;
 }
 
+// kSuperVersionNumberProp is the property holding the number of the
+// current super version, which changes whenever the memtables or
+// sstables change.
+const char kSuperVersionNumberProp[] = "rocksdb.current-super-version-number";
+// kTimeBoundIterAttempts is the number of times DBNewTimeBoundIter
+// tries to build a block skipping iterator from a single version.
+const int kTimeBoundIterAttempts = 3;
+
+// See SetTimeBoundIterTestingHook.
+void (*time_bound_iter_testing_hook)(DBEngine* db);
+
+}  // namespace
+
 DBIterator* DBNewTimeBoundIter(DBEngine* db, DBTimestamp min_ts, DBTimestamp max_ts) {
   const std::string min = EncodeTimestamp(min_ts);
   const std::string max = EncodeTimestamp(max_ts);
@@ -2200,22 +5189,242 @@ DBIterator* DBNewTimeBoundIter(DBEngine* db, DBTimestamp min_ts, DBTimestamp max
     auto userprops = props.user_collected_properties;
     auto tbl_min = userprops.find("crdb.ts.min");
     if (tbl_min == userprops.end() || tbl_min->second.empty()) {
+      ++time_bound_tables_read;
       return true;
     }
     auto tbl_max = userprops.find("crdb.ts.max");
     if (tbl_max == userprops.end() || tbl_max->second.empty()) {
+      ++time_bound_tables_read;
       return true;
     }
     // If the timestamp range of the table overlaps with the timestamp range we
     // want to iterate, the table might contain timestamps we care about.
-    return max.compare(tbl_min->second) >= 0 && min.compare(tbl_max->second) <= 0;
+    const bool overlaps = max.compare(tbl_min->second) >= 0 && min.compare(tbl_max->second) <= 0;
+    ++(overlaps ? time_bound_tables_read : time_bound_tables_skipped);
+    return overlaps;
   };
-  return db->NewIter(&opts);
+
+  // Use an explicit snapshot so that the memtable-only iterator used to
+  // find unindexed keys sees the same data as the iterator itself. Note
+  // that DBEngine::NewIter may substitute the engine's own snapshot.
+  BlobReadPin pin(db->GetBlobStore());
+  const rocksdb::Snapshot* snapshot = db->rep->GetSnapshot();
+  opts.snapshot = snapshot;
+  rocksdb::ReadOptions unindexed_opts;
+  unindexed_opts.total_order_seek = true;
+  unindexed_opts.read_tier = rocksdb::kMemtableTier;
+  unindexed_opts.snapshot = opts.snapshot;
+
+  // The iterator, the table properties from which the ranges are
+  // computed and the memtable-only iterator must all be built from the
+  // same version of the database: a flush between them would move keys
+  // out of the memtables the memtable-only iterator sees and into an
+  // sstable the ranges do not describe, and those keys would be
+  // skipped. The super version number changes whenever the memtables
+  // or sstables change, so they are rebuilt if it changed while they
+  // were being built. If the version keeps changing, blocks are not
+  // skipped. Engines without a cache of the table bounds (e.g. those
+  // not created by DBOpen) read the properties of every sstable.
+  TimeBoundTableCache uncached;
+  TimeBoundTableCache* cache = db->GetTimeBoundTableCache();
+  if (cache == nullptr) {
+    cache = &uncached;
+  }
+  std::vector<std::shared_ptr<const TimeBoundTableCache::Table>> tables;
+  for (int attempt = 0; attempt < kTimeBoundIterAttempts; ++attempt) {
+    uint64_t version;
+    if (!db->rep->GetIntProperty(kSuperVersionNumberProp, &version)) {
+      break;
+    }
+    std::unique_ptr<DBIterator> iter(db->NewIter(&opts));
+    if (iter == nullptr) {
+      break;
+    }
+    std::vector<std::pair<std::string, std::string>> ranges;
+    if (!cache->Get(db->rep, &tables) || !timeBoundRanges(tables, min, max, &ranges)) {
+      break;
+    }
+    if (time_bound_iter_testing_hook != nullptr) {
+      time_bound_iter_testing_hook(db);
+    }
+    std::unique_ptr<DBIterator> unindexed(db->NewIter(&unindexed_opts));
+    uint64_t new_version;
+    if (!db->rep->GetIntProperty(kSuperVersionNumberProp, &new_version)) {
+      break;
+    }
+    if (new_version != version) {
+      continue;
+    }
+    iter->rep.reset(new TimeBoundBlockIterator(db->rep, snapshot, iter->rep.release(),
+                                               unindexed->rep.release(), std::move(ranges)));
+    iter->blob_pin = std::move(pin);
+    iter->latency_stats = db->GetLatencyStats();
+    iter->tracer = db->GetTracer();
+    iter->key_sampler = db->GetKeySampler();
+    return iter.release();
+  }
+
+  // Blocks cannot be skipped. An iterator retains the data it can see
+  // regardless of snapshots, so the snapshot can be released.
+  DBIterator* iter = db->NewIter(&opts);
+  db->rep->ReleaseSnapshot(snapshot);
+  if (iter != NULL) {
+    iter->blob_pin = std::move(pin);
+    iter->latency_stats = db->GetLatencyStats();
+    iter->tracer = db->GetTracer();
+    iter->key_sampler = db->GetKeySampler();
+  }
+  return iter;
 }
 
-void DBIterDestroy(DBIterator* iter) { delete iter; }
+void SetTimeBoundIterTestingHook(void (*hook)(DBEngine* db)) {
+  time_bound_iter_testing_hook = hook;
+}
+
+DBTimeBoundIterStats DBGetTimeBoundIterStats() {
+  DBTimeBoundIterStats stats;
+  stats.tables_read = time_bound_tables_read;
+  stats.tables_skipped = time_bound_tables_skipped;
+  stats.blocks_read = time_bound_blocks_read;
+  stats.blocks_skipped = time_bound_blocks_skipped;
+  return stats;
+}
+
+DBIterator* DBNewIntentIter(DBEngine* db, DBSlice start, DBSlice end) {
+  const std::string start_key = ToString(start);
+  const std::string end_key = ToString(end);
+  rocksdb::ReadOptions opts;
+  opts.total_order_seek = true;
+  opts.table_filter = [start_key, end_key](const rocksdb::TableProperties& props) {
+    auto userprops = props.user_collected_properties;
+    auto count_prop = userprops.find(kIntentCountPropName);
+    auto shadow_prop = userprops.find(kIntentShadowCountPropName);
+    auto first_prop = userprops.find(kIntentFirstKeyPropName);
+    auto last_prop = userprops.find(kIntentLastKeyPropName);
+    uint64_t count;
+    uint64_t shadows;
+    rocksdb::Slice count_buf;
+    rocksdb::Slice shadow_buf;
+    if (count_prop != userprops.end()) {
+      count_buf = count_prop->second;
+    }
+    if (shadow_prop != userprops.end()) {
+      shadow_buf = shadow_prop->second;
+    }
+    if (count_prop == userprops.end() || shadow_prop == userprops.end() ||
+        first_prop == userprops.end() || last_prop == userprops.end() ||
+        !DecodeUint64(&count_buf, &count) || !DecodeUint64(&shadow_buf, &shadows)) {
+      // The table was written before intents and the entries which
+      // may shadow them were counted.
+      ++intent_tables_read;
+      return true;
+    }
+    // The table might contain intents we care about, or entries
+    // shadowing older intents, if it has any and their bounds overlap
+    // [start, end).
+    const bool overlaps = count + shadows > 0 &&
+                          (end_key.empty() || first_prop->second < end_key) &&
+                          start_key <= last_prop->second;
+    ++(overlaps ? intent_tables_read : intent_tables_skipped);
+    return overlaps;
+  };
+
+  BlobReadPin pin(db->GetBlobStore());
+  DBIterator* iter = db->NewIter(&opts);
+  if (iter != NULL) {
+    iter->blob_pin = std::move(pin);
+    iter->latency_stats = db->GetLatencyStats();
+    iter->tracer = db->GetTracer();
+    iter->key_sampler = db->GetKeySampler();
+  }
+  return iter;
+}
+
+DBIntentIterStats DBGetIntentIterStats() {
+  DBIntentIterStats stats;
+  stats.tables_read = intent_tables_read;
+  stats.tables_skipped = intent_tables_skipped;
+  return stats;
+}
+
+IterPool::~IterPool() {
+  for (auto& v : free_) {
+    for (auto iter : v) {
+      delete iter;
+    }
+  }
+}
+
+DBIterator* IterPool::Get(bool prefix) {
+  for (;;) {
+    DBIterator* iter;
+    {
+      std::lock_guard<std::mutex> l(mu_);
+      std::vector<DBIterator*>& v = free_[prefix];
+      if (v.empty()) {
+        return nullptr;
+      }
+      iter = v.back();
+      v.pop_back();
+    }
+    iter->blob_pin.Repin();
+    if (iter->rep->Refresh().ok()) {
+      return iter;
+    }
+    delete iter;
+  }
+}
+
+bool IterPool::Put(DBIterator* iter) {
+  // NB: the iterator is refreshed by Get when it is reused. Refreshing
+  // here as well would not release the SuperVersion, only swap it for
+  // the current one.
+  std::lock_guard<std::mutex> l(mu_);
+  std::vector<DBIterator*>& v = free_[iter->prefix];
+  if (v.size() >= kMaxPooledIters) {
+    return false;
+  }
+  v.push_back(iter);
+  return true;
+}
+
+DBIterator* DBNewPooledIter(DBEngine* db, bool prefix) {
+  IterPool* pool = db->GetIterPool();
+  if (pool == nullptr) {
+    return DBNewIter(db, prefix);
+  }
+  DBIterator* iter = pool->Get(prefix);
+  if (iter == nullptr) {
+    iter = DBNewIter(db, prefix);
+    iter->pool = pool;
+  }
+  return iter;
+}
+
+DBStatus DBIterRefresh(DBIterator* iter) {
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->IterRefresh(iter->trace_id);
+  }
+  iter->blob_pin.Repin();
+  return ToDBStatus(iter->rep->Refresh());
+}
+
+void DBIterDestroy(DBIterator* iter) {
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->IterDestroy(iter->trace_id);
+  }
+  // A pooled iterator is traced as a new iterator when it is reused.
+  iter->trace_id = 0;
+  if (iter->pool == nullptr || !iter->pool->Put(iter)) {
+    delete iter;
+  }
+}
 
 DBIterState DBIterSeek(DBIterator* iter, DBKey key) {
+  LatencyTimer timer(iter->latency_stats, &LatencyStats::iter_seek);
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->IterSeek(traceIterID(iter), key);
+  }
   iter->rep->Seek(EncodeKey(key));
   return DBIterGetState(iter);
 }
@@ -2231,6 +5440,10 @@ DBIterState DBIterSeekToLast(DBIterator* iter) {
 }
 
 DBIterState DBIterNext(DBIterator* iter, bool skip_current_key_versions) {
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->IterNext(traceIterID(iter), skip_current_key_versions);
+  }
+
   // If we're skipping the current key versions, remember the key the
   // iterator was pointing out.
   std::string old_key;
@@ -2312,165 +5525,580 @@ DBIterState DBIterPrev(DBIterator* iter, bool skip_current_key_versions) {
 DBStatus DBMergeOne(DBSlice existing, DBSlice update, DBString* new_value) {
   new_value->len = 0;
 
-  cockroach::storage::engine::enginepb::MVCCMetadata meta;
-  if (!meta.ParseFromArray(existing.data, existing.len)) {
-    return ToDBString("corrupted existing value");
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  if (!meta.ParseFromArray(existing.data, existing.len)) {
+    return ToDBString("corrupted existing value");
+  }
+
+  cockroach::storage::engine::enginepb::MVCCMetadata update_meta;
+  if (!update_meta.ParseFromArray(update.data, update.len)) {
+    return ToDBString("corrupted update value");
+  }
+
+  if (!MergeValues(&meta, update_meta, true, NULL)) {
+    return ToDBString("incompatible merge values");
+  }
+  return MergeResult(&meta, new_value);
+}
+
+// TODO(tschottdorf): it's unfortunate that this method duplicates the logic
+// in (*MVCCStats).AgeTo. Passing now_nanos in is semantically tricky if there
+// is a chance that we run into values ahead of now_nanos. Instead, now_nanos
+// should be taken as a hint but determined by the max timestamp encountered.
+//
+// This implementation must match engine.ComputeStatsGo.
+MVCCStatsResult MVCCComputeStatsInternal(::rocksdb::Iterator* const iter_rep, DBKey start,
+                                         DBKey end, int64_t now_nanos) {
+  MVCCStatsAccumulator acc(now_nanos);
+
+  iter_rep->Seek(EncodeKey(start));
+  const std::string end_key = EncodeKey(end);
+
+  for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
+    if (!acc.Add(iter_rep->key(), iter_rep->value())) {
+      return acc.stats;
+    }
+  }
+
+  acc.stats.last_update_nanos = now_nanos;
+  return acc.stats;
+}
+
+MVCCStatsResult MVCCComputeStats(DBIterator* iter, DBKey start, DBKey end, int64_t now_nanos) {
+  return MVCCComputeStatsInternal(iter->rep.get(), start, end, now_nanos);
+}
+
+namespace {
+
+// mvccStatsSplitPoints returns the user keys at which [start,end) can
+// be divided into (at most) max_spans sub-spans of roughly equal
+// size. The split points are taken from the smallest keys of the
+// bottom-most sstables overlapping the span. Splitting at a user key
+// (rather than at the exact sstable boundary) guarantees that all of
+// the versions of a key fall within the same sub-span, so the
+// per-key state tracked by MVCCComputeStatsInternal (the implicit
+// metadata, prev_key and GC age accrual) never crosses a sub-span
+// boundary and the partial stats can simply be summed.
+std::vector<std::string> mvccStatsSplitPoints(rocksdb::DB* rep, const std::string& start_key,
+                                              const std::string& end_key, int max_spans) {
+  std::vector<rocksdb::LiveFileMetaData> all_metadata;
+  rep->GetLiveFilesMetaData(&all_metadata);
+
+  int max_level = 0;
+  for (int i = 0; i < all_metadata.size(); i++) {
+    if (max_level < all_metadata[i].level) {
+      max_level = all_metadata[i].level;
+    }
+  }
+
+  std::vector<rocksdb::LiveFileMetaData> sst;
+  uint64_t total_size = 0;
+  for (int i = 0; i < all_metadata.size(); i++) {
+    const rocksdb::LiveFileMetaData& m = all_metadata[i];
+    if (m.level != max_level || kComparator.Compare(m.largestkey, start_key) < 0 ||
+        kComparator.Compare(m.smallestkey, end_key) >= 0) {
+      continue;
+    }
+    total_size += m.size;
+    sst.push_back(m);
+  }
+  std::sort(sst.begin(), sst.end(),
+            [](const rocksdb::SstFileMetaData& a, const rocksdb::SstFileMetaData& b) -> bool {
+              return kComparator.Compare(a.smallestkey, b.smallestkey) < 0;
+            });
+
+  std::vector<std::string> splits;
+  const uint64_t target_size = total_size / std::max(1, max_spans);
+  uint64_t size = 0;
+  for (int i = 0; i < sst.size(); ++i) {
+    if (size >= target_size && splits.size() + 1 < max_spans) {
+      rocksdb::Slice key;
+      rocksdb::Slice ts;
+      if (SplitKey(sst[i].smallestkey, &key, &ts)) {
+        const std::string split = EncodeKey(key, 0, 0);
+        if (kComparator.Compare(split, start_key) > 0 &&
+            kComparator.Compare(split, end_key) < 0 &&
+            (splits.empty() || kComparator.Compare(EncodeKey(splits.back(), 0, 0), split) < 0)) {
+          splits.push_back(key.ToString());
+          size = 0;
+        }
+      }
+    }
+    size += sst[i].size;
+  }
+  return splits;
+}
+
+void mvccStatsAdd(MVCCStatsResult* stats, const MVCCStatsResult& other) {
+  stats->live_bytes += other.live_bytes;
+  stats->key_bytes += other.key_bytes;
+  stats->val_bytes += other.val_bytes;
+  stats->intent_bytes += other.intent_bytes;
+  stats->live_count += other.live_count;
+  stats->key_count += other.key_count;
+  stats->val_count += other.val_count;
+  stats->intent_count += other.intent_count;
+  stats->intent_age += other.intent_age;
+  stats->gc_bytes_age += other.gc_bytes_age;
+  stats->sys_bytes += other.sys_bytes;
+  stats->sys_count += other.sys_count;
+}
+
+}  // namespace
+
+MVCCStatsResult MVCCComputeStatsParallel(DBEngine* db, DBKey start, DBKey end, int64_t now_nanos,
+                                         int concurrency) {
+  MVCCStatsResult stats;
+  memset(&stats, 0, sizeof(stats));
+
+  const std::vector<std::string> splits =
+      concurrency > 1 ? mvccStatsSplitPoints(db->rep, EncodeKey(start), EncodeKey(end),
+                                             4 * concurrency)
+                      : std::vector<std::string>();
+
+  std::vector<DBKey> bounds;
+  bounds.push_back(start);
+  for (int i = 0; i < splits.size(); ++i) {
+    DBKey key;
+    key.key = ToDBSlice(splits[i]);
+    key.wall_time = 0;
+    key.logical = 0;
+    bounds.push_back(key);
+  }
+  bounds.push_back(end);
+  const int num_spans = bounds.size() - 1;
+
+  // All of the sub-span iterators read from the same snapshot. A
+  // DBSnapshot engine replaces the snapshot with its own which is
+  // equally consistent.
+  const rocksdb::Snapshot* snapshot = db->rep->GetSnapshot();
+  std::vector<std::unique_ptr<DBIterator>> iters(num_spans);
+  for (int i = 0; i < num_spans; ++i) {
+    rocksdb::ReadOptions opts;
+    opts.total_order_seek = true;
+    opts.snapshot = snapshot;
+    iters[i].reset(db->NewIter(&opts));
+    if (iters[i] == nullptr) {
+      iters.clear();
+      db->rep->ReleaseSnapshot(snapshot);
+      stats.status = FmtStatus("unable to create iterator");
+      return stats;
+    }
+  }
+
+  // The sub-spans are computed on the shared worker pool, with the
+  // calling thread participating as well.
+  std::vector<MVCCStatsResult> results(num_spans);
+  WorkerPool::Default()->ParallelFor(num_spans, concurrency, [&](int i) {
+    results[i] =
+        MVCCComputeStatsInternal(iters[i]->rep.get(), bounds[i], bounds[i + 1], now_nanos);
+  });
+  iters.clear();
+  db->rep->ReleaseSnapshot(snapshot);
+
+  for (int i = 0; i < num_spans; ++i) {
+    if (results[i].status.data != NULL) {
+      for (int j = i + 1; j < num_spans; ++j) {
+        free(results[j].status.data);
+      }
+      return results[i];
+    }
+    mvccStatsAdd(&stats, results[i]);
+  }
+  stats.last_update_nanos = now_nanos;
+  return stats;
+}
+
+namespace {
+
+// kChecksumFlushBytes is the size at which the buffered records of a
+// sequential checksum are hashed.
+const size_t kChecksumFlushBytes = 64 << 10;
+
+void putFixed64LittleEndian(std::string* buf, uint64_t v) {
+  char b[8];
+  for (int i = 0; i < 8; ++i) {
+    b[i] = char(v >> (8 * i));
+  }
+  buf->append(b, sizeof(b));
+}
+
+void putUvarint(std::string* buf, uint64_t v) {
+  for (; v >= 0x80; v >>= 7) {
+    buf->push_back(char(v | 0x80));
+  }
+  buf->push_back(char(v));
+}
+
+// checksumSubSpan appends the checksum records of the key/value pairs
+// in [start_key,end_key) to *buf (see MVCCComputeChecksum). If hasher
+// is not NULL the records are hashed (and the buffer cleared) whenever
+// the buffer grows past kChecksumFlushBytes. If acc is not NULL the
+// pairs are added to the stats as well.
+DBStatus checksumSubSpan(rocksdb::Iterator* iter_rep, BlobStore* blob_store,
+                         const std::string& start_key, const std::string& end_key,
+                         const rocksdb::Slice& skip_key, MVCCStatsAccumulator* acc, SHA512* hasher,
+                         std::string* buf) {
+  std::string blob_value;
+  iter_rep->Seek(start_key);
+  for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
+    if (acc != nullptr && !acc->Add(iter_rep->key(), iter_rep->value())) {
+      return acc->stats.status;
+    }
+    rocksdb::Slice key;
+    int64_t wall_time;
+    int32_t logical;
+    if (!DecodeKey(iter_rep->key(), &key, &wall_time, &logical)) {
+      return FmtStatus("unable to decode key");
+    }
+    if (wall_time == 0 && logical == 0 && !skip_key.empty() && key == skip_key) {
+      continue;
+    }
+    rocksdb::Slice value = iter_rep->value();
+    const rocksdb::Status status = ResolveBlobValue(blob_store, &value, &blob_value);
+    if (!status.ok()) {
+      return ToDBStatus(status);
+    }
+    putFixed64LittleEndian(buf, key.size());
+    putFixed64LittleEndian(buf, value.size());
+    buf->append(key.data(), key.size());
+    // The marshaled hlc.LegacyTimestamp, whose fields are always
+    // written.
+    buf->push_back('\x08');
+    putUvarint(buf, uint64_t(wall_time));
+    buf->push_back('\x10');
+    putUvarint(buf, uint64_t(int64_t(logical)));
+    buf->append(value.data(), value.size());
+    if (hasher != nullptr && buf->size() >= kChecksumFlushBytes) {
+      hasher->Update(buf->data(), buf->size());
+      buf->clear();
+    }
+  }
+  return ToDBStatus(iter_rep->status());
+}
+
+}  // namespace
+
+MVCCChecksumResult MVCCComputeChecksum(DBEngine* db, const DBSpan* spans, int num_spans,
+                                       DBSlice skip_key, bool compute_stats, int64_t now_nanos,
+                                       int concurrency) {
+  MVCCChecksumResult result;
+  memset(&result, 0, sizeof(result));
+
+  // Cut the spans into sub-spans, which are hashed in order.
+  std::vector<std::pair<std::string, std::string>> sub_spans;
+  for (int i = 0; i < num_spans; ++i) {
+    std::string start_key = EncodeKey(ToSlice(spans[i].start), 0, 0);
+    const std::string end_key = EncodeKey(ToSlice(spans[i].end), 0, 0);
+    if (concurrency > 1) {
+      for (const auto& split : mvccStatsSplitPoints(db->rep, start_key, end_key, 4 * concurrency)) {
+        std::string split_key = EncodeKey(split, 0, 0);
+        sub_spans.emplace_back(start_key, split_key);
+        start_key = std::move(split_key);
+      }
+    }
+    sub_spans.emplace_back(start_key, end_key);
+  }
+  const int num_sub_spans = sub_spans.size();
+
+  // All of the sub-span iterators read from the same snapshot (see
+  // MVCCComputeStatsParallel), and resolve separated values from the
+  // same pinned blob store.
+  BlobReadPin pin(db->GetBlobStore());
+  const rocksdb::Snapshot* snapshot = db->rep->GetSnapshot();
+  std::vector<std::unique_ptr<DBIterator>> iters(num_sub_spans);
+  for (int i = 0; i < num_sub_spans; ++i) {
+    rocksdb::ReadOptions opts;
+    opts.total_order_seek = true;
+    opts.snapshot = snapshot;
+    iters[i].reset(db->NewIter(&opts));
+    if (iters[i] == nullptr) {
+      iters.clear();
+      db->rep->ReleaseSnapshot(snapshot);
+      result.status = FmtStatus("unable to create iterator");
+      return result;
+    }
+  }
+
+  std::vector<MVCCStatsResult> stats(num_sub_spans);
+  auto checksum = [&](int i, SHA512* hasher, std::string* buf) {
+    std::unique_ptr<MVCCStatsAccumulator> acc;
+    if (compute_stats) {
+      acc.reset(new MVCCStatsAccumulator(now_nanos));
+    }
+    const DBStatus status =
+        checksumSubSpan(iters[i]->rep.get(), pin.store(), sub_spans[i].first,
+                        sub_spans[i].second, ToSlice(skip_key), acc.get(), hasher, buf);
+    if (acc != nullptr && status.data == NULL) {
+      stats[i] = acc->stats;
+    }
+    return status;
+  };
+
+  SHA512 hasher;
+  DBStatus status = kSuccess;
+  const int num_threads = std::max(1, std::min(concurrency, num_sub_spans));
+  if (num_threads == 1) {
+    std::string buf;
+    for (int i = 0; i < num_sub_spans && status.data == NULL; ++i) {
+      status = checksum(i, &hasher, &buf);
+    }
+    hasher.Update(buf.data(), buf.size());
+  } else {
+    // The sub-spans are buffered on the shared worker pool, with the
+    // calling thread participating as well, a window of sub-spans at a
+    // time. The calling thread then hashes the window's buffers in
+    // order. The window bounds the memory held by the buffers.
+    const int kWindow = 2 * num_threads;
+    std::vector<std::string> bufs(kWindow);
+    std::vector<DBStatus> statuses(kWindow);
+    for (int start = 0; start < num_sub_spans && status.data == NULL; start += kWindow) {
+      const int n = std::min(kWindow, num_sub_spans - start);
+      WorkerPool::Default()->ParallelFor(n, num_threads, [&](int i) {
+        bufs[i].clear();
+        statuses[i] = checksum(start + i, nullptr, &bufs[i]);
+      });
+      for (int i = 0; i < n; ++i) {
+        if (status.data == NULL && statuses[i].data == NULL) {
+          hasher.Update(bufs[i].data(), bufs[i].size());
+        } else if (status.data == NULL) {
+          status = statuses[i];
+        } else {
+          free(statuses[i].data);
+        }
+      }
+    }
   }
+  iters.clear();
+  db->rep->ReleaseSnapshot(snapshot);
 
-  cockroach::storage::engine::enginepb::MVCCMetadata update_meta;
-  if (!update_meta.ParseFromArray(update.data, update.len)) {
-    return ToDBString("corrupted update value");
+  if (status.data != NULL) {
+    result.status = status;
+    return result;
   }
-
-  if (!MergeValues(&meta, update_meta, true, NULL)) {
-    return ToDBString("incompatible merge values");
+  uint8_t digest[SHA512::kDigestSize];
+  hasher.Final(digest);
+  result.checksum = ToDBString(rocksdb::Slice(reinterpret_cast<char*>(digest), sizeof(digest)));
+  if (compute_stats) {
+    for (int i = 0; i < num_sub_spans; ++i) {
+      mvccStatsAdd(&result.stats, stats[i]);
+    }
+    result.stats.last_update_nanos = now_nanos;
   }
-  return MergeResult(&meta, new_value);
-}
-
-const int64_t kNanosecondPerSecond = 1e9;
-
-inline int64_t age_factor(int64_t fromNS, int64_t toNS) {
-  // Careful about implicit conversions here.
-  // toNS/1e9 - fromNS/1e9 is not the same since
-  // "1e9" is a double.
-  return toNS / kNanosecondPerSecond - fromNS / kNanosecondPerSecond;
+  return result;
 }
 
-// TODO(tschottdorf): it's unfortunate that this method duplicates the logic
-// in (*MVCCStats).AgeTo. Passing now_nanos in is semantically tricky if there
-// is a chance that we run into values ahead of now_nanos. Instead, now_nanos
-// should be taken as a hint but determined by the max timestamp encountered.
-//
-// This implementation must match engine.ComputeStatsGo.
-MVCCStatsResult MVCCComputeStatsInternal(::rocksdb::Iterator* const iter_rep, DBKey start,
-                                         DBKey end, int64_t now_nanos) {
+MVCCStatsResult MVCCComputeStatsWithTableProps(DBEngine* db, DBKey start, DBKey end,
+                                               int64_t now_nanos) {
   MVCCStatsResult stats;
   memset(&stats, 0, sizeof(stats));
 
-  iter_rep->Seek(EncodeKey(start));
+  const std::string start_key = EncodeKey(start);
   const std::string end_key = EncodeKey(end);
+  const rocksdb::Slice start_user_key = ToSlice(start.key);
+  const rocksdb::Slice end_user_key = ToSlice(end.key);
+
+  // The live files must be retrieved after the snapshot is created
+  // so that any sstable containing data newer than the snapshot can be
+  // detected (and skipped) using its largest sequence number.
+  const rocksdb::Snapshot* snapshot = db->rep->GetSnapshot();
+  const rocksdb::SequenceNumber snapshot_seq = snapshot->GetSequenceNumber();
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  db->rep->GetLiveFilesMetaData(&metadata);
+  // Only the properties of the sstables overlapping the span are read.
+  const rocksdb::Range range(start_key, end_key);
+  rocksdb::TablePropertiesCollection props;
+  rocksdb::Status status =
+      db->rep->GetPropertiesOfTablesInRange(db->rep->DefaultColumnFamily(), &range, 1, &props);
+  if (!status.ok()) {
+    db->rep->ReleaseSnapshot(snapshot);
+    stats.status = ToDBStatus(status);
+    return stats;
+  }
 
-  cockroach::storage::engine::enginepb::MVCCMetadata meta;
-  std::string prev_key;
-  bool first = false;
-  // NB: making this uninitialized triggers compiler warnings
-  // with `-Werror=maybe-uninitialized`. This warning seems like
-  // a false positive (changing the above line to `first=true`
-  // which results in equivalent code does not remove it either).
-  // An assertion has been placed where the compiler would warn.
-  int64_t accrue_gc_age_nanos = 0;
-
-  for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
-    const rocksdb::Slice key = iter_rep->key();
-    const rocksdb::Slice value = iter_rep->value();
-
-    rocksdb::Slice decoded_key;
-    int64_t wall_time = 0;
-    int32_t logical = 0;
-    if (!DecodeKey(key, &decoded_key, &wall_time, &logical)) {
-      stats.status = FmtStatus("unable to decode key");
-      return stats;
+  // The user key span covered by each live sstable which may overlap
+  // [start,end), sorted by first key.
+  struct userKeySpan {
+    std::string first;
+    std::string last;
+  };
+  struct liveTable {
+    userKeySpan span;
+    const rocksdb::LiveFileMetaData* meta;
+  };
+  std::vector<liveTable> tables;
+  for (const auto& m : metadata) {
+    rocksdb::Slice first, last, ts;
+    if (!SplitKey(m.smallestkey, &first, &ts) || !SplitKey(m.largestkey, &last, &ts)) {
+      continue;
     }
-
-    const bool isSys = (rocksdb::Slice(decoded_key).compare(kLocalMax) < 0);
-    const bool isValue = (wall_time != 0 || logical != 0);
-    const bool implicitMeta = isValue && decoded_key != prev_key;
-    prev_key.assign(decoded_key.data(), decoded_key.size());
-
-    if (implicitMeta) {
-      // No MVCCMetadata entry for this series of keys.
-      meta.Clear();
-      meta.set_key_bytes(kMVCCVersionTimestampSize);
-      meta.set_val_bytes(value.size());
-      meta.set_deleted(value.size() == 0);
-      meta.mutable_timestamp()->set_wall_time(wall_time);
+    if (last.compare(start_user_key) < 0 || first.compare(end_user_key) > 0) {
+      continue;
     }
+    tables.push_back(liveTable{userKeySpan{first.ToString(), last.ToString()}, &m});
+  }
+  std::sort(tables.begin(), tables.end(), [](const liveTable& a, const liveTable& b) {
+    return a.span.first < b.span.first;
+  });
+
+  // A range tombstone hides keys in other sstables without changing
+  // their properties, so no precomputed stats can be used when one may
+  // cover part of the span: either in the memtables (which are not
+  // visible through the table properties) or in any sstable overlapping
+  // the span. Sstables written before the tombstone count was recorded
+  // are treated as if they contained range tombstones.
+  bool range_tombstones = db->GetWriteListener() == nullptr ||
+                          db->GetWriteListener()->MemtablesMayHaveRangeDeletions();
+  for (int i = 0; i < tables.size() && !range_tombstones; ++i) {
+    const rocksdb::LiveFileMetaData& m = *tables[i].meta;
+    auto it = props.find(m.db_path + m.name);
+    if (it == props.end()) {
+      range_tombstones = true;
+      break;
+    }
+    const rocksdb::UserCollectedProperties& user_props = it->second->user_collected_properties;
+    auto count_prop = user_props.find(kMVCCStatsRangeTombstonesPropName);
+    rocksdb::Slice count_buf;
+    uint64_t count = 0;
+    if (count_prop != user_props.end()) {
+      count_buf = count_prop->second;
+    }
+    if (!DecodeUint64(&count_buf, &count) || count > 0) {
+      range_tombstones = true;
+    }
+  }
 
-    if (!isValue || implicitMeta) {
-      const int64_t meta_key_size = decoded_key.size() + 1;
-      const int64_t meta_val_size = implicitMeta ? 0 : value.size();
-      const int64_t total_bytes = meta_key_size + meta_val_size;
-      first = true;
+  // Find the sstables whose precomputed stats can be used: those which
+  // lie entirely within [start,end), contain no data newer than the
+  // snapshot and whose user keys do not overlap any other sstable. As
+  // the tables are sorted by first key, a table overlaps another iff
+  // it overlaps the next one or a preceding one ends at or after its
+  // first key.
+  std::vector<userKeySpan> covered;
+  std::vector<MVCCStatsResult> covered_stats;
+  std::string max_last;
+  for (int i = 0; i < tables.size() && !range_tombstones; ++i) {
+    const userKeySpan& span = tables[i].span;
+    const bool overlaps = (i > 0 && max_last >= span.first) ||
+                          (i + 1 < tables.size() && tables[i + 1].span.first <= span.last);
+    if (i == 0 || max_last < span.last) {
+      max_last = span.last;
+    }
+    const rocksdb::LiveFileMetaData& m = *tables[i].meta;
+    if (overlaps || m.largest_seqno > snapshot_seq) {
+      continue;
+    }
+    auto it = props.find(m.db_path + m.name);
+    if (it == props.end()) {
+      continue;
+    }
+    const rocksdb::UserCollectedProperties& user_props = it->second->user_collected_properties;
+    auto stats_prop = user_props.find(kMVCCStatsPropName);
+    auto first_prop = user_props.find(kMVCCStatsFirstKeyPropName);
+    auto last_prop = user_props.find(kMVCCStatsLastKeyPropName);
+    if (stats_prop == user_props.end() || first_prop == user_props.end() ||
+        last_prop == user_props.end()) {
+      continue;
+    }
+    const std::string& first = first_prop->second;
+    const std::string& last = last_prop->second;
+    if (kComparator.Compare(EncodeKey(first, 0, 0), start_key) < 0 ||
+        rocksdb::Slice(last).compare(end_user_key) >= 0) {
+      continue;
+    }
+    MVCCStatsResult table_stats;
+    memset(&table_stats, 0, sizeof(table_stats));
+    if (!DecodeMVCCStatsProp(stats_prop->second, now_nanos, &table_stats)) {
+      continue;
+    }
+    covered.push_back(userKeySpan{first, last});
+    covered_stats.push_back(table_stats);
+  }
 
-      if (!implicitMeta && !meta.ParseFromArray(value.data(), value.size())) {
-        stats.status = FmtStatus("unable to decode MVCCMetadata");
-        return stats;
+  rocksdb::ReadOptions opts;
+  opts.total_order_seek = true;
+  opts.snapshot = snapshot;
+  std::unique_ptr<DBIterator> iter(db->NewIter(&opts));
+  if (iter == nullptr) {
+    db->rep->ReleaseSnapshot(snapshot);
+    stats.status = FmtStatus("unable to create iterator");
+    return stats;
+  }
+
+  // An sstable is also unusable if there is newer data for its keys
+  // in the memtables. Check for this with a memtable-only iterator.
+  if (!covered.empty()) {
+    rocksdb::ReadOptions mem_opts = opts;
+    mem_opts.read_tier = rocksdb::kMemtableTier;
+    std::unique_ptr<rocksdb::Iterator> mem_iter(db->rep->NewIterator(mem_opts));
+    int n = 0;
+    for (int i = 0; i < covered.size(); ++i) {
+      mem_iter->Seek(EncodeKey(covered[i].first, 0, 0));
+      if (!mem_iter->status().ok()) {
+        // Play it safe and don't use any of the precomputed stats.
+        n = 0;
+        break;
       }
-
-      if (isSys) {
-        stats.sys_bytes += total_bytes;
-        stats.sys_count++;
-      } else {
-        if (!meta.deleted()) {
-          stats.live_bytes += total_bytes;
-          stats.live_count++;
-        } else {
-          stats.gc_bytes_age += total_bytes * age_factor(meta.timestamp().wall_time(), now_nanos);
+      if (mem_iter->Valid()) {
+        rocksdb::Slice key;
+        rocksdb::Slice ts;
+        if (!SplitKey(mem_iter->key(), &key, &ts) || key.compare(covered[i].last) <= 0) {
+          continue;
         }
-        stats.key_bytes += meta_key_size;
-        stats.val_bytes += meta_val_size;
-        stats.key_count++;
-        if (meta.has_raw_bytes()) {
-          stats.val_count++;
-        }
-      }
-      if (!implicitMeta) {
-        continue;
       }
+      covered[n] = covered[i];
+      covered_stats[n] = covered_stats[i];
+      ++n;
     }
-
-    const int64_t total_bytes = value.size() + kMVCCVersionTimestampSize;
-    if (isSys) {
-      stats.sys_bytes += total_bytes;
-    } else {
-      if (first) {
-        first = false;
-        if (!meta.deleted()) {
-          stats.live_bytes += total_bytes;
-        } else {
-          stats.gc_bytes_age += total_bytes * age_factor(meta.timestamp().wall_time(), now_nanos);
-        }
-        if (meta.has_txn()) {
-          stats.intent_bytes += total_bytes;
-          stats.intent_count++;
-          stats.intent_age += age_factor(meta.timestamp().wall_time(), now_nanos);
-        }
-        if (meta.key_bytes() != kMVCCVersionTimestampSize) {
-          stats.status = FmtStatus("expected mvcc metadata key bytes to equal %d; got %d",
-                                   kMVCCVersionTimestampSize, int(meta.key_bytes()));
-          return stats;
-        }
-        if (meta.val_bytes() != value.size()) {
-          stats.status = FmtStatus("expected mvcc metadata val bytes to equal %d; got %d",
-                                   int(value.size()), int(meta.val_bytes()));
-          return stats;
-        }
-        accrue_gc_age_nanos = meta.timestamp().wall_time();
-      } else {
-        bool is_tombstone = value.size() == 0;
-        if (is_tombstone) {
-          stats.gc_bytes_age += total_bytes * age_factor(wall_time, now_nanos);
-        } else {
-          assert(accrue_gc_age_nanos > 0);
-          stats.gc_bytes_age += total_bytes * age_factor(accrue_gc_age_nanos, now_nanos);
-        }
-        accrue_gc_age_nanos = wall_time;
-      }
-      stats.key_bytes += kMVCCVersionTimestampSize;
-      stats.val_bytes += value.size();
-      stats.val_count++;
+    covered.resize(n);
+    covered_stats.resize(n);
+  }
+
+  std::vector<int> order(covered.size());
+  for (int i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&covered](int a, int b) { return covered[a].first < covered[b].first; });
+
+  // Scan the gaps between the covered sstables and add in the
+  // precomputed stats for the covered sstables themselves.
+  std::string gap_start_buf;
+  DBKey gap_start = start;
+  for (int i = 0; i <= order.size(); ++i) {
+    DBKey gap_end = end;
+    if (i < order.size()) {
+      gap_end.key = ToDBSlice(covered[order[i]].first);
+      gap_end.wall_time = 0;
+      gap_end.logical = 0;
     }
-  }
-
+    MVCCStatsResult gap_stats =
+        MVCCComputeStatsInternal(iter->rep.get(), gap_start, gap_end, now_nanos);
+    if (gap_stats.status.data != NULL) {
+      iter.reset();
+      db->rep->ReleaseSnapshot(snapshot);
+      return gap_stats;
+    }
+    mvccStatsAdd(&stats, gap_stats);
+    if (i == order.size()) {
+      break;
+    }
+    mvccStatsAdd(&stats, covered_stats[order[i]]);
+    // The next gap starts at the smallest user key following the last
+    // key of the covered sstable.
+    gap_start_buf = covered[order[i]].last;
+    gap_start_buf.push_back('\0');
+    gap_start.key = ToDBSlice(gap_start_buf);
+    gap_start.wall_time = 0;
+    gap_start.logical = 0;
+  }
+
+  iter.reset();
+  db->rep->ReleaseSnapshot(snapshot);
   stats.last_update_nanos = now_nanos;
   return stats;
 }
 
-MVCCStatsResult MVCCComputeStats(DBIterator* iter, DBKey start, DBKey end, int64_t now_nanos) {
-  return MVCCComputeStatsInternal(iter->rep.get(), start, end, now_nanos);
-}
-
 bool MVCCIsValidSplitKey(DBSlice key, bool allow_meta2_splits) {
   return IsValidSplitKey(ToSlice(key), allow_meta2_splits);
 }
@@ -2506,7 +6134,8 @@ DBStatus MVCCFindSplitKey(DBIterator* iter, DBKey start, DBKey end, DBKey min_sp
       diff = -diff;
     }
     if (valid && diff < best_split_diff) {
-      best_split_key = decoded_key.ToString();
+      // NB: assign() reuses the existing allocation when possible.
+      best_split_key.assign(decoded_key.data(), decoded_key.size());
       best_split_diff = diff;
     }
     // If diff is increasing, that means we've passed the ideal split point and
@@ -2518,9 +6147,9 @@ DBStatus MVCCFindSplitKey(DBIterator* iter, DBKey start, DBKey end, DBKey min_sp
 
     const bool is_value = (wall_time != 0 || logical != 0);
     if (is_value && decoded_key == prev_key) {
-      size_so_far += kMVCCVersionTimestampSize + iter_rep->value().size();
+      size_so_far += kMVCCVersionTimestampSize + BlobValueSize(iter_rep->value());
     } else {
-      size_so_far += decoded_key.size() + 1 + iter_rep->value().size();
+      size_so_far += decoded_key.size() + 1 + BlobValueSize(iter_rep->value());
       if (is_value) {
         size_so_far += kMVCCVersionTimestampSize;
       }
@@ -2534,6 +6163,137 @@ DBStatus MVCCFindSplitKey(DBIterator* iter, DBKey start, DBKey end, DBKey min_sp
   return kSuccess;
 }
 
+namespace {
+
+// midpointKey returns a key which sorts between a and b (a < b) by
+// interpreting the keys as base-256 fractions and averaging them. The
+// returned key is one byte longer than the longer of a and b. If a
+// and b are adjacent (at this length) the result may equal a.
+std::string midpointKey(const std::string& a, const std::string& b) {
+  const int n = std::max(a.size(), b.size()) + 1;
+  std::vector<int> sum(n + 1, 0);
+  int carry = 0;
+  for (int i = n - 1; i >= 0; --i) {
+    const int x = (i < a.size() ? uint8_t(a[i]) : 0) + (i < b.size() ? uint8_t(b[i]) : 0) + carry;
+    sum[i + 1] = x & 0xff;
+    carry = x >> 8;
+  }
+  sum[0] = carry;
+
+  std::string mid(n, '\0');
+  int rem = sum[0];
+  for (int i = 1; i <= n; ++i) {
+    const int v = rem * 256 + sum[i];
+    mid[i - 1] = char(v / 2);
+    rem = v % 2;
+  }
+  return mid;
+}
+
+// kMaxSplitKeyBisections bounds the number of GetApproximateSizes
+// calls performed by MVCCFindSplitKeyApprox.
+const int kMaxSplitKeyBisections = 24;
+// kMaxSplitKeyWindow is the number of keys MVCCFindSplitKeyApprox
+// will examine looking for a valid split key after the estimated
+// split point before falling back to MVCCFindSplitKey.
+const int kMaxSplitKeyWindow = 1000;
+
+}  // namespace
+
+DBStatus MVCCFindSplitKeyApprox(DBEngine* db, DBKey start, DBKey end, DBKey min_split,
+                                int64_t target_size, bool allow_meta2_splits,
+                                DBString* split_key) {
+  rocksdb::ReadOptions opts;
+  opts.total_order_seek = true;
+  std::unique_ptr<DBIterator> iter(db->NewIter(&opts));
+  if (iter == nullptr) {
+    return FmtStatus("unable to create iterator");
+  }
+
+  const std::string start_key = EncodeKey(start);
+  const uint8_t flags = rocksdb::DB::SizeApproximationFlags::INCLUDE_FILES |
+                        rocksdb::DB::SizeApproximationFlags::INCLUDE_MEMTABLES;
+  auto approx_size = [&](const std::string& key) -> int64_t {
+    const std::string end_key = EncodeKey(key, 0, 0);
+    const rocksdb::Range r(start_key, end_key);
+    uint64_t size = 0;
+    db->rep->GetApproximateSizes(&r, 1, &size, flags);
+    return size;
+  };
+
+  // Bisect the key space between start and end using the approximate
+  // sizes, which are computed from the sstable index blocks (and
+  // memtable stats) without reading any data. The approximation is
+  // too coarse to be useful for small spans, in which case we fall
+  // back to the exact scan.
+  std::string lo = ToString(start.key);
+  std::string hi = ToString(end.key);
+  const int64_t total_size = approx_size(hi);
+  if (total_size <= target_size || total_size < (1 << 20)) {
+    return MVCCFindSplitKey(iter.get(), start, end, min_split, target_size, allow_meta2_splits,
+                            split_key);
+  }
+  const int64_t tolerance = target_size / 100;
+  // The estimated split point. If the bisection does not find a key
+  // within the tolerance of the target size, this is the largest key
+  // known to lie before the target.
+  std::string estimate;
+  for (int i = 0; i < kMaxSplitKeyBisections; ++i) {
+    const std::string mid = midpointKey(lo, hi);
+    if (mid <= lo || mid >= hi) {
+      break;
+    }
+    const int64_t size = approx_size(mid);
+    const int64_t diff = size > target_size ? size - target_size : target_size - size;
+    if (diff <= tolerance) {
+      estimate = mid;
+      break;
+    }
+    if (size < target_size) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  if (estimate.empty()) {
+    estimate = lo;
+  }
+
+  // Scan forward from the estimate for the first key which is a valid
+  // split key.
+  const rocksdb::Slice start_user_key = ToSlice(start.key);
+  const rocksdb::Slice min_split_key = ToSlice(min_split.key);
+  if (min_split_key.compare(estimate) > 0) {
+    estimate = min_split_key.ToString();
+  }
+  const std::string end_key = EncodeKey(end);
+  auto iter_rep = iter->rep.get();
+  iter_rep->Seek(EncodeKey(estimate, 0, 0));
+  for (int n = 0; n < kMaxSplitKeyWindow && iter_rep->Valid() &&
+                  kComparator.Compare(iter_rep->key(), end_key) < 0;
+       ++n, iter_rep->Next()) {
+    rocksdb::Slice decoded_key;
+    rocksdb::Slice ts;
+    if (!SplitKey(iter_rep->key(), &decoded_key, &ts)) {
+      return FmtStatus("unable to decode key");
+    }
+    if (decoded_key.compare(start_user_key) > 0 &&
+        IsValidSplitKey(decoded_key, allow_meta2_splits) &&
+        decoded_key.compare(min_split_key) >= 0) {
+      *split_key = ToDBString(decoded_key);
+      return kSuccess;
+    }
+  }
+  if (!iter_rep->status().ok()) {
+    return ToDBStatus(iter_rep->status());
+  }
+
+  // We didn't find a valid split key near the estimate. Fall back to
+  // the exact scan.
+  return MVCCFindSplitKey(iter.get(), start, end, min_split, target_size, allow_meta2_splits,
+                          split_key);
+}
+
 // kMaxItersBeforeSeek is the number of calls to iter->{Next,Prev}()
 // to perform when looking for the next/prev key or a particular
 // version before calling iter->Seek(). Note that mvccScanner makes
@@ -2545,42 +6305,68 @@ DBStatus MVCCFindSplitKey(DBIterator* iter, DBKey start, DBKey end, DBKey min_sp
 // [1,kMaxItersBeforeSeek].
 static const int kMaxItersBeforeSeek = 10;
 
+namespace {
+
+// The sampling period of the perf context attached to MVCCScan
+// results. See DBSetScanPerfSampling.
+std::atomic<int64_t> scan_perf_sample_every(0);
+
+// sampleScanPerf returns true if the current scan should be sampled.
+// The sampling decision is made using a per-thread counter so that
+// it does not contend between threads.
+bool sampleScanPerf() {
+  const int64_t every = scan_perf_sample_every.load(std::memory_order_relaxed);
+  if (every <= 0) {
+    return false;
+  }
+  thread_local int64_t scans = 0;
+  return ++scans % every == 0;
+}
+
+}  // namespace
+
 // mvccScanner implements the MVCCGet, MVCCScan and MVCCReverseScan
 // operations. Parameterizing the code on whether a forward or reverse
 // scan is performed allows the different code paths to be compiled
 // efficiently while still reusing the common code without difficulty.
 //
-// WARNING: Do not use iter_rep_->key() or iter_rep_->value()
-// directly, use cur_raw_key_, cur_key_, and cur_value instead. In
-// order to efficiently support reverse scans, we maintain a single
-// entry buffer that allows "peeking" at the previous key. But the
-// operation of "peeking" cause iter_rep_->{key,value}() to point to
-// different data than what the scanner class considers the "current"
-// key/value.
+// Reverse scans step the iterator back with Prev, using the same
+// adaptive iters_before_seek_ logic as forward scans, and fall back to
+// a SeekForPrev followed by a Seek to the latest version of the key
+// found (see iterSeekReverse). Rather than peeking at the previous
+// entry, which requires saving a copy of the current one, stepping
+// back past the latest version of a key is undone with a Next. So the
+// current key/value always reference the iterator's own buffers and
+// are never copied.
 template <bool reverse> class mvccScanner {
  public:
   mvccScanner(DBIterator* iter, DBSlice start, DBSlice end, DBTimestamp timestamp, int64_t max_keys,
-              DBTxn txn, bool consistent)
+              int64_t target_bytes, bool key_only, DBTxn txn, bool consistent)
       : iter_(iter),
         iter_rep_(iter->rep.get()),
         start_key_(ToSlice(start)),
         end_key_(ToSlice(end)),
         max_keys_(max_keys),
+        target_bytes_(target_bytes),
+        key_only_(key_only),
         timestamp_(timestamp),
         txn_id_(ToSlice(txn.id)),
         txn_epoch_(txn.epoch),
         txn_max_timestamp_(txn.max_timestamp),
         consistent_(consistent),
         check_uncertainty_(timestamp < txn.max_timestamp),
-        kvs_(new rocksdb::WriteBatch),
-        intents_(new rocksdb::WriteBatch),
-        peeked_(false),
-        iters_before_seek_(kMaxItersBeforeSeek / 2) {
+        kvs_(&iter->kvs),
+        intents_(&iter->intents),
+        limit_reached_(false),
+        bytes_reached_(false),
+        iters_before_seek_(kMaxItersBeforeSeek / 2),
+        num_seeks_(0),
+        num_nexts_(0) {
     memset(&results_, 0, sizeof(results_));
     results_.status = kSuccess;
 
-    iter_->kvs.reset();
-    iter_->intents.reset();
+    kvs_->Clear();
+    intents_->Clear();
   }
 
   // The MVCC data is sorted by key and descending timestamp. If a key
@@ -2622,14 +6408,37 @@ template <bool reverse> class mvccScanner {
   }
 
   const DBScanResults& scan() {
-    // TODO(peter): Remove this timing/debugging code.
-    // auto pctx = rocksdb::get_perf_context();
-    // pctx->Reset();
-    // auto start_time = std::chrono::steady_clock::now();
-    // auto elapsed = std::chrono::steady_clock::now() - start_time;
-    // auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
-    // printf("seek %d: %s\n", int(micros), pctx->ToString(true).c_str());
+    if (!sampleScanPerf()) {
+      return scanInternal();
+    }
 
+    // Enable the (thread local) RocksDB perf context for the duration
+    // of the scan, restoring the previous perf level afterwards.
+    const rocksdb::PerfLevel prev_level = rocksdb::GetPerfLevel();
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+    rocksdb::PerfContext* pctx = rocksdb::get_perf_context();
+    pctx->Reset();
+    const auto start_time = std::chrono::steady_clock::now();
+
+    scanInternal();
+
+    DBScanPerf* perf = &results_.perf;
+    perf->sampled = true;
+    perf->elapsed_nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start_time)
+                              .count();
+    perf->block_reads = pctx->block_read_count;
+    perf->block_cache_hits = pctx->block_cache_hit_count;
+    perf->internal_keys_skipped = pctx->internal_key_skipped_count;
+    perf->tombstones_skipped = pctx->internal_delete_skipped_count;
+    perf->seeks = num_seeks_;
+    perf->nexts = num_nexts_;
+    rocksdb::SetPerfLevel(prev_level);
+    return results_;
+  }
+
+ private:
+  const DBScanResults& scanInternal() {
     if (reverse) {
       if (!iterSeekReverse(EncodeKey(start_key_, 0, 0))) {
         return results_;
@@ -2650,10 +6459,144 @@ template <bool reverse> class mvccScanner {
       }
     }
 
+    if (limit_reached_ && results_.status.len == 0) {
+      rocksdb::Slice resume_key;
+      DBTimestamp ts;
+      if (DecodeKey(ResumeRawKey(), &resume_key, &ts)) {
+        results_.resume_key = ToDBSlice(resume_key);
+      }
+    }
+    return fillResults();
+  }
+
+ public:
+  // ResumeRawKey returns the encoded first key which did not fit
+  // within the limits of the scan, which is the last entry in the
+  // results if the scan stopped at max_keys.
+  rocksdb::Slice ResumeRawKey() const {
+    return bytes_reached_ ? rocksdb::Slice(iter_->resume_key) : kvs_->LastKey();
+  }
+
+  // scanSpans performs a forward scan over each of the supplied spans
+  // in order. The spans must be sorted and non-overlapping. The start
+  // and end keys the scanner was constructed with are ignored. The
+  // max_keys and target_bytes limits apply to the results of all of
+  // the spans together. Upon return, span_ends[i] holds the number of
+  // entries in the results belonging to spans [0,i] and *resume_span
+  // holds the index of the first span which was not completely
+  // scanned (or num_spans if every span was completely scanned).
+  //
+  // Rather than seeking to the start of each span, the iterator is
+  // stepped forward from the end of the previous span using the
+  // same adaptive iters_before_seek_ logic used to find the next key
+  // so that nearby spans are reached without paying for a seek.
+  const DBScanResults& scanSpans(const DBSpan* spans, int num_spans,
+                                 std::vector<int64_t>* span_ends, int* resume_span) {
+    static_assert(!reverse, "reverse multi-span scans are not supported");
+    span_ends->clear();
+    *resume_span = num_spans;
+
+    for (int i = 0; i < num_spans; ++i) {
+      start_key_ = ToSlice(spans[i].start);
+      end_key_ = ToSlice(spans[i].end);
+      const bool valid = (i == 0) ? iterSeek(EncodeKey(start_key_, 0, 0)) : stepToSpanStart();
+      if (valid) {
+        for (; cur_key_.compare(end_key_) < 0;) {
+          if (!getAndAdvance()) {
+            break;
+          }
+        }
+      }
+      span_ends->push_back(kvs_->Count());
+      if (limit_reached_ || results_.status.len > 0 ||
+          results_.uncertainty_timestamp != kZeroTimestamp) {
+        *resume_span = i;
+        break;
+      }
+    }
+    return fillResults();
+  }
+
+  // multiGet retrieves the values for each of the supplied keys. The
+  // keys are sorted (and de-duplicated) so that the lookups proceed
+  // in iterator order. For a total order iterator, the iterator
+  // position is shared between lookups: when the next key is close
+  // to the previous one the iterator is stepped forward instead of
+  // re-seeked. For a prefix iterator every lookup is a seek which
+  // allows RocksDB to consult the prefix bloom filter of each sstable
+  // and skip those which cannot contain the key. The results are
+  // returned in sorted key order. Keys which do not exist (or are
+  // deleted) at the read timestamp are omitted.
+  const DBScanResults& multiGet(const DBSlice* keys, int num_keys, bool prefix) {
+    static_assert(!reverse, "reverse multi-gets are not supported");
+    std::vector<rocksdb::Slice> sorted;
+    sorted.reserve(num_keys);
+    for (int i = 0; i < num_keys; ++i) {
+      sorted.push_back(ToSlice(keys[i]));
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const rocksdb::Slice& a, const rocksdb::Slice& b) { return a.compare(b) < 0; });
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      // Similar to get(), the empty end key ensures we don't retrieve a
+      // key different than the one being looked up.
+      start_key_ = sorted[i];
+      end_key_ = rocksdb::Slice();
+      const bool valid = (i == 0 || prefix) ? iterSeek(EncodeKey(start_key_, 0, 0))
+                                            : stepToSpanStart();
+      if (!valid) {
+        if (results_.status.len > 0) {
+          break;
+        }
+        if (prefix) {
+          // A prefix iterator is exhausted at the end of the key's
+          // prefix, the remaining keys may still exist.
+          continue;
+        }
+        // The iterator is exhausted, none of the remaining keys exist.
+        break;
+      }
+      if (cur_key_ == start_key_ && !getAndAdvance()) {
+        if (results_.status.len > 0 || results_.uncertainty_timestamp != kZeroTimestamp) {
+          break;
+        }
+      }
+    }
     return fillResults();
   }
 
  private:
+  // stepToSpanStart positions the iterator at the first key greater
+  // than or equal to start_key_ when moving from one span to the
+  // next during scanSpans and multiGet. Returns false if the iterator
+  // is exhausted or an error occurs.
+  bool stepToSpanStart() {
+    if (!iter_rep_->Valid()) {
+      // The iterator was exhausted by the previous span.
+      return false;
+    }
+    if (cur_key_.compare(start_key_) >= 0) {
+      // The previous span ended by advancing to a new key. The
+      // iterator is positioned at the first (i.e. most recent) version
+      // of that key which is exactly where a seek would land.
+      return true;
+    }
+
+    for (int i = 0; i < iters_before_seek_; ++i) {
+      if (!iterNext()) {
+        return false;
+      }
+      if (cur_key_.compare(start_key_) >= 0) {
+        iters_before_seek_ = std::min<int>(kMaxItersBeforeSeek, iters_before_seek_ + 1);
+        return true;
+      }
+    }
+
+    iters_before_seek_ = std::max<int>(1, iters_before_seek_ - 1);
+    return iterSeek(EncodeKey(start_key_, 0, 0));
+  }
+
   const DBScanResults& fillResults() {
     if (results_.status.len == 0) {
       if (kvs_->Count() > 0) {
@@ -2662,8 +6605,6 @@ template <bool reverse> class mvccScanner {
       if (intents_->Count() > 0) {
         results_.intents = ToDBSlice(intents_->Data());
       }
-      iter_->kvs.reset(kvs_.release());
-      iter_->intents.reset(intents_.release());
     }
     return results_;
   }
@@ -2814,26 +6755,37 @@ template <bool reverse> class mvccScanner {
     return iterSeek(key_buf_);
   }
 
-  // backwardLatestVersion backs up the iterator to the latest version
-  // for the specified key. The parameter i is used to maintain the
-  // iteration count between the loop here and the caller (usually
-  // prevKey). Returns false if an error occurred.
-  bool backwardLatestVersion(const rocksdb::Slice& key, int i) {
-    key_buf_.assign(key.data(), key.size());
+  // backwardLatestVersion backs up the iterator from a version of
+  // cur_key_ to the latest version of cur_key_. The parameter i is used
+  // to maintain the iteration count between the loop here and the
+  // caller (prevKey). Returns false if an error occurred.
+  bool backwardLatestVersion(int i) {
+    if (cur_timestamp_ == kZeroTimestamp || cur_key_.compare(end_key_) < 0) {
+      // An intent or inline value sorts before the versions of its key,
+      // and a key preceding the end of the scan is not read.
+      return true;
+    }
+    key_buf_.assign(cur_key_.data(), cur_key_.size());
 
     for (; i < iters_before_seek_; ++i) {
-      rocksdb::Slice peeked_key;
-      if (!iterPeekPrev(&peeked_key)) {
-        return false;
+      if (!iterPrev()) {
+        if (results_.status.len > 0) {
+          return false;
+        }
+        // The first entry of the key space is the latest version.
+        ++num_seeks_;
+        iter_rep_->SeekToFirst();
+        return updateCurrent();
       }
-      if (peeked_key != key_buf_) {
-        // The key changed which means the current key is the latest
-        // version.
-        iters_before_seek_ = std::max<int>(kMaxItersBeforeSeek, iters_before_seek_ + 1);
-        return true;
+      if (cur_key_ != key_buf_) {
+        // We stepped back past the latest version, which is the next
+        // entry.
+        iters_before_seek_ = std::min<int>(kMaxItersBeforeSeek, iters_before_seek_ + 1);
+        return iterNext();
       }
-      if (!iterPrev()) {
-        return false;
+      if (cur_timestamp_ == kZeroTimestamp) {
+        iters_before_seek_ = std::min<int>(kMaxItersBeforeSeek, iters_before_seek_ + 1);
+        return true;
       }
     }
 
@@ -2842,29 +6794,20 @@ template <bool reverse> class mvccScanner {
     return iterSeek(key_buf_);
   }
 
-  // prevKey backs up the iterator to point to the prev MVCC key less
-  // than the specified key. Returns false if the iterator is
-  // exhausted or an error occurs.
+  // prevKey backs up the iterator to point to the latest version of
+  // the prev MVCC key less than the specified key. Returns false if
+  // the iterator is exhausted or an error occurs.
   bool prevKey(const rocksdb::Slice& key) {
-    if (peeked_ && iter_rep_->key().compare(end_key_) < 0) {
-      // No need to look at the previous key if it is less than our
-      // end key.
-      return false;
-    }
-
     key_buf_.assign(key.data(), key.size());
 
     for (int i = 0; i < iters_before_seek_; ++i) {
-      rocksdb::Slice peeked_key;
-      if (!iterPeekPrev(&peeked_key)) {
-        return false;
-      }
-      if (peeked_key != key_buf_) {
-        return backwardLatestVersion(peeked_key, i + 1);
-      }
       if (!iterPrev()) {
+        // There is no previous key.
         return false;
       }
+      if (cur_key_ != key_buf_) {
+        return backwardLatestVersion(i + 1);
+      }
     }
 
     iters_before_seek_ = std::max<int>(1, iters_before_seek_ - 1);
@@ -2888,7 +6831,7 @@ template <bool reverse> class mvccScanner {
       // Iterating to the next key might have caused the iterator to
       // reach the end of the key space. If that happens, back up to
       // the very last key.
-      clearPeeked();
+      ++num_seeks_;
       iter_rep_->SeekToLast();
       if (!updateCurrent()) {
         return false;
@@ -2914,8 +6857,34 @@ template <bool reverse> class mvccScanner {
 
   bool addAndAdvance(const rocksdb::Slice& value) {
     if (value.size() > 0) {
-      kvs_->Put(cur_raw_key_, value);
+      if (target_bytes_ > 0 && kvs_->NumBytes() >= target_bytes_) {
+        // The results are full. Unlike the key following max_keys_, the
+        // key is not added to the results (so that its value is neither
+        // copied nor read from a blob file), but is only remembered as
+        // the resume key.
+        iter_->resume_key.assign(cur_raw_key_.data(), cur_raw_key_.size());
+        bytes_reached_ = true;
+        limit_reached_ = true;
+        return false;
+      }
+      if (key_only_) {
+        // Neither copy the value nor read it from a blob file.
+        kvs_->Put(cur_raw_key_, rocksdb::Slice());
+      } else {
+        rocksdb::Slice resolved = value;
+        const rocksdb::Status status =
+            ResolveBlobValue(iter_->blob_pin.store(), &resolved, &iter_->blob_value);
+        if (!status.ok()) {
+          return setStatus(ToDBStatus(status));
+        }
+        kvs_->Put(cur_raw_key_, resolved);
+      }
+      KeySampler* sampler = iter_->key_sampler;
+      if (sampler != nullptr && sampler->Sample()) {
+        sampler->Add(cur_key_);
+      }
       if (kvs_->Count() > max_keys_) {
+        limit_reached_ = true;
         return false;
       }
     }
@@ -2989,112 +6958,66 @@ template <bool reverse> class mvccScanner {
   // iterSeek positions the iterator at the first key that is greater
   // than or equal to key.
   bool iterSeek(const rocksdb::Slice& key) {
-    clearPeeked();
+    ++num_seeks_;
     iter_rep_->Seek(key);
     return updateCurrent();
   }
 
-  // iterSeekReverse positions the iterator at the last key that is
-  // less than key.
+  // iterSeekReverse positions the iterator at the latest version of
+  // the last MVCC key that is less than key.
   bool iterSeekReverse(const rocksdb::Slice& key) {
-    clearPeeked();
-
     // SeekForPrev positions the iterator at the key that is less than
     // key. NB: the doc comment on SeekForPrev suggests it positions
     // less than or equal, but this is a lie.
+    ++num_seeks_;
     iter_rep_->SeekForPrev(key);
     if (!updateCurrent()) {
       return false;
     }
     if (cur_timestamp_ == kZeroTimestamp) {
-      // We landed on an intent or inline value.
+      // We landed on an intent or inline value, which sorts before
+      // the versions of the key.
+      return true;
+    }
+    if (cur_key_.compare(end_key_) < 0) {
+      // The key precedes the end of the scan; there is no need to
+      // find its latest version.
       return true;
     }
 
-    // We landed on a versioned value, we need to back up to find the
+    // We landed on the oldest version of the key. Seeking to the key
+    // with a zero timestamp positions the iterator at its intent or
     // latest version.
-    return backwardLatestVersion(cur_key_, 0);
+    key_buf_.assign(cur_key_.data(), cur_key_.size());
+    key_buf_.append("\0", 1);
+    return iterSeek(key_buf_);
   }
 
   bool iterNext() {
-    if (reverse && peeked_) {
-      // If we had peeked at the previous entry, we need to advance
-      // the iterator twice to get to the real next entry.
-      peeked_ = false;
-      iter_rep_->Next();
-      if (!iter_rep_->Valid()) {
-        return false;
-      }
-    }
+    ++num_nexts_;
     iter_rep_->Next();
     return updateCurrent();
   }
 
   bool iterPrev() {
-    if (peeked_) {
-      peeked_ = false;
-      return updateCurrent();
-    }
+    ++num_nexts_;
     iter_rep_->Prev();
     return updateCurrent();
   }
 
-  // iterPeekPrev "peeks" at the previous key before the current
-  // iterator position.
-  bool iterPeekPrev(rocksdb::Slice *peeked_key) {
-    if (!peeked_) {
-      peeked_ = true;
-      // We need to save a copy of the current iterator key and value
-      // and adjust cur_raw_key_, cur_key and cur_value to point to
-      // this saved data. We use a single buffer for this purpose:
-      // saved_buf_.
-      saved_buf_.resize(0);
-      saved_buf_.reserve(cur_raw_key_.size() + cur_value_.size());
-      saved_buf_.append(cur_raw_key_.data(), cur_raw_key_.size());
-      saved_buf_.append(cur_value_.data(), cur_value_.size());
-      cur_raw_key_ = rocksdb::Slice(saved_buf_.data(), cur_raw_key_.size());
-      cur_value_ = rocksdb::Slice(saved_buf_.data() + cur_raw_key_.size(), cur_value_.size());
-      rocksdb::Slice dummy_timestamp;
-      if (!SplitKey(cur_raw_key_, &cur_key_, &dummy_timestamp)) {
-        return setStatus(FmtStatus("failed to split mvcc key"));
-      }
-
-      // With the current iterator state saved we can move the
-      // iterator to the previous entry.
-      iter_rep_->Prev();
-      if (!iter_rep_->Valid()) {
-        // Peeking at the previous key should never leave the iterator
-        // invalid. Instead, we seek back to the first key and set the
-        // peeked_key to the empty key. Note that this prevents using
-        // reverse scan to scan to the empty key.
-        peeked_ = false;
-        *peeked_key = rocksdb::Slice();
-        iter_rep_->SeekToFirst();
-        return updateCurrent();
-      }
-    }
-
-    rocksdb::Slice dummy_timestamp;
-    if (!SplitKey(iter_rep_->key(), peeked_key, &dummy_timestamp)) {
-      return setStatus(FmtStatus("failed to split mvcc key"));
-    }
-    return true;
-  }
-
-  // clearPeeked clears the peeked flag. This should be called before
-  // any iterator movement operations on iter_rep_.
-  void clearPeeked() {
-    if (reverse) {
-      peeked_ = false;
-    }
-  }
-
  public:
   DBIterator* const iter_;
   rocksdb::Iterator* const iter_rep_;
-  const rocksdb::Slice start_key_;
-  const rocksdb::Slice end_key_;
+  // The start and end keys are only modified by scanSpans.
+  rocksdb::Slice start_key_;
+  rocksdb::Slice end_key_;
   const int64_t max_keys_;
+  // If non-zero, the scan stops once the results occupy at least
+  // target_bytes_.
+  const int64_t target_bytes_;
+  // If true, the results hold empty values in place of the values of
+  // the keys. Intents are still returned in full.
+  const bool key_only_;
   const DBTimestamp timestamp_;
   const rocksdb::Slice txn_id_;
   const uint32_t txn_epoch_;
@@ -3102,31 +7025,36 @@ template <bool reverse> class mvccScanner {
   const bool consistent_;
   const bool check_uncertainty_;
   DBScanResults results_;
-  std::unique_ptr<rocksdb::WriteBatch> kvs_;
-  std::unique_ptr<rocksdb::WriteBatch> intents_;
+  // The result buffers are owned by iter_.
+  ScanResultBuffer* const kvs_;
+  ScanResultBuffer* const intents_;
   std::string key_buf_;
-  std::string saved_buf_;
-  bool peeked_;
+  // limit_reached_ is true if the scan stopped due to the max_keys_
+  // or target_bytes_ limits, and bytes_reached_ if it was the latter.
+  bool limit_reached_;
+  bool bytes_reached_;
   cockroach::storage::engine::enginepb::MVCCMetadata meta_;
-  // cur_raw_key_ holds either iter_rep_->key() or the saved value of
-  // iter_rep_->key() if we've peeked at the previous key (and peeked_
-  // is true).
+  // cur_raw_key_ holds iter_rep_->key().
   rocksdb::Slice cur_raw_key_;
   // cur_key_ is the decoded MVCC key, separated from the timestamp
   // suffix.
   rocksdb::Slice cur_key_;
-  // cur_value_ holds either iter_rep_->value() or the saved value of
-  // iter_rep_->value() if we've peeked at the previous key (and
-  // peeked_ is true).
+  // cur_value_ holds iter_rep_->value().
   rocksdb::Slice cur_value_;
   // cur_timestamp_ is the timestamp for a decoded MVCC key.
   DBTimestamp cur_timestamp_;
   int iters_before_seek_;
+  // The number of iterator seeks and steps (nexts and prevs) performed,
+  // reported by sampled scans.
+  int64_t num_seeks_;
+  int64_t num_nexts_;
 };
 
 typedef mvccScanner<false> mvccForwardScanner;
 typedef mvccScanner<true> mvccReverseScanner;
 
+void DBSetScanPerfSampling(int64_t every_n) { scan_perf_sample_every = every_n; }
+
 DBScanResults MVCCGet(DBIterator* iter, DBSlice key, DBTimestamp timestamp, DBTxn txn,
                       bool consistent) {
   // Get is implemented as a scan where we retrieve a single key. Note
@@ -3137,22 +7065,189 @@ DBScanResults MVCCGet(DBIterator* iter, DBSlice key, DBTimestamp timestamp, DBTx
   // We specify an empty key for the end key which will ensure we
   // don't retrieve a key different than the start key. This is a bit
   // of a hack.
+  LatencyTimer timer(iter->latency_stats, &LatencyStats::mvcc_get);
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->MVCCGet(traceIterID(iter), key, timestamp, consistent);
+  }
   const DBSlice end = {0, 0};
-  mvccForwardScanner scanner(iter, key, end, timestamp, 0 /* max_keys */, txn, consistent);
+  mvccForwardScanner scanner(iter, key, end, timestamp, 0 /* max_keys */, 0 /* target_bytes */,
+                             false /* key_only */, txn, consistent);
   return scanner.get();
 }
 
 DBScanResults MVCCScan(DBIterator* iter, DBSlice start, DBSlice end, DBTimestamp timestamp,
                        int64_t max_keys, DBTxn txn, bool consistent, bool reverse) {
+  return MVCCScanWithLimits(iter, start, end, timestamp, max_keys, 0 /* target_bytes */,
+                            false /* key_only */, txn, consistent, reverse);
+}
+
+DBScanResults MVCCScanWithLimits(DBIterator* iter, DBSlice start, DBSlice end,
+                                 DBTimestamp timestamp, int64_t max_keys, int64_t target_bytes,
+                                 bool key_only, DBTxn txn, bool consistent, bool reverse) {
+  LatencyTimer timer(iter->latency_stats, &LatencyStats::mvcc_scan);
+  if (iter->tracer != nullptr && iter->tracer->Enabled()) {
+    iter->tracer->MVCCScan(traceIterID(iter), start, end, timestamp, max_keys, consistent,
+                           reverse);
+  }
   if (reverse) {
-    mvccReverseScanner scanner(iter, end, start, timestamp, max_keys, txn, consistent);
+    mvccReverseScanner scanner(iter, end, start, timestamp, max_keys, target_bytes, key_only, txn,
+                               consistent);
     return scanner.scan();
   } else {
-    mvccForwardScanner scanner(iter, start, end, timestamp, max_keys, txn, consistent);
+    mvccForwardScanner scanner(iter, start, end, timestamp, max_keys, target_bytes, key_only, txn,
+                               consistent);
     return scanner.scan();
   }
 }
 
+DBScanResults MVCCMultiGet(DBIterator* iter, const DBSlice* keys, int num_keys,
+                           DBTimestamp timestamp, DBTxn txn, bool consistent) {
+  // Each key produces at most one result so the max_keys limit is
+  // never reached.
+  const DBSlice empty = {0, 0};
+  mvccForwardScanner scanner(iter, empty, empty, timestamp, num_keys, 0 /* target_bytes */,
+                             false /* key_only */, txn, consistent);
+  return scanner.multiGet(keys, num_keys, iter->prefix);
+}
+
+DBMVCCGetResults DBMVCCGet(DBEngine* db, DBSlice key, DBTimestamp timestamp, DBTxn txn,
+                           bool consistent) {
+  DBMVCCGetResults results;
+  memset(&results, 0, sizeof(results));
+  DBIterator* iter = DBNewPooledIter(db, true /* prefix */);
+  if (iter == nullptr) {
+    results.status = FmtStatus("unable to create iterator");
+    return results;
+  }
+  // The scan results are owned by the iterator, which is returned to
+  // the pool below, so they are copied out first.
+  const DBScanResults get = MVCCGet(iter, key, timestamp, txn, consistent);
+  results.status = get.status;
+  if (get.data.len > 0) {
+    results.data = ToDBString(ToSlice(get.data));
+  }
+  if (get.intents.len > 0) {
+    results.intents = ToDBString(ToSlice(get.intents));
+  }
+  results.uncertainty_timestamp = get.uncertainty_timestamp;
+  DBIterDestroy(iter);
+  return results;
+}
+
+DBReadQueue* DBNewReadQueue() { return new DBReadQueue; }
+
+void DBReleaseReadQueue(DBReadQueue* queue) {
+  for (auto& r : queue->done) {
+    free(r.status.data);
+    free(r.data.data);
+    free(r.intents.data);
+    free(r.resume_key.data);
+  }
+  delete queue;
+}
+
+DBStatus DBSubmitReads(DBEngine* db, const DBReadRequest* reqs, int num_reqs,
+                       DBReadQueue* queue) {
+  ReadPool* pool = db->GetReadPool();
+  if (pool == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  pool->Submit(reqs, num_reqs, queue);
+  return kSuccess;
+}
+
+int DBPollReads(DBReadQueue* queue, DBReadResult* results, int max_results,
+                int64_t timeout_nanos) {
+  return queue->Poll(results, max_results, std::chrono::nanoseconds(timeout_nanos));
+}
+
+DBStatus DBGetReadPoolStats(DBEngine* db, DBReadPoolStats* stats) {
+  ReadPool* pool = db->GetReadPool();
+  if (pool == nullptr) {
+    return FmtStatus("unsupported");
+  }
+  *stats = pool->Stats();
+  return kSuccess;
+}
+
+DBStatus DBQueryTimeSeries(DBIterator* iter, DBKey start, DBKey end, DBTimeSeriesQuery query,
+                           DBTimeSeriesQueryResults* results) {
+  memset(results, 0, sizeof(*results));
+  if (query.interval_nanos <= 0 || query.end_nanos <= query.start_nanos) {
+    return FmtStatus("invalid time series query interval");
+  }
+  const int64_t num_intervals =
+      (query.end_nanos - query.start_nanos - 1) / query.interval_nanos + 1;
+  if (num_intervals > kMaxTimeSeriesQueryIntervals) {
+    return FmtStatus("time series query has too many intervals: %lld", (long long)num_intervals);
+  }
+
+  timeSeriesQuery q(query, num_intervals);
+  const std::string end_key = EncodeKey(end.key, 0, 0);
+  rocksdb::Iterator* const iter_rep = iter->rep.get();
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  for (iter_rep->Seek(EncodeKey(start.key, 0, 0));
+       iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
+    rocksdb::Slice key;
+    DBTimestamp ts = kZeroTimestamp;
+    if (!DecodeKey(iter_rep->key(), &key, &ts)) {
+      return FmtStatus("unable to decode key");
+    }
+    // Time series data is always stored inline.
+    if (ts != kZeroTimestamp) {
+      continue;
+    }
+    const rocksdb::Slice value = iter_rep->value();
+    if (!meta.ParseFromArray(value.data(), value.size())) {
+      return FmtStatus("unable to decode MVCCMetadata");
+    }
+    if (!meta.has_raw_bytes()) {
+      continue;
+    }
+    DBStatus status = q.Add(key, meta.raw_bytes());
+    if (status.data != NULL) {
+      return status;
+    }
+  }
+  if (!iter_rep->status().ok()) {
+    return ToDBStatus(iter_rep->status());
+  }
+  q.Finish(results);
+  return kSuccess;
+}
+
+DBMultiScanResults MVCCScanSpans(DBIterator* iter, const DBSpan* spans, int num_spans,
+                                 DBTimestamp timestamp, int64_t max_keys, int64_t target_bytes,
+                                 DBTxn txn, bool consistent) {
+  DBMultiScanResults results;
+  memset(&results, 0, sizeof(results));
+  if (num_spans == 0) {
+    return results;
+  }
+
+  const DBSlice empty = {0, 0};
+  mvccForwardScanner scanner(iter, empty, empty, timestamp, max_keys, target_bytes,
+                             false /* key_only */, txn, consistent);
+  int resume_span;
+  const DBScanResults& r = scanner.scanSpans(spans, num_spans, &iter->span_ends, &resume_span);
+  results.status = r.status;
+  results.data = r.data;
+  results.intents = r.intents;
+  results.uncertainty_timestamp = r.uncertainty_timestamp;
+  results.span_ends = iter->span_ends.data();
+  results.num_span_ends = iter->span_ends.size();
+  results.resume_span = resume_span;
+  if (resume_span < num_spans && r.status.len == 0) {
+    // This is where the scan of resume_span should resume.
+    rocksdb::Slice resume_key;
+    DBTimestamp ts;
+    if (DecodeKey(scanner.ResumeRawKey(), &resume_key, &ts)) {
+      results.resume_key = ToDBSlice(resume_key);
+    }
+  }
+  return results;
+}
+
 // DBGetStats queries the given DBEngine for various operational stats and
 // write them to the provided DBStatsResult instance.
 DBStatus DBGetStats(DBEngine* db, DBStatsResult* stats) { return db->GetStats(stats); }
@@ -3163,12 +7258,13 @@ DBSSTable* DBGetSSTables(DBEngine* db, int* n) { return db->GetSSTables(n); }
 
 DBString DBGetUserProperties(DBEngine* db) { return db->GetUserProperties(); }
 
-DBStatus DBIngestExternalFile(DBEngine* db, DBSlice path, bool move_file) {
-  const std::vector<std::string> paths = {ToString(path)};
+namespace {
+
+rocksdb::IngestExternalFileOptions MakeIngestOptions(bool move_files) {
   rocksdb::IngestExternalFileOptions ingest_options;
   // If move_files is true and the env supports it, RocksDB will hard link.
   // Otherwise, it will copy.
-  ingest_options.move_files = move_file;
+  ingest_options.move_files = move_files;
   // If snapshot_consistency is true and there is an outstanding RocksDB
   // snapshot, a global sequence number is forced (see the allow_global_seqno
   // option).
@@ -3183,21 +7279,138 @@ DBStatus DBIngestExternalFile(DBEngine* db, DBSlice path, bool move_file) {
   // being ingested, this option is checked. If true, the memtable is flushed
   // and the ingest run. If false, an error is returned.
   ingest_options.allow_blocking_flush = true;
-  rocksdb::Status status = db->rep->IngestExternalFile(paths, ingest_options);
+  return ingest_options;
+}
+
+}  // namespace
+
+DBStatus DBIngestExternalFile(DBEngine* db, DBSlice path, bool move_file) {
+  // NB: the ingestion info recorded by the event listener is retrieved
+  // (and discarded) by DBIngestExternalFiles.
+  DBIngestedFile result;
+  return DBIngestExternalFiles(db, &path, 1, move_file, &result);
+}
+
+DBStatus DBIngestExternalFiles(DBEngine* db, const DBSlice* paths, int num_paths,
+                               bool move_files, DBIngestedFile* results) {
+  std::vector<std::string> files;
+  files.reserve(num_paths);
+  for (int i = 0; i < num_paths; i++) {
+    files.push_back(ToString(paths[i]));
+  }
+  // The sstables the files are ingested as are the live sstables which
+  // did not exist before.
+  std::vector<rocksdb::LiveFileMetaData> metadata;
+  db->rep->GetLiveFilesMetaData(&metadata);
+  std::set<std::string> existing;
+  for (const auto& m : metadata) {
+    existing.insert(m.name);
+  }
+  rocksdb::Status status;
+  {
+    BlobWriteGuard guard(db->GetBlobStore());
+    status = db->rep->IngestExternalFile(files, MakeIngestOptions(move_files));
+  }
   if (!status.ok()) {
     return ToDBStatus(status);
   }
 
+  std::map<std::string, int> index;
+  for (int i = 0; i < num_paths; i++) {
+    results[i].level = -1;
+    results[i].global_seqno = false;
+    index[files[i]] = i;
+  }
+  DBEventListener* listener = db->GetEventListener();
+  if (listener == nullptr) {
+    return kSuccess;
+  }
+
+  // The event listener is notified of each ingested file's internal
+  // file number and global sequence number before IngestExternalFile
+  // returns. Other new sstables were flushed, compacted or ingested
+  // concurrently (possibly from the same external paths), and the
+  // listener only hands out the ingestions from files.
+  const std::set<std::string> external_paths(files.begin(), files.end());
+  metadata.clear();
+  db->rep->GetLiveFilesMetaData(&metadata);
+  for (const auto& m : metadata) {
+    if (existing.count(m.name) > 0) {
+      continue;
+    }
+    std::string external_path;
+    uint64_t global_seqno;
+    if (!listener->TakeIngestedFile(DBEventListener::TableFileNumber(m.name), external_paths,
+                                    &external_path, &global_seqno)) {
+      continue;
+    }
+    DBIngestedFile& result = results[index[external_path]];
+    result.level = m.level;
+    result.global_seqno = global_seqno != 0;
+  }
   return kSuccess;
 }
 
+// kSstSinkFileName is the name under which a streaming
+// DBSstFileWriter writes to its SstSinkEnv.
+const char kSstSinkFileName[] = "sst-sink";
+
+// SstSinkEnv is the Env of a streaming DBSstFileWriter. Writes to
+// kSstSinkFileName accumulate in an in-memory buffer which the caller
+// drains as the sstable is built (see DBSstFileWriterTruncate), so
+// that only the data written since the last drain is held in memory.
+// All other files are passed through to the wrapped Env.
+class SstSinkEnv : public rocksdb::EnvWrapper {
+ public:
+  explicit SstSinkEnv(rocksdb::Env* base) : rocksdb::EnvWrapper(base) {}
+
+  rocksdb::Status NewWritableFile(const std::string& fname,
+                                  std::unique_ptr<rocksdb::WritableFile>* result,
+                                  const rocksdb::EnvOptions& options) override {
+    if (fname != kSstSinkFileName) {
+      return rocksdb::EnvWrapper::NewWritableFile(fname, result, options);
+    }
+    buffer.clear();
+    result->reset(new SinkFile(&buffer));
+    return rocksdb::Status::OK();
+  }
+
+  std::string buffer;
+
+ private:
+  class SinkFile : public rocksdb::WritableFile {
+   public:
+    explicit SinkFile(std::string* buffer) : buffer_(buffer) {}
+    rocksdb::Status Append(const rocksdb::Slice& data) override {
+      buffer_->append(data.data(), data.size());
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status Close() override { return rocksdb::Status::OK(); }
+    rocksdb::Status Flush() override { return rocksdb::Status::OK(); }
+    rocksdb::Status Sync() override { return rocksdb::Status::OK(); }
+
+   private:
+    std::string* const buffer_;
+  };
+};
+
 struct DBSstFileWriter {
   std::unique_ptr<rocksdb::Options> options;
   std::unique_ptr<rocksdb::Env> memenv;
+  // The Env of a writer created by DBSstFileWriterNewWithOptions (owned
+  // by memenv), or NULL for a writer created by DBSstFileWriterNew.
+  SstSinkEnv* sink;
+  // Is the sstable being written to a file (see
+  // DBSstFileWriterOpenFile)?
+  bool to_file;
   rocksdb::SstFileWriter rep;
 
-  DBSstFileWriter(rocksdb::Options* o, rocksdb::Env* m)
-      : options(o), memenv(m), rep(rocksdb::EnvOptions(), *o, o->comparator) {}
+  DBSstFileWriter(rocksdb::Options* o, rocksdb::Env* m, SstSinkEnv* s = nullptr)
+      : options(o),
+        memenv(m),
+        sink(s),
+        to_file(false),
+        rep(rocksdb::EnvOptions(), *o, o->comparator) {}
   virtual ~DBSstFileWriter() {}
 };
 
@@ -3227,11 +7440,57 @@ DBSstFileWriter* DBSstFileWriterNew() {
   return new DBSstFileWriter(options, memenv.release());
 }
 
+DBSstFileWriter* DBSstFileWriterNewWithOptions(DBSstFileWriterOptions opts) {
+  rocksdb::BlockBasedTableOptions table_options;
+  table_options.block_size = opts.block_size > 0 ? opts.block_size : 64 * 1024;
+  table_options.format_version = opts.format_version;
+  table_options.checksum = rocksdb::kCRC32c;
+
+  rocksdb::Options* options = new rocksdb::Options();
+  options->comparator = &kComparator;
+  options->compression = opts.compression ? rocksdb::kSnappyCompression : rocksdb::kNoCompression;
+  if (opts.bloom_bits_per_key > 0) {
+    // Match the bloom filters of the engine (see DBMakeOptions) so
+    // that they remain usable once the sstable is ingested.
+    table_options.filter_policy.reset(
+        rocksdb::NewBloomFilterPolicy(opts.bloom_bits_per_key, false /* !block_based */));
+    table_options.whole_key_filtering = false;
+    options->prefix_extractor.reset(new DBPrefixExtractor);
+  }
+  options->table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+  SstSinkEnv* sink = new SstSinkEnv(rocksdb::Env::Default());
+  options->env = sink;
+  return new DBSstFileWriter(options, sink, sink);
+}
+
 DBStatus DBSstFileWriterOpen(DBSstFileWriter* fw) {
-  rocksdb::Status status = fw->rep.Open("sst");
+  rocksdb::Status status = fw->rep.Open(fw->sink != nullptr ? kSstSinkFileName : "sst");
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  return kSuccess;
+}
+
+DBStatus DBSstFileWriterOpenFile(DBSstFileWriter* fw, DBSlice path) {
+  if (fw->sink == nullptr) {
+    return FmtStatus("writer does not support writing to a file");
+  }
+  rocksdb::Status status = fw->rep.Open(ToString(path));
   if (!status.ok()) {
     return ToDBStatus(status);
   }
+  fw->to_file = true;
+  return kSuccess;
+}
+
+DBStatus DBSstFileWriterTruncate(DBSstFileWriter* fw, DBString* data) {
+  if (fw->sink == nullptr || fw->to_file) {
+    return FmtStatus("writer does not support truncation");
+  }
+  *data = ToDBString(fw->sink->buffer);
+  // NB: clear retains the buffer's allocation for the next chunk.
+  fw->sink->buffer.clear();
   return kSuccess;
 }
 
@@ -3249,6 +7508,16 @@ DBStatus DBSstFileWriterFinish(DBSstFileWriter* fw, DBString* data) {
     return ToDBStatus(status);
   }
 
+  if (fw->sink != nullptr) {
+    // A streaming writer returns whatever has not been drained by
+    // DBSstFileWriterTruncate (nothing if writing to a file).
+    if (fw->to_file) {
+      *data = DBString();
+      return kSuccess;
+    }
+    return DBSstFileWriterTruncate(fw, data);
+  }
+
   uint64_t file_size;
   status = fw->memenv->GetFileSize("sst", &file_size);
   if (!status.ok()) {
@@ -3292,6 +7561,337 @@ DBStatus DBSstFileWriterFinish(DBSstFileWriter* fw, DBString* data) {
 
 void DBSstFileWriterClose(DBSstFileWriter* fw) { delete fw; }
 
+DBStatus DBExportToSst(DBEngine* engine, DBKey start, DBKey end, DBTimestamp start_ts,
+                       DBTimestamp end_ts, bool all_revisions, int64_t target_size,
+                       DBString* sst, DBString* resume_key) {
+  *sst = DBString();
+  *resume_key = DBString();
+
+  std::unique_ptr<DBIterator> iter(DBNewTimeBoundIter(engine, start_ts, end_ts));
+  if (iter == nullptr) {
+    return FmtStatus("unable to create iterator");
+  }
+  std::unique_ptr<DBSstFileWriter> fw(DBSstFileWriterNew());
+  DBStatus status = DBSstFileWriterOpen(fw.get());
+  if (status.data != NULL) {
+    return status;
+  }
+
+  const std::string end_key = EncodeKey(end.key, 0, 0);
+  rocksdb::Iterator* const iter_rep = iter->rep.get();
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  int64_t data_size = 0;
+  std::string cur_key;
+  bool skip_key = false;
+
+  for (iter_rep->Seek(EncodeKey(start.key, 0, 0));
+       iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end_key) < 0; iter_rep->Next()) {
+    rocksdb::Slice key;
+    DBTimestamp ts = kZeroTimestamp;
+    if (!DecodeKey(iter_rep->key(), &key, &ts)) {
+      return FmtStatus("unable to decode key");
+    }
+    if (key != cur_key) {
+      // Only stop at a key boundary so that all of the exported
+      // versions of a key are in the same sstable.
+      if (target_size > 0 && data_size >= target_size) {
+        *resume_key = ToDBString(key);
+        break;
+      }
+      cur_key.assign(key.data(), key.size());
+      skip_key = false;
+    } else if (skip_key) {
+      continue;
+    }
+
+    if (ts == kZeroTimestamp) {
+      const rocksdb::Slice value = iter_rep->value();
+      if (!meta.ParseFromArray(value.data(), value.size())) {
+        return FmtStatus("unable to decode MVCCMetadata");
+      }
+      if (meta.has_raw_bytes()) {
+        // Inline values are only used in non-user data which is not
+        // exported (see MVCCIncrementalIterator).
+        return FmtStatus("inline values are unsupported by export: %s",
+                         key.ToString(true).c_str());
+      }
+      // Like MVCCIncrementalIterator, only intents in (start_ts,
+      // end_ts] conflict with the export.
+      const DBTimestamp intent_ts = ToDBTimestamp(meta.timestamp());
+      if (meta.has_txn() && start_ts < intent_ts && intent_ts <= end_ts) {
+        return FmtStatus("conflicting intent on key %s", key.ToString(true).c_str());
+      }
+      continue;
+    }
+    if (end_ts < ts) {
+      continue;
+    }
+    if (ts <= start_ts) {
+      // This and any older versions predate the export.
+      skip_key = true;
+      continue;
+    }
+
+    rocksdb::Slice value = iter_rep->value();
+    if (!all_revisions) {
+      // Only the latest version is exported. Tombstones are only
+      // needed by incremental exports.
+      skip_key = true;
+      if (value.empty() && start_ts == kZeroTimestamp) {
+        continue;
+      }
+    }
+    rocksdb::Status s = ResolveBlobValue(iter->blob_pin.store(), &value, &iter->blob_value);
+    if (!s.ok()) {
+      return ToDBStatus(s);
+    }
+    s = fw->rep.Put(iter_rep->key(), value);
+    if (!s.ok()) {
+      return ToDBStatus(s);
+    }
+    data_size += iter_rep->key().size() + value.size();
+  }
+  if (!iter_rep->status().ok()) {
+    return ToDBStatus(iter_rep->status());
+  }
+
+  if (data_size == 0) {
+    return kSuccess;
+  }
+  return DBSstFileWriterFinish(fw.get(), sst);
+}
+
+namespace {
+
+// kExternalSstFileVersion is the table property RocksDB requires of
+// the sstables passed to IngestExternalFile.
+const char kExternalSstFileVersion[] = "rocksdb.external_sst_file.version";
+
+// spanExport implements DBExportSpanToSsts once the file deletions
+// have been disabled and the snapshot taken.
+class spanExport {
+ public:
+  spanExport(DBEngine* db, DBEngine* snap, rocksdb::SequenceNumber snap_seqno, bool can_link,
+             const std::string& start, const std::string& end, const std::string& dir)
+      : db_(db),
+        snap_(snap),
+        snap_seqno_(snap_seqno),
+        can_link_(can_link),
+        start_(start),
+        end_(end),
+        dir_(dir),
+        next_file_(0),
+        num_linked_(0),
+        linked_bytes_(0),
+        written_bytes_(0) {}
+
+  rocksdb::Status Run() {
+    rocksdb::Env* env = db_->rep->GetEnv();
+    rocksdb::Status status = env->CreateDirIfMissing(dir_);
+    if (!status.ok()) {
+      return status;
+    }
+
+    // The sstables which are entirely within the span and which can
+    // be ingested as is are hard linked, in key order. Everything
+    // else is rewritten.
+    std::vector<rocksdb::LiveFileMetaData> linked;
+    status = findLinkable(&linked);
+    if (!status.ok()) {
+      return status;
+    }
+    std::string gap_start = start_;
+    for (const auto& f : linked) {
+      const std::string path = nextPath();
+      if (!env->LinkFile(f.db_path + f.name, path).ok()) {
+        // E.g. the export directory is on another filesystem.
+        continue;
+      }
+      status = writeGap(gap_start, f.smallestkey, num_linked_ == 0 /* inclusive_start */);
+      if (!status.ok()) {
+        return status;
+      }
+      paths_.push_back(path);
+      ++num_linked_;
+      linked_bytes_ += f.size;
+      gap_start = f.largestkey;
+    }
+    return writeGap(gap_start, end_, num_linked_ == 0 /* inclusive_start */);
+  }
+
+  void Fill(DBSpanExport* result) {
+    result->num_paths = int(paths_.size());
+    result->paths = static_cast<DBString*>(malloc(paths_.size() * sizeof(DBString)));
+    for (size_t i = 0; i < paths_.size(); i++) {
+      result->paths[i] = ToDBString(paths_[i]);
+    }
+    result->num_linked = num_linked_;
+    result->linked_bytes = linked_bytes_;
+    result->written_bytes = written_bytes_;
+  }
+
+ private:
+  // findLinkable finds the sstables which can be hard linked: those
+  // within the span which were themselves ingested (and have not
+  // been compacted since), which only hold data visible at the
+  // snapshot and which no other sstable overlaps, so that they hold
+  // the latest version of every key in their bounds. The memtable has
+  // been flushed, so data visible at the snapshot is in sstables.
+  rocksdb::Status findLinkable(std::vector<rocksdb::LiveFileMetaData>* linked) {
+    if (!can_link_ || db_->GetBlobStore() != nullptr) {
+      // The sstables of an engine with a blob store may reference blob
+      // files.
+      return rocksdb::Status::OK();
+    }
+    std::vector<rocksdb::LiveFileMetaData> files;
+    db_->rep->GetLiveFilesMetaData(&files);
+    const rocksdb::Range range(start_, end_);
+    rocksdb::TablePropertiesCollection props;
+    rocksdb::Status status =
+        db_->rep->GetPropertiesOfTablesInRange(db_->rep->DefaultColumnFamily(), &range, 1, &props);
+    if (!status.ok()) {
+      return status;
+    }
+
+    for (const auto& f : files) {
+      if (kComparator.Compare(f.smallestkey, start_) < 0 ||
+          kComparator.Compare(f.largestkey, end_) >= 0 || f.largest_seqno > snap_seqno_) {
+        continue;
+      }
+      auto it = props.find(f.db_path + f.name);
+      if (it == props.end() || it->second->user_collected_properties.count(
+                                   kExternalSstFileVersion) == 0) {
+        continue;
+      }
+      bool overlaps = false;
+      for (const auto& g : files) {
+        if (g.name != f.name && kComparator.Compare(g.smallestkey, f.largestkey) <= 0 &&
+            kComparator.Compare(f.smallestkey, g.largestkey) <= 0) {
+          overlaps = true;
+          break;
+        }
+      }
+      if (!overlaps) {
+        linked->push_back(f);
+      }
+    }
+    std::sort(linked->begin(), linked->end(),
+              [](const rocksdb::LiveFileMetaData& a, const rocksdb::LiveFileMetaData& b) {
+                return kComparator.Compare(a.smallestkey, b.smallestkey) < 0;
+              });
+    return rocksdb::Status::OK();
+  }
+
+  // writeGap rewrites the keys visible at the snapshot after (or at,
+  // if inclusive_start) start and before end into a new sstable,
+  // unless there are none.
+  rocksdb::Status writeGap(const std::string& start, const std::string& end,
+                           bool inclusive_start) {
+    std::unique_ptr<DBIterator> iter(DBNewIter(snap_, false /* prefix */));
+    rocksdb::Iterator* const iter_rep = iter->rep.get();
+    iter_rep->Seek(start);
+    if (!inclusive_start && iter_rep->Valid() && iter_rep->key() == rocksdb::Slice(start)) {
+      iter_rep->Next();
+    }
+    if (!iter_rep->Valid() || kComparator.Compare(iter_rep->key(), end) >= 0) {
+      return iter_rep->status();
+    }
+
+    // The rewritten sstables are ingested into the same levels of the
+    // receiver, so match the engine's bloom filters.
+    DBSstFileWriterOptions opts = {};
+    opts.format_version = 2;
+    opts.compression = true;
+    opts.bloom_bits_per_key = 10;
+    std::unique_ptr<DBSstFileWriter> fw(DBSstFileWriterNewWithOptions(opts));
+    const std::string path = nextPath();
+    rocksdb::Status status = fw->rep.Open(path);
+    if (!status.ok()) {
+      return status;
+    }
+    for (; iter_rep->Valid() && kComparator.Compare(iter_rep->key(), end) < 0; iter_rep->Next()) {
+      rocksdb::Slice value = iter_rep->value();
+      status = ResolveBlobValue(iter->blob_pin.store(), &value, &iter->blob_value);
+      if (!status.ok()) {
+        return status;
+      }
+      status = fw->rep.Put(iter_rep->key(), value);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    if (!iter_rep->status().ok()) {
+      return iter_rep->status();
+    }
+    rocksdb::ExternalSstFileInfo info;
+    status = fw->rep.Finish(&info);
+    if (!status.ok()) {
+      return status;
+    }
+    paths_.push_back(path);
+    written_bytes_ += info.file_size;
+    return rocksdb::Status::OK();
+  }
+
+  std::string nextPath() {
+    char name[32];
+    snprintf(name, sizeof(name), "/%06d.sst", int(next_file_++));
+    return dir_ + name;
+  }
+
+  DBEngine* const db_;
+  DBEngine* const snap_;
+  const rocksdb::SequenceNumber snap_seqno_;
+  const bool can_link_;
+  const std::string start_;
+  const std::string end_;
+  const std::string dir_;
+  std::vector<std::string> paths_;
+  int next_file_;
+  int num_linked_;
+  int64_t linked_bytes_;
+  int64_t written_bytes_;
+};
+
+}  // namespace
+
+DBStatus DBExportSpanToSsts(DBEngine* db, DBKey start, DBKey end, DBSlice dir,
+                            DBSpanExport* result) {
+  memset(result, 0, sizeof(*result));
+  if (db->GetEventListener() == nullptr) {
+    return FmtStatus("unsupported");
+  }
+
+  // Like a checkpoint, keep the live sstables from being deleted and
+  // flush the memtable so that all of the data visible at the snapshot
+  // is in sstables.
+  rocksdb::Status status = db->rep->DisableFileDeletions();
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  DBEngine* snap = DBNewSnapshot(db);
+  const rocksdb::SequenceNumber snap_seqno =
+      static_cast<DBSnapshot*>(snap)->snapshot->GetSequenceNumber();
+  rocksdb::FlushOptions flush_opts;
+  flush_opts.wait = true;
+  status = db->rep->Flush(flush_opts);
+  if (status.ok()) {
+    // The sstables of in-memory and encrypted engines are not linked:
+    // they could not be read by the receiver.
+    DBImpl* impl = static_cast<DBImpl*>(db);
+    const bool can_link = impl->memenv == nullptr && impl->switching_env == nullptr;
+    spanExport e(db, snap, snap_seqno, can_link, EncodeKey(start), EncodeKey(end),
+                 ToString(dir));
+    status = e.Run();
+    if (status.ok()) {
+      e.Fill(result);
+    }
+  }
+  DBClose(snap);
+  db->rep->EnableFileDeletions(false /* force */);
+  return ToDBStatus(status);
+}
+
 namespace {
 
 class CockroachKeyFormatter : public rocksdb::SliceFormatter {
@@ -13,18 +13,27 @@
 // permissions and limitations under the License.
 
 #include <libroach.h>
+#include <memory>
 #include <rocksdb/comparator.h>
+#include <rocksdb/env.h>
 #include <rocksdb/iterator.h>
 #include <rocksdb/status.h>
 #include <rocksdb/write_batch.h>
 #include <rocksdb/write_batch_base.h>
 
 // DBOpenHook is called at the beginning of DBOpen. It can be implemented in CCL code.
-rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions opts);
+// If the store is encrypted, the hook sets *encrypted_env to an Env
+// layered on top of base_env which is used for new files.
+rocksdb::Status DBOpenHook(const std::string& db_dir, const DBOptions opts,
+                           rocksdb::Env* base_env, std::unique_ptr<rocksdb::Env>* encrypted_env);
 
 // ToDBSlice returns a DBSlice from a rocksdb::Slice
 DBSlice ToDBSlice(const rocksdb::Slice& s);
 
+// ToDBString returns a DBString, which the caller must free, holding
+// a copy of the contents of a rocksdb::Slice.
+DBString ToDBString(const rocksdb::Slice& s);
+
 // ToString returns a c++ string with the contents of a DBSlice.
 std::string ToString(DBSlice s);
 
@@ -36,12 +45,31 @@ std::string ToString(DBString s);
 // ordering as these keys do not sort lexicographically correctly.
 std::string EncodeKey(DBKey k);
 
+// ToDBKey decodes an encoded MVCC key. The returned key points into
+// the memory backing s and is empty if s cannot be decoded.
+DBKey ToDBKey(const rocksdb::Slice& s);
+
 // ToDBStatus converts a rocksdb Status to a DBStatus.
 DBStatus ToDBStatus(const rocksdb::Status& status);
 
 // FmtStatus formats the given arguments printf-style into a DBStatus.
 DBStatus FmtStatus(const char* fmt, ...);
 
+// DBGetEnv returns the Env through which the engine reads and writes
+// its files, which encrypts them on encrypted stores. The caller does
+// not assume ownership.
+rocksdb::Env* DBGetEnv(DBEngine* db);
+
+// DBGetRocksDB returns the RocksDB instance underlying the engine. The
+// caller does not assume ownership.
+rocksdb::DB* DBGetRocksDB(DBEngine* db);
+
+// SetTimeBoundIterTestingHook installs a function which
+// DBNewTimeBoundIter calls after reading the table properties and
+// before creating its memtable iterator, or removes it if hook is
+// NULL. For testing only.
+void SetTimeBoundIterTestingHook(void (*hook)(DBEngine* db));
+
 // CockroachComparator returns CockroachDB's custom mvcc-aware RocksDB
 // comparator. The caller does not assume ownership.
 const ::rocksdb::Comparator* CockroachComparator();
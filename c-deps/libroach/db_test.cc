@@ -12,19 +12,2832 @@
 // implied.  See the License for the specific language governing
 // permissions and limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <rocksdb/db.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
 #include "db.h"
+#include "encoding.h"
+#include "fmt.h"
 #include "include/libroach.h"
+#include "protos/roachpb/data.pb.h"
+#include "protos/roachpb/internal.pb.h"
+#include "protos/storage/engine/enginepb/mvcc.pb.h"
+#include "protos/storage/engine/enginepb/rocksdb.pb.h"
+#include "protos/util/hlc/legacy_timestamp.pb.h"
+#include "scan_results.h"
+#include "sha512.h"
 #include "testutils.h"
+#include "ts_columnar.h"
+
+namespace {
+
+// scanKeys returns the user keys of the entries in the scan results.
+std::vector<std::string> scanKeys(DBSlice data) {
+  std::vector<std::string> keys;
+  rocksdb::Slice buf(data.data, data.len);
+  uint32_t count;
+  if (!DecodeScanResultHeader(&buf, &count)) {
+    return keys;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    rocksdb::Slice key, value;
+    if (!DecodeScanResultEntry(&buf, &key, &value)) {
+      break;
+    }
+    keys.push_back(ToString(ToDBKey(key).key));
+  }
+  return keys;
+}
+
+void expectStatsEqual(const MVCCStatsResult& expected, const MVCCStatsResult& actual) {
+  EXPECT_EQ(expected.live_bytes, actual.live_bytes);
+  EXPECT_EQ(expected.key_bytes, actual.key_bytes);
+  EXPECT_EQ(expected.val_bytes, actual.val_bytes);
+  EXPECT_EQ(expected.intent_bytes, actual.intent_bytes);
+  EXPECT_EQ(expected.live_count, actual.live_count);
+  EXPECT_EQ(expected.key_count, actual.key_count);
+  EXPECT_EQ(expected.val_count, actual.val_count);
+  EXPECT_EQ(expected.intent_count, actual.intent_count);
+  EXPECT_EQ(expected.intent_age, actual.intent_age);
+  EXPECT_EQ(expected.gc_bytes_age, actual.gc_bytes_age);
+  EXPECT_EQ(expected.sys_bytes, actual.sys_bytes);
+  EXPECT_EQ(expected.sys_count, actual.sys_count);
+  EXPECT_EQ(expected.last_update_nanos, actual.last_update_nanos);
+}
+
+// sstEntries ingests the sstable into a new in-memory engine and
+// returns its entries formatted as <key>@<wall_time>=<value>.
+std::vector<std::string> sstEntries(const std::string& sst) {
+  std::vector<std::string> entries;
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  DBStatus status = DBOpen(&db, DBSlice(), db_opts);
+  EXPECT_EQ(nullptr, status.data);
+  if (status.data == nullptr) {
+    EXPECT_EQ(nullptr, DBEnvWriteFile(db, ToDBSlice("ingest.sst"), ToDBSlice(sst)).data);
+    EXPECT_EQ(nullptr, DBIngestExternalFile(db, ToDBSlice("ingest.sst"), true).data);
+    DBIterator* iter = DBNewIter(db, false);
+    for (DBIterState s = DBIterSeekToFirst(iter); s.valid; s = DBIterNext(iter, false)) {
+      entries.push_back(ToString(s.key.key) + "@" + std::to_string(s.key.wall_time) + "=" +
+                        ToString(s.value));
+    }
+    DBIterDestroy(iter);
+    DBClose(db);
+  }
+  DBReleaseCache(db_opts.cache);
+  return entries;
+}
+
+}  // namespace
 
 TEST(Libroach, DBOpenHook) {
   DBOptions db_opts;
+  std::unique_ptr<rocksdb::Env> encrypted_env;
 
   // Try an empty extra_options.
   db_opts.extra_options = ToDBSlice("");
-  EXPECT_OK(DBOpenHook("", db_opts));
+  EXPECT_OK(DBOpenHook("", db_opts, rocksdb::Env::Default(), &encrypted_env));
 
   // Try extra_options with anything at all.
   db_opts.extra_options = ToDBSlice("blah");
-  EXPECT_ERR(DBOpenHook("", db_opts),
+  EXPECT_ERR(DBOpenHook("", db_opts, rocksdb::Env::Default(), &encrypted_env),
              "DBOptions has extra_options, but OSS code cannot handle them");
 }
+
+TEST(Libroach, ComparatorSeparators) {
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  auto key = [](const std::string& k, int64_t wall_time, int32_t logical) {
+    return EncodeKey(DBKey{ToDBSlice(k), wall_time, logical});
+  };
+
+  struct SeparatorTest {
+    std::string start;
+    std::string limit;
+    std::string expected;
+  };
+  const std::vector<SeparatorTest> separatorTests = {
+      // Different user keys which can be shortened.
+      {key("abcdef", 10, 1), key("abzz", 5, 0), key("abd", 0, 0)},
+      {key("a", 10, 0), key("c", 0, 0), key("b", 0, 0)},
+      // Adjacent bytes can't be shortened.
+      {key("abc", 10, 0), key("abd", 10, 0), key("abc", 10, 0)},
+      // A user key which is a prefix of the other can't be shortened.
+      {key("ab", 10, 0), key("abc", 10, 0), key("ab", 10, 0)},
+      // Versions of the same user key can't be shortened.
+      {key("abc", 10, 0), key("abc", 5, 0), key("abc", 10, 0)},
+  };
+  for (auto& t : separatorTests) {
+    std::string sep = t.start;
+    cmp->FindShortestSeparator(&sep, t.limit);
+    EXPECT_EQ(t.expected, sep);
+    EXPECT_LE(cmp->Compare(t.start, sep), 0);
+    EXPECT_LT(cmp->Compare(sep, t.limit), 0);
+  }
+
+  struct SuccessorTest {
+    std::string key;
+    std::string expected;
+  };
+  const std::vector<SuccessorTest> successorTests = {
+      {key("abc", 10, 0), key("b", 0, 0)},
+      {key("\xff\xff" "a", 10, 0), key("\xff\xff" "b", 0, 0)},
+      {key("\xff\xff", 10, 0), key("\xff\xff", 10, 0)},
+      // Already as short as possible.
+      {key("a", 0, 0), key("a", 0, 0)},
+  };
+  for (auto& t : successorTests) {
+    std::string succ = t.key;
+    cmp->FindShortSuccessor(&succ);
+    EXPECT_EQ(t.expected, succ);
+    EXPECT_LE(cmp->Compare(t.key, succ), 0);
+  }
+}
+
+TEST(Libroach, QueryTimeSeries) {
+  const int64_t kSecond = 1000000000;
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write two hours of 10s samples of the series "cpu" for the sources
+  // "1" and "2", one key per hour. The samples of source "2" are twice
+  // those of source "1".
+  auto dataKey = [](const std::string& source, int64_t slot) {
+    std::string key("\x04tsd", 4);
+    EncodeBytesAscending(&key, "cpu");
+    EncodeVarintAscending(&key, 1);
+    EncodeVarintAscending(&key, slot);
+    return key + source;
+  };
+  for (int64_t slot = 0; slot < 2; slot++) {
+    for (int source = 1; source <= 2; source++) {
+      cockroach::roachpb::InternalTimeSeriesData ts;
+      ts.set_start_timestamp_nanos(slot * 3600 * kSecond);
+      ts.set_sample_duration_nanos(10 * kSecond);
+      for (int i = 0; i < 360; i++) {
+        cockroach::roachpb::InternalTimeSeriesSample* sample = ts.add_samples();
+        sample->set_offset(i);
+        sample->set_sum(source * (i % 6));
+        sample->set_count(1);
+      }
+      std::string raw_bytes(5, '\0');
+      raw_bytes[4] = cockroach::roachpb::TIMESERIES;
+      ts.AppendToString(&raw_bytes);
+      cockroach::storage::engine::enginepb::MVCCMetadata meta;
+      meta.set_raw_bytes(raw_bytes);
+      const std::string key = dataKey(std::to_string(source), slot);
+      ASSERT_EQ(nullptr,
+                DBPut(db, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+    }
+  }
+
+  // Query 90 minutes starting half an hour in, at 1m intervals.
+  const std::string start = dataKey("", 0);
+  const std::string end = dataKey("", 2);
+  struct queryTest {
+    DBTimeSeriesAggregator aggregator;
+    double expected;
+  };
+  const std::vector<queryTest> tests = {
+      {TimeSeriesAggregatorSum, 15},  {TimeSeriesAggregatorAvg, 2.5},
+      {TimeSeriesAggregatorMax, 5},   {TimeSeriesAggregatorMin, 0},
+      {TimeSeriesAggregatorLast, 5},
+  };
+  for (const auto& t : tests) {
+    DBIterator* iter = DBNewIter(db, false);
+    DBTimeSeriesQuery query = {1800 * kSecond, 7200 * kSecond, 60 * kSecond, t.aggregator};
+    DBTimeSeriesQueryResults results;
+    ASSERT_EQ(nullptr,
+              DBQueryTimeSeries(iter, DBKey{ToDBSlice(start), 0, 0},
+                                DBKey{ToDBSlice(end), 0, 0}, query, &results)
+                  .data);
+    DBIterDestroy(iter);
+
+    ASSERT_EQ(2, results.num_series);
+    ASSERT_EQ(90, results.num_intervals);
+    for (int i = 0; i < results.num_series; i++) {
+      DBTimeSeries* s = &results.series[i];
+      EXPECT_EQ("cpu", std::string(s->name.data, s->name.len));
+      EXPECT_EQ(std::to_string(i + 1), std::string(s->source.data, s->source.len));
+      EXPECT_EQ(1, s->resolution);
+      for (int j = 0; j < results.num_intervals; j++) {
+        EXPECT_EQ((i + 1) * t.expected, s->values[j]);
+      }
+      free(s->name.data);
+      free(s->source.data);
+      free(s->values);
+    }
+    free(results.series);
+  }
+
+  // Intervals without samples are NaN.
+  DBIterator* iter = DBNewIter(db, false);
+  DBTimeSeriesQuery query = {7000 * kSecond, 7400 * kSecond, 300 * kSecond,
+                             TimeSeriesAggregatorAvg};
+  DBTimeSeriesQueryResults results;
+  ASSERT_EQ(nullptr, DBQueryTimeSeries(iter, DBKey{ToDBSlice(start), 0, 0},
+                                       DBKey{ToDBSlice(end), 0, 0}, query, &results)
+                         .data);
+  DBIterDestroy(iter);
+  ASSERT_EQ(2, results.num_series);
+  ASSERT_EQ(2, results.num_intervals);
+  for (int i = 0; i < results.num_series; i++) {
+    EXPECT_FALSE(std::isnan(results.series[i].values[0]));
+    EXPECT_TRUE(std::isnan(results.series[i].values[1]));
+    free(results.series[i].name.data);
+    free(results.series[i].source.data);
+    free(results.series[i].values);
+  }
+  free(results.series);
+
+  // The number of intervals is bounded across all of the series: each
+  // series may return 2^19+1 intervals, but the two may not.
+  iter = DBNewIter(db, false);
+  query = {0, (1 << 19) + 1, 1, TimeSeriesAggregatorAvg};
+  DBStatus status = DBQueryTimeSeries(iter, DBKey{ToDBSlice(start), 0, 0},
+                                      DBKey{ToDBSlice(dataKey("2", 0)), 0, 0}, query, &results);
+  EXPECT_EQ(nullptr, status.data);
+  EXPECT_EQ(1, results.num_series);
+  free(results.series[0].name.data);
+  free(results.series[0].source.data);
+  free(results.series[0].values);
+  free(results.series);
+  status = DBQueryTimeSeries(iter, DBKey{ToDBSlice(start), 0, 0}, DBKey{ToDBSlice(end), 0, 0},
+                             query, &results);
+  EXPECT_NE(nullptr, status.data);
+  free(status.data);
+  DBIterDestroy(iter);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, CacheOptions) {
+  // Invalid options are rejected.
+  DBCache* cache;
+  DBCacheOptions cache_opts = {};
+  cache_opts.num_shard_bits = 30;
+  EXPECT_NE(nullptr, DBNewCacheWithOptions(&cache, 1 << 20, cache_opts).data);
+  cache_opts = {};
+  cache_opts.high_pri_pool_ratio = 1.5;
+  EXPECT_NE(nullptr, DBNewCacheWithOptions(&cache, 1 << 20, cache_opts).data);
+
+  // Engines using a cache with a high priority pool store their index
+  // and filter blocks in it.
+  cache_opts = {};
+  cache_opts.high_pri_pool_ratio = 0.25;
+  ASSERT_EQ(nullptr, DBNewCacheWithOptions(&cache, 64 << 20, cache_opts).data);
+  DBOptions db_opts = {};
+  db_opts.cache = cache;
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("1")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+
+  // The flushed L0 file's index and filter blocks are pinned in the
+  // cache.
+  DBStatsResult stats;
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_GT(stats.block_cache_pinned_usage, 0);
+
+  DBClose(db);
+  DBReleaseCache(cache);
+}
+
+TEST(Libroach, GroupCommit) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Commit batches from several threads concurrently.
+  const int kThreads = 8;
+  const int kBatches = 50;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([db, t] {
+      for (int i = 0; i < kBatches; i++) {
+        DBEngine* batch = DBNewBatch(db, true);
+        const std::string key = std::to_string(t) + "-" + std::to_string(i);
+        EXPECT_EQ(nullptr, DBPut(batch, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(key)).data);
+        EXPECT_EQ(nullptr, DBPut(batch, DBKey{ToDBSlice(key + "x"), 0, 0}, ToDBSlice(key)).data);
+        EXPECT_EQ(nullptr, DBCommitAndCloseBatchGrouped(db, batch).data);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < kBatches; i++) {
+      const std::string key = std::to_string(t) + "-" + std::to_string(i);
+      for (auto k : {key, key + "x"}) {
+        DBString result = {};
+        ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice(k), 0, 0}, &result).data);
+        EXPECT_EQ(key, std::string(result.data, result.len));
+        free(result.data);
+      }
+    }
+  }
+
+  DBGroupCommitStats stats;
+  ASSERT_EQ(nullptr, DBGetGroupCommitStats(db, &stats).data);
+  EXPECT_EQ(kThreads * kBatches, stats.group_size.sum);
+  EXPECT_LE(stats.group_size.count, kThreads * kBatches);
+  EXPECT_EQ(stats.group_size.count, stats.sync_latency_nanos.count);
+
+  // Empty batches are closed without being committed; batches and
+  // snapshots cannot perform grouped commits.
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatchGrouped(db, DBNewBatch(db, false)).data);
+  DBEngine* snap = DBNewSnapshot(db);
+  EXPECT_NE(nullptr, DBCommitAndCloseBatchGrouped(db, snap).data);
+  EXPECT_NE(nullptr, DBGetGroupCommitStats(snap, &stats).data);
+  DBClose(snap);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, BatchPool) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  const DBKey key = {ToDBSlice("a"), 0, 0};
+  for (bool write_only : {false, true}) {
+    DBEngine* batch = DBNewBatch(db, write_only);
+    ASSERT_EQ(nullptr, DBPut(batch, key, ToDBSlice("value")).data);
+    DBBatchReset(batch);
+    EXPECT_EQ(12, DBBatchRepr(batch).len);
+    ASSERT_EQ(nullptr, DBPut(batch, key, ToDBSlice("value")).data);
+    DBClose(batch);
+
+    // The closed batch is reused, and is empty.
+    DBEngine* reused = DBNewBatch(db, write_only);
+    EXPECT_EQ(batch, reused);
+    EXPECT_EQ(12, DBBatchRepr(reused).len);
+    if (!write_only) {
+      DBString value = {};
+      ASSERT_EQ(nullptr, DBGet(reused, key, &value).data);
+      EXPECT_EQ(nullptr, value.data);
+    }
+    DBClose(reused);
+  }
+
+  // A batch whose repr grew beyond kMaxPooledBatchBytes is not pooled,
+  // even if it was reset since. Had it been pooled, it would be reused
+  // before the small batch closed ahead of it.
+  for (bool write_only : {false, true}) {
+    DBEngine* small = DBNewBatch(db, write_only);
+    DBEngine* large = DBNewBatch(db, write_only);
+    ASSERT_EQ(nullptr, DBPut(large, key, ToDBSlice(std::string(2 << 20, 'x'))).data);
+    DBBatchReset(large);
+    DBClose(small);
+    DBClose(large);
+    DBEngine* reused = DBNewBatch(db, write_only);
+    EXPECT_EQ(small, reused);
+    DBClose(reused);
+  }
+
+  // A batch may be closed after its engine, in which case it is deleted
+  // rather than returned to the pool.
+  DBEngine* batch = DBNewBatch(db, false);
+  ASSERT_EQ(nullptr, DBPut(batch, key, ToDBSlice("value")).data);
+  DBClose(db);
+  DBClose(batch);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, IterPool) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  const DBKey a = {ToDBSlice("a"), 0, 0};
+  const DBKey b = {ToDBSlice("b"), 0, 0};
+  ASSERT_EQ(nullptr, DBPut(db, a, ToDBSlice("1")).data);
+
+  DBIterator* iter = DBNewPooledIter(db, false);
+  EXPECT_FALSE(DBIterSeek(iter, b).valid);
+
+  // A refreshed iterator sees subsequent writes.
+  ASSERT_EQ(nullptr, DBPut(db, b, ToDBSlice("2")).data);
+  EXPECT_FALSE(DBIterSeek(iter, b).valid);
+  ASSERT_EQ(nullptr, DBIterRefresh(iter).data);
+  EXPECT_TRUE(DBIterSeek(iter, b).valid);
+  DBIterDestroy(iter);
+
+  // The destroyed iterator is reused for the same mode, and sees the
+  // latest writes.
+  const DBKey c = {ToDBSlice("c"), 0, 0};
+  ASSERT_EQ(nullptr, DBPut(db, c, ToDBSlice("3")).data);
+  DBIterator* prefix = DBNewPooledIter(db, true);
+  EXPECT_NE(iter, prefix);
+  DBIterator* reused = DBNewPooledIter(db, false);
+  EXPECT_EQ(iter, reused);
+  EXPECT_TRUE(DBIterSeek(reused, c).valid);
+  DBIterDestroy(reused);
+  DBIterDestroy(prefix);
+
+  // Snapshot iterators cannot be refreshed.
+  DBEngine* snap = DBNewSnapshot(db);
+  DBIterator* snap_iter = DBNewPooledIter(snap, false);
+  EXPECT_NE(nullptr, DBIterRefresh(snap_iter).data);
+  DBIterDestroy(snap_iter);
+  DBClose(snap);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, LatencyStats) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Operations on batches, snapshots and iterators are recorded in the
+  // histograms of the engine they were created on.
+  DBEngine* batch = DBNewBatch(db, false);
+  ASSERT_EQ(nullptr, DBPut(batch, DBKey{ToDBSlice("a"), 0, 0}, ToDBSlice("1")).data);
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+  ASSERT_EQ(nullptr, DBSyncWAL(db).data);
+
+  DBEngine* snap = DBNewSnapshot(db);
+  DBIterator* iter = DBNewIter(snap, false);
+  DBIterSeek(iter, DBKey{ToDBSlice("a"), 0, 0});
+  DBIterSeek(iter, DBKey{ToDBSlice("b"), 0, 0});
+  DBIterDestroy(iter);
+  DBClose(snap);
+
+  DBLatencyStats stats;
+  ASSERT_EQ(nullptr, DBGetLatencyStats(db, &stats).data);
+  EXPECT_EQ(1, stats.commit_batch.count);
+  EXPECT_EQ(1, stats.sync_wal.count);
+  EXPECT_EQ(2, stats.iter_seek.count);
+  EXPECT_EQ(0, stats.mvcc_scan.count);
+  EXPECT_EQ(0, stats.apply_batch_repr.count);
+  EXPECT_GT(stats.commit_batch.max, 0);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, HotKeys) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+  DBHotKeys hot;
+  DBStatus status = DBGetHotKeys(db, DBSlice(), DBSlice(), &hot);
+  EXPECT_NE(nullptr, status.data);
+  free(status.data);
+  DBClose(db);
+
+  db_opts.key_sample_rate = 1;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Both the committed writes and the reads (through a snapshot) are
+  // sampled.
+  DBEngine* batch = DBNewBatch(db, false);
+  for (auto key : {"a", "b", "c", "d"}) {
+    ASSERT_EQ(nullptr, DBPut(batch, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(key)).data);
+  }
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+  DBEngine* snap = DBNewSnapshot(db);
+  const DBTxn txn = {};
+  for (int i = 0; i < 10; i++) {
+    DBMVCCGetResults results = DBMVCCGet(snap, ToDBSlice("b"), DBTimestamp{2, 0}, txn, true);
+    ASSERT_EQ(nullptr, results.status.data);
+    free(results.data.data);
+  }
+  DBClose(snap);
+
+  ASSERT_EQ(nullptr, DBGetHotKeys(db, DBSlice(), DBSlice(), &hot).data);
+  EXPECT_EQ(14, hot.samples);
+  ASSERT_EQ(4, hot.num_keys);
+  EXPECT_EQ("a", ToString(hot.keys[0].key));
+  EXPECT_EQ("b", ToString(hot.keys[1].key));
+  EXPECT_GE(hot.keys[1].accesses, 11);
+  // Splitting before b would leave most of the load on the right.
+  EXPECT_EQ("c", ToString(hot.split_key));
+  for (int i = 0; i < hot.num_keys; i++) {
+    free(hot.keys[i].key.data);
+  }
+  free(hot.keys);
+  free(hot.split_key.data);
+
+  ASSERT_EQ(nullptr, DBGetHotKeys(db, ToDBSlice("c"), ToDBSlice("d"), &hot).data);
+  ASSERT_EQ(1, hot.num_keys);
+  EXPECT_EQ("c", ToString(hot.keys[0].key));
+  EXPECT_EQ(0, hot.split_key.len);
+  free(hot.keys[0].key.data);
+  free(hot.keys);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, TombstoneCompaction) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.tombstone_compaction_density = 0.5;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  auto key = [](int i) { return fmt::StringPrintf("k%03d", i); };
+  auto numTables = [db]() {
+    int n;
+    DBSSTable* tables = DBGetSSTables(db, &n);
+    for (int i = 0; i < n; i++) {
+      free(tables[i].start_key.key.data);
+      free(tables[i].end_key.key.data);
+    }
+    free(tables);
+    return n;
+  };
+  // waitForCompactions waits until n tombstone compactions have
+  // completed and none are pending.
+  auto waitForCompactions = [db](int64_t n) {
+    DBTombstoneCompactionStats stats;
+    for (int i = 0; i < 1000; i++) {
+      EXPECT_EQ(nullptr, DBGetTombstoneCompactionStats(db, &stats).data);
+      if (stats.compactions >= n && stats.pending == 0) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(stats.compactions, n);
+    EXPECT_EQ(0, stats.pending);
+    return stats;
+  };
+
+  // Point deletions of all of the keys of an sstable.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key(i)), 1, 0}, ToDBSlice("value")).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(nullptr, DBDelete(db, DBKey{ToDBSlice(key(i)), 1, 0}).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  DBTombstoneCompactionStats stats = waitForCompactions(1);
+  EXPECT_GT(stats.reclaimed_bytes, 0);
+  EXPECT_EQ(0, numTables());
+
+  // A range deletion.
+  for (int i = 100; i < 200; i++) {
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key(i)), 1, 0}, ToDBSlice("value")).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr,
+            DBDeleteRange(db, DBKey{ToDBSlice("k1"), 0, 0}, DBKey{ToDBSlice("k2"), 0, 0}).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  waitForCompactions(2);
+  EXPECT_EQ(0, numTables());
+
+  // A range deletion of a single key of an sstable deletes too little of
+  // it to be worth compacting.
+  for (int i = 200; i < 300; i++) {
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key(i)), 1, 0}, ToDBSlice("value")).data);
+  }
+  ASSERT_EQ(nullptr, DBDeleteRange(db, DBKey{ToDBSlice(key(250)), 0, 0},
+                                   DBKey{ToDBSlice(key(251)), 0, 0})
+                         .data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  stats = waitForCompactions(2);
+  EXPECT_EQ(2, stats.compactions);
+  EXPECT_EQ(1, numTables());
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, ScanPerfSampling) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write some versioned keys and delete half of them.
+  for (int i = 0; i < 10; i++) {
+    const std::string key = "k" + std::to_string(i);
+    const DBKey k = {ToDBSlice(key), 1, 0};
+    ASSERT_EQ(nullptr, DBPut(db, k, ToDBSlice("value")).data);
+    if (i % 2 == 0) {
+      ASSERT_EQ(nullptr, DBDelete(db, k).data);
+    }
+  }
+
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  DBIterator* iter = DBNewIter(db, false);
+  DBScanResults results =
+      MVCCScan(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 100, txn, true, false);
+  ASSERT_EQ(nullptr, results.status.data);
+  EXPECT_FALSE(results.perf.sampled);
+
+  DBSetScanPerfSampling(1);
+  results = MVCCScan(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 100, txn, true, false);
+  DBSetScanPerfSampling(0);
+  ASSERT_EQ(nullptr, results.status.data);
+  EXPECT_TRUE(results.perf.sampled);
+  EXPECT_GT(results.perf.tombstones_skipped, 0);
+  EXPECT_GE(results.perf.seeks, 1);
+  EXPECT_GE(results.perf.nexts, 5);
+  EXPECT_GT(results.perf.elapsed_nanos, 0);
+
+  DBIterDestroy(iter);
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCScanWithLimits) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  const std::string value(100, 'v');
+  for (int i = 0; i < 10; i++) {
+    const std::string key = "k" + std::to_string(i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+  }
+
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  DBIterator* iter = DBNewIter(db, false);
+
+  // The scan stops at the first key after the results exceed 250
+  // bytes, i.e. after three entries, and returns that key without
+  // adding it to the results.
+  for (bool reverse : {false, true}) {
+    DBScanResults results = MVCCScanWithLimits(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 100, 250,
+                                               false, txn, true, reverse);
+    ASSERT_EQ(nullptr, results.status.data);
+    rocksdb::Slice buf(results.data.data, results.data.len);
+    uint32_t count;
+    ASSERT_TRUE(DecodeScanResultHeader(&buf, &count));
+    EXPECT_EQ(3, count);
+    EXPECT_EQ(reverse ? "k6" : "k3", ToString(results.resume_key));
+  }
+
+  // max_keys also sets the resume key, which is the extra entry in the
+  // results.
+  DBScanResults results = MVCCScanWithLimits(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 5, 0,
+                                             false, txn, true, false);
+  ASSERT_EQ(nullptr, results.status.data);
+  EXPECT_EQ("k5", ToString(results.resume_key));
+  {
+    rocksdb::Slice buf(results.data.data, results.data.len);
+    uint32_t count;
+    ASSERT_TRUE(DecodeScanResultHeader(&buf, &count));
+    EXPECT_EQ(6, count);
+  }
+
+  // Spans share the byte limit; the scan of the span in which it is
+  // reached resumes from the first key which did not fit.
+  const DBSpan spans[] = {{ToDBSlice("k0"), ToDBSlice("k2")}, {ToDBSlice("k4"), ToDBSlice("k8")}};
+  DBMultiScanResults multi = MVCCScanSpans(iter, spans, 2, ts, 100, 250, txn, true);
+  ASSERT_EQ(nullptr, multi.status.data);
+  EXPECT_EQ(1, multi.resume_span);
+  ASSERT_EQ(2, multi.num_span_ends);
+  EXPECT_EQ(2, multi.span_ends[0]);
+  EXPECT_EQ(3, multi.span_ends[1]);
+  EXPECT_EQ("k5", ToString(multi.resume_key));
+
+  // A key-only scan returns every key with an empty value.
+  results = MVCCScanWithLimits(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 100, 250, true, txn, true,
+                               false);
+  ASSERT_EQ(nullptr, results.status.data);
+  EXPECT_EQ(0, results.resume_key.len);
+  rocksdb::Slice buf(results.data.data, results.data.len);
+  uint32_t count;
+  ASSERT_TRUE(DecodeScanResultHeader(&buf, &count));
+  ASSERT_EQ(10, count);
+  for (uint32_t i = 0; i < count; i++) {
+    rocksdb::Slice key, val;
+    ASSERT_TRUE(DecodeScanResultEntry(&buf, &key, &val));
+    EXPECT_TRUE(val.empty());
+  }
+
+  DBIterDestroy(iter);
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCReverseScan) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Keys k0-k9 have i+1 versions, split between an sstable and the
+  // memtable, and every third key also has an inline value.
+  for (int i = 0; i < 10; i++) {
+    const std::string key = "k" + std::to_string(i);
+    for (int v = 1; v <= i + 1; v++) {
+      const std::string value = key + "@" + std::to_string(v);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), v, 0}, ToDBSlice(value)).data);
+    }
+    if (i % 3 == 0) {
+      cockroach::storage::engine::enginepb::MVCCMetadata meta;
+      meta.set_raw_bytes("inline");
+      ASSERT_EQ(nullptr,
+                DBPut(db, DBKey{ToDBSlice(key + "/inline"), 0, 0},
+                      ToDBSlice(meta.SerializeAsString()))
+                    .data);
+    }
+    if (i == 4) {
+      ASSERT_EQ(nullptr, DBFlush(db).data);
+    }
+  }
+
+  // scanKeys returns the keys and values of a scan in key order.
+  auto scanKeys = [](const DBScanResults& results) {
+    std::vector<std::string> kvs;
+    rocksdb::Slice buf(results.data.data, results.data.len);
+    uint32_t count;
+    EXPECT_TRUE(DecodeScanResultHeader(&buf, &count));
+    for (uint32_t i = 0; i < count; i++) {
+      rocksdb::Slice key, val;
+      EXPECT_TRUE(DecodeScanResultEntry(&buf, &key, &val));
+      kvs.push_back(key.ToString() + "=" + val.ToString());
+    }
+    return kvs;
+  };
+
+  const DBTxn txn = {};
+  DBIterator* iter = DBNewIter(db, false);
+  for (int64_t wall : {1, 3, 6, 20}) {
+    const DBTimestamp ts = {wall, 0};
+    for (auto span : {std::make_pair("a", "z"), std::make_pair("k2", "k7"),
+                      std::make_pair("k3/inline", "k6/inline")}) {
+      const DBSlice start = ToDBSlice(span.first);
+      const DBSlice end = ToDBSlice(span.second);
+      DBScanResults results = MVCCScan(iter, start, end, ts, 100, txn, true, false);
+      ASSERT_EQ(nullptr, results.status.data);
+      std::vector<std::string> forward = scanKeys(results);
+      results = MVCCScan(iter, start, end, ts, 100, txn, true, true);
+      ASSERT_EQ(nullptr, results.status.data);
+      std::vector<std::string> reverse = scanKeys(results);
+      std::reverse(reverse.begin(), reverse.end());
+      EXPECT_EQ(forward, reverse) << span.first << "-" << span.second << "@" << wall;
+    }
+  }
+
+  // A limited reverse scan returns k9/inline and k9, resuming at k8.
+  DBScanResults results =
+      MVCCScan(iter, ToDBSlice("a"), ToDBSlice("z"), DBTimestamp{20, 0}, 2, txn, true, true);
+  ASSERT_EQ(nullptr, results.status.data);
+  EXPECT_EQ("k8", ToString(results.resume_key));
+
+  DBIterDestroy(iter);
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, DBMVCCGet) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write two versions of one key in separate sstables and a key which
+  // is only in the memtable.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("1")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 3, 0}, ToDBSlice("3")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("b"), 1, 0}, ToDBSlice("b")).data);
+
+  const DBTxn txn = {};
+  DBIterator* iter = DBNewIter(db, true);
+  for (int i = 0; i < 2; i++) {
+    for (auto key : {"a", "b", "c"}) {
+      for (int64_t wall : {0, 2, 4}) {
+        const DBTimestamp ts = {wall, 0};
+        DBMVCCGetResults results = DBMVCCGet(db, ToDBSlice(key), ts, txn, true);
+        ASSERT_EQ(nullptr, results.status.data);
+        const DBScanResults expected = MVCCGet(iter, ToDBSlice(key), ts, txn, true);
+        EXPECT_EQ(ToString(expected.data), ToString(results.data)) << key << "@" << wall;
+        EXPECT_EQ(0, results.intents.len);
+        free(results.data.data);
+      }
+    }
+  }
+  DBIterDestroy(iter);
+
+  // Write-only batches cannot be read.
+  DBEngine* batch = DBNewBatch(db, true);
+  DBMVCCGetResults results = DBMVCCGet(batch, ToDBSlice("a"), DBTimestamp{4, 0}, txn, true);
+  EXPECT_NE(nullptr, results.status.data);
+  free(results.status.data);
+  DBClose(batch);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, TraceReplay) {
+  // The trace is written and read through the engine's env, so the
+  // engines are on disk rather than in (separate) memenvs.
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  const std::string db_dir = dir + "/libroach-trace-record";
+  const std::string replay_dir = dir + "/libroach-trace-replay-db";
+  const std::string trace_path = dir + "/libroach-trace-replay";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(db_dir)).data);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(replay_dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(db_dir), db_opts).data);
+
+  // A key written before the trace starts is in the checkpoint taken
+  // at its start.
+  const DBKey j = {ToDBSlice("j"), 1, 0};
+  ASSERT_EQ(nullptr, DBPut(db, j, ToDBSlice("before")).data);
+
+  // An iterator used before the trace starts is recorded as a new
+  // iterator when it is first used in the trace.
+  const DBKey k = {ToDBSlice("k"), 1, 0};
+  DBIterator* iter = DBNewIter(db, false);
+  EXPECT_FALSE(DBIterSeek(iter, k).valid);
+  ASSERT_EQ(nullptr, DBStartTrace(db, ToDBSlice(trace_path), ToDBSlice(replay_dir)).data);
+  EXPECT_NE(nullptr, DBStartTrace(db, ToDBSlice(trace_path), DBSlice()).data);
+
+  // Write a key through a committed batch and read it back.
+  DBEngine* batch = DBNewBatch(db, false);
+  ASSERT_EQ(nullptr, DBPut(batch, k, ToDBSlice("value")).data);
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+  ASSERT_EQ(nullptr, DBIterRefresh(iter).data);
+
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  ASSERT_EQ(nullptr, MVCCScan(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 10, txn, true, false)
+                         .status.data);
+  EXPECT_TRUE(DBIterSeek(iter, k).valid);
+  EXPECT_FALSE(DBIterNext(iter, false).valid);
+  DBIterDestroy(iter);
+
+  // The next iterator may reuse the address of the destroyed one, but
+  // is recorded (and replayed) as a distinct iterator.
+  iter = DBNewIter(db, true);
+  EXPECT_TRUE(DBIterSeek(iter, k).valid);
+  DBIterDestroy(iter);
+  ASSERT_EQ(nullptr, DBStopTrace(db).data);
+  DBClose(db);
+
+  // Replaying the trace against the checkpoint recreates the key
+  // written during the trace, and every read is made on an iterator
+  // created by the replay.
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(replay_dir), db_opts).data);
+  DBTraceReplayStats stats;
+  ASSERT_EQ(nullptr, DBReplayTrace(db, ToDBSlice(trace_path), 0, &stats).data);
+  // The commit, the new, scan, seek, next and destroy of the first
+  // iterator and the new, seek and destroy of the second. The refresh
+  // precedes the first use of the iterator in the trace and is not
+  // recorded: the replayed iterator is created after the commit.
+  EXPECT_EQ(9, stats.records);
+  EXPECT_EQ(0, stats.errors);
+  EXPECT_EQ(1, stats.commit_batch.count);
+  EXPECT_EQ(1, stats.mvcc_scan.count);
+  EXPECT_EQ(2, stats.iter_seek.count);
+  EXPECT_EQ(1, stats.iter_next.count);
+
+  DBString value;
+  ASSERT_EQ(nullptr, DBGet(db, k, &value).data);
+  EXPECT_EQ("value", ToString(value));
+  free(value.data);
+  ASSERT_EQ(nullptr, DBGet(db, j, &value).data);
+  EXPECT_EQ("before", ToString(value));
+  free(value.data);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+  rocksdb::Env::Default()->DeleteFile(trace_path);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(db_dir)).data);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(replay_dir)).data);
+}
+
+TEST(Libroach, CompressionStats) {
+  // By default every level, L0 included, is compressed with snappy.
+  for (auto compression : {DBCompressionDefault, DBCompressionNone}) {
+    SCOPED_TRACE(compression);
+    DBOptions db_opts = {};
+    db_opts.cache = DBNewCache(1 << 20);
+    db_opts.num_cpu = 1;
+    db_opts.max_open_files = -1;
+    db_opts.level_compression[0] = compression;
+    DBEngine* db;
+    ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+    // Write highly compressible values and flush them to L0.
+    const std::string value(1000, 'v');
+    for (int i = 0; i < 100; i++) {
+      const std::string key = "k" + std::to_string(i);
+      const DBKey k = {ToDBSlice(key), 1, 0};
+      ASSERT_EQ(nullptr, DBPut(db, k, ToDBSlice(value)).data);
+    }
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+
+    DBStatsResult stats;
+    ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+    EXPECT_GE(stats.compaction_levels[0].raw_bytes, int64_t(100 * value.size()));
+    EXPECT_GT(stats.compaction_levels[0].data_bytes, 0);
+    if (compression == DBCompressionNone) {
+      EXPECT_GT(stats.compaction_levels[0].data_bytes * 2, stats.compaction_levels[0].raw_bytes);
+    } else {
+      EXPECT_LT(stats.compaction_levels[0].data_bytes * 10, stats.compaction_levels[0].raw_bytes);
+    }
+
+    DBClose(db);
+    DBReleaseCache(db_opts.cache);
+  }
+}
+
+TEST(Libroach, WriteStallStats) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Slow down writes once there are two L0 files, before the L0 files
+  // are compacted.
+  ASSERT_OK(DBGetRocksDB(db)->SetOptions({
+      {"level0_file_num_compaction_trigger", "8"},
+      {"level0_slowdown_writes_trigger", "2"},
+  }));
+  for (int i = 0; i < 2; i++) {
+    const std::string key = "k" + std::to_string(i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value")).data);
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+  }
+
+  // The stall is reported by a background thread once the second flush
+  // has been installed.
+  DBStatsResult stats;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+    if (stats.write_stalls > 0) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(1, stats.write_stalls);
+  EXPECT_EQ(0, stats.write_stops);
+  EXPECT_GT(stats.write_stall_nanos, 0);
+  EXPECT_EQ(2, stats.l0_file_count);
+  EXPECT_GT(stats.flush_bytes, 0);
+  EXPECT_EQ(2, stats.flushes);
+
+  // Compacting the L0 files into the bottommost level ends the stall.
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_EQ(1, stats.write_stalls);
+  EXPECT_EQ(0, stats.l0_file_count);
+  EXPECT_GE(stats.compaction_levels[6].compactions, 1);
+  EXPECT_GT(stats.compaction_levels[6].input_bytes, 0);
+  EXPECT_GT(stats.compaction_levels[6].output_bytes, 0);
+  EXPECT_GE(stats.compaction_levels[6].duration_micros.count, 1);
+  for (int level = 1; level < 6; level++) {
+    EXPECT_EQ(0, stats.compaction_levels[level].compactions);
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, CompressionZSTD) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-compression-zstd";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.level_compression[0] = DBCompressionZSTD;
+  db_opts.bottommost_compression = DBCompressionZSTD;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  const std::string value(1000, 'v');
+  for (int i = 0; i < 100; i++) {
+    const std::string key = "k" + std::to_string(i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  DBClose(db);
+
+  // DBOpen fails if RocksDB was built without zstd support. Check that
+  // the sstable was actually compressed with it as well.
+  rocksdb::Options options;
+  options.comparator = CockroachComparator();
+  rocksdb::DB* rep;
+  ASSERT_OK(rocksdb::DB::OpenForReadOnly(options, dir, &rep));
+  rocksdb::TablePropertiesCollection props;
+  ASSERT_OK(rep->GetPropertiesOfAllTables(&props));
+  EXPECT_EQ(1, props.size());
+  for (const auto& p : props) {
+    EXPECT_EQ("ZSTD", p.second->compression_name);
+  }
+  delete rep;
+
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, IntentIter) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write an sstable without intents to the bottom level and flush one
+  // with an intent on "c" (a single L0 file does not trigger a
+  // compaction).
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("value")).data);
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.mutable_txn()->set_key("c");
+  meta.mutable_timestamp()->set_wall_time(2);
+  ASSERT_EQ(nullptr,
+            DBPut(db, DBKey{ToDBSlice("c"), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("c"), 2, 0}, ToDBSlice("value")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+
+  struct iterTest {
+    std::string start;
+    std::string end;
+    int64_t tables_read;
+    std::vector<std::string> keys;
+  };
+  const std::vector<iterTest> tests = {
+      {"", "", 1, {"c", "c"}},
+      {"b", "d", 1, {"c", "c"}},
+      {"c", "", 1, {"c", "c"}},
+      {"", "c", 0, {}},
+      {"d", "", 0, {}},
+  };
+  for (const auto& t : tests) {
+    const DBIntentIterStats before = DBGetIntentIterStats();
+    DBIterator* iter = DBNewIntentIter(db, ToDBSlice(t.start), ToDBSlice(t.end));
+    std::vector<std::string> keys;
+    for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+         state = DBIterNext(iter, false)) {
+      keys.push_back(ToString(state.key.key));
+    }
+    DBIterDestroy(iter);
+    const DBIntentIterStats after = DBGetIntentIterStats();
+    EXPECT_EQ(t.keys, keys);
+    EXPECT_EQ(t.tables_read, after.tables_read - before.tables_read);
+    EXPECT_EQ(2 - t.tables_read, after.tables_skipped - before.tables_skipped);
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, IntentIterResolved) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // intentKeys returns the unversioned keys returned by an intent
+  // iterator over all keys.
+  auto intentKeys = [db]() {
+    std::vector<std::string> keys;
+    DBIterator* iter = DBNewIntentIter(db, DBSlice(), DBSlice());
+    for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+         state = DBIterNext(iter, false)) {
+      if (state.key.wall_time == 0 && state.key.logical == 0) {
+        keys.push_back(ToString(state.key.key));
+      }
+    }
+    DBIterDestroy(iter);
+    return keys;
+  };
+
+  // Write intents on "b" and "c" to an sstable in the bottom level.
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.mutable_txn()->set_key("b");
+  meta.mutable_timestamp()->set_wall_time(2);
+  for (auto key : {"b", "c"}) {
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 2, 0}, ToDBSlice("value")).data);
+  }
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  EXPECT_EQ(std::vector<std::string>({"b", "c"}), intentKeys());
+
+  // Resolve the intent on "b" by deleting its metadata and flush the
+  // deletion to an sstable without intents (a single L0 file does not
+  // trigger a compaction). The newer sstable must be read or the
+  // resolved intent comes back.
+  ASSERT_EQ(nullptr, DBDelete(db, DBKey{ToDBSlice("b"), 0, 0}).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  EXPECT_EQ(std::vector<std::string>({"c"}), intentKeys());
+
+  // Likewise when the intent is replaced by non-transactional
+  // metadata.
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  cockroach::storage::engine::enginepb::MVCCMetadata inline_meta;
+  inline_meta.set_raw_bytes("inline");
+  const std::string inline_value = inline_meta.SerializeAsString();
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("c"), 0, 0}, ToDBSlice(inline_value)).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  EXPECT_EQ(std::vector<std::string>(), intentKeys());
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, SSTCatalog) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-sst-catalog";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("1")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  DBClose(db);
+
+  // checkTables verifies that the sstables and their user properties
+  // are both reported, with the expected timestamps, and returns the
+  // number of sstables.
+  auto checkTables = [](DBEngine* db, int64_t max_wall_time) {
+    int n;
+    DBSSTable* tables = DBGetSSTables(db, &n);
+    for (int i = 0; i < n; i++) {
+      free(tables[i].start_key.key.data);
+      free(tables[i].end_key.key.data);
+    }
+    free(tables);
+
+    DBString props = DBGetUserProperties(db);
+    cockroach::storage::engine::enginepb::SSTUserPropertiesCollection all;
+    EXPECT_TRUE(all.ParseFromArray(props.data, props.len));
+    free(props.data);
+    EXPECT_EQ("", all.error());
+    EXPECT_EQ(n, all.sst_size());
+    int64_t wall_time = 0;
+    for (const auto& sst : all.sst()) {
+      EXPECT_EQ(1, sst.ts_min().wall_time());
+      wall_time = std::max<int64_t>(wall_time, sst.ts_max().wall_time());
+    }
+    EXPECT_EQ(max_wall_time, wall_time);
+    return n;
+  };
+
+  // The properties of sstables written before the engine was opened
+  // are read on first use, those of flushed and compacted sstables are
+  // recorded as they are written.
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  EXPECT_EQ(1, checkTables(db, 1));
+  EXPECT_EQ(1, checkTables(db, 1));
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("b"), 2, 0}, ToDBSlice("2")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  // The two L0 sstables may already have been compacted.
+  EXPECT_GE(checkTables(db, 2), 1);
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  EXPECT_EQ(1, checkTables(db, 2));
+
+  DBClose(db);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, FastOpen) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-fast-open";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+
+  // A new store has nothing to open or replay.
+  DBOpenStats stats;
+  ASSERT_EQ(nullptr, DBGetOpenStats(db, &stats).data);
+  EXPECT_GT(stats.total_nanos, 0);
+  EXPECT_EQ(0, stats.tables_opened);
+  EXPECT_EQ(stats.total_nanos,
+            stats.manifest_nanos + stats.table_open_nanos + stats.wal_replay_nanos);
+
+  // Leave one flushed sstable and a write which is only in the WAL.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("1")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("b"), 1, 0}, ToDBSlice("2")).data);
+  DBClose(db);
+
+  db_opts.fast_open = true;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  ASSERT_EQ(nullptr, DBGetOpenStats(db, &stats).data);
+  EXPECT_EQ(1, stats.tables_opened);
+  EXPECT_GE(stats.wal_files, 1);
+  EXPECT_EQ(stats.total_nanos,
+            stats.manifest_nanos + stats.table_open_nanos + stats.wal_replay_nanos);
+  EXPECT_GT(stats.wal_replay_nanos, 0);
+  DBString value;
+  ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice("b"), 1, 0}, &value).data);
+  EXPECT_EQ("2", ToString(value));
+  free(value.data);
+
+  // Batches have no startup timing.
+  DBEngine* batch = DBNewBatch(db, false);
+  EXPECT_NE(nullptr, DBGetOpenStats(batch, &stats).data);
+  DBClose(batch);
+
+  DBClose(db);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, ExportSpanToSsts) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-export-span";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+
+  // ingest writes the keys to an sstable and ingests it.
+  auto ingest = [&dir](DBEngine* db, const std::string& name, std::vector<std::string> keys) {
+    const std::string path = dir + "-" + name + ".sst";
+    DBSstFileWriter* fw = DBSstFileWriterNewWithOptions(DBSstFileWriterOptions());
+    ASSERT_EQ(nullptr, DBSstFileWriterOpenFile(fw, ToDBSlice(path)).data);
+    for (const auto& key : keys) {
+      ASSERT_EQ(nullptr,
+                DBSstFileWriterAdd(fw, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(key)).data);
+    }
+    DBString data;
+    ASSERT_EQ(nullptr, DBSstFileWriterFinish(fw, &data).data);
+    DBSstFileWriterClose(fw);
+    ASSERT_EQ(nullptr, DBIngestExternalFile(db, ToDBSlice(path), true).data);
+  };
+  // countKeys returns the number of keys in the engine.
+  auto countKeys = [](DBEngine* db) {
+    int n = 0;
+    DBIterator* iter = DBNewIter(db, false);
+    for (DBIterState state = DBIterSeekToFirst(iter); state.valid;
+         state = DBIterNext(iter, false)) {
+      n++;
+    }
+    DBIterDestroy(iter);
+    return n;
+  };
+  // exportAndIngest exports [l, o) and ingests the sstables into a new
+  // engine, returning the number of linked sstables and the number of
+  // keys received.
+  auto exportAndIngest = [&](int* num_linked, int* num_keys) {
+    const std::string export_dir = dir + "-export";
+    DBSpanExport result;
+    ASSERT_EQ(nullptr, DBExportSpanToSsts(db, DBKey{ToDBSlice("l"), 0, 0},
+                                          DBKey{ToDBSlice("o"), 0, 0}, ToDBSlice(export_dir),
+                                          &result)
+                           .data);
+    *num_linked = result.num_linked;
+    std::vector<DBSlice> paths;
+    for (int i = 0; i < result.num_paths; i++) {
+      paths.push_back(ToDBSlice(result.paths[i]));
+    }
+    DBOptions recv_opts = db_opts;
+    DBEngine* recv;
+    ASSERT_EQ(nullptr, DBOpen(&recv, DBSlice(), recv_opts).data);
+    std::vector<DBIngestedFile> ingested(paths.size());
+    ASSERT_EQ(nullptr, DBIngestExternalFiles(recv, paths.data(), int(paths.size()), false,
+                                             ingested.data())
+                           .data);
+    *num_keys = countKeys(recv);
+    DBClose(recv);
+    for (int i = 0; i < result.num_paths; i++) {
+      rocksdb::Env::Default()->DeleteFile(ToString(result.paths[i]));
+      free(result.paths[i].data);
+    }
+    free(result.paths);
+  };
+
+  // The two ingested sstables are linked and the flushed key (and the
+  // keys outside the span) rewritten.
+  ingest(db, "m", {"m0", "m1", "m2", "m3", "m4", "m5", "m6", "m7", "m8", "m9"});
+  ingest(db, "n", {"n1", "n2"});
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 1, 0}, ToDBSlice("a")).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("l1"), 1, 0}, ToDBSlice("l1")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  int num_linked, num_keys;
+  exportAndIngest(&num_linked, &num_keys);
+  EXPECT_EQ(2, num_linked);
+  EXPECT_EQ(13, num_keys);
+
+  // A newer version of a key in the first sstable, which is only in
+  // the memtable, keeps it from being linked.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("m5"), 2, 0}, ToDBSlice("m5@2")).data);
+  exportAndIngest(&num_linked, &num_keys);
+  EXPECT_EQ(1, num_linked);
+  EXPECT_EQ(14, num_keys);
+
+  DBClose(db);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, IngestExternalFiles) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // writeSst writes an sstable holding the keys to path.
+  auto writeSst = [db](const std::string& path, std::vector<std::string> keys) {
+    DBSstFileWriter* fw = DBSstFileWriterNew();
+    ASSERT_EQ(nullptr, DBSstFileWriterOpen(fw).data);
+    for (const auto& key : keys) {
+      ASSERT_EQ(nullptr,
+                DBSstFileWriterAdd(fw, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(key)).data);
+    }
+    DBString data;
+    ASSERT_EQ(nullptr, DBSstFileWriterFinish(fw, &data).data);
+    DBSstFileWriterClose(fw);
+    ASSERT_EQ(nullptr, DBEnvWriteFile(db, ToDBSlice(path), DBSlice{data.data, data.len}).data);
+    free(data.data);
+  };
+  writeSst("a.sst", {"a1", "a2"});
+  writeSst("b.sst", {"b1", "b2"});
+
+  // The files are ingested into the bottommost level, in the order of
+  // the results rather than of their internal file numbers.
+  std::vector<DBSlice> paths = {ToDBSlice("b.sst"), ToDBSlice("a.sst")};
+  std::vector<DBIngestedFile> results(paths.size());
+  ASSERT_EQ(nullptr, DBIngestExternalFiles(db, paths.data(), 2, false, results.data()).data);
+  for (const auto& r : results) {
+    EXPECT_EQ(6, r.level);
+    EXPECT_FALSE(r.global_seqno);
+  }
+
+  // Ingesting a file from the same external path again overlaps the
+  // first ingestion of it, so it needs a global sequence number and a
+  // higher level. The results are those of the new ingestion.
+  paths = {ToDBSlice("a.sst")};
+  ASSERT_EQ(nullptr, DBIngestExternalFiles(db, paths.data(), 1, false, results.data()).data);
+  EXPECT_EQ(5, results[0].level);
+  EXPECT_TRUE(results[0].global_seqno);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, ValueSeparation) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-value-separation";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.value_separation_threshold = 100;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+
+  // The large value is separated, the small one and the unversioned
+  // one are not.
+  const std::string large(1000, 'v');
+  const DBKey large_key = {ToDBSlice("a"), 1, 0};
+  const DBKey small_key = {ToDBSlice("b"), 1, 0};
+  const DBKey meta_key = {ToDBSlice("c"), 0, 0};
+  ASSERT_EQ(nullptr, DBPut(db, large_key, ToDBSlice(large)).data);
+  ASSERT_EQ(nullptr, DBPut(db, small_key, ToDBSlice("small")).data);
+  ASSERT_EQ(nullptr, DBPut(db, meta_key, ToDBSlice(large)).data);
+
+  DBStatsResult stats;
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_EQ(1, stats.blob_file_count);
+  EXPECT_EQ(int64_t(large.size()), stats.blob_file_bytes);
+
+  // References are resolved by gets, iterators and scans, both before
+  // and after the values are flushed.
+  for (int i = 0; i < 2; i++) {
+    DBString value;
+    ASSERT_EQ(nullptr, DBGet(db, large_key, &value).data);
+    EXPECT_EQ(large, ToString(value));
+    free(value.data);
+
+    DBIterator* iter = DBNewIter(db, false);
+    DBIterState state = DBIterSeek(iter, large_key);
+    ASSERT_TRUE(state.valid);
+    EXPECT_EQ(large, ToString(state.value));
+
+    const DBTxn txn = {};
+    DBScanResults results = MVCCScan(iter, ToDBSlice("a"), ToDBSlice("c"), DBTimestamp{2, 0}, 10,
+                                     txn, true, false);
+    ASSERT_EQ(nullptr, results.status.data);
+    rocksdb::Slice buf(results.data.data, results.data.len);
+    uint32_t count;
+    ASSERT_TRUE(DecodeScanResultHeader(&buf, &count));
+    ASSERT_EQ(2, count);
+    rocksdb::Slice key, val;
+    ASSERT_TRUE(DecodeScanResultEntry(&buf, &key, &val));
+    EXPECT_EQ(large, val.ToString());
+    ASSERT_TRUE(DecodeScanResultEntry(&buf, &key, &val));
+    EXPECT_EQ("small", val.ToString());
+
+    // The MVCC stats account for the size of the separated value.
+    MVCCStatsResult mvcc_stats =
+        MVCCComputeStats(iter, DBKey{ToDBSlice("a"), 0, 0}, DBKey{ToDBSlice("b"), 0, 0}, 0);
+    ASSERT_EQ(nullptr, mvcc_stats.status.data);
+    EXPECT_EQ(int64_t(large.size()), mvcc_stats.val_bytes);
+    DBIterDestroy(iter);
+
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+  }
+  DBClose(db);
+
+  // After a restart writes go to a new blob file. Once the large value
+  // is deleted and compacted away, the old file is garbage collected.
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_EQ(2, stats.blob_file_count);
+  ASSERT_EQ(nullptr, DBDelete(db, large_key).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_EQ(1, stats.blob_file_count);
+  EXPECT_EQ(0, stats.blob_file_bytes);
+
+  DBString value;
+  ASSERT_EQ(nullptr, DBGet(db, small_key, &value).data);
+  EXPECT_EQ("small", ToString(value));
+  free(value.data);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+}
+
+TEST(Libroach, BlobRelocation) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-blob-relocation";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.value_separation_threshold = 100;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  const int kValues = 10;
+  const std::string large(1000, 'v');
+  auto key = [](int i) { return "k" + std::to_string(i); };
+  for (int i = 0; i < kValues; i++) {
+    const std::string k = key(i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(k), 1, 0}, ToDBSlice(large)).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  DBClose(db);
+
+  // After a restart the first blob file is sealed. Once most of its
+  // values are deleted, the remaining ones are relocated to the new
+  // file.
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+  for (int i = 2; i < kValues; i++) {
+    const std::string k = key(i);
+    ASSERT_EQ(nullptr, DBDelete(db, DBKey{ToDBSlice(k), 1, 0}).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+
+  DBStatsResult stats;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+    if (stats.blob_relocated_bytes > 0) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(int64_t(2 * large.size()), stats.blob_relocated_bytes);
+
+  // Once the old references are compacted away, the old file is
+  // deleted and only the relocated values remain.
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  ASSERT_EQ(nullptr, DBGetStats(db, &stats).data);
+  EXPECT_EQ(1, stats.blob_file_count);
+  EXPECT_EQ(int64_t(2 * large.size()), stats.blob_file_bytes);
+  for (int i = 0; i < kValues; i++) {
+    const std::string k = key(i);
+    DBString value;
+    ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice(k), 1, 0}, &value).data);
+    EXPECT_EQ(i < 2 ? large : "", ToString(value));
+    free(value.data);
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+}
+
+TEST(Libroach, MemoryStats) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  DBMemoryStats before;
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &before).data);
+  if (before.allocator_stats) {
+    EXPECT_GT(before.allocated, 0);
+    EXPECT_GE(before.resident, before.active);
+  }
+
+  // A batch accounts for its repr until it is freed. The batch is too
+  // large to be pooled.
+  const std::string value(1024, 'v');
+  DBEngine* batch = DBNewBatch(db, true);
+  for (int i = 0; i < 2048; i++) {
+    const std::string key = fmt::StringPrintf("k%04d", i);
+    ASSERT_EQ(nullptr, DBPut(batch, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+  }
+  DBMemoryStats stats;
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &stats).data);
+  EXPECT_GE(stats.batches - before.batches, 2048 * 1024);
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &stats).data);
+  EXPECT_EQ(before.batches, stats.batches);
+  EXPECT_GT(stats.memtables, 0);
+
+  // An iterator accounts for the buffer of its scan results until it is
+  // destroyed.
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  DBIterator* iter = DBNewIter(db, false);
+  DBScanResults results =
+      MVCCScan(iter, ToDBSlice("a"), ToDBSlice("z"), ts, 1000, txn, true, false);
+  ASSERT_EQ(nullptr, results.status.data);
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &stats).data);
+  EXPECT_GE(stats.scan_buffers - before.scan_buffers, 1000 * 1024);
+  // The memtables are pinned by the iterator once flushed.
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &stats).data);
+  EXPECT_GT(stats.pinned_memtables, 0);
+  DBIterDestroy(iter);
+  ASSERT_EQ(nullptr, DBGetMemoryStats(db, &stats).data);
+  EXPECT_EQ(before.scan_buffers, stats.scan_buffers);
+  EXPECT_EQ(0, stats.pinned_memtables);
+
+  // Only engines created by DBOpen have memory stats.
+  DBEngine* snap = DBNewSnapshot(db);
+  EXPECT_NE(nullptr, DBGetMemoryStats(snap, &stats).data);
+  DBClose(snap);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, SharedScheduler) {
+  DBScheduler* scheduler;
+  EXPECT_NE(nullptr, DBNewScheduler(&scheduler, DBSchedulerOptions{0, 0}).data);
+  ASSERT_EQ(nullptr, DBNewScheduler(&scheduler, DBSchedulerOptions{2, 0}).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.scheduler = scheduler;
+  DBEngine* dbs[2];
+  for (auto& db : dbs) {
+    ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+  }
+  // The flushes and compactions of both engines run on the scheduler.
+  for (int i = 0; i < 2; i++) {
+    for (auto db : dbs) {
+      const std::string key = "k" + std::to_string(i);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value")).data);
+      ASSERT_EQ(nullptr, DBFlush(db).data);
+    }
+  }
+  for (auto db : dbs) {
+    ASSERT_EQ(nullptr, DBCompact(db).data);
+    DBString value;
+    ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice("k1"), 1, 0}, &value).data);
+    EXPECT_EQ("value", ToString(value));
+    free(value.data);
+  }
+
+  DBSchedulerStats stats;
+  ASSERT_EQ(nullptr, DBGetSchedulerStats(scheduler, &stats).data);
+  EXPECT_GE(stats.flushes, 4);
+  EXPECT_GE(stats.compactions, 2);
+
+  // The engines keep the scheduler alive until they are closed.
+  DBReleaseScheduler(scheduler);
+
+  for (auto db : dbs) {
+    DBClose(db);
+  }
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCComputeChecksum) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write two versions of each key across several sstables so that
+  // the spans are cut into sub-spans, along with a metadata key which
+  // is excluded from the checksum.
+  for (int i = 0; i < 100; i++) {
+    const std::string key = fmt::StringPrintf("k%03d", i);
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(key), i + 1, 0}, ToDBSlice(std::string(i, 'v'))).data);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), i + 2, 1}, ToDBSlice("value")).data);
+    if (i % 20 == 19) {
+      ASSERT_EQ(nullptr, DBFlush(db).data);
+    }
+  }
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k050-skip"), 0, 0}, DBSlice()).data);
+
+  const DBSpan spans[] = {
+      {ToDBSlice("k"), ToDBSlice("k050")},
+      {ToDBSlice("k050"), ToDBSlice("l")},
+  };
+  const int num_spans = sizeof(spans) / sizeof(spans[0]);
+  const std::string skip_key = "k050-skip";
+
+  // Compute the checksum as Replica.sha512 does, by walking the spans
+  // with an iterator.
+  SHA512 hasher;
+  MVCCStatsResult expected_stats = {};
+  DBIterator* iter = DBNewIter(db, false);
+  for (int i = 0; i < num_spans; i++) {
+    const std::string end = EncodeKey(ToSlice(spans[i].end), 0, 0);
+    const rocksdb::Comparator* cmp = CockroachComparator();
+    for (DBIterState state = DBIterSeek(iter, DBKey{spans[i].start, 0, 0});
+         state.valid && cmp->Compare(EncodeKey(state.key), end) < 0;
+         state = DBIterNext(iter, false)) {
+      const std::string key = ToString(state.key.key);
+      if (key == skip_key && state.key.wall_time == 0 && state.key.logical == 0) {
+        continue;
+      }
+      const std::string value = ToString(state.value);
+      std::string record;
+      EncodeUint64(&record, key.size());
+      EncodeUint64(&record, value.size());
+      // The lengths are little-endian.
+      std::reverse(record.begin(), record.begin() + 8);
+      std::reverse(record.begin() + 8, record.end());
+      cockroach::util::hlc::LegacyTimestamp ts;
+      ts.set_wall_time(state.key.wall_time);
+      ts.set_logical(state.key.logical);
+      record += key + ts.SerializeAsString() + value;
+      hasher.Update(record.data(), record.size());
+    }
+    const MVCCStatsResult s = MVCCComputeStats(iter, DBKey{spans[i].start, 0, 0},
+                                               DBKey{spans[i].end, 0, 0}, 1000);
+    ASSERT_EQ(nullptr, s.status.data);
+    expected_stats.live_bytes += s.live_bytes;
+    expected_stats.key_bytes += s.key_bytes;
+    expected_stats.val_bytes += s.val_bytes;
+    expected_stats.key_count += s.key_count;
+    expected_stats.val_count += s.val_count;
+    expected_stats.gc_bytes_age += s.gc_bytes_age;
+  }
+  DBIterDestroy(iter);
+  uint8_t digest[SHA512::kDigestSize];
+  hasher.Final(digest);
+  const std::string expected(reinterpret_cast<char*>(digest), sizeof(digest));
+
+  // The checksum does not depend on the concurrency.
+  for (int concurrency : {1, 4}) {
+    MVCCChecksumResult result =
+        MVCCComputeChecksum(db, spans, num_spans, ToDBSlice(skip_key), true, 1000, concurrency);
+    ASSERT_EQ(nullptr, result.status.data);
+    EXPECT_EQ(expected, ToString(result.checksum));
+    free(result.checksum.data);
+    EXPECT_EQ(expected_stats.live_bytes, result.stats.live_bytes);
+    EXPECT_EQ(expected_stats.key_bytes, result.stats.key_bytes);
+    EXPECT_EQ(expected_stats.val_bytes, result.stats.val_bytes);
+    EXPECT_EQ(expected_stats.key_count, result.stats.key_count);
+    EXPECT_EQ(expected_stats.val_count, result.stats.val_count);
+    EXPECT_EQ(expected_stats.gc_bytes_age, result.stats.gc_bytes_age);
+    EXPECT_EQ(1000, result.stats.last_update_nanos);
+  }
+
+  // The skipped key is hashed without skip_key.
+  MVCCChecksumResult result = MVCCComputeChecksum(db, spans, num_spans, DBSlice(), false, 0, 4);
+  ASSERT_EQ(nullptr, result.status.data);
+  EXPECT_NE(expected, ToString(result.checksum));
+  free(result.checksum.data);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, EnvStreamFile) {
+  std::string dir;
+  ASSERT_OK(rocksdb::Env::Default()->GetTestDirectory(&dir));
+  dir += "/libroach-stream-file";
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, ToDBSlice(dir), db_opts).data);
+
+  // Write the file in chunks which are not page aligned, so that the
+  // range syncs lag the appended data.
+  const std::string path = dir + "/streamed";
+  DBWritableFile* file;
+  ASSERT_EQ(nullptr, DBEnvOpenFile(db, ToDBSlice(path), 4096, &file).data);
+  std::string expected;
+  for (int i = 0; i < 8; i++) {
+    const std::string chunk(3000, char('a' + i));
+    ASSERT_EQ(nullptr, DBEnvAppendFile(file, ToDBSlice(chunk)).data);
+    expected += chunk;
+  }
+  ASSERT_EQ(nullptr, DBEnvSyncFile(file).data);
+  ASSERT_EQ(nullptr, DBEnvCloseFile(file).data);
+
+  std::string data;
+  ASSERT_OK(rocksdb::ReadFileToString(rocksdb::Env::Default(), path, &data));
+  EXPECT_EQ(expected, data);
+  ASSERT_OK(rocksdb::Env::Default()->DeleteFile(path));
+
+  // Batches have no env to write files through.
+  DBEngine* batch = DBNewBatch(db, false);
+  EXPECT_NE(nullptr, DBEnvOpenFile(batch, ToDBSlice(path), 0, &file).data);
+  DBClose(batch);
+
+  DBClose(db);
+  ASSERT_EQ(nullptr, DBDestroy(ToDBSlice(dir)).data);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, SubmitReads) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  // A single thread so that its iterators are reused across reads.
+  db_opts.read_threads = 1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  for (int i = 0; i < 10; i++) {
+    const std::string key = "k" + std::to_string(i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value" + key)).data);
+  }
+
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  std::vector<DBReadRequest> reqs(3);
+  for (auto& r : reqs) {
+    memset(&r, 0, sizeof(r));
+    r.timestamp = ts;
+    r.txn = txn;
+    r.consistent = true;
+  }
+  // A get, a scan and a scan which stops at its max_keys limit.
+  reqs[0].tag = 0;
+  reqs[0].start = ToDBSlice("k3");
+  reqs[1].tag = 1;
+  reqs[1].start = ToDBSlice("k0");
+  reqs[1].end = ToDBSlice("k5");
+  reqs[1].max_keys = 100;
+  reqs[2].tag = 2;
+  reqs[2].start = ToDBSlice("k2");
+  reqs[2].end = ToDBSlice("z");
+  reqs[2].max_keys = 2;
+
+  DBReadQueue* queue = DBNewReadQueue();
+  ASSERT_EQ(nullptr, DBSubmitReads(db, reqs.data(), reqs.size(), queue).data);
+  std::vector<DBReadResult> results(reqs.size());
+  for (int n = 0; n < results.size();) {
+    n += DBPollReads(queue, &results[n], results.size() - n, -1);
+  }
+  // All of the reads have completed.
+  DBReadResult extra;
+  EXPECT_EQ(0, DBPollReads(queue, &extra, 1, -1));
+
+  // The results match those of synchronous reads.
+  DBIterator* iter = DBNewIter(db, false);
+  for (const auto& result : results) {
+    ASSERT_LT(result.tag, reqs.size());
+    const DBReadRequest& req = reqs[result.tag];
+    ASSERT_EQ(nullptr, result.status.data);
+    const DBScanResults expected =
+        req.end.len == 0 ? MVCCGet(iter, req.start, ts, txn, true)
+                         : MVCCScanWithLimits(iter, req.start, req.end, ts, req.max_keys, 0,
+                                              false, txn, true, false);
+    EXPECT_EQ(ToString(expected.data), ToString(result.data));
+    EXPECT_EQ(ToString(expected.resume_key), ToString(result.resume_key));
+    if (result.tag == 2) {
+      EXPECT_EQ("k4", ToString(result.resume_key));
+    }
+    free(result.data.data);
+    free(result.intents.data);
+    free(result.resume_key.data);
+  }
+  DBIterDestroy(iter);
+
+  // A read sees writes made after the thread's iterator was created.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k3"), 3, 0}, ToDBSlice("new")).data);
+  reqs[0].timestamp = DBTimestamp{4, 0};
+  ASSERT_EQ(nullptr, DBSubmitReads(db, reqs.data(), 1, queue).data);
+  ASSERT_EQ(1, DBPollReads(queue, &results[0], 1, -1));
+  ASSERT_EQ(nullptr, results[0].status.data);
+  EXPECT_NE(std::string::npos, ToString(results[0].data).find("new"));
+  free(results[0].data.data);
+
+  DBReadPoolStats stats;
+  ASSERT_EQ(nullptr, DBGetReadPoolStats(db, &stats).data);
+  EXPECT_EQ(0, stats.queued);
+  EXPECT_EQ(4, stats.queue_nanos.count);
+  EXPECT_EQ(4, stats.service_nanos.count);
+
+  // Batches have no read threads.
+  DBEngine* batch = DBNewBatch(db, false);
+  EXPECT_NE(nullptr, DBSubmitReads(batch, reqs.data(), 1, queue).data);
+  DBClose(batch);
+
+  DBReleaseReadQueue(queue);
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCScanSpans) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  for (const char* prefix : {"a", "b", "c"}) {
+    for (int i = 0; i < 5; i++) {
+      const std::string key = prefix + std::to_string(i);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value")).data);
+    }
+  }
+
+  const DBSpan spans[] = {
+      {ToDBSlice("a1"), ToDBSlice("a3")},
+      {ToDBSlice("b0"), ToDBSlice("b2")},
+      {ToDBSlice("c3"), ToDBSlice("d")},
+  };
+  const DBTxn txn = {};
+  const DBTimestamp ts = {2, 0};
+  DBIterator* iter = DBNewIter(db, false);
+
+  // Every span is scanned to completion.
+  DBMultiScanResults results = MVCCScanSpans(iter, spans, 3, ts, 100, 0, txn, true);
+  ASSERT_EQ(nullptr, results.status.data);
+  const std::vector<std::string> all = {"a1", "a2", "b0", "b1", "c3", "c4"};
+  EXPECT_EQ(all, scanKeys(results.data));
+  ASSERT_EQ(3, results.num_span_ends);
+  EXPECT_EQ(2, results.span_ends[0]);
+  EXPECT_EQ(4, results.span_ends[1]);
+  EXPECT_EQ(6, results.span_ends[2]);
+  EXPECT_EQ(3, results.resume_span);
+  EXPECT_EQ(0, results.resume_key.len);
+
+  // The max_keys limit is shared by the spans: the scan stops in the
+  // second span, whose last entry is the first key which did not fit.
+  results = MVCCScanSpans(iter, spans, 3, ts, 3, 0, txn, true);
+  ASSERT_EQ(nullptr, results.status.data);
+  const std::vector<std::string> limited = {"a1", "a2", "b0", "b1"};
+  EXPECT_EQ(limited, scanKeys(results.data));
+  ASSERT_EQ(2, results.num_span_ends);
+  EXPECT_EQ(2, results.span_ends[0]);
+  EXPECT_EQ(4, results.span_ends[1]);
+  EXPECT_EQ(1, results.resume_span);
+  EXPECT_EQ("b1", ToString(results.resume_key));
+
+  // Resuming from the resume key returns the rest of the results.
+  const std::string resume_key = ToString(results.resume_key);
+  const DBSpan resumed[] = {{ToDBSlice(resume_key), spans[1].end}, spans[2]};
+  results = MVCCScanSpans(iter, resumed, 2, ts, 100, 0, txn, true);
+  ASSERT_EQ(nullptr, results.status.data);
+  const std::vector<std::string> remaining = {"b1", "c3", "c4"};
+  EXPECT_EQ(remaining, scanKeys(results.data));
+
+  DBIterDestroy(iter);
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCMultiGet) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  for (const char* key : {"a", "b", "c", "d"}) {
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value")).data);
+  }
+  // An intent on "c" written by another transaction, and one on "e"
+  // written by a later epoch of the reading transaction.
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.mutable_txn()->set_id("other");
+  meta.mutable_timestamp()->set_wall_time(2);
+  ASSERT_EQ(nullptr,
+            DBPut(db, DBKey{ToDBSlice("c"), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("c"), 2, 0}, ToDBSlice("intent")).data);
+  meta.mutable_txn()->set_id("reader");
+  meta.mutable_txn()->set_epoch(1);
+  ASSERT_EQ(nullptr,
+            DBPut(db, DBKey{ToDBSlice("e"), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("e"), 2, 0}, ToDBSlice("intent")).data);
+
+  DBTxn txn = {};
+  const DBTimestamp ts = {3, 0};
+  for (bool prefix : {false, true}) {
+    SCOPED_TRACE(prefix);
+    DBIterator* iter = DBNewIter(db, prefix);
+
+    // Missing keys are omitted, duplicate keys are returned once and
+    // the intent is returned separately.
+    const DBSlice keys[] = {ToDBSlice("d"), ToDBSlice("a"), ToDBSlice("x"),
+                            ToDBSlice("a"), ToDBSlice("c"), ToDBSlice("b")};
+    DBScanResults results = MVCCMultiGet(iter, keys, 6, ts, txn, true);
+    ASSERT_EQ(nullptr, results.status.data);
+    const std::vector<std::string> found = {"a", "b", "d"};
+    EXPECT_EQ(found, scanKeys(results.data));
+    const std::vector<std::string> intents = {"c"};
+    EXPECT_EQ(intents, scanKeys(results.intents));
+
+    // Reading an intent written by a later epoch of the transaction is
+    // an error, which stops the lookups.
+    txn.id = ToDBSlice("reader");
+    const DBSlice error_keys[] = {ToDBSlice("a"), ToDBSlice("e"), ToDBSlice("f")};
+    results = MVCCMultiGet(iter, error_keys, 3, ts, txn, true);
+    EXPECT_NE(nullptr, results.status.data);
+    EXPECT_EQ(0, results.data.len);
+    free(results.status.data);
+    txn.id = DBSlice();
+
+    DBIterDestroy(iter);
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCComputeStatsParallel) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write enough versions (and deletions) for the compacted data to
+  // span several bottom-level sstables, so that the span is split.
+  for (int i = 0; i < 4000; i++) {
+    const std::string key = fmt::StringPrintf("k%05d", i);
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(std::string(1000, 'a'))).data);
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(key), 2, 0}, ToDBSlice(std::string(500, 'b'))).data);
+    if (i % 7 == 0) {
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 3, 0}, DBSlice()).data);
+    }
+  }
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+
+  const DBKey start = {ToDBSlice("a"), 0, 0};
+  const DBKey end = {ToDBSlice("z"), 0, 0};
+  const int64_t now_nanos = 10 * 1000000000LL;
+  DBIterator* iter = DBNewIter(db, false);
+  const MVCCStatsResult expected = MVCCComputeStats(iter, start, end, now_nanos);
+  DBIterDestroy(iter);
+  ASSERT_EQ(nullptr, expected.status.data);
+  EXPECT_EQ(4000, expected.key_count);
+
+  for (int concurrency : {1, 2, 4, 16}) {
+    SCOPED_TRACE(concurrency);
+    const MVCCStatsResult stats =
+        MVCCComputeStatsParallel(db, start, end, now_nanos, concurrency);
+    ASSERT_EQ(nullptr, stats.status.data);
+    expectStatsEqual(expected, stats);
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCComputeStatsWithTableProps) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Flush several sstables covering disjoint key ranges, with multiple
+  // versions, deleted keys and an intent.
+  for (int t = 0; t < 5; t++) {
+    for (int i = 0; i < 20; i++) {
+      const std::string key = fmt::StringPrintf("k%d-%02d", t, i);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value1")).data);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 2, 0},
+                               i % 5 == 0 ? DBSlice() : ToDBSlice("value2"))
+                             .data);
+    }
+    if (t == 2) {
+      cockroach::storage::engine::enginepb::MVCCMetadata meta;
+      meta.mutable_txn()->set_id("txn");
+      meta.mutable_timestamp()->set_wall_time(3);
+      meta.set_key_bytes(12);
+      meta.set_val_bytes(6);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k2-99"), 0, 0},
+                               ToDBSlice(meta.SerializeAsString()))
+                             .data);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k2-99"), 3, 0}, ToDBSlice("intent")).data);
+    }
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+  }
+  // A newer version of a key in the memtable, which makes the stats of
+  // the sstable holding the key unusable.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k3-05"), 4, 0}, ToDBSlice("value4")).data);
+
+  const int64_t now_nanos = 10 * 1000000000LL;
+  DBIterator* iter = DBNewIter(db, false);
+  const std::vector<std::pair<std::string, std::string>> spans = {
+      {"a", "z"}, {"k1", "k4"}, {"k1-10", "k3-10"}, {"k2", "k2-99"}, {"k4-00", "k4-19"},
+  };
+  for (const auto& span : spans) {
+    SCOPED_TRACE(span.first + "-" + span.second);
+    const DBKey start = {ToDBSlice(span.first), 0, 0};
+    const DBKey end = {ToDBSlice(span.second), 0, 0};
+    const MVCCStatsResult expected = MVCCComputeStats(iter, start, end, now_nanos);
+    ASSERT_EQ(nullptr, expected.status.data);
+    const MVCCStatsResult stats = MVCCComputeStatsWithTableProps(db, start, end, now_nanos);
+    ASSERT_EQ(nullptr, stats.status.data);
+    expectStatsEqual(expected, stats);
+  }
+  DBIterDestroy(iter);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCComputeStatsWithTablePropsRangeDeletion) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Flush several sstables covering disjoint key ranges, each of whose
+  // stats could be used on its own.
+  for (int t = 0; t < 4; t++) {
+    for (int i = 0; i < 20; i++) {
+      const std::string key = fmt::StringPrintf("k%d-%02d", t, i);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice("value1")).data);
+    }
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+  }
+
+  const int64_t now_nanos = 10 * 1000000000LL;
+  auto checkStats = [&]() {
+    DBIterator* iter = DBNewIter(db, false);
+    const std::vector<std::pair<std::string, std::string>> spans = {
+        {"a", "z"}, {"k0", "k4"}, {"k1", "k2"}, {"k2", "k3"}, {"k3", "k4"},
+    };
+    for (const auto& span : spans) {
+      SCOPED_TRACE(span.first + "-" + span.second);
+      const DBKey start = {ToDBSlice(span.first), 0, 0};
+      const DBKey end = {ToDBSlice(span.second), 0, 0};
+      const MVCCStatsResult expected = MVCCComputeStats(iter, start, end, now_nanos);
+      ASSERT_EQ(nullptr, expected.status.data);
+      const MVCCStatsResult stats = MVCCComputeStatsWithTableProps(db, start, end, now_nanos);
+      ASSERT_EQ(nullptr, stats.status.data);
+      expectStatsEqual(expected, stats);
+    }
+    DBIterDestroy(iter);
+  };
+
+  // A range tombstone in the memtable hides keys of the sstables.
+  ASSERT_EQ(nullptr, DBDeleteRange(db, DBKey{ToDBSlice("k1-05"), 0, 0},
+                                   DBKey{ToDBSlice("k2-10"), 0, 0})
+                         .data);
+  {
+    SCOPED_TRACE("memtable");
+    checkStats();
+  }
+
+  // Once flushed, the range tombstone lives in an sstable overlapping
+  // the sstables whose keys it hides.
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  {
+    SCOPED_TRACE("sstable");
+    checkStats();
+  }
+
+  // A range tombstone committed through a batch is tracked as well.
+  DBEngine* batch = DBNewBatch(db, false);
+  ASSERT_EQ(nullptr, DBDeleteRange(batch, DBKey{ToDBSlice("k3-00"), 0, 0},
+                                   DBKey{ToDBSlice("k3-15"), 0, 0})
+                         .data);
+  ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+  {
+    SCOPED_TRACE("batch");
+    checkStats();
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MVCCFindSplitKeyApprox) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  db_opts.block_size = 4 << 10;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Write ~4MB of incompressible values of the same size so that the
+  // size of a span is proportional to the number of keys in it.
+  const int kNumKeys = 4000;
+  uint32_t seed = 1;
+  std::string value(1000, 0);
+  for (int i = 0; i < kNumKeys; i++) {
+    for (auto& c : value) {
+      seed = seed * 1103515245 + 12345;
+      c = char(seed >> 16);
+    }
+    const std::string key = fmt::StringPrintf("k%05d", i);
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+
+  const DBKey start = {ToDBSlice("a"), 0, 0};
+  const DBKey end = {ToDBSlice("z"), 0, 0};
+  uint64_t total_size = 0;
+  ASSERT_EQ(nullptr, DBApproximateDiskBytes(db, start, end, &total_size).data);
+  ASSERT_GT(total_size, 1 << 20);
+
+  for (const double fraction : {0.25, 0.5, 0.75}) {
+    SCOPED_TRACE(fraction);
+    const int64_t target_size = int64_t(total_size * fraction);
+    DBString split_key;
+    ASSERT_EQ(nullptr,
+              MVCCFindSplitKeyApprox(db, start, end, start, target_size, false, &split_key).data);
+    const std::string split = ToString(split_key);
+    free(split_key.data);
+
+    // The size to the left of the split key is within the tolerance of
+    // the target size, plus the granularity of the size estimates (a
+    // data block).
+    uint64_t split_size = 0;
+    ASSERT_EQ(nullptr,
+              DBApproximateDiskBytes(db, start, DBKey{ToDBSlice(split), 0, 0}, &split_size).data);
+    const int64_t diff = std::abs(int64_t(split_size) - target_size);
+    EXPECT_LE(diff, target_size / 100 + 2 * int64_t(db_opts.block_size));
+
+    // The split key splits the keys in the same proportion.
+    const int index = atoi(split.c_str() + 1);
+    EXPECT_LE(std::abs(index - int(kNumKeys * fraction)), kNumKeys / 50) << split;
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MergeTimeSeriesOverlapping) {
+  const int64_t kSecond = 1000000000;
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  auto tsValue = [&](const std::vector<std::pair<int, double>>& samples) {
+    cockroach::roachpb::InternalTimeSeriesData ts;
+    ts.set_start_timestamp_nanos(0);
+    ts.set_sample_duration_nanos(10 * kSecond);
+    for (const auto& s : samples) {
+      cockroach::roachpb::InternalTimeSeriesSample* sample = ts.add_samples();
+      sample->set_offset(s.first);
+      sample->set_sum(s.second);
+      sample->set_count(1);
+    }
+    std::string raw_bytes(5, '\0');
+    raw_bytes[4] = cockroach::roachpb::TIMESERIES;
+    ts.AppendToString(&raw_bytes);
+    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    meta.set_raw_bytes(raw_bytes);
+    return meta.SerializeAsString();
+  };
+
+  // Operands whose offsets overlap each other (and which are not
+  // themselves sorted). The expected result holds, for each offset, the
+  // sample from the last operand merged.
+  const std::vector<std::vector<std::pair<int, double>>> operands = {
+      {{5, 1}, {1, 1}, {3, 1}},
+      {{3, 2}, {4, 2}, {0, 2}},
+      {{9, 3}, {1, 3}},
+      {{4, 4}, {4, 5}, {7, 4}},
+  };
+  for (const bool existing : {false, true}) {
+    SCOPED_TRACE(existing);
+    const std::string key = existing ? "existing" : "empty";
+    std::map<int, double> expected;
+    if (existing) {
+      ASSERT_EQ(nullptr,
+                DBPut(db, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(tsValue({{2, 0}, {3, 0}}))).data);
+      expected = {{2, 0}, {3, 0}};
+    }
+    for (const auto& operand : operands) {
+      ASSERT_EQ(nullptr,
+                DBMerge(db, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(tsValue(operand))).data);
+      for (const auto& s : operand) {
+        expected[s.first] = s.second;
+      }
+    }
+
+    DBString result = {};
+    ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice(key), 0, 0}, &result).data);
+    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    ASSERT_TRUE(meta.ParseFromArray(result.data, result.len));
+    free(result.data);
+    cockroach::roachpb::InternalTimeSeriesData ts;
+    ASSERT_TRUE(ts.ParseFromArray(meta.raw_bytes().data() + 5, meta.raw_bytes().size() - 5));
+    ASSERT_EQ(expected.size(), ts.samples_size());
+    int i = 0;
+    for (const auto& e : expected) {
+      EXPECT_EQ(e.first, ts.samples(i).offset());
+      EXPECT_EQ(e.second, ts.samples(i).sum());
+      i++;
+    }
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, MergeTimeSeriesColumnar) {
+  const int64_t kSecond = 1000000000;
+
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // tsValue returns an MVCCMetadata holding the samples in either the
+  // InternalTimeSeriesData or the columnar encoding.
+  auto tsValue = [&](const std::vector<std::pair<int, double>>& samples, bool columnar) {
+    std::string raw_bytes(5, '\0');
+    if (columnar) {
+      raw_bytes[4] = cockroach::roachpb::TIMESERIES_COLUMNAR;
+      ColumnarTimeSeriesWriter writer;
+      writer.Reset(0, 10 * kSecond);
+      for (const auto& s : samples) {
+        EXPECT_TRUE(writer.Add(s.first, s.second));
+      }
+      writer.Finish(&raw_bytes);
+    } else {
+      raw_bytes[4] = cockroach::roachpb::TIMESERIES;
+      cockroach::roachpb::InternalTimeSeriesData ts;
+      ts.set_start_timestamp_nanos(0);
+      ts.set_sample_duration_nanos(10 * kSecond);
+      for (const auto& s : samples) {
+        cockroach::roachpb::InternalTimeSeriesSample* sample = ts.add_samples();
+        sample->set_offset(s.first);
+        sample->set_sum(s.second);
+        sample->set_count(1);
+      }
+      ts.AppendToString(&raw_bytes);
+    }
+    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    meta.set_raw_bytes(raw_bytes);
+    return meta.SerializeAsString();
+  };
+
+  // Each operand is merged in the encoding given by its flag. Once a
+  // columnar value takes part in a merge, the result is columnar.
+  const std::vector<std::pair<std::vector<std::pair<int, double>>, bool>> operands = {
+      {{{1, 1}, {3, 1}, {5, 1}}, false},
+      {{{0, 2}, {3, 2}, {4, 2}}, true},
+      {{{1, 3}, {9, 3}}, false},
+      {{{4, 4}, {7, 4}}, true},
+  };
+  for (const bool existing : {false, true}) {
+    SCOPED_TRACE(existing);
+    const std::string key = existing ? "existing" : "empty";
+    std::map<int, double> expected;
+    if (existing) {
+      ASSERT_EQ(nullptr,
+                DBPut(db, DBKey{ToDBSlice(key), 0, 0}, ToDBSlice(tsValue({{2, 0}, {3, 0}}, false)))
+                    .data);
+      expected = {{2, 0}, {3, 0}};
+    }
+    for (const auto& operand : operands) {
+      ASSERT_EQ(nullptr, DBMerge(db, DBKey{ToDBSlice(key), 0, 0},
+                                 ToDBSlice(tsValue(operand.first, operand.second)))
+                             .data);
+      for (const auto& s : operand.first) {
+        expected[s.first] = s.second;
+      }
+    }
+
+    DBString result = {};
+    ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice(key), 0, 0}, &result).data);
+    cockroach::storage::engine::enginepb::MVCCMetadata meta;
+    ASSERT_TRUE(meta.ParseFromArray(result.data, result.len));
+    free(result.data);
+    ASSERT_LE(5u, meta.raw_bytes().size());
+    EXPECT_EQ(cockroach::roachpb::TIMESERIES_COLUMNAR, int(meta.raw_bytes()[4]));
+    rocksdb::Slice data(meta.raw_bytes());
+    data.remove_prefix(5);
+    ColumnarTimeSeriesReader reader;
+    ASSERT_TRUE(reader.Init(data));
+    EXPECT_EQ(10 * kSecond, reader.duration_nanos());
+    ASSERT_EQ(expected.size(), reader.count());
+    for (const auto& e : expected) {
+      ASSERT_TRUE(reader.Next());
+      EXPECT_EQ(e.first, reader.offset());
+      EXPECT_EQ(e.second, reader.sum());
+    }
+    EXPECT_FALSE(reader.Next());
+    EXPECT_FALSE(reader.Error());
+  }
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, DeleteIterRangeAdaptive) {
+  // deleteCounter counts the point and range deletions in a batch.
+  struct deleteCounter : public rocksdb::WriteBatch::Handler {
+    deleteCounter() : deletes(0), range_deletes(0) {}
+    void Put(const rocksdb::Slice& key, const rocksdb::Slice& value) override {}
+    void Delete(const rocksdb::Slice& key) override { deletes++; }
+    rocksdb::Status DeleteRangeCF(uint32_t column_family_id, const rocksdb::Slice& begin_key,
+                                  const rocksdb::Slice& end_key) override {
+      range_deletes++;
+      return rocksdb::Status::OK();
+    }
+    int deletes;
+    int range_deletes;
+  };
+
+  // Spans holding few keys are deleted with point tombstones. Spans
+  // holding many more keys than the threshold switch to a range
+  // tombstone after the sampled keys.
+  struct testCase {
+    int num_keys;
+    int expected_deletes;
+    int expected_range_deletes;
+  };
+  const std::vector<testCase> testCases = {
+      {1000, 1000, 0},
+      {20000, 64, 1},
+  };
+  for (const auto& t : testCases) {
+    SCOPED_TRACE(t.num_keys);
+    DBOptions db_opts = {};
+    db_opts.cache = DBNewCache(1 << 20);
+    db_opts.num_cpu = 1;
+    db_opts.max_open_files = -1;
+    DBEngine* db;
+    ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+    // Incompressible values so that the approximate size of the span
+    // reflects the number of keys in it.
+    uint32_t seed = 1;
+    std::string value(100, 0);
+    for (int i = 0; i < t.num_keys; i++) {
+      for (auto& c : value) {
+        seed = seed * 1103515245 + 12345;
+        c = char(seed >> 16);
+      }
+      const std::string key = fmt::StringPrintf("k%05d", i);
+      ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+    }
+    ASSERT_EQ(nullptr, DBFlush(db).data);
+
+    DBEngine* batch = DBNewBatch(db, true);
+    DBIterator* iter = DBNewIter(db, false);
+    ASSERT_EQ(nullptr, DBDeleteIterRangeAdaptive(batch, iter, DBKey{ToDBSlice("a"), 0, 0},
+                                                 DBKey{ToDBSlice("z"), 0, 0})
+                           .data);
+    DBIterDestroy(iter);
+
+    const DBSlice repr = DBBatchRepr(batch);
+    rocksdb::WriteBatch wb(std::string(repr.data, repr.len));
+    deleteCounter counter;
+    ASSERT_TRUE(wb.Iterate(&counter).ok());
+    EXPECT_EQ(t.expected_deletes, counter.deletes);
+    EXPECT_EQ(t.expected_range_deletes, counter.range_deletes);
+
+    // Either way, all of the keys are deleted.
+    ASSERT_EQ(nullptr, DBCommitAndCloseBatch(batch, false).data);
+    iter = DBNewIter(db, false);
+    EXPECT_FALSE(DBIterSeekToFirst(iter).valid);
+    DBIterDestroy(iter);
+
+    DBClose(db);
+    DBReleaseCache(db_opts.cache);
+  }
+}
+
+TEST(Libroach, TimeBoundIterBlockSkipping) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // Old versions of many keys and a single recent one, in one sstable.
+  for (int i = 0; i < 1000; i++) {
+    const std::string key = fmt::StringPrintf("k%05d", i);
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(key), i == 500 ? 100 : 1, 0}, ToDBSlice("value")).data);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+
+  // scan returns the keys in [min, max] seen by a time bound iterator
+  // and adds the change in the counters to *stats.
+  auto scan = [db](int64_t min, int64_t max, DBTimeBoundIterStats* stats) {
+    const DBTimeBoundIterStats before = DBGetTimeBoundIterStats();
+    std::vector<std::string> keys;
+    DBIterator* iter = DBNewTimeBoundIter(db, DBTimestamp{min, 0}, DBTimestamp{max, 0});
+    for (DBIterState s = DBIterSeekToFirst(iter); s.valid; s = DBIterNext(iter, false)) {
+      if (s.key.wall_time >= min && s.key.wall_time <= max) {
+        keys.push_back(ToString(s.key.key));
+      }
+    }
+    DBIterDestroy(iter);
+    const DBTimeBoundIterStats after = DBGetTimeBoundIterStats();
+    *stats = DBTimeBoundIterStats{after.tables_read - before.tables_read,
+                                  after.tables_skipped - before.tables_skipped,
+                                  after.blocks_read - before.blocks_read,
+                                  after.blocks_skipped - before.blocks_skipped};
+    return keys;
+  };
+
+  // The sstable is read, but only the blocks around the recent version.
+  DBTimeBoundIterStats stats;
+  EXPECT_EQ(std::vector<std::string>({"k00500"}), scan(50, 200, &stats));
+  EXPECT_GE(stats.tables_read, 1);
+  EXPECT_EQ(0, stats.tables_skipped);
+  EXPECT_GE(stats.blocks_read, 1);
+  EXPECT_GT(stats.blocks_skipped, stats.blocks_read);
+
+  // The sstable is skipped.
+  EXPECT_EQ(std::vector<std::string>(), scan(500, 600, &stats));
+  EXPECT_EQ(0, stats.tables_read);
+  EXPECT_GE(stats.tables_skipped, 1);
+
+  // The bounds of new sstables are picked up, and those of compacted
+  // sstables dropped.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("k00700"), 150, 0}, ToDBSlice("value")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  EXPECT_EQ(std::vector<std::string>({"k00500", "k00700"}), scan(50, 200, &stats));
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  EXPECT_EQ(std::vector<std::string>({"k00500", "k00700"}), scan(50, 200, &stats));
+  EXPECT_GT(stats.blocks_skipped, stats.blocks_read);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, TimeBoundIterFlushDuringConstruction) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  // One key in an sstable, with per-block timestamp bounds, and one in
+  // the memtable which is not described by any sstable.
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("a"), 5, 0}, ToDBSlice("a")).data);
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("m"), 5, 0}, ToDBSlice("m")).data);
+
+  // Flush the memtable while the iterator is being built, after it has
+  // read the table properties.
+  static int flushes;
+  flushes = 1;
+  SetTimeBoundIterTestingHook([](DBEngine* db) {
+    if (flushes > 0) {
+      flushes--;
+      ASSERT_EQ(nullptr, DBFlush(db).data);
+    }
+  });
+  DBIterator* iter = DBNewTimeBoundIter(db, DBTimestamp{1, 0}, DBTimestamp{10, 0});
+  SetTimeBoundIterTestingHook(nullptr);
+  EXPECT_EQ(0, flushes);
+
+  std::vector<std::string> keys;
+  for (DBIterState s = DBIterSeekToFirst(iter); s.valid; s = DBIterNext(iter, false)) {
+    keys.push_back(ToString(s.key.key));
+  }
+  EXPECT_EQ(std::vector<std::string>({"a", "m"}), keys);
+  DBIterDestroy(iter);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, ExportToSst) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  struct version {
+    const char* key;
+    int64_t wall_time;
+    const char* value;
+  };
+  const std::vector<version> versions = {
+      {"a", 1, "a1"}, {"a", 3, "a3"}, {"a", 5, ""}, {"b", 2, "b2"}, {"b", 4, "b4"}, {"c", 6, "c6"},
+  };
+  for (const auto& v : versions) {
+    ASSERT_EQ(nullptr,
+              DBPut(db, DBKey{ToDBSlice(v.key), v.wall_time, 0}, ToDBSlice(v.value)).data);
+  }
+  // Some of the versions are in an sstable and some in the memtable.
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("d"), 3, 0}, ToDBSlice("d3")).data);
+
+  struct testCase {
+    int64_t start_ts;
+    bool all_revisions;
+    int64_t target_size;
+    std::vector<std::string> expected;
+    std::string expected_resume_key;
+  };
+  const std::vector<testCase> testCases = {
+      // The latest version of each key, omitting deletions.
+      {0, false, 0, {"b@4=b4", "d@3=d3"}, ""},
+      // All of the versions up to end_ts.
+      {0, true, 0, {"a@5=", "a@3=a3", "a@1=a1", "b@4=b4", "b@2=b2", "d@3=d3"}, ""},
+      // An incremental export of the latest versions includes deletions.
+      {2, false, 0, {"a@5=", "b@4=b4", "d@3=d3"}, ""},
+      {2, true, 0, {"a@5=", "a@3=a3", "b@4=b4", "d@3=d3"}, ""},
+      // The export stops at a key boundary once target_size is reached.
+      {0, true, 1, {"a@5=", "a@3=a3", "a@1=a1"}, "b"},
+  };
+  for (const auto& t : testCases) {
+    SCOPED_TRACE(std::to_string(t.start_ts) + " " + std::to_string(t.all_revisions) + " " +
+                 std::to_string(t.target_size));
+    DBString sst, resume_key;
+    ASSERT_EQ(nullptr, DBExportToSst(db, DBKey{ToDBSlice("a"), 0, 0}, DBKey{ToDBSlice("z"), 0, 0},
+                                     DBTimestamp{t.start_ts, 0}, DBTimestamp{5, 0},
+                                     t.all_revisions, t.target_size, &sst, &resume_key)
+                           .data);
+    EXPECT_EQ(t.expected, sstEntries(ToString(sst)));
+    EXPECT_EQ(t.expected_resume_key, ToString(resume_key));
+    free(sst.data);
+    free(resume_key.data);
+  }
+
+  // Nothing to export returns an empty sstable.
+  DBString sst, resume_key;
+  ASSERT_EQ(nullptr, DBExportToSst(db, DBKey{ToDBSlice("c"), 0, 0}, DBKey{ToDBSlice("d"), 0, 0},
+                                   DBTimestamp{0, 0}, DBTimestamp{5, 0}, true, 0, &sst,
+                                   &resume_key)
+                         .data);
+  EXPECT_EQ(0, sst.len);
+
+  // An intent in (start_ts, end_ts] is an error.
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.mutable_txn()->set_id("txn");
+  meta.mutable_timestamp()->set_wall_time(4);
+  ASSERT_EQ(nullptr,
+            DBPut(db, DBKey{ToDBSlice("e"), 0, 0}, ToDBSlice(meta.SerializeAsString())).data);
+  ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice("e"), 4, 0}, ToDBSlice("e4")).data);
+  DBStatus status = DBExportToSst(db, DBKey{ToDBSlice("a"), 0, 0}, DBKey{ToDBSlice("z"), 0, 0},
+                                  DBTimestamp{0, 0}, DBTimestamp{5, 0}, true, 0, &sst, &resume_key);
+  ASSERT_NE(nullptr, status.data);
+  EXPECT_NE(std::string::npos, ToString(status).find("conflicting intent")) << ToString(status);
+  free(status.data);
+
+  // An intent at or below start_ts is ignored, as is its provisional
+  // value.
+  ASSERT_EQ(nullptr, DBExportToSst(db, DBKey{ToDBSlice("a"), 0, 0}, DBKey{ToDBSlice("z"), 0, 0},
+                                   DBTimestamp{4, 0}, DBTimestamp{5, 0}, true, 0, &sst,
+                                   &resume_key)
+                         .data);
+  EXPECT_EQ(std::vector<std::string>({"a@5="}), sstEntries(ToString(sst)));
+  free(sst.data);
+  free(resume_key.data);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
+
+TEST(Libroach, SstFileWriterTruncate) {
+  DBSstFileWriterOptions opts = {};
+  opts.block_size = 4 << 10;
+  DBSstFileWriter* fw = DBSstFileWriterNewWithOptions(opts);
+  ASSERT_EQ(nullptr, DBSstFileWriterOpen(fw).data);
+
+  // Drain the writer as the sstable is built. The chunks are returned
+  // in order and their concatenation (with the data returned by
+  // Finish) is the sstable.
+  const std::string value(1000, 'v');
+  std::vector<std::string> expected;
+  std::string sst;
+  int non_empty_chunks = 0;
+  for (int i = 0; i < 5000; i++) {
+    const std::string key = fmt::StringPrintf("k%04d", i);
+    ASSERT_EQ(nullptr, DBSstFileWriterAdd(fw, DBKey{ToDBSlice(key), 1, 0}, ToDBSlice(value)).data);
+    expected.push_back(key + "@1=" + value);
+    if (i % 500 == 499) {
+      DBString chunk;
+      ASSERT_EQ(nullptr, DBSstFileWriterTruncate(fw, &chunk).data);
+      non_empty_chunks += chunk.len > 0;
+      sst.append(chunk.data, chunk.len);
+      free(chunk.data);
+    }
+  }
+  DBString rest;
+  ASSERT_EQ(nullptr, DBSstFileWriterFinish(fw, &rest).data);
+  sst.append(rest.data, rest.len);
+  free(rest.data);
+  DBSstFileWriterClose(fw);
+
+  // The data was returned as it was written rather than all at once
+  // (the file writer buffers up to 1MB before writing to the sink).
+  EXPECT_GE(non_empty_chunks, 4);
+  EXPECT_EQ(expected, sstEntries(sst));
+
+  // A writer created by DBSstFileWriterNew cannot be truncated.
+  fw = DBSstFileWriterNew();
+  ASSERT_EQ(nullptr, DBSstFileWriterOpen(fw).data);
+  DBString chunk;
+  DBStatus status = DBSstFileWriterTruncate(fw, &chunk);
+  EXPECT_NE(nullptr, status.data);
+  free(status.data);
+  DBSstFileWriterClose(fw);
+}
+
+TEST(Libroach, CompactRangeParallel) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(1 << 20);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  ASSERT_EQ(nullptr, DBOpen(&db, DBSlice(), db_opts).data);
+
+  auto key = [](int i) { return fmt::StringPrintf("k%05d", i); };
+  auto put = [db, &key](int i, const std::string& value) {
+    ASSERT_EQ(nullptr, DBPut(db, DBKey{ToDBSlice(key(i)), 1, 0}, ToDBSlice(value)).data);
+  };
+  // tableLevels returns the levels of the sstables.
+  auto tableLevels = [db]() {
+    int n;
+    DBSSTable* tables = DBGetSSTables(db, &n);
+    std::vector<int> levels;
+    for (int i = 0; i < n; i++) {
+      levels.push_back(tables[i].level);
+      free(tables[i].start_key.key.data);
+      free(tables[i].end_key.key.data);
+    }
+    free(tables);
+    return levels;
+  };
+
+  // Fill the bottom level with several sstables, then overwrite some
+  // of the keys in L0 so that the compaction has work to do.
+  const int kNumKeys = 12000;
+  const std::string value(1000, 'a');
+  for (int i = 0; i < kNumKeys; i++) {
+    put(i, value);
+  }
+  ASSERT_EQ(nullptr, DBCompact(db).data);
+  ASSERT_GE(tableLevels().size(), 2);
+  const std::string new_value(1000, 'b');
+  for (int i = 0; i < kNumKeys; i += 3) {
+    put(i, new_value);
+  }
+  ASSERT_EQ(nullptr, DBFlush(db).data);
+  const std::vector<int> levels = tableLevels();
+  EXPECT_EQ(1, std::count(levels.begin(), levels.end(), 0));
+
+  DBCompactRangeProgress* progress = DBNewCompactRangeProgress();
+  ASSERT_EQ(nullptr, DBCompactRangeParallel(db, DBSlice(), DBSlice(), 4, progress).data);
+  uint64_t bytes_done, bytes_total;
+  DBCompactRangeProgressGet(progress, &bytes_done, &bytes_total);
+  EXPECT_GT(bytes_total, 0);
+  EXPECT_EQ(bytes_total, bytes_done);
+  DBCompactRangeProgressDestroy(progress);
+
+  // All of the sstables are in the bottom level and the latest value of
+  // every key is readable.
+  for (int level : tableLevels()) {
+    EXPECT_EQ(6, level);
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    DBString result;
+    ASSERT_EQ(nullptr, DBGet(db, DBKey{ToDBSlice(key(i)), 1, 0}, &result).data);
+    EXPECT_EQ(i % 3 == 0 ? new_value : value, ToString(result)) << key(i);
+    free(result.data);
+  }
+
+  // A canceled compaction does not compact any chunks.
+  progress = DBNewCompactRangeProgress();
+  DBCompactRangeProgressCancel(progress);
+  DBStatus status = DBCompactRangeParallel(db, DBSlice(), DBSlice(), 4, progress);
+  EXPECT_NE(std::string::npos, ToString(status).find("canceled"));
+  free(status.data);
+  DBCompactRangeProgressGet(progress, &bytes_done, &bytes_total);
+  EXPECT_EQ(0, bytes_done);
+  DBCompactRangeProgressDestroy(progress);
+
+  DBClose(db);
+  DBReleaseCache(db_opts.cache);
+}
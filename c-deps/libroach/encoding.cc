@@ -15,6 +15,23 @@
 #include "encoding.h"
 #include "rocksdb/slice.h"
 
+namespace {
+
+// The tags of the varint encoding. See the Go encoding package.
+const int kIntMin = 0x80;
+const int kIntMax = 0xfd;
+const int kIntMaxWidth = 8;
+const int kIntZero = kIntMin + kIntMaxWidth;
+const int kIntSmall = kIntMax - kIntZero - kIntMaxWidth;
+
+// The escapes of the bytes encoding. See the Go encoding package.
+const char kBytesMarker = 0x12;
+const char kEscape = 0x00;
+const char kEscapedTerm = 0x01;
+const char kEscaped00 = char(0xff);
+
+}  // namespace
+
 void EncodeUint32(std::string* buf, uint32_t v) {
   const uint8_t tmp[sizeof(v)] = {
       uint8_t(v >> 24),
@@ -56,3 +73,88 @@ bool DecodeUint64(rocksdb::Slice* buf, uint64_t* value) {
   buf->remove_prefix(N);
   return true;
 }
+
+void EncodeVarintAscending(std::string* buf, int64_t v) {
+  // Non-negative values are encoded as uvarints. Negative values are
+  // encoded as a tag holding the number of bytes needed followed by
+  // the big-endian bytes of the value.
+  if (v >= 0 && v <= kIntSmall) {
+    buf->push_back(char(kIntZero + v));
+    return;
+  }
+  const uint64_t u = v < 0 ? uint64_t(0) - uint64_t(v) : uint64_t(v);
+  int n = 1;
+  while (n < 8 && (u >> (8 * n)) != 0) {
+    n++;
+  }
+  buf->push_back(char(v < 0 ? kIntZero - n : kIntMax - 8 + n));
+  for (int i = n - 1; i >= 0; i--) {
+    buf->push_back(char(uint64_t(v) >> (8 * i)));
+  }
+}
+
+bool DecodeVarintAscending(rocksdb::Slice* buf, int64_t* value) {
+  if (buf->empty()) {
+    return false;
+  }
+  const uint8_t* b = reinterpret_cast<const uint8_t*>(buf->data());
+  int length = int(b[0]) - kIntZero;
+  if (length >= 0 && length <= kIntSmall) {
+    *value = length;
+    buf->remove_prefix(1);
+    return true;
+  }
+  const bool negative = length < 0;
+  length = negative ? -length : length - kIntSmall;
+  if (length > 8 || buf->size() < 1 + length) {
+    return false;
+  }
+  uint64_t v = negative ? ~uint64_t(0) : 0;
+  for (int i = 1; i <= length; i++) {
+    v = (v << 8) | b[i];
+  }
+  if (!negative && int64_t(v) < 0) {
+    // The value overflows an int64.
+    return false;
+  }
+  *value = int64_t(v);
+  buf->remove_prefix(1 + length);
+  return true;
+}
+
+void EncodeBytesAscending(std::string* buf, const rocksdb::Slice& v) {
+  buf->push_back(kBytesMarker);
+  for (size_t i = 0; i < v.size(); i++) {
+    buf->push_back(v[i]);
+    if (v[i] == kEscape) {
+      buf->push_back(kEscaped00);
+    }
+  }
+  buf->push_back(kEscape);
+  buf->push_back(kEscapedTerm);
+}
+
+bool DecodeBytesAscending(rocksdb::Slice* buf, std::string* value) {
+  if (buf->empty() || (*buf)[0] != kBytesMarker) {
+    return false;
+  }
+  value->clear();
+  for (size_t i = 1; i + 1 < buf->size(); i++) {
+    const char c = (*buf)[i];
+    if (c != kEscape) {
+      value->push_back(c);
+      continue;
+    }
+    const char next = (*buf)[i + 1];
+    if (next == kEscapedTerm) {
+      buf->remove_prefix(i + 2);
+      return true;
+    }
+    if (next != kEscaped00) {
+      return false;
+    }
+    value->push_back(kEscape);
+    i++;
+  }
+  return false;
+}
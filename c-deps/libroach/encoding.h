@@ -33,6 +33,27 @@ bool DecodeUint32(rocksdb::Slice* buf, uint32_t* value);
 // true on a successful decode. The decoded value is returned in *value.
 bool DecodeUint64(rocksdb::Slice* buf, uint64_t* value);
 
+// EncodeVarintAscending encodes the int64 value using the variable
+// length, order-preserving encoding of the Go
+// encoding.EncodeVarintAscending. The encoded bytes are appended to
+// the supplied buffer.
+void EncodeVarintAscending(std::string* buf, int64_t v);
+
+// DecodeVarintAscending decodes a value encoded by
+// EncodeVarintAscending from a buffer, returning true on a successful
+// decode. The decoded value is returned in *value.
+bool DecodeVarintAscending(rocksdb::Slice* buf, int64_t* value);
+
+// EncodeBytesAscending encodes the bytes using the escape-based,
+// order-preserving encoding of the Go encoding.EncodeBytesAscending.
+// The encoded bytes are appended to the supplied buffer.
+void EncodeBytesAscending(std::string* buf, const rocksdb::Slice& v);
+
+// DecodeBytesAscending decodes bytes encoded by EncodeBytesAscending
+// from a buffer, returning true on a successful decode. The decoded
+// bytes are returned in *value.
+bool DecodeBytesAscending(rocksdb::Slice* buf, std::string* value);
+
 // local variables:
 // mode: c++
 // end:
@@ -65,3 +65,82 @@ TEST(Libroach, Encoding) {
     EXPECT_EQ(*it, out);
   }
 }
+
+TEST(Libroach, EncodingVarintAscending) {
+  // The encodings match those of the Go encoding package.
+  // clang-format off
+  const std::vector<std::pair<int64_t, std::string>> cases{
+    {0, "\x88"},
+    {109, "\xf5"},
+    {110, std::string("\xf6\x6e")},
+    {256, std::string("\xf7\x01\x00", 3)},
+    {-1, "\x87\xff"},
+    {-255, std::string("\x87\x01")},
+    {-256, std::string("\x86\xff\x00", 3)},
+    {INT64_MAX, "\xfd\x7f\xff\xff\xff\xff\xff\xff\xff"},
+    {INT64_MIN, std::string("\x80\x80\x00\x00\x00\x00\x00\x00\x00", 9)},
+  };
+  // clang-format on
+
+  for (const auto& c : cases) {
+    std::string buf;
+    EncodeVarintAscending(&buf, c.first);
+    EXPECT_EQ(c.second, buf);
+    int64_t out;
+    rocksdb::Slice slice(buf);
+    EXPECT_TRUE(DecodeVarintAscending(&slice, &out));
+    EXPECT_EQ(c.first, out);
+    EXPECT_TRUE(slice.empty());
+  }
+
+  // The encoding preserves order.
+  std::mt19937 rng;
+  std::uniform_int_distribution<int64_t> uniform64;
+  for (int i = 0; i < 64; i++) {
+    // Vary the magnitude so that all of the encoded lengths are used.
+    const int64_t a = uniform64(rng) / (int64_t(1) << (i % 63));
+    const int64_t b = uniform64(rng) / (int64_t(1) << ((i * 7) % 63));
+    std::string abuf, bbuf;
+    EncodeVarintAscending(&abuf, a);
+    EncodeVarintAscending(&bbuf, b);
+    EXPECT_EQ(a < b, abuf < bbuf);
+    int64_t out;
+    rocksdb::Slice slice(abuf);
+    EXPECT_TRUE(DecodeVarintAscending(&slice, &out));
+    EXPECT_EQ(a, out);
+  }
+
+  int64_t out;
+  rocksdb::Slice truncated("\xf7\x01", 2);
+  EXPECT_FALSE(DecodeVarintAscending(&truncated, &out));
+}
+
+TEST(Libroach, EncodingBytesAscending) {
+  const std::vector<std::pair<std::string, std::string>> cases{
+      {"", std::string("\x12\x00\x01", 3)},
+      {"foo", std::string("\x12"
+                          "foo\x00\x01",
+                          6)},
+      {std::string("a\x00b", 3), std::string("\x12"
+                                             "a\x00\xff"
+                                             "b\x00\x01",
+                                             7)},
+  };
+
+  for (const auto& c : cases) {
+    std::string buf;
+    EncodeBytesAscending(&buf, c.first);
+    EXPECT_EQ(c.second, buf);
+    buf.append("rest");
+    std::string out;
+    rocksdb::Slice slice(buf);
+    EXPECT_TRUE(DecodeBytesAscending(&slice, &out));
+    EXPECT_EQ(c.first, out);
+    EXPECT_EQ("rest", slice.ToString());
+  }
+
+  std::string out;
+  rocksdb::Slice unterminated("\x12"
+                              "foo");
+  EXPECT_FALSE(DecodeBytesAscending(&unterminated, &out));
+}
@@ -0,0 +1,452 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "env_readahead.h"
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+bool isTableFile(const std::string& fname) {
+  static const std::string suffix = ".sst";
+  return fname.size() >= suffix.size() &&
+         fname.compare(fname.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// readaheadBuffer holds a range of a file which was read ahead. The
+// bytes it holds are accounted for in the env's BufferedBytes.
+struct readaheadBuffer {
+  explicit readaheadBuffer(ReadaheadEnv* env) : env(env), offset(0), eof(false) {}
+  ~readaheadBuffer() { env->AddBufferedBytes(-int64_t(data.size())); }
+
+  bool Contains(uint64_t off, size_t n) const {
+    return off >= offset && off + n <= offset + data.size();
+  }
+  uint64_t End() const { return offset + data.size(); }
+
+  ReadaheadEnv* const env;
+  uint64_t offset;
+  std::string data;
+  // Whether the read was cut short by the end of the file.
+  bool eof;
+};
+
+typedef std::shared_ptr<const readaheadBuffer> readaheadBufferPtr;
+
+// readRange reads n bytes at offset from the file into a new buffer.
+rocksdb::Status readRange(ReadaheadEnv* env, rocksdb::RandomAccessFile* file, uint64_t offset,
+                          size_t n, std::shared_ptr<readaheadBuffer>* result_buf) {
+  std::shared_ptr<readaheadBuffer> buf = std::make_shared<readaheadBuffer>(env);
+  buf->offset = offset;
+  buf->data.resize(n);
+  rocksdb::Slice result;
+  rocksdb::Status status = file->Read(offset, n, &result, &buf->data[0]);
+  if (!status.ok()) {
+    buf->data.clear();
+    return status;
+  }
+  if (result.data() != buf->data.data()) {
+    // Some files (e.g. those of a MemEnv) return their own memory
+    // rather than filling in the scratch buffer.
+    std::string copy(result.data(), result.size());
+    buf->data.swap(copy);
+  } else {
+    buf->data.resize(result.size());
+  }
+  buf->eof = buf->data.size() < n;
+  env->AddBufferedBytes(buf->data.size());
+  *result_buf = std::move(buf);
+  return rocksdb::Status::OK();
+}
+
+// readaheadStream is the state of a sequential run of reads of a
+// file.
+struct readaheadStream {
+  readaheadStream() : next_offset(0), window(0), prefetching(false), live(true) {}
+
+  // The offset following the end of the previous read.
+  uint64_t next_offset;
+  // The current readahead size.
+  size_t window;
+  // The buffer reads are currently served from and the prefetched
+  // buffer which follows it.
+  readaheadBufferPtr cur;
+  readaheadBufferPtr next;
+  bool prefetching;
+  // Whether the stream is still one of the file's streams (a prefetch
+  // may complete after the stream was dropped).
+  bool live;
+  std::chrono::steady_clock::time_point last_use;
+};
+
+typedef std::shared_ptr<readaheadStream> readaheadStreamPtr;
+
+// readaheadState is the state of a readahead file. It is shared with
+// the file's in-flight prefetches, which may outlive the file.
+struct readaheadState {
+  readaheadState(ReadaheadEnv* env, std::unique_ptr<rocksdb::RandomAccessFile> file)
+      : env(env),
+        file(std::move(file)),
+        num_streams(0),
+        tracked(false) {}
+
+  ReadaheadEnv* const env;
+  const std::unique_ptr<rocksdb::RandomAccessFile> file;
+  // The candidate runs among the reads which are not part of a
+  // stream: the offset following the end of a candidate's last read
+  // and its number of consecutive sequential reads. These detect new
+  // runs without locking.
+  struct candidate {
+    candidate() : next_offset(0), seq_reads(0) {}
+    std::atomic<uint64_t> next_offset;
+    std::atomic<int> seq_reads;
+  };
+  candidate candidates[ReadaheadEnv::kMaxStreams];
+  // The number of streams, which is read without locking to let the
+  // reads of a file without streams bypass mu.
+  std::atomic<int> num_streams;
+  std::mutex mu;
+  std::vector<readaheadStreamPtr> streams;
+  // Whether the state is tracked by the env for idle streams.
+  bool tracked;
+};
+
+typedef std::shared_ptr<readaheadState> readaheadStatePtr;
+
+class readaheadFile : public rocksdb::RandomAccessFile {
+ public:
+  readaheadFile(ReadaheadEnv* env, std::unique_ptr<rocksdb::RandomAccessFile> file)
+      : state_(std::make_shared<readaheadState>(env, std::move(file))) {}
+
+  virtual ~readaheadFile() {
+    // Release the buffers now rather than when the in-flight prefetches
+    // and the env's tracking let go of the state.
+    std::lock_guard<std::mutex> l(state_->mu);
+    dropStreamsLocked(state_, std::chrono::steady_clock::time_point::max());
+  }
+
+  virtual rocksdb::Status Read(uint64_t offset, size_t n, rocksdb::Slice* result,
+                               char* scratch) const override {
+    const readaheadStatePtr& s = state_;
+    const bool has_streams = s->num_streams.load(std::memory_order_relaxed) > 0;
+    if (!has_streams && !detectSequential(s, offset, n)) {
+      return s->file->Read(offset, n, result, scratch);
+    }
+
+    readaheadStreamPtr st;
+    size_t window = 0;
+    {
+      std::lock_guard<std::mutex> l(s->mu);
+      const auto now = std::chrono::steady_clock::now();
+      st = findStreamLocked(s, offset, n);
+      if (st == nullptr) {
+        if (has_streams && !detectSequential(s, offset, n)) {
+          // Not part of a run; leave the runs alone.
+          return s->file->Read(offset, n, result, scratch);
+        }
+        st = newStreamLocked(s, offset);
+      }
+      st->last_use = now;
+      st->next_offset = offset + n;
+
+      if (st->next != nullptr && st->next->Contains(offset, n)) {
+        st->cur = std::move(st->next);
+        st->next.reset();
+      }
+      if (st->cur != nullptr && st->cur->Contains(offset, n)) {
+        memcpy(scratch, st->cur->data.data() + (offset - st->cur->offset), n);
+        *result = rocksdb::Slice(scratch, n);
+        s->env->AddHitBytes(n);
+        if (st->cur->eof && offset + n == st->cur->End()) {
+          // The run reached the end of the file.
+          dropStreamLocked(s, st);
+        } else {
+          maybePrefetchLocked(s, st, offset + n);
+        }
+        return rocksdb::Status::OK();
+      }
+      st->window = growWindow(s, st->window);
+      window = st->window;
+    }
+
+    if (window <= n) {
+      return s->file->Read(offset, n, result, scratch);
+    }
+
+    std::shared_ptr<readaheadBuffer> buf;
+    rocksdb::Status status = readRange(s->env, s->file.get(), offset, window, &buf);
+    if (!status.ok()) {
+      return status;
+    }
+    const size_t copied = std::min(n, buf->data.size());
+    memcpy(scratch, buf->data.data(), copied);
+    *result = rocksdb::Slice(scratch, copied);
+    s->env->AddReadaheadBytes(buf->data.size() - copied);
+
+    std::lock_guard<std::mutex> l(s->mu);
+    if (!st->live) {
+      // Evicted by another run in the meantime.
+      return rocksdb::Status::OK();
+    }
+    if (buf->eof && copied == buf->data.size()) {
+      dropStreamLocked(s, st);
+      return rocksdb::Status::OK();
+    }
+    st->cur = std::move(buf);
+    st->next.reset();
+    maybePrefetchLocked(s, st, offset + copied);
+    return rocksdb::Status::OK();
+  }
+
+  virtual size_t GetUniqueId(char* id, size_t max_size) const override {
+    return state_->file->GetUniqueId(id, max_size);
+  }
+
+  virtual void Hint(AccessPattern pattern) override { state_->file->Hint(pattern); }
+
+  virtual bool use_direct_io() const override { return state_->file->use_direct_io(); }
+
+  virtual size_t GetRequiredBufferAlignment() const override {
+    return state_->file->GetRequiredBufferAlignment();
+  }
+
+  virtual rocksdb::Status InvalidateCache(size_t offset, size_t length) override {
+    {
+      std::lock_guard<std::mutex> l(state_->mu);
+      dropStreamsLocked(state_, std::chrono::steady_clock::time_point::max());
+    }
+    return state_->file->InvalidateCache(offset, length);
+  }
+
+ private:
+  // detectSequential records a read which is not part of a stream,
+  // returning true once it is the kSequentialReads-th consecutive
+  // sequential read of a candidate run. A read which continues no
+  // candidate replaces the candidate with the fewest sequential reads.
+  static bool detectSequential(const readaheadStatePtr& s, uint64_t offset, size_t n) {
+    readaheadState::candidate* fewest = &s->candidates[0];
+    for (auto& c : s->candidates) {
+      uint64_t expected = offset;
+      if (c.next_offset.compare_exchange_strong(expected, offset + n,
+                                                std::memory_order_relaxed)) {
+        if (c.seq_reads.fetch_add(1, std::memory_order_relaxed) + 1 <
+            ReadaheadEnv::kSequentialReads) {
+          return false;
+        }
+        // The run becomes a stream; free the candidate.
+        c.seq_reads.store(0, std::memory_order_relaxed);
+        c.next_offset.store(0, std::memory_order_relaxed);
+        return true;
+      }
+      if (c.seq_reads.load(std::memory_order_relaxed) <
+          fewest->seq_reads.load(std::memory_order_relaxed)) {
+        fewest = &c;
+      }
+    }
+    fewest->next_offset.store(offset + n, std::memory_order_relaxed);
+    fewest->seq_reads.store(0, std::memory_order_relaxed);
+    return false;
+  }
+
+  // findStreamLocked returns the stream the read continues, if any.
+  static readaheadStreamPtr findStreamLocked(const readaheadStatePtr& s, uint64_t offset,
+                                             size_t n) {
+    for (const auto& st : s->streams) {
+      if (st->next_offset == offset || (st->cur != nullptr && st->cur->Contains(offset, n)) ||
+          (st->next != nullptr && st->next->Contains(offset, n))) {
+        return st;
+      }
+    }
+    return nullptr;
+  }
+
+  // newStreamLocked starts a stream, replacing the least recently used
+  // one if the file has kMaxStreams of them.
+  static readaheadStreamPtr newStreamLocked(const readaheadStatePtr& s, uint64_t offset) {
+    if (s->streams.size() >= size_t(ReadaheadEnv::kMaxStreams)) {
+      auto lru = std::min_element(s->streams.begin(), s->streams.end(),
+                                  [](const readaheadStreamPtr& a, const readaheadStreamPtr& b) {
+                                    return a->last_use < b->last_use;
+                                  });
+      dropStreamLocked(s, *lru);
+    }
+    readaheadStreamPtr st = std::make_shared<readaheadStream>();
+    st->next_offset = offset;
+    s->streams.push_back(st);
+    s->num_streams.store(int(s->streams.size()), std::memory_order_relaxed);
+    if (!s->tracked) {
+      s->tracked = true;
+      std::weak_ptr<readaheadState> weak(s);
+      s->env->Track([weak](std::chrono::steady_clock::time_point idle) {
+        readaheadStatePtr s = weak.lock();
+        if (s == nullptr) {
+          return false;
+        }
+        std::lock_guard<std::mutex> l(s->mu);
+        dropStreamsLocked(s, idle);
+        s->tracked = !s->streams.empty();
+        return s->tracked;
+      });
+    }
+    return st;
+  }
+
+  // dropStreamLocked drops the stream, releasing its buffers.
+  static void dropStreamLocked(const readaheadStatePtr& s, const readaheadStreamPtr& st) {
+    st->live = false;
+    st->cur.reset();
+    st->next.reset();
+    s->streams.erase(std::find(s->streams.begin(), s->streams.end(), st));
+    s->num_streams.store(int(s->streams.size()), std::memory_order_relaxed);
+  }
+
+  // dropStreamsLocked drops the streams last used before idle.
+  static void dropStreamsLocked(const readaheadStatePtr& s,
+                                std::chrono::steady_clock::time_point idle) {
+    for (size_t i = 0; i < s->streams.size();) {
+      if (s->streams[i]->last_use < idle) {
+        dropStreamLocked(s, readaheadStreamPtr(s->streams[i]));
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  // growWindow returns the readahead size following window.
+  static size_t growWindow(const readaheadStatePtr& s, size_t window) {
+    return std::min(window == 0 ? ReadaheadEnv::kInitialReadahead : 2 * window,
+                    s->env->MaxReadahead());
+  }
+
+  // maybePrefetchLocked starts prefetching the range following the
+  // stream's current buffer once the reader has consumed half of it.
+  static void maybePrefetchLocked(const readaheadStatePtr& s, const readaheadStreamPtr& st,
+                                  uint64_t consumed) {
+    const readaheadBufferPtr& cur = st->cur;
+    if (cur == nullptr || cur->eof || st->window == 0 || st->prefetching ||
+        consumed < cur->offset + cur->data.size() / 2 ||
+        (st->next != nullptr && st->next->offset == cur->End())) {
+      return;
+    }
+    st->window = growWindow(s, st->window);
+    const uint64_t offset = cur->End();
+    const size_t size = st->window;
+    st->prefetching = true;
+    s->env->Prefetch([s, st, offset, size] {
+      std::shared_ptr<readaheadBuffer> buf;
+      const bool ok = readRange(s->env, s->file.get(), offset, size, &buf).ok();
+      std::lock_guard<std::mutex> l(s->mu);
+      st->prefetching = false;
+      if (!ok || buf->data.empty()) {
+        return;
+      }
+      s->env->AddReadaheadBytes(buf->data.size());
+      // The prefetch is discarded if the stream was dropped or the
+      // reader has moved on.
+      if (st->live && st->cur != nullptr && st->cur->End() == offset) {
+        st->next = std::move(buf);
+      }
+    });
+  }
+
+  const readaheadStatePtr state_;
+};
+
+}  // namespace
+
+const int ReadaheadEnv::kSequentialReads;
+const size_t ReadaheadEnv::kInitialReadahead;
+const int ReadaheadEnv::kMaxStreams;
+const int ReadaheadEnv::kIdleMillis;
+
+ReadaheadEnv::ReadaheadEnv(rocksdb::Env* base_env, size_t max_readahead)
+    : rocksdb::EnvWrapper(base_env),
+      max_readahead_(std::max(max_readahead, kInitialReadahead)),
+      readahead_bytes_(0),
+      hit_bytes_(0),
+      buffered_bytes_(0),
+      stopping_(false),
+      thread_(&ReadaheadEnv::run, this) {}
+
+ReadaheadEnv::~ReadaheadEnv() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+rocksdb::Status ReadaheadEnv::NewRandomAccessFile(
+    const std::string& fname, std::unique_ptr<rocksdb::RandomAccessFile>* result,
+    const rocksdb::EnvOptions& options) {
+  rocksdb::Status status = target()->NewRandomAccessFile(fname, result, options);
+  if (!status.ok() || options.use_direct_reads || options.use_mmap_reads || !isTableFile(fname)) {
+    return status;
+  }
+  result->reset(new readaheadFile(this, std::move(*result)));
+  return status;
+}
+
+void ReadaheadEnv::Prefetch(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    queue_.push_back(std::move(fn));
+  }
+  cv_.notify_one();
+}
+
+void ReadaheadEnv::Track(IdleFn fn) {
+  std::lock_guard<std::mutex> l(mu_);
+  tracked_.push_back(std::move(fn));
+}
+
+void ReadaheadEnv::run() {
+  const std::chrono::milliseconds idle(kIdleMillis);
+  std::unique_lock<std::mutex> l(mu_);
+  auto next_check = std::chrono::steady_clock::now() + idle;
+  for (;;) {
+    cv_.wait_until(l, next_check, [this] { return stopping_ || !queue_.empty(); });
+    if (stopping_) {
+      // Pending prefetches are dropped, releasing their files.
+      queue_.clear();
+      tracked_.clear();
+      return;
+    }
+    if (!queue_.empty()) {
+      std::function<void()> fn = std::move(queue_.front());
+      queue_.pop_front();
+      l.unlock();
+      fn();
+      l.lock();
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now < next_check) {
+      continue;
+    }
+    // Drop the streams which have been idle since the last check. The
+    // files are called without holding mu_, which they acquire (via
+    // Prefetch and Track) while holding their own locks.
+    std::vector<IdleFn> tracked;
+    tracked.swap(tracked_);
+    l.unlock();
+    tracked.erase(std::remove_if(tracked.begin(), tracked.end(),
+                                 [&now, &idle](const IdleFn& fn) { return !fn(now - idle); }),
+                  tracked.end());
+    l.lock();
+    tracked_.insert(tracked_.end(), tracked.begin(), tracked.end());
+    next_check = now + idle;
+  }
+}
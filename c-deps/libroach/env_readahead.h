@@ -0,0 +1,98 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <rocksdb/env.h>
+#include <thread>
+#include <vector>
+
+// ReadaheadEnv performs adaptive readahead on sstable reads. RocksDB
+// reads the data blocks of an sstable one at a time, so a long forward
+// scan (a table scan, a backup or MVCCComputeStats) issues a stream of
+// small synchronous reads, which network attached volumes handle
+// badly. Once kSequentialReads consecutive reads of a file are found
+// to be sequential the file reads ahead, starting with
+// kInitialReadahead bytes and doubling the readahead on every
+// subsequent sequential read up to the maximum. Once half of the
+// readahead buffer has been consumed, the following window is
+// prefetched on a background thread so that the disk latency overlaps
+// with the decoding of the current blocks.
+//
+// A file is shared by all the iterators reading it, so each sequential
+// run is tracked separately (up to kMaxStreams per file, replacing the
+// least recently used) and reads which are not part of a run do not
+// disturb the runs. A run's buffers are released when it reaches the
+// end of the file or when it has not been read for kIdleMillis (e.g.
+// because its iterator was closed or moved elsewhere).
+//
+// Point lookups and short scans are unaffected: their reads are not
+// sequential (or not for long) and pass straight through to the
+// underlying file, without locking unless the file is also being read
+// sequentially.
+class ReadaheadEnv : public rocksdb::EnvWrapper {
+ public:
+  static const int kSequentialReads = 3;
+  static const size_t kInitialReadahead = 16 << 10;
+  static const int kMaxStreams = 4;
+  static const int kIdleMillis = 1000;
+
+  ReadaheadEnv(rocksdb::Env* base_env, size_t max_readahead);
+  virtual ~ReadaheadEnv();
+
+  virtual rocksdb::Status NewRandomAccessFile(const std::string& fname,
+                                              std::unique_ptr<rocksdb::RandomAccessFile>* result,
+                                              const rocksdb::EnvOptions& options) override;
+
+  // ReadaheadBytes returns the total number of bytes read ahead
+  // (including prefetches), HitBytes the total number of bytes of
+  // reads served from readahead buffers and BufferedBytes the number
+  // of bytes currently held in readahead buffers.
+  int64_t ReadaheadBytes() const { return readahead_bytes_.load(); }
+  int64_t HitBytes() const { return hit_bytes_.load(); }
+  int64_t BufferedBytes() const { return buffered_bytes_.load(); }
+
+  // Internal to the readahead files.
+  size_t MaxReadahead() const { return max_readahead_; }
+  void AddReadaheadBytes(int64_t n) { readahead_bytes_ += n; }
+  void AddHitBytes(int64_t n) { hit_bytes_ += n; }
+  void AddBufferedBytes(int64_t n) { buffered_bytes_ += n; }
+  // Prefetch runs fn on the prefetch thread.
+  void Prefetch(std::function<void()> fn);
+  // Track calls fn on the prefetch thread every kIdleMillis with the
+  // time before which runs are idle, until it returns false.
+  typedef std::function<bool(std::chrono::steady_clock::time_point)> IdleFn;
+  void Track(IdleFn fn);
+
+ private:
+  void run();
+
+  const size_t max_readahead_;
+  std::atomic<int64_t> readahead_bytes_;
+  std::atomic<int64_t> hit_bytes_;
+  std::atomic<int64_t> buffered_bytes_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> queue_;
+  std::vector<IdleFn> tracked_;
+  bool stopping_;
+  std::thread thread_;
+};
@@ -0,0 +1,161 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include "env_readahead.h"
+#include "testutils.h"
+
+namespace {
+
+const size_t kFileSize = 1 << 20;
+const size_t kBlockSize = 4096;
+
+// newTestFile writes a file of kFileSize pseudo-random bytes to the
+// env, returning its contents.
+std::string newTestFile(rocksdb::Env* env, const std::string& fname) {
+  std::mt19937 rng;
+  std::string contents(kFileSize, '\0');
+  for (auto& c : contents) {
+    c = char(rng());
+  }
+  std::unique_ptr<rocksdb::WritableFile> file;
+  EXPECT_OK(env->NewWritableFile(fname, &file, rocksdb::EnvOptions()));
+  EXPECT_OK(file->Append(contents));
+  EXPECT_OK(file->Close());
+  return contents;
+}
+
+// waitForBuffers waits for the env's buffered bytes to drop to n,
+// returning false if they have not after several idle intervals.
+bool waitForBuffers(ReadaheadEnv* env, int64_t n) {
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(5 * ReadaheadEnv::kIdleMillis);
+  while (env->BufferedBytes() != n) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(Libroach, ReadaheadEnvSequential) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  ReadaheadEnv env(mem_env.get(), 256 << 10);
+  const std::string contents = newTestFile(&env, "/000001.sst");
+
+  std::unique_ptr<rocksdb::RandomAccessFile> file;
+  ASSERT_OK(env.NewRandomAccessFile("/000001.sst", &file, rocksdb::EnvOptions()));
+
+  // Read the whole file block by block (with the trailer RocksDB reads
+  // along with each block) and then the tail which is cut short by the
+  // end of the file.
+  const size_t n = kBlockSize + 5;
+  char scratch[n];
+  uint64_t offset = 0;
+  for (; offset + n <= kFileSize; offset += n) {
+    rocksdb::Slice result;
+    ASSERT_OK(file->Read(offset, n, &result, scratch));
+    ASSERT_EQ(contents.substr(offset, n), result.ToString());
+  }
+  rocksdb::Slice result;
+  ASSERT_OK(file->Read(offset, n, &result, scratch));
+  EXPECT_EQ(contents.substr(offset), result.ToString());
+
+  // Most of the file was read ahead of the reads.
+  EXPECT_GT(env.ReadaheadBytes(), int64_t(kFileSize / 2));
+  EXPECT_GT(env.HitBytes(), int64_t(kFileSize / 2));
+
+  // The run ended at the end of the file, releasing its buffers (once
+  // any in-flight prefetch has completed).
+  EXPECT_TRUE(waitForBuffers(&env, 0));
+}
+
+TEST(Libroach, ReadaheadEnvInterleaved) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  ReadaheadEnv env(mem_env.get(), 256 << 10);
+  const std::string contents = newTestFile(&env, "/000001.sst");
+
+  std::unique_ptr<rocksdb::RandomAccessFile> file;
+  ASSERT_OK(env.NewRandomAccessFile("/000001.sst", &file, rocksdb::EnvOptions()));
+
+  // Two scans of the file (as by two iterators sharing the table
+  // reader) interleaved with point reads each read ahead.
+  const uint64_t kScanBytes = kFileSize / 4;
+  const uint64_t starts[] = {0, kFileSize / 2};
+  std::mt19937 rng;
+  std::uniform_int_distribution<uint64_t> uniform(1, kFileSize / kBlockSize - 1);
+  char scratch[kBlockSize];
+  for (uint64_t pos = 0; pos < kScanBytes; pos += kBlockSize) {
+    for (const uint64_t start : starts) {
+      rocksdb::Slice result;
+      ASSERT_OK(file->Read(start + pos, kBlockSize, &result, scratch));
+      ASSERT_EQ(contents.substr(start + pos, kBlockSize), result.ToString());
+    }
+    const uint64_t offset = uniform(rng) * kBlockSize;
+    rocksdb::Slice result;
+    ASSERT_OK(file->Read(offset, kBlockSize, &result, scratch));
+    ASSERT_EQ(contents.substr(offset, kBlockSize), result.ToString());
+  }
+  EXPECT_GT(env.HitBytes(), int64_t(kScanBytes));
+
+  // The runs were abandoned mid-file. Their buffers are released once
+  // they have been idle for a while.
+  EXPECT_GT(env.BufferedBytes(), 0);
+  EXPECT_TRUE(waitForBuffers(&env, 0));
+
+  // Closing the file releases the buffers of its runs right away.
+  for (uint64_t offset = 0; offset < kScanBytes; offset += kBlockSize) {
+    rocksdb::Slice result;
+    ASSERT_OK(file->Read(offset, kBlockSize, &result, scratch));
+  }
+  EXPECT_GT(env.BufferedBytes(), 0);
+  file.reset();
+  EXPECT_TRUE(waitForBuffers(&env, 0));
+}
+
+TEST(Libroach, ReadaheadEnvRandom) {
+  std::unique_ptr<rocksdb::Env> mem_env(rocksdb::NewMemEnv(rocksdb::Env::Default()));
+  ReadaheadEnv env(mem_env.get(), 256 << 10);
+  const std::string contents = newTestFile(&env, "/000001.sst");
+
+  std::unique_ptr<rocksdb::RandomAccessFile> file;
+  ASSERT_OK(env.NewRandomAccessFile("/000001.sst", &file, rocksdb::EnvOptions()));
+
+  // Random reads are not read ahead.
+  std::mt19937 rng;
+  std::uniform_int_distribution<uint64_t> uniform(1, kFileSize / kBlockSize - 1);
+  char scratch[kBlockSize];
+  for (int i = 0; i < 100; i++) {
+    const uint64_t offset = uniform(rng) * kBlockSize;
+    rocksdb::Slice result;
+    ASSERT_OK(file->Read(offset, kBlockSize, &result, scratch));
+    ASSERT_EQ(contents.substr(offset, kBlockSize), result.ToString());
+  }
+
+  // Sequential reads of other files are not read ahead either.
+  newTestFile(&env, "/MANIFEST-000001");
+  ASSERT_OK(env.NewRandomAccessFile("/MANIFEST-000001", &file, rocksdb::EnvOptions()));
+  for (uint64_t offset = 0; offset < kFileSize; offset += kBlockSize) {
+    rocksdb::Slice result;
+    ASSERT_OK(file->Read(offset, kBlockSize, &result, scratch));
+  }
+
+  EXPECT_EQ(0, env.HitBytes());
+}
@@ -13,6 +13,9 @@
 // permissions and limitations under the License.
 
 #include "env_switching.h"
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
 
 /*
  *
@@ -33,19 +36,233 @@
  *           | base_env (Env) |
  *           ------------------
  *
+ * Files are encrypted when created if an encrypted_env is present. Existing
+ * files are opened through the encrypted_env if they start with
+ * kEncryptedFileMagic and through the base_env otherwise, which allows a
+ * store to switch to (or away from) encryption without rewriting its
+ * existing files.
+ *
+ * Whether a file is encrypted is cached, so all changes to the files
+ * must go through the SwitchingEnv. An encrypted file found when no
+ * encrypted_env is present can't be opened.
+ *
  * Any unimplemented methods are called on the base_env.
  */
 class SwitchingEnv : public rocksdb::EnvWrapper {
  public:
-  SwitchingEnv(rocksdb::Env* base_env, std::shared_ptr<rocksdb::Logger> logger)
-      : rocksdb::EnvWrapper(base_env), logger(logger) {
-    rocksdb::Info(logger, "initialized switching env");
+  SwitchingEnv(rocksdb::Env* base_env, std::unique_ptr<rocksdb::Env> encrypted_env,
+               std::shared_ptr<rocksdb::Logger> logger)
+      : rocksdb::EnvWrapper(base_env), encrypted_env(std::move(encrypted_env)), logger(logger) {
+    rocksdb::Info(logger, "initialized switching env (encryption %s)",
+                  this->encrypted_env != nullptr ? "enabled" : "disabled");
+  }
+
+  virtual rocksdb::Status NewSequentialFile(const std::string& fname,
+                                            std::unique_ptr<rocksdb::SequentialFile>* result,
+                                            const rocksdb::EnvOptions& options) override {
+    rocksdb::Env* env;
+    rocksdb::Status status = envForFile(fname, &env);
+    if (!status.ok()) {
+      return status;
+    }
+    return env->NewSequentialFile(fname, result, options);
+  }
+
+  virtual rocksdb::Status NewRandomAccessFile(const std::string& fname,
+                                              std::unique_ptr<rocksdb::RandomAccessFile>* result,
+                                              const rocksdb::EnvOptions& options) override {
+    rocksdb::Env* env;
+    rocksdb::Status status = envForFile(fname, &env);
+    if (!status.ok()) {
+      return status;
+    }
+    return env->NewRandomAccessFile(fname, result, options);
+  }
+
+  virtual rocksdb::Status NewWritableFile(const std::string& fname,
+                                          std::unique_ptr<rocksdb::WritableFile>* result,
+                                          const rocksdb::EnvOptions& options) override {
+    return envForNewFile(fname)->NewWritableFile(fname, result, options);
+  }
+
+  virtual rocksdb::Status ReopenWritableFile(const std::string& fname,
+                                             std::unique_ptr<rocksdb::WritableFile>* result,
+                                             const rocksdb::EnvOptions& options) override {
+    // Appending to an existing file must keep its current format.
+    if (target()->FileExists(fname).ok()) {
+      rocksdb::Env* env;
+      rocksdb::Status status = envForFile(fname, &env);
+      if (!status.ok()) {
+        return status;
+      }
+      return env->ReopenWritableFile(fname, result, options);
+    }
+    return envForNewFile(fname)->ReopenWritableFile(fname, result, options);
+  }
+
+  virtual rocksdb::Status ReuseWritableFile(const std::string& fname, const std::string& old_fname,
+                                            std::unique_ptr<rocksdb::WritableFile>* result,
+                                            const rocksdb::EnvOptions& options) override {
+    // The contents of the old file are discarded, so the reused file
+    // gets a fresh prefix.
+    forget(old_fname);
+    return envForNewFile(fname)->ReuseWritableFile(fname, old_fname, result, options);
+  }
+
+  virtual rocksdb::Status NewRandomRWFile(const std::string& fname,
+                                          std::unique_ptr<rocksdb::RandomRWFile>* result,
+                                          const rocksdb::EnvOptions& options) override {
+    if (target()->FileExists(fname).ok()) {
+      rocksdb::Env* env;
+      rocksdb::Status status = envForFile(fname, &env);
+      if (!status.ok()) {
+        return status;
+      }
+      return env->NewRandomRWFile(fname, result, options);
+    }
+    return envForNewFile(fname)->NewRandomRWFile(fname, result, options);
+  }
+
+  virtual rocksdb::Status DeleteFile(const std::string& fname) override {
+    rocksdb::Status status = target()->DeleteFile(fname);
+    forget(fname);
+    return status;
+  }
+
+  virtual rocksdb::Status RenameFile(const std::string& src, const std::string& dst) override {
+    rocksdb::Status status = target()->RenameFile(src, dst);
+    std::lock_guard<std::mutex> guard(mu);
+    auto it = encrypted.find(src);
+    if (!status.ok() || it == encrypted.end()) {
+      encrypted.erase(dst);
+    } else {
+      encrypted[dst] = it->second;
+    }
+    encrypted.erase(src);
+    return status;
+  }
+
+  virtual rocksdb::Status LinkFile(const std::string& src, const std::string& dst) override {
+    rocksdb::Status status = target()->LinkFile(src, dst);
+    std::lock_guard<std::mutex> guard(mu);
+    auto it = encrypted.find(src);
+    if (!status.ok() || it == encrypted.end()) {
+      encrypted.erase(dst);
+    } else {
+      encrypted[dst] = it->second;
+    }
+    return status;
+  }
+
+  virtual rocksdb::Status GetFileSize(const std::string& fname, uint64_t* file_size) override {
+    rocksdb::Status status = target()->GetFileSize(fname, file_size);
+    if (!status.ok() || encrypted_env == nullptr) {
+      return status;
+    }
+    bool is_encrypted;
+    status = isEncrypted(fname, &is_encrypted);
+    if (status.ok() && is_encrypted) {
+      *file_size = *file_size > kEncryptionPrefixLength ? *file_size - kEncryptionPrefixLength : 0;
+    }
+    return status;
+  }
+
+  virtual rocksdb::Status
+  GetChildrenFileAttributes(const std::string& dir,
+                            std::vector<rocksdb::Env::FileAttributes>* result) override {
+    rocksdb::Status status = target()->GetChildrenFileAttributes(dir, result);
+    if (!status.ok() || encrypted_env == nullptr) {
+      return status;
+    }
+    for (auto& attrs : *result) {
+      bool is_encrypted;
+      status = isEncrypted(dir + "/" + attrs.name, &is_encrypted);
+      if (!status.ok()) {
+        return status;
+      }
+      if (is_encrypted) {
+        attrs.size_bytes = attrs.size_bytes > kEncryptionPrefixLength
+                               ? attrs.size_bytes - kEncryptionPrefixLength
+                               : 0;
+      }
+    }
+    return status;
   }
 
  private:
+  // isEncrypted sets *result to true if the file exists and starts
+  // with kEncryptedFileMagic. The result is cached for files whose
+  // prefix could be read in full.
+  rocksdb::Status isEncrypted(const std::string& fname, bool* result) {
+    {
+      std::lock_guard<std::mutex> guard(mu);
+      auto it = encrypted.find(fname);
+      if (it != encrypted.end()) {
+        *result = it->second;
+        return rocksdb::Status::OK();
+      }
+    }
+
+    *result = false;
+    std::unique_ptr<rocksdb::SequentialFile> file;
+    if (!target()->NewSequentialFile(fname, &file, rocksdb::EnvOptions()).ok()) {
+      // Missing files are reported by the operation itself.
+      return rocksdb::Status::OK();
+    }
+    char scratch[kEncryptedFileMagicLength];
+    rocksdb::Slice magic;
+    rocksdb::Status status = file->Read(kEncryptedFileMagicLength, &magic, scratch);
+    if (!status.ok()) {
+      return status;
+    }
+    if (magic.size() < kEncryptedFileMagicLength) {
+      // The file may still be being written.
+      return rocksdb::Status::OK();
+    }
+    *result = memcmp(magic.data(), kEncryptedFileMagic, kEncryptedFileMagicLength) == 0;
+    std::lock_guard<std::mutex> guard(mu);
+    encrypted[fname] = *result;
+    return rocksdb::Status::OK();
+  }
+
+  // envForFile sets *env to the Env to open the existing file with.
+  rocksdb::Status envForFile(const std::string& fname, rocksdb::Env** env) {
+    bool is_encrypted;
+    rocksdb::Status status = isEncrypted(fname, &is_encrypted);
+    if (!status.ok()) {
+      return status;
+    }
+    if (is_encrypted && encrypted_env == nullptr) {
+      return rocksdb::Status::InvalidArgument("file is encrypted but encryption is not enabled",
+                                              fname);
+    }
+    *env = is_encrypted ? encrypted_env.get() : target();
+    return rocksdb::Status::OK();
+  }
+
+  // envForNewFile returns the Env to create the file with, and records
+  // whether the file is encrypted.
+  rocksdb::Env* envForNewFile(const std::string& fname) {
+    std::lock_guard<std::mutex> guard(mu);
+    encrypted[fname] = encrypted_env != nullptr;
+    return encrypted_env != nullptr ? encrypted_env.get() : target();
+  }
+
+  // forget drops the cached state of a removed file.
+  void forget(const std::string& fname) {
+    std::lock_guard<std::mutex> guard(mu);
+    encrypted.erase(fname);
+  }
+
+  std::unique_ptr<rocksdb::Env> encrypted_env;
   std::shared_ptr<rocksdb::Logger> logger;
+  // mu protects encrypted, which caches whether each file is encrypted.
+  std::mutex mu;
+  std::unordered_map<std::string, bool> encrypted;
 };
 
-rocksdb::Env* NewSwitchingEnv(rocksdb::Env* base_env, std::shared_ptr<rocksdb::Logger> logger) {
-  return new SwitchingEnv(base_env ? base_env : rocksdb::Env::Default(), logger);
+rocksdb::Env* NewSwitchingEnv(rocksdb::Env* base_env, std::unique_ptr<rocksdb::Env> encrypted_env,
+                              std::shared_ptr<rocksdb::Logger> logger) {
+  return new SwitchingEnv(base_env ? base_env : rocksdb::Env::Default(), std::move(encrypted_env),
+                          logger);
 }
@@ -14,7 +14,24 @@
 
 #pragma once
 
+#include <memory>
 #include <rocksdb/env.h>
 
-// Returns a new SwitchingEnv using the passed-in env as the base.
-rocksdb::Env* NewSwitchingEnv(rocksdb::Env* base_env, std::shared_ptr<rocksdb::Logger> logger);
+// kEncryptionPrefixLength is the size of the prefix written at the
+// start of every encrypted file. It is a multiple of the page size so
+// that the encrypted contents remain aligned for direct I/O.
+static const size_t kEncryptionPrefixLength = 4096;
+
+// kEncryptedFileMagic is the start of the prefix of every encrypted
+// file, used to distinguish encrypted files from plaintext ones.
+static const char kEncryptedFileMagic[] =
+    "\xc0\x0c\xdb\x1e"
+    "ENCRYPTED"
+    "\xdb\x1e\xc0";
+static const size_t kEncryptedFileMagicLength = sizeof(kEncryptedFileMagic) - 1;
+
+// NewSwitchingEnv returns an Env which switches between base_env and
+// encrypted_env (which may be NULL) on a per-file basis. The returned
+// Env takes ownership of encrypted_env.
+rocksdb::Env* NewSwitchingEnv(rocksdb::Env* base_env, std::unique_ptr<rocksdb::Env> encrypted_env,
+                              std::shared_ptr<rocksdb::Logger> logger);
@@ -13,15 +13,51 @@
 // permissions and limitations under the License.
 
 #include "eventlistener.h"
+#include <algorithm>
 #include <rocksdb/table_properties.h>
 
 static const bool kDebug = false;
 
-DBEventListener::DBEventListener() : flushes_(0), compactions_(0) {}
+DBEventListener::DBEventListener()
+    : flushes_(0),
+      compactions_(0),
+      flush_bytes_(0),
+      write_stalls_(0),
+      write_stops_(0),
+      unflushed_range_deletion_seq_(0),
+      stalled_(false),
+      stall_nanos_(0),
+      tables_generation_(1),
+      live_tables_generation_(0) {}
+
+void DBEventListener::addTableProps(const std::string& path,
+                                    const rocksdb::TableProperties& props) {
+  TableUserProps& p = table_props_[path];
+  const rocksdb::UserCollectedProperties& user = props.user_collected_properties;
+  auto it = user.find("crdb.ts.min");
+  p.ts_min = it != user.end() ? it->second : std::string();
+  it = user.find("crdb.ts.max");
+  p.ts_max = it != user.end() ? it->second : std::string();
+}
 
 void DBEventListener::OnFlushCompleted(rocksdb::DB* db,
                                        const rocksdb::FlushJobInfo& flush_job_info) {
   ++flushes_;
+  // The memtables are flushed in order, so the range deletions up to
+  // largest_seqno are now in sstables.
+  uint64_t seq = unflushed_range_deletion_seq_.load();
+  while (seq != 0 && seq <= flush_job_info.largest_seqno &&
+         !unflushed_range_deletion_seq_.compare_exchange_weak(seq, 0)) {
+  }
+  const rocksdb::TableProperties& props = flush_job_info.table_properties;
+  flush_bytes_ += props.data_size + props.index_size + props.filter_size;
+  levels_[0].raw_bytes += props.raw_key_size + props.raw_value_size;
+  levels_[0].data_bytes += props.data_size;
+  {
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    addTableProps(flush_job_info.file_path, props);
+    ++tables_generation_;
+  }
 
   if (kDebug) {
     const rocksdb::TableProperties& p = flush_job_info.table_properties;
@@ -36,6 +72,33 @@ void DBEventListener::OnFlushCompleted(rocksdb::DB* db,
 
 void DBEventListener::OnCompactionCompleted(rocksdb::DB* db, const rocksdb::CompactionJobInfo& ci) {
   ++compactions_;
+  levelStats& level = levels_[std::min(std::max(ci.output_level, 0), kNumLevels - 1)];
+  ++level.compactions;
+  level.input_bytes += ci.stats.total_input_bytes;
+  level.output_bytes += ci.stats.total_output_bytes;
+  level.duration_micros.Record(ci.stats.elapsed_micros);
+  for (const auto& t : ci.table_properties) {
+    level.raw_bytes += t.second->raw_key_size + t.second->raw_value_size;
+    level.data_bytes += t.second->data_size;
+  }
+  {
+    // The compaction's table properties cover both its inputs and its
+    // outputs. A trivial move lists the same file as input and output.
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    for (const auto& path : ci.input_files) {
+      if (std::find(ci.output_files.begin(), ci.output_files.end(), path) ==
+          ci.output_files.end()) {
+        table_props_.erase(path);
+      }
+    }
+    for (const auto& path : ci.output_files) {
+      auto it = ci.table_properties.find(path);
+      if (it != ci.table_properties.end()) {
+        addTableProps(path, *it->second);
+      }
+    }
+    ++tables_generation_;
+  }
 
   if (kDebug) {
     fprintf(stderr, "OnCompactionCompleted: input=%d output=%d\n", ci.base_input_level,
@@ -49,6 +112,200 @@ void DBEventListener::OnCompactionCompleted(rocksdb::DB* db, const rocksdb::Comp
   }
 }
 
+void DBEventListener::OnExternalFileIngested(rocksdb::DB* db,
+                                             const rocksdb::ExternalFileIngestionInfo& info) {
+  {
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    addTableProps(info.internal_file_path, info.table_properties);
+    ++tables_generation_;
+  }
+  std::lock_guard<std::mutex> guard(mu_);
+  ingested_[TableFileNumber(info.internal_file_path)] =
+      ingestedFile{info.external_file_path, info.global_seqno};
+}
+
+void DBEventListener::OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) {
+  {
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    table_props_.erase(info.file_path);
+    ++tables_generation_;
+  }
+  std::lock_guard<std::mutex> guard(mu_);
+  ingested_.erase(TableFileNumber(info.file_path));
+}
+
+std::shared_ptr<const std::vector<rocksdb::LiveFileMetaData>>
+DBEventListener::GetLiveTables(rocksdb::DB* db) {
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    if (live_tables_ != nullptr && live_tables_generation_ == tables_generation_) {
+      return live_tables_;
+    }
+    generation = tables_generation_;
+  }
+
+  // The generation is read before the metadata so that changes made
+  // concurrently with its retrieval cause it to be retrieved again on
+  // the next call.
+  std::shared_ptr<std::vector<rocksdb::LiveFileMetaData>> tables =
+      std::make_shared<std::vector<rocksdb::LiveFileMetaData>>();
+  db->GetLiveFilesMetaData(tables.get());
+
+  std::lock_guard<std::mutex> guard(tables_mu_);
+  if (generation >= live_tables_generation_) {
+    live_tables_ = tables;
+    live_tables_generation_ = generation;
+  }
+  return tables;
+}
+
+rocksdb::Status DBEventListener::GetLiveTableUserProps(
+    rocksdb::DB* db, std::vector<std::pair<std::string, TableUserProps>>* props) {
+  const std::shared_ptr<const std::vector<rocksdb::LiveFileMetaData>> tables = GetLiveTables(db);
+  std::vector<std::string> paths;
+  paths.reserve(tables->size());
+  for (const auto& t : *tables) {
+    paths.push_back(t.db_path + t.name);
+  }
+
+  bool missing = false;
+  {
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    for (const auto& path : paths) {
+      if (table_props_.find(path) == table_props_.end()) {
+        missing = true;
+        break;
+      }
+    }
+  }
+  if (missing) {
+    // Load the properties of the sstables which predate the listener.
+    // This only happens on the first call (or if an event was missed).
+    rocksdb::TablePropertiesCollection all;
+    rocksdb::Status status = db->GetPropertiesOfAllTables(&all);
+    if (!status.ok()) {
+      return status;
+    }
+    std::lock_guard<std::mutex> guard(tables_mu_);
+    for (const auto& path : paths) {
+      auto it = all.find(path);
+      if (it != all.end() && table_props_.find(path) == table_props_.end()) {
+        addTableProps(path, *it->second);
+      }
+    }
+  }
+
+  props->clear();
+  props->reserve(paths.size());
+  std::lock_guard<std::mutex> guard(tables_mu_);
+  for (const auto& path : paths) {
+    auto it = table_props_.find(path);
+    if (it != table_props_.end()) {
+      props->emplace_back(path, it->second);
+    }
+  }
+  return rocksdb::Status::OK();
+}
+
+void DBEventListener::InvalidateLiveTables() {
+  std::lock_guard<std::mutex> guard(tables_mu_);
+  ++tables_generation_;
+}
+
+void DBEventListener::RangeDeletionWritten(uint64_t seq) {
+  uint64_t cur = unflushed_range_deletion_seq_.load();
+  while (cur < seq && !unflushed_range_deletion_seq_.compare_exchange_weak(cur, seq)) {
+  }
+}
+
+bool DBEventListener::MemtablesMayHaveRangeDeletions() const {
+  return unflushed_range_deletion_seq_.load() != 0;
+}
+
+bool DBEventListener::TakeIngestedFile(uint64_t file_number,
+                                       const std::set<std::string>& external_paths,
+                                       std::string* external_path, uint64_t* global_seqno) {
+  std::lock_guard<std::mutex> guard(mu_);
+  auto it = ingested_.find(file_number);
+  if (it == ingested_.end() || external_paths.count(it->second.external_path) == 0) {
+    return false;
+  }
+  *external_path = it->second.external_path;
+  *global_seqno = it->second.global_seqno;
+  ingested_.erase(it);
+  return true;
+}
+
+uint64_t DBEventListener::TableFileNumber(const std::string& path) {
+  // sstables are named <dir>/<number>.sst.
+  const size_t start = path.find_last_of('/') + 1;
+  const size_t end = path.find(".sst", start);
+  if (end == std::string::npos || end == start) {
+    return 0;
+  }
+  uint64_t number = 0;
+  for (size_t i = start; i < end; i++) {
+    if (path[i] < '0' || path[i] > '9') {
+      return 0;
+    }
+    number = number * 10 + (path[i] - '0');
+  }
+  return number;
+}
+
+void DBEventListener::OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) {
+  const bool stalled = info.condition.cur != rocksdb::WriteStallCondition::kNormal;
+  if (info.condition.cur == rocksdb::WriteStallCondition::kStopped) {
+    ++write_stops_;
+  } else if (info.condition.cur == rocksdb::WriteStallCondition::kDelayed) {
+    ++write_stalls_;
+  }
+
+  std::lock_guard<std::mutex> guard(stall_mu_);
+  const auto now = std::chrono::steady_clock::now();
+  if (stalled && !stalled_) {
+    stall_start_ = now;
+  } else if (!stalled && stalled_) {
+    stall_nanos_ +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - stall_start_).count();
+  }
+  stalled_ = stalled;
+
+  if (kDebug) {
+    fprintf(stderr, "OnStallConditionsChanged: %s: %d -> %d\n", info.cf_name.c_str(),
+            int(info.condition.prev), int(info.condition.cur));
+  }
+}
+
 uint64_t DBEventListener::GetFlushes() const { return flushes_.load(); }
 
 uint64_t DBEventListener::GetCompactions() const { return compactions_.load(); }
+
+uint64_t DBEventListener::GetFlushBytes() const { return flush_bytes_.load(); }
+
+uint64_t DBEventListener::GetWriteStalls() const { return write_stalls_.load(); }
+
+uint64_t DBEventListener::GetWriteStops() const { return write_stops_.load(); }
+
+int64_t DBEventListener::GetWriteStallNanos() {
+  std::lock_guard<std::mutex> guard(stall_mu_);
+  int64_t nanos = stall_nanos_;
+  if (stalled_) {
+    nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - stall_start_)
+                 .count();
+  }
+  return nanos;
+}
+
+void DBEventListener::GetCompactionLevelStats(DBCompactionLevelStats* levels) const {
+  for (int i = 0; i < kNumLevels; ++i) {
+    levels[i].compactions = int64_t(levels_[i].compactions.load());
+    levels[i].input_bytes = int64_t(levels_[i].input_bytes.load());
+    levels[i].output_bytes = int64_t(levels_[i].output_bytes.load());
+    levels[i].duration_micros = levels_[i].duration_micros.Export();
+    levels[i].raw_bytes = int64_t(levels_[i].raw_bytes.load());
+    levels[i].data_bytes = int64_t(levels_[i].data_bytes.load());
+  }
+}
@@ -15,8 +15,18 @@
 #pragma once
 
 #include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <chrono>
+#include <libroach.h>
 #include <rocksdb/db.h>
+#include "histogram.h"
 
 // DBEventListener is an implementation of RocksDB's EventListener interface
 // used to collect information on RocksDB events that could be of interest
@@ -26,16 +36,133 @@ class DBEventListener : public rocksdb::EventListener {
   DBEventListener();
   virtual ~DBEventListener() {}
 
+  // kNumLevels is the number of levels compaction statistics are kept
+  // for. Compactions to deeper levels are attributed to the last level.
+  static const int kNumLevels = 7;
+
   uint64_t GetFlushes() const;
   uint64_t GetCompactions() const;
+  // GetFlushBytes returns the total size of the sstables written by
+  // flushes.
+  uint64_t GetFlushBytes() const;
+  // GetWriteStalls and GetWriteStops return the number of times writes
+  // have been delayed or stopped, respectively.
+  uint64_t GetWriteStalls() const;
+  uint64_t GetWriteStops() const;
+  // GetWriteStallNanos returns the total time writes have been delayed
+  // or stopped, including any ongoing stall.
+  int64_t GetWriteStallNanos();
+  // GetCompactionLevelStats fills in the compaction statistics of each
+  // of the kNumLevels output levels.
+  void GetCompactionLevelStats(DBCompactionLevelStats* levels) const;
+
+  // TakeIngestedFile retrieves (and forgets) the external path and the
+  // global sequence number of the sstable with the given internal file
+  // number if it was ingested from one of external_paths, returning
+  // false if no such ingestion is recorded. Ingestions are recorded
+  // until they are retrieved or the sstable is deleted, so that
+  // concurrent ingestions of the same external path cannot be
+  // confused.
+  bool TakeIngestedFile(uint64_t file_number, const std::set<std::string>& external_paths,
+                        std::string* external_path, uint64_t* global_seqno);
+
+  // TableFileNumber returns the file number of the sstable at path, or
+  // 0 if path is not the path of an sstable.
+  static uint64_t TableFileNumber(const std::string& path);
+
+  // The listener maintains a catalog of the live sstables and of the
+  // user properties of each of them so that metrics and debug pages
+  // neither rebuild the metadata from the current version nor read
+  // the properties of every sstable from disk on each request.
+
+  // TableUserProps holds the crdb.ts.min and crdb.ts.max user
+  // properties of an sstable.
+  struct TableUserProps {
+    std::string ts_min;
+    std::string ts_max;
+  };
+
+  // GetLiveTables returns the metadata of the live sstables of db. The
+  // metadata is cached and only retrieved again after the set of live
+  // sstables has changed.
+  std::shared_ptr<const std::vector<rocksdb::LiveFileMetaData>> GetLiveTables(rocksdb::DB* db);
+  // GetLiveTableUserProps returns the user properties of each live
+  // sstable of db, keyed by path. The properties of the sstables
+  // written since the listener was created are recorded as they are
+  // written; those of older sstables are read once, on first use.
+  rocksdb::Status GetLiveTableUserProps(rocksdb::DB* db,
+                                        std::vector<std::pair<std::string, TableUserProps>>* props);
+  // InvalidateLiveTables discards the cached sstable metadata. It is
+  // called after flushes which may have completed before the listener
+  // was notified.
+  void InvalidateLiveTables();
+
+  // RangeDeletionWritten records that range deletions have been written
+  // to the memtables at sequence numbers no greater than seq.
+  // MemtablesMayHaveRangeDeletions returns true until a flush of the
+  // memtables up to seq has completed. Range deletions in the memtables
+  // are not visible through any iterator, so this is how readers of
+  // per-sstable properties find out that keys in the sstables may have
+  // been deleted.
+  void RangeDeletionWritten(uint64_t seq);
+  bool MemtablesMayHaveRangeDeletions() const;
 
   // EventListener methods.
   virtual void OnFlushCompleted(rocksdb::DB* db,
                                 const rocksdb::FlushJobInfo& flush_job_info) override;
   virtual void OnCompactionCompleted(rocksdb::DB* db,
                                      const rocksdb::CompactionJobInfo& ci) override;
+  virtual void OnExternalFileIngested(rocksdb::DB* db,
+                                      const rocksdb::ExternalFileIngestionInfo& info) override;
+  virtual void OnStallConditionsChanged(const rocksdb::WriteStallInfo& info) override;
+  virtual void OnTableFileDeleted(const rocksdb::TableFileDeletionInfo& info) override;
 
  private:
+  struct ingestedFile {
+    std::string external_path;
+    uint64_t global_seqno;
+  };
+
+  void addTableProps(const std::string& path, const rocksdb::TableProperties& props);
+
+  struct levelStats {
+    levelStats() : compactions(0), input_bytes(0), output_bytes(0), raw_bytes(0), data_bytes(0) {}
+    std::atomic<uint64_t> compactions;
+    std::atomic<uint64_t> input_bytes;
+    std::atomic<uint64_t> output_bytes;
+    Histogram duration_micros;
+    // The uncompressed size of the keys and values written to the
+    // level and the size of the data blocks they were written in.
+    std::atomic<uint64_t> raw_bytes;
+    std::atomic<uint64_t> data_bytes;
+  };
+
   std::atomic<uint64_t> flushes_;
   std::atomic<uint64_t> compactions_;
+  std::atomic<uint64_t> flush_bytes_;
+  std::atomic<uint64_t> write_stalls_;
+  std::atomic<uint64_t> write_stops_;
+  // The sequence number passed to RangeDeletionWritten since the last
+  // flush which covered it, or 0.
+  std::atomic<uint64_t> unflushed_range_deletion_seq_;
+  levelStats levels_[kNumLevels];
+  std::mutex stall_mu_;
+  // Protected by stall_mu_. stall_start_ is only valid while stalled_.
+  bool stalled_;
+  std::chrono::steady_clock::time_point stall_start_;
+  int64_t stall_nanos_;
+  std::mutex mu_;
+  // The files ingested since they were last retrieved by
+  // TakeIngestedFile, keyed by their internal file number.
+  std::map<uint64_t, ingestedFile> ingested_;
+  std::mutex tables_mu_;
+  // Protected by tables_mu_. The generation is incremented whenever
+  // the set of live sstables changes; live_tables_ holds the metadata
+  // retrieved at live_tables_generation_.
+  uint64_t tables_generation_;
+  uint64_t live_tables_generation_;
+  std::shared_ptr<const std::vector<rocksdb::LiveFileMetaData>> live_tables_;
+  // Protected by tables_mu_. The user properties of the sstables, keyed
+  // by path.
+  std::unordered_map<std::string, TableUserProps> table_props_;
 };
@@ -0,0 +1,140 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "group_commit.h"
+#include <chrono>
+
+namespace {
+
+// The header of the WriteBatch repr format: an 8-byte sequence
+// number followed by a 4-byte count.
+const size_t kBatchHeaderSize = 12;
+
+uint32_t batchCount(const std::string& rep) {
+  const uint8_t* b = reinterpret_cast<const uint8_t*>(rep.data() + 8);
+  return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+}
+
+void putBatchCount(std::string* rep, uint32_t count) {
+  char* dst = &(*rep)[8];
+  dst[0] = char(count);
+  dst[1] = char(count >> 8);
+  dst[2] = char(count >> 16);
+  dst[3] = char(count >> 24);
+}
+
+}  // namespace
+
+GroupCommitter::GroupCommitter(rocksdb::DB* db) : db_(db), stopping_(false) {}
+
+GroupCommitter::~GroupCommitter() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  pending_cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+rocksdb::Status GroupCommitter::Commit(rocksdb::WriteBatch* batch) {
+  waiter w;
+  w.batch = batch;
+  w.done = false;
+
+  std::unique_lock<std::mutex> l(mu_);
+  if (!thread_.joinable()) {
+    thread_ = std::thread(&GroupCommitter::run, this);
+  }
+  pending_.push_back(&w);
+  pending_cv_.notify_one();
+  done_cv_.wait(l, [&w] { return w.done; });
+  return w.status;
+}
+
+void GroupCommitter::run() {
+  std::vector<waiter*> group;
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    pending_cv_.wait(l, [this] { return stopping_ || !pending_.empty(); });
+    if (pending_.empty()) {
+      // We're stopping and there is nothing left to commit.
+      return;
+    }
+
+    // Take as many of the queued batches as fit in a group. The first
+    // batch is always taken regardless of its size.
+    size_t bytes = 0;
+    group.clear();
+    while (!pending_.empty()) {
+      const size_t size = pending_.front()->batch->GetDataSize();
+      if (!group.empty() && bytes + size > kMaxGroupBytes) {
+        break;
+      }
+      bytes += size;
+      group.push_back(pending_.front());
+      pending_.pop_front();
+    }
+
+    // Batches queued while the group is being written form the next
+    // group.
+    l.unlock();
+    const rocksdb::Status status = writeGroup(group);
+    l.lock();
+
+    for (auto w : group) {
+      w->status = status;
+      w->done = true;
+    }
+    done_cv_.notify_all();
+  }
+}
+
+rocksdb::Status GroupCommitter::writeGroup(const std::vector<waiter*>& group) {
+  rocksdb::WriteOptions options;
+  options.sync = true;
+  group_sizes_.Record(group.size());
+  const auto start = std::chrono::steady_clock::now();
+
+  rocksdb::Status status;
+  if (group.size() == 1) {
+    status = db_->Write(options, group[0]->batch);
+  } else {
+    // Concatenate the batch reprs: the combined batch has a single
+    // header with the total count, followed by the records of each
+    // batch.
+    size_t size = kBatchHeaderSize;
+    for (auto w : group) {
+      size += w->batch->GetDataSize() - kBatchHeaderSize;
+    }
+    std::string rep;
+    rep.reserve(size);
+    rep.assign(kBatchHeaderSize, '\0');
+    uint32_t count = 0;
+    for (auto w : group) {
+      const std::string& r = w->batch->Data();
+      count += batchCount(r);
+      rep.append(r.data() + kBatchHeaderSize, r.size() - kBatchHeaderSize);
+    }
+    putBatchCount(&rep, count);
+    rocksdb::WriteBatch combined(std::move(rep));
+    status = db_->Write(options, &combined);
+  }
+
+  sync_latencies_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+  return status;
+}
@@ -0,0 +1,80 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+
+// GroupCommitter durably commits batches on behalf of many concurrent
+// callers. Rather than each caller performing its own synchronous
+// write (and WAL fsync), callers queue their batches and block while
+// a dedicated commit thread concatenates the queued batches into a
+// single batch which is written with one WAL append and one fsync.
+// The batches in a group are committed atomically together: either
+// all of them are applied or none are and every waiter receives the
+// same error. The memtable is only updated after the fsync, so
+// committed data is never visible before it is durable.
+class GroupCommitter {
+ public:
+  // kMaxGroupBytes bounds the size of a combined batch. A single
+  // larger batch is still committed, but alone.
+  static const size_t kMaxGroupBytes = 4 << 20;
+
+  // The DB must outlive the GroupCommitter.
+  explicit GroupCommitter(rocksdb::DB* db);
+  ~GroupCommitter();
+
+  // Commit durably applies the batch, blocking until it has been
+  // synced to the WAL. The batch must not be modified until Commit
+  // returns.
+  rocksdb::Status Commit(rocksdb::WriteBatch* batch);
+
+  // GroupSizes returns the histogram of the number of batches per
+  // group commit.
+  const Histogram& GroupSizes() const { return group_sizes_; }
+  // SyncLatencies returns the histogram of the duration (in
+  // nanoseconds) of the synchronous write of each group.
+  const Histogram& SyncLatencies() const { return sync_latencies_; }
+
+ private:
+  struct waiter {
+    rocksdb::WriteBatch* batch;
+    rocksdb::Status status;
+    bool done;
+  };
+
+  void run();
+  rocksdb::Status writeGroup(const std::vector<waiter*>& group);
+
+  rocksdb::DB* const db_;
+  std::mutex mu_;
+  // pending_cv_ is signaled when a waiter is queued (or on shutdown)
+  // and done_cv_ when a group has been committed.
+  std::condition_variable pending_cv_;
+  std::condition_variable done_cv_;
+  std::deque<waiter*> pending_;
+  bool stopping_;
+  // The commit thread is started on the first call to Commit so that
+  // engines which never use grouped commits do not pay for it.
+  std::thread thread_;
+  Histogram group_sizes_;
+  Histogram sync_latencies_;
+};
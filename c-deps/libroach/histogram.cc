@@ -0,0 +1,129 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "histogram.h"
+
+namespace {
+
+int bucketIndex(uint64_t value) { return value == 0 ? 0 : 64 - __builtin_clzll(value); }
+
+// bucketLow returns the smallest value in the bucket.
+uint64_t bucketLow(int i) { return i == 0 ? 0 : uint64_t(1) << (i - 1); }
+
+// bucketHigh returns the largest value in the bucket.
+uint64_t bucketHigh(int i) {
+  return i == 0 ? 0 : (i == 64 ? UINT64_MAX : (uint64_t(1) << i) - 1);
+}
+
+// shardIndex returns the calling thread's ShardedHistogram shard.
+// Threads are assigned shards round-robin on first use.
+int shardIndex() {
+  static std::atomic<int> next_shard(0);
+  thread_local int shard = next_shard.fetch_add(1) % ShardedHistogram::kNumShards;
+  return shard;
+}
+
+}  // namespace
+
+Histogram::Histogram() : count_(0), sum_(0), max_(0) {
+  for (int i = 0; i < kNumBuckets; ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+void Histogram::Record(uint64_t value) {
+  buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t Histogram::Percentile(double fraction) const {
+  uint64_t counts[kNumBuckets];
+  uint64_t total = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  const uint64_t max = max_.load(std::memory_order_relaxed);
+  const double rank = fraction * total;
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    if (seen + counts[i] >= rank) {
+      const uint64_t low = bucketLow(i);
+      const uint64_t high = bucketHigh(i) < max ? bucketHigh(i) : max;
+      const double within = (rank - seen) / counts[i];
+      const double v = low + within * double(high - low);
+      return v >= double(high) ? high : uint64_t(v);
+    }
+    seen += counts[i];
+  }
+  return max;
+}
+
+DBHistogram Histogram::Export() const {
+  DBHistogram h;
+  h.count = int64_t(count_.load(std::memory_order_relaxed));
+  h.sum = int64_t(sum_.load(std::memory_order_relaxed));
+  h.max = int64_t(max_.load(std::memory_order_relaxed));
+  h.p50 = int64_t(Percentile(0.50));
+  h.p95 = int64_t(Percentile(0.95));
+  h.p99 = int64_t(Percentile(0.99));
+  return h;
+}
+
+void Histogram::Merge(const Histogram& other) {
+  for (int i = 0; i < kNumBuckets; ++i) {
+    buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  }
+  count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  const uint64_t other_max = other.max_.load(std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (other_max > max &&
+         !max_.compare_exchange_weak(max, other_max, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Subtract(const Histogram& other) {
+  for (int i = 0; i < kNumBuckets; ++i) {
+    buckets_[i].fetch_sub(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  }
+  count_.fetch_sub(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  sum_.fetch_sub(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void ShardedHistogram::Record(uint64_t value) { shards_[shardIndex()].h.Record(value); }
+
+DBHistogram ShardedHistogram::Export() const {
+  Histogram merged;
+  MergeInto(&merged);
+  return merged.Export();
+}
+
+void ShardedHistogram::MergeInto(Histogram* h) const {
+  for (int i = 0; i < kNumShards; ++i) {
+    h->Merge(shards_[i].h);
+  }
+}
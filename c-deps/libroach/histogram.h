@@ -0,0 +1,85 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <libroach.h>
+#include <stdint.h>
+
+// Histogram is a lock-free histogram of non-negative values with
+// power-of-two sized buckets: bucket 0 counts zeros and bucket i > 0
+// counts values in [2^(i-1), 2^i). Percentiles are interpolated
+// linearly within a bucket, so they are approximate but accurate to
+// within a factor of two, which suffices for latencies and sizes.
+class Histogram {
+ public:
+  static const int kNumBuckets = 65;
+
+  Histogram();
+
+  // Record adds the value to the histogram.
+  void Record(uint64_t value);
+
+  // Export returns the count, sum, max and (approximate) percentiles of
+  // the recorded values. Concurrent calls to Record may or may not be
+  // reflected.
+  DBHistogram Export() const;
+
+  // Percentile returns the (approximate) value below which the given
+  // fraction of the recorded values fall.
+  uint64_t Percentile(double fraction) const;
+
+  // Merge adds the values recorded in other to the histogram.
+  void Merge(const Histogram& other);
+
+  // Subtract removes the values recorded in other, which must be an
+  // earlier copy of the histogram made with Merge, so that the
+  // histogram holds only the values recorded since. The max is not
+  // adjusted.
+  void Subtract(const Histogram& other);
+
+ private:
+  std::atomic<uint64_t> buckets_[kNumBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+// ShardedHistogram is a Histogram which is sharded by thread so that
+// recording values on hot paths from many threads concurrently does
+// not contend on the same cache lines.
+class ShardedHistogram {
+ public:
+  static const int kNumShards = 16;
+
+  // Record adds the value to the current thread's shard.
+  void Record(uint64_t value);
+
+  // Export merges the shards and returns the summary of the merged
+  // histogram (see Histogram::Export).
+  DBHistogram Export() const;
+
+  // MergeInto adds the values recorded in all of the shards to h.
+  void MergeInto(Histogram* h) const;
+
+ private:
+  struct shard {
+    Histogram h;
+    // Pad the shards apart so that neighboring shards don't share a
+    // cache line.
+    char pad[64];
+  };
+  shard shards_[kNumShards];
+};
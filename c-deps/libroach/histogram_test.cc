@@ -0,0 +1,95 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+
+TEST(Libroach, Histogram) {
+  Histogram h;
+  DBHistogram e = h.Export();
+  EXPECT_EQ(0, e.count);
+  EXPECT_EQ(0, e.p50);
+
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    h.Record(i);
+  }
+  e = h.Export();
+  EXPECT_EQ(1000, e.count);
+  EXPECT_EQ(500500, e.sum);
+  EXPECT_EQ(1000, e.max);
+  // Percentiles are accurate to within a factor of two.
+  EXPECT_GE(e.p50, 250);
+  EXPECT_LE(e.p50, 1000);
+  EXPECT_GE(e.p99, 495);
+  EXPECT_LE(e.p99, 1000);
+  EXPECT_LE(e.p50, e.p95);
+  EXPECT_LE(e.p95, e.p99);
+
+  // A single value.
+  Histogram one;
+  one.Record(0);
+  e = one.Export();
+  EXPECT_EQ(1, e.count);
+  EXPECT_EQ(0, e.max);
+  EXPECT_EQ(0, e.p99);
+
+  Histogram big;
+  big.Record(UINT64_MAX);
+  EXPECT_EQ(UINT64_MAX, big.Percentile(1.0));
+}
+
+TEST(Libroach, HistogramSubtract) {
+  Histogram h;
+  for (uint64_t i = 0; i < 100; ++i) {
+    h.Record(1);
+  }
+  Histogram prev;
+  prev.Merge(h);
+  for (uint64_t i = 0; i < 100; ++i) {
+    h.Record(1 << 20);
+  }
+
+  // Only the values recorded since the copy remain.
+  Histogram delta;
+  delta.Merge(h);
+  delta.Subtract(prev);
+  DBHistogram e = delta.Export();
+  EXPECT_EQ(100, e.count);
+  EXPECT_EQ(100 << 20, e.sum);
+  EXPECT_GE(e.p50, 1 << 19);
+}
+
+TEST(Libroach, ShardedHistogram) {
+  ShardedHistogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2 * ShardedHistogram::kNumShards; t++) {
+    threads.emplace_back([&h, t] {
+      for (uint64_t i = 1; i <= 100; ++i) {
+        h.Record(i * (t + 1));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const int n = 2 * ShardedHistogram::kNumShards;
+  DBHistogram e = h.Export();
+  EXPECT_EQ(100 * n, e.count);
+  EXPECT_EQ(5050 * n * (n + 1) / 2, e.sum);
+  EXPECT_EQ(100 * n, e.max);
+  EXPECT_LE(e.p50, e.p99);
+  EXPECT_LE(e.p99, e.max);
+}
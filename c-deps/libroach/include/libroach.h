@@ -59,10 +59,78 @@ typedef struct {
 } DBIterState;
 
 typedef struct DBCache DBCache;
+typedef struct DBScheduler DBScheduler;
 typedef struct DBEngine DBEngine;
 typedef struct DBIterator DBIterator;
 
+// DBCompression is the compression applied to the blocks of
+// sstables. DBCompressionDefault selects the engine's default for the
+// level (see DBOptions).
+typedef enum {
+  DBCompressionDefault = 0,
+  DBCompressionNone,
+  DBCompressionSnappy,
+  DBCompressionLZ4,
+  DBCompressionZSTD,
+} DBCompression;
+
 // DBOptions contains local database options.
+//
+// level_compression[i] is the compression of L<i>. Because the engine
+// uses dynamic level sizing, index 1 applies to the base level (the
+// level L0 is compacted into) and the levels below it follow. Levels
+// left at DBCompressionDefault use snappy, as do all levels by default.
+// bottommost_compression, if set, overrides the compression of the
+// bottommost level, which holds most of the data. When it is zstd, a
+// compression dictionary of up to compression_dict_bytes (16KB if 0)
+// sampled from the compaction's output is used for the bottommost
+// level.
+//
+// If value_separation_threshold is positive, MVCC values larger than
+// it are stored in blob files and the sstables hold references to
+// them, so that compactions do not rewrite the values. Reads resolve
+// the references transparently.
+//
+// If rate_limit_bytes_per_sec is positive, flush and compaction writes
+// are limited to at most that rate. The limit is lowered while the p99
+// latency of foreground point reads and commits exceeds
+// rate_limit_target_latency_nanos (10ms if 0) and raised again while
+// it is well below it or compactions are falling behind.
+//
+// If max_readahead_bytes is positive, long sequential scans of an
+// sstable read ahead (and prefetch the following data in the
+// background), ramping up to max_readahead_bytes per read.
+//
+// If fast_open is true, opening the engine does less work before it
+// can serve requests: the sstables' table readers are opened on more
+// threads and the sstable statistics used to estimate compaction
+// sizes are not loaded at startup (they are accumulated as sstables
+// are written instead).
+//
+// If key_sample_rate is positive, roughly one in key_sample_rate of
+// the keys read by MVCCGet and MVCCScan and written by batch commits
+// is sampled to estimate the hottest keys (see DBGetHotKeys).
+//
+// If tombstone_compaction_density is positive, the spans of the
+// tombstones of sstables in which at least that fraction of the entries
+// (and at least 64 of them) are deletions, or whose range deletions
+// cover an estimated size of data of at least that fraction of their
+// own, are compacted in the background, dropping the tombstones and the
+// data they delete (see DBGetTombstoneCompactionStats).
+//
+// If scheduler is not NULL, the engine's flushes and compactions run
+// on the threads of the scheduler, which is shared with the other
+// engines it is passed to, and are limited by its write budget unless
+// rate_limit_bytes_per_sec is set (see DBNewScheduler).
+//
+// If read_threads is positive, the engine executes reads submitted
+// with DBSubmitReads on that many threads.
+//
+// If detailed_timers is true, the engine's statistics also time
+// individual operations such as block decompression (see
+// DBStatsResult.decompression_nanos). Reading the clock around every
+// such operation has a measurable cost, so the timers are disabled by
+// default.
 typedef struct {
   DBCache* cache;
   uint64_t block_size;
@@ -73,11 +141,51 @@ typedef struct {
   bool use_switching_env;
   bool must_exist;
   DBSlice extra_options;
+  DBCompression level_compression[7];
+  DBCompression bottommost_compression;
+  int compression_dict_bytes;
+  int64_t value_separation_threshold;
+  int64_t rate_limit_bytes_per_sec;
+  int64_t rate_limit_target_latency_nanos;
+  int64_t max_readahead_bytes;
+  bool fast_open;
+  int key_sample_rate;
+  double tombstone_compaction_density;
+  DBScheduler* scheduler;
+  int read_threads;
+  bool detailed_timers;
 } DBOptions;
 
 // Create a new cache with the specified size.
 DBCache* DBNewCache(uint64_t size);
 
+// DBCacheOptions configures the cache created by
+// DBNewCacheWithOptions. The zero value creates the same cache as
+// DBNewCache.
+//
+// The cache is split into 2^num_shard_bits shards (16 if
+// num_shard_bits is 0). If high_pri_pool_ratio is positive, the index
+// and filter blocks of the engines using the cache are stored in the
+// cache and given that fraction of its capacity, from which they are
+// only evicted after the data blocks; otherwise they are held in
+// memory for as long as the sstable is open.
+typedef struct {
+  int num_shard_bits;
+  double high_pri_pool_ratio;
+} DBCacheOptions;
+
+// Create a new cache with the specified size and options.
+DBStatus DBNewCacheWithOptions(DBCache** cache, uint64_t size, DBCacheOptions options);
+
+// Create a new tiered cache: an in-memory cache with the specified
+// size backed by a persistent cache of persistent_size bytes stored in
+// the persistent_path directory (typically on a local SSD). Blocks
+// evicted from the in-memory cache are retained by the persistent
+// tier. The persistent tier is shared by all references to the cache
+// and its contents do not survive a restart.
+DBStatus DBNewTieredCache(DBCache** cache, uint64_t size, DBSlice persistent_path,
+                          uint64_t persistent_size);
+
 // Add a reference to an existing cache. Note that the underlying
 // RocksDB cache is shared between the original and new reference.
 DBCache* DBRefCache(DBCache* cache);
@@ -87,10 +195,65 @@ DBCache* DBRefCache(DBCache* cache);
 // all of the references have been released.
 void DBReleaseCache(DBCache* cache);
 
+// DBSchedulerOptions configures the scheduler created by
+// DBNewScheduler. num_threads is the number of threads running the
+// flushes and compactions of all of the engines using the scheduler.
+// If bytes_per_sec is positive it bounds the total rate at which the
+// flushes and compactions of those engines write.
+typedef struct {
+  int num_threads;
+  int64_t bytes_per_sec;
+} DBSchedulerOptions;
+
+// Create a new background job scheduler, to be shared by the engines
+// of a node (see DBOptions.scheduler) so that their background work is
+// bounded per node rather than per engine. Flushes run before
+// compactions, and the compactions of the engines with the most L0
+// files run first. At most num_threads-1 compactions run at once (if
+// num_threads > 1) so that a thread is always available for flushes.
+DBStatus DBNewScheduler(DBScheduler** scheduler, DBSchedulerOptions options);
+
+// Release a scheduler. The scheduler is not destroyed until the
+// engines using it have been closed.
+void DBReleaseScheduler(DBScheduler* scheduler);
+
+// DBSchedulerStats describes the flushes and compactions run by a
+// scheduler: the number which have run, are running and are queued.
+typedef struct {
+  int64_t flushes;
+  int64_t compactions;
+  int64_t running_flushes;
+  int64_t running_compactions;
+  int64_t queued_flushes;
+  int64_t queued_compactions;
+} DBSchedulerStats;
+
+DBStatus DBGetSchedulerStats(DBScheduler* scheduler, DBSchedulerStats* stats);
+
 // Opens the database located in "dir", creating it if it doesn't
 // exist.
 DBStatus DBOpen(DBEngine** db, DBSlice dir, DBOptions options);
 
+// DBOpenStats breaks down the time spent opening an engine. Recovery
+// first reads the MANIFEST, then opens the table readers and then
+// replays the WAL (flushing the recovered memtables). The phases are
+// delimited by the first table and WAL file opened, so a phase which
+// did not happen takes no time.
+typedef struct {
+  int64_t total_nanos;
+  int64_t manifest_nanos;
+  int64_t table_open_nanos;
+  int64_t wal_replay_nanos;
+  // The number of sstables opened before the WAL replay.
+  int64_t tables_opened;
+  // The number of WAL files replayed.
+  int64_t wal_files;
+} DBOpenStats;
+
+// DBGetOpenStats retrieves the startup timing of an engine created by
+// DBOpen.
+DBStatus DBGetOpenStats(DBEngine* db, DBOpenStats* stats);
+
 // Destroys the database located in "dir". As the name implies, this
 // operation is destructive. Use with caution.
 DBStatus DBDestroy(DBSlice dir);
@@ -114,6 +277,33 @@ DBStatus DBCompact(DBEngine* db);
 // If end is empty, it indicates the end of the database.
 DBStatus DBCompactRange(DBEngine* db, DBSlice start, DBSlice end);
 
+// DBCompactRangeProgress tracks the progress of, and allows canceling,
+// a DBCompactRangeParallel call from another thread.
+typedef struct DBCompactRangeProgress DBCompactRangeProgress;
+
+DBCompactRangeProgress* DBNewCompactRangeProgress();
+
+// DBCompactRangeProgressGet retrieves the number of bytes compacted so
+// far and the total number of bytes to compact. The sizes count the
+// sstables in the bottom-most level which determine the compaction's
+// chunks.
+void DBCompactRangeProgressGet(DBCompactRangeProgress* progress, uint64_t* bytes_done,
+                               uint64_t* bytes_total);
+
+// DBCompactRangeProgressCancel cancels the compaction. Chunks which
+// are being compacted run to completion but no further chunks are
+// started, and DBCompactRangeParallel returns an error.
+void DBCompactRangeProgressCancel(DBCompactRangeProgress* progress);
+
+void DBCompactRangeProgressDestroy(DBCompactRangeProgress* progress);
+
+// Like DBCompactRange, but compacts up to concurrency chunks of the
+// range at a time, and at most 4. The compactions are still bounded by
+// the engine's background compaction threads. If progress is non-NULL it is updated
+// as chunks complete and can be used to cancel the compaction.
+DBStatus DBCompactRangeParallel(DBEngine* db, DBSlice start, DBSlice end, int concurrency,
+                                DBCompactRangeProgress* progress);
+
 // Stores the approximate on-disk size of the given key range into the
 // supplied uint64.
 DBStatus DBApproximateDiskBytes(DBEngine* db, DBKey start, DBKey end, uint64_t* size);
@@ -139,6 +329,15 @@ DBStatus DBDeleteRange(DBEngine* db, DBKey start, DBKey end);
 // tombstones for the individual keys.
 DBStatus DBDeleteIterRange(DBEngine* db, DBIterator* iter, DBKey start, DBKey end);
 
+// DBDeleteIterRangeAdaptive is like DBDeleteIterRange, but if the
+// span turns out to contain many keys (estimated from the approximate
+// size of the span and the keys seen so far) the remainder of the span
+// is deleted with a single range tombstone (as with DBDeleteRange).
+// Small spans are deleted with point tombstones which are cheaper for
+// subsequent reads. Note that a batch containing a range tombstone
+// can no longer be read from.
+DBStatus DBDeleteIterRangeAdaptive(DBEngine* db, DBIterator* iter, DBKey start, DBKey end);
+
 // Applies a batch of operations (puts, merges and deletes) to the
 // database atomically and closes the batch. It is only valid to call
 // this function on an engine created by DBNewBatch. If an error is
@@ -146,6 +345,124 @@ DBStatus DBDeleteIterRange(DBEngine* db, DBIterator* iter, DBKey start, DBKey en
 // responsibility to call DBClose.
 DBStatus DBCommitAndCloseBatch(DBEngine* db, bool sync);
 
+// DBCommitAndCloseBatchGrouped is like DBCommitAndCloseBatch with
+// sync=true, but rather than performing its own synchronous write the
+// batch is handed to a dedicated commit thread in db (an engine
+// created by DBOpen) which combines the batches of concurrent callers
+// into a single WAL write and fsync. The call blocks until the batch
+// is durable. The batches in a group succeed or fail together.
+DBStatus DBCommitAndCloseBatchGrouped(DBEngine* db, DBEngine* batch);
+
+// DBHistogram summarizes the distribution of a set of values. The
+// percentiles are approximate.
+typedef struct {
+  int64_t count;
+  int64_t sum;
+  int64_t max;
+  int64_t p50;
+  int64_t p95;
+  int64_t p99;
+} DBHistogram;
+
+// DBGroupCommitStats contains the distribution of the number of
+// batches per group and the latency of the synchronous write of each
+// group performed by DBCommitAndCloseBatchGrouped.
+typedef struct {
+  DBHistogram group_size;
+  DBHistogram sync_latency_nanos;
+} DBGroupCommitStats;
+
+// DBGetGroupCommitStats retrieves the group commit statistics of an
+// engine created by DBOpen.
+DBStatus DBGetGroupCommitStats(DBEngine* db, DBGroupCommitStats* stats);
+
+// DBLatencyStats contains the distribution of the latency (in
+// nanoseconds) of the named operations on an engine, including
+// operations on its batches, snapshots and iterators.
+typedef struct {
+  DBHistogram mvcc_scan;
+  DBHistogram mvcc_get;
+  DBHistogram iter_seek;
+  DBHistogram commit_batch;
+  DBHistogram apply_batch_repr;
+  DBHistogram sync_wal;
+} DBLatencyStats;
+
+// DBGetLatencyStats retrieves the latency histograms of an engine
+// created by DBOpen. The histograms are cumulative since the engine
+// was opened.
+DBStatus DBGetLatencyStats(DBEngine* db, DBLatencyStats* stats);
+
+// DBTombstoneCompactionStats describes the compactions triggered by
+// sstables dense with tombstones: the number which have completed,
+// the decrease in the size of the sstables overlapping the compacted
+// spans and the number of spans queued or being compacted.
+typedef struct {
+  int64_t compactions;
+  int64_t reclaimed_bytes;
+  int64_t pending;
+} DBTombstoneCompactionStats;
+
+// DBGetTombstoneCompactionStats retrieves the tombstone compaction
+// statistics of an engine created by DBOpen with a positive
+// tombstone_compaction_density.
+DBStatus DBGetTombstoneCompactionStats(DBEngine* db, DBTombstoneCompactionStats* stats);
+
+// DBMemoryStats breaks down the memory held by the process. The
+// allocator fields are the jemalloc statistics of the whole process
+// and are only set if allocator_stats is true (i.e. the process uses
+// jemalloc). The engine fields are the memory held by the engine's
+// block cache (including the blocks pinned by iterators), memtables
+// (those which are still current and those which have been flushed
+// but are pinned by iterators) and table readers (the index and
+// filter blocks which are not held in the block cache). The libroach
+// fields are the memory allocated by libroach itself across all of
+// the engines in the process.
+typedef struct {
+  bool allocator_stats;
+  int64_t allocated;
+  int64_t active;
+  int64_t metadata;
+  int64_t resident;
+  int64_t mapped;
+  int64_t retained;
+  int64_t block_cache_usage;
+  int64_t block_cache_pinned_usage;
+  int64_t memtables;
+  int64_t pinned_memtables;
+  int64_t table_readers;
+  int64_t scan_buffers;
+  int64_t batches;
+} DBMemoryStats;
+
+// DBGetMemoryStats retrieves the memory statistics of an engine
+// created by DBOpen.
+DBStatus DBGetMemoryStats(DBEngine* db, DBMemoryStats* stats);
+
+// DBHotKey is a sampled key and the (approximate) number of times it
+// has been accessed recently.
+typedef struct {
+  DBString key;
+  int64_t accesses;
+} DBHotKey;
+
+// DBHotKeys holds the hottest keys of a span in key order. split_key
+// is the key which best divides their accesses in two (empty if there
+// are fewer than two keys), and samples is the total number of
+// accesses sampled by the engine. The keys array must be freed along
+// with each of the keys and split_key.
+typedef struct {
+  DBHotKey* keys;
+  int num_keys;
+  DBString split_key;
+  int64_t samples;
+} DBHotKeys;
+
+// DBGetHotKeys retrieves the current hottest keys in [start, end) of
+// an engine created by DBOpen with a positive key_sample_rate. An
+// empty end is unbounded. The keys are MVCC keys without timestamps.
+DBStatus DBGetHotKeys(DBEngine* db, DBSlice start, DBSlice end, DBHotKeys* result);
+
 // ApplyBatchRepr applies a batch of mutations encoded using that
 // batch representation returned by DBBatchRepr(). It is only valid to
 // call this function on an engine created by DBOpen() or DBNewBatch()
@@ -168,9 +485,18 @@ DBEngine* DBNewSnapshot(DBEngine* db);
 // batch can be used for reads or only for writes. A writeOnly batch
 // does not need to index keys for reading and can be faster if the
 // number of keys is large (and reads are not necessary). It is the
-// caller's responsibility to call DBClose().
+// caller's responsibility to call DBClose(). Batches created on an
+// engine returned by DBOpen are recycled: closing such a batch returns
+// it (if it is not too large) to a pool on the engine from which
+// subsequent calls to DBNewBatch are served. Batches must therefore be
+// closed before the engine they were created on.
 DBEngine* DBNewBatch(DBEngine* db, bool writeOnly);
 
+// DBBatchReset discards all of the mutations in a batch created by
+// DBNewBatch, allowing the batch to be reused without reallocating
+// it. Any iterators on the batch must be closed first.
+DBStatus DBBatchReset(DBEngine* db);
+
 // Creates a new database iterator. When prefix is true, Seek will use
 // the user-key prefix of the key supplied to DBIterSeek() to restrict
 // which sstables are searched, but iteration (using Next) over keys
@@ -179,8 +505,60 @@ DBEngine* DBNewBatch(DBEngine* db, bool writeOnly);
 // DBIterDestroy().
 DBIterator* DBNewIter(DBEngine* db, bool prefix);
 
+// Creates a new database iterator which only needs to return keys
+// with timestamps in [min_ts, max_ts]. Sstables (and, using per-block
+// timestamp bounds, parts of sstables) which contain no keys in the
+// range are skipped, but keys outside the range may still be returned
+// and must be filtered by the caller. It is the callers responsibility
+// to call DBIterDestroy().
 DBIterator* DBNewTimeBoundIter(DBEngine* db, DBTimestamp min_ts, DBTimestamp max_ts);
 
+// DBTimeBoundIterStats contains process-wide counters of the sstables
+// and block spans read and skipped by time bound iterators.
+typedef struct {
+  int64_t tables_read;
+  int64_t tables_skipped;
+  int64_t blocks_read;
+  int64_t blocks_skipped;
+} DBTimeBoundIterStats;
+
+DBTimeBoundIterStats DBGetTimeBoundIterStats();
+
+// Creates a new database iterator which only needs to return the
+// intents with keys in [start, end) (end may be empty, meaning
+// unbounded). Sstables which contain no such intents, nor deletions or
+// overwrites of unversioned keys which may shadow older intents, are
+// skipped, but other keys and versions may still be returned and must
+// be filtered by the caller. It is the callers responsibility to call
+// DBIterDestroy().
+DBIterator* DBNewIntentIter(DBEngine* db, DBSlice start, DBSlice end);
+
+// DBIntentIterStats contains process-wide counters of the sstables
+// read and skipped by intent iterators.
+typedef struct {
+  int64_t tables_read;
+  int64_t tables_skipped;
+} DBIntentIterStats;
+
+DBIntentIterStats DBGetIntentIterStats();
+
+// DBNewPooledIter is like DBNewIter, but for engines created by
+// DBOpen the iterator is checked out of a pool of previously destroyed
+// iterators of the same mode (prefix or total order) when possible.
+// Pooled iterators are refreshed to the latest state of the database
+// rather than rebuilt. DBIterDestroy returns the iterator to the pool,
+// where it continues to pin the memtables and sstables it last read
+// until it is reused. Pooled iterators must be destroyed before the
+// engine is closed.
+DBIterator* DBNewPooledIter(DBEngine* db, bool prefix);
+
+// DBIterRefresh updates the iterator to reflect the latest state of
+// the database without reallocating it. The iterator must be
+// repositioned (e.g. with DBIterSeek) afterwards. An error is returned
+// for iterators which cannot be refreshed, such as those on snapshots
+// and time bound iterators.
+DBStatus DBIterRefresh(DBIterator* iter);
+
 // Destroys an iterator, freeing up any associated memory.
 void DBIterDestroy(DBIterator* iter);
 
@@ -232,10 +610,39 @@ typedef struct {
 
 MVCCStatsResult MVCCComputeStats(DBIterator* iter, DBKey start, DBKey end, int64_t now_nanos);
 
+// MVCCComputeStatsParallel computes the same stats as MVCCComputeStats
+// for [start,end) using up to concurrency threads. The span is cut
+// into sub-spans at the boundaries of the bottom-most sstables and
+// the stats for each sub-span are computed from a consistent
+// snapshot and merged. The engine must not be a batch containing
+// range deletions or a write-only batch.
+MVCCStatsResult MVCCComputeStatsParallel(DBEngine* db, DBKey start, DBKey end, int64_t now_nanos,
+                                         int concurrency);
+
+// MVCCComputeStatsWithTableProps computes the same stats as
+// MVCCComputeStats for [start,end) but uses the per-sstable stats
+// recorded in the table properties for sstables which lie entirely
+// within the span and which do not overlap any other sstable or the
+// memtables. Only the remainder of the span is scanned. The engine
+// must not be a batch or a snapshot.
+MVCCStatsResult MVCCComputeStatsWithTableProps(DBEngine* db, DBKey start, DBKey end,
+                                               int64_t now_nanos);
+
 bool MVCCIsValidSplitKey(DBSlice key, bool allow_meta2_splits);
 DBStatus MVCCFindSplitKey(DBIterator* iter, DBKey start, DBKey end, DBKey min_split,
                           int64_t target_size, bool allow_meta2_splits, DBString* split_key);
 
+// MVCCFindSplitKeyApprox is like MVCCFindSplitKey but locates the
+// split point by bisecting the key span using the approximate sizes
+// maintained by RocksDB and then only scans a small window of keys
+// following the estimate for a valid split key. This avoids reading
+// the entire first half of the span. Small spans, and spans for which
+// no valid split key is found near the estimate, fall back to
+// MVCCFindSplitKey.
+DBStatus MVCCFindSplitKeyApprox(DBEngine* db, DBKey start, DBKey end, DBKey min_split,
+                                int64_t target_size, bool allow_meta2_splits,
+                                DBString* split_key);
+
 // DBTxn contains the fields from a roachpb.Transaction that are
 // necessary for MVCC Get and Scan operations. Note that passing a
 // serialized roachpb.Transaction appears to be a non-starter as an
@@ -250,13 +657,44 @@ typedef struct {
   DBTimestamp max_timestamp;
 } DBTxn;
 
+// DBScanPerf contains the RocksDB perf counters of a sampled MVCCScan
+// (see DBSetScanPerfSampling). Scans which are slow due to a buildup
+// of tombstones or old versions show large internal_keys_skipped or
+// tombstones_skipped counts relative to the number of results.
+typedef struct {
+  // Whether the scan was sampled. If false the other fields are zero.
+  bool sampled;
+  int64_t elapsed_nanos;
+  // The number of blocks read from sstables (i.e. block cache misses)
+  // and the number of block cache hits.
+  int64_t block_reads;
+  int64_t block_cache_hits;
+  // The number of internal keys (e.g. older versions) and tombstones
+  // skipped by the iterator.
+  int64_t internal_keys_skipped;
+  int64_t tombstones_skipped;
+  // The number of iterator seeks and steps performed by the scan.
+  int64_t seeks;
+  int64_t nexts;
+} DBScanPerf;
+
 // DBScanResults contains the key/value pairs and intents encoded
-// using the RocksDB batch repr format.
+// using the scan results format (a fixed 4-byte little-endian count
+// followed by entries of the form <key-len><val-len><key><value> with
+// fixed 4-byte little-endian lengths). The data is owned by the
+// iterator the scan was performed on and is only valid until the next
+// MVCCScan or MVCCGet call on that iterator.
 typedef struct {
   DBStatus status;
   DBSlice data;
   DBSlice intents;
   DBTimestamp uncertainty_timestamp;
+  DBScanPerf perf;
+  // If the scan stopped due to its max_keys or target_bytes limits,
+  // resume_key is the first key that did not fit, where the scan
+  // should resume. For max_keys it is the key of the last entry in
+  // data; for target_bytes it is not added to data.
+  DBSlice resume_key;
 } DBScanResults;
 
 DBScanResults MVCCGet(DBIterator* iter, DBSlice key, DBTimestamp timestamp,
@@ -265,6 +703,210 @@ DBScanResults MVCCScan(DBIterator* iter, DBSlice start, DBSlice end,
                        DBTimestamp timestamp, int64_t max_keys,
                        DBTxn txn, bool consistent, bool reverse);
 
+// MVCCScanWithLimits is like MVCCScan, but if target_bytes is positive
+// the scan also stops at the first key after the results occupy at
+// least target_bytes, without reading that key's value (see
+// DBScanResults.resume_key). If key_only is
+// true the results hold empty values, which are neither copied nor
+// read from blob files, for existence checks and counting scans.
+DBScanResults MVCCScanWithLimits(DBIterator* iter, DBSlice start, DBSlice end,
+                                 DBTimestamp timestamp, int64_t max_keys, int64_t target_bytes,
+                                 bool key_only, DBTxn txn, bool consistent, bool reverse);
+
+// DBSetScanPerfSampling configures MVCCScan to collect RocksDB perf
+// counters for one in every_n scans (per thread) and return them in
+// DBScanResults.perf. Sampling is disabled if every_n is <= 0 (the
+// default). Sampled scans are somewhat slower.
+void DBSetScanPerfSampling(int64_t every_n);
+
+// MVCCMultiGet retrieves the values of each of the num_keys keys at
+// the specified timestamp in a single call. The keys are sorted
+// internally so that the lookups share the iterator position; for a
+// prefix iterator each lookup is instead a seek which is able to use
+// the prefix bloom filters to skip sstables. The results (in the
+// same format as MVCCScan) are returned in sorted key order and
+// omit keys which do not exist at the timestamp.
+DBScanResults MVCCMultiGet(DBIterator* iter, const DBSlice* keys, int num_keys,
+                           DBTimestamp timestamp, DBTxn txn, bool consistent);
+
+// DBMVCCGetResults contains the results of DBMVCCGet, encoded in the
+// same format as DBScanResults. Unlike DBScanResults the data and
+// intents are owned by the caller and must be freed.
+typedef struct {
+  DBStatus status;
+  DBString data;
+  DBString intents;
+  DBTimestamp uncertainty_timestamp;
+} DBMVCCGetResults;
+
+// DBMVCCGet is the point read fast path: it retrieves the value of key
+// at the specified timestamp without the caller creating an iterator.
+// The lookup uses a pooled prefix iterator (see DBNewPooledIter) so
+// that the seek consults the prefix bloom filter of every sstable
+// (along with the memtables) and only descends into the sstables
+// which may contain the key before selecting the MVCC version visible
+// at the timestamp.
+DBMVCCGetResults DBMVCCGet(DBEngine* db, DBSlice key, DBTimestamp timestamp, DBTxn txn,
+                           bool consistent);
+
+// DBReadRequest is a read submitted with DBSubmitReads. If end is
+// empty it is an MVCCGet of start, otherwise it is an
+// MVCCScanWithLimits of [start, end). The keys and the txn id must
+// remain valid until the read completes. tag is returned with the
+// result to identify the read.
+typedef struct {
+  uint64_t tag;
+  DBSlice start;
+  DBSlice end;
+  DBTimestamp timestamp;
+  int64_t max_keys;
+  int64_t target_bytes;
+  bool key_only;
+  DBTxn txn;
+  bool consistent;
+  bool reverse;
+} DBReadRequest;
+
+// DBReadResult contains the results of a DBReadRequest, encoded in
+// the same format as DBScanResults. Unlike DBScanResults the data,
+// intents and resume_key are owned by the caller and must be freed.
+typedef struct {
+  uint64_t tag;
+  DBStatus status;
+  DBString data;
+  DBString intents;
+  DBTimestamp uncertainty_timestamp;
+  DBString resume_key;
+} DBReadResult;
+
+// DBReadQueue is a completion queue for the reads submitted with
+// DBSubmitReads. A queue may be shared by reads on several engines.
+typedef struct DBReadQueue DBReadQueue;
+
+// DBNewReadQueue creates a read completion queue. It is the caller's
+// responsibility to call DBReleaseReadQueue().
+DBReadQueue* DBNewReadQueue();
+
+// DBReleaseReadQueue releases the queue, which must not have any
+// submitted reads outstanding, along with any results not yet polled.
+void DBReleaseReadQueue(DBReadQueue* queue);
+
+// DBSubmitReads queues the reads for execution on the read threads of
+// an engine created by DBOpen with DBOptions.read_threads > 0, which
+// reuse their iterators across reads. I/O-bound reads thereby overlap
+// without blocking a calling thread per read. The results are added
+// to queue as the reads complete, in no particular order. The reads
+// see the latest state of the engine when they execute.
+DBStatus DBSubmitReads(DBEngine* db, const DBReadRequest* reqs, int num_reqs,
+                       DBReadQueue* queue);
+
+// DBPollReads moves up to max_results completed reads from the queue
+// into results and returns the number moved. If none have completed
+// but some are outstanding, it first waits up to timeout_nanos for a
+// read to complete: not at all if zero, and indefinitely if negative.
+int DBPollReads(DBReadQueue* queue, DBReadResult* results, int max_results,
+                int64_t timeout_nanos);
+
+// DBReadPoolStats contains the number of reads submitted with
+// DBSubmitReads which are queued and executing, and the distributions
+// of the time (in nanoseconds) reads spent queued and executing.
+typedef struct {
+  int64_t queued;
+  int64_t running;
+  DBHistogram queue_nanos;
+  DBHistogram service_nanos;
+} DBReadPoolStats;
+
+// DBGetReadPoolStats retrieves the read thread statistics of an
+// engine created by DBOpen with DBOptions.read_threads > 0. The
+// histograms are cumulative since the engine was opened.
+DBStatus DBGetReadPoolStats(DBEngine* db, DBReadPoolStats* stats);
+
+// DBSpan is a span of (unencoded) user keys [start, end).
+typedef struct {
+  DBSlice start;
+  DBSlice end;
+} DBSpan;
+
+// DBMultiScanResults contains the results of MVCCScanSpans. The
+// key/value pairs and intents for all of the spans are encoded in the
+// same format as DBScanResults. span_ends[i] is the number of
+// key/value pairs in data belonging to spans [0, i]; there are
+// num_span_ends entries, which is less than the number of spans if
+// the scan stopped early. resume_span is the index of the first span
+// which was not scanned to completion (or the number of spans if all
+// of them were). resume_key is then the first key which did not fit
+// within the limits, which as with MVCCScan is also the last
+// key/value pair in data if the scan stopped at max_keys. As with
+// DBScanResults, all of the returned data is owned by the iterator.
+typedef struct {
+  DBStatus status;
+  DBSlice data;
+  DBSlice intents;
+  DBTimestamp uncertainty_timestamp;
+  const int64_t* span_ends;
+  int num_span_ends;
+  int resume_span;
+  DBSlice resume_key;
+} DBMultiScanResults;
+
+// MVCCScanSpans performs a forward MVCCScan over each of the sorted,
+// non-overlapping spans using a single iterator. The max_keys and
+// target_bytes limits (target_bytes == 0 indicates no limit) are
+// shared by all of the spans. The iterator is stepped from one span
+// to the next when they are close together rather than re-seeked,
+// which makes this much cheaper than issuing one MVCCScan per span
+// for batches of small spans. The iterator must not be a prefix
+// iterator.
+DBMultiScanResults MVCCScanSpans(DBIterator* iter, const DBSpan* spans, int num_spans,
+                                 DBTimestamp timestamp, int64_t max_keys, int64_t target_bytes,
+                                 DBTxn txn, bool consistent);
+
+// MVCCChecksumResult holds the consistency checksum of a set of spans
+// and, if requested, their MVCC stats.
+typedef struct {
+  DBStatus status;
+  // The SHA-512 digest of the spans. The caller must free it.
+  DBString checksum;
+  MVCCStatsResult stats;
+} MVCCChecksumResult;
+
+// MVCCComputeChecksum computes the replica consistency checksum of
+// the spans, which must be sorted and disjoint, as Replica.sha512 (in
+// pkg/storage) defines it. Every key/value pair is hashed in key order,
+// as its little-endian 8-byte key and value lengths, then the key,
+// the marshaled hlc.LegacyTimestamp, and the value. The exception is
+// skip_key, which is an unencoded key that is not hashed if it has no
+// timestamp. Separated values are hashed as the values they refer
+// to.
+//
+// Up to concurrency threads read the spans from a consistent
+// snapshot. The spans are cut into sub-spans as in
+// MVCCComputeStatsParallel, and the sub-spans are hashed in order, so
+// the checksum does not depend on the concurrency. If compute_stats is
+// true, the MVCC stats of the spans at now_nanos are computed from the
+// same read of the data. The engine must not be a batch containing
+// range deletions or a write-only batch.
+MVCCChecksumResult MVCCComputeChecksum(DBEngine* db, const DBSpan* spans, int num_spans,
+                                       DBSlice skip_key, bool compute_stats, int64_t now_nanos,
+                                       int concurrency);
+
+// DBCompactionLevelStats contains the cumulative statistics of the
+// compactions which output to a single level. The ratio of the bytes
+// written by compactions (plus flushes) to the bytes written by the
+// application is the write amplification. The ratio of raw_bytes (the
+// uncompressed size of the keys and values written to the level by
+// flushes and compactions) to data_bytes (the size of the data blocks
+// they were written in) is the compression ratio of the level.
+typedef struct {
+  int64_t compactions;
+  int64_t input_bytes;
+  int64_t output_bytes;
+  DBHistogram duration_micros;
+  int64_t raw_bytes;
+  int64_t data_bytes;
+} DBCompactionLevelStats;
+
 // DBStatsResult contains various runtime stats for RocksDB.
 typedef struct {
   int64_t block_cache_hits;
@@ -278,9 +920,94 @@ typedef struct {
   int64_t compactions;
   int64_t table_readers_mem_estimate;
   int64_t pending_compaction_bytes_estimate;
+  int64_t persistent_cache_hits;
+  int64_t persistent_cache_misses;
+  int64_t persistent_cache_usage;
+  // The number of times writes have been delayed or stopped because
+  // of a buildup of memtables, L0 files or pending compaction bytes,
+  // and the total time spent delayed or stopped.
+  int64_t write_stalls;
+  int64_t write_stops;
+  int64_t write_stall_nanos;
+  int64_t flush_bytes;
+  int64_t l0_file_count;
+  // The compaction statistics, indexed by output level.
+  DBCompactionLevelStats compaction_levels[7];
+  // The number of blocks decompressed and the total time spent
+  // decompressing them, which is only measured if
+  // DBOptions.detailed_timers is set.
+  int64_t block_decompressions;
+  int64_t decompression_nanos;
+  // The number and total size of the blob files holding separated
+  // values (see DBOptions.value_separation_threshold), and the total
+  // size of the values relocated out of sparsely referenced blob files.
+  int64_t blob_file_count;
+  int64_t blob_file_bytes;
+  int64_t blob_relocated_bytes;
+  // The current rate of the flush and compaction rate limiter (0 if it
+  // is disabled) and the total time flushes and compactions have been
+  // throttled by it.
+  int64_t rate_limit_bytes_per_sec;
+  int64_t rate_limit_throttled_nanos;
+  // The number of bytes read ahead of sequential sstable scans and the
+  // number of bytes of reads served from the readahead (see
+  // DBOptions.max_readahead_bytes).
+  int64_t readahead_bytes;
+  int64_t readahead_hit_bytes;
 } DBStatsResult;
 
 DBStatus DBGetStats(DBEngine* db, DBStatsResult* stats);
+
+typedef enum {
+  TimeSeriesAggregatorSum = 0,
+  TimeSeriesAggregatorAvg = 1,
+  TimeSeriesAggregatorMax = 2,
+  TimeSeriesAggregatorMin = 3,
+  TimeSeriesAggregatorLast = 4,
+} DBTimeSeriesAggregator;
+
+// DBTimeSeriesQuery describes the downsampling of time series data
+// into the intervals of interval_nanos starting at start_nanos which
+// precede end_nanos. The samples in each interval are aggregated by
+// the aggregator: the sum or the average of their values, the maximum
+// or minimum of their values or the value of the latest sample. The
+// value of a sample is its sum divided by its count, i.e. samples
+// which were rolled up are weighted by the number of samples they
+// accumulate.
+typedef struct {
+  int64_t start_nanos;
+  int64_t end_nanos;
+  int64_t interval_nanos;
+  DBTimeSeriesAggregator aggregator;
+} DBTimeSeriesQuery;
+
+// DBTimeSeries holds the downsampled values of a single series. The
+// values array holds the value of each interval, or NaN if the
+// interval had no samples.
+typedef struct {
+  DBString name;
+  DBString source;
+  int64_t resolution;
+  double* values;
+} DBTimeSeries;
+
+typedef struct {
+  DBTimeSeries* series;
+  int num_series;
+  int64_t num_intervals;
+} DBTimeSeriesQueryResults;
+
+// DBQueryTimeSeries downsamples the time series data stored in the key
+// span [start, end) (see DBTimeSeriesQuery), reading the sample arrays
+// of the InternalTimeSeriesData or columnar values directly rather
+// than returning them to the caller. The results hold one entry per
+// series (i.e. per name, resolution and source) with data in the
+// span, in key order. The series array must be freed along with the
+// name, source and values of each series. Queries returning more than
+// 2^20 intervals in total, across all of the series, fail.
+DBStatus DBQueryTimeSeries(DBIterator* iter, DBKey start, DBKey end, DBTimeSeriesQuery query,
+                           DBTimeSeriesQueryResults* results);
+
 DBString DBGetCompactionStats(DBEngine* db);
 
 typedef struct {
@@ -305,14 +1032,62 @@ DBString DBGetUserProperties(DBEngine* db);
 // can be added. If move_file is true, the file will be moved instead of copied.
 DBStatus DBIngestExternalFile(DBEngine* db, DBSlice path, bool move_file);
 
+// DBIngestedFile describes where an sstable was ingested by
+// DBIngestExternalFiles.
+typedef struct {
+  // The level the file was ingested into, or -1 if unknown (e.g. if
+  // the file was compacted away before the ingest returned).
+  int level;
+  // Whether the file was assigned a global sequence number (because it
+  // overlapped existing data or a snapshot was outstanding). False if
+  // unknown.
+  bool global_seqno;
+} DBIngestedFile;
+
+// Bulk adds the non-overlapping files at the given paths to a database
+// atomically in a single ingestion, filling in results[i] for
+// paths[i]. See DBIngestExternalFile.
+DBStatus DBIngestExternalFiles(DBEngine* db, const DBSlice* paths, int num_paths,
+                               bool move_files, DBIngestedFile* results);
+
 typedef struct DBSstFileWriter DBSstFileWriter;
 
 // Creates a new SstFileWriter with the default configuration.
 DBSstFileWriter* DBSstFileWriterNew();
 
+// DBSstFileWriterOptions configures the sstables built by a writer
+// created with DBSstFileWriterNewWithOptions.
+typedef struct {
+  // The data block size. Zero selects the default (64 KB).
+  uint64_t block_size;
+  // The block based table format version.
+  int format_version;
+  // Whether to compress blocks (with snappy).
+  bool compression;
+  // The bits per key of the prefix bloom filter, or zero for none.
+  int bloom_bits_per_key;
+} DBSstFileWriterOptions;
+
+// Creates a new streaming SstFileWriter with the given options. Its
+// output is either written to a file (see DBSstFileWriterOpenFile) or
+// buffered in memory only until it is drained by
+// DBSstFileWriterTruncate (see DBSstFileWriterOpen), so the whole
+// sstable is never held in memory.
+DBSstFileWriter* DBSstFileWriterNewWithOptions(DBSstFileWriterOptions opts);
+
 // Opens an in-memory file for output of an sstable.
 DBStatus DBSstFileWriterOpen(DBSstFileWriter* fw);
 
+// Opens the file at path for output of an sstable. Only supported by
+// writers created with DBSstFileWriterNewWithOptions.
+DBStatus DBSstFileWriterOpenFile(DBSstFileWriter* fw, DBSlice path);
+
+// Returns the data written by a streaming writer (see
+// DBSstFileWriterNewWithOptions) since the previous call and discards
+// it from the writer. The concatenation of the returned chunks and the
+// data returned by DBSstFileWriterFinish is the sstable.
+DBStatus DBSstFileWriterTruncate(DBSstFileWriter* fw, DBString* data);
+
 // Adds a kv entry to the sstable being built. An error is returned if it is
 // not greater than any previously added entry (according to the comparator
 // configured during writer creation). `Open` must have been called. `Close`
@@ -320,18 +1095,135 @@ DBStatus DBSstFileWriterOpen(DBSstFileWriter* fw);
 DBStatus DBSstFileWriterAdd(DBSstFileWriter* fw, DBKey key, DBSlice val);
 
 // Finalizes the writer and stores the constructed file's contents in *data. At
-// least one kv entry must have been added. May only be called once.
+// least one kv entry must have been added. May only be called once. For a
+// streaming writer *data only holds the data not yet returned by
+// DBSstFileWriterTruncate, and is empty when writing to a file.
 DBStatus DBSstFileWriterFinish(DBSstFileWriter* fw, DBString* data);
 
 // Closes the writer and frees memory and other resources. May only be called
 // once.
 void DBSstFileWriterClose(DBSstFileWriter* fw);
 
+// DBExportToSst exports the MVCC versions in [start, end) with
+// timestamps in (start_ts, end_ts] to an sstable, equivalent to
+// iterating them with an MVCCIncrementalIterator and adding them to a
+// DBSstFileWriter but without any per-kv calls from Go. If
+// all_revisions is false only the latest version of each key is
+// exported (and deletion tombstones are omitted when start_ts is
+// zero). An error is returned if an intent in (start_ts, end_ts] is
+// encountered. If target_size is positive the export stops at the
+// first key after target_size bytes of keys and values have been
+// exported and that key is returned in *resume_key. The sstable
+// contents are returned in *sst, which is empty if there was nothing
+// to export. The caller is responsible for freeing *sst and
+// *resume_key.
+DBStatus DBExportToSst(DBEngine* engine, DBKey start, DBKey end, DBTimestamp start_ts,
+                       DBTimestamp end_ts, bool all_revisions, int64_t target_size,
+                       DBString* sst, DBString* resume_key);
+
+// DBSpanExport describes the sstables written by DBExportSpanToSsts.
+// The paths array must be freed along with each of the paths.
+typedef struct {
+  DBString* paths;
+  int num_paths;
+  // The number of sstables which were hard linked rather than
+  // rewritten, and the sizes of the linked and rewritten sstables.
+  int num_linked;
+  int64_t linked_bytes;
+  int64_t written_bytes;
+} DBSpanExport;
+
+// DBExportSpanToSsts exports a consistent snapshot of the keys in
+// [start, end) as non-overlapping sstables in dir (which is created if
+// it does not exist), in key order, so that the receiver can ingest
+// them in one DBIngestExternalFiles call. Like DBCreateCheckpoint it
+// flushes the memtable. An sstable which lies entirely within the span
+// and which is not overlapped by any other sstable is hard linked
+// rather than rewritten if it was itself ingested (and so can be
+// ingested again), which is typically the case for the data of a
+// range received in a snapshot; everything else in the span is
+// rewritten. Linked sstables share their contents with the engine and
+// must be copied rather than moved by an ingestion on the same
+// filesystem. The engine must have been created by DBOpen.
+DBStatus DBExportSpanToSsts(DBEngine* db, DBKey start, DBKey end, DBSlice dir,
+                            DBSpanExport* result);
+
 void DBRunLDB(int argc, char** argv);
 
+// DBStartTrace starts recording the engine calls made on the engine
+// (and the batches, snapshots and iterators created from it) into a
+// new trace file at path. Recorded are DBApplyBatchRepr, batch
+// commits, MVCCGet, MVCCScan, DBIterSeek and DBIterNext, along with
+// their timestamps and keys, and the lifetime of the iterators they
+// are made on. The trace is written through the engine's env, so it
+// is encrypted on encrypted stores. Only one trace can be recorded at
+// a time.
+//
+// If checkpoint_dir is not empty, a checkpoint of the engine (see
+// DBCreateCheckpoint) is created in it as of the start of the trace,
+// which the trace can then be replayed against with DBReplayTrace.
+// The calls made while the checkpoint is created wait for it.
+DBStatus DBStartTrace(DBEngine* db, DBSlice path, DBSlice checkpoint_dir);
+
+// DBStopTrace stops recording the current trace and closes the trace
+// file.
+DBStatus DBStopTrace(DBEngine* db);
+
+typedef struct {
+  int64_t records;
+  int64_t errors;
+  int64_t elapsed_nanos;
+  DBHistogram apply_batch_repr;
+  DBHistogram commit_batch;
+  DBHistogram mvcc_get;
+  DBHistogram mvcc_scan;
+  DBHistogram iter_seek;
+  DBHistogram iter_next;
+} DBTraceReplayStats;
+
+// DBReplayTrace re-executes the calls recorded in a trace file
+// against the engine and returns the latency of each type of call in
+// nanoseconds. With a speed > 0 the calls are issued at the recorded
+// pace accelerated by the speed factor; otherwise they are issued as
+// fast as possible. Batch commits are replayed as DBApplyBatchRepr and
+// reads are replayed without their transaction, so reads which
+// encountered the transaction's own intents may fail; such failures
+// are counted in errors. The engine is modified by the replay, which
+// is meant to be made on the checkpoint taken by DBStartTrace, opened
+// with the options (and encryption settings) of the traced store. The
+// trace is read incrementally through the engine's env.
+DBStatus DBReplayTrace(DBEngine* db, DBSlice trace_path, double speed,
+                       DBTraceReplayStats* stats);
+
+// DBCreateCheckpoint creates a consistent copy of the engine in dir
+// (which must not exist). sstables are hard linked if dir is on the
+// same filesystem as the engine.
+DBStatus DBCreateCheckpoint(DBEngine* db, DBSlice dir);
+
 // DBEnvWriteFile writes the given data as a new "file" in the given engine.
 DBStatus DBEnvWriteFile(DBEngine* db, DBSlice path, DBSlice contents);
 
+// DBWritableFile is a file in an engine's env which is written
+// incrementally, so that large files (e.g. sideloaded sstables) need
+// not be buffered in memory.
+typedef struct DBWritableFile DBWritableFile;
+
+// DBEnvOpenFile creates (or truncates) the "file" at path in the given
+// engine. If bytes_per_sync is non-zero, writeback of the appended data
+// is started every bytes_per_sync bytes instead of being left for the
+// final sync. The file must be closed with DBEnvCloseFile.
+DBStatus DBEnvOpenFile(DBEngine* db, DBSlice path, uint64_t bytes_per_sync, DBWritableFile** file);
+
+// DBEnvAppendFile appends the given data to the file.
+DBStatus DBEnvAppendFile(DBWritableFile* file, DBSlice contents);
+
+// DBEnvSyncFile syncs the data appended to the file to disk.
+DBStatus DBEnvSyncFile(DBWritableFile* file);
+
+// DBEnvCloseFile closes the file and releases it, even if an error is
+// returned. It does not sync the file.
+DBStatus DBEnvCloseFile(DBWritableFile* file);
+
 // DBFileLock contains various parameters set during DBLockFile and required for DBUnlockFile.
 typedef void* DBFileLock;
 
@@ -0,0 +1,236 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "key_sampler.h"
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+// shardIndex returns the calling thread's KeySampler shard. Threads
+// are assigned shards round-robin on first use.
+int shardIndex() {
+  static std::atomic<int> next_shard(0);
+  thread_local int shard = next_shard.fetch_add(1) % KeySampler::kNumShards;
+  return shard;
+}
+
+// nextRandom returns the next value of the calling thread's xorshift
+// generator.
+uint64_t nextRandom() {
+  thread_local uint64_t state = 0x9e3779b97f4a7c15ULL + uint64_t(shardIndex());
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// hashKey returns the 64-bit FNV-1a hash of the key.
+uint64_t hashKey(const std::string& key) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : key) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+}  // namespace
+
+const int KeySampler::kNumShards;
+const size_t KeySampler::kBufferSize;
+const int KeySampler::kSketchDepth;
+const int KeySampler::kSketchWidth;
+const size_t KeySampler::kMaxCandidates;
+const size_t KeySampler::kReservoirSize;
+const uint64_t KeySampler::kDecayInterval;
+
+KeySampler::KeySampler(int sample_rate)
+    : sample_rate_(std::max(sample_rate, 1)),
+      reservoir_seen_(0),
+      samples_(0),
+      since_decay_(0) {
+  memset(sketch_, 0, sizeof(sketch_));
+  for (int i = 0; i < kNumShards; ++i) {
+    shards_[i].countdown = nextSkip();
+  }
+}
+
+int64_t KeySampler::nextSkip() const {
+  // Uniform in [1, 2*sample_rate-1], which averages sample_rate.
+  return 1 + int64_t(nextRandom() % uint64_t(2 * sample_rate_ - 1));
+}
+
+bool KeySampler::Sample() {
+  shard& s = shards_[shardIndex()];
+  if (s.countdown.fetch_sub(1, std::memory_order_relaxed) > 1) {
+    return false;
+  }
+  // Racing threads sharing the shard may both sample, which is
+  // harmless.
+  s.countdown.store(nextSkip(), std::memory_order_relaxed);
+  return true;
+}
+
+bool KeySampler::Skip(uint32_t n) {
+  shard& s = shards_[shardIndex()];
+  if (s.countdown.load(std::memory_order_relaxed) > int64_t(n)) {
+    s.countdown.fetch_sub(n, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void KeySampler::Add(const rocksdb::Slice& key) {
+  shard* s = &shards_[shardIndex()];
+  {
+    std::lock_guard<std::mutex> l(s->mu);
+    s->buf.push_back(key.ToString());
+    if (s->buf.size() < kBufferSize) {
+      return;
+    }
+  }
+  flush(s);
+}
+
+void KeySampler::flush(shard* s) {
+  std::vector<std::string> buf;
+  {
+    std::lock_guard<std::mutex> l(s->mu);
+    buf.swap(s->buf);
+  }
+  if (buf.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> l(mu_);
+  for (const auto& key : buf) {
+    addLocked(key);
+  }
+}
+
+void KeySampler::addLocked(const std::string& key) {
+  // The depth hashes are derived from two halves of one hash (see
+  // Kirsch and Mitzenmacher, "Less Hashing, Same Performance").
+  const uint64_t h = hashKey(key);
+  const uint32_t h1 = uint32_t(h);
+  const uint32_t h2 = uint32_t(h >> 32) | 1;
+  uint32_t estimate = UINT32_MAX;
+  for (int i = 0; i < kSketchDepth; ++i) {
+    uint32_t& c = sketch_[i][(h1 + i * h2) % kSketchWidth];
+    if (c < UINT32_MAX) {
+      ++c;
+    }
+    estimate = std::min(estimate, c);
+  }
+  ++samples_;
+
+  auto it = candidates_.find(key);
+  if (it != candidates_.end()) {
+    it->second = estimate;
+  } else if (candidates_.size() < kMaxCandidates) {
+    candidates_.emplace(key, estimate);
+  } else {
+    auto min = candidates_.begin();
+    for (auto c = candidates_.begin(); c != candidates_.end(); ++c) {
+      if (c->second < min->second) {
+        min = c;
+      }
+    }
+    if (estimate > min->second) {
+      candidates_.erase(min);
+      candidates_.emplace(key, estimate);
+    }
+  }
+
+  // Reservoir sampling (Vitter's Algorithm R).
+  ++reservoir_seen_;
+  if (reservoir_.size() < kReservoirSize) {
+    reservoir_.push_back(key);
+  } else {
+    const uint64_t i = nextRandom() % reservoir_seen_;
+    if (i < kReservoirSize) {
+      reservoir_[i] = key;
+    }
+  }
+
+  if (++since_decay_ >= kDecayInterval) {
+    decayLocked();
+  }
+}
+
+uint32_t KeySampler::estimateLocked(const std::string& key) const {
+  const uint64_t h = hashKey(key);
+  const uint32_t h1 = uint32_t(h);
+  const uint32_t h2 = uint32_t(h >> 32) | 1;
+  uint32_t estimate = UINT32_MAX;
+  for (int i = 0; i < kSketchDepth; ++i) {
+    estimate = std::min(estimate, sketch_[i][(h1 + i * h2) % kSketchWidth]);
+  }
+  return estimate;
+}
+
+void KeySampler::decayLocked() {
+  since_decay_ = 0;
+  for (int i = 0; i < kSketchDepth; ++i) {
+    for (int j = 0; j < kSketchWidth; ++j) {
+      sketch_[i][j] /= 2;
+    }
+  }
+  // Halving the samples the reservoir was drawn from makes the
+  // following samples twice as likely to replace the older ones.
+  reservoir_seen_ = std::max<uint64_t>(reservoir_seen_ / 2, reservoir_.size());
+  for (auto it = candidates_.begin(); it != candidates_.end();) {
+    it->second /= 2;
+    if (it->second == 0) {
+      it = candidates_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void KeySampler::HotKeys(const rocksdb::Slice& start, const rocksdb::Slice& end,
+                         std::vector<std::pair<std::string, uint64_t>>* keys, uint64_t* samples) {
+  for (int i = 0; i < kNumShards; ++i) {
+    flush(&shards_[i]);
+  }
+  keys->clear();
+  std::lock_guard<std::mutex> l(mu_);
+  std::vector<std::string> span;
+  auto inSpan = [&start, &end](const std::string& k) {
+    const rocksdb::Slice key(k);
+    return key.compare(start) >= 0 && (end.empty() || key.compare(end) < 0);
+  };
+  for (const auto& c : candidates_) {
+    if (inSpan(c.first)) {
+      span.push_back(c.first);
+    }
+  }
+  for (const auto& k : reservoir_) {
+    if (inSpan(k)) {
+      span.push_back(k);
+    }
+  }
+  std::sort(span.begin(), span.end());
+  span.erase(std::unique(span.begin(), span.end()), span.end());
+  for (auto& k : span) {
+    const uint32_t estimate = estimateLocked(k);
+    if (estimate == 0) {
+      // Decayed away since it was sampled.
+      continue;
+    }
+    keys->emplace_back(std::move(k), uint64_t(estimate) * uint64_t(sample_rate_));
+  }
+  *samples = samples_;
+}
@@ -0,0 +1,107 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <rocksdb/slice.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// KeySampler estimates which keys are accessed the most, so that
+// load-based splitting can pick split points which divide the load of
+// a range rather than its size. Roughly one in sample_rate accesses is
+// sampled (the gaps between samples are randomized so that regular
+// access patterns are not aliased). The sampled keys are counted in a
+// Count-Min sketch, and the keys with the largest estimated counts are
+// tracked as the hot key candidates. Since the candidates are shared
+// by all the ranges of the store, a reservoir of kReservoirSize
+// sampled keys is kept as well, so that each span is represented in
+// proportion to its share of the load even when there are more hot
+// spans than candidates. Counts are halved every kDecayInterval
+// samples (which also favors the recent samples in the reservoir) so
+// that the candidates follow the current load.
+//
+// Sampling decisions are made per thread shard without locking, and
+// sampled keys are buffered in the shard and added to the sketch in
+// batches of kBufferSize, so the sketch lock is taken once per
+// kBufferSize samples.
+class KeySampler {
+ public:
+  static const int kNumShards = 16;
+  static const size_t kBufferSize = 64;
+  static const int kSketchDepth = 4;
+  static const int kSketchWidth = 4096;
+  static const size_t kMaxCandidates = 64;
+  static const size_t kReservoirSize = 4096;
+  static const uint64_t kDecayInterval = 1 << 16;
+
+  explicit KeySampler(int sample_rate);
+
+  // Sample returns true if the current access should be sampled, in
+  // which case the caller passes the accessed key to Add.
+  bool Sample();
+  // Skip returns true if any of the next n accesses will be sampled.
+  // Otherwise it skips them, so that the caller need not call Sample
+  // for each of them.
+  bool Skip(uint32_t n);
+  // Add records the sampled access of key.
+  void Add(const rocksdb::Slice& key);
+
+  // HotKeys returns the hot key candidates and the reservoir keys in
+  // [start, end) (an empty end is unbounded) with their estimated
+  // access counts, sorted by key, along with the total number of
+  // samples taken. A sampled access counts for sample_rate accesses.
+  void HotKeys(const rocksdb::Slice& start, const rocksdb::Slice& end,
+               std::vector<std::pair<std::string, uint64_t>>* keys, uint64_t* samples);
+
+  int SampleRate() const { return sample_rate_; }
+
+ private:
+  struct shard {
+    shard() : countdown(0) {}
+
+    // The number of accesses until the next sample.
+    std::atomic<int64_t> countdown;
+    std::mutex mu;
+    std::vector<std::string> buf;
+    // Pad the shards apart so that neighboring shards don't share a
+    // cache line.
+    char pad[64];
+  };
+
+  // nextSkip returns a random number of accesses to the next sample.
+  int64_t nextSkip() const;
+  // flush adds the keys buffered in the shard to the sketch.
+  void flush(shard* s);
+  void addLocked(const std::string& key);
+  // estimateLocked returns the sketch's estimate of the samples of key.
+  uint32_t estimateLocked(const std::string& key) const;
+  void decayLocked();
+
+  const int sample_rate_;
+  shard shards_[kNumShards];
+  std::mutex mu_;
+  uint32_t sketch_[kSketchDepth][kSketchWidth];
+  std::unordered_map<std::string, uint64_t> candidates_;
+  std::vector<std::string> reservoir_;
+  // The (decayed) number of samples the reservoir was drawn from.
+  uint64_t reservoir_seen_;
+  uint64_t samples_;
+  uint64_t since_decay_;
+};
@@ -0,0 +1,170 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "fmt.h"
+#include "key_sampler.h"
+
+namespace {
+
+// access records an access of key, as the engine does.
+void access(KeySampler* s, const std::string& key) {
+  if (s->Sample()) {
+    s->Add(key);
+  }
+}
+
+}  // namespace
+
+TEST(Libroach, KeySamplerHotKeys) {
+  KeySampler s(1);
+  // Two hot keys amid many more cold keys than there are candidates.
+  for (int i = 0; i < 20 * int(KeySampler::kMaxCandidates); i++) {
+    access(&s, fmt::StringPrintf("cold%05d", i));
+    if (i % 2 == 0) {
+      access(&s, "hot-a");
+    }
+    if (i % 4 == 0) {
+      access(&s, "hot-b");
+    }
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  uint64_t samples;
+  s.HotKeys("", "", &keys, &samples);
+  EXPECT_EQ(20 * KeySampler::kMaxCandidates * 7 / 4, samples);
+  ASSERT_LE(keys.size(), KeySampler::kMaxCandidates + KeySampler::kReservoirSize);
+  ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+  uint64_t a = 0, b = 0;
+  for (const auto& k : keys) {
+    if (k.first == "hot-a") {
+      a = k.second;
+    } else if (k.first == "hot-b") {
+      b = k.second;
+    }
+  }
+  // The sketch may only overestimate.
+  EXPECT_GE(a, 10 * KeySampler::kMaxCandidates);
+  EXPECT_GE(b, 5 * KeySampler::kMaxCandidates);
+  EXPECT_GT(a, b);
+
+  // Only the keys in the span are returned.
+  s.HotKeys("hot-b", "", &keys, &samples);
+  ASSERT_FALSE(keys.empty());
+  EXPECT_EQ("hot-b", keys[0].first);
+  s.HotKeys("cold", "hot", &keys, &samples);
+  for (const auto& k : keys) {
+    EXPECT_EQ("cold", k.first.substr(0, 4));
+  }
+}
+
+TEST(Libroach, KeySamplerDisjointSpans) {
+  // Many more disjoint hot spans (each with one hot key amid cold keys)
+  // than there are candidates, as when a store holds many busy ranges.
+  const int kSpans = 4 * int(KeySampler::kMaxCandidates);
+  const int kHotAccesses = 100;
+  KeySampler s(1);
+  for (int i = 0; i < kHotAccesses; i++) {
+    for (int span = 0; span < kSpans; span++) {
+      access(&s, fmt::StringPrintf("span%03d/hot", span));
+      if (i % 4 == 0) {
+        access(&s, fmt::StringPrintf("span%03d/cold%03d", span, i));
+      }
+    }
+  }
+
+  // Every span finds its hot key, and it is the hottest key in the
+  // span.
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  uint64_t samples;
+  for (int span = 0; span < kSpans; span++) {
+    const std::string start = fmt::StringPrintf("span%03d/", span);
+    const std::string end = fmt::StringPrintf("span%03d0", span);
+    s.HotKeys(start, end, &keys, &samples);
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    auto hottest = std::max_element(
+        keys.begin(), keys.end(),
+        [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+          return a.second < b.second;
+        });
+    ASSERT_NE(keys.end(), hottest) << start;
+    EXPECT_EQ(start + "hot", hottest->first);
+    EXPECT_GE(hottest->second, kHotAccesses);
+    for (const auto& k : keys) {
+      EXPECT_EQ(start, k.first.substr(0, start.size()));
+    }
+  }
+}
+
+TEST(Libroach, KeySamplerRate) {
+  const int kRate = 10;
+  const int kAccesses = 100000;
+  KeySampler s(kRate);
+  int sampled = 0;
+  for (int i = 0; i < kAccesses; i++) {
+    if (s.Sample()) {
+      sampled++;
+      s.Add("key");
+    }
+  }
+  EXPECT_GT(sampled, kAccesses / kRate * 9 / 10);
+  EXPECT_LT(sampled, kAccesses / kRate * 11 / 10);
+
+  // The counts are scaled up by the sample rate.
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  uint64_t samples;
+  s.HotKeys("", "", &keys, &samples);
+  EXPECT_EQ(uint64_t(sampled), samples);
+  ASSERT_EQ(1, keys.size());
+  EXPECT_EQ(uint64_t(sampled * kRate), keys[0].second);
+
+  // Skipping fewer accesses than the gap to the next sample never
+  // samples them.
+  int skipped = 0;
+  for (int i = 0; i < 1000; i++) {
+    if (!s.Skip(1)) {
+      skipped++;
+    } else {
+      s.Sample();
+    }
+  }
+  EXPECT_GT(skipped, 1000 / 2);
+}
+
+TEST(Libroach, KeySamplerConcurrent) {
+  KeySampler s(1);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2 * KeySampler::kNumShards; t++) {
+    threads.emplace_back([&s, t] {
+      for (int i = 0; i < 1000; i++) {
+        access(&s, fmt::StringPrintf("thread%02d", t % 4));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  uint64_t samples;
+  s.HotKeys("", "", &keys, &samples);
+  EXPECT_EQ(2 * KeySampler::kNumShards * 1000, samples);
+  ASSERT_EQ(4, keys.size());
+  for (const auto& k : keys) {
+    EXPECT_GE(k.second, KeySampler::kNumShards / 2 * 1000);
+  }
+}
@@ -0,0 +1,90 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "memory_stats.h"
+#include <atomic>
+
+#if defined(__linux__)
+// libroach does not link against jemalloc itself: the cockroach binary
+// does, unless it is built with the stdmalloc tag. The reference to
+// mallctl is weak so that it is NULL when jemalloc is not linked in.
+// On other platforms jemalloc is built with a symbol prefix and the
+// weak reference would not resolve, so the stats are unavailable.
+extern "C" int mallctl(const char* name, void* oldp, size_t* oldlenp, void* newp, size_t newlen)
+    __attribute__((weak));
+#define ROACH_HAVE_MALLCTL 1
+#endif
+
+namespace {
+
+const int kNumShards = 16;
+
+struct shard {
+  std::atomic<int64_t> bytes[kNumMemoryAccounts];
+  // Pad the shards apart so that neighboring shards don't share a
+  // cache line.
+  char pad[64];
+};
+
+shard shards[kNumShards];
+
+// shardIndex returns the calling thread's shard. Threads are assigned
+// shards round-robin on first use.
+int shardIndex() {
+  static std::atomic<int> next_shard(0);
+  thread_local int shard = next_shard.fetch_add(1) % kNumShards;
+  return shard;
+}
+
+#ifdef ROACH_HAVE_MALLCTL
+bool readStat(const char* name, size_t* value) {
+  size_t sz = sizeof(*value);
+  return mallctl(name, value, &sz, nullptr, 0) == 0;
+}
+#endif
+
+}  // namespace
+
+void MemoryAccountAdd(MemoryAccount account, int64_t delta) {
+  shards[shardIndex()].bytes[account].fetch_add(delta, std::memory_order_relaxed);
+}
+
+int64_t MemoryAccountBytes(MemoryAccount account) {
+  // A reservation may be grown on one thread and released on another,
+  // so individual shards may be negative but the sum is not.
+  int64_t bytes = 0;
+  for (int i = 0; i < kNumShards; ++i) {
+    bytes += shards[i].bytes[account].load(std::memory_order_relaxed);
+  }
+  return bytes;
+}
+
+bool GetAllocatorStats(AllocatorStats* stats) {
+#ifdef ROACH_HAVE_MALLCTL
+  if (mallctl == nullptr) {
+    return false;
+  }
+  // Bump the epoch to refresh the statistics cached by jemalloc.
+  uint64_t epoch = 1;
+  size_t sz = sizeof(epoch);
+  mallctl("epoch", &epoch, &sz, &epoch, sz);
+  return readStat("stats.allocated", &stats->allocated) &&
+         readStat("stats.active", &stats->active) &&
+         readStat("stats.metadata", &stats->metadata) &&
+         readStat("stats.resident", &stats->resident) &&
+         readStat("stats.mapped", &stats->mapped) && readStat("stats.retained", &stats->retained);
+#else
+  return false;
+#endif
+}
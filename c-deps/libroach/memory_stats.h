@@ -0,0 +1,76 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MemoryAccount identifies a class of memory allocated by libroach
+// itself (as opposed to by RocksDB), so that the memory held by a
+// process can be attributed. The accounts are process wide: they
+// cover all of the engines in the process.
+enum MemoryAccount {
+  // The buffers of MVCCScan and MVCCGet results owned by iterators.
+  kMemoryScanBuffers,
+  // The reprs of batches, including closed batches held by the pools.
+  kMemoryBatches,
+  kNumMemoryAccounts,
+};
+
+// MemoryAccountAdd adds delta bytes to an account. The accounts are
+// sharded by thread so that they can be updated on hot paths.
+void MemoryAccountAdd(MemoryAccount account, int64_t delta);
+
+// MemoryAccountBytes returns the number of bytes in an account.
+int64_t MemoryAccountBytes(MemoryAccount account);
+
+// MemoryReservation tracks the size of an allocation in a memory
+// account, releasing it when the reservation is destroyed.
+class MemoryReservation {
+ public:
+  explicit MemoryReservation(MemoryAccount account) : account_(account), bytes_(0) {}
+  ~MemoryReservation() { Set(0); }
+
+  // Set updates the size of the allocation.
+  void Set(size_t bytes) {
+    if (bytes != bytes_) {
+      MemoryAccountAdd(account_, int64_t(bytes) - int64_t(bytes_));
+      bytes_ = bytes;
+    }
+  }
+
+ private:
+  MemoryReservation(const MemoryReservation&) = delete;
+  MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+  const MemoryAccount account_;
+  size_t bytes_;
+};
+
+// AllocatorStats are the process-wide statistics of the jemalloc
+// allocator (see http://jemalloc.net/jemalloc.3.html).
+struct AllocatorStats {
+  size_t allocated;
+  size_t active;
+  size_t metadata;
+  size_t resident;
+  size_t mapped;
+  size_t retained;
+};
+
+// GetAllocatorStats refreshes and retrieves the jemalloc statistics,
+// returning false if the process does not use jemalloc (e.g. builds
+// with the stdmalloc tag).
+bool GetAllocatorStats(AllocatorStats* stats);
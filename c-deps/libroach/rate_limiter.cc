@@ -0,0 +1,131 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "rate_limiter.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// The refill period and fairness of the underlying generic rate
+// limiter. These are the RocksDB defaults.
+const int64_t kRefillPeriodMicros = 100 * 1000;
+const int32_t kFairness = 10;
+
+}  // namespace
+
+const int AdaptiveRateLimiter::kTuneIntervalMillis;
+const int AdaptiveRateLimiter::kMinRateFraction;
+const int64_t AdaptiveRateLimiter::kMinBytesPerSec;
+
+AdaptiveRateLimiter::AdaptiveRateLimiter(int64_t max_bytes_per_sec, uint64_t target_latency_nanos,
+                                         uint64_t pending_compaction_bytes_limit)
+    : base_(rocksdb::NewGenericRateLimiter(max_bytes_per_sec, kRefillPeriodMicros, kFairness)),
+      max_bytes_per_sec_(max_bytes_per_sec),
+      min_bytes_per_sec_(std::min(max_bytes_per_sec, std::max(max_bytes_per_sec / kMinRateFraction,
+                                                              int64_t(kMinBytesPerSec)))),
+      target_latency_nanos_(target_latency_nanos),
+      pending_compaction_bytes_limit_(pending_compaction_bytes_limit),
+      throttled_nanos_(0),
+      stopping_(false) {}
+
+AdaptiveRateLimiter::~AdaptiveRateLimiter() { Stop(); }
+
+void AdaptiveRateLimiter::Start(Sampler sampler) {
+  std::lock_guard<std::mutex> l(mu_);
+  if (!thread_.joinable()) {
+    stopping_ = false;
+    thread_ = std::thread(&AdaptiveRateLimiter::run, this, sampler);
+  }
+}
+
+void AdaptiveRateLimiter::Stop() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void AdaptiveRateLimiter::run(Sampler sampler) {
+  // The sampled latencies are cumulative, so the latencies of the last
+  // interval are the difference from the previous sample.
+  std::unique_ptr<Histogram> prev(new Histogram);
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    cv_.wait_for(l, std::chrono::milliseconds(kTuneIntervalMillis), [this] { return stopping_; });
+    if (stopping_) {
+      return;
+    }
+    l.unlock();
+    std::unique_ptr<Histogram> cur(new Histogram);
+    uint64_t pending_compaction_bytes = 0;
+    sampler(cur.get(), &pending_compaction_bytes);
+    Histogram interval;
+    interval.Merge(*cur);
+    interval.Subtract(*prev);
+    Tune(interval.Percentile(0.99), pending_compaction_bytes);
+    prev = std::move(cur);
+    l.lock();
+  }
+}
+
+void AdaptiveRateLimiter::Tune(uint64_t latency_nanos, uint64_t pending_compaction_bytes) {
+  const int64_t rate = GetBytesPerSecond();
+  int64_t new_rate = rate;
+  if (pending_compaction_bytes_limit_ > 0 &&
+      pending_compaction_bytes > pending_compaction_bytes_limit_) {
+    new_rate = rate + rate / 4;
+  } else if (latency_nanos > target_latency_nanos_) {
+    new_rate = rate - rate / 4;
+  } else if (latency_nanos < target_latency_nanos_ / 2) {
+    new_rate = rate + max_bytes_per_sec_ / 20;
+  }
+  new_rate = std::max(min_bytes_per_sec_, std::min(max_bytes_per_sec_, new_rate));
+  if (new_rate != rate) {
+    SetBytesPerSecond(new_rate);
+  }
+}
+
+void AdaptiveRateLimiter::SetBytesPerSecond(int64_t bytes_per_second) {
+  base_->SetBytesPerSecond(bytes_per_second);
+}
+
+void AdaptiveRateLimiter::Request(const int64_t bytes, const rocksdb::Env::IOPriority pri) {
+  Request(bytes, pri, nullptr);
+}
+
+void AdaptiveRateLimiter::Request(const int64_t bytes, const rocksdb::Env::IOPriority pri,
+                                  rocksdb::Statistics* stats) {
+  const auto start = std::chrono::steady_clock::now();
+  base_->Request(bytes, pri, stats);
+  throttled_nanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+int64_t AdaptiveRateLimiter::GetSingleBurstBytes() const { return base_->GetSingleBurstBytes(); }
+
+int64_t AdaptiveRateLimiter::GetTotalBytesThrough(const rocksdb::Env::IOPriority pri) const {
+  return base_->GetTotalBytesThrough(pri);
+}
+
+int64_t AdaptiveRateLimiter::GetTotalRequests(const rocksdb::Env::IOPriority pri) const {
+  return base_->GetTotalRequests(pri);
+}
+
+int64_t AdaptiveRateLimiter::GetBytesPerSecond() const { return base_->GetBytesPerSecond(); }
@@ -0,0 +1,92 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <rocksdb/rate_limiter.h>
+#include <thread>
+#include "histogram.h"
+
+// AdaptiveRateLimiter limits the rate at which flushes and compactions
+// write, adjusting the rate so that background I/O yields to
+// foreground operations. Once per kTuneIntervalMillis the tuning thread
+// samples the latency of foreground operations and the pending
+// compaction bytes and adjusts the rate (see Tune): the rate is cut
+// multiplicatively while the foreground p99 latency exceeds its
+// target, grows additively while the latency is well below the
+// target, and grows multiplicatively while compactions are falling
+// behind, as the write stalls which follow would be worse than slow
+// foreground operations. The rate stays between 1/kMinRateFraction
+// of the maximum rate (but at least kMinBytesPerSec) and the maximum.
+class AdaptiveRateLimiter : public rocksdb::RateLimiter {
+ public:
+  static const int kTuneIntervalMillis = 1000;
+  static const int kMinRateFraction = 10;
+  static const int64_t kMinBytesPerSec = 1 << 20;
+
+  // Sampler adds the latencies (in nanoseconds) of all of the
+  // foreground operations so far to *latency and sets the pending
+  // compaction bytes.
+  typedef std::function<void(Histogram* latency, uint64_t* pending_compaction_bytes)> Sampler;
+
+  // A pending_compaction_bytes_limit of zero disables raising the rate
+  // when compactions fall behind.
+  AdaptiveRateLimiter(int64_t max_bytes_per_sec, uint64_t target_latency_nanos,
+                      uint64_t pending_compaction_bytes_limit);
+  ~AdaptiveRateLimiter();
+
+  // Start starts the tuning thread. Stop stops it and must be called
+  // before anything the sampler references is destroyed.
+  void Start(Sampler sampler);
+  void Stop();
+
+  // Tune adjusts the rate given the foreground p99 latency over the
+  // last interval and the current pending compaction bytes.
+  void Tune(uint64_t latency_nanos, uint64_t pending_compaction_bytes);
+
+  // GetThrottledNanos returns the total time flushes and compactions
+  // have waited for the rate limiter.
+  int64_t GetThrottledNanos() const { return throttled_nanos_.load(); }
+
+  // rocksdb::RateLimiter methods.
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) override;
+  virtual void Request(const int64_t bytes, const rocksdb::Env::IOPriority pri) override;
+  virtual void Request(const int64_t bytes, const rocksdb::Env::IOPriority pri,
+                       rocksdb::Statistics* stats) override;
+  virtual int64_t GetSingleBurstBytes() const override;
+  virtual int64_t GetTotalBytesThrough(
+      const rocksdb::Env::IOPriority pri = rocksdb::Env::IO_TOTAL) const override;
+  virtual int64_t GetTotalRequests(
+      const rocksdb::Env::IOPriority pri = rocksdb::Env::IO_TOTAL) const override;
+  virtual int64_t GetBytesPerSecond() const override;
+
+ private:
+  void run(Sampler sampler);
+
+  std::unique_ptr<rocksdb::RateLimiter> base_;
+  const int64_t max_bytes_per_sec_;
+  const int64_t min_bytes_per_sec_;
+  const uint64_t target_latency_nanos_;
+  const uint64_t pending_compaction_bytes_limit_;
+  std::atomic<int64_t> throttled_nanos_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stopping_;
+  std::thread thread_;
+};
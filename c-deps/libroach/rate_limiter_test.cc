@@ -0,0 +1,89 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include "rate_limiter.h"
+
+namespace {
+
+const int64_t kMaxRate = 100 << 20;
+const uint64_t kTarget = 10 * 1000 * 1000;
+const uint64_t kPendingLimit = 1 << 30;
+
+}  // namespace
+
+TEST(Libroach, AdaptiveRateLimiterTune) {
+  AdaptiveRateLimiter limiter(kMaxRate, kTarget, kPendingLimit);
+  EXPECT_EQ(kMaxRate, limiter.GetBytesPerSecond());
+
+  // Slow foreground operations cut the rate, down to the minimum.
+  limiter.Tune(2 * kTarget, 0);
+  EXPECT_EQ(kMaxRate - kMaxRate / 4, limiter.GetBytesPerSecond());
+  for (int i = 0; i < 100; ++i) {
+    limiter.Tune(2 * kTarget, 0);
+  }
+  EXPECT_EQ(kMaxRate / AdaptiveRateLimiter::kMinRateFraction, limiter.GetBytesPerSecond());
+
+  // Latencies near the target leave the rate alone.
+  limiter.Tune(kTarget - 1, 0);
+  EXPECT_EQ(kMaxRate / AdaptiveRateLimiter::kMinRateFraction, limiter.GetBytesPerSecond());
+
+  // Fast foreground operations raise the rate, up to the maximum.
+  limiter.Tune(kTarget / 4, 0);
+  EXPECT_EQ(kMaxRate / AdaptiveRateLimiter::kMinRateFraction + kMaxRate / 20,
+            limiter.GetBytesPerSecond());
+  for (int i = 0; i < 100; ++i) {
+    limiter.Tune(0, 0);
+  }
+  EXPECT_EQ(kMaxRate, limiter.GetBytesPerSecond());
+
+  // Compactions falling behind raise the rate even while foreground
+  // operations are slow.
+  for (int i = 0; i < 100; ++i) {
+    limiter.Tune(2 * kTarget, 0);
+  }
+  const int64_t rate = limiter.GetBytesPerSecond();
+  limiter.Tune(2 * kTarget, 2 * kPendingLimit);
+  EXPECT_EQ(rate + rate / 4, limiter.GetBytesPerSecond());
+}
+
+TEST(Libroach, AdaptiveRateLimiterMinRate) {
+  // The minimum rate is never below kMinBytesPerSec unless the
+  // maximum rate is.
+  AdaptiveRateLimiter limiter(2 * AdaptiveRateLimiter::kMinBytesPerSec, kTarget, 0);
+  for (int i = 0; i < 100; ++i) {
+    limiter.Tune(2 * kTarget, 0);
+  }
+  EXPECT_EQ(AdaptiveRateLimiter::kMinBytesPerSec, limiter.GetBytesPerSecond());
+
+  // A zero pending compaction bytes limit never raises the rate.
+  limiter.Tune(2 * kTarget, 1 << 30);
+  EXPECT_EQ(AdaptiveRateLimiter::kMinBytesPerSec, limiter.GetBytesPerSecond());
+
+  AdaptiveRateLimiter slow(AdaptiveRateLimiter::kMinBytesPerSec / 2, kTarget, 0);
+  slow.Tune(2 * kTarget, 0);
+  EXPECT_EQ(AdaptiveRateLimiter::kMinBytesPerSec / 2, slow.GetBytesPerSecond());
+}
+
+TEST(Libroach, AdaptiveRateLimiterThrottledNanos) {
+  AdaptiveRateLimiter limiter(AdaptiveRateLimiter::kMinBytesPerSec, kTarget, 0);
+  EXPECT_EQ(0, limiter.GetThrottledNanos());
+  // Requesting more than a refill period's worth of bytes waits for
+  // the next refill.
+  for (int i = 0; i < 3; ++i) {
+    limiter.Request(limiter.GetSingleBurstBytes(), rocksdb::Env::IO_HIGH);
+  }
+  EXPECT_GT(limiter.GetThrottledNanos(), 0);
+  EXPECT_EQ(3 * limiter.GetSingleBurstBytes(), limiter.GetTotalBytesThrough());
+}
@@ -0,0 +1,183 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "read_pool.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include "db.h"
+
+namespace {
+
+int64_t toNanos(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+// copyOut copies scan results, which are owned by the iterator, into a
+// string owned by the caller.
+DBString copyOut(DBSlice s) {
+  if (s.len == 0) {
+    return DBString{NULL, 0};
+  }
+  return ToDBString(rocksdb::Slice(s.data, s.len));
+}
+
+}  // namespace
+
+void DBReadQueue::Add(int n) {
+  std::lock_guard<std::mutex> l(mu);
+  pending += n;
+}
+
+void DBReadQueue::Complete(const DBReadResult& result) {
+  {
+    std::lock_guard<std::mutex> l(mu);
+    done.push_back(result);
+    pending--;
+  }
+  cv.notify_all();
+}
+
+int DBReadQueue::Poll(DBReadResult* results, int max_results, std::chrono::nanoseconds timeout) {
+  std::unique_lock<std::mutex> l(mu);
+  auto ready = [this] { return !done.empty() || pending == 0; };
+  if (timeout.count() < 0) {
+    cv.wait(l, ready);
+  } else if (timeout.count() > 0) {
+    cv.wait_for(l, timeout, ready);
+  }
+  int n = 0;
+  for (; n < max_results && !done.empty(); n++) {
+    results[n] = done.front();
+    done.pop_front();
+  }
+  return n;
+}
+
+ReadPool::ReadPool(DBEngine* db, int num_threads) : db_(db), running_(0), stopping_(false) {
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    threads_.emplace_back(&ReadPool::run, this);
+  }
+}
+
+ReadPool::~ReadPool() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+void ReadPool::Submit(const DBReadRequest* reqs, int num_reqs, DBReadQueue* queue) {
+  if (num_reqs <= 0) {
+    return;
+  }
+  queue->Add(num_reqs);
+  const auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    for (int i = 0; i < num_reqs; i++) {
+      queue_.push_back(job{reqs[i], queue, now});
+    }
+  }
+  if (num_reqs == 1) {
+    cv_.notify_one();
+  } else {
+    cv_.notify_all();
+  }
+}
+
+DBReadPoolStats ReadPool::Stats() {
+  DBReadPoolStats stats;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stats.queued = queue_.size();
+    stats.running = running_;
+  }
+  stats.queue_nanos = queue_nanos_.Export();
+  stats.service_nanos = service_nanos_.Export();
+  return stats;
+}
+
+void ReadPool::run() {
+  // The thread's prefix (for gets) and total order (for scans)
+  // iterators.
+  DBIterator* iters[2] = {nullptr, nullptr};
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    while (!stopping_ && queue_.empty()) {
+      cv_.wait(l);
+    }
+    if (queue_.empty()) {
+      break;
+    }
+    const job j = queue_.front();
+    queue_.pop_front();
+    running_++;
+    l.unlock();
+
+    const auto start = std::chrono::steady_clock::now();
+    queue_nanos_.Record(toNanos(start - j.queued));
+    const DBReadResult result = execute(j.req, iters);
+    service_nanos_.Record(toNanos(std::chrono::steady_clock::now() - start));
+    j.queue->Complete(result);
+
+    l.lock();
+    running_--;
+  }
+  l.unlock();
+  for (auto iter : iters) {
+    if (iter != nullptr) {
+      DBIterDestroy(iter);
+    }
+  }
+}
+
+DBReadResult ReadPool::execute(const DBReadRequest& req, DBIterator* iters[2]) {
+  const bool get = req.end.len == 0;
+  DBIterator*& iter = iters[get];
+  if (iter != nullptr) {
+    // Refreshing reuses the iterator's state but reads the latest
+    // version of the database, as a new iterator would.
+    DBStatus status = DBIterRefresh(iter);
+    if (status.data != NULL) {
+      free(status.data);
+      DBIterDestroy(iter);
+      iter = nullptr;
+    }
+  }
+  if (iter == nullptr) {
+    iter = DBNewIter(db_, get /* prefix */);
+  }
+
+  const DBScanResults scan =
+      get ? MVCCGet(iter, req.start, req.timestamp, req.txn, req.consistent)
+          : MVCCScanWithLimits(iter, req.start, req.end, req.timestamp, req.max_keys,
+                               req.target_bytes, req.key_only, req.txn, req.consistent,
+                               req.reverse);
+  // The scan results are owned by the iterator, which is reused by the
+  // next read, so they are copied out.
+  DBReadResult result;
+  memset(&result, 0, sizeof(result));
+  result.tag = req.tag;
+  result.status = scan.status;
+  result.data = copyOut(scan.data);
+  result.intents = copyOut(scan.intents);
+  result.uncertainty_timestamp = scan.uncertainty_timestamp;
+  result.resume_key = copyOut(scan.resume_key);
+  return result;
+}
@@ -0,0 +1,90 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <libroach.h>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include "histogram.h"
+
+// DBReadQueue collects the results of the reads submitted to a
+// ReadPool as they complete (see DBNewReadQueue).
+struct DBReadQueue {
+  DBReadQueue() : pending(0) {}
+
+  // Add records that n more reads will complete on the queue.
+  void Add(int n);
+
+  // Complete adds the result of a read to the queue.
+  void Complete(const DBReadResult& result);
+
+  // Poll moves up to max_results results into results, waiting up to
+  // timeout for a result if there are none but reads are pending. A
+  // negative timeout waits indefinitely.
+  int Poll(DBReadResult* results, int max_results, std::chrono::nanoseconds timeout);
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<DBReadResult> done;
+  // The number of reads submitted which have not completed.
+  int64_t pending;
+};
+
+// ReadPool executes MVCC gets and scans on a fixed number of threads
+// so that callers do not block an OS thread per read while waiting for
+// disk reads. Each thread reuses its own iterator (refreshed before
+// each read) rather than creating one per read: a prefix iterator for
+// gets, which can use the prefix bloom filters, and a total order
+// iterator for scans, each created on first use.
+class ReadPool {
+ public:
+  ReadPool(DBEngine* db, int num_threads);
+  // The reads already submitted are completed before the threads exit.
+  ~ReadPool();
+
+  // Submit queues the reads. Their results are added to queue.
+  void Submit(const DBReadRequest* reqs, int num_reqs, DBReadQueue* queue);
+
+  // Stats returns the number of queued and running reads and the
+  // distributions of the time reads spent queued and executing.
+  DBReadPoolStats Stats();
+
+ private:
+  struct job {
+    DBReadRequest req;
+    DBReadQueue* queue;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  void run();
+  // execute performs the read using the thread's iterators, creating
+  // or refreshing the one it uses.
+  DBReadResult execute(const DBReadRequest& req, DBIterator* iters[2]);
+
+  DBEngine* const db_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<job> queue_;
+  int64_t running_;
+  bool stopping_;
+  Histogram queue_nanos_;
+  Histogram service_nanos_;
+  std::vector<std::thread> threads_;
+};
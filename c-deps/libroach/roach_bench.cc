@@ -0,0 +1,619 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+
+// roach_bench contains microbenchmarks for the libroach hot paths. All
+// of the synthetic data is generated from fixed seeds so that results
+// can be compared across commits:
+//
+//   roach_bench --benchmark_filter=MVCCScan --benchmark_repetitions=5
+
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <rocksdb/comparator.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "comparable_key.h"
+#include "db.h"
+#include "include/libroach.h"
+#include "protos/roachpb/data.pb.h"
+#include "protos/roachpb/internal.pb.h"
+#include "protos/storage/engine/enginepb/mvcc.pb.h"
+
+// num_allocs counts the calls to the global operator new so that the
+// benchmarks can report allocations per operation.
+static std::atomic<int64_t> num_allocs(0);
+
+void* operator new(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+namespace {
+
+const int64_t kSecond = 1000000000;
+const uint32_t kSeed = 1;
+
+// randomKey returns a random user key of the form "key-<digits>" with
+// a fixed length, so that keys sharing a prefix exercise the
+// comparator the same way table keys do.
+std::string randomKey(std::mt19937* rng, int n) {
+  std::uniform_int_distribution<int> dist(0, n - 1);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "key-%08d", dist(*rng));
+  return buf;
+}
+
+std::string userKey(int i) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "key-%08d", i);
+  return buf;
+}
+
+DBEngine* openEngine(uint64_t cache_size = 64 << 20) {
+  DBOptions db_opts = {};
+  db_opts.cache = DBNewCache(cache_size);
+  db_opts.num_cpu = 1;
+  db_opts.max_open_files = -1;
+  DBEngine* db;
+  DBStatus status = DBOpen(&db, DBSlice(), db_opts);
+  DBReleaseCache(db_opts.cache);
+  if (status.data != nullptr) {
+    fprintf(stderr, "unable to open engine: %s\n", ToString(status).c_str());
+    abort();
+  }
+  return db;
+}
+
+// mvccEngine returns an in-memory engine holding kNumKeys keys with the
+// given number of versions each, flushed and compacted into sstables.
+// The engines are built once per version count and shared by all of
+// the benchmarks.
+const int kNumKeys = 10000;
+
+DBEngine* mvccEngine(int versions) {
+  static std::map<int, DBEngine*> engines;
+  auto it = engines.find(versions);
+  if (it != engines.end()) {
+    return it->second;
+  }
+
+  DBEngine* db = openEngine();
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int> value_size(16, 256);
+  for (int i = 0; i < kNumKeys; i++) {
+    const std::string key = userKey(i);
+    for (int v = 1; v <= versions; v++) {
+      const DBKey k = {ToDBSlice(key), v * kSecond, 0};
+      const std::string value(value_size(rng), 'v');
+      DBPut(db, k, ToDBSlice(value));
+    }
+  }
+  DBFlush(db);
+  DBCompact(db);
+  engines[versions] = db;
+  return db;
+}
+
+// tableKey returns a user key shaped like a SQL table key: a common
+// table and index prefix followed by a random 32 byte primary key.
+std::string tableKey(std::mt19937* rng) {
+  std::uniform_int_distribution<int> dist('a', 'z');
+  std::string key("/Table/51/1/");
+  for (int i = 0; i < 32; i++) {
+    key.push_back(char(dist(*rng)));
+  }
+  return key;
+}
+
+// tableEngine returns an in-memory engine using a block cache of the
+// given size, holding the keys returned by tableKey with 4 versions
+// each, flushed and compacted into sstables.
+const int kNumTableKeys = 100000;
+
+DBEngine* tableEngine(uint64_t cache_size, std::vector<std::string>* keys) {
+  DBEngine* db = openEngine(cache_size);
+  std::mt19937 rng(kSeed);
+  const std::string value(100, 'v');
+  for (int i = 0; i < kNumTableKeys; i++) {
+    keys->push_back(tableKey(&rng));
+    for (int v = 1; v <= 4; v++) {
+      const DBKey k = {ToDBSlice(keys->back()), v * kSecond, 0};
+      DBPut(db, k, ToDBSlice(value));
+    }
+  }
+  DBFlush(db);
+  DBCompact(db);
+  return db;
+}
+
+// tsValue returns an MVCCMetadata holding time series data with the
+// given number of 10s samples, starting at sample offset start.
+std::string tsValue(int start, int samples) {
+  cockroach::roachpb::InternalTimeSeriesData ts;
+  ts.set_start_timestamp_nanos(0);
+  ts.set_sample_duration_nanos(10 * kSecond);
+  for (int i = start; i < start + samples; i++) {
+    cockroach::roachpb::InternalTimeSeriesSample* sample = ts.add_samples();
+    sample->set_offset(i);
+    sample->set_sum(i % 7);
+    sample->set_count(1);
+  }
+  std::string raw_bytes(5, '\0');
+  raw_bytes[4] = cockroach::roachpb::TIMESERIES;
+  ts.AppendToString(&raw_bytes);
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.set_raw_bytes(raw_bytes);
+  return meta.SerializeAsString();
+}
+
+void BM_ComparatorCompare(benchmark::State& state) {
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int64_t> wall_time(1, 100 * kSecond);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; i++) {
+    // Draw from a small key space so that many comparisons fall
+    // through to the timestamps.
+    const std::string key = randomKey(&rng, 64);
+    const DBKey k = {ToDBSlice(key), wall_time(rng), 0};
+    keys.push_back(EncodeKey(k));
+  }
+
+  size_t i = 0;
+  int sum = 0;
+  while (state.KeepRunning()) {
+    sum += cmp->Compare(keys[i & 1023], keys[(i + 1) & 1023]);
+    i++;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_ComparatorCompare);
+
+// BM_ComparableKeyCompare compares the keys of BM_ComparatorCompare in
+// the comparable encoding with the bytewise comparator.
+void BM_ComparableKeyCompare(benchmark::State& state) {
+  const rocksdb::Comparator* cmp = rocksdb::BytewiseComparator();
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int64_t> wall_time(1, 100 * kSecond);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; i++) {
+    const std::string key = randomKey(&rng, 64);
+    std::string k;
+    EncodeComparableKey(&k, key, wall_time(rng), 0);
+    keys.push_back(k);
+  }
+
+  size_t i = 0;
+  int sum = 0;
+  while (state.KeepRunning()) {
+    sum += cmp->Compare(keys[i & 1023], keys[(i + 1) & 1023]);
+    i++;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+BENCHMARK(BM_ComparableKeyCompare);
+
+// BM_ComparatorShortenIndexKeys computes the index block separators
+// for the sorted keys returned by tableKey, with 4 versions each, cut
+// into blocks of 25 keys (roughly 4KB blocks of 100 byte values). It
+// reports the average size of an index key before (full_bytes) and
+// after (short_bytes) FindShortestSeparator, which does not depend on
+// the block cache or the sstable layout as BM_MVCCGetBlockCache does.
+void BM_ComparatorShortenIndexKeys(benchmark::State& state) {
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  const int kKeysPerBlock = 25;
+  std::mt19937 rng(kSeed);
+  std::vector<std::string> user_keys;
+  for (int i = 0; i < kNumTableKeys; i++) {
+    user_keys.push_back(tableKey(&rng));
+  }
+  std::sort(user_keys.begin(), user_keys.end());
+  std::vector<std::string> keys;
+  for (const auto& key : user_keys) {
+    for (int v = 4; v >= 1; v--) {
+      keys.push_back(EncodeKey(DBKey{ToDBSlice(key), v * kSecond, 0}));
+    }
+  }
+
+  // The index key sizes are computed over all of the blocks up front so
+  // that they do not depend on the number of iterations.
+  const size_t num_blocks = keys.size() / kKeysPerBlock - 1;
+  int64_t full_bytes = 0;
+  int64_t short_bytes = 0;
+  std::string sep;
+  for (size_t b = 0; b < num_blocks; b++) {
+    const size_t last = (b + 1) * kKeysPerBlock - 1;
+    sep = keys[last];
+    cmp->FindShortestSeparator(&sep, keys[last + 1]);
+    full_bytes += keys[last].size();
+    short_bytes += sep.size();
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const size_t last = (i % num_blocks + 1) * kKeysPerBlock - 1;
+    sep = keys[last];
+    cmp->FindShortestSeparator(&sep, keys[last + 1]);
+    i++;
+  }
+  state.counters["full_bytes"] = double(full_bytes) / num_blocks;
+  state.counters["short_bytes"] = double(short_bytes) / num_blocks;
+}
+BENCHMARK(BM_ComparatorShortenIndexKeys);
+
+void BM_EncodeKey(benchmark::State& state) {
+  std::mt19937 rng(kSeed);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; i++) {
+    keys.push_back(randomKey(&rng, kNumKeys));
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    const DBKey k = {ToDBSlice(keys[i & 1023]), int64_t(i) * kSecond, int32_t(i & 1)};
+    benchmark::DoNotOptimize(EncodeKey(k));
+    i++;
+  }
+}
+BENCHMARK(BM_EncodeKey);
+
+void BM_DecodeKey(benchmark::State& state) {
+  std::mt19937 rng(kSeed);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; i++) {
+    const std::string key = randomKey(&rng, kNumKeys);
+    const DBKey k = {ToDBSlice(key), int64_t(i + 1) * kSecond, int32_t(i & 1)};
+    keys.push_back(EncodeKey(k));
+  }
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ToDBKey(keys[i & 1023]));
+    i++;
+  }
+}
+BENCHMARK(BM_DecodeKey);
+
+// BM_MVCCScan scans 1000 keys at a random position at the latest
+// timestamp and reports the number of allocations per scan. Args are
+// the number of versions per key and whether the scan is in reverse.
+void BM_MVCCScan(benchmark::State& state) {
+  DBEngine* db = mvccEngine(state.range(0));
+  const bool reverse = state.range(1) != 0;
+  const int kScanKeys = 1000;
+  const DBTxn txn = {};
+  const DBTimestamp ts = {(state.range(0) + 1) * kSecond, 0};
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int> start_dist(0, kNumKeys - kScanKeys - 1);
+
+  DBIterator* iter = DBNewIter(db, false);
+  const int64_t allocs = num_allocs.load();
+  while (state.KeepRunning()) {
+    const int start = start_dist(rng);
+    const std::string start_key = userKey(start);
+    const std::string end_key = userKey(start + kScanKeys);
+    DBScanResults results = MVCCScan(iter, ToDBSlice(start_key), ToDBSlice(end_key), ts,
+                                     kScanKeys, txn, true, reverse);
+    if (results.status.data != nullptr) {
+      state.SkipWithError(ToString(results.status).c_str());
+      break;
+    }
+  }
+  state.counters["allocs"] =
+      double(num_allocs.load() - allocs) / std::max<size_t>(state.iterations(), 1);
+  DBIterDestroy(iter);
+  state.SetItemsProcessed(state.iterations() * kScanKeys);
+}
+BENCHMARK(BM_MVCCScan)
+    ->ArgNames({"versions", "reverse"})
+    ->Args({1, 0})
+    ->Args({4, 0})
+    ->Args({16, 0})
+    ->Args({1, 1})
+    ->Args({4, 1})
+    ->Args({16, 1});
+
+// BM_MVCCReverseScan reverse scans 1000 keys at a random position at
+// the latest timestamp. The arg is the number of versions per key. The
+// scanner steps back with Prev over keys with few versions and seeks
+// past keys with many, which the seeks and nexts per key reflect. Every
+// scan is sampled to count them, so the timings are somewhat slower
+// than those of BM_MVCCScan.
+void BM_MVCCReverseScan(benchmark::State& state) {
+  DBEngine* db = mvccEngine(state.range(0));
+  const int kScanKeys = 1000;
+  const DBTxn txn = {};
+  const DBTimestamp ts = {(state.range(0) + 1) * kSecond, 0};
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int> start_dist(0, kNumKeys - kScanKeys - 1);
+
+  DBSetScanPerfSampling(1);
+  int64_t seeks = 0;
+  int64_t nexts = 0;
+  DBIterator* iter = DBNewIter(db, false);
+  while (state.KeepRunning()) {
+    const int start = start_dist(rng);
+    const std::string start_key = userKey(start);
+    const std::string end_key = userKey(start + kScanKeys);
+    DBScanResults results = MVCCScan(iter, ToDBSlice(start_key), ToDBSlice(end_key), ts,
+                                     kScanKeys, txn, true, true /* reverse */);
+    if (results.status.data != nullptr) {
+      state.SkipWithError(ToString(results.status).c_str());
+      break;
+    }
+    seeks += results.perf.seeks;
+    nexts += results.perf.nexts;
+  }
+  DBIterDestroy(iter);
+  DBSetScanPerfSampling(0);
+  const double keys = double(state.iterations()) * kScanKeys;
+  state.SetItemsProcessed(state.iterations() * kScanKeys);
+  state.counters["seeks_per_key"] = keys > 0 ? seeks / keys : 0;
+  state.counters["nexts_per_key"] = keys > 0 ? nexts / keys : 0;
+}
+BENCHMARK(BM_MVCCReverseScan)->ArgName("versions")->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+// BM_MVCCGetBlockCache performs MVCCGets of random keys of a
+// tableEngine with a block cache of the given size in MB. It reports
+// the block cache hit rate and the memory used by the table readers,
+// which hold the index blocks, both of which depend on the size of the
+// index entries produced by the comparator's key shortening.
+void BM_MVCCGetBlockCache(benchmark::State& state) {
+  std::vector<std::string> keys;
+  DBEngine* db = tableEngine(uint64_t(state.range(0)) << 20, &keys);
+  const DBTxn txn = {};
+  const DBTimestamp ts = {10 * kSecond, 0};
+  std::mt19937 rng(kSeed);
+  std::uniform_int_distribution<int> key_dist(0, keys.size() - 1);
+
+  DBStatsResult before = {};
+  DBGetStats(db, &before);
+  DBIterator* iter = DBNewIter(db, true);
+  while (state.KeepRunning()) {
+    DBScanResults results = MVCCGet(iter, ToDBSlice(keys[key_dist(rng)]), ts, txn, true);
+    if (results.status.data != nullptr) {
+      state.SkipWithError(ToString(results.status).c_str());
+      break;
+    }
+  }
+  DBIterDestroy(iter);
+
+  DBStatsResult after = {};
+  DBGetStats(db, &after);
+  const int64_t hits = after.block_cache_hits - before.block_cache_hits;
+  const int64_t misses = after.block_cache_misses - before.block_cache_misses;
+  state.counters["hit_rate"] = hits + misses > 0 ? double(hits) / (hits + misses) : 0;
+  state.counters["table_readers"] = after.table_readers_mem_estimate;
+  DBClose(db);
+}
+BENCHMARK(BM_MVCCGetBlockCache)->ArgName("cache_mb")->Arg(1)->Arg(4)->Arg(16);
+
+// BM_MergeTimeSeries merges time series updates of the given number of
+// samples into an existing value holding an hour of 10s samples.
+void BM_MergeTimeSeries(benchmark::State& state) {
+  const std::string existing = tsValue(0, 360);
+  const std::string update = tsValue(360, state.range(0));
+  while (state.KeepRunning()) {
+    DBString result;
+    DBStatus status = DBMergeOne(ToDBSlice(existing), ToDBSlice(update), &result);
+    if (status.data != nullptr) {
+      state.SkipWithError(ToString(status).c_str());
+      break;
+    }
+    free(result.data);
+  }
+}
+BENCHMARK(BM_MergeTimeSeries)->Arg(1)->Arg(60)->Arg(360);
+
+// bytesValue returns an MVCCMetadata holding a BYTES value.
+std::string bytesValue(const std::string& data) {
+  std::string raw_bytes(5, '\0');
+  raw_bytes[4] = cockroach::roachpb::BYTES;
+  raw_bytes.append(data);
+  cockroach::storage::engine::enginepb::MVCCMetadata meta;
+  meta.set_raw_bytes(raw_bytes);
+  return meta.SerializeAsString();
+}
+
+// BM_FullMerge reads a key holding the given number of merge operands
+// in the memtable, which performs a full merge of the operands on
+// every read, and reports the number of allocations per read. Args are
+// the number of operands and whether they hold time series data.
+void BM_FullMerge(benchmark::State& state) {
+  DBEngine* db = openEngine();
+  const int num_operands = state.range(0);
+  const bool time_series = state.range(1) != 0;
+  const DBKey key = {ToDBSlice("merge"), 0, 0};
+  for (int i = 0; i < num_operands; i++) {
+    const std::string value = time_series ? tsValue(i * 6, 6) : bytesValue("operand");
+    DBMerge(db, key, ToDBSlice(value));
+  }
+
+  const int64_t allocs = num_allocs.load();
+  while (state.KeepRunning()) {
+    DBString result;
+    DBStatus status = DBGet(db, key, &result);
+    if (status.data != nullptr) {
+      state.SkipWithError(ToString(status).c_str());
+      break;
+    }
+    free(result.data);
+  }
+  state.counters["allocs"] =
+      double(num_allocs.load() - allocs) / std::max<size_t>(state.iterations(), 1);
+  DBClose(db);
+}
+BENCHMARK(BM_FullMerge)
+    ->ArgNames({"operands", "timeseries"})
+    ->Args({2, 0})
+    ->Args({16, 0})
+    ->Args({128, 0})
+    ->Args({2, 1})
+    ->Args({16, 1})
+    ->Args({128, 1});
+
+// BM_NewBatch writes a key to a batch and reports the number of
+// allocations per batch. Args are whether the batch is write-only and
+// how it is obtained: 0 creates and closes a batch on a snapshot, which
+// is not pooled (the behavior before batch pooling); 1 creates and
+// closes a batch on the engine, which is pooled; and 2 reuses a single
+// batch with DBBatchReset.
+void BM_NewBatch(benchmark::State& state) {
+  DBEngine* db = openEngine();
+  DBEngine* snap = DBNewSnapshot(db);
+  const bool write_only = state.range(0) != 0;
+  const int mode = state.range(1);
+  const DBKey key = {ToDBSlice("key"), kSecond, 0};
+  const std::string value(100, 'v');
+
+  DBEngine* reused = mode == 2 ? DBNewBatch(db, write_only) : nullptr;
+  const int64_t allocs = num_allocs.load();
+  while (state.KeepRunning()) {
+    DBEngine* batch = reused != nullptr ? reused : DBNewBatch(mode == 0 ? snap : db, write_only);
+    DBStatus status = DBPut(batch, key, ToDBSlice(value));
+    if (status.data != nullptr) {
+      state.SkipWithError(ToString(status).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(DBBatchRepr(batch));
+    if (reused != nullptr) {
+      status = DBBatchReset(batch);
+      if (status.data != nullptr) {
+        state.SkipWithError(ToString(status).c_str());
+        break;
+      }
+    } else {
+      DBClose(batch);
+    }
+  }
+  state.counters["allocs"] =
+      double(num_allocs.load() - allocs) / std::max<size_t>(state.iterations(), 1);
+  if (reused != nullptr) {
+    DBClose(reused);
+  }
+  DBClose(snap);
+  DBClose(db);
+}
+BENCHMARK(BM_NewBatch)
+    ->ArgNames({"write_only", "mode"})
+    ->Args({0, 0})
+    ->Args({0, 1})
+    ->Args({0, 2})
+    ->Args({1, 0})
+    ->Args({1, 1})
+    ->Args({1, 2});
+
+// BM_NewIter seeks a prefix iterator to a random key and reports the
+// number of allocations per seek. The arg is how the iterator is
+// obtained: 0 creates and destroys an iterator with DBNewIter (the
+// behavior before iterator pooling); 1 does the same with
+// DBNewPooledIter; 2 reuses a single iterator, refreshing it with
+// DBIterRefresh; and 3 reuses a single iterator without refreshing it,
+// which is the cost of the seek alone.
+void BM_NewIter(benchmark::State& state) {
+  DBEngine* db = mvccEngine(1);
+  const int mode = state.range(0);
+  std::mt19937 rng(kSeed);
+
+  DBIterator* reused = mode >= 2 ? DBNewIter(db, true) : nullptr;
+  const int64_t allocs = num_allocs.load();
+  while (state.KeepRunning()) {
+    DBIterator* iter = reused;
+    if (mode == 0) {
+      iter = DBNewIter(db, true);
+    } else if (mode == 1) {
+      iter = DBNewPooledIter(db, true);
+    } else if (mode == 2) {
+      DBStatus status = DBIterRefresh(iter);
+      if (status.data != nullptr) {
+        state.SkipWithError(ToString(status).c_str());
+        break;
+      }
+    }
+    const std::string key = randomKey(&rng, kNumKeys);
+    benchmark::DoNotOptimize(DBIterSeek(iter, DBKey{ToDBSlice(key), 0, 0}));
+    if (reused == nullptr) {
+      DBIterDestroy(iter);
+    }
+  }
+  state.counters["allocs"] =
+      double(num_allocs.load() - allocs) / std::max<size_t>(state.iterations(), 1);
+  if (reused != nullptr) {
+    DBIterDestroy(reused);
+  }
+}
+BENCHMARK(BM_NewIter)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2)->Arg(3);
+
+// BM_BaseDeltaIterator iterates over all of the keys of an engine
+// through a batch holding the given number of writes spread over the
+// key space.
+void BM_BaseDeltaIterator(benchmark::State& state) {
+  DBEngine* db = mvccEngine(1);
+  DBEngine* batch = DBNewBatch(db, false);
+  std::mt19937 rng(kSeed);
+  for (int i = 0; i < state.range(0); i++) {
+    const std::string key = randomKey(&rng, kNumKeys);
+    const DBKey k = {ToDBSlice(key), 2 * kSecond, 0};
+    DBPut(batch, k, ToDBSlice("batch-value"));
+  }
+
+  DBIterator* iter = DBNewIter(batch, false);
+  while (state.KeepRunning()) {
+    int n = 0;
+    for (DBIterState s = DBIterSeekToFirst(iter); s.valid; s = DBIterNext(iter, false)) {
+      n++;
+    }
+    benchmark::DoNotOptimize(n);
+  }
+  DBIterDestroy(iter);
+  DBClose(batch);
+}
+BENCHMARK(BM_BaseDeltaIterator)->Arg(0)->Arg(10)->Arg(100)->Arg(1000)->Arg(10000);
+
+// BM_MVCCComputeStats computes the stats over all of the keys of an
+// engine with the given number of versions per key.
+void BM_MVCCComputeStats(benchmark::State& state) {
+  DBEngine* db = mvccEngine(state.range(0));
+  const DBKey start = {ToDBSlice(""), 0, 0};
+  const DBKey end = {ToDBSlice("\xff"), 0, 0};
+  DBIterator* iter = DBNewIter(db, false);
+  while (state.KeepRunning()) {
+    MVCCStatsResult stats = MVCCComputeStats(iter, start, end, 100 * kSecond);
+    if (stats.status.data != nullptr) {
+      state.SkipWithError(ToString(stats.status).c_str());
+      break;
+    }
+  }
+  DBIterDestroy(iter);
+  state.SetItemsProcessed(state.iterations() * kNumKeys * state.range(0));
+}
+BENCHMARK(BM_MVCCComputeStats)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,96 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "scan_results.h"
+#include <string.h>
+
+namespace {
+
+void PutFixed32(char* dst, uint32_t v) {
+  dst[0] = char(v);
+  dst[1] = char(v >> 8);
+  dst[2] = char(v >> 16);
+  dst[3] = char(v >> 24);
+}
+
+uint32_t GetFixed32(const char* src) {
+  const uint8_t* b = reinterpret_cast<const uint8_t*>(src);
+  return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+}
+
+}  // namespace
+
+ScanResultBuffer::ScanResultBuffer()
+    : reservation_(kMemoryScanBuffers), count_(0), last_key_offset_(0), last_key_size_(0) {
+  rep_.assign(kHeaderSize, '\0');
+  reservation_.Set(rep_.capacity());
+}
+
+void ScanResultBuffer::Clear() {
+  // std::string::resize (and clear) do not release the underlying
+  // allocation which is exactly what we want.
+  rep_.resize(kHeaderSize);
+  PutFixed32(&rep_[0], 0);
+  count_ = 0;
+  last_key_offset_ = 0;
+  last_key_size_ = 0;
+}
+
+rocksdb::Slice ScanResultBuffer::LastKey() const {
+  if (count_ == 0) {
+    return rocksdb::Slice();
+  }
+  return rocksdb::Slice(rep_.data() + last_key_offset_, last_key_size_);
+}
+
+void ScanResultBuffer::Put(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+  const size_t offset = rep_.size();
+  rep_.resize(offset + kEntryHeaderSize + key.size() + value.size());
+  char* dst = &rep_[offset];
+  PutFixed32(dst, uint32_t(key.size()));
+  PutFixed32(dst + sizeof(uint32_t), uint32_t(value.size()));
+  dst += kEntryHeaderSize;
+  memcpy(dst, key.data(), key.size());
+  memcpy(dst + key.size(), value.data(), value.size());
+  last_key_offset_ = offset + kEntryHeaderSize;
+  last_key_size_ = key.size();
+  ++count_;
+  PutFixed32(&rep_[0], uint32_t(count_));
+  reservation_.Set(rep_.capacity());
+}
+
+bool DecodeScanResultHeader(rocksdb::Slice* buf, uint32_t* count) {
+  if (buf->size() < ScanResultBuffer::kHeaderSize) {
+    return false;
+  }
+  *count = GetFixed32(buf->data());
+  buf->remove_prefix(ScanResultBuffer::kHeaderSize);
+  return true;
+}
+
+bool DecodeScanResultEntry(rocksdb::Slice* buf, rocksdb::Slice* key, rocksdb::Slice* value) {
+  if (buf->size() < ScanResultBuffer::kEntryHeaderSize) {
+    return false;
+  }
+  const uint32_t key_size = GetFixed32(buf->data());
+  const uint32_t value_size = GetFixed32(buf->data() + sizeof(uint32_t));
+  buf->remove_prefix(ScanResultBuffer::kEntryHeaderSize);
+  if (buf->size() < uint64_t(key_size) + value_size) {
+    return false;
+  }
+  *key = rocksdb::Slice(buf->data(), key_size);
+  *value = rocksdb::Slice(buf->data() + key_size, value_size);
+  buf->remove_prefix(key_size + value_size);
+  return true;
+}
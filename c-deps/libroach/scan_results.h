@@ -0,0 +1,90 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <rocksdb/slice.h>
+#include <stdint.h>
+#include <string>
+#include "memory_stats.h"
+
+// ScanResultBuffer accumulates the key/value pairs returned by
+// MVCCScan and MVCCGet. The buffer is owned by a DBIterator and is
+// reused across scans so that the memory backing it is only
+// allocated once per iterator (rather than once per scan as is the
+// case with a rocksdb::WriteBatch).
+//
+// The encoded format is a fixed 4-byte little-endian entry count
+// followed by the entries. Each entry is a fixed 4-byte little-endian
+// key length, a fixed 4-byte little-endian value length, the key
+// bytes and the value bytes:
+//
+//   <count><key-len><val-len><key><value><key-len><val-len>...
+//
+// Using fixed-width lengths (as opposed to the varints used by the
+// RocksDB batch repr format) allows the Go side to walk the results
+// without any per-entry varint decoding. See
+// storage/engine/mvcc.go:mvccScanDecodeKeyValue.
+//
+// The memory backing the buffer is tracked in kMemoryScanBuffers.
+class ScanResultBuffer {
+ public:
+  // kHeaderSize is the size of the count prefix.
+  static const int kHeaderSize = sizeof(uint32_t);
+  // kEntryHeaderSize is the size of the key and value length prefix
+  // of each entry.
+  static const int kEntryHeaderSize = 2 * sizeof(uint32_t);
+
+  ScanResultBuffer();
+
+  // Clear discards the contents of the buffer but retains the
+  // allocated memory for reuse.
+  void Clear();
+
+  // Put appends the key/value pair to the buffer.
+  void Put(const rocksdb::Slice& key, const rocksdb::Slice& value);
+
+  // Count returns the number of entries in the buffer.
+  int64_t Count() const { return count_; }
+
+  // NumBytes returns the number of bytes used by the entries in the
+  // buffer, including their framing.
+  int64_t NumBytes() const { return rep_.size() - kHeaderSize; }
+
+  // LastKey returns the key of the most recently added entry, or an
+  // empty slice if the buffer is empty. The returned slice is only
+  // valid until the next call to Put or Clear.
+  rocksdb::Slice LastKey() const;
+
+  // Data returns the encoded contents of the buffer. The returned
+  // slice is only valid until the next call to Put or Clear.
+  rocksdb::Slice Data() const { return rocksdb::Slice(rep_); }
+
+ private:
+  std::string rep_;
+  MemoryReservation reservation_;
+  int64_t count_;
+  size_t last_key_offset_;
+  size_t last_key_size_;
+};
+
+// DecodeScanResultHeader decodes the count prefix of an encoded
+// ScanResultBuffer, returning true on success. The remaining entries
+// are left in *buf.
+bool DecodeScanResultHeader(rocksdb::Slice* buf, uint32_t* count);
+
+// DecodeScanResultEntry decodes the next key/value pair from an
+// encoded ScanResultBuffer, returning true on success. The decoded
+// key and value point into the memory backing *buf.
+bool DecodeScanResultEntry(rocksdb::Slice* buf, rocksdb::Slice* key, rocksdb::Slice* value);
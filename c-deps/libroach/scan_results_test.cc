@@ -0,0 +1,63 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "scan_results.h"
+
+TEST(Libroach, ScanResultBuffer) {
+  std::vector<std::pair<std::string, std::string>> kvs{
+      {"a", "1"}, {"", "value"}, {"key", ""}, {std::string(300, 'k'), std::string(70000, 'v')},
+  };
+
+  ScanResultBuffer buf;
+  EXPECT_EQ(0, buf.Count());
+  EXPECT_EQ(0, buf.NumBytes());
+  EXPECT_TRUE(buf.LastKey().empty());
+
+  // Fill the buffer twice to verify that Clear() resets it for reuse.
+  for (int pass = 0; pass < 2; pass++) {
+    buf.Clear();
+    for (auto it = kvs.begin(); it != kvs.end(); it++) {
+      buf.Put(it->first, it->second);
+    }
+    EXPECT_EQ(kvs.size(), buf.Count());
+    EXPECT_EQ(kvs.back().first, buf.LastKey().ToString());
+
+    rocksdb::Slice data = buf.Data();
+    uint32_t count;
+    ASSERT_TRUE(DecodeScanResultHeader(&data, &count));
+    EXPECT_EQ(kvs.size(), count);
+    for (auto it = kvs.begin(); it != kvs.end(); it++) {
+      rocksdb::Slice key, value;
+      ASSERT_TRUE(DecodeScanResultEntry(&data, &key, &value));
+      EXPECT_EQ(it->first, key.ToString());
+      EXPECT_EQ(it->second, value.ToString());
+    }
+    EXPECT_TRUE(data.empty());
+  }
+
+  // A truncated buffer fails to decode.
+  rocksdb::Slice data = buf.Data();
+  data = rocksdb::Slice(data.data(), data.size() - 1);
+  uint32_t count;
+  ASSERT_TRUE(DecodeScanResultHeader(&data, &count));
+  rocksdb::Slice key, value;
+  for (uint32_t i = 0; i + 1 < count; i++) {
+    ASSERT_TRUE(DecodeScanResultEntry(&data, &key, &value));
+  }
+  EXPECT_FALSE(DecodeScanResultEntry(&data, &key, &value));
+}
@@ -0,0 +1,200 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "scheduler.h"
+#include <algorithm>
+#include <rocksdb/db.h>
+#include <stdlib.h>
+#include <string>
+
+namespace {
+
+// SchedulerListener refreshes the number of L0 files of a store after
+// each flush and compaction. Listeners are called without the DB mutex
+// held, so unlike Env::Schedule they can read the DB's properties.
+class SchedulerListener : public rocksdb::EventListener {
+ public:
+  explicit SchedulerListener(SchedulingEnv* env) : env_(env) {}
+
+  virtual void OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) override {
+    env_->UpdateL0Files(db);
+  }
+  virtual void OnCompactionCompleted(rocksdb::DB* db,
+                                     const rocksdb::CompactionJobInfo& info) override {
+    env_->UpdateL0Files(db);
+  }
+
+ private:
+  SchedulingEnv* const env_;
+};
+
+}  // namespace
+
+BackgroundScheduler::BackgroundScheduler(int num_threads, int64_t bytes_per_sec)
+    : num_threads_(std::max(num_threads, 1)),
+      max_compactions_(std::max(num_threads_ - 1, 1)),
+      rate_limiter_(bytes_per_sec > 0 ? rocksdb::NewGenericRateLimiter(bytes_per_sec) : nullptr),
+      running_{0, 0},
+      ran_{0, 0},
+      stopping_(false) {
+  for (int i = 0; i < num_threads_; ++i) {
+    threads_.emplace_back(&BackgroundScheduler::run, this);
+  }
+}
+
+BackgroundScheduler::~BackgroundScheduler() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+  // The stores are closed before the scheduler is destroyed, so the
+  // queue is normally empty.
+  for (const auto& j : queue_) {
+    if (j.unschedule != nullptr) {
+      j.unschedule(j.arg);
+    }
+  }
+}
+
+void BackgroundScheduler::Schedule(const Store* store, void (*function)(void*), void* arg,
+                                   bool flush, void* tag, void (*unschedule)(void*)) {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    queue_.push_back(job{store, function, arg, flush, tag, unschedule});
+  }
+  cv_.notify_one();
+}
+
+int BackgroundScheduler::Unschedule(void* tag, bool flush) {
+  std::vector<job> removed;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    for (auto it = queue_.begin(); it != queue_.end();) {
+      if (it->tag == tag && it->flush == flush) {
+        removed.push_back(*it);
+        it = queue_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (const auto& j : removed) {
+    if (j.unschedule != nullptr) {
+      j.unschedule(j.arg);
+    }
+  }
+  return int(removed.size());
+}
+
+int BackgroundScheduler::Queued(bool flush) {
+  std::lock_guard<std::mutex> l(mu_);
+  return int(std::count_if(queue_.begin(), queue_.end(),
+                           [flush](const job& j) { return j.flush == flush; }));
+}
+
+int64_t BackgroundScheduler::Ran(bool flush) {
+  std::lock_guard<std::mutex> l(mu_);
+  return ran_[flush];
+}
+
+int64_t BackgroundScheduler::Running(bool flush) {
+  std::lock_guard<std::mutex> l(mu_);
+  return running_[flush];
+}
+
+std::deque<BackgroundScheduler::job>::iterator BackgroundScheduler::pickLocked() {
+  // The oldest flush runs first. The queue is short (each store limits
+  // the jobs it schedules), so it is simply scanned.
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    if (it->flush) {
+      return it;
+    }
+  }
+  if (running_[false] >= max_compactions_) {
+    return queue_.end();
+  }
+  auto best = queue_.end();
+  for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+    if (best == queue_.end() ||
+        it->store->l0_files.load(std::memory_order_relaxed) >
+            best->store->l0_files.load(std::memory_order_relaxed)) {
+      best = it;
+    }
+  }
+  return best;
+}
+
+void BackgroundScheduler::run() {
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    auto it = queue_.end();
+    while (!stopping_ && (it = pickLocked()) == queue_.end()) {
+      cv_.wait(l);
+    }
+    if (stopping_) {
+      return;
+    }
+    const job j = *it;
+    queue_.erase(it);
+    running_[j.flush]++;
+    l.unlock();
+
+    j.function(j.arg);
+
+    l.lock();
+    running_[j.flush]--;
+    ran_[j.flush]++;
+    // A compaction may have been waiting for a free slot.
+    if (!j.flush) {
+      cv_.notify_one();
+    }
+  }
+}
+
+SchedulingEnv::SchedulingEnv(rocksdb::Env* base_env,
+                             std::shared_ptr<BackgroundScheduler> scheduler)
+    : rocksdb::EnvWrapper(base_env), scheduler_(scheduler) {}
+
+std::shared_ptr<rocksdb::EventListener> SchedulingEnv::NewListener() {
+  return std::make_shared<SchedulerListener>(this);
+}
+
+void SchedulingEnv::UpdateL0Files(rocksdb::DB* db) {
+  std::string value;
+  if (db->GetProperty("rocksdb.num-files-at-level0", &value)) {
+    store_.l0_files.store(strtoll(value.c_str(), nullptr, 10), std::memory_order_relaxed);
+  }
+}
+
+void SchedulingEnv::Schedule(void (*function)(void* arg), void* arg, Priority pri, void* tag,
+                             void (*unschedFunction)(void* arg)) {
+  scheduler_->Schedule(&store_, function, arg, pri == HIGH, tag, unschedFunction);
+}
+
+int SchedulingEnv::UnSchedule(void* tag, Priority pri) {
+  return scheduler_->Unschedule(tag, pri == HIGH);
+}
+
+unsigned int SchedulingEnv::GetThreadPoolQueueLen(Priority pri) const {
+  return (unsigned int)scheduler_->Queued(pri == HIGH);
+}
+
+int SchedulingEnv::GetBackgroundThreads(Priority pri) {
+  // There is no separate pool for bottommost compactions.
+  return pri == HIGH || pri == LOW ? scheduler_->NumThreads() : 0;
+}
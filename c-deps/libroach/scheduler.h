@@ -0,0 +1,124 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <rocksdb/env.h>
+#include <rocksdb/listener.h>
+#include <rocksdb/rate_limiter.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// BackgroundScheduler runs the flushes and compactions of all of the
+// stores of a node on one set of threads, so that the number of
+// background threads (and the background write rate) is bounded per
+// node rather than per store. Flushes run first, as a flush which
+// falls behind stalls writes. Compactions are run in the order of the
+// number of L0 files of their store, so that the stores closest to an
+// L0 write stall are compacted first, and at most num_threads-1 of them
+// run at once so that a thread is always left for flushes.
+class BackgroundScheduler {
+ public:
+  // A bytes_per_sec of zero leaves the background writes unlimited.
+  BackgroundScheduler(int num_threads, int64_t bytes_per_sec);
+  ~BackgroundScheduler();
+
+  // Store is the per-store state used to prioritize its jobs.
+  struct Store {
+    Store() : l0_files(0) {}
+    std::atomic<int64_t> l0_files;
+  };
+
+  // Schedule queues a job (see rocksdb::Env::Schedule). Flushes are the
+  // jobs of the HIGH priority pool.
+  void Schedule(const Store* store, void (*function)(void*), void* arg, bool flush, void* tag,
+                void (*unschedule)(void*));
+  // Unschedule removes the queued jobs with the given tag, calling
+  // their unschedule functions, and returns the number removed.
+  int Unschedule(void* tag, bool flush);
+  // Queued returns the number of queued flushes or compactions.
+  int Queued(bool flush);
+
+  int NumThreads() const { return num_threads_; }
+
+  // RateLimiter returns the background write budget shared by the
+  // stores, or NULL if it is unlimited.
+  const std::shared_ptr<rocksdb::RateLimiter>& RateLimiter() const { return rate_limiter_; }
+
+  // Ran returns the number of flushes or compactions which have run
+  // and Running the number currently running.
+  int64_t Ran(bool flush);
+  int64_t Running(bool flush);
+
+ private:
+  struct job {
+    const Store* store;
+    void (*function)(void*);
+    void* arg;
+    bool flush;
+    void* tag;
+    void (*unschedule)(void*);
+  };
+
+  // pickLocked returns the next job to run, or queue_.end() if none
+  // can run.
+  std::deque<job>::iterator pickLocked();
+  void run();
+
+  const int num_threads_;
+  const int max_compactions_;
+  const std::shared_ptr<rocksdb::RateLimiter> rate_limiter_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // Protected by mu_. The arrays are indexed by whether the jobs are
+  // flushes.
+  std::deque<job> queue_;
+  int64_t running_[2];
+  int64_t ran_[2];
+  bool stopping_;
+  std::vector<std::thread> threads_;
+};
+
+// SchedulingEnv runs the background jobs of a store on a shared
+// BackgroundScheduler rather than on the thread pools of the wrapped
+// env. The thread pools of the scheduler are fixed, so requests to
+// resize them are ignored.
+class SchedulingEnv : public rocksdb::EnvWrapper {
+ public:
+  SchedulingEnv(rocksdb::Env* base_env, std::shared_ptr<BackgroundScheduler> scheduler);
+
+  // NewListener returns a listener which keeps track of the number of
+  // L0 files of the store, which prioritizes its compactions.
+  std::shared_ptr<rocksdb::EventListener> NewListener();
+  // UpdateL0Files refreshes the number of L0 files of the store.
+  void UpdateL0Files(rocksdb::DB* db);
+
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri = LOW,
+                        void* tag = nullptr, void (*unschedFunction)(void* arg) = 0) override;
+  virtual int UnSchedule(void* tag, Priority pri) override;
+  virtual unsigned int GetThreadPoolQueueLen(Priority pri = LOW) const override;
+  virtual void SetBackgroundThreads(int number, Priority pri = LOW) override {}
+  virtual int GetBackgroundThreads(Priority pri = LOW) override;
+  virtual void IncBackgroundThreadsIfNeeded(int number, Priority pri) override {}
+
+ private:
+  const std::shared_ptr<BackgroundScheduler> scheduler_;
+  BackgroundScheduler::Store store_;
+};
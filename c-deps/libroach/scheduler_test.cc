@@ -0,0 +1,134 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "scheduler.h"
+
+namespace {
+
+// testJob adapts a closure to the function and argument of a job.
+struct testJob {
+  std::function<void()> fn;
+};
+
+void runJob(void* arg) { static_cast<testJob*>(arg)->fn(); }
+
+void unscheduleJob(void* arg) { static_cast<testJob*>(arg)->fn = nullptr; }
+
+// waitFor waits until cond is true, returning false after a second.
+bool waitFor(std::function<bool()> cond) {
+  for (int i = 0; i < 1000; i++) {
+    if (cond()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST(Libroach, SchedulerPriority) {
+  BackgroundScheduler s(1, 0);
+  BackgroundScheduler::Store idle, busy;
+  idle.l0_files = 1;
+  busy.l0_files = 8;
+
+  // Block the only thread while the jobs are queued.
+  std::promise<void> unblock;
+  std::shared_future<void> unblocked(unblock.get_future());
+  testJob blocker{[unblocked] { unblocked.wait(); }};
+  s.Schedule(&idle, runJob, &blocker, false, nullptr, nullptr);
+  ASSERT_TRUE(waitFor([&s] { return s.Running(false) == 1; }));
+
+  std::mutex mu;
+  std::vector<std::string> order;
+  auto record = [&mu, &order](const char* name) {
+    return testJob{[&mu, &order, name] {
+      std::lock_guard<std::mutex> l(mu);
+      order.push_back(name);
+    }};
+  };
+  testJob idle_compaction = record("idle compaction");
+  testJob busy_compaction = record("busy compaction");
+  testJob flush = record("flush");
+  s.Schedule(&idle, runJob, &idle_compaction, false, nullptr, nullptr);
+  s.Schedule(&busy, runJob, &busy_compaction, false, nullptr, nullptr);
+  s.Schedule(&idle, runJob, &flush, true, nullptr, nullptr);
+  EXPECT_EQ(1, s.Queued(true));
+  EXPECT_EQ(2, s.Queued(false));
+
+  unblock.set_value();
+  ASSERT_TRUE(waitFor([&s] { return s.Ran(false) == 3 && s.Ran(true) == 1; }));
+  const std::vector<std::string> expected = {"flush", "busy compaction", "idle compaction"};
+  EXPECT_EQ(expected, order);
+}
+
+TEST(Libroach, SchedulerReservesFlushThread) {
+  BackgroundScheduler s(3, 0);
+  BackgroundScheduler::Store store;
+
+  std::promise<void> unblock;
+  std::shared_future<void> unblocked(unblock.get_future());
+  std::vector<testJob> compactions(4, testJob{[unblocked] { unblocked.wait(); }});
+  for (auto& c : compactions) {
+    s.Schedule(&store, runJob, &c, false, nullptr, nullptr);
+  }
+  // Only two of the compactions run, leaving a thread for flushes.
+  ASSERT_TRUE(waitFor([&s] { return s.Running(false) == 2; }));
+  EXPECT_EQ(2, s.Queued(false));
+
+  bool flushed = false;
+  testJob flush{[&flushed] { flushed = true; }};
+  s.Schedule(&store, runJob, &flush, true, nullptr, nullptr);
+  ASSERT_TRUE(waitFor([&s] { return s.Ran(true) == 1; }));
+  EXPECT_TRUE(flushed);
+
+  unblock.set_value();
+  ASSERT_TRUE(waitFor([&s] { return s.Ran(false) == 4; }));
+}
+
+TEST(Libroach, SchedulerUnschedule) {
+  BackgroundScheduler s(1, 0);
+  BackgroundScheduler::Store store;
+
+  std::promise<void> unblock;
+  std::shared_future<void> unblocked(unblock.get_future());
+  testJob blocker{[unblocked] { unblocked.wait(); }};
+  s.Schedule(&store, runJob, &blocker, false, nullptr, nullptr);
+  ASSERT_TRUE(waitFor([&s] { return s.Running(false) == 1; }));
+
+  // Only the queued jobs with the tag and priority are removed, and
+  // their unschedule functions are called.
+  int a, b;
+  testJob a1{[] {}}, a2{[] {}}, b1{[] {}};
+  s.Schedule(&store, runJob, &a1, false, &a, unscheduleJob);
+  s.Schedule(&store, runJob, &a2, true, &a, unscheduleJob);
+  s.Schedule(&store, runJob, &b1, false, &b, unscheduleJob);
+  EXPECT_EQ(1, s.Unschedule(&a, false));
+  EXPECT_EQ(nullptr, a1.fn);
+  EXPECT_NE(nullptr, a2.fn);
+  EXPECT_EQ(0, s.Unschedule(&a, false));
+  EXPECT_EQ(1, s.Queued(true));
+  EXPECT_EQ(1, s.Queued(false));
+
+  unblock.set_value();
+  ASSERT_TRUE(waitFor([&s] { return s.Ran(false) == 2 && s.Ran(true) == 1; }));
+}
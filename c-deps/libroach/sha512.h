@@ -0,0 +1,45 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA512 computes the SHA-512 digest (FIPS 180-4) of a stream of
+// bytes, as the Go crypto/sha512 package does. It is used to compute
+// replica consistency checksums without calling back into Go. (The
+// CryptoPP library is only linked into the CCL build.)
+class SHA512 {
+ public:
+  static const int kDigestSize = 64;
+  static const int kBlockSize = 128;
+
+  SHA512();
+
+  // Update adds the bytes to the digest.
+  void Update(const void* data, size_t n);
+
+  // Final writes the digest of the bytes added to out. The digest
+  // must not be updated afterwards.
+  void Final(uint8_t out[kDigestSize]);
+
+ private:
+  void compress(const uint8_t* block);
+
+  uint64_t h_[8];
+  uint8_t buf_[kBlockSize];
+  size_t buf_len_;
+  uint64_t total_len_;
+};
@@ -0,0 +1,66 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "sha512.h"
+
+namespace {
+
+std::string hexDigest(SHA512* h) {
+  uint8_t digest[SHA512::kDigestSize];
+  h->Final(digest);
+  std::string hex;
+  for (int i = 0; i < SHA512::kDigestSize; i++) {
+    char b[3];
+    snprintf(b, sizeof(b), "%02x", digest[i]);
+    hex += b;
+  }
+  return hex;
+}
+
+}  // namespace
+
+TEST(Libroach, SHA512) {
+  struct testCase {
+    std::string data;
+    std::string expected;
+  };
+  const std::vector<testCase> tests = {
+      {"",
+       "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+       "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"},
+      {"abc",
+       "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+       "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"},
+      {std::string(1000000, 'a'),
+       "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+       "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b"},
+  };
+  for (const auto& t : tests) {
+    SHA512 whole;
+    whole.Update(t.data.data(), t.data.size());
+    EXPECT_EQ(t.expected, hexDigest(&whole));
+
+    // The digest does not depend on how the data is split into updates.
+    SHA512 pieces;
+    for (size_t i = 0, n = 1; i < t.data.size(); i += n, n = n * 2 + 1) {
+      pieces.Update(t.data.data() + i, std::min(n, t.data.size() - i));
+    }
+    EXPECT_EQ(t.expected, hexDigest(&pieces));
+  }
+}
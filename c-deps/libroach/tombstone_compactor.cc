@@ -0,0 +1,324 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "tombstone_compactor.h"
+#include <rocksdb/convenience.h>
+#include "db.h"
+#include "encoding.h"
+
+namespace {
+
+const char kTombstonesPropName[] = "crdb.tombstones";
+const char kRangeTombstonesPropName[] = "crdb.range_tombstones";
+const char kTombstoneStartPropName[] = "crdb.tombstones.start";
+const char kTombstoneEndPropName[] = "crdb.tombstones.end";
+const char kRangeTombstoneStartPropName[] = "crdb.range_tombstones.start";
+const char kRangeTombstoneEndPropName[] = "crdb.range_tombstones.end";
+
+// TombstoneTblPropCollector records the number of point and range
+// tombstones in an sstable and the spans they cover in the MVCC key
+// order.
+class TombstoneTblPropCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  explicit TombstoneTblPropCollector(double density)
+      : density_(density), entries_(0), tombstones_(0), range_tombstones_(0) {}
+
+  const char* Name() const override { return "TombstoneTblPropCollector"; }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    std::string tombstones;
+    EncodeUint64(&tombstones, tombstones_);
+    std::string range_tombstones;
+    EncodeUint64(&range_tombstones, range_tombstones_);
+    *properties = rocksdb::UserCollectedProperties{
+        {kTombstonesPropName, tombstones},
+        {kRangeTombstonesPropName, range_tombstones},
+        {kTombstoneStartPropName, start_},
+        {kTombstoneEndPropName, end_},
+        {kRangeTombstoneStartPropName, range_start_},
+        {kRangeTombstoneEndPropName, range_end_},
+    };
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& user_key, const rocksdb::Slice& value,
+                             rocksdb::EntryType type, rocksdb::SequenceNumber seq,
+                             uint64_t file_size) override {
+    entries_++;
+    switch (type) {
+    case rocksdb::kEntryDelete:
+    case rocksdb::kEntrySingleDelete:
+      tombstones_++;
+      extend(tombstones_ == 1, user_key, user_key, &start_, &end_);
+      break;
+    case rocksdb::kEntryOther:
+      // Range deletions are the only entries of the engine which are
+      // neither puts, merges nor deletions. Their value is the end key.
+      range_tombstones_++;
+      extend(range_tombstones_ == 1, user_key, value, &range_start_, &range_end_);
+      break;
+    default:
+      break;
+    }
+    return rocksdb::Status::OK();
+  }
+
+  bool NeedCompact() const override {
+    // Whether a range tombstone is worth compacting depends on how much
+    // data it deletes, which only TombstoneCompactor can estimate.
+    return TombstoneCompactor::Dense(density_, entries_, tombstones_);
+  }
+
+  virtual rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return rocksdb::UserCollectedProperties{};
+  }
+
+ private:
+  // extend extends the span [*span_start, *span_end] to cover [start,
+  // end], replacing it if first is true. Range tombstones are not added
+  // in key order.
+  static void extend(bool first, const rocksdb::Slice& start, const rocksdb::Slice& end,
+                     std::string* span_start, std::string* span_end) {
+    const rocksdb::Comparator* cmp = CockroachComparator();
+    if (first || cmp->Compare(start, *span_start) < 0) {
+      span_start->assign(start.data(), start.size());
+    }
+    if (first || cmp->Compare(end, *span_end) > 0) {
+      span_end->assign(end.data(), end.size());
+    }
+  }
+
+  const double density_;
+  uint64_t entries_;
+  uint64_t tombstones_;
+  uint64_t range_tombstones_;
+  std::string start_;
+  std::string end_;
+  std::string range_start_;
+  std::string range_end_;
+};
+
+class TombstoneTblPropCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  explicit TombstoneTblPropCollectorFactory(double density) : density_(density) {}
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new TombstoneTblPropCollector(density_);
+  }
+  const char* Name() const override { return "TombstoneTblPropCollectorFactory"; }
+
+ private:
+  const double density_;
+};
+
+// decodeCount decodes the named count property, returning 0 if it is
+// missing.
+uint64_t decodeCount(const rocksdb::UserCollectedProperties& props, const char* name) {
+  auto it = props.find(name);
+  if (it == props.end()) {
+    return 0;
+  }
+  rocksdb::Slice buf(it->second);
+  uint64_t count;
+  return DecodeUint64(&buf, &count) ? count : 0;
+}
+
+}  // namespace
+
+const uint64_t TombstoneCompactor::kMinTombstones;
+const size_t TombstoneCompactor::kMaxQueuedSpans;
+
+TombstoneCompactor::TombstoneCompactor(double density)
+    : density_(density),
+      db_(nullptr),
+      compactions_(0),
+      reclaimed_bytes_(0),
+      compacting_(false),
+      stopping_(false) {}
+
+TombstoneCompactor::~TombstoneCompactor() { Stop(); }
+
+rocksdb::TablePropertiesCollectorFactory* TombstoneCompactor::NewTblPropCollectorFactory() const {
+  return new TombstoneTblPropCollectorFactory(density_);
+}
+
+bool TombstoneCompactor::Dense(double density, uint64_t entries, uint64_t tombstones) {
+  return tombstones >= kMinTombstones && double(tombstones) >= density * double(entries);
+}
+
+bool TombstoneCompactor::RangeDense(double density, uint64_t data_bytes, uint64_t deleted_bytes) {
+  return deleted_bytes > 0 && double(deleted_bytes) >= density * double(data_bytes);
+}
+
+void TombstoneCompactor::Start(rocksdb::DB* db) {
+  std::lock_guard<std::mutex> l(mu_);
+  if (!thread_.joinable()) {
+    db_ = db;
+    stopping_ = false;
+    thread_ = std::thread(&TombstoneCompactor::run, this);
+  }
+}
+
+void TombstoneCompactor::Stop() {
+  bool compacting;
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+    compacting = compacting_;
+  }
+  if (compacting) {
+    // RocksDB 5.9 can neither disable manual compactions nor cancel a
+    // single one, but cancelling all of the background work, which the
+    // caller is about to do by closing db anyway, makes the running
+    // CompactRange return. It may flush, notifying this listener, so mu_
+    // must not be held.
+    rocksdb::CancelAllBackgroundWork(db_, false);
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+int64_t TombstoneCompactor::Pending() {
+  std::lock_guard<std::mutex> l(mu_);
+  return int64_t(queue_.size()) + (compacting_ ? 1 : 0);
+}
+
+void TombstoneCompactor::OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) {
+  maybeQueue(db, info.table_properties);
+}
+
+void TombstoneCompactor::OnCompactionCompleted(rocksdb::DB* db,
+                                               const rocksdb::CompactionJobInfo& info) {
+  // The table properties cover the compaction's inputs too, which have
+  // been queued already if they were dense.
+  for (const auto& path : info.output_files) {
+    auto it = info.table_properties.find(path);
+    if (it != info.table_properties.end()) {
+      maybeQueue(db, *it->second);
+    }
+  }
+}
+
+void TombstoneCompactor::maybeQueue(rocksdb::DB* db, const rocksdb::TableProperties& props) {
+  const rocksdb::UserCollectedProperties& user = props.user_collected_properties;
+  auto findSpan = [&user](const char* start_name, const char* end_name, span* s) {
+    auto start = user.find(start_name);
+    auto end = user.find(end_name);
+    if (start == user.end() || end == user.end()) {
+      return false;
+    }
+    *s = span{start->second, end->second};
+    return true;
+  };
+
+  span s;
+  if (Dense(density_, props.num_entries, decodeCount(user, kTombstonesPropName)) &&
+      findSpan(kTombstoneStartPropName, kTombstoneEndPropName, &s)) {
+    queue(std::move(s));
+  }
+  if (decodeCount(user, kRangeTombstonesPropName) > 0 &&
+      findSpan(kRangeTombstoneStartPropName, kRangeTombstoneEndPropName, &s)) {
+    // The range tombstones are stored outside of the data blocks, so the
+    // approximate size of their span is that of the data they shadow in
+    // this and the other sstables.
+    const rocksdb::Range r(s.start, s.end);
+    uint64_t deleted_bytes = 0;
+    db->GetApproximateSizes(&r, 1, &deleted_bytes);
+    if (RangeDense(density_, props.data_size, deleted_bytes)) {
+      queue(std::move(s));
+    }
+  }
+}
+
+void TombstoneCompactor::queue(span s) {
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  auto overlaps = [cmp](const span& a, const span& b) {
+    return cmp->Compare(a.start, b.end) <= 0 && cmp->Compare(b.start, a.end) <= 0;
+  };
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    // The output of a tombstone-triggered compaction may still hold
+    // tombstones (e.g. those visible to a snapshot). Queueing it again
+    // would compact the span over and over.
+    if (compacting_ && overlaps(s, running_)) {
+      return;
+    }
+    for (auto& q : queue_) {
+      if (overlaps(s, q)) {
+        if (cmp->Compare(s.start, q.start) < 0) {
+          q.start = s.start;
+        }
+        if (cmp->Compare(s.end, q.end) > 0) {
+          q.end = s.end;
+        }
+        return;
+      }
+    }
+    if (queue_.size() >= kMaxQueuedSpans) {
+      return;
+    }
+    queue_.push_back(std::move(s));
+  }
+  cv_.notify_one();
+}
+
+uint64_t TombstoneCompactor::overlappingBytes(const span& s) {
+  const rocksdb::Comparator* cmp = CockroachComparator();
+  std::vector<rocksdb::LiveFileMetaData> files;
+  db_->GetLiveFilesMetaData(&files);
+  uint64_t bytes = 0;
+  for (const auto& f : files) {
+    if (cmp->Compare(f.smallestkey, s.end) <= 0 && cmp->Compare(s.start, f.largestkey) <= 0) {
+      bytes += f.size;
+    }
+  }
+  return bytes;
+}
+
+void TombstoneCompactor::run() {
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    cv_.wait(l, [this] { return stopping_ || !queue_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    running_ = std::move(queue_.front());
+    queue_.pop_front();
+    compacting_ = true;
+    const span s = running_;
+    l.unlock();
+
+    const uint64_t before = overlappingBytes(s);
+    rocksdb::CompactRangeOptions opts;
+    // Don't hold up automatic compactions, and compact the bottommost
+    // level too, which is where the tombstones are dropped.
+    opts.exclusive_manual_compaction = false;
+    opts.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+    const rocksdb::Slice start(s.start);
+    const rocksdb::Slice end(s.end);
+    const rocksdb::Status status = db_->CompactRange(opts, &start, &end);
+    if (status.ok()) {
+      const uint64_t after = overlappingBytes(s);
+      compactions_++;
+      if (after < before) {
+        reclaimed_bytes_ += before - after;
+      }
+    }
+
+    l.lock();
+    compacting_ = false;
+  }
+}
@@ -0,0 +1,119 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <rocksdb/db.h>
+#include <rocksdb/listener.h>
+#include <rocksdb/table_properties.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// TombstoneCompactor compacts the spans of sstables which are dense
+// with deletion tombstones, such as those written after a replica is
+// cleared with DBDeleteIterRange or DBDeleteRange. Until a compaction
+// drops them, every scan and seek across the span has to skip the
+// tombstones and the data they shadow, and normal compactions may take
+// a long time to reach them.
+//
+// Each sstable records the number of point and range tombstones it
+// contains and the spans they cover in its properties (see
+// NewTblPropCollectorFactory). An sstable is dense with point
+// tombstones if at least kMinTombstones and the configured fraction of
+// its entries are point tombstones. Such sstables are marked for
+// compaction so that RocksDB picks them up once it has nothing more
+// urgent to do. An sstable is dense with range tombstones if the
+// estimated size of the data under their span is at least the
+// configured fraction of the size of its own data, so that a small
+// range deletion does not trigger the compaction of a large sstable.
+// When a flush or compaction writes a dense sstable, the span of its
+// tombstones is queued, and a background thread compacts the queued
+// spans down to the bottommost level, where the tombstones and the
+// data they cover are dropped.
+class TombstoneCompactor : public rocksdb::EventListener {
+ public:
+  static const uint64_t kMinTombstones = 64;
+  // kMaxQueuedSpans bounds the queue. Spans which do not fit are left
+  // to RocksDB's compaction of marked sstables.
+  static const size_t kMaxQueuedSpans = 64;
+
+  explicit TombstoneCompactor(double density);
+  virtual ~TombstoneCompactor();
+
+  // NewTblPropCollectorFactory returns a table properties collector
+  // factory which records the tombstones of each sstable and marks the
+  // dense ones for compaction.
+  rocksdb::TablePropertiesCollectorFactory* NewTblPropCollectorFactory() const;
+
+  // Start starts compacting the queued spans of db. Stop stops the
+  // compaction thread, cancelling the current compaction along with the
+  // rest of the background work of db, and must be called before db is
+  // closed.
+  void Start(rocksdb::DB* db);
+  void Stop();
+
+  // Compactions returns the number of tombstone-triggered compactions
+  // which have completed, ReclaimedBytes the decrease in the size of
+  // the sstables overlapping their spans and Pending the number of
+  // spans queued or being compacted.
+  int64_t Compactions() const { return compactions_.load(); }
+  int64_t ReclaimedBytes() const { return reclaimed_bytes_.load(); }
+  int64_t Pending();
+
+  // Dense returns true if an sstable with the given number of entries
+  // and point tombstones should be compacted. RangeDense returns true
+  // if an sstable with data_bytes of data whose range tombstones cover
+  // an estimated deleted_bytes should be compacted.
+  static bool Dense(double density, uint64_t entries, uint64_t tombstones);
+  static bool RangeDense(double density, uint64_t data_bytes, uint64_t deleted_bytes);
+
+  // EventListener methods.
+  virtual void OnFlushCompleted(rocksdb::DB* db, const rocksdb::FlushJobInfo& info) override;
+  virtual void OnCompactionCompleted(rocksdb::DB* db,
+                                     const rocksdb::CompactionJobInfo& info) override;
+
+ private:
+  struct span {
+    std::string start;
+    std::string end;
+  };
+
+  // maybeQueue queues the tombstone spans of an sstable of db if it is
+  // dense. queue adds s to the queue, merging it with the spans it
+  // overlaps.
+  void maybeQueue(rocksdb::DB* db, const rocksdb::TableProperties& props);
+  void queue(span s);
+  // overlappingBytes returns the total size of the live sstables
+  // overlapping s.
+  uint64_t overlappingBytes(const span& s);
+  void run();
+
+  const double density_;
+  rocksdb::DB* db_;
+  std::atomic<int64_t> compactions_;
+  std::atomic<int64_t> reclaimed_bytes_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // Protected by mu_. running_ is only valid while compacting_.
+  std::deque<span> queue_;
+  bool compacting_;
+  span running_;
+  bool stopping_;
+  std::thread thread_;
+};
@@ -0,0 +1,455 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "trace.h"
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "db.h"
+#include "histogram.h"
+
+const char Tracer::kTraceMagic[] = "CRDBTRC1";
+
+const DBStatus kSuccess = {NULL, 0};
+
+namespace {
+
+void putVarint64(std::string* dst, uint64_t v) {
+  while (v >= 0x80) {
+    dst->push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  dst->push_back(char(v));
+}
+
+void putBool(std::string* dst, bool b) { dst->push_back(b ? 1 : 0); }
+
+void putBytes(std::string* dst, const rocksdb::Slice& s) {
+  putVarint64(dst, s.size());
+  dst->append(s.data(), s.size());
+}
+
+bool getVarint64(rocksdb::Slice* src, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift <= 63 && !src->empty(); shift += 7) {
+    const uint8_t b = (*src)[0];
+    src->remove_prefix(1);
+    result |= uint64_t(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool getBool(rocksdb::Slice* src, bool* b) {
+  if (src->empty()) {
+    return false;
+  }
+  *b = (*src)[0] != 0;
+  src->remove_prefix(1);
+  return true;
+}
+
+bool getBytes(rocksdb::Slice* src, rocksdb::Slice* s) {
+  uint64_t n;
+  if (!getVarint64(src, &n) || n > src->size()) {
+    return false;
+  }
+  *s = rocksdb::Slice(src->data(), n);
+  src->remove_prefix(n);
+  return true;
+}
+
+rocksdb::Slice toSlice(DBSlice s) { return rocksdb::Slice(s.data, s.len); }
+
+}  // namespace
+
+Tracer::Tracer() : enabled_(false), next_iter_id_(1), first_iter_id_(1) {}
+
+Tracer::~Tracer() { Stop(); }
+
+rocksdb::Status Tracer::Start(rocksdb::Env* env, const std::string& path,
+                              const std::function<rocksdb::Status()>& at_start) {
+  std::lock_guard<std::mutex> l(mu_);
+  if (file_ != nullptr) {
+    return rocksdb::Status::InvalidArgument("a trace is already being recorded");
+  }
+  rocksdb::Status status = env->NewWritableFile(path, &file_, rocksdb::EnvOptions());
+  if (!status.ok()) {
+    return status;
+  }
+  buf_.assign(kTraceMagic, kTraceMagicLength);
+  first_iter_id_.store(next_iter_id_.load());
+  enabled_.store(true);
+  if (at_start) {
+    // The calls made from now on are recorded before they are executed
+    // and wait for mu_ to be recorded, so at_start sees the engine as
+    // of the start of the trace.
+    status = at_start();
+    if (!status.ok()) {
+      enabled_.store(false);
+      file_->Close();
+      file_.reset();
+      env->DeleteFile(path);
+      return status;
+    }
+  }
+  last_ = std::chrono::steady_clock::now();
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status Tracer::Stop() {
+  std::lock_guard<std::mutex> l(mu_);
+  enabled_.store(false);
+  if (file_ == nullptr) {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status status = flushLocked();
+  rocksdb::Status close_status = file_->Close();
+  file_.reset();
+  return status.ok() ? close_status : status;
+}
+
+rocksdb::Status Tracer::flushLocked() {
+  rocksdb::Status status = file_->Append(buf_);
+  buf_.clear();
+  return status;
+}
+
+void Tracer::append(TraceOp op, const std::string& fields) {
+  std::lock_guard<std::mutex> l(mu_);
+  if (file_ == nullptr) {
+    // The trace was stopped after the caller checked Enabled.
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  buf_.push_back(char(op));
+  putVarint64(&buf_, std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count());
+  buf_.append(fields);
+  last_ = now;
+  if (buf_.size() >= kFlushBytes && !flushLocked().ok()) {
+    // Stop tracing rather than recording a trace with holes.
+    enabled_.store(false);
+    file_->Close();
+    file_.reset();
+  }
+}
+
+void Tracer::ApplyBatchRepr(const rocksdb::Slice& repr, bool sync) {
+  std::string fields;
+  putBool(&fields, sync);
+  putBytes(&fields, repr);
+  append(kTraceApplyBatchRepr, fields);
+}
+
+void Tracer::CommitBatch(const rocksdb::Slice& repr, bool sync) {
+  std::string fields;
+  putBool(&fields, sync);
+  putBytes(&fields, repr);
+  append(kTraceCommitBatch, fields);
+}
+
+void Tracer::MVCCGet(uint64_t iter_id, DBSlice key, DBTimestamp ts, bool consistent) {
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  putBytes(&fields, toSlice(key));
+  putVarint64(&fields, ts.wall_time);
+  putVarint64(&fields, uint32_t(ts.logical));
+  putBool(&fields, consistent);
+  append(kTraceMVCCGet, fields);
+}
+
+void Tracer::MVCCScan(uint64_t iter_id, DBSlice start, DBSlice end, DBTimestamp ts,
+                      int64_t max_keys, bool consistent, bool reverse) {
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  putBytes(&fields, toSlice(start));
+  putBytes(&fields, toSlice(end));
+  putVarint64(&fields, ts.wall_time);
+  putVarint64(&fields, uint32_t(ts.logical));
+  putVarint64(&fields, max_keys);
+  putBool(&fields, consistent);
+  putBool(&fields, reverse);
+  append(kTraceMVCCScan, fields);
+}
+
+void Tracer::IterSeek(uint64_t iter_id, DBKey key) {
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  putBytes(&fields, toSlice(key.key));
+  putVarint64(&fields, key.wall_time);
+  putVarint64(&fields, uint32_t(key.logical));
+  append(kTraceIterSeek, fields);
+}
+
+void Tracer::IterNext(uint64_t iter_id, bool skip_current_key_versions) {
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  putBool(&fields, skip_current_key_versions);
+  append(kTraceIterNext, fields);
+}
+
+uint64_t Tracer::IterID(uint64_t* iter_id, bool prefix) {
+  if (*iter_id < first_iter_id_.load(std::memory_order_relaxed)) {
+    *iter_id = next_iter_id_.fetch_add(1);
+    std::string fields;
+    putVarint64(&fields, *iter_id);
+    putBool(&fields, prefix);
+    append(kTraceIterNew, fields);
+  }
+  return *iter_id;
+}
+
+void Tracer::IterDestroy(uint64_t iter_id) {
+  if (iter_id < first_iter_id_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  append(kTraceIterDestroy, fields);
+}
+
+void Tracer::IterRefresh(uint64_t iter_id) {
+  if (iter_id < first_iter_id_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::string fields;
+  putVarint64(&fields, iter_id);
+  append(kTraceIterRefresh, fields);
+}
+
+bool TraceReader::fill() {
+  buf_.erase(0, pos_);
+  pos_ = 0;
+  std::unique_ptr<char[]> scratch(new char[kReadBytes]);
+  rocksdb::Slice result;
+  rocksdb::Status status = file_->Read(kReadBytes, &result, scratch.get());
+  if (!status.ok()) {
+    error_ = status.ToString();
+    return false;
+  }
+  buf_.append(result.data(), result.size());
+  eof_ = result.empty();
+  return true;
+}
+
+bool TraceReader::Init() {
+  while (buf_.size() < Tracer::kTraceMagicLength && !eof_) {
+    if (!fill()) {
+      return false;
+    }
+  }
+  if (buf_.size() < Tracer::kTraceMagicLength ||
+      memcmp(buf_.data(), Tracer::kTraceMagic, Tracer::kTraceMagicLength) != 0) {
+    error_ = "not a trace file";
+    return false;
+  }
+  pos_ = Tracer::kTraceMagicLength;
+  return true;
+}
+
+namespace {
+
+// decodeRecord decodes the record at the start of data, returning
+// false if data holds only part of the record.
+bool decodeRecord(rocksdb::Slice* data, TraceRecord* rec, uint64_t* delta) {
+  *rec = TraceRecord();
+  rec->op = TraceOp((*data)[0]);
+  data->remove_prefix(1);
+
+  uint64_t wall_time = 0, logical = 0, max_keys = 0;
+  bool ok = getVarint64(data, delta);
+  switch (rec->op) {
+  case kTraceApplyBatchRepr:
+  case kTraceCommitBatch:
+    ok = ok && getBool(data, &rec->flag) && getBytes(data, &rec->key);
+    break;
+  case kTraceMVCCGet:
+    ok = ok && getVarint64(data, &rec->iter_id) && getBytes(data, &rec->key) &&
+         getVarint64(data, &wall_time) && getVarint64(data, &logical) &&
+         getBool(data, &rec->flag);
+    break;
+  case kTraceMVCCScan:
+    ok = ok && getVarint64(data, &rec->iter_id) && getBytes(data, &rec->key) &&
+         getBytes(data, &rec->end_key) && getVarint64(data, &wall_time) &&
+         getVarint64(data, &logical) && getVarint64(data, &max_keys) &&
+         getBool(data, &rec->flag) && getBool(data, &rec->reverse);
+    break;
+  case kTraceIterSeek:
+    ok = ok && getVarint64(data, &rec->iter_id) && getBytes(data, &rec->key) &&
+         getVarint64(data, &wall_time) && getVarint64(data, &logical);
+    break;
+  case kTraceIterNext:
+    ok = ok && getVarint64(data, &rec->iter_id) && getBool(data, &rec->flag);
+    break;
+  case kTraceIterNew:
+    ok = ok && getVarint64(data, &rec->iter_id) && getBool(data, &rec->prefix);
+    break;
+  case kTraceIterDestroy:
+  case kTraceIterRefresh:
+    ok = ok && getVarint64(data, &rec->iter_id);
+    break;
+  }
+  rec->ts.wall_time = wall_time;
+  rec->ts.logical = int32_t(logical);
+  rec->max_keys = max_keys;
+  return ok;
+}
+
+}  // namespace
+
+bool TraceReader::Next(TraceRecord* rec) {
+  if (!error_.empty()) {
+    return false;
+  }
+  for (;;) {
+    rocksdb::Slice data(buf_.data() + pos_, buf_.size() - pos_);
+    if (!data.empty()) {
+      const int op = data[0];
+      if (op < kTraceApplyBatchRepr || op > kTraceIterRefresh) {
+        error_ = "unknown trace record type " + std::to_string(op);
+        return false;
+      }
+      uint64_t delta;
+      if (decodeRecord(&data, rec, &delta)) {
+        pos_ = buf_.size() - data.size();
+        nanos_ += delta;
+        rec->nanos = nanos_;
+        return true;
+      }
+    }
+    // The buffer holds at most part of the next record.
+    if (eof_) {
+      if (!data.empty()) {
+        error_ = "truncated trace record";
+      }
+      return false;
+    }
+    if (!fill()) {
+      return false;
+    }
+  }
+}
+
+DBStatus DBReplayTrace(DBEngine* db, DBSlice trace_path, double speed,
+                       DBTraceReplayStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  // The trace is read through the engine's env, which is the one it
+  // was written through if it was recorded on this store.
+  std::unique_ptr<rocksdb::SequentialFile> file;
+  rocksdb::Status status =
+      DBGetEnv(db)->NewSequentialFile(ToString(trace_path), &file, rocksdb::EnvOptions());
+  if (!status.ok()) {
+    return ToDBStatus(status);
+  }
+  TraceReader reader(std::move(file));
+  if (!reader.Init()) {
+    return FmtStatus("%s", reader.Error().c_str());
+  }
+
+  Histogram latencies[kTraceIterRefresh + 1];
+  std::map<uint64_t, DBIterator*> iters;
+  auto getIter = [&iters](const TraceRecord& rec) -> DBIterator* {
+    auto it = iters.find(rec.iter_id);
+    return it == iters.end() ? nullptr : it->second;
+  };
+
+  const DBTxn txn = {};
+  const auto start = std::chrono::steady_clock::now();
+  TraceRecord rec;
+  while (reader.Next(&rec)) {
+    if (speed > 0) {
+      std::this_thread::sleep_until(
+          start + std::chrono::nanoseconds(int64_t(rec.nanos / speed)));
+    }
+
+    const auto op_start = std::chrono::steady_clock::now();
+    DBStatus op_status = kSuccess;
+    DBIterator* iter = getIter(rec);
+    switch (rec.op) {
+    case kTraceApplyBatchRepr:
+    case kTraceCommitBatch:
+      op_status = DBApplyBatchRepr(db, ToDBSlice(rec.key), rec.flag);
+      break;
+    case kTraceIterNew:
+      if (iter != nullptr) {
+        DBIterDestroy(iter);
+      }
+      iters[rec.iter_id] = DBNewIter(db, rec.prefix);
+      break;
+    default:
+      if (iter == nullptr) {
+        op_status = FmtStatus("unknown iterator %llu", (unsigned long long)rec.iter_id);
+        break;
+      }
+      switch (rec.op) {
+      case kTraceMVCCGet:
+        op_status = MVCCGet(iter, ToDBSlice(rec.key), rec.ts, txn, rec.flag).status;
+        break;
+      case kTraceMVCCScan:
+        op_status = MVCCScan(iter, ToDBSlice(rec.key), ToDBSlice(rec.end_key), rec.ts,
+                             rec.max_keys, txn, rec.flag, rec.reverse)
+                        .status;
+        break;
+      case kTraceIterSeek: {
+        const DBKey key = {ToDBSlice(rec.key), rec.ts.wall_time, rec.ts.logical};
+        op_status = DBIterSeek(iter, key).status;
+        break;
+      }
+      case kTraceIterNext:
+        op_status = DBIterNext(iter, rec.flag).status;
+        break;
+      case kTraceIterRefresh:
+        op_status = DBIterRefresh(iter);
+        break;
+      case kTraceIterDestroy:
+        DBIterDestroy(iter);
+        iters.erase(rec.iter_id);
+        break;
+      default:
+        break;
+      }
+    }
+    latencies[rec.op].Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - op_start)
+                                 .count());
+    stats->records++;
+    if (op_status.data != NULL) {
+      // Errors (e.g. intents encountered by consistent reads, which are
+      // replayed without their transaction) are counted rather than
+      // aborting the replay.
+      stats->errors++;
+      free(op_status.data);
+    }
+  }
+  for (auto& i : iters) {
+    DBIterDestroy(i.second);
+  }
+  stats->elapsed_nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  stats->apply_batch_repr = latencies[kTraceApplyBatchRepr].Export();
+  stats->commit_batch = latencies[kTraceCommitBatch].Export();
+  stats->mvcc_get = latencies[kTraceMVCCGet].Export();
+  stats->mvcc_scan = latencies[kTraceMVCCScan].Export();
+  stats->iter_seek = latencies[kTraceIterSeek].Export();
+  stats->iter_next = latencies[kTraceIterNext].Export();
+  if (!reader.Error().empty()) {
+    return FmtStatus("%s", reader.Error().c_str());
+  }
+  return kSuccess;
+}
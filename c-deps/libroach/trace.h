@@ -0,0 +1,189 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <libroach.h>
+#include <memory>
+#include <mutex>
+#include <rocksdb/env.h>
+#include <rocksdb/slice.h>
+#include <rocksdb/status.h>
+#include <stdint.h>
+#include <string>
+
+// TraceOp is the type of a record in a trace file.
+enum TraceOp {
+  kTraceApplyBatchRepr = 1,
+  kTraceCommitBatch = 2,
+  kTraceMVCCGet = 3,
+  kTraceMVCCScan = 4,
+  kTraceIterSeek = 5,
+  kTraceIterNext = 6,
+  kTraceIterNew = 7,
+  kTraceIterDestroy = 8,
+  kTraceIterRefresh = 9,
+};
+
+// Tracer records the engine calls made while it is enabled into a
+// compact binary trace file, which can be replayed with DBReplayTrace
+// to reproduce the access pattern of a production workload. Recording
+// is a single relaxed atomic load when the tracer is disabled.
+//
+// A trace file is kTraceMagic followed by a sequence of records. Each
+// record is encoded as:
+//
+//   <op:1><delta-nanos:varint64><fields>
+//
+// where delta-nanos is the time elapsed since the previous record (or
+// since the trace was started) and the fields depend on the op. Byte
+// strings are encoded as a varint32 length followed by the bytes, and
+// integers are varints.
+//
+//   ApplyBatchRepr, CommitBatch: <sync:1><repr>
+//   MVCCGet:  <iter-id><key><wall-time><logical><consistent:1>
+//   MVCCScan: <iter-id><start><end><wall-time><logical><max-keys>
+//             <consistent:1><reverse:1>
+//   IterSeek: <iter-id><key><wall-time><logical>
+//   IterNext: <iter-id><skip-current-key-versions:1>
+//   IterNew:  <iter-id><prefix:1>
+//   IterDestroy, IterRefresh: <iter-id>
+//
+// Iterators are identified by an ID which is unique within the trace
+// (iterator addresses are reused once an iterator is freed). The
+// creation of an iterator is recorded the first time it is used while
+// tracing, so that sequences of seeks and steps are replayed on a
+// fresh iterator of the same kind, and its destruction and refreshes
+// are recorded so that the replayed iterator sees the same state.
+class Tracer {
+ public:
+  static const char kTraceMagic[];
+  static const size_t kTraceMagicLength = 8;
+  // kFlushBytes is the amount of buffered trace data which triggers a
+  // write to the trace file.
+  static const size_t kFlushBytes = 64 << 10;
+
+  Tracer();
+  ~Tracer();
+
+  // Start starts recording into a new trace file at path, written
+  // through env, returning an error if a trace is already being
+  // recorded. If at_start is set, it is called once recording has been
+  // enabled but before any call is recorded (the calls to be recorded
+  // wait for it), and the trace is abandoned if it fails. This allows
+  // a copy of the engine to be taken which the trace can be replayed
+  // against.
+  rocksdb::Status Start(rocksdb::Env* env, const std::string& path,
+                        const std::function<rocksdb::Status()>& at_start);
+  // Stop stops recording and closes the trace file.
+  rocksdb::Status Stop();
+
+  bool Enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void ApplyBatchRepr(const rocksdb::Slice& repr, bool sync);
+  void CommitBatch(const rocksdb::Slice& repr, bool sync);
+  void MVCCGet(uint64_t iter_id, DBSlice key, DBTimestamp ts, bool consistent);
+  void MVCCScan(uint64_t iter_id, DBSlice start, DBSlice end, DBTimestamp ts, int64_t max_keys,
+                bool consistent, bool reverse);
+  void IterSeek(uint64_t iter_id, DBKey key);
+  void IterNext(uint64_t iter_id, bool skip_current_key_versions);
+
+  // IterID returns the ID of the iterator whose ID is stored in
+  // *iter_id, assigning it a new ID and recording its creation if it
+  // has not been used in the current trace (*iter_id is 0 for
+  // iterators which have never been traced).
+  uint64_t IterID(uint64_t* iter_id, bool prefix);
+  // IterDestroy and IterRefresh record the destruction and refresh of
+  // the iterator with the given ID, if it has been used in the current
+  // trace.
+  void IterDestroy(uint64_t iter_id);
+  void IterRefresh(uint64_t iter_id);
+
+ private:
+  // append adds the encoded record (without its op and timestamp) to
+  // the buffer.
+  void append(TraceOp op, const std::string& fields);
+  rocksdb::Status flushLocked();
+
+ private:
+  std::atomic<bool> enabled_;
+  // The next iterator ID to assign, and the first ID assigned in the
+  // current trace. IDs are never reused, so IDs assigned in earlier
+  // traces are below first_iter_id_.
+  std::atomic<uint64_t> next_iter_id_;
+  std::atomic<uint64_t> first_iter_id_;
+  std::mutex mu_;
+  std::unique_ptr<rocksdb::WritableFile> file_;
+  std::string buf_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+// TraceRecord is a decoded trace record. The slices point into the
+// buffer of the TraceReader and remain valid until the next call to
+// TraceReader::Next.
+struct TraceRecord {
+  TraceOp op;
+  // The time of the record relative to the start of the trace.
+  int64_t nanos;
+  uint64_t iter_id;
+  // Is the iterator a prefix iterator (IterNew only)?
+  bool prefix;
+  // sync for batch records, consistent for MVCCGet and MVCCScan and
+  // skip_current_key_versions for IterNext.
+  bool flag;
+  bool reverse;
+  // The batch repr, the key or the start key.
+  rocksdb::Slice key;
+  rocksdb::Slice end_key;
+  DBTimestamp ts;
+  int64_t max_keys;
+};
+
+// TraceReader decodes the records of a trace file. The file is read
+// incrementally so that traces larger than memory can be replayed.
+class TraceReader {
+ public:
+  // kReadBytes is the amount of data read from the file at a time.
+  static const size_t kReadBytes = 64 << 10;
+
+  explicit TraceReader(std::unique_ptr<rocksdb::SequentialFile> file)
+      : file_(std::move(file)), pos_(0), eof_(false), nanos_(0) {}
+
+  // Init checks the trace header, returning false on error.
+  bool Init();
+
+  // Next decodes the next record, returning false at the end of the
+  // trace or on error (see Error).
+  bool Next(TraceRecord* rec);
+
+  const std::string& Error() const { return error_; }
+
+ private:
+  // fill reads more of the file into the buffer, discarding the data
+  // which has been decoded. It returns false on error.
+  bool fill();
+
+ private:
+  std::unique_ptr<rocksdb::SequentialFile> file_;
+  // The data read from the file, of which the bytes before pos_ have
+  // been decoded.
+  std::string buf_;
+  size_t pos_;
+  bool eof_;
+  int64_t nanos_;
+  std::string error_;
+};
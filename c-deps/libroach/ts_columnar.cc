@@ -0,0 +1,341 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "ts_columnar.h"
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+void PutVarint64(std::string* buf, uint64_t v) {
+  while (v >= 0x80) {
+    buf->push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  buf->push_back(char(v));
+}
+
+bool GetVarint64(rocksdb::Slice* buf, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0, i = 0; shift <= 63 && i < buf->size(); shift += 7, ++i) {
+    const uint64_t byte = uint8_t((*buf)[i]);
+    result |= (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      buf->remove_prefix(i + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ZigZagEncode(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+
+int64_t ZigZagDecode(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+uint64_t DoubleBits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+double BitsDouble(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+int LeadingZeros(uint64_t x) {
+  int n = 0;
+  for (uint64_t mask = uint64_t(1) << 63; (x & mask) == 0; mask >>= 1) {
+    ++n;
+  }
+  return n;
+}
+
+int TrailingZeros(uint64_t x) {
+  int n = 0;
+  for (; (x & 1) == 0; x >>= 1) {
+    ++n;
+  }
+  return n;
+}
+
+// The leading zero count is stored in 5 bits.
+const int kMaxLeadingZeros = 31;
+
+}  // namespace
+
+ColumnarTimeSeriesWriter::ColumnarTimeSeriesWriter() { Reset(0, 0); }
+
+void ColumnarTimeSeriesWriter::Reset(int64_t start_nanos, int64_t duration_nanos) {
+  start_nanos_ = start_nanos;
+  duration_nanos_ = duration_nanos;
+  count_ = 0;
+  offsets_.clear();
+  prev_offset_ = 0;
+  prev_delta_ = 0;
+  sums_.clear();
+  prev_sum_bits_ = 0;
+  prev_leading_ = -1;
+  prev_trailing_ = 0;
+  bit_pos_ = 0;
+}
+
+void ColumnarTimeSeriesWriter::putBits(uint64_t v, int nbits) {
+  while (nbits > 0) {
+    if (bit_pos_ == 0) {
+      sums_.push_back('\0');
+    }
+    const int avail = 8 - bit_pos_;
+    const int n = std::min(avail, nbits);
+    const uint8_t chunk = (v >> (nbits - n)) & ((1u << n) - 1);
+    sums_.back() = char(uint8_t(sums_.back()) | (chunk << (avail - n)));
+    bit_pos_ = (bit_pos_ + n) % 8;
+    nbits -= n;
+  }
+}
+
+bool ColumnarTimeSeriesWriter::Add(int32_t offset, double sum) {
+  if (count_ > 0 && offset <= prev_offset_) {
+    return false;
+  }
+
+  if (count_ == 0) {
+    PutVarint64(&offsets_, ZigZagEncode(offset));
+  } else {
+    const int64_t delta = int64_t(offset) - prev_offset_;
+    PutVarint64(&offsets_, ZigZagEncode(count_ == 1 ? delta : delta - prev_delta_));
+    prev_delta_ = delta;
+  }
+  prev_offset_ = offset;
+
+  const uint64_t bits = DoubleBits(sum);
+  if (count_ == 0) {
+    putBits(bits, 64);
+  } else {
+    const uint64_t x = bits ^ prev_sum_bits_;
+    if (x == 0) {
+      putBits(0, 1);
+    } else {
+      const int leading = std::min(LeadingZeros(x), kMaxLeadingZeros);
+      const int trailing = TrailingZeros(x);
+      if (prev_leading_ >= 0 && leading >= prev_leading_ && trailing >= prev_trailing_) {
+        // The meaningful bits fit within the previous window.
+        putBits(0x2, 2);
+        putBits(x >> prev_trailing_, 64 - prev_leading_ - prev_trailing_);
+      } else {
+        const int meaningful = 64 - leading - trailing;
+        putBits(0x3, 2);
+        putBits(leading, 5);
+        putBits(meaningful - 1, 6);
+        putBits(x >> trailing, meaningful);
+        prev_leading_ = leading;
+        prev_trailing_ = trailing;
+      }
+    }
+  }
+  prev_sum_bits_ = bits;
+  ++count_;
+  return true;
+}
+
+void ColumnarTimeSeriesWriter::Finish(std::string* buf) {
+  PutVarint64(buf, uint64_t(start_nanos_));
+  PutVarint64(buf, uint64_t(duration_nanos_));
+  PutVarint64(buf, count_);
+  PutVarint64(buf, offsets_.size());
+  buf->append(offsets_);
+  buf->append(sums_);
+}
+
+ColumnarTimeSeriesReader::ColumnarTimeSeriesReader()
+    : start_nanos_(0),
+      duration_nanos_(0),
+      count_(0),
+      seen_(0),
+      bit_pos_(0),
+      offset_(0),
+      delta_(0),
+      sum_(0),
+      sum_bits_(0),
+      leading_(-1),
+      trailing_(0),
+      error_(false) {}
+
+bool ColumnarTimeSeriesReader::setError() {
+  error_ = true;
+  return false;
+}
+
+bool ColumnarTimeSeriesReader::Init(const rocksdb::Slice& value) {
+  *this = ColumnarTimeSeriesReader();
+  rocksdb::Slice buf(value);
+  uint64_t start, duration, count, offsets_len;
+  if (!GetVarint64(&buf, &start) || !GetVarint64(&buf, &duration) ||
+      !GetVarint64(&buf, &count) || !GetVarint64(&buf, &offsets_len) ||
+      count > UINT32_MAX || offsets_len > buf.size()) {
+    return setError();
+  }
+  start_nanos_ = int64_t(start);
+  duration_nanos_ = int64_t(duration);
+  count_ = uint32_t(count);
+  offsets_ = rocksdb::Slice(buf.data(), offsets_len);
+  buf.remove_prefix(offsets_len);
+  sums_ = buf;
+  return true;
+}
+
+bool ColumnarTimeSeriesReader::getBits(int nbits, uint64_t* v) {
+  uint64_t r = 0;
+  while (nbits > 0) {
+    if (sums_.empty()) {
+      return false;
+    }
+    const int avail = 8 - bit_pos_;
+    const int n = std::min(avail, nbits);
+    const uint8_t byte = sums_[0];
+    r = (r << n) | ((byte >> (avail - n)) & ((1u << n) - 1));
+    bit_pos_ += n;
+    nbits -= n;
+    if (bit_pos_ == 8) {
+      bit_pos_ = 0;
+      sums_.remove_prefix(1);
+    }
+  }
+  *v = r;
+  return true;
+}
+
+bool ColumnarTimeSeriesReader::Next() {
+  if (error_ || seen_ == count_) {
+    return false;
+  }
+
+  uint64_t v;
+  if (!GetVarint64(&offsets_, &v)) {
+    return setError();
+  }
+  int64_t offset = ZigZagDecode(v);
+  if (seen_ == 1) {
+    delta_ = offset;
+    offset = int64_t(offset_) + delta_;
+  } else if (seen_ > 1) {
+    delta_ += offset;
+    offset = int64_t(offset_) + delta_;
+  }
+  if (offset < INT32_MIN || offset > INT32_MAX || (seen_ > 0 && offset <= offset_)) {
+    return setError();
+  }
+  offset_ = int32_t(offset);
+
+  if (seen_ == 0) {
+    if (!getBits(64, &sum_bits_)) {
+      return setError();
+    }
+  } else {
+    uint64_t control;
+    if (!getBits(1, &control)) {
+      return setError();
+    }
+    if (control != 0) {
+      if (!getBits(1, &control)) {
+        return setError();
+      }
+      if (control != 0) {
+        uint64_t leading, meaningful;
+        if (!getBits(5, &leading) || !getBits(6, &meaningful)) {
+          return setError();
+        }
+        leading_ = int(leading);
+        trailing_ = 64 - leading_ - int(meaningful + 1);
+        if (trailing_ < 0) {
+          return setError();
+        }
+      } else if (leading_ < 0) {
+        return setError();
+      }
+      uint64_t x;
+      if (!getBits(64 - leading_ - trailing_, &x)) {
+        return setError();
+      }
+      sum_bits_ ^= x << trailing_;
+    }
+  }
+  sum_ = BitsDouble(sum_bits_);
+  ++seen_;
+  return true;
+}
+
+bool MergeColumnarTimeSeries(const std::vector<rocksdb::Slice>& values, std::string* result) {
+  if (values.empty()) {
+    return false;
+  }
+  std::vector<ColumnarTimeSeriesReader> readers(values.size());
+  std::vector<int> heap;
+  heap.reserve(values.size());
+  for (int i = 0; i < values.size(); ++i) {
+    if (!readers[i].Init(values[i]) ||
+        readers[i].start_nanos() != readers[0].start_nanos() ||
+        readers[i].duration_nanos() != readers[0].duration_nanos()) {
+      return false;
+    }
+    if (readers[i].Next()) {
+      heap.push_back(i);
+    } else if (readers[i].Error()) {
+      return false;
+    }
+  }
+
+  // The heap is ordered by offset, and for equal offsets by
+  // descending value index so that the sample from the most recently
+  // merged value is popped first.
+  auto cmp = [&readers](int a, int b) {
+    if (readers[a].offset() != readers[b].offset()) {
+      return readers[a].offset() > readers[b].offset();
+    }
+    return a < b;
+  };
+  std::make_heap(heap.begin(), heap.end(), cmp);
+
+  ColumnarTimeSeriesWriter writer;
+  writer.Reset(readers[0].start_nanos(), readers[0].duration_nanos());
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), cmp);
+    const int i = heap.back();
+    const int32_t offset = readers[i].offset();
+    writer.Add(offset, readers[i].sum());
+
+    // Advance every reader positioned at this offset, discarding the
+    // samples which were overwritten by the winning sample.
+    for (;;) {
+      const int j = heap.back();
+      if (readers[j].Next()) {
+        std::push_heap(heap.begin(), heap.end(), cmp);
+      } else {
+        if (readers[j].Error()) {
+          return false;
+        }
+        heap.pop_back();
+      }
+      if (heap.empty() || readers[heap.front()].offset() != offset) {
+        break;
+      }
+      std::pop_heap(heap.begin(), heap.end(), cmp);
+    }
+  }
+
+  writer.Finish(result);
+  return true;
+}
@@ -0,0 +1,128 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <rocksdb/slice.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The columnar time series encoding is a compact alternative to the
+// repeated InternalTimeSeriesSample protobuf encoding of
+// InternalTimeSeriesData. The samples are always sorted by offset
+// with no duplicate offsets which allows values to be merged with a
+// single streaming k-way merge, without decoding the samples into
+// individual messages. The encoding is:
+//
+//   <start-nanos:varint64><duration-nanos:varint64><count:varint32>
+//   <offsets-len:varint32><offsets><sums>
+//
+// The offsets column holds the first offset, the first delta and all
+// subsequent delta-of-deltas as zig-zag encoded varints. The sums
+// column holds the sample sums as XOR-compressed doubles (as
+// described in the Gorilla paper): the first sum is stored verbatim
+// and each following sum is stored as the XOR with its predecessor,
+// using a single 0 bit when the two are identical.
+//
+// Only the offset and sum of each sample are stored. The deprecated
+// count, max and min fields of InternalTimeSeriesSample cannot be
+// represented.
+
+// ColumnarTimeSeriesWriter builds a columnar time series value. The
+// internal buffers are reused across calls to Reset.
+class ColumnarTimeSeriesWriter {
+ public:
+  ColumnarTimeSeriesWriter();
+
+  // Reset prepares the writer to build a new value.
+  void Reset(int64_t start_nanos, int64_t duration_nanos);
+
+  // Add appends a sample. The offsets must be added in strictly
+  // increasing order. Returns false if they are not.
+  bool Add(int32_t offset, double sum);
+
+  // Finish appends the encoded value to *buf.
+  void Finish(std::string* buf);
+
+ private:
+  void putBits(uint64_t v, int nbits);
+
+ private:
+  int64_t start_nanos_;
+  int64_t duration_nanos_;
+  uint32_t count_;
+  std::string offsets_;
+  int32_t prev_offset_;
+  int64_t prev_delta_;
+  std::string sums_;
+  uint64_t prev_sum_bits_;
+  int prev_leading_;
+  int prev_trailing_;
+  // The number of bits used in the last byte of sums_ (0 means the
+  // last byte is full or sums_ is empty).
+  int bit_pos_;
+};
+
+// ColumnarTimeSeriesReader iterates over the samples of a columnar
+// time series value without allocating.
+class ColumnarTimeSeriesReader {
+ public:
+  ColumnarTimeSeriesReader();
+
+  // Init decodes the header of the value, returning false if it is
+  // malformed.
+  bool Init(const rocksdb::Slice& value);
+
+  int64_t start_nanos() const { return start_nanos_; }
+  int64_t duration_nanos() const { return duration_nanos_; }
+  uint32_t count() const { return count_; }
+
+  // Next decodes the next sample, returning false when there are no
+  // more samples or the value is malformed (see Error).
+  bool Next();
+
+  // Error returns true if the value was found to be malformed.
+  bool Error() const { return error_; }
+
+  int32_t offset() const { return offset_; }
+  double sum() const { return sum_; }
+
+ private:
+  bool getBits(int nbits, uint64_t* v);
+  bool setError();
+
+ private:
+  int64_t start_nanos_;
+  int64_t duration_nanos_;
+  uint32_t count_;
+  uint32_t seen_;
+  rocksdb::Slice offsets_;
+  rocksdb::Slice sums_;
+  int bit_pos_;
+  int32_t offset_;
+  int64_t delta_;
+  double sum_;
+  uint64_t sum_bits_;
+  int leading_;
+  int trailing_;
+  bool error_;
+};
+
+// MergeColumnarTimeSeries merges the columnar time series values
+// (which must have the same start and duration) into a single value
+// appended to *result. When multiple values contain a sample at the
+// same offset, the sample from the later value wins. Returns false
+// if any of the values is malformed or the values are incompatible.
+bool MergeColumnarTimeSeries(const std::vector<rocksdb::Slice>& values, std::string* result);
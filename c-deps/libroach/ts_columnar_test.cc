@@ -0,0 +1,106 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <gtest/gtest.h>
+#include <utility>
+#include "ts_columnar.h"
+
+namespace {
+
+typedef std::vector<std::pair<int32_t, double>> samples;
+
+std::string Encode(int64_t start, int64_t duration, const samples& s) {
+  ColumnarTimeSeriesWriter w;
+  w.Reset(start, duration);
+  for (auto& p : s) {
+    EXPECT_TRUE(w.Add(p.first, p.second));
+  }
+  std::string buf;
+  w.Finish(&buf);
+  return buf;
+}
+
+samples Decode(const std::string& buf) {
+  ColumnarTimeSeriesReader r;
+  EXPECT_TRUE(r.Init(buf));
+  samples s;
+  while (r.Next()) {
+    s.push_back(std::make_pair(r.offset(), r.sum()));
+  }
+  EXPECT_FALSE(r.Error());
+  EXPECT_EQ(r.count(), s.size());
+  return s;
+}
+
+}  // namespace
+
+TEST(Libroach, ColumnarTimeSeriesRoundTrip) {
+  const samples testCases[] = {
+      {},
+      {{0, 1.5}},
+      {{1, 1}, {2, 1}, {3, 1}, {4, 1}},
+      {{-5, -1}, {7, 3.25}, {9, 3.25}, {100, 1e300}, {101, -0.0}, {2000000000, 12345.678}},
+      {{1, 0.1}, {2, 0.2}, {3, 0.30000000000000004}, {5, 0.4}, {8, 1024}, {13, 1023.75}},
+  };
+  for (auto& s : testCases) {
+    const std::string buf = Encode(100, 10, s);
+    ColumnarTimeSeriesReader r;
+    ASSERT_TRUE(r.Init(buf));
+    EXPECT_EQ(100, r.start_nanos());
+    EXPECT_EQ(10, r.duration_nanos());
+    EXPECT_EQ(s, Decode(buf));
+  }
+}
+
+TEST(Libroach, ColumnarTimeSeriesWriterOrdering) {
+  ColumnarTimeSeriesWriter w;
+  w.Reset(0, 1);
+  EXPECT_TRUE(w.Add(2, 1));
+  EXPECT_FALSE(w.Add(2, 1));
+  EXPECT_FALSE(w.Add(1, 1));
+}
+
+TEST(Libroach, ColumnarTimeSeriesTruncated) {
+  const std::string buf = Encode(0, 1, {{1, 1.5}, {2, 2.5}, {5, 7.25}});
+  for (int i = 0; i < buf.size(); ++i) {
+    ColumnarTimeSeriesReader r;
+    if (!r.Init(rocksdb::Slice(buf.data(), i))) {
+      continue;
+    }
+    while (r.Next()) {
+    }
+    EXPECT_TRUE(r.Error()) << i;
+  }
+}
+
+TEST(Libroach, MergeColumnarTimeSeries) {
+  const std::string a = Encode(0, 1, {{1, 1}, {3, 3}, {5, 5}});
+  const std::string b = Encode(0, 1, {{2, 20}, {3, 30}});
+  const std::string c = Encode(0, 1, {{3, 300}, {6, 600}});
+  const std::string d = Encode(0, 1, {});
+
+  std::string result;
+  ASSERT_TRUE(MergeColumnarTimeSeries({a, b, c, d}, &result));
+  EXPECT_EQ(samples({{1, 1}, {2, 20}, {3, 300}, {5, 5}, {6, 600}}), Decode(result));
+
+  // The later value wins.
+  result.clear();
+  ASSERT_TRUE(MergeColumnarTimeSeries({c, b, a}, &result));
+  EXPECT_EQ(samples({{1, 1}, {2, 20}, {3, 3}, {5, 5}, {6, 600}}), Decode(result));
+
+  // Mismatched start timestamps and durations.
+  result.clear();
+  EXPECT_FALSE(MergeColumnarTimeSeries({a, Encode(1, 1, {{1, 1}})}, &result));
+  EXPECT_FALSE(MergeColumnarTimeSeries({a, Encode(0, 2, {{1, 1}})}, &result));
+}
@@ -0,0 +1,115 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// parallelFor is the state shared by the calling thread and the
+// helpers of a ParallelFor call. Helpers which are dequeued after the
+// call has returned find done set and exit without touching fn.
+struct parallelFor {
+  parallelFor(int n, const std::function<void(int)>* fn)
+      : n(n), fn(fn), next(0), active(0), done(false) {}
+
+  // work calls fn for the indexes not yet claimed.
+  void work() {
+    for (int i; (i = next.fetch_add(1)) < n;) {
+      (*fn)(i);
+    }
+  }
+
+  const int n;
+  const std::function<void(int)>* const fn;
+  std::atomic<int> next;
+  std::mutex mu;
+  std::condition_variable cv;
+  int active;
+  bool done;
+};
+
+}  // namespace
+
+WorkerPool::WorkerPool(int num_threads) : stopping_(false) {
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    threads_.emplace_back(&WorkerPool::run, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> l(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+WorkerPool* WorkerPool::Default() {
+  static WorkerPool pool(std::max<int>(1, std::thread::hardware_concurrency()));
+  return &pool;
+}
+
+void WorkerPool::ParallelFor(int n, int parallelism, const std::function<void(int)>& fn) {
+  auto state = std::make_shared<parallelFor>(n, &fn);
+  const int helpers = std::min(std::min(parallelism, n) - 1, NumThreads());
+  if (helpers > 0) {
+    {
+      std::lock_guard<std::mutex> l(mu_);
+      for (int i = 0; i < helpers; ++i) {
+        queue_.push_back([state] {
+          {
+            std::lock_guard<std::mutex> l(state->mu);
+            if (state->done) {
+              return;
+            }
+            state->active++;
+          }
+          state->work();
+          std::lock_guard<std::mutex> l(state->mu);
+          if (--state->active == 0) {
+            state->cv.notify_all();
+          }
+        });
+      }
+    }
+    cv_.notify_all();
+  }
+
+  state->work();
+  std::unique_lock<std::mutex> l(state->mu);
+  state->done = true;
+  state->cv.wait(l, [&state] { return state->active == 0; });
+}
+
+void WorkerPool::run() {
+  std::unique_lock<std::mutex> l(mu_);
+  for (;;) {
+    while (!stopping_ && queue_.empty()) {
+      cv_.wait(l);
+    }
+    if (stopping_) {
+      return;
+    }
+    const std::function<void()> task = std::move(queue_.front());
+    queue_.pop_front();
+    l.unlock();
+    task();
+    l.lock();
+  }
+}
@@ -0,0 +1,54 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// WorkerPool is a fixed set of threads which foreground operations
+// (e.g. MVCCComputeStatsParallel) split their work across, so that
+// such operations do not create and tear down threads on every call.
+class WorkerPool {
+ public:
+  explicit WorkerPool(int num_threads);
+  ~WorkerPool();
+
+  // Default returns the process-wide pool, which has a thread per
+  // core.
+  static WorkerPool* Default();
+
+  // ParallelFor calls fn(i) for each i in [0,n) on up to parallelism
+  // threads, one of which is the calling thread, and returns once all
+  // of the calls have completed. The calling thread performs all of
+  // the calls which the pool's threads, if busy, do not get to, so
+  // ParallelFor never waits for a thread to become free.
+  void ParallelFor(int n, int parallelism, const std::function<void(int)>& fn);
+
+  int NumThreads() const { return int(threads_.size()); }
+
+ private:
+  void run();
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> queue_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+};
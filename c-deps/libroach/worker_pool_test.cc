@@ -0,0 +1,67 @@
+// Copyright 2017 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied.  See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <atomic>
+#include <future>
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+#include "worker_pool.h"
+
+TEST(Libroach, WorkerPoolParallelFor) {
+  WorkerPool pool(3);
+  for (int parallelism : {1, 2, 4, 8}) {
+    std::vector<std::atomic<int>> calls(100);
+    for (auto& c : calls) {
+      c = 0;
+    }
+    std::mutex mu;
+    std::set<std::thread::id> threads;
+    pool.ParallelFor(100, parallelism, [&](int i) {
+      calls[i]++;
+      std::lock_guard<std::mutex> l(mu);
+      threads.insert(std::this_thread::get_id());
+    });
+    for (const auto& c : calls) {
+      EXPECT_EQ(1, c.load());
+    }
+    EXPECT_LE(threads.size(), std::min(parallelism, pool.NumThreads() + 1));
+  }
+}
+
+TEST(Libroach, WorkerPoolBusy) {
+  // ParallelFor completes on the calling thread while every thread of
+  // the pool is blocked.
+  WorkerPool pool(1);
+  std::promise<void> unblock;
+  std::shared_future<void> unblocked(unblock.get_future());
+  std::atomic<int> blocked(0);
+  std::thread t([&] {
+    pool.ParallelFor(2, 2, [&](int i) {
+      blocked++;
+      unblocked.wait();
+    });
+  });
+  while (blocked.load() < 2) {
+    std::this_thread::yield();
+  }
+
+  int sum = 0;
+  pool.ParallelFor(10, 4, [&sum](int i) { sum += i; });
+  EXPECT_EQ(45, sum);
+
+  unblock.set_value();
+  t.join();
+}
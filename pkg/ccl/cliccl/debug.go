@@ -0,0 +1,26 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed as a CockroachDB Enterprise file under the Cockroach Community
+// License (the "License"); you may not use this file except in compliance with
+// the License. You may obtain a copy of the License at
+//
+//     https://github.com/cockroachdb/cockroach/blob/master/licenses/CCL.txt
+
+package cliccl
+
+import (
+	"github.com/cockroachdb/cockroach/pkg/ccl/cliccl/cliflagsccl"
+	"github.com/cockroachdb/cockroach/pkg/cli"
+	"github.com/spf13/cobra"
+)
+
+func init() {
+	// The checkpoint of an encrypted store replayed against by `debug
+	// trace-replay` is encrypted like the store.
+	f := cli.DebugTraceReplayCmd.Flags()
+	cli.VarFlag(f, &storeEncryptionSpecs, cliflagsccl.EnterpriseEncryption)
+	cli.AddPersistentPreRunE(cli.DebugTraceReplayCmd, func(cmd *cobra.Command, _ []string) error {
+		return populateStoreSpecsEncryption()
+	})
+	_ = f.MarkHidden(cliflagsccl.EnterpriseEncryption.Name)
+}
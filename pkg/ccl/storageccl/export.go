@@ -133,69 +133,36 @@ func evalExport(
 		defer exportStore.Close()
 	}
 
-	sst, err := engine.MakeRocksDBSstFileWriter()
-	if err != nil {
-		return result.Result{}, err
-	}
-	defer sst.Close()
-
-	var skipTombstones bool
-	var iterFn func(*engineccl.MVCCIncrementalIterator)
+	var allRevisions bool
 	switch args.MVCCFilter {
 	case roachpb.MVCCFilter_Latest:
-		skipTombstones = true
-		iterFn = (*engineccl.MVCCIncrementalIterator).NextKey
+		allRevisions = false
 	case roachpb.MVCCFilter_All:
-		skipTombstones = false
-		iterFn = (*engineccl.MVCCIncrementalIterator).Next
+		allRevisions = true
 	default:
 		return result.Result{}, errors.Errorf("unknown MVCC filter: %s", args.MVCCFilter)
 	}
 
-	var rows rowCounter
-	// TODO(dan): Move all this iteration into cpp to avoid the cgo calls.
-	// TODO(dan): Consider checking ctx periodically during the MVCCIterate call.
-	iter := engineccl.NewMVCCIncrementalIterator(batch, args.StartTime, h.Timestamp)
-	defer iter.Close()
-	for iter.Seek(engine.MakeMVCCMetadataKey(args.Key)); ; iterFn(iter) {
-		ok, err := iter.Valid()
+	// TODO(dan): Consider checking ctx periodically during the export.
+	sstContents, _, ok, err := engine.ExportToSst(
+		batch, args.Key, args.EndKey, args.StartTime, h.Timestamp, allRevisions, 0, /* targetSize */
+	)
+	if !ok || err != nil {
+		// The C++ export only reports a conflicting intent as a string, so
+		// fall back to the iterator, which returns it as a WriteIntentError
+		// and causes this command to be retried.
+		sstContents, err = exportWithIterator(ctx, batch, args, h.Timestamp, allRevisions)
 		if err != nil {
-			// The error may be a WriteIntentError. In which case, returning it will
-			// cause this command to be retried.
 			return result.Result{}, err
 		}
-		if !ok || iter.UnsafeKey().Key.Compare(args.EndKey) >= 0 {
-			break
-		}
-
-		// Skip tombstone (len=0) records when startTime is zero
-		// (non-incremental) and we're not exporting all versions.
-		if skipTombstones && (args.StartTime == hlc.Timestamp{}) && len(iter.UnsafeValue()) == 0 {
-			iter.NextKey()
-			continue
-		}
-
-		if log.V(3) {
-			v := roachpb.Value{RawBytes: iter.UnsafeValue()}
-			log.Infof(ctx, "Export %s %s", iter.UnsafeKey(), v.PrettyPrint())
-		}
-
-		if err := rows.count(iter.UnsafeKey().Key); err != nil {
-			return result.Result{}, errors.Wrapf(err, "decoding %s", iter.UnsafeKey())
-		}
-		if err := sst.Add(engine.MVCCKeyValue{Key: iter.UnsafeKey(), Value: iter.UnsafeValue()}); err != nil {
-			return result.Result{}, errors.Wrapf(err, "adding key %s", iter.UnsafeKey())
-		}
 	}
 
-	if sst.DataSize == 0 {
-		// Let the defer Close the sstable.
+	if len(sstContents) == 0 {
 		reply.Files = []roachpb.ExportResponse_File{}
 		return result.Result{}, nil
 	}
-	rows.BulkOpSummary.DataSize = sst.DataSize
 
-	sstContents, err := sst.Finish()
+	rows, err := countExportedRows(ctx, sstContents)
 	if err != nil {
 		return result.Result{}, err
 	}
@@ -227,6 +194,89 @@ func evalExport(
 	return result.Result{}, nil
 }
 
+// exportWithIterator is the iterator-based equivalent of
+// engine.ExportToSst, used for readers not backed by RocksDB and to surface
+// conflicting intents as WriteIntentErrors.
+func exportWithIterator(
+	ctx context.Context,
+	batch engine.Reader,
+	args *roachpb.ExportRequest,
+	endTime hlc.Timestamp,
+	allRevisions bool,
+) ([]byte, error) {
+	sst, err := engine.MakeRocksDBSstFileWriter()
+	if err != nil {
+		return nil, err
+	}
+	defer sst.Close()
+
+	iterFn := (*engineccl.MVCCIncrementalIterator).NextKey
+	if allRevisions {
+		iterFn = (*engineccl.MVCCIncrementalIterator).Next
+	}
+
+	iter := engineccl.NewMVCCIncrementalIterator(batch, args.StartTime, endTime)
+	defer iter.Close()
+	for iter.Seek(engine.MakeMVCCMetadataKey(args.Key)); ; iterFn(iter) {
+		ok, err := iter.Valid()
+		if err != nil {
+			// The error may be a WriteIntentError. In which case, returning it will
+			// cause this command to be retried.
+			return nil, err
+		}
+		if !ok || iter.UnsafeKey().Key.Compare(args.EndKey) >= 0 {
+			break
+		}
+
+		// Skip tombstone (len=0) records when startTime is zero
+		// (non-incremental) and we're not exporting all versions.
+		if !allRevisions && (args.StartTime == hlc.Timestamp{}) && len(iter.UnsafeValue()) == 0 {
+			iter.NextKey()
+			continue
+		}
+
+		if err := sst.Add(engine.MVCCKeyValue{Key: iter.UnsafeKey(), Value: iter.UnsafeValue()}); err != nil {
+			return nil, errors.Wrapf(err, "adding key %s", iter.UnsafeKey())
+		}
+	}
+
+	if sst.DataSize == 0 {
+		// Let the defer Close the sstable.
+		return nil, nil
+	}
+	return sst.Finish()
+}
+
+// countExportedRows returns the summary of the keys in an exported sstable.
+func countExportedRows(ctx context.Context, sstContents []byte) (rowCounter, error) {
+	var rows rowCounter
+	iter, err := engineccl.NewMemSSTIterator(sstContents, false)
+	if err != nil {
+		return rows, err
+	}
+	defer iter.Close()
+	for iter.Seek(engine.MVCCKey{}); ; iter.Next() {
+		ok, err := iter.Valid()
+		if err != nil {
+			return rows, err
+		}
+		if !ok {
+			break
+		}
+
+		if log.V(3) {
+			v := roachpb.Value{RawBytes: iter.UnsafeValue()}
+			log.Infof(ctx, "Export %s %s", iter.UnsafeKey(), v.PrettyPrint())
+		}
+
+		if err := rows.count(iter.UnsafeKey().Key); err != nil {
+			return rows, errors.Wrapf(err, "decoding %s", iter.UnsafeKey())
+		}
+		rows.BulkOpSummary.DataSize += int64(len(iter.UnsafeKey().Key)) + int64(len(iter.UnsafeValue()))
+	}
+	return rows, nil
+}
+
 // SHA512ChecksumData returns the SHA512 checksum of data.
 func SHA512ChecksumData(data []byte) ([]byte, error) {
 	h := sha512.New()
@@ -596,6 +596,13 @@ is the prefix for range local keys.`}
 		Description: `Print key and value sizes along with their associated key.`,
 	}
 
+	ReplaySpeed = FlagInfo{
+		Name: "speed",
+		Description: `
+Speed factor at which to replay the trace: 1 replays the calls at the recorded
+pace, larger values replay them faster and 0 replays them as fast as possible.`,
+	}
+
 	Replicated = FlagInfo{
 		Name:        "replicated",
 		Description: "Restrict scan to replicated data.",
@@ -88,6 +88,7 @@ func initCLIDefaults() {
 	debugCtx.inputFile = ""
 	debugCtx.printSystemConfig = false
 	debugCtx.maxResults = 1000
+	debugCtx.replaySpeed = 0
 
 	zoneCtx.zoneConfig = ""
 	zoneCtx.zoneDisableReplication = false
@@ -191,6 +192,7 @@ var debugCtx struct {
 	inputFile         string
 	printSystemConfig bool
 	maxResults        int64
+	replaySpeed       float64
 }
 
 // zoneCtx captures the command-line parameters of the `zone` command.
@@ -78,15 +78,22 @@ func openExistingStore(dir string, stopper *stop.Stopper) (*engine.RocksDB, erro
 	if err != nil {
 		return nil, err
 	}
-	db, err := engine.NewRocksDB(
-		engine.RocksDBConfig{
-			Settings:     serverCfg.Settings,
-			Dir:          dir,
-			MaxOpenFiles: maxOpenFiles,
-			MustExist:    true,
-		},
-		cache,
-	)
+	cfg := engine.RocksDBConfig{
+		Settings:     serverCfg.Settings,
+		Dir:          dir,
+		MaxOpenFiles: maxOpenFiles,
+		MustExist:    true,
+	}
+	// A store matched by a store spec is opened with the spec's
+	// encryption settings, which CCL code populates (see
+	// DebugTraceReplayCmd).
+	for _, spec := range serverCfg.Stores.Specs {
+		if spec.Path == dir {
+			cfg.UseSwitchingEnv = spec.UseSwitchingEnv
+			cfg.ExtraOptions = spec.ExtraOptions
+		}
+	}
+	db, err := engine.NewRocksDB(cfg, cache)
 	if err != nil {
 		return nil, err
 	}
@@ -776,6 +783,64 @@ https://github.com/facebook/rocksdb/wiki/Administration-and-Data-Access-Tool#ldb
 	},
 }
 
+// DebugTraceReplayCmd is exported so that CCL code can add the
+// encryption flag to it.
+var DebugTraceReplayCmd = &cobra.Command{
+	Use:   "trace-replay [directory] [trace-file]",
+	Short: "replay a storage engine trace",
+	Long: `
+Replays a trace of storage engine calls against the checkpoint of the store
+taken when the trace was started and prints the latency distribution of each
+type of call. The checkpoint is opened like the store it was taken from and is
+modified by the replay. A speed of 1 replays the calls at the recorded pace,
+larger values replay them faster and 0 (the default) replays them as fast as
+possible.
+`,
+	RunE: MaybeDecorateGRPCError(runDebugTraceReplay),
+}
+
+func runDebugTraceReplay(cmd *cobra.Command, args []string) error {
+	stopper := stop.NewStopper()
+	defer stopper.Stop(context.Background())
+
+	if len(args) != 2 {
+		return errors.New("two arguments required: dir trace-file")
+	}
+
+	db, err := openExistingStore(args[0], stopper)
+	if err != nil {
+		return err
+	}
+	stats, err := db.ReplayTrace(args[1], debugCtx.replaySpeed)
+	if err != nil {
+		return err
+	}
+
+	fmt.Printf("replayed %d records in %s (%d errors)\n",
+		stats.Records, stats.Elapsed, stats.Errors)
+	fmt.Printf("%-18s %10s %10s %10s %10s %10s\n",
+		"op", "count", "p50(us)", "p95(us)", "p99(us)", "max(us)")
+	for _, op := range []struct {
+		name string
+		h    engine.HistogramSummary
+	}{
+		{"apply_batch_repr", stats.ApplyBatchRepr},
+		{"commit_batch", stats.CommitBatch},
+		{"mvcc_get", stats.MVCCGet},
+		{"mvcc_scan", stats.MVCCScan},
+		{"iter_seek", stats.IterSeek},
+		{"iter_next", stats.IterNext},
+	} {
+		if op.h.Count == 0 {
+			continue
+		}
+		fmt.Printf("%-18s %10d %10.1f %10.1f %10.1f %10.1f\n", op.name, op.h.Count,
+			float64(op.h.P50)/1e3, float64(op.h.P95)/1e3, float64(op.h.P99)/1e3,
+			float64(op.h.Max)/1e3)
+	}
+	return nil
+}
+
 var debugEnvCmd = &cobra.Command{
 	Use:   "env",
 	Short: "output environment settings",
@@ -997,6 +1062,7 @@ var debugCmds = []*cobra.Command{
 	debugGCCmd,
 	debugCheckStoreCmd,
 	debugRocksDBCmd,
+	DebugTraceReplayCmd,
 	debugCompactCmd,
 	debugSSTablesCmd,
 	debugGossipValuesCmd,
@@ -160,6 +160,16 @@ func init() {
 		return setDefaultStderrVerbosity(cmd, log.Severity_INFO)
 	})
 
+	// The checkpoint replayed against by `debug trace-replay` is matched
+	// by a store spec so that CCL code can populate its encryption
+	// settings.
+	AddPersistentPreRunE(DebugTraceReplayCmd, func(cmd *cobra.Command, args []string) error {
+		if len(args) > 0 {
+			serverCfg.Stores = base.StoreSpecList{Specs: []base.StoreSpec{{Path: args[0]}}}
+		}
+		return setDefaultStderrVerbosity(cmd, log.Severity_WARNING)
+	})
+
 	// Map any flags registered in the standard "flag" package into the
 	// top-level cockroach command.
 	pf := cockroachCmd.PersistentFlags()
@@ -382,6 +392,11 @@ func init() {
 		StringFlag(f, &debugCtx.inputFile, cliflags.GossipInputFile, debugCtx.inputFile)
 		BoolFlag(f, &debugCtx.printSystemConfig, cliflags.PrintSystemConfig, debugCtx.printSystemConfig)
 	}
+	{
+		f := DebugTraceReplayCmd.Flags()
+		f.Float64Var(&debugCtx.replaySpeed, cliflags.ReplaySpeed.Name, debugCtx.replaySpeed,
+			cliflags.ReplaySpeed.Usage())
+	}
 }
 
 func extraServerFlagInit() {
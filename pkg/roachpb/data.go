@@ -394,6 +394,22 @@ func (v *Value) SetProto(msg protoutil.Message) error {
 	return nil
 }
 
+// SetColumnarTimeseries encodes the samples of the time series data into the
+// bytes field of the receiver in the columnar encoding (see
+// EncodeColumnarTimeSeries), sets the tag to TIMESERIES_COLUMNAR and clears
+// the checksum. Columnar values can be merged with each other and with
+// TIMESERIES values, the result of which is a columnar value.
+func (v *Value) SetColumnarTimeseries(data InternalTimeSeriesData) error {
+	b, err := EncodeColumnarTimeSeries(data)
+	if err != nil {
+		return err
+	}
+	v.RawBytes = make([]byte, headerSize+len(b))
+	copy(v.RawBytes[headerSize:], b)
+	v.setTag(ValueType_TIMESERIES_COLUMNAR)
+	return nil
+}
+
 // SetTime encodes the specified time value into the bytes field of the
 // receiver, sets the tag and clears the checksum.
 func (v *Value) SetTime(t time.Time) {
@@ -495,12 +511,21 @@ func (v Value) GetInt() (int64, error) {
 
 // GetProto unmarshals the bytes field of the receiver into msg. If
 // unmarshalling fails or the tag is not BYTES, an error will be
-// returned.
+// returned. An InternalTimeSeriesData is decoded from values tagged
+// TIMESERIES or TIMESERIES_COLUMNAR.
 func (v Value) GetProto(msg protoutil.Message) error {
 	expectedTag := ValueType_BYTES
 
 	// Special handling for ts data.
-	if _, ok := msg.(*InternalTimeSeriesData); ok {
+	if ts, ok := msg.(*InternalTimeSeriesData); ok {
+		if v.GetTag() == ValueType_TIMESERIES_COLUMNAR {
+			data, err := DecodeColumnarTimeSeries(v.dataBytes())
+			if err != nil {
+				return err
+			}
+			*ts = data
+			return nil
+		}
 		expectedTag = ValueType_TIMESERIES
 	}
 
@@ -541,7 +566,7 @@ func (v Value) GetDecimal() (apd.Decimal, error) {
 
 // GetTimeseries decodes an InternalTimeSeriesData value from the bytes
 // field of the receiver. An error will be returned if the tag is not
-// TIMESERIES or if decoding fails.
+// TIMESERIES or TIMESERIES_COLUMNAR or if decoding fails.
 func (v Value) GetTimeseries() (InternalTimeSeriesData, error) {
 	ts := InternalTimeSeriesData{}
 	return ts, v.GetProto(&ts)
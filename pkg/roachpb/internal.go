@@ -14,6 +14,15 @@
 
 package roachpb
 
+import (
+	"encoding/binary"
+	"math"
+	"math/bits"
+	"sort"
+
+	"github.com/pkg/errors"
+)
+
 // Summation returns the sum value for this sample.
 func (samp InternalTimeSeriesSample) Summation() float64 {
 	return samp.Sum
@@ -48,3 +57,254 @@ func (samp InternalTimeSeriesSample) Minimum() float64 {
 	}
 	return 0
 }
+
+// The columnar time series encoding is a compact alternative to the
+// repeated InternalTimeSeriesSample encoding of InternalTimeSeriesData,
+// used by values tagged TIMESERIES_COLUMNAR. The samples are sorted by
+// offset with no duplicate offsets, which allows libroach to merge
+// values without decoding them into individual samples. The encoding
+// is:
+//
+//   <start-nanos:uvarint><duration-nanos:uvarint><count:uvarint>
+//   <offsets-len:uvarint><offsets><sums>
+//
+// The offsets column holds the first offset, the first delta and all
+// subsequent delta-of-deltas as zig-zag encoded varints. The sums
+// column holds the sums as XOR-compressed doubles (as described in the
+// Gorilla paper): the first sum is stored verbatim and each following
+// sum as its XOR with its predecessor, using a single 0 bit when the
+// two are identical. See c-deps/libroach/ts_columnar.h, which must be
+// kept in sync.
+//
+// Only the offset and sum of each sample are stored: samples are
+// decoded with a count of 1, and samples using the deprecated count,
+// max and min fields cannot be encoded.
+
+// columnarMaxLeadingZeros is the largest leading zero count which can
+// be stored (in 5 bits).
+const columnarMaxLeadingZeros = 31
+
+// columnarBitWriter appends bits to a byte slice, most significant bit
+// first.
+type columnarBitWriter struct {
+	buf []byte
+	// The number of bits used in the last byte of buf (0 if it is full).
+	pos uint
+}
+
+func (w *columnarBitWriter) put(v uint64, nbits uint) {
+	for nbits > 0 {
+		if w.pos == 0 {
+			w.buf = append(w.buf, 0)
+		}
+		avail := 8 - w.pos
+		n := nbits
+		if n > avail {
+			n = avail
+		}
+		chunk := (v >> (nbits - n)) & (uint64(1)<<n - 1)
+		w.buf[len(w.buf)-1] |= byte(chunk << (avail - n))
+		w.pos = (w.pos + n) % 8
+		nbits -= n
+	}
+}
+
+// columnarBitReader reads the bits written by columnarBitWriter.
+type columnarBitReader struct {
+	buf []byte
+	pos uint
+}
+
+func (r *columnarBitReader) get(nbits uint) (uint64, bool) {
+	var v uint64
+	for nbits > 0 {
+		if len(r.buf) == 0 {
+			return 0, false
+		}
+		avail := 8 - r.pos
+		n := nbits
+		if n > avail {
+			n = avail
+		}
+		v = v<<n | (uint64(r.buf[0])>>(avail-n))&(uint64(1)<<n-1)
+		r.pos += n
+		nbits -= n
+		if r.pos == 8 {
+			r.pos = 0
+			r.buf = r.buf[1:]
+		}
+	}
+	return v, true
+}
+
+func zigZagEncode(v int64) uint64 {
+	return uint64(v<<1) ^ uint64(v>>63)
+}
+
+func zigZagDecode(v uint64) int64 {
+	return int64(v>>1) ^ -int64(v&1)
+}
+
+// EncodeColumnarTimeSeries returns the samples of data in the columnar
+// time series encoding. The samples need not be sorted; when several
+// samples share an offset the last one wins, as it does when time
+// series values are merged.
+func EncodeColumnarTimeSeries(data InternalTimeSeriesData) ([]byte, error) {
+	samples := make([]InternalTimeSeriesSample, len(data.Samples))
+	copy(samples, data.Samples)
+	sort.SliceStable(samples, func(i, j int) bool {
+		return samples[i].Offset < samples[j].Offset
+	})
+
+	var offsets []byte
+	var sums columnarBitWriter
+	var buf [binary.MaxVarintLen64]byte
+	var count uint64
+	var prevOffset int32
+	var prevDelta int64
+	var prevBits uint64
+	prevLeading, prevTrailing := -1, 0
+	for i, sample := range samples {
+		if sample.Count > 1 || sample.Max != nil || sample.Min != nil {
+			return nil, errors.Errorf(
+				"cannot encode time series sample with deprecated fields: %+v", sample)
+		}
+		if i+1 < len(samples) && samples[i+1].Offset == sample.Offset {
+			continue
+		}
+
+		var v uint64
+		switch count {
+		case 0:
+			v = zigZagEncode(int64(sample.Offset))
+		case 1:
+			prevDelta = int64(sample.Offset) - int64(prevOffset)
+			v = zigZagEncode(prevDelta)
+		default:
+			delta := int64(sample.Offset) - int64(prevOffset)
+			v = zigZagEncode(delta - prevDelta)
+			prevDelta = delta
+		}
+		offsets = append(offsets, buf[:binary.PutUvarint(buf[:], v)]...)
+		prevOffset = sample.Offset
+
+		sumBits := math.Float64bits(sample.Sum)
+		if count == 0 {
+			sums.put(sumBits, 64)
+		} else if x := sumBits ^ prevBits; x == 0 {
+			sums.put(0, 1)
+		} else {
+			leading := bits.LeadingZeros64(x)
+			if leading > columnarMaxLeadingZeros {
+				leading = columnarMaxLeadingZeros
+			}
+			trailing := bits.TrailingZeros64(x)
+			if prevLeading >= 0 && leading >= prevLeading && trailing >= prevTrailing {
+				// The meaningful bits fit within the previous window.
+				sums.put(0x2, 2)
+				sums.put(x>>uint(prevTrailing), uint(64-prevLeading-prevTrailing))
+			} else {
+				meaningful := 64 - leading - trailing
+				sums.put(0x3, 2)
+				sums.put(uint64(leading), 5)
+				sums.put(uint64(meaningful-1), 6)
+				sums.put(x>>uint(trailing), uint(meaningful))
+				prevLeading, prevTrailing = leading, trailing
+			}
+		}
+		prevBits = sumBits
+		count++
+	}
+
+	result := make([]byte, 0, 4*binary.MaxVarintLen64+len(offsets)+len(sums.buf))
+	for _, v := range []uint64{
+		uint64(data.StartTimestampNanos), uint64(data.SampleDurationNanos), count, uint64(len(offsets)),
+	} {
+		result = append(result, buf[:binary.PutUvarint(buf[:], v)]...)
+	}
+	result = append(result, offsets...)
+	return append(result, sums.buf...), nil
+}
+
+// DecodeColumnarTimeSeries decodes a value encoded by
+// EncodeColumnarTimeSeries. Every decoded sample has a count of 1.
+func DecodeColumnarTimeSeries(b []byte) (InternalTimeSeriesData, error) {
+	var header [4]uint64
+	for i := range header {
+		v, n := binary.Uvarint(b)
+		if n <= 0 {
+			return InternalTimeSeriesData{}, errors.New("malformed columnar time series header")
+		}
+		header[i] = v
+		b = b[n:]
+	}
+	count, offsetsLen := header[2], header[3]
+	if offsetsLen > uint64(len(b)) || count > uint64(len(b))*8 {
+		return InternalTimeSeriesData{}, errors.New("malformed columnar time series header")
+	}
+	data := InternalTimeSeriesData{
+		StartTimestampNanos: int64(header[0]),
+		SampleDurationNanos: int64(header[1]),
+		Samples:             make([]InternalTimeSeriesSample, 0, count),
+	}
+	offsets := b[:offsetsLen]
+	sums := columnarBitReader{buf: b[offsetsLen:]}
+
+	var offset, delta int64
+	var sumBits uint64
+	leading, trailing := -1, 0
+	for i := uint64(0); i < count; i++ {
+		v, n := binary.Uvarint(offsets)
+		if n <= 0 {
+			return InternalTimeSeriesData{}, errors.New("malformed columnar time series offsets")
+		}
+		offsets = offsets[n:]
+		switch d := zigZagDecode(v); i {
+		case 0:
+			offset = d
+		case 1:
+			delta = d
+			offset += delta
+		default:
+			delta += d
+			offset += delta
+		}
+		if offset < math.MinInt32 || offset > math.MaxInt32 || (i > 0 && delta <= 0) {
+			return InternalTimeSeriesData{}, errors.New("malformed columnar time series offsets")
+		}
+
+		ok := true
+		if i == 0 {
+			sumBits, ok = sums.get(64)
+		} else if control, ok1 := sums.get(1); !ok1 {
+			ok = false
+		} else if control != 0 {
+			if control, ok = sums.get(1); ok && control != 0 {
+				var l, m uint64
+				l, ok = sums.get(5)
+				if ok {
+					m, ok = sums.get(6)
+				}
+				leading = int(l)
+				trailing = 64 - leading - int(m+1)
+				ok = ok && trailing >= 0
+			} else if leading < 0 {
+				ok = false
+			}
+			if ok {
+				var x uint64
+				x, ok = sums.get(uint(64 - leading - trailing))
+				sumBits ^= x << uint(trailing)
+			}
+		}
+		if !ok {
+			return InternalTimeSeriesData{}, errors.New("malformed columnar time series sums")
+		}
+		data.Samples = append(data.Samples, InternalTimeSeriesSample{
+			Offset: int32(offset),
+			Sum:    math.Float64frombits(sumBits),
+			Count:  1,
+		})
+	}
+	return data, nil
+}
@@ -0,0 +1,120 @@
+// Copyright 2018 The Cockroach Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+package roachpb
+
+import (
+	"math"
+	"reflect"
+	"testing"
+)
+
+func tsSamples(offsetSums ...float64) []InternalTimeSeriesSample {
+	var samples []InternalTimeSeriesSample
+	for i := 0; i < len(offsetSums); i += 2 {
+		samples = append(samples, InternalTimeSeriesSample{
+			Offset: int32(offsetSums[i]),
+			Sum:    offsetSums[i+1],
+			Count:  1,
+		})
+	}
+	return samples
+}
+
+func TestColumnarTimeSeriesRoundTrip(t *testing.T) {
+	testCases := []struct {
+		input    []InternalTimeSeriesSample
+		expected []InternalTimeSeriesSample
+	}{
+		{nil, nil},
+		{tsSamples(0, 1.5), tsSamples(0, 1.5)},
+		{tsSamples(0, 1, 1, 1, 2, 1, 3, 2), tsSamples(0, 1, 1, 1, 2, 1, 3, 2)},
+		// Irregular offsets and values which share no bits.
+		{tsSamples(5, -1e300, 17, 0, 18, math.Inf(1), 1000, 3.25), tsSamples(5, -1e300, 17, 0, 18, math.Inf(1), 1000, 3.25)},
+		// Unsorted input is sorted, and the last sample for an offset wins.
+		{tsSamples(3, 30, 1, 10, 3, 31, 2, 20), tsSamples(1, 10, 2, 20, 3, 31)},
+	}
+	for i, c := range testCases {
+		data := InternalTimeSeriesData{
+			StartTimestampNanos: 1000,
+			SampleDurationNanos: 10,
+			Samples:             c.input,
+		}
+		b, err := EncodeColumnarTimeSeries(data)
+		if err != nil {
+			t.Fatalf("%d: %s", i, err)
+		}
+		decoded, err := DecodeColumnarTimeSeries(b)
+		if err != nil {
+			t.Fatalf("%d: %s", i, err)
+		}
+		if decoded.StartTimestampNanos != data.StartTimestampNanos ||
+			decoded.SampleDurationNanos != data.SampleDurationNanos {
+			t.Errorf("%d: expected start %d and duration %d, got %d and %d", i,
+				data.StartTimestampNanos, data.SampleDurationNanos,
+				decoded.StartTimestampNanos, decoded.SampleDurationNanos)
+		}
+		if len(decoded.Samples) != len(c.expected) ||
+			(len(c.expected) > 0 && !reflect.DeepEqual(decoded.Samples, c.expected)) {
+			t.Errorf("%d: expected samples %v, got %v", i, c.expected, decoded.Samples)
+		}
+		// Every strict prefix of the encoding is rejected.
+		for j := 0; j < len(b); j++ {
+			if _, err := DecodeColumnarTimeSeries(b[:j]); err == nil {
+				t.Errorf("%d: expected error decoding %d of %d bytes", i, j, len(b))
+			}
+		}
+	}
+}
+
+func TestColumnarTimeSeriesDeprecatedFields(t *testing.T) {
+	max := 1.0
+	for i, sample := range []InternalTimeSeriesSample{
+		{Offset: 1, Sum: 1, Count: 2},
+		{Offset: 1, Sum: 1, Count: 1, Max: &max},
+		{Offset: 1, Sum: 1, Count: 1, Min: &max},
+	} {
+		data := InternalTimeSeriesData{Samples: []InternalTimeSeriesSample{sample}}
+		if _, err := EncodeColumnarTimeSeries(data); err == nil {
+			t.Errorf("%d: expected error encoding %v", i, sample)
+		}
+	}
+}
+
+func TestValueColumnarTimeseries(t *testing.T) {
+	data := InternalTimeSeriesData{
+		StartTimestampNanos: 1000,
+		SampleDurationNanos: 10,
+		Samples:             tsSamples(0, 1, 4, 2.5),
+	}
+	var v Value
+	if err := v.SetColumnarTimeseries(data); err != nil {
+		t.Fatal(err)
+	}
+	if tag := v.GetTag(); tag != ValueType_TIMESERIES_COLUMNAR {
+		t.Fatalf("expected tag %s, got %s", ValueType_TIMESERIES_COLUMNAR, tag)
+	}
+	decoded, err := v.GetTimeseries()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !reflect.DeepEqual(decoded, data) {
+		t.Errorf("expected %v, got %v", data, decoded)
+	}
+	var bytesValue Value
+	bytesValue.SetBytes(v.RawBytes)
+	if _, err := bytesValue.GetTimeseries(); err == nil {
+		t.Error("expected error decoding a BYTES value as time series")
+	}
+}
@@ -496,6 +496,7 @@ func (cfg *Config) CreateEngines(ctx context.Context) (Engines, error) {
 
 			details = append(details, fmt.Sprintf("store %d: RocksDB, max size %s, max open file limit %d",
 				i, humanizeutil.IBytes(sizeInBytes), openFileLimitPerStore))
+			detailedTimers := envutil.EnvOrDefaultBool("COCKROACH_ROCKSDB_DETAILED_TIMERS", false)
 			rocksDBConfig := engine.RocksDBConfig{
 				Attrs:                   spec.Attributes,
 				Dir:                     spec.Path,
@@ -505,6 +506,7 @@ func (cfg *Config) CreateEngines(ctx context.Context) (Engines, error) {
 				Settings:                cfg.Settings,
 				UseSwitchingEnv:         spec.UseSwitchingEnv,
 				ExtraOptions:            spec.ExtraOptions,
+				DetailedTimers:          detailedTimers,
 			}
 
 			eng, err := engine.NewRocksDB(rocksDBConfig, cache)
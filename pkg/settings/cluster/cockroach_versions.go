@@ -42,6 +42,7 @@ const (
 	VersionLeaseSequence
 	VersionUnreplicatedTombstoneKey
 	VersionRecomputeStats
+	VersionColumnarTimeSeries
 
 	// Add new versions here (step one of two).
 
@@ -152,6 +153,12 @@ var versionsSingleton = keyedVersions([]keyedVersion{
 		Key:     VersionRecomputeStats,
 		Version: roachpb.Version{Major: 1, Minor: 1, Unstable: 10},
 	},
+	{
+		// VersionColumnarTimeSeries enables writing time series data in the
+		// columnar encoding (roachpb.ValueType_TIMESERIES_COLUMNAR).
+		Key:     VersionColumnarTimeSeries,
+		Version: roachpb.Version{Major: 1, Minor: 1, Unstable: 11},
+	},
 
 	// Add new versions here (step two of two).
 
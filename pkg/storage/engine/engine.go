@@ -101,17 +101,17 @@ type Iterator interface {
 	//
 	// TODO: remove allowMeta2Splits in version 1.3.
 	FindSplitKey(start, end, minSplitKey MVCCKey, targetSize int64, allowMeta2Splits bool) (MVCCKey, error)
-	// MVCCGet retrieves the value for the key at the specified timestamp. The
-	// value is returned in batch repr format with the key being present as the
-	// empty string. If an intent exists at the specified key, it will be
-	// returned in batch repr format in the separate intent return value.
+	// MVCCGet retrieves the value for the key at the specified timestamp. If an
+	// intent exists at the specified key, it will be returned in the separate
+	// intent return value.
 	MVCCGet(key roachpb.Key, timestamp hlc.Timestamp,
 		txn *roachpb.Transaction, consistent bool,
 	) (*roachpb.Value, []roachpb.Intent, error)
 	// MVCCScan scans the underlying engine from start to end keys and returns
 	// key/value pairs which have a timestamp less than or equal to the supplied
-	// timestamp, up to a max rows. The key/value pairs are returned in the batch
-	// repr format and can be iterated over using RocksDBBatchReader.
+	// timestamp, up to a max rows. The key/value pairs and intents are returned
+	// in the scan results format (see c-deps/libroach/scan_results.h) and can
+	// be iterated over using mvccScanDecodeKeyValue.
 	MVCCScan(start, end roachpb.Key, max int64, timestamp hlc.Timestamp,
 		txn *roachpb.Transaction, consistent, reverse bool,
 	) (kvs []byte, intents []byte, err error)
@@ -308,6 +308,27 @@ type Stats struct {
 	Compactions                    int64
 	TableReadersMemEstimate        int64
 	PendingCompactionBytesEstimate int64
+	PersistentCacheHits            int64
+	PersistentCacheMisses          int64
+	PersistentCacheUsage           int64
+	WriteStalls                    int64
+	WriteStops                     int64
+	WriteStallNanos                int64
+	FlushBytes                     int64
+	L0FileCount                    int64
+	CompactionInputBytes           int64
+	CompactionOutputBytes          int64
+	SSTRawBytes                    int64
+	SSTDataBytes                   int64
+	BlockDecompressions            int64
+	DecompressionNanos             int64
+	BlobFileCount                  int64
+	BlobFileBytes                  int64
+	BlobRelocatedBytes             int64
+	RateLimitBytesPerSec           int64
+	RateLimitThrottledNanos        int64
+	ReadaheadBytes                 int64
+	ReadaheadHitBytes              int64
 }
 
 // PutProto sets the given key to the protobuf-serialized byte string
@@ -17,6 +17,7 @@ package engine
 import (
 	"bytes"
 	"context"
+	"encoding/binary"
 	"fmt"
 	"math"
 	"sync"
@@ -721,6 +722,9 @@ func MVCCGet(
 		return mvccGetUsingIter(ctx, iter, key, timestamp, consistent, txn)
 	}
 
+	if getter, ok := engine.(mvccGetter); ok {
+		return getter.mvccGet(key, timestamp, txn, consistent)
+	}
 	iter := engine.NewIterator(true)
 	value, intents, err := iter.MVCCGet(key, timestamp, txn, consistent)
 	iter.Close()
@@ -1844,24 +1848,65 @@ func mvccScanInternal(
 	return kvs, resumeSpan, intents, err
 }
 
+const (
+	// mvccScanHeaderSize is the size of the count prefix of the scan results
+	// returned by C.MVCCScan and C.MVCCGet.
+	mvccScanHeaderSize = 4
+	// mvccScanEntryHeaderSize is the size of the fixed-width key and value
+	// length prefix of each entry in the scan results.
+	mvccScanEntryHeaderSize = 8
+)
+
+// mvccScanDecodeHeader decodes the header of the scan results returned by
+// C.MVCCScan and C.MVCCGet, returning both the count of the entries and the
+// suffix of data containing the entries. See
+// c-deps/libroach/scan_results.h for a description of the format.
+func mvccScanDecodeHeader(repr []byte) (count int, orepr []byte, err error) {
+	if len(repr) < mvccScanHeaderSize {
+		return 0, nil, errors.Errorf("scan results too small: %d < %d", len(repr), mvccScanHeaderSize)
+	}
+	count = int(binary.LittleEndian.Uint32(repr))
+	return count, repr[mvccScanHeaderSize:], nil
+}
+
+// mvccScanDecodeKeyValue decodes a key/value pair from the scan results
+// returned by C.MVCCScan and C.MVCCGet, returning both the key/value and the
+// suffix of data remaining in the results.
+func mvccScanDecodeKeyValue(repr []byte) (key MVCCKey, value []byte, orepr []byte, err error) {
+	if len(repr) < mvccScanEntryHeaderSize {
+		return key, nil, repr, errors.Errorf("unexpected scan results EOF")
+	}
+	keySize := int(binary.LittleEndian.Uint32(repr))
+	valSize := int(binary.LittleEndian.Uint32(repr[4:]))
+	repr = repr[mvccScanEntryHeaderSize:]
+	if keySize+valSize > len(repr) {
+		return key, nil, repr, errors.Errorf("malformed scan results, expected %d bytes, but only %d remaining",
+			keySize+valSize, len(repr))
+	}
+	key, err = DecodeKey(repr[:keySize])
+	return key, repr[keySize : keySize+valSize], repr[keySize+valSize:], err
+}
+
 func buildScanIntents(data []byte) ([]roachpb.Intent, error) {
 	if len(data) == 0 {
 		return nil, nil
 	}
 
-	reader, err := NewRocksDBBatchReader(data)
+	count, data, err := mvccScanDecodeHeader(data)
 	if err != nil {
 		return nil, err
 	}
 
-	intents := make([]roachpb.Intent, 0, reader.Count())
+	intents := make([]roachpb.Intent, 0, count)
 	var meta enginepb.MVCCMetadata
-	for reader.Next() {
-		key, err := reader.MVCCKey()
+	for i := 0; i < count; i++ {
+		var key MVCCKey
+		var value []byte
+		key, value, data, err = mvccScanDecodeKeyValue(data)
 		if err != nil {
 			return nil, err
 		}
-		if err := protoutil.Unmarshal(reader.Value(), &meta); err != nil {
+		if err := protoutil.Unmarshal(value, &meta); err != nil {
 			return nil, err
 		}
 		intents = append(intents, roachpb.Intent{
@@ -1870,10 +1915,6 @@ func buildScanIntents(data []byte) ([]roachpb.Intent, error) {
 			Txn:    *meta.Txn,
 		})
 	}
-
-	if err := reader.Error(); err != nil {
-		return nil, err
-	}
 	return intents, nil
 }
 
@@ -1891,11 +1932,9 @@ func buildScanResults(
 		return nil, nil, intents, nil
 	}
 
-	// Loop over the kvData (which is in RocksDB batch repr format), creating a
-	// slice of roachpb.KeyValue. This code would be slightly more compact using
-	// RocksDBBatchReader, but there is a measurable performance benefit to
-	// avoiding the associated allocation for small (1 row) scans.
-	count, kvData, err := rocksDBBatchDecodeHeader(kvData)
+	// Loop over the kvData (which is in the scan results format described in
+	// c-deps/libroach/scan_results.h), creating a slice of roachpb.KeyValue.
+	count, kvData, err := mvccScanDecodeHeader(kvData)
 	if err != nil {
 		return nil, nil, nil, err
 	}
@@ -1918,7 +1957,7 @@ func buildScanResults(
 	var key MVCCKey
 	var rawBytes []byte
 	for i := range kvs {
-		key, rawBytes, kvData, err = rocksDBBatchDecodeValue(kvData)
+		key, rawBytes, kvData, err = mvccScanDecodeKeyValue(kvData)
 		if err != nil {
 			return nil, nil, nil, err
 		}
@@ -1929,7 +1968,7 @@ func buildScanResults(
 
 	var resumeKey roachpb.Key
 	if count > int(max) {
-		key, _, _, err = rocksDBBatchDecodeValue(kvData)
+		key, _, _, err = mvccScanDecodeKeyValue(kvData)
 		if err != nil {
 			return nil, nil, nil, err
 		}
@@ -18,6 +18,7 @@ import (
 	"bytes"
 	"context"
 	"fmt"
+	"io"
 	"io/ioutil"
 	"math"
 	"os"
@@ -54,6 +55,8 @@ import (
 // #cgo LDFLAGS: -lprotobuf
 // #cgo LDFLAGS: -lrocksdb
 // #cgo LDFLAGS: -lsnappy
+// #cgo LDFLAGS: -lzstd
+// #cgo LDFLAGS: -llz4
 // #cgo linux LDFLAGS: -lrt -lpthread
 // #cgo windows LDFLAGS: -lrpcrt4
 //
@@ -67,6 +70,12 @@ var minWALSyncInterval = settings.RegisterDurationSetting(
 	0*time.Millisecond,
 )
 
+var groupedCommitEnabled = settings.RegisterBoolSetting(
+	"rocksdb.grouped_commit.enabled",
+	"if enabled, synchronous batch commits are combined into a single WAL write and sync by a commit thread in RocksDB",
+	false,
+)
+
 //export rocksDBLog
 func rocksDBLog(s *C.char, n C.int) {
 	// Note that rocksdb logging is only enabled if log.V(3) is true
@@ -397,6 +406,42 @@ func NewRocksDBCache(cacheSize int64) RocksDBCache {
 	return RocksDBCache{cache: C.DBNewCache(C.uint64_t(cacheSize))}
 }
 
+// NewRocksDBCacheWithOptions is like NewRocksDBCache, but the cache is split
+// into 2^numShardBits shards (16 if numShardBits is zero). If
+// highPriPoolRatio is positive, the index and filter blocks of the engines
+// using the cache are stored in it and given that fraction of its capacity,
+// rather than being held in memory for as long as their sstable is open.
+func NewRocksDBCacheWithOptions(
+	cacheSize int64, numShardBits int, highPriPoolRatio float64,
+) (RocksDBCache, error) {
+	var cache *C.DBCache
+	status := C.DBNewCacheWithOptions(&cache, C.uint64_t(cacheSize), C.DBCacheOptions{
+		num_shard_bits:      C.int(numShardBits),
+		high_pri_pool_ratio: C.double(highPriPoolRatio),
+	})
+	if err := statusToError(status); err != nil {
+		return RocksDBCache{}, errors.Wrap(err, "could not create cache")
+	}
+	return RocksDBCache{cache: cache}, nil
+}
+
+// NewRocksDBTieredCache creates a new cache of the specified size backed by
+// a persistent cache of persistentSize bytes stored in persistentDir,
+// typically on a local SSD. Blocks evicted from the in-memory cache are
+// retained by the persistent tier. As with NewRocksDBCache, Release() should
+// be called after having used the cache.
+func NewRocksDBTieredCache(
+	cacheSize int64, persistentDir string, persistentSize int64,
+) (RocksDBCache, error) {
+	var cache *C.DBCache
+	status := C.DBNewTieredCache(&cache, C.uint64_t(cacheSize),
+		goToCSlice([]byte(persistentDir)), C.uint64_t(persistentSize))
+	if err := statusToError(status); err != nil {
+		return RocksDBCache{}, errors.Wrap(err, "could not create tiered cache")
+	}
+	return RocksDBCache{cache: cache}, nil
+}
+
 func (c RocksDBCache) ref() RocksDBCache {
 	if c.cache != nil {
 		c.cache = C.DBRefCache(c.cache)
@@ -413,6 +458,65 @@ func (c RocksDBCache) Release() {
 	}
 }
 
+// RocksDBScheduler is a wrapper around C.DBScheduler, which runs the flushes
+// and compactions of the RocksDB engines it is shared by.
+type RocksDBScheduler struct {
+	scheduler *C.DBScheduler
+}
+
+// NewRocksDBScheduler creates a scheduler running the flushes and compactions
+// of the engines using it (see RocksDBConfig.Scheduler) on numThreads
+// threads. Flushes run before compactions, and at most numThreads-1
+// compactions run at once (if numThreads > 1). If bytesPerSec is positive, it
+// bounds the total rate at which the flushes and compactions write. Release()
+// should be called after having used the scheduler.
+func NewRocksDBScheduler(numThreads int, bytesPerSec int64) (RocksDBScheduler, error) {
+	var scheduler *C.DBScheduler
+	status := C.DBNewScheduler(&scheduler, C.DBSchedulerOptions{
+		num_threads:   C.int(numThreads),
+		bytes_per_sec: C.int64_t(bytesPerSec),
+	})
+	if err := statusToError(status); err != nil {
+		return RocksDBScheduler{}, errors.Wrap(err, "could not create scheduler")
+	}
+	return RocksDBScheduler{scheduler: scheduler}, nil
+}
+
+// Release releases the scheduler. Note that the scheduler will continue to be
+// used until all of the RocksDB engines it was passed to have been closed.
+func (s RocksDBScheduler) Release() {
+	if s.scheduler != nil {
+		C.DBReleaseScheduler(s.scheduler)
+	}
+}
+
+// RocksDBSchedulerStats contains the number of flushes and compactions a
+// RocksDBScheduler has run, is running and has queued.
+type RocksDBSchedulerStats struct {
+	Flushes            int64
+	Compactions        int64
+	RunningFlushes     int64
+	RunningCompactions int64
+	QueuedFlushes      int64
+	QueuedCompactions  int64
+}
+
+// GetStats retrieves the statistics of the scheduler.
+func (s RocksDBScheduler) GetStats() (RocksDBSchedulerStats, error) {
+	var stats C.DBSchedulerStats
+	if err := statusToError(C.DBGetSchedulerStats(s.scheduler, &stats)); err != nil {
+		return RocksDBSchedulerStats{}, err
+	}
+	return RocksDBSchedulerStats{
+		Flushes:            int64(stats.flushes),
+		Compactions:        int64(stats.compactions),
+		RunningFlushes:     int64(stats.running_flushes),
+		RunningCompactions: int64(stats.running_compactions),
+		QueuedFlushes:      int64(stats.queued_flushes),
+		QueuedCompactions:  int64(stats.queued_compactions),
+	}, nil
+}
+
 // RocksDBConfig holds all configuration parameters and knobs used in setting
 // up a new RocksDB instance.
 type RocksDBConfig struct {
@@ -442,6 +546,20 @@ type RocksDBConfig struct {
 	// ExtraOptions is a serialized protobuf set by Go CCL code and passed through
 	// to C CCL code.
 	ExtraOptions []byte
+	// FastOpen reduces the work done before the instance can serve requests:
+	// the sstables are opened on more threads and their statistics are not
+	// loaded at startup.
+	FastOpen bool
+	// Scheduler, if set, runs the flushes and compactions of the instance,
+	// along with those of the other instances it is shared by.
+	Scheduler RocksDBScheduler
+	// ReadThreads is the number of threads executing the reads submitted with
+	// SubmitReads. Zero disables SubmitReads.
+	ReadThreads int
+	// DetailedTimers enables the statistics which time individual operations
+	// such as block decompression, at the cost of reading the clock around
+	// each of them.
+	DetailedTimers bool
 }
 
 // RocksDB is a wrapper around a RocksDB database instance.
@@ -592,10 +710,21 @@ func (r *RocksDB) open() error {
 			use_switching_env: C.bool(newVersion == versionCurrent),
 			must_exist:        C.bool(r.cfg.MustExist),
 			extra_options:     goToCSlice(r.cfg.ExtraOptions),
+			fast_open:         C.bool(r.cfg.FastOpen),
+			scheduler:         r.cfg.Scheduler.scheduler,
+			read_threads:      C.int(r.cfg.ReadThreads),
+			detailed_timers:   C.bool(r.cfg.DetailedTimers),
 		})
 	if err := statusToError(status); err != nil {
 		return errors.Wrap(err, "could not open rocksdb instance")
 	}
+	if len(r.cfg.Dir) != 0 {
+		if s, err := r.GetOpenStats(); err == nil {
+			log.Infof(context.TODO(), "opened rocksdb instance at %q in %s: manifest %s, "+
+				"%d tables %s, %d WAL files %s", r.cfg.Dir, s.Total, s.Manifest,
+				s.TablesOpened, s.TableOpen, s.WALFiles, s.WALReplay)
+		}
+	}
 
 	// Update or add the version file if needed and if on-disk.
 	if len(r.cfg.Dir) != 0 && existingVersion < newVersion {
@@ -861,6 +990,252 @@ func (r *RocksDB) ApproximateDiskBytes(from, to roachpb.Key) (uint64, error) {
 	return uint64(result), err
 }
 
+// StartTrace starts recording the reads and writes made on the engine
+// into a new trace file at path. The trace is written through the
+// engine's env, so it is encrypted on encrypted stores. If
+// checkpointDir is not empty, a checkpoint of the engine as of the
+// start of the trace is created in it, which the trace can be replayed
+// against with ReplayTrace.
+func (r *RocksDB) StartTrace(path, checkpointDir string) error {
+	return statusToError(C.DBStartTrace(r.rdb, goToCSlice([]byte(path)),
+		goToCSlice([]byte(checkpointDir))))
+}
+
+// StopTrace stops recording the trace started by StartTrace.
+func (r *RocksDB) StopTrace() error {
+	return statusToError(C.DBStopTrace(r.rdb))
+}
+
+// TraceReplayStats contains the number of calls replayed by
+// ReplayTrace, how many of them failed, and the distribution of the
+// latency (in nanoseconds) of each type of call.
+type TraceReplayStats struct {
+	Records, Errors int64
+	Elapsed         time.Duration
+	ApplyBatchRepr  HistogramSummary
+	CommitBatch     HistogramSummary
+	MVCCGet         HistogramSummary
+	MVCCScan        HistogramSummary
+	IterSeek        HistogramSummary
+	IterNext        HistogramSummary
+}
+
+// ReplayTrace re-executes the calls recorded in the trace file at path
+// against the engine, which is modified by the replay. The engine is
+// expected to be the checkpoint created by StartTrace, opened with the
+// configuration (including the encryption settings) of the traced
+// store. With a speed > 0 the calls are issued at the recorded pace
+// accelerated by the speed factor; otherwise they are issued as fast
+// as possible.
+func (r *RocksDB) ReplayTrace(path string, speed float64) (TraceReplayStats, error) {
+	var s C.DBTraceReplayStats
+	err := statusToError(C.DBReplayTrace(r.rdb, goToCSlice([]byte(path)), C.double(speed), &s))
+	return TraceReplayStats{
+		Records:        int64(s.records),
+		Errors:         int64(s.errors),
+		Elapsed:        time.Duration(s.elapsed_nanos),
+		ApplyBatchRepr: cHistogramToGo(s.apply_batch_repr),
+		CommitBatch:    cHistogramToGo(s.commit_batch),
+		MVCCGet:        cHistogramToGo(s.mvcc_get),
+		MVCCScan:       cHistogramToGo(s.mvcc_scan),
+		IterSeek:       cHistogramToGo(s.iter_seek),
+		IterNext:       cHistogramToGo(s.iter_next),
+	}, err
+}
+
+// RocksDBReadRequest is a read submitted with SubmitReads. If EndKey is empty
+// it is an MVCCGet of Key, otherwise an MVCCScan of [Key, EndKey). Tag is
+// returned with the result to identify the read.
+type RocksDBReadRequest struct {
+	Tag         uint64
+	Key, EndKey roachpb.Key
+	Timestamp   hlc.Timestamp
+	MaxKeys     int64
+	Txn         *roachpb.Transaction
+	Consistent  bool
+	Reverse     bool
+}
+
+// RocksDBReadResult is the result of a RocksDBReadRequest. KVs and Intents
+// are encoded as the results of rocksDBIterator.MVCCScan. ResumeKey is set
+// if a scan stopped at its MaxKeys (see DBScanResults.resume_key).
+type RocksDBReadResult struct {
+	Tag       uint64
+	KVs       []byte
+	Intents   []byte
+	ResumeKey roachpb.Key
+	Err       error
+}
+
+// pendingRead is a read submitted to a RocksDBReadQueue which has not been
+// polled yet.
+type pendingRead struct {
+	tag       uint64
+	timestamp hlc.Timestamp
+	txn       *roachpb.Transaction
+	// buf is the C copy of the keys and txn id of the read, which the read
+	// refers to until it completes.
+	buf unsafe.Pointer
+}
+
+// RocksDBReadQueue is a completion queue for the reads submitted with
+// SubmitReads, which may be shared by reads on several engines.
+type RocksDBReadQueue struct {
+	queue *C.DBReadQueue
+	mu    struct {
+		syncutil.Mutex
+		nextID  uint64
+		pending map[uint64]pendingRead
+	}
+}
+
+// NewRocksDBReadQueue creates a read completion queue. Release() must be
+// called once the reads submitted to it have been polled.
+func NewRocksDBReadQueue() *RocksDBReadQueue {
+	q := &RocksDBReadQueue{queue: C.DBNewReadQueue()}
+	q.mu.pending = make(map[uint64]pendingRead)
+	return q
+}
+
+// Release releases the queue, which must not have any reads outstanding.
+func (q *RocksDBReadQueue) Release() {
+	C.DBReleaseReadQueue(q.queue)
+	q.queue = nil
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for id, read := range q.mu.pending {
+		C.free(read.buf)
+		delete(q.mu.pending, id)
+	}
+}
+
+// Poll returns up to max completed reads. If none have completed but some
+// are outstanding, it first waits up to timeout for a read to complete: not
+// at all if zero, and indefinitely if negative.
+func (q *RocksDBReadQueue) Poll(max int, timeout time.Duration) []RocksDBReadResult {
+	if max <= 0 {
+		return nil
+	}
+	cResults := make([]C.DBReadResult, max)
+	n := int(C.DBPollReads(q.queue, &cResults[0], C.int(max), C.int64_t(timeout)))
+	results := make([]RocksDBReadResult, n)
+
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for i := range results {
+		c := &cResults[i]
+		read := q.mu.pending[uint64(c.tag)]
+		delete(q.mu.pending, uint64(c.tag))
+		C.free(read.buf)
+
+		res := &results[i]
+		res.Tag = read.tag
+		res.KVs = cStringToGoBytes(c.data)
+		res.Intents = cStringToGoBytes(c.intents)
+		res.ResumeKey = cStringToGoBytes(c.resume_key)
+		res.Err = statusToError(c.status)
+		if res.Err == nil {
+			res.Err = uncertaintyToError(read.timestamp, c.uncertainty_timestamp, read.txn)
+		}
+		if res.Err != nil {
+			res.KVs, res.Intents, res.ResumeKey = nil, nil, nil
+		}
+	}
+	return results
+}
+
+// SubmitReads queues the reads for execution on the ReadThreads of the
+// engine. Their results are added to q as they complete, in no particular
+// order. The reads see the latest state of the engine when they execute.
+func (r *RocksDB) SubmitReads(q *RocksDBReadQueue, reqs []RocksDBReadRequest) error {
+	if len(reqs) == 0 {
+		return nil
+	}
+	cReqs := make([]C.DBReadRequest, len(reqs))
+	ids := make([]uint64, len(reqs))
+
+	q.mu.Lock()
+	defer q.mu.Unlock()
+	for i := range reqs {
+		req := &reqs[i]
+		if !req.Consistent && req.Txn != nil {
+			for _, id := range ids[:i] {
+				C.free(q.mu.pending[id].buf)
+				delete(q.mu.pending, id)
+			}
+			return errors.Errorf("cannot allow inconsistent reads within a transaction")
+		}
+
+		// The keys and txn id are copied to C memory, as the read refers to
+		// them after this call returns.
+		var txnID []byte
+		if req.Txn != nil {
+			txnID = req.Txn.ID.GetBytes()
+		}
+		buf := make([]byte, 0, len(req.Key)+len(req.EndKey)+len(txnID))
+		buf = append(append(append(buf, req.Key...), req.EndKey...), txnID...)
+		cBuf := C.CBytes(buf)
+		cSlice := func(offset, n int) C.DBSlice {
+			if n == 0 {
+				return C.DBSlice{}
+			}
+			return C.DBSlice{
+				data: (*C.char)(unsafe.Pointer(uintptr(cBuf) + uintptr(offset))),
+				len:  C.int(n),
+			}
+		}
+
+		id := q.mu.nextID
+		q.mu.nextID++
+		ids[i] = id
+		q.mu.pending[id] = pendingRead{tag: req.Tag, timestamp: req.Timestamp, txn: req.Txn, buf: cBuf}
+
+		c := &cReqs[i]
+		c.tag = C.uint64_t(id)
+		c.start = cSlice(0, len(req.Key))
+		c.end = cSlice(len(req.Key), len(req.EndKey))
+		c.timestamp = goToCTimestamp(req.Timestamp)
+		c.max_keys = C.int64_t(req.MaxKeys)
+		c.txn = goToCTxn(req.Txn)
+		c.txn.id = cSlice(len(req.Key)+len(req.EndKey), len(txnID))
+		c.consistent = C.bool(req.Consistent)
+		c.reverse = C.bool(req.Reverse)
+	}
+
+	status := C.DBSubmitReads(r.rdb, &cReqs[0], C.int(len(cReqs)), q.queue)
+	if err := statusToError(status); err != nil {
+		for _, id := range ids {
+			C.free(q.mu.pending[id].buf)
+			delete(q.mu.pending, id)
+		}
+		return err
+	}
+	return nil
+}
+
+// ReadPoolStats contains the number of reads submitted with SubmitReads
+// which are queued and executing, and the distributions of the time (in
+// nanoseconds) reads spent queued and executing since the engine was opened.
+type ReadPoolStats struct {
+	Queued, Running int64
+	QueueNanos      HistogramSummary
+	ServiceNanos    HistogramSummary
+}
+
+// GetReadPoolStats retrieves the statistics of the engine's ReadThreads.
+func (r *RocksDB) GetReadPoolStats() (ReadPoolStats, error) {
+	var s C.DBReadPoolStats
+	if err := statusToError(C.DBGetReadPoolStats(r.rdb, &s)); err != nil {
+		return ReadPoolStats{}, err
+	}
+	return ReadPoolStats{
+		Queued:       int64(s.queued),
+		Running:      int64(s.running),
+		QueueNanos:   cHistogramToGo(s.queue_nanos),
+		ServiceNanos: cHistogramToGo(s.service_nanos),
+	}, nil
+}
+
 // Destroy destroys the underlying filesystem data associated with the database.
 func (r *RocksDB) Destroy() error {
 	return statusToError(C.DBDestroy(goToCSlice([]byte(r.cfg.Dir))))
@@ -883,6 +1258,12 @@ func (r *RocksDB) NewTimeBoundIterator(start, end hlc.Timestamp) Iterator {
 	return it
 }
 
+func (r *RocksDB) mvccGet(
+	key roachpb.Key, timestamp hlc.Timestamp, txn *roachpb.Transaction, consistent bool,
+) (*roachpb.Value, []roachpb.Intent, error) {
+	return dbMVCCGet(r.rdb, key, timestamp, txn, consistent)
+}
+
 // NewSnapshot creates a snapshot handle from engine and returns a
 // read-only rocksDBSnapshot engine.
 func (r *RocksDB) NewSnapshot() Reader {
@@ -982,6 +1363,17 @@ func (r *rocksDBReadOnly) NewTimeBoundIterator(start, end hlc.Timestamp) Iterato
 	return it
 }
 
+// mvccGet reads the latest state of the engine, unlike the cached prefix
+// iterator, which sees the engine as of its creation.
+func (r *rocksDBReadOnly) mvccGet(
+	key roachpb.Key, timestamp hlc.Timestamp, txn *roachpb.Transaction, consistent bool,
+) (*roachpb.Value, []roachpb.Intent, error) {
+	if r.isClosed {
+		panic("using a closed rocksDBReadOnly")
+	}
+	return dbMVCCGet(r.parent.rdb, key, timestamp, txn, consistent)
+}
+
 // Writer methods are not implemented for rocksDBReadOnly. Ideally, the code could be refactored so that
 // a Reader could be supplied to evaluateBatch
 
@@ -1070,6 +1462,102 @@ func (r *RocksDB) getUserProperties() (enginepb.SSTUserPropertiesCollection, err
 	return ssts, nil
 }
 
+// HistogramSummary summarizes a distribution recorded by libroach.
+// The percentiles are approximate.
+type HistogramSummary struct {
+	Count, Sum, Max int64
+	P50, P95, P99   int64
+}
+
+func cHistogramToGo(h C.DBHistogram) HistogramSummary {
+	return HistogramSummary{
+		Count: int64(h.count),
+		Sum:   int64(h.sum),
+		Max:   int64(h.max),
+		P50:   int64(h.p50),
+		P95:   int64(h.p95),
+		P99:   int64(h.p99),
+	}
+}
+
+// GroupCommitStats contains the distribution of the number of batches
+// per group and of the latency (in nanoseconds) of the WAL write and
+// sync of each group committed while rocksdb.grouped_commit.enabled is
+// set.
+type GroupCommitStats struct {
+	GroupSize   HistogramSummary
+	SyncLatency HistogramSummary
+}
+
+// GetGroupCommitStats retrieves the grouped commit statistics of the
+// engine.
+func (r *RocksDB) GetGroupCommitStats() (GroupCommitStats, error) {
+	var s C.DBGroupCommitStats
+	if err := statusToError(C.DBGetGroupCommitStats(r.rdb, &s)); err != nil {
+		return GroupCommitStats{}, err
+	}
+	return GroupCommitStats{
+		GroupSize:   cHistogramToGo(s.group_size),
+		SyncLatency: cHistogramToGo(s.sync_latency_nanos),
+	}, nil
+}
+
+// LatencyStats contains the distribution of the latency (in nanoseconds)
+// of operations on the engine, including those on its batches, snapshots
+// and iterators, since the engine was opened.
+type LatencyStats struct {
+	MVCCScan       HistogramSummary
+	MVCCGet        HistogramSummary
+	IterSeek       HistogramSummary
+	CommitBatch    HistogramSummary
+	ApplyBatchRepr HistogramSummary
+	SyncWAL        HistogramSummary
+}
+
+// GetLatencyStats retrieves the operation latency statistics of the engine.
+func (r *RocksDB) GetLatencyStats() (LatencyStats, error) {
+	var s C.DBLatencyStats
+	if err := statusToError(C.DBGetLatencyStats(r.rdb, &s)); err != nil {
+		return LatencyStats{}, err
+	}
+	return LatencyStats{
+		MVCCScan:       cHistogramToGo(s.mvcc_scan),
+		MVCCGet:        cHistogramToGo(s.mvcc_get),
+		IterSeek:       cHistogramToGo(s.iter_seek),
+		CommitBatch:    cHistogramToGo(s.commit_batch),
+		ApplyBatchRepr: cHistogramToGo(s.apply_batch_repr),
+		SyncWAL:        cHistogramToGo(s.sync_wal),
+	}, nil
+}
+
+// RocksDBOpenStats breaks down the time spent opening a RocksDB instance:
+// recovering the MANIFEST, opening the sstables and replaying the WAL.
+type RocksDBOpenStats struct {
+	Total        time.Duration
+	Manifest     time.Duration
+	TableOpen    time.Duration
+	WALReplay    time.Duration
+	TablesOpened int64
+	WALFiles     int64
+}
+
+// GetOpenStats retrieves the time spent opening this engine's RocksDB
+// instance.
+func (r *RocksDB) GetOpenStats() (RocksDBOpenStats, error) {
+	var s C.DBOpenStats
+	if err := statusToError(C.DBGetOpenStats(r.rdb, &s)); err != nil {
+		return RocksDBOpenStats{}, err
+	}
+	return RocksDBOpenStats{
+		Total:        time.Duration(s.total_nanos),
+		Manifest:     time.Duration(s.manifest_nanos),
+		TableOpen:    time.Duration(s.table_open_nanos),
+		WALReplay:    time.Duration(s.wal_replay_nanos),
+		TablesOpened: int64(s.tables_opened),
+		WALFiles:     int64(s.wal_files),
+	}, nil
+}
+
 // GetStats retrieves stats from this engine's RocksDB instance and
 // returns it in a new instance of Stats.
 func (r *RocksDB) GetStats() (*Stats, error) {
@@ -1077,6 +1565,13 @@ func (r *RocksDB) GetStats() (*Stats, error) {
 	if err := statusToError(C.DBGetStats(r.rdb, &s)); err != nil {
 		return nil, err
 	}
+	var compactionInputBytes, compactionOutputBytes, sstRawBytes, sstDataBytes int64
+	for _, l := range s.compaction_levels {
+		compactionInputBytes += int64(l.input_bytes)
+		compactionOutputBytes += int64(l.output_bytes)
+		sstRawBytes += int64(l.raw_bytes)
+		sstDataBytes += int64(l.data_bytes)
+	}
 	return &Stats{
 		BlockCacheHits:                 int64(s.block_cache_hits),
 		BlockCacheMisses:               int64(s.block_cache_misses),
@@ -1089,6 +1584,27 @@ func (r *RocksDB) GetStats() (*Stats, error) {
 		Compactions:                    int64(s.compactions),
 		TableReadersMemEstimate:        int64(s.table_readers_mem_estimate),
 		PendingCompactionBytesEstimate: int64(s.pending_compaction_bytes_estimate),
+		PersistentCacheHits:            int64(s.persistent_cache_hits),
+		PersistentCacheMisses:          int64(s.persistent_cache_misses),
+		PersistentCacheUsage:           int64(s.persistent_cache_usage),
+		WriteStalls:                    int64(s.write_stalls),
+		WriteStops:                     int64(s.write_stops),
+		WriteStallNanos:                int64(s.write_stall_nanos),
+		FlushBytes:                     int64(s.flush_bytes),
+		L0FileCount:                    int64(s.l0_file_count),
+		CompactionInputBytes:           compactionInputBytes,
+		CompactionOutputBytes:          compactionOutputBytes,
+		SSTRawBytes:                    sstRawBytes,
+		SSTDataBytes:                   sstDataBytes,
+		BlockDecompressions:            int64(s.block_decompressions),
+		DecompressionNanos:             int64(s.decompression_nanos),
+		BlobFileCount:                  int64(s.blob_file_count),
+		BlobFileBytes:                  int64(s.blob_file_bytes),
+		BlobRelocatedBytes:             int64(s.blob_relocated_bytes),
+		RateLimitBytesPerSec:           int64(s.rate_limit_bytes_per_sec),
+		RateLimitThrottledNanos:        int64(s.rate_limit_throttled_nanos),
+		ReadaheadBytes:                 int64(s.readahead_bytes),
+		ReadaheadHitBytes:              int64(s.readahead_hit_bytes),
 	}, nil
 }
 
@@ -1578,6 +2094,11 @@ func (r *rocksDBBatch) Commit(syncCommit bool) error {
 	}
 	r.distinctOpen = false
 
+	if syncCommit && r.parent.cfg.Settings != nil &&
+		groupedCommitEnabled.Get(&r.parent.cfg.Settings.SV) {
+		return r.commitGrouped()
+	}
+
 	// Combine multiple write-only batch commits into a single call to
 	// RocksDB. RocksDB is supposed to be performing such batching internally,
 	// but whether Cgo or something else, it isn't achieving the same degree of
@@ -1670,6 +2191,24 @@ func (r *rocksDBBatch) Commit(syncCommit bool) error {
 	return r.commitErr
 }
 
+// commitGrouped durably commits the batch through the group committer
+// of the engine, which combines the batches of concurrent callers into
+// a single WAL write and sync (see DBCommitAndCloseBatchGrouped). It
+// bypasses the commit and sync goroutines used by Commit.
+func (r *rocksDBBatch) commitGrouped() error {
+	start := timeutil.Now()
+	r.flushMutations()
+	if r.batch != nil {
+		if err := statusToError(C.DBCommitAndCloseBatchGrouped(r.parent.rdb, r.batch)); err != nil {
+			return err
+		}
+		r.batch = nil
+	}
+	r.committed = true
+	r.warnIfLarge(start, r.flushedCount, r.flushedSize)
+	return nil
+}
+
 func (r *rocksDBBatch) commitInternal(sync bool) error {
 	start := timeutil.Now()
 	var count, size int
@@ -1698,14 +2237,19 @@ func (r *rocksDBBatch) commitInternal(sync bool) error {
 		}
 	}
 	r.committed = true
+	r.warnIfLarge(start, count, size)
+	return nil
+}
 
+// warnIfLarge logs a warning if the commit of the batch, holding count
+// mutations of size bytes, took longer than WarnLargeBatchThreshold
+// since start.
+func (r *rocksDBBatch) warnIfLarge(start time.Time, count, size int) {
 	warnLargeBatches := r.parent.cfg.WarnLargeBatchThreshold > 0
 	if elapsed := timeutil.Since(start); warnLargeBatches && (elapsed >= r.parent.cfg.WarnLargeBatchThreshold) {
 		log.Warningf(context.TODO(), "batch [%d/%d/%d] commit took %s (>%s):\n%s",
 			count, size, r.flushes, elapsed, r.parent.cfg.WarnLargeBatchThreshold, debug.Stack())
 	}
-
-	return nil
 }
 
 func (r *rocksDBBatch) Repr() []byte {
@@ -1758,6 +2302,14 @@ type dbIteratorGetter interface {
 	getIter() *C.DBIterator
 }
 
+// mvccGetter is implemented by the readers which serve MVCCGet without
+// creating an iterator.
+type mvccGetter interface {
+	mvccGet(
+		key roachpb.Key, timestamp hlc.Timestamp, txn *roachpb.Transaction, consistent bool,
+	) (*roachpb.Value, []roachpb.Intent, error)
+}
+
 type rocksDBIterator struct {
 	engine Reader
 	iter   *C.DBIterator
@@ -1979,30 +2531,67 @@ func (r *rocksDBIterator) MVCCGet(
 		r.iter, goToCSlice(key), goToCTimestamp(timestamp),
 		goToCTxn(txn), C.bool(consistent),
 	)
+	return decodeMVCCGet(timestamp, txn, consistent, state.status, state.uncertainty_timestamp,
+		cSliceToGoBytes(state.intents), cSliceToUnsafeGoBytes(state.data))
+}
 
-	if err := statusToError(state.status); err != nil {
+// dbMVCCGet is like rocksDBIterator.MVCCGet, but reads through a pooled
+// iterator of rdb (see DBMVCCGet) rather than one created by the caller.
+func dbMVCCGet(
+	rdb *C.DBEngine,
+	key roachpb.Key,
+	timestamp hlc.Timestamp,
+	txn *roachpb.Transaction,
+	consistent bool,
+) (*roachpb.Value, []roachpb.Intent, error) {
+	if !consistent && txn != nil {
+		return nil, nil, errors.Errorf("cannot allow inconsistent reads within a transaction")
+	}
+	if len(key) == 0 {
+		return nil, nil, emptyKeyError()
+	}
+
+	state := C.DBMVCCGet(
+		rdb, goToCSlice(key), goToCTimestamp(timestamp),
+		goToCTxn(txn), C.bool(consistent),
+	)
+	intents := cStringToGoBytes(state.intents)
+	data := cStringToGoBytes(state.data)
+	return decodeMVCCGet(timestamp, txn, consistent, state.status, state.uncertainty_timestamp,
+		intents, data)
+}
+
+// decodeMVCCGet converts the results of an MVCCGet, encoded as by
+// MVCCScan, into the value and intents at key.
+func decodeMVCCGet(
+	timestamp hlc.Timestamp,
+	txn *roachpb.Transaction,
+	consistent bool,
+	status C.DBStatus,
+	uncertaintyTimestamp C.DBTimestamp,
+	intentsRepr []byte,
+	repr []byte,
+) (*roachpb.Value, []roachpb.Intent, error) {
+	if err := statusToError(status); err != nil {
 		return nil, nil, err
 	}
-	if err := uncertaintyToError(timestamp, state.uncertainty_timestamp, txn); err != nil {
+	if err := uncertaintyToError(timestamp, uncertaintyTimestamp, txn); err != nil {
 		return nil, nil, err
 	}
 
-	intents, err := buildScanIntents(cSliceToGoBytes(state.intents))
+	intents, err := buildScanIntents(intentsRepr)
 	if err != nil {
 		return nil, nil, err
 	}
 	if consistent && len(intents) > 0 {
 		return nil, nil, &roachpb.WriteIntentError{Intents: intents}
 	}
-	if state.data.len == 0 {
+	if len(repr) == 0 {
 		return nil, intents, nil
 	}
 
-	// Extract the value from the batch data. This code would be slightly more
-	// compact using RocksDBBatchReader, but avoiding the allocation has a
-	// measurable impact on benchmarks.
-	repr := cSliceToUnsafeGoBytes(state.data)
-	count, repr, err := rocksDBBatchDecodeHeader(repr)
+	// Extract the value from the scan results.
+	count, repr, err := mvccScanDecodeHeader(repr)
 	if err != nil {
 		return nil, nil, err
 	}
@@ -2012,7 +2601,7 @@ func (r *rocksDBIterator) MVCCGet(
 	if count == 0 {
 		return nil, intents, nil
 	}
-	mvccKey, rawValue, _, err := rocksDBBatchDecodeValue(repr)
+	mvccKey, rawValue, _, err := mvccScanDecodeKeyValue(repr)
 	if err != nil {
 		return nil, nil, err
 	}
@@ -2441,6 +3030,122 @@ func (fw *RocksDBSstFileWriter) Close() {
 	fw.fw = nil
 }
 
+// readerEngine returns the C engine backing reader, if it is backed by
+// RocksDB.
+func readerEngine(reader Reader) (*C.DBEngine, bool) {
+	switch r := reader.(type) {
+	case *RocksDB:
+		return r.rdb, true
+	case InMem:
+		return r.rdb, true
+	case *rocksDBReadOnly:
+		if r.isClosed {
+			panic("using a closed rocksDBReadOnly")
+		}
+		return r.parent.rdb, true
+	case *rocksDBSnapshot:
+		return r.handle, true
+	case *rocksDBBatch:
+		if r.writeOnly {
+			panic("write-only batch")
+		}
+		if r.distinctOpen {
+			panic("distinct batch open")
+		}
+		r.flushMutations()
+		r.ensureBatch()
+		return r.batch, true
+	default:
+		return nil, false
+	}
+}
+
+// ExportToSst writes the versions of the keys in [start, end) with
+// timestamps in (startTS, endTS] to a new sstable and returns its
+// contents, which are empty if nothing was exported. Only the latest
+// version of each key is exported unless allRevisions is set. If
+// targetSize is positive, the export stops at the first key boundary
+// after that many bytes and resumeKey is the key to continue from. An
+// error is returned on an intent in (startTS, endTS], and when reader
+// is not backed by RocksDB, in which case ok is false.
+func ExportToSst(
+	reader Reader,
+	start, end roachpb.Key,
+	startTS, endTS hlc.Timestamp,
+	allRevisions bool,
+	targetSize int64,
+) (sst []byte, resumeKey roachpb.Key, ok bool, err error) {
+	rdb, ok := readerEngine(reader)
+	if !ok {
+		return nil, nil, false, errors.Errorf("export is unsupported by %T", reader)
+	}
+
+	var cSst, cResumeKey C.DBString
+	err = statusToError(C.DBExportToSst(rdb, goToCKey(MakeMVCCMetadataKey(start)),
+		goToCKey(MakeMVCCMetadataKey(end)), goToCTimestamp(startTS), goToCTimestamp(endTS),
+		C.bool(allRevisions), C.int64_t(targetSize), &cSst, &cResumeKey))
+	return cStringToGoBytes(cSst), cStringToGoBytes(cResumeKey), true, err
+}
+
+// ComputeChecksum computes the replica consistency checksum of the spans of
+// reader, which must be sorted and disjoint, and if computeStats is set their
+// MVCC stats at nowNanos, from one read of the data on up to concurrency
+// threads. Every key/value pair is hashed in key order, as its little-endian
+// 8-byte key and value lengths, then the key, the marshaled
+// hlc.LegacyTimestamp and the value, except for skipKey if it has no
+// timestamp. An error is returned when reader is not backed by RocksDB, in
+// which case ok is false.
+func ComputeChecksum(
+	reader Reader,
+	spans []roachpb.Span,
+	skipKey roachpb.Key,
+	computeStats bool,
+	nowNanos int64,
+	concurrency int,
+) (checksum []byte, ms enginepb.MVCCStats, ok bool, err error) {
+	rdb, ok := readerEngine(reader)
+	if !ok {
+		return nil, ms, false, errors.Errorf("checksum is unsupported by %T", reader)
+	}
+	if len(spans) == 0 {
+		return nil, ms, true, errors.New("no spans to checksum")
+	}
+
+	// The span keys are copied to C memory, which the spans passed to C may
+	// point to.
+	var spanKeys []byte
+	for _, span := range spans {
+		spanKeys = append(spanKeys, span.Key...)
+		spanKeys = append(spanKeys, span.EndKey...)
+	}
+	cKeys := (*C.char)(C.CBytes(spanKeys))
+	defer C.free(unsafe.Pointer(cKeys))
+	cSpans := make([]C.DBSpan, len(spans))
+	var offset int
+	cSlice := func(n int) C.DBSlice {
+		data := (*C.char)(unsafe.Pointer(uintptr(unsafe.Pointer(cKeys)) + uintptr(offset)))
+		offset += n
+		return C.DBSlice{data: data, len: C.int(n)}
+	}
+	for i, span := range spans {
+		cSpans[i].start = cSlice(len(span.Key))
+		cSpans[i].end = cSlice(len(span.EndKey))
+	}
+
+	result := C.MVCCComputeChecksum(rdb, &cSpans[0], C.int(len(cSpans)), goToCSlice(skipKey),
+		C.bool(computeStats), C.int64_t(nowNanos), C.int(concurrency))
+	if err := statusToError(result.status); err != nil {
+		return nil, ms, true, err
+	}
+	checksum = cStringToGoBytes(result.checksum)
+	if computeStats {
+		if ms, err = cStatsToGoStats(result.stats, nowNanos); err != nil {
+			return nil, ms, true, err
+		}
+	}
+	return checksum, ms, true, nil
+}
+
 // RunLDB runs RocksDB's ldb command-line tool. The passed
 // command-line arguments should not include argv[0].
 func RunLDB(args []string) {
@@ -2482,6 +3187,56 @@ func (r *RocksDB) WriteFile(filename string, data []byte) error {
 	return statusToError(C.DBEnvWriteFile(r.rdb, goToCSlice([]byte(filename)), goToCSlice(data)))
 }
 
+// RocksDBFile is a file in a RocksDB's env which is written incrementally,
+// so that large files need not be buffered in memory.
+type RocksDBFile struct {
+	file *C.DBWritableFile
+}
+
+var _ io.WriteCloser = &RocksDBFile{}
+
+// CreateFile creates (or truncates) a file in this RocksDB's env. If
+// bytesPerSync is non-zero, writeback of the written data is started every
+// bytesPerSync bytes rather than being left for the final Sync. The file must
+// be closed.
+func (r *RocksDB) CreateFile(filename string, bytesPerSync uint64) (*RocksDBFile, error) {
+	var file *C.DBWritableFile
+	status := C.DBEnvOpenFile(r.rdb, goToCSlice([]byte(filename)), C.uint64_t(bytesPerSync), &file)
+	if err := statusToError(status); err != nil {
+		return nil, err
+	}
+	return &RocksDBFile{file: file}, nil
+}
+
+// Write appends data to the file.
+func (f *RocksDBFile) Write(data []byte) (int, error) {
+	if f.file == nil {
+		return 0, errors.New("cannot call Write on a closed file")
+	}
+	if err := statusToError(C.DBEnvAppendFile(f.file, goToCSlice(data))); err != nil {
+		return 0, err
+	}
+	return len(data), nil
+}
+
+// Sync syncs the data written to the file to disk.
+func (f *RocksDBFile) Sync() error {
+	if f.file == nil {
+		return errors.New("cannot call Sync on a closed file")
+	}
+	return statusToError(C.DBEnvSyncFile(f.file))
+}
+
+// Close closes the file without syncing it.
+func (f *RocksDBFile) Close() error {
+	if f.file == nil {
+		return nil
+	}
+	err := statusToError(C.DBEnvCloseFile(f.file))
+	f.file = nil
+	return err
+}
+
 // IsValidSplitKey returns whether the key is a valid split key. Certain key
 // ranges cannot be split (the meta1 span and the system DB span); split keys
 // chosen within any of these ranges are considered invalid. And a split key
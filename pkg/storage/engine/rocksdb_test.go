@@ -15,12 +15,17 @@
 package engine
 
 import (
+	"bytes"
 	"context"
+	"crypto/sha512"
+	"encoding/binary"
 	"encoding/json"
 	"fmt"
 	"io/ioutil"
 	"math/rand"
 	"os"
+	"path/filepath"
+	"reflect"
 	"sort"
 	"strconv"
 	"testing"
@@ -29,6 +34,7 @@ import (
 	"github.com/cockroachdb/cockroach/pkg/keys"
 	"github.com/cockroachdb/cockroach/pkg/roachpb"
 	"github.com/cockroachdb/cockroach/pkg/settings/cluster"
+	"github.com/cockroachdb/cockroach/pkg/storage/engine/enginepb"
 	"github.com/cockroachdb/cockroach/pkg/testutils"
 	"github.com/cockroachdb/cockroach/pkg/util"
 	"github.com/cockroachdb/cockroach/pkg/util/encoding"
@@ -36,6 +42,7 @@ import (
 	"github.com/cockroachdb/cockroach/pkg/util/humanizeutil"
 	"github.com/cockroachdb/cockroach/pkg/util/leaktest"
 	"github.com/cockroachdb/cockroach/pkg/util/log"
+	"github.com/cockroachdb/cockroach/pkg/util/protoutil"
 	"github.com/cockroachdb/cockroach/pkg/util/randutil"
 	"github.com/cockroachdb/cockroach/pkg/util/timeutil"
 )
@@ -704,6 +711,76 @@ func BenchmarkRocksDBSstFileReader(b *testing.B) {
 	}
 }
 
+func TestRocksDBGroupedCommit(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	st := cluster.MakeTestingClusterSettings()
+	groupedCommitEnabled.Override(&st.SV, true)
+	db, err := NewRocksDB(
+		RocksDBConfig{
+			Settings: st,
+			Dir:      dir,
+		},
+		RocksDBCache{},
+	)
+	if err != nil {
+		t.Fatalf("could not create new rocksdb db instance at %s: %v", dir, err)
+	}
+	defer db.Close()
+
+	// Concurrently commit synchronous batches, some of which have been
+	// flushed to C++ by reading from them.
+	const numBatches = 32
+	errChan := make(chan error, numBatches)
+	for i := 0; i < numBatches; i++ {
+		go func(i int) {
+			batch := db.NewBatch()
+			defer batch.Close()
+			k := key(strconv.Itoa(i))
+			if err := batch.Put(k, []byte(k.String())); err != nil {
+				errChan <- err
+				return
+			}
+			if i%2 == 0 {
+				if _, err := batch.Get(k); err != nil {
+					errChan <- err
+					return
+				}
+			}
+			errChan <- batch.Commit(true /* sync */)
+		}(i)
+	}
+	for i := 0; i < numBatches; i++ {
+		if err := <-errChan; err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	for i := 0; i < numBatches; i++ {
+		k := key(strconv.Itoa(i))
+		if v, err := db.Get(k); err != nil {
+			t.Fatal(err)
+		} else if string(v) != k.String() {
+			t.Fatalf("expected %s to be %q, got %q", k, k.String(), v)
+		}
+	}
+
+	stats, err := db.GetGroupCommitStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.GroupSize.Sum != numBatches {
+		t.Fatalf("expected %d batches to be committed in groups, got %d",
+			numBatches, stats.GroupSize.Sum)
+	}
+	if stats.SyncLatency.Count != stats.GroupSize.Count {
+		t.Fatalf("expected a sync per group, got %d syncs for %d groups",
+			stats.SyncLatency.Count, stats.GroupSize.Count)
+	}
+}
+
 func TestRocksDBTimeBound(t *testing.T) {
 	defer leaktest.AfterTest(t)()
 	dir, dirCleanup := testutils.TempDir(t)
@@ -926,3 +1003,585 @@ func TestSSTableInfosByLevel(t *testing.T) {
 		})
 	}
 }
+
+func TestRocksDBTieredCache(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	dir, cleanup := testutils.TempDir(t)
+	defer cleanup()
+
+	cache, err := NewRocksDBTieredCache(1<<20, dir, 256<<20)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// The engine holds its own reference to the cache.
+	db, err := newMemRocksDB(roachpb.Attributes{}, cache, 512<<20)
+	cache.Release()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+
+	const numKeys = 1000
+	value := bytes.Repeat([]byte("v"), 1000)
+	for i := 0; i < numKeys; i++ {
+		key := MakeMVCCMetadataKey(roachpb.Key(fmt.Sprintf("key-%04d", i)))
+		if err := db.Put(key, value); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+	// Reading the flushed sstable fills both tiers of the cache.
+	for i := 0; i < numKeys; i++ {
+		key := MakeMVCCMetadataKey(roachpb.Key(fmt.Sprintf("key-%04d", i)))
+		if v, err := db.Get(key); err != nil {
+			t.Fatal(err)
+		} else if !bytes.Equal(value, v) {
+			t.Fatalf("%s: expected %q, got %q", key, value, v)
+		}
+	}
+
+	stats, err := db.GetStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.PersistentCacheUsage <= 0 || stats.PersistentCacheUsage > 256<<20 {
+		t.Fatalf("unexpected persistent cache usage %d", stats.PersistentCacheUsage)
+	}
+}
+
+func TestRocksDBExportToSst(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	db := NewInMem(roachpb.Attributes{}, 1<<20)
+	defer db.Close()
+
+	ts := func(wallTime int64) hlc.Timestamp { return hlc.Timestamp{WallTime: wallTime} }
+	kvs := []MVCCKeyValue{
+		{Key: MVCCKey{Key: roachpb.Key("a"), Timestamp: ts(1)}, Value: []byte("a1")},
+		{Key: MVCCKey{Key: roachpb.Key("a"), Timestamp: ts(3)}, Value: []byte("a3")},
+		{Key: MVCCKey{Key: roachpb.Key("b"), Timestamp: ts(2)}, Value: []byte("b2")},
+		{Key: MVCCKey{Key: roachpb.Key("c"), Timestamp: ts(2)}, Value: nil},
+		{Key: MVCCKey{Key: roachpb.Key("d"), Timestamp: ts(2)}, Value: []byte("d2")},
+	}
+	for _, kv := range kvs {
+		if err := db.Put(kv.Key, kv.Value); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	exported := func(sst []byte) []string {
+		if len(sst) == 0 {
+			return nil
+		}
+		reader := MakeRocksDBSstFileReader()
+		defer reader.Close()
+		if err := reader.IngestExternalFile(sst); err != nil {
+			t.Fatal(err)
+		}
+		var result []string
+		if err := reader.Iterate(MVCCKey{Key: keys.MinKey}, MVCCKey{Key: keys.MaxKey},
+			func(kv MVCCKeyValue) (bool, error) {
+				result = append(result, fmt.Sprintf("%s=%s", kv.Key, kv.Value))
+				return false, nil
+			}); err != nil {
+			t.Fatal(err)
+		}
+		return result
+	}
+
+	testCases := []struct {
+		end          roachpb.Key
+		startTS      hlc.Timestamp
+		endTS        hlc.Timestamp
+		allRevisions bool
+		targetSize   int64
+		expected     []string
+		resumeKey    roachpb.Key
+	}{
+		// Latest versions, without the tombstone of a full export.
+		{roachpb.Key("z"), ts(0), ts(3), false, 0,
+			[]string{`"a"/0.000000003,0=a3`, `"b"/0.000000002,0=b2`, `"d"/0.000000002,0=d2`}, nil},
+		{roachpb.Key("z"), ts(0), ts(2), false, 0,
+			[]string{`"a"/0.000000001,0=a1`, `"b"/0.000000002,0=b2`, `"d"/0.000000002,0=d2`}, nil},
+		// Incremental exports keep the tombstone.
+		{roachpb.Key("z"), ts(1), ts(3), false, 0,
+			[]string{`"a"/0.000000003,0=a3`, `"b"/0.000000002,0=b2`, `"c"/0.000000002,0=`,
+				`"d"/0.000000002,0=d2`}, nil},
+		{roachpb.Key("c"), ts(0), ts(3), true, 0,
+			[]string{`"a"/0.000000003,0=a3`, `"a"/0.000000001,0=a1`, `"b"/0.000000002,0=b2`}, nil},
+		// The export stops at the key boundary after the target size.
+		{roachpb.Key("z"), ts(0), ts(3), true, 1,
+			[]string{`"a"/0.000000003,0=a3`, `"a"/0.000000001,0=a1`}, roachpb.Key("b")},
+		{roachpb.Key("z"), ts(3), ts(4), false, 0, nil, nil},
+	}
+	for i, c := range testCases {
+		sst, resumeKey, ok, err := ExportToSst(
+			db, roachpb.Key("a"), c.end, c.startTS, c.endTS, c.allRevisions, c.targetSize,
+		)
+		if !ok || err != nil {
+			t.Fatalf("%d: %t %v", i, ok, err)
+		}
+		if result := exported(sst); !reflect.DeepEqual(c.expected, result) {
+			t.Errorf("%d: expected %v, got %v", i, c.expected, result)
+		}
+		if !c.resumeKey.Equal(resumeKey) {
+			t.Errorf("%d: expected resume key %s, got %s", i, c.resumeKey, resumeKey)
+		}
+	}
+
+	// An intent in the exported time range is an error.
+	txn := makeTxn(*txn1, ts(5))
+	if err := MVCCPut(context.Background(), db, nil, roachpb.Key("b"), txn.Timestamp,
+		roachpb.MakeValueFromString("b5"), txn); err != nil {
+		t.Fatal(err)
+	}
+	if _, _, _, err := ExportToSst(db, roachpb.Key("a"), roachpb.Key("z"), ts(0), ts(4), false,
+		0); err != nil {
+		t.Fatalf("unexpected error for an intent after the export: %v", err)
+	}
+	if _, _, _, err := ExportToSst(db, roachpb.Key("a"), roachpb.Key("z"), ts(0), ts(5), false,
+		0); !testutils.IsError(err, "conflicting intent") {
+		t.Fatalf("expected intent error, got %v", err)
+	}
+}
+
+func TestRocksDBMVCCGet(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	ctx := context.Background()
+	db := NewInMem(roachpb.Attributes{}, 1<<20)
+	defer db.Close()
+
+	ts := func(wallTime int64) hlc.Timestamp { return hlc.Timestamp{WallTime: wallTime} }
+	for i, v := range []string{"a1", "a2"} {
+		if err := MVCCPut(ctx, db, nil, roachpb.Key("a"), ts(int64(i+1)),
+			roachpb.MakeValueFromString(v), nil); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+	txn := makeTxn(*txn1, ts(3))
+	if err := MVCCPut(ctx, db, nil, roachpb.Key("a"), txn.Timestamp,
+		roachpb.MakeValueFromString("a3"), txn); err != nil {
+		t.Fatal(err)
+	}
+
+	readOnly := db.NewReadOnly()
+	defer readOnly.Close()
+	for _, reader := range []Reader{db, readOnly} {
+		for _, key := range []roachpb.Key{roachpb.Key("a"), roachpb.Key("b")} {
+			for _, get := range []struct {
+				timestamp  hlc.Timestamp
+				txn        *roachpb.Transaction
+				consistent bool
+			}{
+				{ts(1), nil, true},
+				{ts(2), nil, true},
+				{ts(3), nil, true},
+				{ts(3), nil, false},
+				{ts(3), txn, true},
+			} {
+				value, intents, err := MVCCGet(ctx, reader, key, get.timestamp, get.consistent, get.txn)
+				iter := reader.NewIterator(true)
+				expValue, expIntents, expErr := iter.MVCCGet(key, get.timestamp, get.txn, get.consistent)
+				iter.Close()
+				if !reflect.DeepEqual(expValue, value) || !reflect.DeepEqual(expIntents, intents) ||
+					!reflect.DeepEqual(expErr, err) {
+					t.Errorf("%T %s %+v: expected %v %v %v, got %v %v %v", reader, key, get,
+						expValue, expIntents, expErr, value, intents, err)
+				}
+			}
+		}
+	}
+}
+
+func TestRocksDBCacheWithOptions(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	if _, err := NewRocksDBCacheWithOptions(1<<20, 0, 1); !testutils.IsError(err,
+		"high_pri_pool_ratio must be in") {
+		t.Fatalf("expected high_pri_pool_ratio error, got %v", err)
+	}
+
+	cache, err := NewRocksDBCacheWithOptions(1<<20, 2, 0.25)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// The engine holds its own reference to the cache.
+	db, err := newMemRocksDB(roachpb.Attributes{}, cache, 512<<20)
+	cache.Release()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+
+	key := MakeMVCCMetadataKey(roachpb.Key("a"))
+	if err := db.Put(key, []byte("value")); err != nil {
+		t.Fatal(err)
+	}
+	if err := db.Flush(); err != nil {
+		t.Fatal(err)
+	}
+	if v, err := db.Get(key); err != nil {
+		t.Fatal(err)
+	} else if string(v) != "value" {
+		t.Fatalf("expected value, got %q", v)
+	}
+
+	stats, err := db.GetStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.BlockCacheUsage <= 0 {
+		t.Fatalf("unexpected block cache usage %d", stats.BlockCacheUsage)
+	}
+}
+
+func TestRocksDBFastOpen(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	cfg := RocksDBConfig{
+		Settings: cluster.MakeTestingClusterSettings(),
+		Dir:      dir,
+		FastOpen: true,
+	}
+	key := MakeMVCCMetadataKey(roachpb.Key("a"))
+	for i := 0; i < 2; i++ {
+		db, err := NewRocksDB(cfg, RocksDBCache{})
+		if err != nil {
+			t.Fatal(err)
+		}
+		if i == 0 {
+			if err := db.Put(key, []byte("value")); err != nil {
+				t.Fatal(err)
+			}
+		} else if v, err := db.Get(key); err != nil {
+			t.Fatal(err)
+		} else if string(v) != "value" {
+			t.Fatalf("expected value, got %q", v)
+		}
+
+		stats, err := db.GetOpenStats()
+		db.Close()
+		if err != nil {
+			t.Fatal(err)
+		}
+		if stats.Total <= 0 || stats.Manifest+stats.TableOpen+stats.WALReplay > stats.Total {
+			t.Fatalf("%d: unexpected open stats %+v", i, stats)
+		}
+	}
+}
+
+func TestRocksDBLatencyStats(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	db, err := NewRocksDB(RocksDBConfig{
+		Settings:       cluster.MakeTestingClusterSettings(),
+		Dir:            dir,
+		DetailedTimers: true,
+	}, RocksDBCache{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+
+	ctx := context.Background()
+	ts := hlc.Timestamp{WallTime: 1}
+	batch := db.NewBatch()
+	if err := MVCCPut(ctx, batch, nil, roachpb.Key("a"), ts,
+		roachpb.MakeValueFromString("value"), nil); err != nil {
+		t.Fatal(err)
+	}
+	if err := batch.Commit(false /* sync */); err != nil {
+		t.Fatal(err)
+	}
+	batch.Close()
+	if _, _, err := MVCCGet(ctx, db, roachpb.Key("a"), ts, true, nil); err != nil {
+		t.Fatal(err)
+	}
+
+	stats, err := db.GetLatencyStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.CommitBatch.Count == 0 || stats.MVCCGet.Count == 0 {
+		t.Fatalf("expected commit and get latencies, got %+v", stats)
+	}
+}
+
+func TestRocksDBSharedScheduler(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	if _, err := NewRocksDBScheduler(0, 0); !testutils.IsError(err, "num_threads must be positive") {
+		t.Fatalf("expected num_threads error, got %v", err)
+	}
+	scheduler, err := NewRocksDBScheduler(2, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer scheduler.Release()
+
+	var dbs []*RocksDB
+	for i := 0; i < 2; i++ {
+		dir, dirCleanup := testutils.TempDir(t)
+		defer dirCleanup()
+		db, err := NewRocksDB(RocksDBConfig{
+			Settings:  cluster.MakeTestingClusterSettings(),
+			Dir:       dir,
+			Scheduler: scheduler,
+		}, RocksDBCache{})
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer db.Close()
+		dbs = append(dbs, db)
+	}
+	// The flushes and compactions of both engines run on the scheduler.
+	for i := 0; i < 2; i++ {
+		for _, db := range dbs {
+			if err := db.Put(MakeMVCCMetadataKey(roachpb.Key(fmt.Sprintf("k%d", i))),
+				[]byte("value")); err != nil {
+				t.Fatal(err)
+			}
+			if err := db.Flush(); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	for _, db := range dbs {
+		if err := db.Compact(); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	stats, err := scheduler.GetStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.Flushes < 4 || stats.Compactions < 2 {
+		t.Fatalf("unexpected scheduler stats %+v", stats)
+	}
+}
+
+func TestRocksDBComputeChecksum(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	ctx := context.Background()
+	db := NewInMem(roachpb.Attributes{}, 1<<20)
+	defer db.Close()
+
+	// Write two versions of each key across several sstables, along with an
+	// intent and the metadata key which is skipped.
+	for i := 0; i < 100; i++ {
+		key := roachpb.Key(fmt.Sprintf("key-%03d", i))
+		for _, wallTime := range []int64{1, 2} {
+			value := roachpb.MakeValueFromString(fmt.Sprintf("%s-%d", key, wallTime))
+			if err := MVCCPut(ctx, db, nil, key, hlc.Timestamp{WallTime: wallTime}, value,
+				nil); err != nil {
+				t.Fatal(err)
+			}
+		}
+		if i%25 == 0 {
+			if err := db.Flush(); err != nil {
+				t.Fatal(err)
+			}
+		}
+	}
+	txn := makeTxn(*txn1, hlc.Timestamp{WallTime: 3})
+	if err := MVCCPut(ctx, db, nil, roachpb.Key("key-050"), txn.Timestamp,
+		roachpb.MakeValueFromString("intent"), txn); err != nil {
+		t.Fatal(err)
+	}
+	skipKey := roachpb.Key("key-010")
+	if err := db.Put(MakeMVCCMetadataKey(skipKey), []byte("skipped")); err != nil {
+		t.Fatal(err)
+	}
+
+	spans := []roachpb.Span{
+		{Key: roachpb.Key("key-000"), EndKey: roachpb.Key("key-040")},
+		{Key: roachpb.Key("key-060"), EndKey: roachpb.Key("key-100")},
+	}
+	const nowNanos = 10
+	hasher := sha512.New()
+	var expMS enginepb.MVCCStats
+	for _, span := range spans {
+		iter := db.NewIterator(false)
+		ms, err := ComputeStatsGo(iter, MakeMVCCMetadataKey(span.Key), MakeMVCCMetadataKey(span.EndKey),
+			nowNanos, func(key MVCCKey, value []byte) error {
+				if key.Equal(MakeMVCCMetadataKey(skipKey)) {
+					return nil
+				}
+				_ = binary.Write(hasher, binary.LittleEndian, int64(len(key.Key)))
+				_ = binary.Write(hasher, binary.LittleEndian, int64(len(value)))
+				_, _ = hasher.Write(key.Key)
+				legacyTimestamp := hlc.LegacyTimestamp(key.Timestamp)
+				timestamp, err := protoutil.Marshal(&legacyTimestamp)
+				if err != nil {
+					return err
+				}
+				_, _ = hasher.Write(timestamp)
+				_, _ = hasher.Write(value)
+				return nil
+			})
+		iter.Close()
+		if err != nil {
+			t.Fatal(err)
+		}
+		expMS.Add(ms)
+	}
+	expChecksum := hasher.Sum(nil)
+
+	for _, concurrency := range []int{1, 4} {
+		checksum, ms, ok, err := ComputeChecksum(db, spans, skipKey, true, nowNanos, concurrency)
+		if !ok || err != nil {
+			t.Fatalf("%d: %t %v", concurrency, ok, err)
+		}
+		if !bytes.Equal(expChecksum, checksum) {
+			t.Errorf("%d: expected checksum %x, got %x", concurrency, expChecksum, checksum)
+		}
+		if !reflect.DeepEqual(expMS, ms) {
+			t.Errorf("%d: expected stats %+v, got %+v", concurrency, expMS, ms)
+		}
+	}
+}
+
+func TestRocksDBCreateFile(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+
+	db, err := NewRocksDB(RocksDBConfig{
+		Settings: cluster.MakeTestingClusterSettings(),
+		Dir:      dir,
+	}, RocksDBCache{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+
+	// The file is written in chunks which cross the sync interval.
+	path := filepath.Join(dir, "file")
+	file, err := db.CreateFile(path, 4096)
+	if err != nil {
+		t.Fatal(err)
+	}
+	var expected []byte
+	for i := 0; i < 10; i++ {
+		chunk := bytes.Repeat([]byte{byte('a' + i)}, 1000)
+		if _, err := file.Write(chunk); err != nil {
+			t.Fatal(err)
+		}
+		expected = append(expected, chunk...)
+	}
+	if err := file.Sync(); err != nil {
+		t.Fatal(err)
+	}
+	if err := file.Close(); err != nil {
+		t.Fatal(err)
+	}
+	if _, err := file.Write([]byte("a")); !testutils.IsError(err, "closed file") {
+		t.Fatalf("expected closed file error, got %v", err)
+	}
+
+	data, err := ioutil.ReadFile(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(expected, data) {
+		t.Fatalf("expected %d bytes, got %d", len(expected), len(data))
+	}
+}
+
+func TestRocksDBSubmitReads(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+
+	ctx := context.Background()
+	queue := NewRocksDBReadQueue()
+	defer queue.Release()
+
+	mem := NewInMem(roachpb.Attributes{}, 1<<20)
+	defer mem.Close()
+	if err := mem.SubmitReads(queue, []RocksDBReadRequest{{Key: roachpb.Key("a")}}); !testutils.IsError(
+		err, "unsupported") {
+		t.Fatalf("expected unsupported error, got %v", err)
+	}
+
+	dir, dirCleanup := testutils.TempDir(t)
+	defer dirCleanup()
+	db, err := NewRocksDB(RocksDBConfig{
+		Settings:    cluster.MakeTestingClusterSettings(),
+		Dir:         dir,
+		ReadThreads: 2,
+	}, RocksDBCache{})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer db.Close()
+
+	ts := hlc.Timestamp{WallTime: 1}
+	for _, key := range []string{"a", "b", "c"} {
+		if err := MVCCPut(ctx, db, nil, roachpb.Key(key), ts, roachpb.MakeValueFromString(key),
+			nil); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	reqs := []RocksDBReadRequest{
+		{Tag: 1, Key: roachpb.Key("a"), Timestamp: ts, Consistent: true},
+		{Tag: 2, Key: roachpb.Key("missing"), Timestamp: ts, Consistent: true},
+		{Tag: 3, Key: roachpb.Key("a"), EndKey: roachpb.Key("z"), Timestamp: ts, MaxKeys: 10,
+			Consistent: true},
+		{Tag: 4, Key: roachpb.Key("a"), Timestamp: ts, Txn: txn1},
+	}
+	if err := db.SubmitReads(queue, reqs[3:]); !testutils.IsError(err, "inconsistent reads") {
+		t.Fatalf("expected inconsistent reads error, got %v", err)
+	}
+	if err := db.SubmitReads(queue, reqs[:3]); err != nil {
+		t.Fatal(err)
+	}
+
+	counts := make(map[uint64]int)
+	for len(counts) < 3 {
+		for _, res := range queue.Poll(2, -1) {
+			if res.Err != nil {
+				t.Fatalf("%d: %v", res.Tag, res.Err)
+			}
+			if len(res.ResumeKey) != 0 {
+				t.Errorf("%d: unexpected resume key %s", res.Tag, res.ResumeKey)
+			}
+			var count int
+			if len(res.KVs) > 0 {
+				if count, _, err = mvccScanDecodeHeader(res.KVs); err != nil {
+					t.Fatal(err)
+				}
+			}
+			counts[res.Tag] = count
+		}
+	}
+	if expected := map[uint64]int{1: 1, 2: 0, 3: 3}; !reflect.DeepEqual(expected, counts) {
+		t.Errorf("expected counts %v, got %v", expected, counts)
+	}
+	if res := queue.Poll(1, 0); len(res) != 0 {
+		t.Errorf("unexpected results %v", res)
+	}
+
+	stats, err := db.GetReadPoolStats()
+	if err != nil {
+		t.Fatal(err)
+	}
+	if stats.Queued != 0 || stats.QueueNanos.Count != 3 || stats.ServiceNanos.Count != 3 {
+		t.Errorf("unexpected read pool stats %+v", stats)
+	}
+}
@@ -202,6 +202,24 @@ var (
 	metaRdbNumSSTables = metric.Metadata{
 		Name: "rocksdb.num-sstables",
 		Help: "Number of rocksdb SSTables"}
+	metaRdbMVCCScanLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.mvcc-scan-p99",
+		Help: "99th percentile latency in nanoseconds of MVCC scans since the store was opened"}
+	metaRdbMVCCGetLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.mvcc-get-p99",
+		Help: "99th percentile latency in nanoseconds of MVCC gets since the store was opened"}
+	metaRdbIterSeekLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.iter-seek-p99",
+		Help: "99th percentile latency in nanoseconds of iterator seeks since the store was opened"}
+	metaRdbCommitBatchLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.commit-batch-p99",
+		Help: "99th percentile latency in nanoseconds of batch commits since the store was opened"}
+	metaRdbApplyBatchReprLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.apply-batch-repr-p99",
+		Help: "99th percentile latency in nanoseconds of batch applications since the store opened"}
+	metaRdbSyncWALLatencyP99 = metric.Metadata{
+		Name: "rocksdb.latency.sync-wal-p99",
+		Help: "99th percentile latency in nanoseconds of WAL syncs since the store was opened"}
 
 	// Range event metrics.
 	metaRangeSplits = metric.Metadata{
@@ -539,6 +557,12 @@ type StoreMetrics struct {
 	RdbTableReadersMemEstimate  *metric.Gauge
 	RdbReadAmplification        *metric.Gauge
 	RdbNumSSTables              *metric.Gauge
+	RdbMVCCScanLatencyP99       *metric.Gauge
+	RdbMVCCGetLatencyP99        *metric.Gauge
+	RdbIterSeekLatencyP99       *metric.Gauge
+	RdbCommitBatchLatencyP99    *metric.Gauge
+	RdbApplyBatchReprLatencyP99 *metric.Gauge
+	RdbSyncWALLatencyP99        *metric.Gauge
 
 	// TODO(mrtracy): This should be removed as part of #4465. This is only
 	// maintained to keep the current structure of StatusSummaries; it would be
@@ -730,6 +754,12 @@ func newStoreMetrics(histogramWindow time.Duration) *StoreMetrics {
 		RdbTableReadersMemEstimate:  metric.NewGauge(metaRdbTableReadersMemEstimate),
 		RdbReadAmplification:        metric.NewGauge(metaRdbReadAmplification),
 		RdbNumSSTables:              metric.NewGauge(metaRdbNumSSTables),
+		RdbMVCCScanLatencyP99:       metric.NewGauge(metaRdbMVCCScanLatencyP99),
+		RdbMVCCGetLatencyP99:        metric.NewGauge(metaRdbMVCCGetLatencyP99),
+		RdbIterSeekLatencyP99:       metric.NewGauge(metaRdbIterSeekLatencyP99),
+		RdbCommitBatchLatencyP99:    metric.NewGauge(metaRdbCommitBatchLatencyP99),
+		RdbApplyBatchReprLatencyP99: metric.NewGauge(metaRdbApplyBatchReprLatencyP99),
+		RdbSyncWALLatencyP99:        metric.NewGauge(metaRdbSyncWALLatencyP99),
 
 		// Range event metrics.
 		RangeSplits:                     metric.NewCounter(metaRangeSplits),
@@ -906,6 +936,15 @@ func (sm *StoreMetrics) updateRocksDBStats(stats engine.Stats) {
 	sm.RdbTableReadersMemEstimate.Update(stats.TableReadersMemEstimate)
 }
 
+func (sm *StoreMetrics) updateRocksDBLatencyStats(stats engine.LatencyStats) {
+	sm.RdbMVCCScanLatencyP99.Update(stats.MVCCScan.P99)
+	sm.RdbMVCCGetLatencyP99.Update(stats.MVCCGet.P99)
+	sm.RdbIterSeekLatencyP99.Update(stats.IterSeek.P99)
+	sm.RdbCommitBatchLatencyP99.Update(stats.CommitBatch.P99)
+	sm.RdbApplyBatchReprLatencyP99.Update(stats.ApplyBatchRepr.P99)
+	sm.RdbSyncWALLatencyP99.Update(stats.SyncWAL.P99)
+}
+
 func (sm *StoreMetrics) leaseRequestComplete(success bool) {
 	if success {
 		sm.LeaseRequestSuccessCount.Inc(1)
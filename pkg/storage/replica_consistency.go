@@ -49,6 +49,10 @@ const (
 	// is caught up via a snapshot and never performs the ComputeChecksum
 	// operation.
 	collectChecksumTimeout = 5 * time.Second
+
+	// consistencyChecksumConcurrency is the number of threads computing the
+	// checksum of a replica for a consistency check.
+	consistencyChecksumConcurrency = 4
 )
 
 // CheckConsistency runs a consistency check on the range. It first applies a
@@ -375,6 +379,27 @@ func (r *Replica) sha512(
 ) (*replicaHash, error) {
 	legacyTombstoneKey := engine.MakeMVCCMetadataKey(keys.RaftTombstoneIncorrectLegacyKey(desc.RangeID))
 
+	var result replicaHash
+	if snapshot == nil {
+		// Without a snapshot to collect, the data is hashed in C++.
+		var spans []roachpb.Span
+		for _, span := range rditer.MakeReplicatedKeyRanges(&desc) {
+			spans = append(spans, roachpb.Span{Key: span.Start.Key, EndKey: span.End.Key})
+		}
+		checksum, ms, ok, err := engine.ComputeChecksum(
+			snap, spans, legacyTombstoneKey.Key, true /* computeStats */, 0, /* nowNanos */
+			consistencyChecksumConcurrency,
+		)
+		if ok {
+			if err != nil {
+				return nil, err
+			}
+			result.RecomputedMS = ms
+			copy(result.SHA512[:], checksum)
+			return finishReplicaHash(ctx, desc, snap, &result)
+		}
+	}
+
 	// Iterate over all the data in the range.
 	iter := snap.NewIterator(false /* prefix */)
 	defer iter.Close()
@@ -436,10 +461,16 @@ func (r *Replica) sha512(
 		ms.Add(spanMS)
 	}
 
-	var result replicaHash
 	result.RecomputedMS = ms
 	hasher.Sum(result.SHA512[:0])
+	return finishReplicaHash(ctx, desc, snap, &result)
+}
 
+// finishReplicaHash adds the persisted MVCC stats of the replica to the
+// result of sha512.
+func finishReplicaHash(
+	ctx context.Context, desc roachpb.RangeDescriptor, snap engine.Reader, result *replicaHash,
+) (*replicaHash, error) {
 	ok, err := engine.MVCCGetProto(
 		ctx, snap, keys.RangeStatsKey(desc.RangeID), hlc.Timestamp{},
 		true /* consistent */, nil /* txn */, &result.PersistedMS,
@@ -455,5 +486,5 @@ func (r *Replica) sha512(
 	// the same timestamp.
 	result.RecomputedMS.AgeTo(result.PersistedMS.LastUpdateNanos)
 
-	return &result, nil
+	return result, nil
 }
@@ -4395,6 +4395,11 @@ func (s *Store) ComputeMetrics(ctx context.Context, tick int) error {
 		s.metrics.RdbNumSSTables.Update(int64(sstables.Len()))
 		readAmp := sstables.ReadAmplification()
 		s.metrics.RdbReadAmplification.Update(int64(readAmp))
+		latencyStats, err := rocksdb.GetLatencyStats()
+		if err != nil {
+			return err
+		}
+		s.metrics.updateRocksDBLatencyStats(latencyStats)
 		// Log this metric infrequently.
 		if tick%60 == 0 /* every 10m */ {
 			log.Infof(ctx, "sstables (read amplification = %d):\n%s", readAmp, sstables)
@@ -41,6 +41,19 @@ var TimeseriesStorageEnabled = settings.RegisterBoolSetting(
 	true,
 )
 
+// TimeseriesColumnarEncodingEnabled controls whether timeseries data is stored
+// in the compact columnar encoding (see roachpb.EncodeColumnarTimeSeries)
+// rather than as InternalTimeSeriesData messages. Values in either encoding
+// can be merged with each other. The setting only takes effect once the
+// cluster version is at least VersionColumnarTimeSeries, as older nodes can't
+// read the encoding.
+var TimeseriesColumnarEncodingEnabled = settings.RegisterBoolSetting(
+	"timeseries.storage.columnar.enabled",
+	"if set, timeseries data is stored in a compact columnar encoding once the cluster "+
+		"version allows it",
+	false,
+)
+
 // Resolution10StoreDuration defines the amount of time to store internal metrics
 var Resolution10StoreDuration = settings.RegisterDurationSetting(
 	"timeseries.resolution_10s.storage_duration",
@@ -72,6 +85,13 @@ func NewDB(db *client.DB, settings *cluster.Settings) *DB {
 	}
 }
 
+// columnarEncodingEnabled returns whether time series data is to be written in
+// the columnar encoding.
+func (db *DB) columnarEncodingEnabled() bool {
+	return TimeseriesColumnarEncodingEnabled.Get(&db.st.SV) &&
+		db.st.Version.IsActive(cluster.VersionColumnarTimeSeries)
+}
+
 // A DataSource can be queryied for a slice of time series data.
 type DataSource interface {
 	GetTimeSeriesData() []tspb.TimeSeriesData
@@ -172,7 +192,11 @@ func (db *DB) StoreData(ctx context.Context, r Resolution, data []tspb.TimeSerie
 		}
 		for _, idata := range idatas {
 			var value roachpb.Value
-			if err := value.SetProto(&idata); err != nil {
+			if db.columnarEncodingEnabled() {
+				if err := value.SetColumnarTimeseries(idata); err != nil {
+					return err
+				}
+			} else if err := value.SetProto(&idata); err != nil {
 				return err
 			}
 			kvs = append(kvs, roachpb.KeyValue{
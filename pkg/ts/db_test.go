@@ -27,6 +27,7 @@ import (
 	"github.com/cockroachdb/cockroach/pkg/keys"
 	"github.com/cockroachdb/cockroach/pkg/kv"
 	"github.com/cockroachdb/cockroach/pkg/roachpb"
+	"github.com/cockroachdb/cockroach/pkg/settings/cluster"
 	"github.com/cockroachdb/cockroach/pkg/storage/engine"
 	"github.com/cockroachdb/cockroach/pkg/testutils"
 	"github.com/cockroachdb/cockroach/pkg/testutils/localtestcluster"
@@ -495,3 +496,27 @@ func TestPruneThreshold(t *testing.T) {
 		t.Errorf("prune threshold did not match expected value: %d != %d", expected, result)
 	}
 }
+
+// TestColumnarEncodingEnabled verifies that the columnar encoding is only used
+// once both the setting is enabled and the cluster version allows it.
+func TestColumnarEncodingEnabled(t *testing.T) {
+	defer leaktest.AfterTest(t)()
+	for _, tc := range []struct {
+		version  cluster.VersionKey
+		enabled  bool
+		expected bool
+	}{
+		{cluster.VersionRecomputeStats, false, false},
+		{cluster.VersionRecomputeStats, true, false},
+		{cluster.VersionColumnarTimeSeries, false, false},
+		{cluster.VersionColumnarTimeSeries, true, true},
+	} {
+		v := cluster.VersionByKey(tc.version)
+		st := cluster.MakeTestingClusterSettingsWithVersion(v, v)
+		TimeseriesColumnarEncodingEnabled.Override(&st.SV, tc.enabled)
+		db := NewDB(nil, st)
+		if actual := db.columnarEncodingEnabled(); actual != tc.expected {
+			t.Errorf("version %s, enabled %t: expected %t, got %t", v, tc.enabled, tc.expected, actual)
+		}
+	}
+}